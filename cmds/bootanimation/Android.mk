@@ -16,7 +16,8 @@ LOCAL_SHARED_LIBRARIES := \
 	libskia \
     libEGL \
     libGLESv1_CM \
-    libgui
+    libgui \
+    libETC1
 
 LOCAL_C_INCLUDES := \
 	$(call include-path-for, corecg graphics)
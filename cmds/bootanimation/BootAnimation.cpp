@@ -49,6 +49,8 @@
 #include <GLES/glext.h>
 #include <EGL/eglext.h>
 
+#include <ETC1/etc1.h>
+
 #include "BootAnimation.h"
 
 #define USER_BOOTANIMATION_FILE "/data/local/bootanimation.zip"
@@ -151,16 +153,42 @@ status_t BootAnimation::initTexture(Texture* texture, AssetManager& assets,
     return NO_ERROR;
 }
 
-status_t BootAnimation::initTexture(void* buffer, size_t len)
+void BootAnimation::decodeFrame(const void* buffer, size_t len, bool hasETC1,
+        DecodedFrame* frame)
 {
-    //StopWatch watch("blah");
+    const etc1_byte* pkm = static_cast<const etc1_byte*>(buffer);
+    frame->compressed = NULL;
+    frame->bitmap.reset();
+
+    if (len >= ETC_PKM_HEADER_SIZE && etc1_pkm_is_valid(pkm)) {
+        const int w = etc1_pkm_get_width(pkm);
+        const int h = etc1_pkm_get_height(pkm);
+        if (len < ETC_PKM_HEADER_SIZE + etc1_get_encoded_data_size(w, h)) {
+            ALOGW("Truncated ETC1 frame");
+            return;
+        }
+
+        // ETC1 textures cannot be updated in part, so only power of two
+        // frames are uploaded compressed. Others are decoded to 565.
+        if (hasETC1 && w >= 4 && h >= 4 && !(w & (w - 1)) && !(h & (h - 1))) {
+            frame->compressed = buffer;
+            return;
+        }
+
+        frame->bitmap.setConfig(SkBitmap::kRGB_565_Config, w, h);
+        if (frame->bitmap.allocPixels()) {
+            etc1_decode_image(pkm + ETC_PKM_HEADER_SIZE,
+                    static_cast<etc1_byte*>(frame->bitmap.getPixels()),
+                    w, h, 2, frame->bitmap.rowBytes());
+        }
+        return;
+    }
 
-    SkBitmap bitmap;
     SkMemoryStream  stream(buffer, len);
     SkImageDecoder* codec = SkImageDecoder::Factory(&stream);
-    codec->setDitherImage(false);
     if (codec) {
-        codec->decode(&stream, &bitmap,
+        codec->setDitherImage(false);
+        codec->decode(&stream, &frame->bitmap,
                 #ifdef USE_565
                 SkBitmap::kRGB_565_Config,
                 #else
@@ -169,14 +197,36 @@ status_t BootAnimation::initTexture(void* buffer, size_t len)
                 SkImageDecoder::kDecodePixels_Mode);
         delete codec;
     }
+}
 
-    // ensure we can call getPixels(). No need to call unlock, since the
-    // bitmap will go out of scope when we return from this method.
+status_t BootAnimation::initTexture(const DecodedFrame& frame)
+{
+    //StopWatch watch("blah");
+
+    if (frame.compressed) {
+        const etc1_byte* pkm = static_cast<const etc1_byte*>(frame.compressed);
+        const int w = etc1_pkm_get_width(pkm);
+        const int h = etc1_pkm_get_height(pkm);
+
+        GLint crop[4] = { 0, h, w, -h };
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_ETC1_RGB8_OES, w, h, 0,
+                etc1_get_encoded_data_size(w, h), pkm + ETC_PKM_HEADER_SIZE);
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_CROP_RECT_OES, crop);
+        return NO_ERROR;
+    }
+
+    const SkBitmap& bitmap(frame.bitmap);
+
+    // ensure we can call getPixels(). The pixels stay locked until the
+    // decoder reuses the frame.
     bitmap.lockPixels();
 
     const int w = bitmap.width();
     const int h = bitmap.height();
     const void* p = bitmap.getPixels();
+    if (w == 0 || h == 0) {
+        return NO_ERROR;
+    }
 
     GLint crop[4] = { 0, h, w, -h };
     int tw = 1 << (31 - __builtin_clz(w));
@@ -217,6 +267,137 @@ status_t BootAnimation::initTexture(void* buffer, size_t len)
     return NO_ERROR;
 }
 
+status_t BootAnimation::updateTexture(const DecodedFrame& frame, int x, int y,
+        SkBitmap::Config config)
+{
+    SkBitmap bitmap(frame.bitmap);
+    if (bitmap.getConfig() != config) {
+        // The texture keeps the format of the first frame of the part
+        if (!frame.bitmap.copyTo(&bitmap, config)) {
+            return NO_MEMORY;
+        }
+    }
+    bitmap.lockPixels();
+
+    const void* p = bitmap.getPixels();
+    switch (config) {
+        case SkBitmap::kARGB_8888_Config:
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, bitmap.width(), bitmap.height(),
+                    GL_RGBA, GL_UNSIGNED_BYTE, p);
+            break;
+        case SkBitmap::kRGB_565_Config:
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, bitmap.width(), bitmap.height(),
+                    GL_RGB, GL_UNSIGNED_SHORT_5_6_5, p);
+            break;
+        default:
+            break;
+    }
+
+    bitmap.unlockPixels();
+    return NO_ERROR;
+}
+
+// Each line of delta.txt is "<frame> <x> <y>", the frame only holds the region
+// at x, y (from the top left corner) that changed since the previous frame.
+// Frames that are not listed replace the whole animation.
+void BootAnimation::parseDelta(Animation::Part& part, FileMap* map)
+{
+    String8 delta((char const*)map->getDataPtr(), map->getDataLength());
+    char const* s = delta.string();
+    for (;;) {
+        const char* endl = strstr(s, "\n");
+        if (!endl) break;
+        String8 line(s, endl - s);
+        char name[256];
+        int x, y;
+        if (sscanf(line.string(), "%255s %d %d", name, &x, &y) == 3) {
+            Animation::Frame key;
+            key.name = name;
+            ssize_t index = part.frames.indexOf(key);
+            if (index >= 0) {
+                Animation::Frame& frame(part.frames.editItemAt(index));
+                frame.partial = true;
+                frame.x = x;
+                frame.y = y;
+            }
+        }
+        s = ++endl;
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+BootAnimation::FrameDecoder::FrameDecoder(const Animation::Part& part, int repeats,
+        bool hasETC1)
+    : Thread(false), mPart(part), mRepeats(repeats), mHasETC1(hasETC1),
+      mRepeat(0), mNext(0), mReadIndex(0), mWriteIndex(0), mFilled(0)
+{
+}
+
+const BootAnimation::DecodedFrame& BootAnimation::FrameDecoder::acquireFrame()
+{
+    Mutex::Autolock _l(mLock);
+    while (mFilled == 0) {
+        mCondition.wait(mLock);
+    }
+    return mFrames[mReadIndex];
+}
+
+void BootAnimation::FrameDecoder::releaseFrame()
+{
+    Mutex::Autolock _l(mLock);
+    mReadIndex = (mReadIndex + 1) % FRAME_DECODE_AHEAD;
+    mFilled--;
+    mCondition.broadcast();
+}
+
+void BootAnimation::FrameDecoder::stop()
+{
+    requestExit();
+    {
+        Mutex::Autolock _l(mLock);
+        mCondition.broadcast();
+    }
+    requestExitAndWait();
+}
+
+bool BootAnimation::FrameDecoder::threadLoop()
+{
+    const size_t fcount = mPart.frames.size();
+    if (fcount == 0 || (mRepeats && mRepeat >= mRepeats)) {
+        return false;
+    }
+
+    DecodedFrame* frame;
+    {
+        Mutex::Autolock _l(mLock);
+        while (mFilled == FRAME_DECODE_AHEAD && !exitPending()) {
+            mCondition.wait(mLock);
+        }
+        if (exitPending()) {
+            return false;
+        }
+        frame = &mFrames[mWriteIndex];
+    }
+
+    // The slot is not visible to the display loop until it is counted as filled
+    const Animation::Frame& source(mPart.frames[mNext]);
+    decodeFrame(source.map->getDataPtr(), source.map->getDataLength(), mHasETC1, frame);
+
+    if (++mNext == fcount) {
+        mNext = 0;
+        mRepeat++;
+    }
+
+    Mutex::Autolock _l(mLock);
+    mWriteIndex = (mWriteIndex + 1) % FRAME_DECODE_AHEAD;
+    mFilled++;
+    mCondition.broadcast();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
 status_t BootAnimation::readyToRun() {
     mAssets.addDefaultAssets();
 
@@ -463,6 +644,7 @@ bool BootAnimation::movie()
             part.count = count;
             part.pause = pause;
             part.path = path;
+            part.delta = false;
             animation.parts.add(part);
         }
 
@@ -471,6 +653,8 @@ bool BootAnimation::movie()
 
     // read all the data structures
     const size_t pcount = animation.parts.size();
+    Vector<FileMap*> deltaMaps;
+    deltaMaps.insertAt(NULL, 0, pcount);
     for (size_t i=0 ; i<numEntries ; i++) {
         char name[256];
         ZipEntryRO entry = zip.findEntryByIndex(i);
@@ -486,10 +670,14 @@ bool BootAnimation::movie()
                         if (zip.getEntryInfo(entry, &method, 0, 0, 0, 0, 0)) {
                             if (method == ZipFileRO::kCompressStored) {
                                 FileMap* map = zip.createEntryFileMap(entry);
-                                if (map) {
+                                if (map && leaf == "delta.txt") {
+                                    deltaMaps.editItemAt(j) = map;
+                                } else if (map) {
                                     Animation::Frame frame;
                                     frame.name = leaf;
                                     frame.map = map;
+                                    frame.partial = false;
+                                    frame.x = frame.y = 0;
                                     Animation::Part& part(animation.parts.editItemAt(j));
                                     part.frames.add(frame);
                                 }
@@ -501,6 +689,22 @@ bool BootAnimation::movie()
         }
     }
 
+    bool hasDelta = false;
+    for (size_t j=0 ; j<pcount ; j++) {
+        if (deltaMaps[j]) {
+            Animation::Part& part(animation.parts.editItemAt(j));
+            parseDelta(part, deltaMaps[j]);
+            part.delta = true;
+            hasDelta = true;
+            deltaMaps[j]->release();
+        }
+    }
+
+    // Partial frames only redraw their region when the content of the
+    // surface is kept across swaps
+    const bool preserved = hasDelta && eglSurfaceAttrib(mDisplay, mSurface,
+            EGL_SWAP_BEHAVIOR, EGL_BUFFER_PRESERVED) == EGL_TRUE;
+
     // clear screen
     glShadeModel(GL_FLAT);
     glDisable(GL_DITHER);
@@ -527,6 +731,10 @@ bool BootAnimation::movie()
     Region clearReg(Rect(mWidth, mHeight));
     clearReg.subtractSelf(Rect(xc, yc, xc+animation.width, yc+animation.height));
 
+    const char* extensions = (const char*) glGetString(GL_EXTENSIONS);
+    const bool hasETC1 = extensions &&
+            strstr(extensions, "GL_OES_compressed_ETC1_RGB8_texture") != NULL;
+
     for (int i=0 ; i<pcount ; i++) {
         const Animation::Part& part(animation.parts[i]);
         const size_t fcount = part.frames.size();
@@ -541,6 +749,24 @@ bool BootAnimation::movie()
 
         glBindTexture(GL_TEXTURE_2D, 0);
 
+        // Partial frames are applied in order to a single texture, which is
+        // rebuilt on every run from the first frame of the part. That frame
+        // must be a full one. ETC1 textures cannot be updated in part.
+        GLuint deltaTexture = 0;
+        SkBitmap::Config deltaConfig = SkBitmap::kNo_Config;
+        if (part.delta) {
+            glGenTextures(1, &deltaTexture);
+            glBindTexture(GL_TEXTURE_2D, deltaTexture);
+            glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+
+        // Frames are uploaded on the first run of the part only, unless the
+        // textures are not cached
+        sp<FrameDecoder> decoder = new FrameDecoder(part,
+                noTextureCache || part.delta ? part.count : 1, hasETC1 && !part.delta);
+        decoder->run("BootAnimationDecoder", PRIORITY_DISPLAY);
+
         for (int r=0 ; !part.count || r<part.count ; r++) {
             // Exit any non playuntil complete parts immediately
             if(exitPending() && !part.playUntilComplete)
@@ -550,7 +776,23 @@ bool BootAnimation::movie()
                 const Animation::Frame& frame(part.frames[j]);
                 nsecs_t lastFrame = systemTime();
 
-                if (r > 0 && !noTextureCache) {
+                Rect dirty;
+                if (part.delta) {
+                    const DecodedFrame& decoded(decoder->acquireFrame());
+                    if (frame.partial && deltaConfig != SkBitmap::kNo_Config) {
+                        updateTexture(decoded, frame.x, frame.y, deltaConfig);
+                        if (preserved) {
+                            // in GL coordinates, from the bottom left corner
+                            const int bottom = yc + animation.height - frame.y;
+                            dirty.set(xc + frame.x, bottom - decoded.bitmap.height(),
+                                    xc + frame.x + decoded.bitmap.width(), bottom);
+                        }
+                    } else {
+                        initTexture(decoded);
+                        deltaConfig = decoded.bitmap.getConfig();
+                    }
+                    decoder->releaseFrame();
+                } else if (r > 0 && !noTextureCache) {
                     glBindTexture(GL_TEXTURE_2D, frame.tid);
                 } else {
                     if (part.count != 1) {
@@ -559,25 +801,33 @@ bool BootAnimation::movie()
                         glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
                         glTexParameterx(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
                     }
-                    initTexture(
-                            frame.map->getDataPtr(),
-                            frame.map->getDataLength());
+                    initTexture(decoder->acquireFrame());
+                    decoder->releaseFrame();
                 }
 
-                if (!clearReg.isEmpty()) {
-                    Region::const_iterator head(clearReg.begin());
-                    Region::const_iterator tail(clearReg.end());
+                if (!dirty.isEmpty()) {
+                    // The rest of the surface still shows the previous frame
                     glEnable(GL_SCISSOR_TEST);
-                    while (head != tail) {
-                        const Rect& r(*head++);
-                        glScissor(r.left, mHeight - r.bottom,
-                                r.width(), r.height());
-                        glClear(GL_COLOR_BUFFER_BIT);
-                    }
+                    glScissor(dirty.left, dirty.top, dirty.width(), dirty.height());
+                    glDrawTexiOES(xc, yc, 0, animation.width, animation.height);
                     glDisable(GL_SCISSOR_TEST);
+                    eglSwapBuffers(mDisplay, mSurface);
+                } else {
+                    if (!clearReg.isEmpty()) {
+                        Region::const_iterator head(clearReg.begin());
+                        Region::const_iterator tail(clearReg.end());
+                        glEnable(GL_SCISSOR_TEST);
+                        while (head != tail) {
+                            const Rect& r(*head++);
+                            glScissor(r.left, mHeight - r.bottom,
+                                    r.width(), r.height());
+                            glClear(GL_COLOR_BUFFER_BIT);
+                        }
+                        glDisable(GL_SCISSOR_TEST);
+                    }
+                    glDrawTexiOES(xc, yc, 0, animation.width, animation.height);
+                    eglSwapBuffers(mDisplay, mSurface);
                 }
-                glDrawTexiOES(xc, yc, 0, animation.width, animation.height);
-                eglSwapBuffers(mDisplay, mSurface);
 
                 nsecs_t now = systemTime();
                 nsecs_t delay = frameDuration - (now - lastFrame);
@@ -596,7 +846,7 @@ bool BootAnimation::movie()
 
                 checkExit();
  
-                if (noTextureCache)
+                if (noTextureCache && !part.delta)
                     glDeleteTextures(1, &frame.tid);
             }
 
@@ -607,8 +857,12 @@ bool BootAnimation::movie()
                 break;
         }
 
+        decoder->stop();
+
         // free the textures for this part
-        if (part.count != 1 && !noTextureCache) {
+        if (part.delta) {
+            glDeleteTextures(1, &deltaTexture);
+        } else if (part.count != 1 && !noTextureCache) {
             for (size_t j=0 ; j<fcount ; j++) {
                 const Animation::Frame& frame(part.frames[j]);
                 glDeleteTextures(1, &frame.tid);
@@ -26,7 +26,7 @@
 #include <EGL/egl.h>
 #include <GLES/gl.h>
 
-class SkBitmap;
+#include <core/SkBitmap.h>
 
 namespace android {
 
@@ -60,6 +60,11 @@ private:
         struct Frame {
             String8 name;
             FileMap* map;
+            // Position of the frame in the animation when it only holds the
+            // region that changed since the previous frame
+            bool partial;
+            int x;
+            int y;
             mutable GLuint tid;
             bool operator < (const Frame& rhs) const {
                 return name < rhs.name;
@@ -71,6 +76,8 @@ private:
             String8 path;
             SortedVector<Frame> frames;
             bool playUntilComplete;
+            // Set when the part has a delta.txt listing its partial frames
+            bool delta;
         };
         int fps;
         int width;
@@ -78,8 +85,58 @@ private:
         Vector<Part> parts;
     };
 
+    // Frames decoded by the FrameDecoder, ready to be uploaded
+    struct DecodedFrame {
+        SkBitmap bitmap;
+        // ETC1 data in PKM format, uploaded as is when not NULL
+        const void* compressed;
+    };
+
+    /**
+     * Decodes the frames of a part on its own thread, ahead of display, into a
+     * ring of FRAME_DECODE_AHEAD frames. Frames are decoded in the order they
+     * are displayed, for the given number of repeats of the part, 0 meaning
+     * forever.
+     */
+    class FrameDecoder : public Thread {
+    public:
+        FrameDecoder(const Animation::Part& part, int repeats, bool hasETC1);
+
+        /**
+         * Waits for the next frame, which stays valid until releaseFrame().
+         */
+        const DecodedFrame& acquireFrame();
+        void releaseFrame();
+
+        /**
+         * Stops decoding and waits for the thread to exit.
+         */
+        void stop();
+
+    private:
+        virtual bool threadLoop();
+
+        enum { FRAME_DECODE_AHEAD = 3 };
+
+        const Animation::Part& mPart;
+        const int mRepeats;
+        const bool mHasETC1;
+        int mRepeat;
+        size_t mNext;
+
+        Mutex mLock;
+        Condition mCondition;
+        DecodedFrame mFrames[FRAME_DECODE_AHEAD];
+        int mReadIndex;
+        int mWriteIndex;
+        int mFilled;
+    };
+
     status_t initTexture(Texture* texture, AssetManager& asset, const char* name);
-    status_t initTexture(void* buffer, size_t len);
+    static void decodeFrame(const void* buffer, size_t len, bool hasETC1, DecodedFrame* frame);
+    status_t initTexture(const DecodedFrame& frame);
+    status_t updateTexture(const DecodedFrame& frame, int x, int y, SkBitmap::Config config);
+    static void parseDelta(Animation::Part& part, FileMap* map);
     bool android();
     bool movie();
 
@@ -14,12 +14,28 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
+#include <unistd.h>
+
 #include <binder/BinderService.h>
+#include <SensorDevice.h>
 #include <SensorService.h>
 
 using namespace android;
 
 int main(int argc, char** argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        switch (opt) {
+            case 'r':
+                // record the raw h/w sensor events, see sensorreplay
+                SensorDevice::getInstance().startRecording(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-r recording]\n", argv[0]);
+                return 1;
+        }
+    }
     SensorService::publishAndJoinThreadPool();
     return 0;
 }
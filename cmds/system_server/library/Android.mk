@@ -17,6 +17,7 @@ LOCAL_SHARED_LIBRARIES := \
 	libsensorservice \
 	libsurfaceflinger \
     libinput \
+	libandroidfw \
 	libutils \
 	libbinder \
 	libcutils
@@ -17,6 +17,8 @@
 #include <SurfaceFlinger.h>
 #include <SensorService.h>
 
+#include <androidfw/AssetManager.h>
+
 #include <android_runtime/AndroidRuntime.h>
 
 #include <signal.h>
@@ -72,6 +74,10 @@ extern "C" status_t system_init()
         SensorService::instantiate();
     }
 
+    // The system server owns the resource cache, keep the bags of the
+    // system resources the zygote maps in it up to date
+    AssetManager::setWritesSystemBagCache(true);
+
     // And now start the Android runtime.  We have to do this bit
     // of nastiness because the Android runtime initialization requires
     // some of the core system services to already be started.
@@ -37,7 +37,10 @@
 #include "android_util_Binder.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <signal.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <signal.h>
@@ -779,6 +782,125 @@ char* AndroidRuntime::toSlashClassName(const char* className)
     return result;
 }
 
+/*
+ * Steps of the zygote startup, written out as a boot profile when the
+ * debug.zygote.profile property names a file.
+ */
+struct BootProfileStep {
+    const char* name;
+    nsecs_t duration;
+    off64_t size;
+};
+
+static Mutex gBootProfileLock;
+static Vector<BootProfileStep> gBootProfile;
+
+static void recordBootStep(const char* name, nsecs_t start, off64_t size = 0)
+{
+    BootProfileStep step;
+    step.name = name;
+    step.duration = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    step.size = size;
+
+    AutoMutex _l(gBootProfileLock);
+    gBootProfile.add(step);
+}
+
+static void writeBootProfile()
+{
+    char path[PROPERTY_VALUE_MAX];
+    if (property_get("debug.zygote.profile", path, NULL) <= 0) {
+        return;
+    }
+
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        ALOGW("Unable to write boot profile to %s: %s", path, strerror(errno));
+        return;
+    }
+
+    AutoMutex _l(gBootProfileLock);
+    for (size_t i = 0; i < gBootProfile.size(); i++) {
+        const BootProfileStep& step(gBootProfile[i]);
+        fprintf(fp, "%s %lld %lld\n", step.name, ns2us(step.duration), step.size);
+    }
+    fclose(fp);
+}
+
+/*
+ * Reads the boot class path and the framework resources while the VM starts
+ * and registers the natives, so that the classes and drawables preloaded by
+ * ZygoteInit are already in the page cache. The thread does not call into
+ * the VM and is stopped before main() runs, as the zygote must be single
+ * threaded when it forks.
+ */
+class ZygoteWarmupThread : public Thread {
+public:
+    ZygoteWarmupThread(const char* rootDir) : Thread(false) {
+        const char* bootClassPath = getenv("BOOTCLASSPATH");
+        if (bootClassPath != NULL) {
+            char* paths = strdup(bootClassPath);
+            char* save;
+            for (char* jar = strtok_r(paths, ":", &save); jar != NULL;
+                    jar = strtok_r(NULL, ":", &save)) {
+                addDexFile(jar);
+            }
+            free(paths);
+        }
+        mFiles.add(String8::format("%s/framework/framework-res.apk", rootDir));
+    }
+
+private:
+    // The optimized dex file is next to the jar when the system is
+    // preoptimized, otherwise in the dalvik cache.
+    void addDexFile(const char* jar) {
+        String8 odex(jar);
+        odex = odex.getBasePath();
+        odex.append(".odex");
+        if (access(odex.string(), R_OK) == 0) {
+            mFiles.add(odex);
+            return;
+        }
+
+        String8 name(jar[0] == '/' ? jar + 1 : jar);
+        for (char* p = name.lockBuffer(name.size()); *p; p++) {
+            if (*p == '/') {
+                *p = '@';
+            }
+        }
+        name.unlockBuffer();
+        mFiles.add(String8::format("/data/dalvik-cache/%s@classes.dex", name.string()));
+    }
+
+    virtual bool threadLoop() {
+        const size_t kBufferSize = 64 * 1024;
+        char* buffer = (char*) malloc(kBufferSize);
+        if (buffer == NULL) {
+            return false;
+        }
+
+        for (size_t i = 0; i < mFiles.size() && !exitPending(); i++) {
+            nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+            int fd = open(mFiles[i].string(), O_RDONLY);
+            if (fd < 0) {
+                continue;
+            }
+            off64_t size = 0;
+            ssize_t n;
+            while (!exitPending() && (n = read(fd, buffer, kBufferSize)) > 0) {
+                size += n;
+            }
+            close(fd);
+            recordBootStep(mFiles[i].string(), start, size);
+        }
+
+        free(buffer);
+        return false;
+    }
+
+    Vector<String8> mFiles;
+};
+
 /*
  * Start the Android runtime.  This involves starting the virtual machine
  * and calling the "static void main(String[] args)" method in the class
@@ -798,7 +920,8 @@ void AndroidRuntime::start(const char* className, const char* options)
      * 'startSystemServer == true' means runtime is obsolete and not run from
      * init.rc anymore, so we print out the boot start event here.
      */
-    if (strcmp(options, "start-system-server") == 0) {
+    const bool zygote = strcmp(options, "start-system-server") == 0;
+    if (zygote) {
         /* track our progress through the boot sequence */
         const int LOG_BOOT_PROGRESS_START = 3000;
         LOG_EVENT_LONG(LOG_BOOT_PROGRESS_START,
@@ -818,20 +941,35 @@ void AndroidRuntime::start(const char* className, const char* options)
     //const char* kernelHack = getenv("LD_ASSUME_KERNEL");
     //ALOGD("Found LD_ASSUME_KERNEL='%s'\n", kernelHack);
 
+    sp<ZygoteWarmupThread> warmup;
+    if (zygote) {
+        warmup = new ZygoteWarmupThread(rootDir);
+        warmup->run("ZygoteWarmup", PRIORITY_BACKGROUND);
+    }
+
     /* start the virtual machine */
     JNIEnv* env;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
     if (startVm(&mJavaVM, &env) != 0) {
         return;
     }
     onVmCreated(env);
+    recordBootStep("startVm", start);
 
     /*
      * Register android functions.
      */
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
     if (startReg(env) < 0) {
         ALOGE("Unable to register all android natives\n");
         return;
     }
+    recordBootStep("startReg", start);
+
+    if (warmup != NULL) {
+        warmup->requestExitAndWait();
+        writeBootProfile();
+    }
 
     /*
      * We want to call main() with a String array with arguments in it.
@@ -1041,30 +1179,25 @@ static void quickTest(void* arg)
 }
 #endif
 
-#ifdef NDEBUG
-    #define REG_JNI(name)      { name }
-    struct RegJNIRec {
-        int (*mProc)(JNIEnv*);
-    };
-#else
-    #define REG_JNI(name)      { name, #name }
-    struct RegJNIRec {
-        int (*mProc)(JNIEnv*);
-        const char* mName;
-    };
-#endif
+#define REG_JNI(name)      { name, #name }
+struct RegJNIRec {
+    int (*mProc)(JNIEnv*);
+    const char* mName;
+};
 
 typedef void (*RegJAMProc)();
 
 static int register_jni_procs(const RegJNIRec array[], size_t count, JNIEnv* env)
 {
     for (size_t i = 0; i < count; i++) {
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
         if (array[i].mProc(env) < 0) {
 #ifndef NDEBUG
             ALOGD("----------!!! %s failed to load\n", array[i].mName);
 #endif
             return -1;
         }
+        recordBootStep(array[i].mName, start);
     }
     return 0;
 }
@@ -1106,13 +1239,6 @@ static const RegJNIRec gRegJNI[] = {
     REG_JNI(register_android_view_HardwareRenderer),
     REG_JNI(register_android_view_Surface),
     REG_JNI(register_android_view_TextureView),
-    REG_JNI(register_com_google_android_gles_jni_EGLImpl),
-    REG_JNI(register_com_google_android_gles_jni_GLImpl),
-    REG_JNI(register_android_opengl_jni_GLES10),
-    REG_JNI(register_android_opengl_jni_GLES10Ext),
-    REG_JNI(register_android_opengl_jni_GLES11),
-    REG_JNI(register_android_opengl_jni_GLES11Ext),
-    REG_JNI(register_android_opengl_jni_GLES20),
 
     REG_JNI(register_android_graphics_Bitmap),
     REG_JNI(register_android_graphics_BitmapFactory),
@@ -1161,23 +1287,12 @@ static const RegJNIRec gRegJNI[] = {
     REG_JNI(register_com_android_internal_os_ZygoteInit),
     REG_JNI(register_android_hardware_Camera),
     REG_JNI(register_android_hardware_SensorManager),
-    REG_JNI(register_android_hardware_SerialPort),
-    REG_JNI(register_android_hardware_UsbDevice),
-    REG_JNI(register_android_hardware_UsbDeviceConnection),
-    REG_JNI(register_android_hardware_UsbRequest),
     REG_JNI(register_android_media_AudioRecord),
     REG_JNI(register_android_media_AudioSystem),
     REG_JNI(register_android_media_AudioTrack),
     REG_JNI(register_android_media_JetPlayer),
     REG_JNI(register_android_media_ToneGenerator),
 
-    REG_JNI(register_android_opengl_classes),
-    REG_JNI(register_android_bluetooth_HeadsetBase),
-    REG_JNI(register_android_bluetooth_BluetoothAudioGateway),
-    REG_JNI(register_android_bluetooth_BluetoothSocket),
-    REG_JNI(register_android_server_BluetoothService),
-    REG_JNI(register_android_server_BluetoothEventLoop),
-    REG_JNI(register_android_server_BluetoothA2dpService),
     REG_JNI(register_android_server_NetworkManagementSocketTagger),
     REG_JNI(register_android_server_Watchdog),
     REG_JNI(register_android_ddm_DdmHandleNativeHeap),
@@ -1208,6 +1323,107 @@ static const RegJNIRec gRegJNI[] = {
 
 };
 
+/*
+ * Groups of natives that devices which never use them can leave out of the
+ * zygote by listing them, separated by commas, in the ro.zygote.deferred_jni
+ * property. The classes of a deferred group must also be left out of
+ * preloaded-classes, as some of them call natives in their static
+ * initializers. AndroidRuntime::registerDeferredNatives() registers a group
+ * later on.
+ */
+static const RegJNIRec gRegJNIGles[] = {
+    REG_JNI(register_com_google_android_gles_jni_EGLImpl),
+    REG_JNI(register_com_google_android_gles_jni_GLImpl),
+    REG_JNI(register_android_opengl_jni_GLES10),
+    REG_JNI(register_android_opengl_jni_GLES10Ext),
+    REG_JNI(register_android_opengl_jni_GLES11),
+    REG_JNI(register_android_opengl_jni_GLES11Ext),
+    REG_JNI(register_android_opengl_jni_GLES20),
+    REG_JNI(register_android_opengl_classes),
+};
+
+static const RegJNIRec gRegJNIBluetooth[] = {
+    REG_JNI(register_android_bluetooth_HeadsetBase),
+    REG_JNI(register_android_bluetooth_BluetoothAudioGateway),
+    REG_JNI(register_android_bluetooth_BluetoothSocket),
+    REG_JNI(register_android_server_BluetoothService),
+    REG_JNI(register_android_server_BluetoothEventLoop),
+    REG_JNI(register_android_server_BluetoothA2dpService),
+};
+
+static const RegJNIRec gRegJNIUsb[] = {
+    REG_JNI(register_android_hardware_SerialPort),
+    REG_JNI(register_android_hardware_UsbDevice),
+    REG_JNI(register_android_hardware_UsbDeviceConnection),
+    REG_JNI(register_android_hardware_UsbRequest),
+};
+
+struct RegJNIGroup {
+    const char* mName;
+    const RegJNIRec* mRecs;
+    size_t mCount;
+};
+
+static const RegJNIGroup gRegJNIGroups[] = {
+    { "gles", gRegJNIGles, NELEM(gRegJNIGles) },
+    { "bluetooth", gRegJNIBluetooth, NELEM(gRegJNIBluetooth) },
+    { "usb", gRegJNIUsb, NELEM(gRegJNIUsb) },
+};
+
+static Mutex gRegJNIGroupsLock;
+static bool gRegJNIGroupsRegistered[NELEM(gRegJNIGroups)];
+
+static bool isDeferredGroup(const char* deferred, const char* name)
+{
+    size_t len = strlen(name);
+    for (const char* p = deferred; (p = strstr(p, name)) != NULL; p += len) {
+        if ((p == deferred || p[-1] == ',') && (p[len] == '\0' || p[len] == ',')) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int register_jni_groups(JNIEnv* env, const char* deferred)
+{
+    AutoMutex _l(gRegJNIGroupsLock);
+    for (size_t i = 0; i < NELEM(gRegJNIGroups); i++) {
+        const RegJNIGroup& group(gRegJNIGroups[i]);
+        if (gRegJNIGroupsRegistered[i]
+                || (deferred != NULL && isDeferredGroup(deferred, group.mName))) {
+            continue;
+        }
+        if (register_jni_procs(group.mRecs, group.mCount, env) < 0) {
+            return -1;
+        }
+        gRegJNIGroupsRegistered[i] = true;
+    }
+    return 0;
+}
+
+/*static*/ int AndroidRuntime::registerDeferredNatives(JNIEnv* env, const char* group)
+{
+    AutoMutex _l(gRegJNIGroupsLock);
+    for (size_t i = 0; i < NELEM(gRegJNIGroups); i++) {
+        if (strcmp(gRegJNIGroups[i].mName, group) != 0) {
+            continue;
+        }
+        if (!gRegJNIGroupsRegistered[i]) {
+            env->PushLocalFrame(200);
+            int result = register_jni_procs(gRegJNIGroups[i].mRecs,
+                    gRegJNIGroups[i].mCount, env);
+            env->PopLocalFrame(NULL);
+            if (result < 0) {
+                return -1;
+            }
+            gRegJNIGroupsRegistered[i] = true;
+        }
+        return 0;
+    }
+    ALOGE("Unknown group of natives %s", group);
+    return -1;
+}
+
 /*
  * Register android native functions with the VM.
  */
@@ -1230,7 +1446,11 @@ static const RegJNIRec gRegJNI[] = {
      */
     env->PushLocalFrame(200);
 
-    if (register_jni_procs(gRegJNI, NELEM(gRegJNI), env) < 0) {
+    char deferred[PROPERTY_VALUE_MAX];
+    property_get("ro.zygote.deferred_jni", deferred, "");
+
+    if (register_jni_procs(gRegJNI, NELEM(gRegJNI), env) < 0
+            || register_jni_groups(env, deferred) < 0) {
         env->PopLocalFrame(NULL);
         return -1;
     }
@@ -1252,7 +1472,10 @@ AndroidRuntime* AndroidRuntime::getRuntime()
 extern "C"
 jint Java_com_android_internal_util_WithFramework_registerNatives(
         JNIEnv* env, jclass clazz) {
-    return register_jni_procs(gRegJNI, NELEM(gRegJNI), env);
+    if (register_jni_procs(gRegJNI, NELEM(gRegJNI), env) < 0) {
+        return -1;
+    }
+    return register_jni_groups(env, NULL);
 }
 
 /**
@@ -1260,7 +1483,10 @@ jint Java_com_android_internal_util_WithFramework_registerNatives(
  */
 extern "C"
 jint Java_LoadClass_registerNatives(JNIEnv* env, jclass clazz) {
-    return register_jni_procs(gRegJNI, NELEM(gRegJNI), env);
+    if (register_jni_procs(gRegJNI, NELEM(gRegJNI), env) < 0) {
+        return -1;
+    }
+    return register_jni_groups(env, NULL);
 }
 
 }   // namespace android
@@ -20,6 +20,7 @@
 #include <netinet/in.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 jfieldID gOptions_justBoundsFieldID;
 jfieldID gOptions_sampleSizeFieldID;
@@ -152,12 +153,41 @@ static SkPixelRef* installPixelRef(SkBitmap* bitmap, SkStream* stream,
     return pr;
 }
 
+// Allocator that gives the decoder the pixels of the bitmap being reused,
+// provided the decoded image has the same size and config. Unlike decoding
+// through SkImageDecoder's reuse mode, this works with any sample size.
+class RecyclingPixelAllocator : public SkBitmap::Allocator {
+public:
+    RecyclingPixelAllocator(const SkBitmap* reused) : fReused(reused) {}
+
+    virtual bool allocPixelRef(SkBitmap* bitmap, SkColorTable* ctable) {
+        SkPixelRef* pr = fReused->pixelRef();
+        // A color table can't be swapped into an existing pixel ref
+        if (pr == NULL || ctable != NULL ||
+                bitmap->config() != fReused->config() ||
+                bitmap->width() != fReused->width() ||
+                bitmap->height() != fReused->height() ||
+                bitmap->getSize() > fReused->getSize()) {
+            SkDebugf("--- decoded image does not match the reused bitmap\n");
+            return false;
+        }
+        bitmap->setPixelRef(pr, fReused->pixelRefOffset());
+        bitmap->lockPixels();
+        return true;
+    }
+
+private:
+    const SkBitmap* fReused;
+};
+
 // since we "may" create a purgeable imageref, we require the stream be ref'able
 // i.e. dynamically allocated, since its lifetime may exceed the current stack
 // frame.
+// canRewind tells whether the stream can always be rewound to its start,
+// which Java InputStreams only can within the limit they were marked with.
 static jobject doDecode(JNIEnv* env, SkStream* stream, jobject padding,
         jobject options, bool allowPurgeable, bool forcePurgeable = false,
-        bool applyScale = false, float scale = 1.0f) {
+        bool applyScale = false, float scale = 1.0f, bool canRewind = false) {
 
     int sampleSize = 1;
 
@@ -208,25 +238,68 @@ static jobject doDecode(JNIEnv* env, SkStream* stream, jobject padding,
 
     NinePatchPeeker peeker(decoder);
     JavaPixelAllocator javaAllocator(env);
+    PooledPixelAllocator pooledAllocator;
 
     SkBitmap* bitmap;
     if (javaBitmap == NULL) {
         bitmap = new SkBitmap;
     } else {
-        if (sampleSize != 1) {
-            return nullObjectReturn("SkImageDecoder: Cannot reuse bitmap with sampleSize != 1");
-        }
         bitmap = (SkBitmap*) env->GetIntField(javaBitmap, gBitmap_nativeBitmapFieldID);
         // config of supplied bitmap overrules config set in options
         prefConfig = bitmap->getConfig();
     }
+    RecyclingPixelAllocator recyclingAllocator(bitmap);
 
     SkAutoTDelete<SkImageDecoder> add(decoder);
     SkAutoTDelete<SkBitmap> adb(bitmap, javaBitmap == NULL);
 
+    // When a JPEG is scaled down by half or more, most of the scaling is left
+    // to the decoder, whose IDCT scaling only does a fraction of the work of a
+    // full decode. If that gives the exact target size, the image is decoded
+    // straight into the final bitmap and not resampled at all. The bounds are
+    // read first, so this needs a stream that can always be rewound.
+    bool resample = willScale;
+    int unscaledWidth = -1;
+    int unscaledHeight = -1;
+    if (willScale && scale < 1.0f && sampleSize == 1 && canRewind &&
+            mode == SkImageDecoder::kDecodePixels_Mode &&
+            decoder->getFormat() == SkImageDecoder::kJPEG_Format) {
+        SkBitmap bounds;
+        if (!decoder->decode(stream, &bounds, prefConfig, SkImageDecoder::kDecodeBounds_Mode) ||
+                !stream->rewind()) {
+            return nullObjectReturn("decoder->decode returned false");
+        }
+        unscaledWidth = bounds.width();
+        unscaledHeight = bounds.height();
+        const int targetWidth = int(unscaledWidth * scale + 0.5f);
+        const int targetHeight = int(unscaledHeight * scale + 0.5f);
+
+        int extraSampleSize = 1;
+        while (extraSampleSize < 8 &&
+                unscaledWidth / (extraSampleSize * 2) >= targetWidth &&
+                unscaledHeight / (extraSampleSize * 2) >= targetHeight) {
+            extraSampleSize *= 2;
+        }
+        if (extraSampleSize > 1) {
+            decoder->setSampleSize(extraSampleSize);
+            resample = unscaledWidth % extraSampleSize != 0 ||
+                    unscaledHeight % extraSampleSize != 0 ||
+                    unscaledWidth / extraSampleSize != targetWidth ||
+                    unscaledHeight / extraSampleSize != targetHeight;
+        }
+    }
+
     decoder->setPeeker(&peeker);
     if (!isPurgeable) {
-        decoder->setAllocator(&javaAllocator);
+        if (javaBitmap != NULL) {
+            decoder->setAllocator(&recyclingAllocator);
+        } else if (resample) {
+            // the unscaled image is only drawn into the scaled one below, so
+            // it doesn't need to live on the Java heap
+            decoder->setAllocator(&pooledAllocator);
+        } else {
+            decoder->setAllocator(&javaAllocator);
+        }
     }
 
     AutoDecoderCancel adc(options, decoder);
@@ -244,21 +317,27 @@ static jobject doDecode(JNIEnv* env, SkStream* stream, jobject padding,
     }
 
     SkBitmap* decoded;
-    if (willScale) {
+    if (resample) {
         decoded = new SkBitmap;
     } else {
         decoded = bitmap;
     }
-    SkAutoTDelete<SkBitmap> adb2(willScale ? decoded : NULL);
+    SkAutoTDelete<SkBitmap> adb2(resample ? decoded : NULL);
 
-    if (!decoder->decode(stream, decoded, prefConfig, decodeMode, javaBitmap != NULL)) {
+    // recyclingAllocator hands the reused bitmap's pixels to the decoder,
+    // which decodes into them in place: a failed decode may leave them
+    // partly overwritten.
+    if (!decoder->decode(stream, decoded, prefConfig, decodeMode)) {
         return nullObjectReturn("decoder->decode returned false");
     }
 
     int scaledWidth = decoded->width();
     int scaledHeight = decoded->height();
 
-    if (willScale && mode != SkImageDecoder::kDecodeBounds_Mode) {
+    if (unscaledWidth >= 0) {
+        scaledWidth = int(unscaledWidth * scale + 0.5f);
+        scaledHeight = int(unscaledHeight * scale + 0.5f);
+    } else if (willScale && mode != SkImageDecoder::kDecodeBounds_Mode) {
         scaledWidth = int(scaledWidth * scale + 0.5f);
         scaledHeight = int(scaledHeight * scale + 0.5f);
     }
@@ -318,7 +397,7 @@ static jobject doDecode(JNIEnv* env, SkStream* stream, jobject padding,
         }
     }
 
-    if (willScale) {
+    if (resample) {
         // This is weird so let me explain: we could use the scale parameter
         // directly, but for historical reasons this is how the corresponding
         // Dalvik code has always behaved. We simply recreate the behavior here.
@@ -456,6 +535,50 @@ static jobject nativeDecodeFileDescriptor(JNIEnv* env, jobject clazz, jobject fi
     return doDecode(env, stream, padding, bitmapFactoryOptions, weOwnTheFD);
 }
 
+/*  A memory stream over a read-only mapping of the part of a file that holds
+    an uncompressed asset. The mapping is released with the stream.
+ */
+class MappedAssetStream : public SkMemoryStream {
+public:
+    MappedAssetStream(void* mapAddr, size_t mapLength, size_t dataOffset, size_t dataLength)
+        : SkMemoryStream((const char*) mapAddr + dataOffset, dataLength, false),
+          fMapAddr(mapAddr), fMapLength(mapLength) {}
+
+    virtual ~MappedAssetStream() {
+        munmap(fMapAddr, fMapLength);
+    }
+
+private:
+    void* fMapAddr;
+    size_t fMapLength;
+};
+
+/*  map the data of an uncompressed asset straight from its file, and return it
+    as a stream that outlives the asset, or NULL if the asset is compressed or
+    can't be mapped.
+ */
+static SkStream* mapAssetToStream(Asset* asset) {
+    off64_t start, length;
+    int fd = asset->openFileDescriptor(&start, &length);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    // mmap offsets must be page aligned
+    const off64_t pageSize = sysconf(_SC_PAGESIZE);
+    const off64_t mapStart = start - start % pageSize;
+    const size_t mapLength = size_t(length + (start - mapStart));
+    void* addr = MAP_FAILED;
+    if (length > 0) {
+        addr = mmap64(NULL, mapLength, PROT_READ, MAP_SHARED, fd, mapStart);
+    }
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+    return new MappedAssetStream(addr, mapLength, size_t(start - mapStart), size_t(length));
+}
+
 /*  make a deep copy of the asset, and return it as a stream, or NULL if there
     was an error.
  */
@@ -491,9 +614,13 @@ static jobject nativeDecodeAssetScaled(JNIEnv* env, jobject clazz, jint native_a
     Asset* asset = reinterpret_cast<Asset*>(native_asset);
     bool forcePurgeable = optionsPurgeable(env, options);
     if (forcePurgeable) {
-        // if we could "ref/reopen" the asset, we may not need to copy it here
-        // and we could assume optionsShareable, since assets are always RO
-        stream = copyAssetToStream(asset);
+        // the stream outlives the asset, as the pixels may be decoded again
+        // later. Uncompressed assets are mapped from their file; compressed
+        // ones have no file data to map, so they are copied.
+        stream = mapAssetToStream(asset);
+        if (stream == NULL) {
+            stream = copyAssetToStream(asset);
+        }
         if (stream == NULL) {
             return NULL;
         }
@@ -503,7 +630,8 @@ static jobject nativeDecodeAssetScaled(JNIEnv* env, jobject clazz, jint native_a
         stream = new AssetStreamAdaptor(asset);
     }
     SkAutoUnref aur(stream);
-    return doDecode(env, stream, padding, options, true, forcePurgeable, applyScale, scale);
+    return doDecode(env, stream, padding, options, true, forcePurgeable, applyScale, scale,
+            true);
 }
 
 static jobject nativeDecodeAsset(JNIEnv* env, jobject clazz, jint native_asset,
@@ -39,7 +39,11 @@
 #include <binder/Parcel.h>
 #include <jni.h>
 #include <androidfw/Asset.h>
+#include <utils/GenerationCache.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #if 0
     #define TRACE_BITMAP(code)  code
@@ -70,7 +74,254 @@ static SkMemoryStream* buildSkMemoryStream(SkStream *stream) {
     return streamMem;
 }
 
-static jobject doBuildTileIndex(JNIEnv* env, SkStream* stream) {
+/*
+ * What a decoded region depends on, besides the image.
+ */
+struct RegionTileKey {
+    SkIRect region;
+    int sampleSize;
+    SkBitmap::Config config;
+    bool doDither;
+    bool preferQualityOverSpeed;
+
+    static int compare(const RegionTileKey& lhs, const RegionTileKey& rhs) {
+        int deltaInt = lhs.region.fLeft - rhs.region.fLeft;
+        if (deltaInt != 0) return deltaInt;
+        deltaInt = lhs.region.fTop - rhs.region.fTop;
+        if (deltaInt != 0) return deltaInt;
+        deltaInt = lhs.region.fRight - rhs.region.fRight;
+        if (deltaInt != 0) return deltaInt;
+        deltaInt = lhs.region.fBottom - rhs.region.fBottom;
+        if (deltaInt != 0) return deltaInt;
+        deltaInt = lhs.sampleSize - rhs.sampleSize;
+        if (deltaInt != 0) return deltaInt;
+        deltaInt = int(lhs.config) - int(rhs.config);
+        if (deltaInt != 0) return deltaInt;
+        deltaInt = int(lhs.doDither) - int(rhs.doDither);
+        if (deltaInt != 0) return deltaInt;
+        return int(lhs.preferQualityOverSpeed) - int(rhs.preferQualityOverSpeed);
+    }
+
+    bool operator<(const RegionTileKey& rhs) const {
+        return compare(*this, rhs) < 0;
+    }
+};
+
+inline int strictly_order_type(const RegionTileKey& lhs, const RegionTileKey& rhs) {
+    return RegionTileKey::compare(lhs, rhs) < 0;
+}
+
+inline int compare_type(const RegionTileKey& lhs, const RegionTileKey& rhs) {
+    return RegionTileKey::compare(lhs, rhs);
+}
+
+/*
+ * The native side of a BitmapRegionDecoder.
+ *
+ * A decoder only decodes one region at a time, so regions requested while
+ * every decoder is busy get a decoder of their own, up to one per CPU. Each
+ * decoder needs its own stream over the image, which is only possible when
+ * the image is held in memory; an image read through a shared file
+ * descriptor keeps a single decoder.
+ *
+ * The most recently decoded tiles are also kept, so that decoding a region
+ * again, as a viewer does when panning back, only costs a copy.
+ */
+class RegionDecoderPool : private OnEntryRemoved<RegionTileKey, SkBitmap*> {
+public:
+    // Takes ownership of decoder. memoryStream is the stream of decoder if
+    // it is an SkMemoryStream, NULL otherwise.
+    RegionDecoderPool(SkBitmapRegionDecoder* decoder, SkMemoryStream* memoryStream);
+    virtual ~RegionDecoderPool();
+
+    int getWidth() const { return mWidth; }
+    int getHeight() const { return mHeight; }
+    SkImageDecoder::Format getFormat() const { return mFormat; }
+
+    // Returns an idle decoder, waiting for one if needed. Never NULL.
+    SkBitmapRegionDecoder* acquire(JNIEnv* env);
+    void release(SkBitmapRegionDecoder* decoder);
+
+    // Copies a cached tile into bitmap, which is allocated with allocator if
+    // it has no pixels yet. Returns false if the tile isn't cached or doesn't
+    // fit bitmap.
+    bool copyCachedTile(const RegionTileKey& key, SkBitmap* bitmap,
+            SkBitmap::Allocator* allocator);
+    void cacheTile(const RegionTileKey& key, const SkBitmap& bitmap);
+
+private:
+    // Tiles larger than kMaxTileBytes aren't cached at all.
+    static const size_t kMaxTileBytes = 1024 * 1024;
+    static const size_t kMaxTileCacheBytes = 4 * 1024 * 1024;
+
+    SkBitmapRegionDecoder* buildDecoder(JNIEnv* env);
+
+    // Called when a tile is evicted
+    void operator()(RegionTileKey& key, SkBitmap*& tile);
+
+    Mutex mLock;
+    Condition mDecoderReleased;
+    SkMemoryStream* mMemoryStream;
+    Vector<SkBitmapRegionDecoder*> mIdleDecoders;
+    size_t mDecoderCount;
+    size_t mMaxDecoders;
+    int mWidth;
+    int mHeight;
+    SkImageDecoder::Format mFormat;
+
+    GenerationCache<RegionTileKey, SkBitmap*> mTiles;
+    size_t mTileBytes;
+};
+
+RegionDecoderPool::RegionDecoderPool(SkBitmapRegionDecoder* decoder,
+        SkMemoryStream* memoryStream)
+        : mMemoryStream(memoryStream), mDecoderCount(1), mMaxDecoders(1),
+          mWidth(decoder->getWidth()), mHeight(decoder->getHeight()),
+          mFormat(decoder->getDecoder()->getFormat()),
+          mTiles(GenerationCache<RegionTileKey, SkBitmap*>::kUnlimitedCapacity),
+          mTileBytes(0) {
+    mIdleDecoders.add(decoder);
+    mTiles.setOnEntryRemovedListener(this);
+    if (mMemoryStream != NULL) {
+        // the memory of the stream is shared with the other decoders
+        mMemoryStream->ref();
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        mMaxDecoders = cpus > 1 ? size_t(cpus) : 1;
+    }
+}
+
+RegionDecoderPool::~RegionDecoderPool() {
+    // the Java object is only finalized once no decode is running
+    for (size_t i = 0; i < mIdleDecoders.size(); i++) {
+        delete mIdleDecoders[i];
+    }
+    mTiles.clear();
+    if (mMemoryStream != NULL) {
+        mMemoryStream->unref();
+    }
+}
+
+SkBitmapRegionDecoder* RegionDecoderPool::buildDecoder(JNIEnv* env) {
+    SkMemoryStream* stream = new SkMemoryStream();
+    stream->setMemory(mMemoryStream->getMemoryBase(), mMemoryStream->getLength(), false);
+
+    SkImageDecoder* decoder = SkImageDecoder::Factory(stream);
+    if (NULL == decoder) {
+        stream->unref();
+        return NULL;
+    }
+
+    JavaPixelAllocator *javaAllocator = new JavaPixelAllocator(env);
+    decoder->setAllocator(javaAllocator);
+    javaAllocator->unref();
+
+    int width, height;
+    if (!decoder->buildTileIndex(stream, &width, &height)) {
+        delete decoder;
+        stream->unref();
+        return NULL;
+    }
+    return new SkBitmapRegionDecoder(decoder, stream, width, height);
+}
+
+SkBitmapRegionDecoder* RegionDecoderPool::acquire(JNIEnv* env) {
+    {
+        AutoMutex _l(mLock);
+        if (mIdleDecoders.isEmpty() && mDecoderCount < mMaxDecoders) {
+            mDecoderCount++;
+        } else {
+            while (mIdleDecoders.isEmpty()) {
+                mDecoderReleased.wait(mLock);
+            }
+            SkBitmapRegionDecoder* decoder = mIdleDecoders.top();
+            mIdleDecoders.pop();
+            return decoder;
+        }
+    }
+
+    // building the tile index reads the whole image, so it's done unlocked
+    SkBitmapRegionDecoder* decoder = buildDecoder(env);
+    if (decoder != NULL) {
+        return decoder;
+    }
+
+    AutoMutex _l(mLock);
+    // don't try again, the other decoders will have to do
+    mDecoderCount--;
+    mMaxDecoders = mDecoderCount;
+    while (mIdleDecoders.isEmpty()) {
+        mDecoderReleased.wait(mLock);
+    }
+    decoder = mIdleDecoders.top();
+    mIdleDecoders.pop();
+    return decoder;
+}
+
+void RegionDecoderPool::release(SkBitmapRegionDecoder* decoder) {
+    AutoMutex _l(mLock);
+    mIdleDecoders.push(decoder);
+    mDecoderReleased.signal();
+}
+
+bool RegionDecoderPool::copyCachedTile(const RegionTileKey& key, SkBitmap* bitmap,
+        SkBitmap::Allocator* allocator) {
+    AutoMutex _l(mLock);
+    SkBitmap* tile = mTiles.get(key);
+    if (tile == NULL) {
+        return false;
+    }
+
+    if (bitmap->getPixels() == NULL && bitmap->pixelRef() == NULL) {
+        bitmap->setConfig(tile->config(), tile->width(), tile->height());
+        if (!bitmap->allocPixels(allocator, NULL)) {
+            return false;
+        }
+    } else if (bitmap->config() != tile->config() || bitmap->width() != tile->width() ||
+            bitmap->height() != tile->height() || bitmap->rowBytes() != tile->rowBytes()) {
+        return false;
+    }
+
+    SkAutoLockPixels alpTile(*tile);
+    SkAutoLockPixels alp(*bitmap);
+    if (bitmap->getPixels() == NULL) {
+        return false;
+    }
+    memcpy(bitmap->getPixels(), tile->getPixels(), tile->getSize());
+    bitmap->setIsOpaque(tile->isOpaque());
+    bitmap->notifyPixelsChanged();
+    return true;
+}
+
+void RegionDecoderPool::cacheTile(const RegionTileKey& key, const SkBitmap& bitmap) {
+    // a color table can't be copied into a reused bitmap
+    if (bitmap.getSize() > kMaxTileBytes || bitmap.getColorTable() != NULL) {
+        return;
+    }
+
+    SkBitmap* tile = new SkBitmap;
+    if (!bitmap.copyTo(tile, bitmap.config())) {
+        delete tile;
+        return;
+    }
+
+    AutoMutex _l(mLock);
+    if (mTiles.get(key) != NULL) {
+        // decoded by another thread in the meantime
+        delete tile;
+        return;
+    }
+    mTiles.put(key, tile);
+    mTileBytes += tile->getSize();
+    while (mTileBytes > kMaxTileCacheBytes && mTiles.removeOldest()) {
+    }
+}
+
+void RegionDecoderPool::operator()(RegionTileKey& key, SkBitmap*& tile) {
+    mTileBytes -= tile->getSize();
+    delete tile;
+}
+
+static jobject doBuildTileIndex(JNIEnv* env, SkStream* stream, bool isMemoryStream) {
     SkImageDecoder* decoder = SkImageDecoder::Factory(stream);
     int width, height;
     if (NULL == decoder) {
@@ -91,8 +342,10 @@ static jobject doBuildTileIndex(JNIEnv* env, SkStream* stream) {
     }
 
     SkBitmapRegionDecoder *bm = new SkBitmapRegionDecoder(decoder, stream, width, height);
+    RegionDecoderPool* pool = new RegionDecoderPool(bm,
+            isMemoryStream ? static_cast<SkMemoryStream*>(stream) : NULL);
 
-    return GraphicsJNI::createBitmapRegionDecoder(env, bm);
+    return GraphicsJNI::createBitmapRegionDecoder(env, pool);
 }
 
 static jobject nativeNewInstanceFromByteArray(JNIEnv* env, jobject, jbyteArray byteArray,
@@ -103,7 +356,7 @@ static jobject nativeNewInstanceFromByteArray(JNIEnv* env, jobject, jbyteArray b
      */
     AutoJavaByteArray ar(env, byteArray);
     SkStream* stream = new SkMemoryStream(ar.ptr() + offset, length, true);
-    return doBuildTileIndex(env, stream);
+    return doBuildTileIndex(env, stream, true);
 }
 
 static jobject nativeNewInstanceFromFileDescriptor(JNIEnv* env, jobject clazz,
@@ -112,6 +365,7 @@ static jobject nativeNewInstanceFromFileDescriptor(JNIEnv* env, jobject clazz,
 
     jint descriptor = jniGetFDFromFileDescriptor(env, fileDescriptor);
     SkStream *stream = NULL;
+    bool isMemoryStream = false;
     struct stat fdStat;
     int newFD;
     if (fstat(descriptor, &fdStat) == -1) {
@@ -141,10 +395,11 @@ static jobject nativeNewInstanceFromFileDescriptor(JNIEnv* env, jobject clazz,
             return NULL;
         }
         stream = buildSkMemoryStream(fdStream);
+        isMemoryStream = true;
         fdStream->unref();
     }
 
-    return doBuildTileIndex(env, stream);
+    return doBuildTileIndex(env, stream, isMemoryStream);
 }
 
 static jobject nativeNewInstanceFromStream(JNIEnv* env, jobject clazz,
@@ -157,7 +412,7 @@ static jobject nativeNewInstanceFromStream(JNIEnv* env, jobject clazz,
     if (stream) {
         // for now we don't allow shareable with java inputstreams
         SkMemoryStream *mStream = buildSkMemoryStream(stream);
-        largeBitmap = doBuildTileIndex(env, mStream);
+        largeBitmap = doBuildTileIndex(env, mStream, true);
         stream->unref();
     }
     return largeBitmap;
@@ -171,7 +426,7 @@ static jobject nativeNewInstanceFromAsset(JNIEnv* env, jobject clazz,
     assStream = new AssetStreamAdaptor(asset);
     stream = buildSkMemoryStream(assStream);
     assStream->unref();
-    return doBuildTileIndex(env, stream);
+    return doBuildTileIndex(env, stream, true);
 }
 
 /*
@@ -180,10 +435,9 @@ static jobject nativeNewInstanceFromAsset(JNIEnv* env, jobject clazz,
  * purgeable not supported
  * reportSizeToVM not supported
  */
-static jobject nativeDecodeRegion(JNIEnv* env, jobject, SkBitmapRegionDecoder *brd,
+static jobject nativeDecodeRegion(JNIEnv* env, jobject, RegionDecoderPool *pool,
                                 int start_x, int start_y, int width, int height, jobject options) {
     jobject tileBitmap = NULL;
-    SkImageDecoder *decoder = brd->getDecoder();
     int sampleSize = 1;
     SkBitmap::Config prefConfig = SkBitmap::kNo_Config;
     bool doDither = true;
@@ -205,17 +459,6 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, SkBitmapRegionDecoder *b
         tileBitmap = env->GetObjectField(options, gOptions_bitmapFieldID);
     }
 
-    decoder->setDitherImage(doDither);
-    decoder->setPreferQualityOverSpeed(preferQualityOverSpeed);
-    AutoDecoderCancel   adc(options, decoder);
-
-    // To fix the race condition in case "requestCancelDecode"
-    // happens earlier than AutoDecoderCancel object is added
-    // to the gAutoDecoderCancelMutex linked list.
-    if (NULL != options && env->GetBooleanField(options, gOptions_mCancelID)) {
-        return nullObjectReturn("gOptions_mCancelID");;
-    }
-
     SkIRect region;
     region.fLeft = start_x;
     region.fTop = start_y;
@@ -233,8 +476,43 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, SkBitmapRegionDecoder *b
         adb.reset(bitmap);
     }
 
-    if (!brd->decodeRegion(bitmap, region, prefConfig, sampleSize)) {
-        return nullObjectReturn("decoder->decodeRegion returned false");
+    RegionTileKey key;
+    key.region = region;
+    key.sampleSize = sampleSize;
+    key.config = prefConfig;
+    key.doDither = doDither;
+    key.preferQualityOverSpeed = preferQualityOverSpeed;
+
+    JavaPixelAllocator javaAllocator(env);
+    jbyteArray buff = NULL;
+    if (pool->copyCachedTile(key, bitmap, &javaAllocator)) {
+        buff = javaAllocator.getStorageObj();
+    } else {
+        SkBitmapRegionDecoder* brd = pool->acquire(env);
+        SkImageDecoder *decoder = brd->getDecoder();
+        decoder->setDitherImage(doDither);
+        decoder->setPreferQualityOverSpeed(preferQualityOverSpeed);
+
+        bool decoded = false;
+        {
+            AutoDecoderCancel   adc(options, decoder);
+
+            // To fix the race condition in case "requestCancelDecode"
+            // happens earlier than AutoDecoderCancel object is added
+            // to the gAutoDecoderCancelMutex linked list.
+            if (NULL == options || !env->GetBooleanField(options, gOptions_mCancelID)) {
+                decoded = brd->decodeRegion(bitmap, region, prefConfig, sampleSize);
+            }
+        }
+
+        JavaPixelAllocator* allocator = (JavaPixelAllocator*) decoder->getAllocator();
+        buff = allocator->getStorageObjAndReset();
+        pool->release(brd);
+
+        if (!decoded) {
+            return nullObjectReturn("decoder->decodeRegion returned false");
+        }
+        pool->cacheTile(key, *bitmap);
     }
 
     // update options (if any)
@@ -245,7 +523,7 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, SkBitmapRegionDecoder *b
         // but how to reuse a set of strings, rather than allocating new one
         // each time?
         env->SetObjectField(options, gOptions_mimeFieldID,
-                            getMimeTypeString(env, decoder->getFormat()));
+                            getMimeTypeString(env, pool->getFormat()));
     }
 
     if (tileBitmap != NULL) {
@@ -255,21 +533,19 @@ static jobject nativeDecodeRegion(JNIEnv* env, jobject, SkBitmapRegionDecoder *b
     // detach bitmap from its autodeleter, since we want to own it now
     adb.release();
 
-    JavaPixelAllocator* allocator = (JavaPixelAllocator*) decoder->getAllocator();
-    jbyteArray buff = allocator->getStorageObjAndReset();
     return GraphicsJNI::createBitmap(env, bitmap, buff, false, NULL, NULL, -1);
 }
 
-static int nativeGetHeight(JNIEnv* env, jobject, SkBitmapRegionDecoder *brd) {
-    return brd->getHeight();
+static int nativeGetHeight(JNIEnv* env, jobject, RegionDecoderPool *pool) {
+    return pool->getHeight();
 }
 
-static int nativeGetWidth(JNIEnv* env, jobject, SkBitmapRegionDecoder *brd) {
-    return brd->getWidth();
+static int nativeGetWidth(JNIEnv* env, jobject, RegionDecoderPool *pool) {
+    return pool->getWidth();
 }
 
-static void nativeClean(JNIEnv* env, jobject, SkBitmapRegionDecoder *brd) {
-    delete brd;
+static void nativeClean(JNIEnv* env, jobject, RegionDecoderPool *pool) {
+    delete pool;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
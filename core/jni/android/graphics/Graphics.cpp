@@ -8,6 +8,8 @@
 #include "SkDevice.h"
 #include "SkPicture.h"
 #include "SkRegion.h"
+#include "SkTemplates.h"
+#include "SkThread.h"
 #include <android_runtime/AndroidRuntime.h>
 
 void doThrowNPE(JNIEnv* env) {
@@ -364,7 +366,7 @@ jobject GraphicsJNI::createBitmap(JNIEnv* env, SkBitmap* bitmap, bool isMutable,
 }
 
 
-jobject GraphicsJNI::createBitmapRegionDecoder(JNIEnv* env, SkBitmapRegionDecoder* bitmap)
+jobject GraphicsJNI::createBitmapRegionDecoder(JNIEnv* env, RegionDecoderPool* bitmap)
 {
     SkASSERT(bitmap != NULL);
 
@@ -384,6 +386,43 @@ jobject GraphicsJNI::createRegion(JNIEnv* env, SkRegion* region)
     return obj;
 }
 
+bool GraphicsJNI::setRegionToUnion(SkRegion* region, const SkIRect rects[], int count)
+{
+    if (count <= 0) {
+        return region->setEmpty();
+    }
+
+    // Adding the rects one by one rebuilds the whole region for each of them, which is
+    // quadratic in the number of rects. Merging pairs of regions of similar sizes only
+    // walks each rect once per level. Neighbours in the list end up in the same
+    // regions, which stay small.
+    SkAutoSTArray<16, SkRegion> storage((count + 1) / 2);
+    SkRegion* merged = storage.get();
+    int n = 0;
+    for (int i = 0; i < count; i += 2) {
+        merged[n].setRect(rects[i]);
+        if (i + 1 < count) {
+            merged[n].op(rects[i + 1], SkRegion::kUnion_Op);
+        }
+        n++;
+    }
+    while (n > 1) {
+        int half = 0;
+        for (int i = 0; i < n; i += 2) {
+            if (i + 1 < n) {
+                merged[half].op(merged[i], merged[i + 1], SkRegion::kUnion_Op);
+            } else {
+                merged[half].swap(merged[i]);
+            }
+            half++;
+        }
+        n = half;
+    }
+
+    region->swap(merged[0]);
+    return !region->isEmpty();
+}
+
 static JNIEnv* vm2env(JavaVM* vm)
 {
     JNIEnv* env = NULL;
@@ -525,6 +564,91 @@ bool JavaPixelAllocator::allocPixelRef(SkBitmap* bitmap, SkColorTable* ctable) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// Buckets hold buffers of 4KB (1 << kMinPoolShift) to 1MB (1 << kMaxPoolShift);
+// anything larger is allocated and freed directly.
+static const int kMinPoolShift = 12;
+static const int kMaxPoolShift = 20;
+static const int kPoolBucketCount = kMaxPoolShift - kMinPoolShift + 1;
+static const int kMaxBuffersPerBucket = 4;
+static const size_t kMaxPooledBytes = 2 * 1024 * 1024;
+
+static SkMutex gPixelPoolMutex;
+static void* gPixelPool[kPoolBucketCount][kMaxBuffersPerBucket];
+static int gPixelPoolCount[kPoolBucketCount];
+static size_t gPixelPoolBytes;
+
+static int pixelPoolBucket(size_t size) {
+    int shift = kMinPoolShift;
+    while (shift <= kMaxPoolShift && ((size_t) 1 << shift) < size) {
+        shift++;
+    }
+    return shift <= kMaxPoolShift ? shift - kMinPoolShift : -1;
+}
+
+static void* pixelPoolAlloc(int bucket) {
+    {
+        SkAutoMutexAcquire ac(gPixelPoolMutex);
+        if (gPixelPoolCount[bucket] > 0) {
+            gPixelPoolBytes -= (size_t) 1 << (bucket + kMinPoolShift);
+            return gPixelPool[bucket][--gPixelPoolCount[bucket]];
+        }
+    }
+    return sk_malloc_flags((size_t) 1 << (bucket + kMinPoolShift), 0);
+}
+
+static void pixelPoolFree(int bucket, void* addr) {
+    const size_t size = (size_t) 1 << (bucket + kMinPoolShift);
+    {
+        SkAutoMutexAcquire ac(gPixelPoolMutex);
+        if (gPixelPoolCount[bucket] < kMaxBuffersPerBucket &&
+                gPixelPoolBytes + size <= kMaxPooledBytes) {
+            gPixelPool[bucket][gPixelPoolCount[bucket]++] = addr;
+            gPixelPoolBytes += size;
+            return;
+        }
+    }
+    sk_free(addr);
+}
+
+class PooledPixelRef : public SkMallocPixelRef {
+public:
+    PooledPixelRef(void* storage, size_t size, int bucket, SkColorTable* ctable)
+        : SkMallocPixelRef(storage, size, ctable), fBucket(bucket) {}
+
+    virtual ~PooledPixelRef() {
+        if (fBucket >= 0) {
+            pixelPoolFree(fBucket, fStorage);
+            // Set this to NULL to prevent the SkMallocPixelRef destructor
+            // from freeing the memory.
+            fStorage = NULL;
+        }
+    }
+
+private:
+    int fBucket;
+};
+
+bool PooledPixelAllocator::allocPixelRef(SkBitmap* bitmap, SkColorTable* ctable) {
+    Sk64 size64 = bitmap->getSize64();
+    if (size64.isNeg() || !size64.is32()) {
+        return false;
+    }
+
+    size_t size = size64.get32();
+    int bucket = pixelPoolBucket(size);
+    void* addr = bucket >= 0 ? pixelPoolAlloc(bucket) : sk_malloc_flags(size, 0);
+    if (NULL == addr) {
+        return false;
+    }
+
+    bitmap->setPixelRef(new PooledPixelRef(addr, size, bucket, ctable))->unref();
+    // since we're already allocated, we lockPixels right away
+    bitmap->lockPixels();
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 JavaHeapBitmapRef::JavaHeapBitmapRef(JNIEnv* env, SkBitmap* nativeBitmap, jbyteArray buffer) {
     fEnv = env;
     fNativeBitmap = nativeBitmap;
@@ -14,6 +14,7 @@
 class SkCanvas;
 class SkPaint;
 class SkPicture;
+class RegionDecoderPool;
 
 class GraphicsJNI {
 public:
@@ -61,7 +62,13 @@ public:
 
     static jobject createRegion(JNIEnv* env, SkRegion* region);
 
-    static jobject createBitmapRegionDecoder(JNIEnv* env, SkBitmapRegionDecoder* bitmap);
+    /** Set region to the union of the rects, merging them two by two rather than
+        adding them one at a time. Rects sorted by top, as region iterators return
+        them, merge best. Returns false if the region is empty.
+    */
+    static bool setRegionToUnion(SkRegion* region, const SkIRect rects[], int count);
+
+    static jobject createBitmapRegionDecoder(JNIEnv* env, RegionDecoderPool* bitmap);
 
     static jbyteArray allocateJavaPixelRef(JNIEnv* env, SkBitmap* bitmap,
                                      SkColorTable* ctable);
@@ -164,6 +171,19 @@ private:
     int fAllocCount;
 };
 
+/** Allocator for short-lived native pixel buffers, such as the unscaled image
+ *  a scaled decode draws from. Freed buffers are kept in power-of-two size
+ *  buckets, up to a fixed total, so that decoding a list of similar images
+ *  reuses the same few buffers. None of it is on the Java heap, so unlike
+ *  JavaPixelAllocator it never causes a collection.
+ *  Safe to use from several threads.
+ */
+class PooledPixelAllocator : public SkBitmap::Allocator {
+public:
+    // overrides
+    virtual bool allocPixelRef(SkBitmap* bitmap, SkColorTable* ctable);
+};
+
 enum JNIAccess {
     kRO_JNIAccess,
     kRW_JNIAccess
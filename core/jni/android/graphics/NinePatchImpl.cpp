@@ -19,11 +19,14 @@
 #define LOG_NDEBUG 1
 
 #include <androidfw/ResourceTypes.h>
+#include <utils/GenerationCache.h>
 #include <utils/Log.h>
+#include <utils/RefBase.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 
 #include "SkBitmap.h"
 #include "SkCanvas.h"
-#include "SkNinePatch.h"
 #include "SkPaint.h"
 #include "SkUnPreMultiply.h"
 
@@ -92,14 +95,206 @@ static void drawStretchyPatch(SkCanvas* canvas, SkIRect& src, const SkRect& dst,
     }
 }
 
-SkScalar calculateStretch(SkScalar boundsLimit, SkScalar startingPoint,
-                          int srcSpace, int numStrechyPixelsRemaining,
-                          int numFixedPixelsRemaining) {
-    SkScalar spaceRemaining = boundsLimit - startingPoint;
-    SkScalar stretchySpaceRemaining =
-                spaceRemaining - SkIntToScalar(numFixedPixelsRemaining);
-    return SkScalarMulDiv(srcSpace, stretchySpaceRemaining,
-                          numStrechyPixelsRemaining);
+// Number of nine-patch layouts kept in memory. Applications use a few dozen
+// nine-patches at most, each drawn at many sizes
+#define NINE_PATCH_LAYOUT_CACHE_CAPACITY 64
+
+/**
+ * Identifies the layout of a nine-patch: the divs and colors of its chunk,
+ * and the size of its bitmap.
+ */
+struct NinePatchLayoutKey {
+    NinePatchLayoutKey(): hash(0) {
+    }
+
+    NinePatchLayoutKey(int bitmapWidth, int bitmapHeight, const android::Res_png_9patch& chunk) {
+        data.push(bitmapWidth);
+        data.push(bitmapHeight);
+        data.push(chunk.numXDivs);
+        data.push(chunk.numYDivs);
+        data.push(chunk.numColors);
+        data.appendArray(chunk.xDivs, chunk.numXDivs);
+        data.appendArray(chunk.yDivs, chunk.numYDivs);
+        data.appendArray((const int32_t*) chunk.colors, chunk.numColors);
+
+        hash = 0;
+        for (size_t i = 0; i < data.size(); i++) {
+            hash = hash * 31 + data[i];
+        }
+    }
+
+    static int compare(const NinePatchLayoutKey& lhs, const NinePatchLayoutKey& rhs) {
+        if (lhs.hash != rhs.hash) return lhs.hash < rhs.hash ? -1 : 1;
+        if (lhs.data.size() != rhs.data.size()) return lhs.data.size() < rhs.data.size() ? -1 : 1;
+        return memcmp(lhs.data.array(), rhs.data.array(), lhs.data.size() * sizeof(int32_t));
+    }
+
+    android::Vector<int32_t> data;
+    uint32_t hash;
+};
+
+inline int strictly_order_type(const NinePatchLayoutKey& lhs, const NinePatchLayoutKey& rhs) {
+    return NinePatchLayoutKey::compare(lhs, rhs) < 0;
+}
+
+inline int compare_type(const NinePatchLayoutKey& lhs, const NinePatchLayoutKey& rhs) {
+    return NinePatchLayoutKey::compare(lhs, rhs);
+}
+
+/**
+ * Layout of a nine-patch that does not depend on the bounds it is drawn
+ * in. As with the meshes of hwui's Patch, each edge of a column or row is
+ * made of a fixed part and of a stretchable part, in bitmap pixels; drawing
+ * the nine-patch at a given size only requires scaling the stretchable
+ * parts by a single factor per axis.
+ */
+class NinePatchLayout: public android::LightRefBase<NinePatchLayout> {
+public:
+    /**
+     * Column or row of the nine-patch. The last one always extends to the
+     * edge of the bounds.
+     */
+    struct Span {
+        int32_t srcStart;
+        int32_t srcEnd;
+        SkScalar fixedStart;
+        SkScalar stretchableStart;
+        SkScalar fixedEnd;
+        SkScalar stretchableEnd;
+        bool last;
+    };
+
+    NinePatchLayout(int bitmapWidth, int bitmapHeight, const android::Res_png_9patch& chunk) {
+        computeSpans(chunk.xDivs, chunk.numXDivs, bitmapWidth, mColumns,
+                &mFixedWidth, &mStretchableWidth);
+        computeSpans(chunk.yDivs, chunk.numYDivs, bitmapHeight, mRows,
+                &mFixedHeight, &mStretchableHeight);
+        mColors.appendArray(chunk.colors, chunk.numColors);
+    }
+
+    /**
+     * Returns the layout of the specified chunk, computing it if needed.
+     */
+    static android::sp<NinePatchLayout> get(int bitmapWidth, int bitmapHeight,
+            const android::Res_png_9patch& chunk);
+
+    /**
+     * Returns the factor the stretchable parts of the spans are scaled by
+     * to fill the specified size, in pixels.
+     */
+    static SkScalar getStretch(SkScalar size, SkScalar fixedSize, SkScalar stretchableSize) {
+        if (stretchableSize <= 0) return 0;
+        return SkScalarDiv(size - fixedSize, stretchableSize);
+    }
+
+    SkScalar getHorizontalStretch(SkScalar width) const {
+        return getStretch(width, mFixedWidth, mStretchableWidth);
+    }
+
+    SkScalar getVerticalStretch(SkScalar height) const {
+        return getStretch(height, mFixedHeight, mStretchableHeight);
+    }
+
+    const android::Vector<Span>& getColumns() const {
+        return mColumns;
+    }
+
+    const android::Vector<Span>& getRows() const {
+        return mRows;
+    }
+
+    /**
+     * Returns the color hint of the specified patch, patches are numbered
+     * row by row in the order they are drawn.
+     */
+    uint32_t getColor(size_t index) const {
+        return index < mColors.size() ? mColors[index] : android::Res_png_9patch::NO_COLOR;
+    }
+
+private:
+    /**
+     * Walks the divs the way the nine-patch is drawn: the first span is
+     * stretchable if the first div is 0, the spans then alternate between
+     * fixed and stretchable.
+     */
+    static void computeSpans(const int32_t* divs, int count, int bitmapSize,
+            android::Vector<Span>& spans, SkScalar* fixedSize, SkScalar* stretchableSize) {
+        int stretchablePixels = 0;
+        for (int i = 0; i < count; i += 2) {
+            stretchablePixels += divs[i + 1] - divs[i];
+        }
+        *fixedSize = SkIntToScalar(bitmapSize - stretchablePixels);
+        *stretchableSize = SkIntToScalar(stretchablePixels);
+
+        bool stretchable = count > 0 && divs[0] == 0;
+        SkScalar fixed = 0;
+        SkScalar stretched = 0;
+        int32_t start = 0;
+
+        for (int i = stretchable ? 1 : 0; i <= count && start < bitmapSize;
+                i++, stretchable = !stretchable) {
+            Span span;
+            span.srcStart = start;
+            span.fixedStart = fixed;
+            span.stretchableStart = stretched;
+            span.last = i == count;
+            span.srcEnd = span.last ? bitmapSize : divs[i];
+
+            // Empty spans are skipped without moving the destination edge
+            const int32_t size = span.srcEnd - span.srcStart;
+            if (size > 0) {
+                if (stretchable) {
+                    stretched += SkIntToScalar(size);
+                } else {
+                    fixed += SkIntToScalar(size);
+                }
+            }
+            span.fixedEnd = fixed;
+            span.stretchableEnd = stretched;
+
+            spans.push(span);
+            start = span.srcEnd;
+        }
+    }
+
+    android::Vector<Span> mColumns;
+    android::Vector<Span> mRows;
+    android::Vector<uint32_t> mColors;
+
+    SkScalar mFixedWidth;
+    SkScalar mStretchableWidth;
+    SkScalar mFixedHeight;
+    SkScalar mStretchableHeight;
+};
+
+static android::Mutex gLayoutCacheLock;
+static android::GenerationCache<NinePatchLayoutKey, android::sp<NinePatchLayout> >
+        gLayoutCache(NINE_PATCH_LAYOUT_CACHE_CAPACITY);
+
+android::sp<NinePatchLayout> NinePatchLayout::get(int bitmapWidth, int bitmapHeight,
+        const android::Res_png_9patch& chunk) {
+    NinePatchLayoutKey key(bitmapWidth, bitmapHeight, chunk);
+
+    android::Mutex::Autolock _l(gLayoutCacheLock);
+    android::sp<NinePatchLayout> layout = gLayoutCache.get(key);
+    if (layout == NULL) {
+        layout = new NinePatchLayout(bitmapWidth, bitmapHeight, chunk);
+        gLayoutCache.put(key, layout);
+    }
+    return layout;
+}
+
+/**
+ * Computes the destination edges of the specified span.
+ */
+static void getSpanBounds(const NinePatchLayout::Span& span, SkScalar origin, SkScalar end,
+        SkScalar stretch, SkScalar* start, SkScalar* spanEnd) {
+    *start = origin + span.fixedStart + SkScalarMul(span.stretchableStart, stretch);
+    if (span.last) {
+        *spanEnd = end;
+    } else {
+        *spanEnd = origin + span.fixedEnd + SkScalarMul(span.stretchableEnd, stretch);
+    }
 }
 
 void NinePatch_Draw(SkCanvas* canvas, const SkRect& bounds,
@@ -115,16 +310,6 @@ void NinePatch_Draw(SkCanvas* canvas, const SkRect& bounds,
         defaultPaint.setDither(true);
         paint = &defaultPaint;
     }
-    
-    // if our SkCanvas were back by GL we should enable this and draw this as
-    // a mesh, which will be faster in most cases.
-    if (false) {
-        SkNinePatch::DrawMesh(canvas, bounds, bitmap,
-                              chunk.xDivs, chunk.numXDivs,
-                              chunk.yDivs, chunk.numYDivs,
-                              paint);
-        return;
-    }
 
 #ifdef USE_TRACE
     gTrace = true;
@@ -168,126 +353,58 @@ void NinePatch_Draw(SkCanvas* canvas, const SkRect& bounds,
         return;
 
     const bool hasXfer = paint->getXfermode() != NULL;
-    SkRect      dst;
-    SkIRect     src;
-
-    const int32_t x0 = chunk.xDivs[0];
-    const int32_t y0 = chunk.yDivs[0];
     const SkColor initColor = ((SkPaint*)paint)->getColor();
-    const uint8_t numXDivs = chunk.numXDivs;
-    const uint8_t numYDivs = chunk.numYDivs;
-    int i;
-    int j;
-    int colorIndex = 0;
-    uint32_t color;
-    bool xIsStretchable;
-    const bool initialXIsStretchable =  (x0 == 0);
-    bool yIsStretchable = (y0 == 0);
-    const int bitmapWidth = bitmap.width();
-    const int bitmapHeight = bitmap.height();
-
-    SkScalar* dstRights = (SkScalar*) alloca((numXDivs + 1) * sizeof(SkScalar));
-    bool dstRightsHaveBeenCached = false;
-
-    int numStretchyXPixelsRemaining = 0;
-    for (i = 0; i < numXDivs; i += 2) {
-        numStretchyXPixelsRemaining += chunk.xDivs[i + 1] - chunk.xDivs[i];
-    }
-    int numFixedXPixelsRemaining = bitmapWidth - numStretchyXPixelsRemaining;
-    int numStretchyYPixelsRemaining = 0;
-    for (i = 0; i < numYDivs; i += 2) {
-        numStretchyYPixelsRemaining += chunk.yDivs[i + 1] - chunk.yDivs[i];
-    }
-    int numFixedYPixelsRemaining = bitmapHeight - numStretchyYPixelsRemaining;
+
+    // The layout only depends on the chunk and on the size of the bitmap,
+    // the edges of the patches are computed from it for the bounds
+    const android::sp<NinePatchLayout> layout =
+            NinePatchLayout::get(bitmap.width(), bitmap.height(), chunk);
+    const android::Vector<NinePatchLayout::Span>& columns = layout->getColumns();
+    const android::Vector<NinePatchLayout::Span>& rows = layout->getRows();
+    const SkScalar xStretch = layout->getHorizontalStretch(bounds.width());
+    const SkScalar yStretch = layout->getVerticalStretch(bounds.height());
 
 #ifdef USE_TRACE
     ALOGV("NinePatch [%d %d] bounds [%g %g %g %g] divs [%d %d]\n",
              bitmap.width(), bitmap.height(),
              SkScalarToFloat(bounds.fLeft), SkScalarToFloat(bounds.fTop),
              SkScalarToFloat(bounds.width()), SkScalarToFloat(bounds.height()),
-             numXDivs, numYDivs);
+             chunk.numXDivs, chunk.numYDivs);
 #endif
 
-    src.fTop = 0;
-    dst.fTop = bounds.fTop;
-    // The first row always starts with the top being at y=0 and the bottom
-    // being either yDivs[1] (if yDivs[0]=0) of yDivs[0].  In the former case
-    // the first row is stretchable along the Y axis, otherwise it is fixed.
-    // The last row always ends with the bottom being bitmap.height and the top
-    // being either yDivs[numYDivs-2] (if yDivs[numYDivs-1]=bitmap.height) or
-    // yDivs[numYDivs-1]. In the former case the last row is stretchable along
-    // the Y axis, otherwise it is fixed.
-    //
-    // The first and last columns are similarly treated with respect to the X
-    // axis.
-    //
-    // The above is to help explain some of the special casing that goes on the
-    // code below.
-
-    // The initial yDiv and whether the first row is considered stretchable or
-    // not depends on whether yDiv[0] was zero or not.
-    for (j = yIsStretchable ? 1 : 0;
-          j <= numYDivs && src.fTop < bitmapHeight;
-          j++, yIsStretchable = !yIsStretchable) {
-        src.fLeft = 0;
-        dst.fLeft = bounds.fLeft;
-        if (j == numYDivs) {
-            src.fBottom = bitmapHeight;
-            dst.fBottom = bounds.fBottom;
-        } else {
-            src.fBottom = chunk.yDivs[j];
-            const int srcYSize = src.fBottom - src.fTop;
-            if (yIsStretchable) {
-                dst.fBottom = dst.fTop + calculateStretch(bounds.fBottom, dst.fTop,
-                                                          srcYSize,
-                                                          numStretchyYPixelsRemaining,
-                                                          numFixedYPixelsRemaining);
-                numStretchyYPixelsRemaining -= srcYSize;
-            } else {
-                dst.fBottom = dst.fTop + SkIntToScalar(srcYSize);
-                numFixedYPixelsRemaining -= srcYSize;
-            }
-        }
+    SkScalar* dstLefts = (SkScalar*) alloca(columns.size() * sizeof(SkScalar));
+    SkScalar* dstRights = (SkScalar*) alloca(columns.size() * sizeof(SkScalar));
+    for (size_t i = 0; i < columns.size(); i++) {
+        getSpanBounds(columns[i], bounds.fLeft, bounds.fRight, xStretch,
+                &dstLefts[i], &dstRights[i]);
+    }
 
-        xIsStretchable = initialXIsStretchable;
-        // The initial xDiv and whether the first column is considered
-        // stretchable or not depends on whether xDiv[0] was zero or not.
-        for (i = xIsStretchable ? 1 : 0;
-              i <= numXDivs && src.fLeft < bitmapWidth;
-              i++, xIsStretchable = !xIsStretchable) {
-            color = chunk.colors[colorIndex++];
-            if (i == numXDivs) {
-                src.fRight = bitmapWidth;
-                dst.fRight = bounds.fRight;
-            } else {
-                src.fRight = chunk.xDivs[i];
-                if (dstRightsHaveBeenCached) {
-                    dst.fRight = dstRights[i];
-                } else {
-                    const int srcXSize = src.fRight - src.fLeft;
-                    if (xIsStretchable) {
-                        dst.fRight = dst.fLeft + calculateStretch(bounds.fRight, dst.fLeft,
-                                                                  srcXSize,
-                                                                  numStretchyXPixelsRemaining,
-                                                                  numFixedXPixelsRemaining);
-                        numStretchyXPixelsRemaining -= srcXSize;
-                    } else {
-                        dst.fRight = dst.fLeft + SkIntToScalar(srcXSize);
-                        numFixedXPixelsRemaining -= srcXSize;
-                    }
-                    dstRights[i] = dst.fRight;
-                }
-            }
-            // If this horizontal patch is too small to be displayed, leave
-            // the destination left edge where it is and go on to the next patch
-            // in the source.
-            if (src.fLeft >= src.fRight) {
-                src.fLeft = src.fRight;
+    SkRect      dst;
+    SkIRect     src;
+    size_t colorIndex = 0;
+
+    for (size_t j = 0; j < rows.size(); j++) {
+        const NinePatchLayout::Span& row = rows[j];
+        src.fTop = row.srcStart;
+        src.fBottom = row.srcEnd;
+        getSpanBounds(row, bounds.fTop, bounds.fBottom, yStretch, &dst.fTop, &dst.fBottom);
+
+        for (size_t i = 0; i < columns.size(); i++) {
+            const NinePatchLayout::Span& column = columns[i];
+            const uint32_t color = layout->getColor(colorIndex++);
+            src.fLeft = column.srcStart;
+            src.fRight = column.srcEnd;
+            dst.fLeft = dstLefts[i];
+            dst.fRight = dstRights[i];
+
+            // If this horizontal patch is too small to be displayed, go on
+            // to the next patch in the source.
+            if (src.fLeft >= src.fRight || src.fTop >= src.fBottom) {
                 continue;
             }
             // Make sure that we actually have room to draw any bits
             if (dst.fRight <= dst.fLeft || dst.fBottom <= dst.fTop) {
-                goto nextDiv;
+                continue;
             }
             // If this patch is transparent, skip and don't draw.
             if (color == android::Res_png_9patch::TRANSPARENT_COLOR && !hasXfer) {
@@ -301,7 +418,7 @@ void NinePatch_Draw(SkCanvas* canvas, const SkRect& bounds,
                     //     idst.fLeft, idst.fTop, idst.fRight, idst.fBottom);
                     (*outRegion)->op(idst, SkRegion::kUnion_Op);
                 }
-                goto nextDiv;
+                continue;
             }
             if (canvas) {
 #ifdef USE_TRACE
@@ -309,20 +426,10 @@ void NinePatch_Draw(SkCanvas* canvas, const SkRect& bounds,
                          src.fLeft, src.fTop, src.width(), src.height(),
                          SkScalarToFloat(dst.fLeft), SkScalarToFloat(dst.fTop),
                          SkScalarToFloat(dst.width()), SkScalarToFloat(dst.height()));
-                if (2 == src.width() && SkIntToScalar(5) == dst.width()) {
-                    ALOGV("--- skip patch\n");
-                }
 #endif
                 drawStretchyPatch(canvas, src, dst, bitmap, *paint, initColor,
                                   color, hasXfer);
             }
-
-nextDiv:
-            src.fLeft = src.fRight;
-            dst.fLeft = dst.fRight;
         }
-        src.fTop = src.fBottom;
-        dst.fTop = dst.fBottom;
-        dstRightsHaveBeenCached = true;
     }
 }
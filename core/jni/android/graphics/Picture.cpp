@@ -23,6 +23,8 @@
 #include "SkTemplates.h"
 #include "CreateJavaOutputStreamAdaptor.h"
 
+#include <Caches.h>
+
 namespace android {
 
 class SkPictureGlue {
@@ -48,6 +50,7 @@ public:
     
     static void killPicture(JNIEnv* env, jobject, SkPicture* picture) {
         SkASSERT(picture);
+        invalidateDisplayList(picture);
         picture->unref();
     }
     
@@ -82,6 +85,7 @@ public:
     
     static SkCanvas* beginRecording(JNIEnv* env, jobject, SkPicture* pict,
                                     int w, int h) {
+        invalidateDisplayList(pict);
         // beginRecording does not ref its return value, it just returns it.
         SkCanvas* canvas = pict->beginRecording(w, h);
         // the java side will wrap this guy in a Canvas.java, which will call
@@ -94,6 +98,17 @@ public:
     static void endRecording(JNIEnv* env, jobject, SkPicture* pict) {
         pict->endRecording();
     }
+
+private:
+    // Drops the display list the hardware renderer translated the picture
+    // into, the picture is about to change or go away
+    static void invalidateDisplayList(SkPicture* picture) {
+#ifdef USE_OPENGL_RENDERER
+        if (android::uirenderer::Caches::hasInstance()) {
+            android::uirenderer::Caches::getInstance().pictureCache.removeDeferred(picture);
+        }
+#endif // USE_OPENGL_RENDERER
+    }
 };
 
 static JNINativeMethod gPictureMethods[] = {
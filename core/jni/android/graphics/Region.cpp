@@ -136,15 +136,17 @@ static void scale_rect(SkIRect* dst, const SkIRect& src, float scale) {
 // Scale the region by given scale and set the reuslt to the dst.
 // dest and src can be the same region instance.
 static void scale_rgn(SkRegion* dst, const SkRegion& src, float scale) {
-   SkRegion tmp;
-   SkRegion::Iterator iter(src);
+   int count = 0;
+   for (SkRegion::Iterator iter(src); !iter.done(); iter.next()) {
+       count++;
+   }
 
-   for (; !iter.done(); iter.next()) {
-       SkIRect r;
-       scale_rect(&r, iter.rect(), scale);
-       tmp.op(r, SkRegion::kUnion_Op);
+   SkAutoSTMalloc<16, SkIRect> rects(count);
+   SkIRect* r = rects.get();
+   for (SkRegion::Iterator iter(src); !iter.done(); iter.next()) {
+       scale_rect(r++, iter.rect(), scale);
    }
-   dst->swap(tmp);
+   GraphicsJNI::setRegionToUnion(dst, rects.get(), count);
 }
 
 static void Region_scale(JNIEnv* env, jobject region, jfloat scale, jobject dst) {
@@ -43,10 +43,10 @@ ANDROID_SINGLETON_STATIC_INSTANCE(TextLayoutEngine);
 
 //--------------------------------------------------------------------------------------------------
 
-TextLayoutCache::TextLayoutCache(TextLayoutShaper* shaper) :
+TextLayoutCache::TextLayoutCache(TextLayoutShaper* shaper, uint32_t maxSize) :
         mShaper(shaper),
         mCache(GenerationCache<TextLayoutCacheKey, sp<TextLayoutValue> >::kUnlimitedCapacity),
-        mSize(0), mMaxSize(MB(DEFAULT_TEXT_LAYOUT_CACHE_SIZE_IN_MB)),
+        mSize(0), mMaxSize(maxSize),
         mCacheHitCount(0), mNanosecondsSaved(0) {
     init();
 }
@@ -86,7 +86,17 @@ void TextLayoutCache::operator()(TextLayoutCacheKey& text, sp<TextLayoutValue>&
  * Cache clearing
  */
 void TextLayoutCache::clear() {
+    AutoMutex _l(mLock);
     mCache.clear();
+    mShaper->purgeCaches();
+}
+
+/*
+ * The advances of linear text are proportional to the text size. Hinted advances
+ * are rounded at each size, so they are only valid for the size they are computed for.
+ */
+static bool isScalable(const SkPaint* paint) {
+    return paint->isLinearText() && paint->getTextSize() > 0;
 }
 
 /*
@@ -100,8 +110,12 @@ sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
         startTime = systemTime(SYSTEM_TIME_MONOTONIC);
     }
 
-    // Create the key
+    // Create the key, shared by all the text sizes if the advances can be scaled
     TextLayoutCacheKey key(paint, text, start, count, contextCount, dirFlags);
+    bool scalable = isScalable(paint);
+    if (scalable) {
+        key.clearTextSize();
+    }
 
     // Get value from cache if possible
     sp<TextLayoutValue> value = mCache.get(key);
@@ -123,8 +137,11 @@ sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
             value->setElapsedTime(systemTime(SYSTEM_TIME_MONOTONIC) - startTime);
         }
 
+        // Store scalable values for a unit text size
+        sp<TextLayoutValue> entry = scalable ? value->scaled(1.0f / paint->getTextSize()) : value;
+
         // Don't bother to add in the cache if the entry is too big
-        size_t size = key.getSize() + value->getSize();
+        size_t size = key.getSize() + entry->getSize();
         if (size <= mMaxSize) {
             // Cleanup to make some room if needed
             if (mSize + size > mMaxSize) {
@@ -147,7 +164,7 @@ sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
             // Copy the text when we insert the new entry
             key.internalTextCopy();
 
-            bool putOne = mCache.put(key, value);
+            bool putOne = mCache.put(key, entry);
             LOG_ALWAYS_FATAL_IF(!putOne, "Failed to put an entry into the cache.  "
                     "This indicates that the cache already has an entry with the "
                     "same key but it should not since we checked earlier!"
@@ -177,6 +194,10 @@ sp<TextLayoutValue> TextLayoutCache::getValue(const SkPaint* paint,
             }
         }
     } else {
+        if (scalable) {
+            value = value->scaled(paint->getTextSize());
+        }
+
         // This is a cache hit, just log timestamp and user infos
         if (mDebugEnabled) {
             nsecs_t elapsedTimeThruCacheGet = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
@@ -304,6 +325,15 @@ void TextLayoutCacheKey::internalTextCopy() {
     text = NULL;
 }
 
+uint32_t TextLayoutCacheKey::hashText() const {
+    const UChar* chars = getText();
+    uint32_t hash = start * 31 + count;
+    for (size_t i = 0; i < contextCount; i++) {
+        hash = hash * 31 + chars[i];
+    }
+    return hash;
+}
+
 size_t TextLayoutCacheKey::getSize() const {
     return sizeof(TextLayoutCacheKey) + sizeof(UChar) * contextCount;
 }
@@ -327,11 +357,43 @@ void TextLayoutValue::setElapsedTime(uint32_t time) {
     mElapsedTime = time;
 }
 
-uint32_t TextLayoutValue::getElapsedTime() {
+uint32_t TextLayoutValue::getElapsedTime() const {
     return mElapsedTime;
 }
 
-TextLayoutShaper::TextLayoutShaper() : mShaperItemGlyphArraySize(0) {
+sp<TextLayoutValue> TextLayoutValue::scaled(float scale) const {
+    size_t count = mAdvances.size();
+    sp<TextLayoutValue> value = new TextLayoutValue(count);
+    for (size_t i = 0; i < count; i++) {
+        value->mAdvances.add(mAdvances[i] * scale);
+    }
+    value->mTotalAdvance = mTotalAdvance * scale;
+    value->mGlyphs.appendVector(mGlyphs);
+    value->mElapsedTime = mElapsedTime;
+    return value;
+}
+
+TextLayoutWordCache::TextLayoutWordCache() : mCache(WORD_CACHE_CAPACITY) {
+}
+
+sp<TextLayoutValue> TextLayoutWordCache::get(const TextLayoutCacheKey& key) {
+    AutoMutex _l(mLock);
+    return mCache.get(key);
+}
+
+void TextLayoutWordCache::put(const TextLayoutCacheKey& key, const sp<TextLayoutValue>& value) {
+    AutoMutex _l(mLock);
+    // Another shaper may have put the same word in the meantime, the values are the same
+    mCache.put(key, value);
+}
+
+void TextLayoutWordCache::clear() {
+    AutoMutex _l(mLock);
+    mCache.clear();
+}
+
+TextLayoutShaper::TextLayoutShaper(TextLayoutWordCache* wordCache) :
+        mShaperItemGlyphArraySize(0), mWordCache(wordCache) {
     init();
 
     mFontRec.klass = &harfbuzzSkiaClass;
@@ -488,7 +550,7 @@ void TextLayoutShaper::computeValues(const SkPaint* paint, const UChar* chars,
                             ALOGD("Processing Bidi Run = %d -- run-start = %d, run-len = %d, isRTL = %d",
                                     i, startRun, lengthRun, isRTL);
 #endif
-                            computeRunValues(paint, chars + startRun, lengthRun, isRTL,
+                            computeSegmentedRunValues(paint, chars + startRun, lengthRun, isRTL,
                                     outAdvances, &runTotalAdvance, outGlyphs);
 
                             *outTotalAdvance += runTotalAdvance;
@@ -513,7 +575,7 @@ void TextLayoutShaper::computeValues(const SkPaint* paint, const UChar* chars,
             ALOGD("Using a SINGLE BiDi Run "
                     "-- run-start = %d, run-len = %d, isRTL = %d", start, count, isRTL);
 #endif
-            computeRunValues(paint, chars + start, count, isRTL,
+            computeSegmentedRunValues(paint, chars + start, count, isRTL,
                     outAdvances, outTotalAdvance, outGlyphs);
         }
 
@@ -523,6 +585,64 @@ void TextLayoutShaper::computeValues(const SkPaint* paint, const UChar* chars,
 #endif
 }
 
+void TextLayoutShaper::computeSegmentedRunValues(const SkPaint* paint, const UChar* chars,
+        size_t count, bool isRTL,
+        Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance,
+        Vector<jchar>* const outGlyphs) {
+    if (!mWordCache || count < WORD_CACHE_MIN_RUN_LENGTH) {
+        computeRunValues(paint, chars, count, isRTL, outAdvances, outTotalAdvance, outGlyphs);
+        return;
+    }
+
+    // Split the run after each space, keeping diacritics with the char they follow
+    Vector<sp<TextLayoutValue> > words;
+    size_t wordStart = 0;
+    for (size_t i = 0; i < count; i++) {
+        bool isWordEnd = (i + 1 == count) || (chars[i] == ' ' && chars[i + 1] != ' ' &&
+                ::ublock_getCode(chars[i + 1]) != UBLOCK_COMBINING_DIACRITICAL_MARKS);
+        if (isWordEnd) {
+            words.add(getWordValue(paint, chars + wordStart, i + 1 - wordStart, isRTL));
+            wordStart = i + 1;
+        }
+    }
+
+    // Advances are in logical order
+    jfloat totalAdvance = 0;
+    for (size_t i = 0; i < words.size(); i++) {
+        const sp<TextLayoutValue>& word = words[i];
+        outAdvances->appendArray(word->getAdvances(), word->getAdvancesCount());
+        totalAdvance += word->getTotalAdvance();
+    }
+    *outTotalAdvance = totalAdvance;
+
+    // Glyphs are in visual order, so the words of a RTL run come last first
+    if (outGlyphs) {
+        for (size_t i = 0; i < words.size(); i++) {
+            const sp<TextLayoutValue>& word = words[isRTL ? words.size() - 1 - i : i];
+            outGlyphs->appendArray(word->getGlyphs(), word->getGlyphsCount());
+        }
+    }
+
+#if DEBUG_GLYPHS
+    ALOGD("Shaped run of %d chars as %d words", count, words.size());
+#endif
+}
+
+sp<TextLayoutValue> TextLayoutShaper::getWordValue(const SkPaint* paint, const UChar* chars,
+        size_t count, bool isRTL) {
+    TextLayoutCacheKey key(paint, chars, 0, count, count,
+            isRTL ? kBidi_Force_RTL : kBidi_Force_LTR);
+    sp<TextLayoutValue> value = mWordCache->get(key);
+    if (value == NULL) {
+        value = new TextLayoutValue(count);
+        computeRunValues(paint, chars, count, isRTL,
+                &value->mAdvances, &value->mTotalAdvance, &value->mGlyphs);
+        key.internalTextCopy();
+        mWordCache->put(key, value);
+    }
+    return value;
+}
+
 static void logGlyphs(HB_ShaperItem shaperItem) {
     ALOGD("         -- glyphs count=%d", shaperItem.num_glyphs);
     for (size_t i = 0; i < shaperItem.num_glyphs; i++) {
@@ -1001,25 +1121,49 @@ void TextLayoutShaper::purgeCaches() {
     init();
 }
 
-TextLayoutEngine::TextLayoutEngine() {
-    mShaper = new TextLayoutShaper();
+TextLayoutEngine::TextLayoutEngine() : mExiting(false) {
+    for (size_t i = 0; i < TEXT_LAYOUT_CACHE_SHARD_COUNT; i++) {
+        mShapers[i] = new TextLayoutShaper(&mWordCache);
 #if USE_TEXT_LAYOUT_CACHE
-    mTextLayoutCache = new TextLayoutCache(mShaper);
+        // Each shard has its own lock, so that threads laying out different texts
+        // don't wait for each other
+        mTextLayoutCaches[i] = new TextLayoutCache(mShapers[i],
+                MB(DEFAULT_TEXT_LAYOUT_CACHE_SIZE_IN_MB) / TEXT_LAYOUT_CACHE_SHARD_COUNT);
 #else
-    mTextLayoutCache = NULL;
+        mTextLayoutCaches[i] = NULL;
 #endif
+    }
 }
 
 TextLayoutEngine::~TextLayoutEngine() {
-    delete mTextLayoutCache;
-    delete mShaper;
+    sp<PrefetchThread> thread;
+    {
+        AutoMutex _l(mPrefetchLock);
+        mExiting = true;
+        thread = mPrefetchThread;
+        mPrefetchCondition.signal();
+    }
+    if (thread != NULL) {
+        thread->requestExitAndWait();
+    }
+    for (size_t i = 0; i < mPrefetchQueue.size(); i++) {
+        delete mPrefetchQueue.itemAt(i);
+    }
+
+    for (size_t i = 0; i < TEXT_LAYOUT_CACHE_SHARD_COUNT; i++) {
+        delete mTextLayoutCaches[i];
+        delete mShapers[i];
+    }
 }
 
 sp<TextLayoutValue> TextLayoutEngine::getValue(const SkPaint* paint, const jchar* text,
         jint start, jint count, jint contextCount, jint dirFlags) {
     sp<TextLayoutValue> value;
 #if USE_TEXT_LAYOUT_CACHE
-    value = mTextLayoutCache->getValue(paint, text, start, count,
+    // The shard only depends on the text, so that all the sizes of a text share its entry
+    TextLayoutCacheKey key(paint, text, start, count, contextCount, dirFlags);
+    size_t shard = key.hashText() % TEXT_LAYOUT_CACHE_SHARD_COUNT;
+    value = mTextLayoutCaches[shard]->getValue(paint, text, start, count,
             contextCount, dirFlags);
     if (value == NULL) {
         ALOGE("Cannot get TextLayoutCache value for text = '%s'",
@@ -1027,16 +1171,70 @@ sp<TextLayoutValue> TextLayoutEngine::getValue(const SkPaint* paint, const jchar
     }
 #else
     value = new TextLayoutValue(count);
-    mShaper->computeValues(value.get(), paint,
+    mShapers[0]->computeValues(value.get(), paint,
             reinterpret_cast<const UChar*>(text), start, count, contextCount, dirFlags);
 #endif
     return value;
 }
 
+void TextLayoutEngine::prefetchValue(const SkPaint* paint, const jchar* text,
+        jint start, jint count, jint contextCount, jint dirFlags) {
+#if USE_TEXT_LAYOUT_CACHE
+    if (!paint || !text || count <= 0) return;
+
+    AutoMutex _l(mPrefetchLock);
+    if (mExiting || mPrefetchQueue.size() >= MAX_PENDING_PREFETCH_REQUESTS) return;
+
+    // getValue() only reads the context, which starts at text
+    PrefetchRequest* request = new PrefetchRequest;
+    request->paint = *paint;
+    request->text.appendArray(text, contextCount);
+    request->start = start;
+    request->count = count;
+    request->dirFlags = dirFlags;
+    mPrefetchQueue.push(request);
+
+    if (mPrefetchThread == NULL) {
+        mPrefetchThread = new PrefetchThread(this);
+        mPrefetchThread->run("TextLayoutPrefetch", PRIORITY_BACKGROUND);
+    }
+
+    mPrefetchCondition.signal();
+#endif
+}
+
+bool TextLayoutEngine::PrefetchThread::threadLoop() {
+    return mEngine->processNextPrefetchRequest(this);
+}
+
+bool TextLayoutEngine::processNextPrefetchRequest(Thread* thread) {
+    PrefetchRequest* request = NULL;
+    {
+        AutoMutex _l(mPrefetchLock);
+        while (mPrefetchQueue.isEmpty()) {
+            if (mExiting || thread->exitPending()) return false;
+            mPrefetchCondition.wait(mPrefetchLock);
+        }
+        if (mExiting) return false;
+
+        request = mPrefetchQueue.itemAt(0);
+        mPrefetchQueue.removeAt(0);
+    }
+
+    // Shaping stores the value in the cache, nobody needs it now
+    getValue(&request->paint, request->text.array(), request->start, request->count,
+            request->text.size(), request->dirFlags);
+    delete request;
+
+    return true;
+}
+
 void TextLayoutEngine::purgeCaches() {
 #if USE_TEXT_LAYOUT_CACHE
-    mTextLayoutCache->clear();
-    mShaper->purgeCaches();
+    for (size_t i = 0; i < TEXT_LAYOUT_CACHE_SHARD_COUNT; i++) {
+        mTextLayoutCaches[i]->clear();
+    }
+    mWordCache.clear();
 #if DEBUG_GLYPHS
     ALOGD("Purged TextLayoutEngine caches");
 #endif
@@ -61,6 +61,16 @@
 // Define the interval in number of cache hits between two statistics dump
 #define DEFAULT_DUMP_STATS_CACHE_HIT_INTERVAL 100
 
+// Define the number of caches, each with its own lock and shaper, the text layouts are spread over
+#define TEXT_LAYOUT_CACHE_SHARD_COUNT 4
+
+// Define the maximum number of texts waiting to be shaped in the background
+#define MAX_PENDING_PREFETCH_REQUESTS 64
+
+// Define the length from which runs are shaped word by word, and how many words are kept
+#define WORD_CACHE_MIN_RUN_LENGTH 64
+#define WORD_CACHE_CAPACITY 512
+
 namespace android {
 
 /**
@@ -81,6 +91,17 @@ public:
      */
     void internalTextCopy();
 
+    /**
+     * Drop the text size from the key, so that the entry is shared by all the sizes.
+     */
+    inline void clearTextSize() { textSize = 0; }
+
+    /**
+     * Hash of the text only, so that the same text goes to the same cache shard
+     * whatever the paint is.
+     */
+    uint32_t hashText() const;
+
     /**
      * Get the size of the Cache key.
      */
@@ -121,8 +142,13 @@ class TextLayoutValue : public RefBase {
 public:
     TextLayoutValue(size_t contextCount);
 
+    /**
+     * Copy of the value with all its advances multiplied by scale
+     */
+    sp<TextLayoutValue> scaled(float scale) const;
+
     void setElapsedTime(uint32_t time);
-    uint32_t getElapsedTime();
+    uint32_t getElapsedTime() const;
 
     inline const jfloat* getAdvances() const { return mAdvances.array(); }
     inline size_t getAdvancesCount() const { return mAdvances.size(); }
@@ -158,12 +184,36 @@ private:
 
 }; // TextLayoutCacheValue
 
+/**
+ * Cache of the words of long runs, shared by all the shapers. The shaping of a word
+ * doesn't depend on the words around it, so editing a long paragraph only reshapes
+ * the words that changed.
+ */
+class TextLayoutWordCache {
+public:
+    TextLayoutWordCache();
+
+    sp<TextLayoutValue> get(const TextLayoutCacheKey& key);
+
+    /**
+     * The key must own a copy of its text
+     */
+    void put(const TextLayoutCacheKey& key, const sp<TextLayoutValue>& value);
+
+    void clear();
+
+private:
+    Mutex mLock;
+    GenerationCache<TextLayoutCacheKey, sp<TextLayoutValue> > mCache;
+
+}; // TextLayoutWordCache
+
 /**
  * The TextLayoutShaper is responsible for shaping (with the Harfbuzz library)
  */
 class TextLayoutShaper {
 public:
-    TextLayoutShaper();
+    TextLayoutShaper(TextLayoutWordCache* wordCache);
     virtual ~TextLayoutShaper();
 
     void computeValues(TextLayoutValue* value, const SkPaint* paint, const UChar* chars,
@@ -220,6 +270,11 @@ private:
      */
     UnicodeString mBuffer;
 
+    /**
+     * Shaped words of long runs, may be NULL
+     */
+    TextLayoutWordCache* mWordCache;
+
     void init();
     void unrefTypefaces();
 
@@ -238,6 +293,14 @@ private:
             Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance,
             Vector<jchar>* const outGlyphs);
 
+    void computeSegmentedRunValues(const SkPaint* paint, const UChar* chars,
+            size_t count, bool isRTL,
+            Vector<jfloat>* const outAdvances, jfloat* outTotalAdvance,
+            Vector<jchar>* const outGlyphs);
+
+    sp<TextLayoutValue> getWordValue(const SkPaint* paint, const UChar* chars,
+            size_t count, bool isRTL);
+
     SkTypeface* getCachedTypeface(SkTypeface** typeface, const char path[]);
     HB_Face getCachedHBFace(SkTypeface* typeface);
 
@@ -249,11 +312,15 @@ private:
 
 /**
  * Cache of text layout information.
+ *
+ * The layouts of linear text scale with the text size, so they are stored once for
+ * a unit text size and their advances are scaled to the size of the paint on lookup.
+ * The layouts of hinted text are stored for each size.
  */
 class TextLayoutCache : private OnEntryRemoved<TextLayoutCacheKey, sp<TextLayoutValue> >
 {
 public:
-    TextLayoutCache(TextLayoutShaper* shaper);
+    TextLayoutCache(TextLayoutShaper* shaper, uint32_t maxSize);
 
     ~TextLayoutCache();
 
@@ -271,7 +338,7 @@ public:
             jint count, jint contextCount, jint dirFlags);
 
     /**
-     * Clear the cache
+     * Clear the cache and the caches of its shaper
      */
     void clear();
 
@@ -316,11 +383,53 @@ public:
     sp<TextLayoutValue> getValue(const SkPaint* paint, const jchar* text, jint start,
             jint count, jint contextCount, jint dirFlags);
 
+    /**
+     * Queues the text for shaping on a background thread, so that a later getValue()
+     * with the same arguments finds it in the cache. The paint and the text are copied.
+     * Requests beyond MAX_PENDING_PREFETCH_REQUESTS are dropped.
+     */
+    void prefetchValue(const SkPaint* paint, const jchar* text, jint start,
+            jint count, jint contextCount, jint dirFlags);
+
     void purgeCaches();
 
 private:
-    TextLayoutCache* mTextLayoutCache;
-    TextLayoutShaper* mShaper;
+    struct PrefetchRequest {
+        SkPaint paint;
+        Vector<jchar> text;
+        jint start;
+        jint count;
+        jint dirFlags;
+    };
+
+    class PrefetchThread : public Thread {
+    public:
+        PrefetchThread(TextLayoutEngine* engine) : Thread(false), mEngine(engine) { }
+
+    private:
+        virtual bool threadLoop();
+
+        TextLayoutEngine* mEngine;
+    }; // PrefetchThread
+
+    /**
+     * Waits for the next queued request and shapes its text. Returns false once
+     * the thread was asked to exit.
+     */
+    bool processNextPrefetchRequest(Thread* thread);
+
+    Vector<PrefetchRequest*> mPrefetchQueue;
+    sp<PrefetchThread> mPrefetchThread;
+    bool mExiting;
+    Mutex mPrefetchLock;
+    Condition mPrefetchCondition;
+
+    /**
+     * Each shaper is only used under the lock of its cache
+     */
+    TextLayoutCache* mTextLayoutCaches[TEXT_LAYOUT_CACHE_SHARD_COUNT];
+    TextLayoutShaper* mShapers[TEXT_LAYOUT_CACHE_SHARD_COUNT];
+    TextLayoutWordCache mWordCache;
 }; // TextLayoutEngine
 
 } // namespace android
@@ -6,6 +6,80 @@
 
 #include <jni.h>
 
+#if defined(__ARM_HAVE_NEON)
+    #include <arm_neon.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+/**
+ * Splits count interleaved byte pairs from src into first[] and second[].
+ */
+static void splitPairs(const uint8_t* src, uint8_t* first, uint8_t* second, int count) {
+    int i = 0;
+#if defined(__ARM_HAVE_NEON)
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16x2_t pairs = vld2q_u8(src + 2 * i);
+        vst1q_u8(first + i, pairs.val[0]);
+        vst1q_u8(second + i, pairs.val[1]);
+    }
+#elif defined(__SSE2__)
+    const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+    for (; i + 16 <= count; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i*) (src + 2 * i));
+        const __m128i b = _mm_loadu_si128((const __m128i*) (src + 2 * i + 16));
+        _mm_storeu_si128((__m128i*) (first + i), _mm_packus_epi16(
+                _mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes)));
+        _mm_storeu_si128((__m128i*) (second + i), _mm_packus_epi16(
+                _mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+#endif
+    for (; i < count; i++) {
+        first[i] = src[2 * i];
+        second[i] = src[2 * i + 1];
+    }
+}
+
+/**
+ * Splits count YUYV groups from src into 2 * count luma samples and count
+ * samples of each chroma component.
+ */
+static void splitYuyv(const uint8_t* src, uint8_t* y, uint8_t* u, uint8_t* v, int count) {
+    int i = 0;
+#if defined(__ARM_HAVE_NEON)
+    for (; i + 8 <= count; i += 8) {
+        const uint8x8x4_t yuyv = vld4_u8(src + 4 * i);
+        uint8x8x2_t luma;
+        luma.val[0] = yuyv.val[0];
+        luma.val[1] = yuyv.val[2];
+        vst2_u8(y + 2 * i, luma);
+        vst1_u8(u + i, yuyv.val[1]);
+        vst1_u8(v + i, yuyv.val[3]);
+    }
+#elif defined(__SSE2__)
+    const __m128i lowBytes = _mm_set1_epi16(0x00ff);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8) {
+        const __m128i a = _mm_loadu_si128((const __m128i*) (src + 4 * i));
+        const __m128i b = _mm_loadu_si128((const __m128i*) (src + 4 * i + 16));
+        _mm_storeu_si128((__m128i*) (y + 2 * i), _mm_packus_epi16(
+                _mm_and_si128(a, lowBytes), _mm_and_si128(b, lowBytes)));
+        // u and v still interleaved
+        const __m128i uv = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        _mm_storel_epi64((__m128i*) (u + i),
+                _mm_packus_epi16(_mm_and_si128(uv, lowBytes), zero));
+        _mm_storel_epi64((__m128i*) (v + i),
+                _mm_packus_epi16(_mm_srli_epi16(uv, 8), zero));
+    }
+#endif
+    for (; i < count; i++) {
+        y[2 * i] = src[4 * i];
+        u[i] = src[4 * i + 1];
+        y[2 * i + 1] = src[4 * i + 2];
+        v[i] = src[4 * i + 3];
+    }
+}
+
 YuvToJpegEncoder* YuvToJpegEncoder::create(int format, int* strides) {
     // Only ImageFormat.NV21 and ImageFormat.YUY2 are supported
     // for now.
@@ -115,13 +189,8 @@ void Yuv420SpToJpegEncoder::deinterleave(uint8_t* vuPlanar, uint8_t* uRows,
         uint8_t* vRows, int rowIndex, int width) {
     for (int row = 0; row < 8; ++row) {
         int offset = ((rowIndex >> 1) + row) * fStrides[1];
-        uint8_t* vu = vuPlanar + offset;
-        for (int i = 0; i < (width >> 1); ++i) {
-            int index = row * (width >> 1) + i;
-            uRows[index] = vu[1];
-            vRows[index] = vu[0];
-            vu += 2;
-        }
+        int index = row * (width >> 1);
+        splitPairs(vuPlanar + offset, vRows + index, uRows + index, width >> 1);
     }
 }
 
@@ -187,15 +256,8 @@ void Yuv422IToJpegEncoder::deinterleave(uint8_t* yuv, uint8_t* yRows, uint8_t* u
         uint8_t* vRows, int rowIndex, int width, int height) {
     for (int row = 0; row < 16; ++row) {
         uint8_t* yuvSeg = yuv + (rowIndex + row) * fStrides[0];
-        for (int i = 0; i < (width >> 1); ++i) {
-            int indexY = row * width + (i << 1);
-            int indexU = row * (width >> 1) + i;
-            yRows[indexY] = yuvSeg[0];
-            yRows[indexY + 1] = yuvSeg[2];
-            uRows[indexU] = yuvSeg[1];
-            vRows[indexU] = yuvSeg[3];
-            yuvSeg += 4;
-        }
+        int indexU = row * (width >> 1);
+        splitYuyv(yuvSeg, yRows + row * width, uRows + indexU, vRows + indexU, width >> 1);
     }
 }
 
@@ -29,6 +29,10 @@
 
 #include <core/SkBitmap.h>
 
+#if defined(__ARM_HAVE_NEON)
+    #include <arm_neon.h>
+#endif
+
 #include "android_runtime/AndroidRuntime.h"
 
 #undef LOG_TAG
@@ -42,10 +46,20 @@ namespace android {
 
 static inline
 void mx4transform(float x, float y, float z, float w, const float* pM, float* pDest) {
+#if defined(__ARM_HAVE_NEON)
+    // The matrix is column major: the result is the sum of its columns
+    // scaled by the components of the vector.
+    float32x4_t r = vmulq_n_f32(vld1q_f32(pM), x);
+    r = vmlaq_n_f32(r, vld1q_f32(pM + 4), y);
+    r = vmlaq_n_f32(r, vld1q_f32(pM + 8), z);
+    r = vmlaq_n_f32(r, vld1q_f32(pM + 12), w);
+    vst1q_f32(pDest, r);
+#else
     pDest[0] = pM[0 + 4 * 0] * x + pM[0 + 4 * 1] * y + pM[0 + 4 * 2] * z + pM[0 + 4 * 3] * w;
     pDest[1] = pM[1 + 4 * 0] * x + pM[1 + 4 * 1] * y + pM[1 + 4 * 2] * z + pM[1 + 4 * 3] * w;
     pDest[2] = pM[2 + 4 * 0] * x + pM[2 + 4 * 1] * y + pM[2 + 4 * 2] * z + pM[2 + 4 * 3] * w;
     pDest[3] = pM[3 + 4 * 0] * x + pM[3 + 4 * 1] * y + pM[3 + 4 * 2] * z + pM[3 + 4 * 3] * w;
+#endif
 }
 
 class MallocHelper {
@@ -261,7 +275,37 @@ void util_computeBoundingSphere(JNIEnv *env, jclass clazz,
     float z0 = *pSrc++;
     float z1 = z0;
 
-    for(int i = 1; i < positionsCount; i++) {
+    int i = 1;
+#if defined(__ARM_HAVE_NEON)
+    if (positionsCount >= 5) {
+        float32x4_t minX = vdupq_n_f32(x0), maxX = minX;
+        float32x4_t minY = vdupq_n_f32(y0), maxY = minY;
+        float32x4_t minZ = vdupq_n_f32(z0), maxZ = minZ;
+        for (; i + 4 <= positionsCount; i += 4, pSrc += 12) {
+            float32x4x3_t xyz = vld3q_f32(pSrc);
+            minX = vminq_f32(minX, xyz.val[0]);
+            maxX = vmaxq_f32(maxX, xyz.val[0]);
+            minY = vminq_f32(minY, xyz.val[1]);
+            maxY = vmaxq_f32(maxY, xyz.val[1]);
+            minZ = vminq_f32(minZ, xyz.val[2]);
+            maxZ = vmaxq_f32(maxZ, xyz.val[2]);
+        }
+        float lanes[4];
+        vst1q_f32(lanes, minX);
+        x0 = fminf(fminf(lanes[0], lanes[1]), fminf(lanes[2], lanes[3]));
+        vst1q_f32(lanes, maxX);
+        x1 = fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3]));
+        vst1q_f32(lanes, minY);
+        y0 = fminf(fminf(lanes[0], lanes[1]), fminf(lanes[2], lanes[3]));
+        vst1q_f32(lanes, maxY);
+        y1 = fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3]));
+        vst1q_f32(lanes, minZ);
+        z0 = fminf(fminf(lanes[0], lanes[1]), fminf(lanes[2], lanes[3]));
+        vst1q_f32(lanes, maxZ);
+        z1 = fmaxf(fmaxf(lanes[0], lanes[1]), fmaxf(lanes[2], lanes[3]));
+    }
+#endif
+    for(; i < positionsCount; i++) {
         {
             float x = *pSrc++;
             if (x < x0) {
@@ -320,6 +364,8 @@ static inline float signedDistance(const float* pPlane, float x, float y, float
     return dot3(pPlane[0], pPlane[1], pPlane[2], x, y, z) + pPlane[3];
 }
 
+#if !defined(__ARM_HAVE_NEON)
+
 // Return true if the sphere intersects or is inside the frustum
 
 static bool sphereHitsFrustum(const float* pFrustum, const float* pSphere) {
@@ -335,6 +381,8 @@ static bool sphereHitsFrustum(const float* pFrustum, const float* pSphere) {
     return true;
 }
 
+#endif
+
 static void computeFrustum(const float* m, float* f) {
     float m3 = m[3];
     float m7 = m[7];
@@ -417,8 +465,42 @@ int util_frustumCullSpheres(JNIEnv *env, jclass clazz,
     pSphere = spheres.mData;
     pResults = results.mData;
     outputCount = 0;
+#if defined(__ARM_HAVE_NEON)
+    // Test each sphere against four planes at once. The planes are
+    // transposed into one vector per coefficient, the last two planes
+    // repeated to fill the second group of four.
+    float32x4_t planeA[2], planeB[2], planeC[2], planeD[2];
+    for (int g = 0; g < 2; g++) {
+        float a[4], b[4], c[4], d[4];
+        for (int k = 0; k < 4; k++) {
+            const float* pPlane = frustum + 4 * (g == 0 ? k : 4 + (k & 1));
+            a[k] = pPlane[0];
+            b[k] = pPlane[1];
+            c[k] = pPlane[2];
+            d[k] = pPlane[3];
+        }
+        planeA[g] = vld1q_f32(a);
+        planeB[g] = vld1q_f32(b);
+        planeC[g] = vld1q_f32(c);
+        planeD[g] = vld1q_f32(d);
+    }
+#endif
     for(int i = 0; i < spheresCount; i++, pSphere += 4) {
-        if (sphereHitsFrustum(frustum, pSphere)) {
+#if defined(__ARM_HAVE_NEON)
+        float32x4_t negRadius = vdupq_n_f32(-pSphere[3]);
+        uint32x4_t outside = vdupq_n_u32(0);
+        for (int g = 0; g < 2; g++) {
+            float32x4_t dist = vmlaq_n_f32(planeD[g], planeA[g], pSphere[0]);
+            dist = vmlaq_n_f32(dist, planeB[g], pSphere[1]);
+            dist = vmlaq_n_f32(dist, planeC[g], pSphere[2]);
+            outside = vorrq_u32(outside, vcleq_f32(dist, negRadius));
+        }
+        uint32x2_t folded = vorr_u32(vget_low_u32(outside), vget_high_u32(outside));
+        bool hits = (vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) == 0;
+#else
+        bool hits = sphereHitsFrustum(frustum, pSphere);
+#endif
+        if (hits) {
             if (outputCount < resultsCapacity) {
                 *pResults++ = i;
             }
@@ -470,6 +552,12 @@ int util_visibilityTest(JNIEnv *env, jclass clazz,
 static
 void multiplyMM(float* r, const float* lhs, const float* rhs)
 {
+#if defined(__ARM_HAVE_NEON)
+    // Each column of the result is lhs applied to that column of rhs.
+    for (int i=0 ; i<4 ; i++) {
+        mx4transform(rhs[I(i,0)], rhs[I(i,1)], rhs[I(i,2)], rhs[I(i,3)], lhs, r + 4*i);
+    }
+#else
     for (int i=0 ; i<4 ; i++) {
         register const float rhs_i0 = rhs[ I(i,0) ];
         register float ri0 = lhs[ I(0,0) ] * rhs_i0;
@@ -488,6 +576,7 @@ void multiplyMM(float* r, const float* lhs, const float* rhs)
         r[ I(i,2) ] = ri2;
         r[ I(i,3) ] = ri3;
     }
+#endif
 }
 
 static
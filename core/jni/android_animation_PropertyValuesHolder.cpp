@@ -47,6 +47,9 @@ static jmethodID android_animation_PropertyValuesHolder_getFloatMethod(
     return mid;
 }
 
+// Called for every animated property on every frame, with a method ID that
+// PropertyValuesHolder looked up once per target class. Keep these free of
+// lookups and allocations.
 static void android_animation_PropertyValuesHolder_callIntMethod(
         JNIEnv* env, jclass pvhObject, jobject target, jmethodID methodID, int arg)
 {
@@ -160,6 +160,26 @@ int32_t AInputQueue::hasEvents() {
 }
 
 int32_t AInputQueue::getEvent(AInputEvent** outEvent) {
+    return getEvent(outEvent, -1);
+}
+
+size_t AInputQueue::getEvents(AInputEvent** outEvents, size_t maxEvents) {
+    nsecs_t frameTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    size_t count = 0;
+    size_t misses = 0;
+    while (count < maxEvents) {
+        if (getEvent(&outEvents[count], frameTime) == 0) {
+            count += 1;
+        } else if (hasEvents() <= 0 || ++misses > maxEvents) {
+            // Nothing left, or the channel is broken. A miss with events still
+            // pending is a key the IME handled, which was finished right away.
+            break;
+        }
+    }
+    return count;
+}
+
+int32_t AInputQueue::getEvent(AInputEvent** outEvent, nsecs_t frameTime) {
     *outEvent = NULL;
 
     char byteread;
@@ -207,8 +227,8 @@ int32_t AInputQueue::getEvent(AInputEvent** outEvent) {
 
     uint32_t consumerSeq;
     InputEvent* myEvent = NULL;
-    status_t res = mConsumer.consume(&mPooledInputEventFactory, true /*consumeBatches*/, -1,
-            &consumerSeq, &myEvent);
+    status_t res = mConsumer.consume(&mPooledInputEventFactory, true /*consumeBatches*/,
+            frameTime, &consumerSeq, &myEvent);
     if (res != android::OK) {
         if (res != android::WOULD_BLOCK) {
             ALOGW("channel '%s' ~ Failed to consume input event.  status=%d",
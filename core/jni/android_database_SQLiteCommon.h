@@ -22,6 +22,10 @@
 
 #include <sqlite3.h>
 
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
 // Special log tags defined in SQLiteDebug.java.
 #define SQLITE_LOG_TAG "SQLiteLog"
 #define SQLITE_TRACE_TAG "SQLiteStatements"
@@ -46,6 +50,44 @@ void throw_sqlite3_exception_errcode(JNIEnv* env, int errcode, const char* messa
 void throw_sqlite3_exception(JNIEnv* env, int errcode,
         const char* sqlite3Message, const char* message);
 
+/* write the blob in the given row of a table column to fd with incremental blob I/O,
+   filling ashmem regions in place and streaming to anything else; returns the size of
+   the blob or -1 with an exception thrown
+ */
+jlong write_sqlite3_blob_to_fd(JNIEnv* env, jint connectionPtr, const char* dbName,
+        const char* table, const char* column, jlong rowId, int fd);
+
+/* create a read-only ashmem region holding the blob in the given row of a table column;
+   returns its file descriptor or -1 with an exception thrown
+ */
+int create_ashmem_region_with_sqlite3_blob(JNIEnv* env, jint connectionPtr, const char* dbName,
+        const char* table, const char* column, jlong rowId);
+
+/* execution statistics of one SQL statement on one connection */
+struct SQLiteStatementStats {
+    String8 label;          // label of the connection
+    String8 sql;
+    uint32_t prepareCount;  // a statement prepared more than once was evicted from the cache
+    nsecs_t prepareTime;
+    uint32_t executeCount;
+    uint32_t stepCount;
+    nsecs_t stepTime;
+    uint32_t rowCount;
+};
+
+/* copy the statistics of the statements of every open connection */
+void get_sqlite3_statement_stats(Vector<SQLiteStatementStats>& outStats);
+
+/* return the statement cache size the given connection would need to stop
+   preparing the statements it evicted, or currentSize if it already hits often enough
+ */
+int get_sqlite3_statement_cache_size_hint(jint connectionPtr, int currentSize);
+
+/* write the statement statistics of every open connection to fd, the statements
+   prepared most often first
+ */
+void dump_sqlite3_statement_stats(int fd);
+
 }
 
 #endif // _ANDROID_DATABASE_SQLITE_COMMON_H
@@ -20,12 +20,15 @@
 #include <JNIHelp.h>
 #include <android_runtime/AndroidRuntime.h>
 
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <utils/String16.h>
+#include <utils/threads.h>
 #include <cutils/ashmem.h>
 #include <sys/mman.h>
 
+#include <alloca.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -55,6 +58,21 @@ namespace android {
  */
 static const int BUSY_TIMEOUT_MS = 2500;
 
+/* Maximum number of distinct SQL statements whose statistics are kept per connection.
+ * Statements prepared once the limit is reached only count towards the connection totals.
+ */
+static const size_t MAX_STATEMENT_STATS = 200;
+
+/* Must be kept in sync with SQLiteDatabase.MAX_SQL_CACHE_SIZE. */
+static const int MAX_STATEMENT_CACHE_SIZE = 100;
+
+/* The statement cache size hint grows the cache once at least this many statements
+ * were executed and more than one in STATEMENT_CACHE_MISS_RATIO of them had to
+ * prepare again a statement evicted earlier.
+ */
+static const uint32_t STATEMENT_CACHE_MIN_EXECUTIONS = 100;
+static const uint32_t STATEMENT_CACHE_MISS_RATIO = 10;
+
 static struct {
     jfieldID name;
     jfieldID numArgs;
@@ -83,10 +101,132 @@ struct SQLiteConnection {
 
     volatile bool canceled;
 
+    // Statement statistics, keyed by SQL so they outlive the statements evicted from
+    // the statement cache. Guarded by statsLock as they are read from other threads.
+    Mutex statsLock;
+    KeyedVector<String8, SQLiteStatementStats*> statsBySql;
+    KeyedVector<sqlite3_stmt*, SQLiteStatementStats*> statsByStatement;
+    uint32_t executeCount;
+    uint32_t prepareCount;
+    uint32_t reprepareCount;
+
     SQLiteConnection(sqlite3* db, int openFlags, const String8& path, const String8& label) :
-        db(db), openFlags(openFlags), path(path), label(label), canceled(false) { }
+        db(db), openFlags(openFlags), path(path), label(label), canceled(false),
+        executeCount(0), prepareCount(0), reprepareCount(0) { }
+
+    ~SQLiteConnection() {
+        for (size_t i = 0; i < statsBySql.size(); i++) {
+            delete statsBySql.valueAt(i);
+        }
+    }
+};
+
+// Open connections, for statement statistics.
+static Mutex gConnectionsLock;
+static Vector<SQLiteConnection*> gConnections;
+
+// Steps of one execution of a statement, recorded in the statement statistics when done.
+struct StatementExecution {
+    uint32_t stepCount;
+    uint32_t rowCount;
+    nsecs_t stepTime;
+
+    StatementExecution() : stepCount(0), rowCount(0), stepTime(0) { }
+
+    int step(sqlite3_stmt* statement) {
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        int err = sqlite3_step(statement);
+        stepTime += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        stepCount++;
+        if (err == SQLITE_ROW) {
+            rowCount++;
+        }
+        return err;
+    }
 };
 
+static void recordPrepare(SQLiteConnection* connection, sqlite3_stmt* statement,
+        nsecs_t prepareTime) {
+    String8 sql(sqlite3_sql(statement));
+
+    AutoMutex _l(connection->statsLock);
+    connection->prepareCount++;
+
+    SQLiteStatementStats* stats;
+    ssize_t index = connection->statsBySql.indexOfKey(sql);
+    if (index >= 0) {
+        stats = connection->statsBySql.valueAt(index);
+        connection->reprepareCount++;
+    } else if (connection->statsBySql.size() < MAX_STATEMENT_STATS) {
+        stats = new SQLiteStatementStats();
+        stats->label = connection->label;
+        stats->sql = sql;
+        stats->prepareCount = 0;
+        stats->prepareTime = 0;
+        stats->executeCount = 0;
+        stats->stepCount = 0;
+        stats->stepTime = 0;
+        stats->rowCount = 0;
+        connection->statsBySql.add(sql, stats);
+    } else {
+        return;
+    }
+
+    stats->prepareCount++;
+    stats->prepareTime += prepareTime;
+    connection->statsByStatement.add(statement, stats);
+}
+
+static void recordFinalize(SQLiteConnection* connection, sqlite3_stmt* statement) {
+    AutoMutex _l(connection->statsLock);
+    connection->statsByStatement.removeItem(statement);
+}
+
+static void recordExecution(SQLiteConnection* connection, sqlite3_stmt* statement,
+        const StatementExecution& execution) {
+    AutoMutex _l(connection->statsLock);
+    connection->executeCount++;
+
+    ssize_t index = connection->statsByStatement.indexOfKey(statement);
+    if (index >= 0) {
+        SQLiteStatementStats* stats = connection->statsByStatement.valueAt(index);
+        stats->executeCount++;
+        stats->stepCount += execution.stepCount;
+        stats->stepTime += execution.stepTime;
+        stats->rowCount += execution.rowCount;
+    }
+}
+
+void get_sqlite3_statement_stats(Vector<SQLiteStatementStats>& outStats) {
+    AutoMutex _l(gConnectionsLock);
+    for (size_t i = 0; i < gConnections.size(); i++) {
+        SQLiteConnection* connection = gConnections.itemAt(i);
+
+        AutoMutex _sl(connection->statsLock);
+        for (size_t j = 0; j < connection->statsBySql.size(); j++) {
+            outStats.add(*connection->statsBySql.valueAt(j));
+        }
+    }
+}
+
+int get_sqlite3_statement_cache_size_hint(jint connectionPtr, int currentSize) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+
+    AutoMutex _l(connection->statsLock);
+    if (connection->executeCount < STATEMENT_CACHE_MIN_EXECUTIONS
+            || connection->reprepareCount * STATEMENT_CACHE_MISS_RATIO
+                    <= connection->executeCount) {
+        return currentSize;
+    }
+
+    // Every statement seen so far could be cached, up to the limit of the Java cache.
+    int size = int(connection->statsBySql.size());
+    if (size > MAX_STATEMENT_CACHE_SIZE) {
+        size = MAX_STATEMENT_CACHE_SIZE;
+    }
+    return size > currentSize ? size : currentSize;
+}
+
 // Called each time a statement begins execution, when tracing is enabled.
 static void sqliteTraceCallback(void *data, const char *sql) {
     SQLiteConnection* connection = static_cast<SQLiteConnection*>(data);
@@ -159,6 +299,10 @@ static jint nativeOpen(JNIEnv* env, jclass clazz, jstring pathStr, jint openFlag
 
     // Create wrapper object.
     SQLiteConnection* connection = new SQLiteConnection(db, openFlags, path, label);
+    {
+        AutoMutex _l(gConnectionsLock);
+        gConnections.add(connection);
+    }
 
     // Enable tracing and profiling if requested.
     if (enableTrace) {
@@ -185,6 +329,15 @@ static void nativeClose(JNIEnv* env, jclass clazz, jint connectionPtr) {
             return;
         }
 
+        {
+            AutoMutex _l(gConnectionsLock);
+            for (size_t i = 0; i < gConnections.size(); i++) {
+                if (gConnections.itemAt(i) == connection) {
+                    gConnections.removeAt(i);
+                    break;
+                }
+            }
+        }
         delete connection;
     }
 }
@@ -286,8 +439,10 @@ static jint nativePrepareStatement(JNIEnv* env, jclass clazz, jint connectionPtr
     jsize sqlLength = env->GetStringLength(sqlString);
     const jchar* sql = env->GetStringCritical(sqlString, NULL);
     sqlite3_stmt* statement;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
     int err = sqlite3_prepare16_v2(connection->db,
             sql, sqlLength * sizeof(jchar), &statement, NULL);
+    nsecs_t prepareTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
     env->ReleaseStringCritical(sqlString, sql);
 
     if (err != SQLITE_OK) {
@@ -306,6 +461,8 @@ static jint nativePrepareStatement(JNIEnv* env, jclass clazz, jint connectionPtr
         return 0;
     }
 
+    recordPrepare(connection, statement, prepareTime);
+
     ALOGV("Prepared statement %p on connection %p", statement, connection->db);
     return reinterpret_cast<jint>(statement);
 }
@@ -319,6 +476,7 @@ static void nativeFinalizeStatement(JNIEnv* env, jclass clazz, jint connectionPt
     // whether any errors occurred while executing the statement.  The statement itself
     // is always finalized regardless.
     ALOGV("Finalized statement %p on connection %p", statement, connection->db);
+    recordFinalize(connection, statement);
     sqlite3_finalize(statement);
 }
 
@@ -439,7 +597,9 @@ static void nativeResetStatementAndClearBindings(JNIEnv* env, jclass clazz, jint
 }
 
 static int executeNonQuery(JNIEnv* env, SQLiteConnection* connection, sqlite3_stmt* statement) {
-    int err = sqlite3_step(statement);
+    StatementExecution execution;
+    int err = execution.step(statement);
+    recordExecution(connection, statement, execution);
     if (err == SQLITE_ROW) {
         throw_sqlite3_exception(env,
                 "Queries can be performed using SQLiteDatabase query or rawQuery methods only.");
@@ -477,7 +637,9 @@ static jlong nativeExecuteForLastInsertedRowId(JNIEnv* env, jclass clazz,
 }
 
 static int executeOneRowQuery(JNIEnv* env, SQLiteConnection* connection, sqlite3_stmt* statement) {
-    int err = sqlite3_step(statement);
+    StatementExecution execution;
+    int err = execution.step(statement);
+    recordExecution(connection, statement, execution);
     if (err != SQLITE_ROW) {
         throw_sqlite3_exception(env, connection->db);
     }
@@ -564,6 +726,142 @@ static jint nativeExecuteForBlobFileDescriptor(JNIEnv* env, jclass clazz,
     return -1;
 }
 
+// Blobs streamed to file descriptors that are not ashmem regions are read in chunks this large.
+static const int BLOB_CHUNK_SIZE = 64 * 1024;
+
+static sqlite3_blob* openBlob(JNIEnv* env, SQLiteConnection* connection,
+        const char* dbName, const char* table, const char* column, jlong rowId) {
+    sqlite3_blob* blob;
+    int err = sqlite3_blob_open(connection->db, dbName, table, column, rowId, 0, &blob);
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception(env, connection->db, "Could not open blob.");
+        return NULL;
+    }
+    return blob;
+}
+
+// Reads the blob straight into an ashmem region, SQLite copies the overflow pages
+// in place instead of assembling the whole blob in its own memory first.
+static bool readBlobIntoAshmemRegion(JNIEnv* env, SQLiteConnection* connection,
+        sqlite3_blob* blob, int fd, int length) {
+    if (length == 0) {
+        return true;
+    }
+
+    void* ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) {
+        int error = errno;
+        ALOGE("mmap failed: %s", strerror(error));
+        jniThrowIOException(env, error);
+        return false;
+    }
+
+    int err = sqlite3_blob_read(blob, ptr, length, 0);
+    munmap(ptr, length);
+    if (err != SQLITE_OK) {
+        throw_sqlite3_exception(env, connection->db, "Could not read blob.");
+        return false;
+    }
+    return true;
+}
+
+static bool writeBlobToFileDescriptor(JNIEnv* env, SQLiteConnection* connection,
+        sqlite3_blob* blob, int fd, int length) {
+    char* buffer = static_cast<char*>(malloc(length < BLOB_CHUNK_SIZE ? length : BLOB_CHUNK_SIZE));
+    if (!buffer && length > 0) {
+        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+        return false;
+    }
+
+    bool result = true;
+    for (int offset = 0; result && offset < length; ) {
+        int chunkSize = length - offset < BLOB_CHUNK_SIZE ? length - offset : BLOB_CHUNK_SIZE;
+        int err = sqlite3_blob_read(blob, buffer, chunkSize, offset);
+        if (err != SQLITE_OK) {
+            throw_sqlite3_exception(env, connection->db, "Could not read blob.");
+            result = false;
+            break;
+        }
+
+        for (int written = 0; written < chunkSize; ) {
+            ssize_t count = write(fd, buffer + written, chunkSize - written);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                int error = errno;
+                ALOGE("write failed: %s", strerror(error));
+                jniThrowIOException(env, error);
+                result = false;
+                break;
+            }
+            written += count;
+        }
+        offset += chunkSize;
+    }
+
+    free(buffer);
+    return result;
+}
+
+/* Writes the blob stored in the given row of a table column to fd with incremental blob
+ * I/O, so the blob is never loaded whole in memory. An ashmem region large enough, such as
+ * the one of a MemoryFile, is filled in place. Anything else, such as a pipe, is streamed.
+ * Returns the size of the blob, or -1 with an exception thrown.
+ */
+jlong write_sqlite3_blob_to_fd(JNIEnv* env, jint connectionPtr, const char* dbName,
+        const char* table, const char* column, jlong rowId, int fd) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+
+    sqlite3_blob* blob = openBlob(env, connection, dbName, table, column, rowId);
+    if (!blob) {
+        return -1;
+    }
+
+    int length = sqlite3_blob_bytes(blob);
+    int regionSize = ashmem_get_size_region(fd);
+    bool result = regionSize > 0 && regionSize >= length
+            ? readBlobIntoAshmemRegion(env, connection, blob, fd, length)
+            : writeBlobToFileDescriptor(env, connection, blob, fd, length);
+    sqlite3_blob_close(blob);
+    return result ? length : -1;
+}
+
+/* Same as write_sqlite3_blob_to_fd() but into a new read-only ashmem region, like
+ * nativeExecuteForBlobFileDescriptor() without the copy of the blob SQLite makes
+ * when stepping a statement. Returns the file descriptor of the region, or -1 with
+ * an exception thrown.
+ */
+int create_ashmem_region_with_sqlite3_blob(JNIEnv* env, jint connectionPtr, const char* dbName,
+        const char* table, const char* column, jlong rowId) {
+    SQLiteConnection* connection = reinterpret_cast<SQLiteConnection*>(connectionPtr);
+
+    sqlite3_blob* blob = openBlob(env, connection, dbName, table, column, rowId);
+    if (!blob) {
+        return -1;
+    }
+
+    int length = sqlite3_blob_bytes(blob);
+    int fd = ashmem_create_region(NULL, length);
+    if (fd < 0) {
+        int error = errno;
+        ALOGE("ashmem_create_region failed: %s", strerror(error));
+        jniThrowIOException(env, error);
+    } else if (!readBlobIntoAshmemRegion(env, connection, blob, fd, length)) {
+        close(fd);
+        fd = -1;
+    } else if (ashmem_set_prot_region(fd, PROT_READ) < 0) {
+        int error = errno;
+        ALOGE("ashmem_set_prot_region failed: %s", strerror(error));
+        jniThrowIOException(env, error);
+        close(fd);
+        fd = -1;
+    }
+
+    sqlite3_blob_close(blob);
+    return fd;
+}
+
 enum CopyRowResult {
     CPR_OK,
     CPR_FULL,
@@ -572,95 +870,82 @@ enum CopyRowResult {
 
 static CopyRowResult copyRow(JNIEnv* env, CursorWindow* window,
         sqlite3_stmt* statement, int numColumns, int startPos, int addedRows) {
-    // Allocate a new field directory for the row.
-    status_t status = window->allocRow();
-    if (status) {
-        LOG_WINDOW("Failed allocating fieldDir at startPos %d row %d, error=%d",
-                startPos, addedRows, status);
-        return CPR_FULL;
-    }
-
-    // Pack the row into the window.
-    CopyRowResult result = CPR_OK;
+    // Look up the values first so that the row, its strings and its blobs
+    // can be allocated at once. The type must be read before the value,
+    // reading a value may convert it.
+    int* types = static_cast<int*>(alloca(numColumns * sizeof(int)));
+    const void** values = static_cast<const void**>(alloca(numColumns * sizeof(void*)));
+    size_t* sizes = static_cast<size_t*>(alloca(numColumns * sizeof(size_t)));
+    size_t dataSize = 0;
     for (int i = 0; i < numColumns; i++) {
         int type = sqlite3_column_type(statement, i);
+        types[i] = type;
         if (type == SQLITE_TEXT) {
-            // TEXT data
-            const char* text = reinterpret_cast<const char*>(
-                    sqlite3_column_text(statement, i));
+            values[i] = sqlite3_column_text(statement, i);
             // SQLite does not include the NULL terminator in size, but does
             // ensure all strings are NULL terminated, so increase size by
             // one to make sure we store the terminator.
-            size_t sizeIncludingNull = sqlite3_column_bytes(statement, i) + 1;
-            status = window->putString(addedRows, i, text, sizeIncludingNull);
-            if (status) {
-                LOG_WINDOW("Failed allocating %u bytes for text at %d,%d, error=%d",
-                        sizeIncludingNull, startPos + addedRows, i, status);
-                result = CPR_FULL;
+            sizes[i] = sqlite3_column_bytes(statement, i) + 1;
+            dataSize += sizes[i];
+        } else if (type == SQLITE_BLOB) {
+            values[i] = sqlite3_column_blob(statement, i);
+            sizes[i] = sqlite3_column_bytes(statement, i);
+            dataSize += sizes[i];
+        } else if (type != SQLITE_INTEGER && type != SQLITE_FLOAT && type != SQLITE_NULL) {
+            // Unknown data
+            ALOGE("Unknown column type when filling database window");
+            throw_sqlite3_exception(env, "Unknown column type when filling window");
+            return CPR_ERROR;
+        }
+    }
+
+    // Allocate a new field directory for the row, followed by its data.
+    CursorWindow::FieldSlot* fieldDir;
+    void* data;
+    status_t status = window->allocRow(dataSize, &fieldDir, &data);
+    if (status) {
+        LOG_WINDOW("Failed allocating fieldDir and %u bytes at startPos %d row %d, error=%d",
+                dataSize, startPos, addedRows, status);
+        return CPR_FULL;
+    }
+
+    // Pack the row into the window. Fields are null once allocated.
+    uint8_t* next = static_cast<uint8_t*>(data);
+    for (int i = 0; i < numColumns; i++) {
+        CursorWindow::FieldSlot* fieldSlot = &fieldDir[i];
+        switch (types[i]) {
+            case SQLITE_TEXT:
+                memcpy(next, values[i], sizes[i]);
+                window->setFieldSlotBuffer(fieldSlot, CursorWindow::FIELD_TYPE_STRING,
+                        next, sizes[i]);
+                next += sizes[i];
+                LOG_WINDOW("%d,%d is TEXT with %u bytes", startPos + addedRows, i, sizes[i]);
                 break;
-            }
-            LOG_WINDOW("%d,%d is TEXT with %u bytes",
-                    startPos + addedRows, i, sizeIncludingNull);
-        } else if (type == SQLITE_INTEGER) {
-            // INTEGER data
-            int64_t value = sqlite3_column_int64(statement, i);
-            status = window->putLong(addedRows, i, value);
-            if (status) {
-                LOG_WINDOW("Failed allocating space for a long in column %d, error=%d",
-                        i, status);
-                result = CPR_FULL;
+            case SQLITE_BLOB:
+                memcpy(next, values[i], sizes[i]);
+                window->setFieldSlotBuffer(fieldSlot, CursorWindow::FIELD_TYPE_BLOB,
+                        next, sizes[i]);
+                next += sizes[i];
+                LOG_WINDOW("%d,%d is Blob with %u bytes", startPos + addedRows, i, sizes[i]);
                 break;
-            }
-            LOG_WINDOW("%d,%d is INTEGER 0x%016llx", startPos + addedRows, i, value);
-        } else if (type == SQLITE_FLOAT) {
-            // FLOAT data
-            double value = sqlite3_column_double(statement, i);
-            status = window->putDouble(addedRows, i, value);
-            if (status) {
-                LOG_WINDOW("Failed allocating space for a double in column %d, error=%d",
-                        i, status);
-                result = CPR_FULL;
+            case SQLITE_INTEGER: {
+                int64_t value = sqlite3_column_int64(statement, i);
+                window->setFieldSlotLong(fieldSlot, value);
+                LOG_WINDOW("%d,%d is INTEGER 0x%016llx", startPos + addedRows, i, value);
                 break;
             }
-            LOG_WINDOW("%d,%d is FLOAT %lf", startPos + addedRows, i, value);
-        } else if (type == SQLITE_BLOB) {
-            // BLOB data
-            const void* blob = sqlite3_column_blob(statement, i);
-            size_t size = sqlite3_column_bytes(statement, i);
-            status = window->putBlob(addedRows, i, blob, size);
-            if (status) {
-                LOG_WINDOW("Failed allocating %u bytes for blob at %d,%d, error=%d",
-                        size, startPos + addedRows, i, status);
-                result = CPR_FULL;
+            case SQLITE_FLOAT: {
+                double value = sqlite3_column_double(statement, i);
+                window->setFieldSlotDouble(fieldSlot, value);
+                LOG_WINDOW("%d,%d is FLOAT %lf", startPos + addedRows, i, value);
                 break;
             }
-            LOG_WINDOW("%d,%d is Blob with %u bytes",
-                    startPos + addedRows, i, size);
-        } else if (type == SQLITE_NULL) {
-            // NULL field
-            status = window->putNull(addedRows, i);
-            if (status) {
-                LOG_WINDOW("Failed allocating space for a null in column %d, error=%d",
-                        i, status);
-                result = CPR_FULL;
+            default:
+                LOG_WINDOW("%d,%d is NULL", startPos + addedRows, i);
                 break;
-            }
-
-            LOG_WINDOW("%d,%d is NULL", startPos + addedRows, i);
-        } else {
-            // Unknown data
-            ALOGE("Unknown column type when filling database window");
-            throw_sqlite3_exception(env, "Unknown column type when filling window");
-            result = CPR_ERROR;
-            break;
         }
     }
-
-    // Free the last row if if was not successfully copied.
-    if (result != CPR_OK) {
-        window->freeLastRow();
-    }
-    return result;
+    return CPR_OK;
 }
 
 static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
@@ -670,31 +955,37 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
     sqlite3_stmt* statement = reinterpret_cast<sqlite3_stmt*>(statementPtr);
     CursorWindow* window = reinterpret_cast<CursorWindow*>(windowPtr);
 
-    status_t status = window->clear();
-    if (status) {
-        String8 msg;
-        msg.appendFormat("Failed to clear the cursor window, status=%d", status);
-        throw_sqlite3_exception(env, connection->db, msg.string());
-        return 0;
-    }
-
+    // Without a window, the rows are only counted.
     int numColumns = sqlite3_column_count(statement);
-    status = window->setNumColumns(numColumns);
-    if (status) {
-        String8 msg;
-        msg.appendFormat("Failed to set the cursor window column count to %d, status=%d",
-                numColumns, status);
-        throw_sqlite3_exception(env, connection->db, msg.string());
-        return 0;
+    if (window) {
+        status_t status = window->clear();
+        if (status) {
+            String8 msg;
+            msg.appendFormat("Failed to clear the cursor window, status=%d", status);
+            throw_sqlite3_exception(env, connection->db, msg.string());
+            return 0;
+        }
+
+        status = window->setNumColumns(numColumns);
+        if (status) {
+            String8 msg;
+            msg.appendFormat("Failed to set the cursor window column count to %d, status=%d",
+                    numColumns, status);
+            throw_sqlite3_exception(env, connection->db, msg.string());
+            return 0;
+        }
+    } else {
+        countAllRows = true;
     }
 
     int retryCount = 0;
     int totalRows = 0;
     int addedRows = 0;
-    bool windowFull = false;
+    bool windowFull = window == NULL;
     bool gotException = false;
+    StatementExecution execution;
     while (!gotException && (!windowFull || countAllRows)) {
-        int err = sqlite3_step(statement);
+        int err = execution.step(statement);
         if (err == SQLITE_ROW) {
             LOG_WINDOW("Stepped statement %p to row %d", statement, totalRows);
             retryCount = 0;
@@ -748,8 +1039,9 @@ static jlong nativeExecuteForCursorWindow(JNIEnv* env, jclass clazz,
 
     LOG_WINDOW("Resetting statement %p after fetching %d rows and adding %d rows"
             "to the window in %d bytes",
-            statement, totalRows, addedRows, window->size() - window->freeSpace());
+            statement, totalRows, addedRows, window ? window->size() - window->freeSpace() : 0);
     sqlite3_reset(statement);
+    recordExecution(connection, statement, execution);
 
     // Report the total number of rows on request.
     if (startPos > totalRows) {
@@ -20,14 +20,18 @@
 #include <JNIHelp.h>
 #include <android_runtime/AndroidRuntime.h>
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <utils/Log.h>
+#include <utils/String8.h>
 
 #include <sqlite3.h>
 
+#include "android_database_SQLiteCommon.h"
+
 namespace android {
 
 static struct {
@@ -52,6 +56,49 @@ static void nativeGetPagerStats(JNIEnv *env, jobject clazz, jobject statsObj)
     env->SetIntField(statsObj, gSQLiteDebugPagerStatsClassInfo.largestMemAlloc, largestMemAlloc);
 }
 
+static int compareStatementStats(const SQLiteStatementStats* lhs,
+        const SQLiteStatementStats* rhs) {
+    // Statements prepared most often churn the statement cache the most.
+    if (lhs->prepareCount != rhs->prepareCount) {
+        return lhs->prepareCount > rhs->prepareCount ? -1 : 1;
+    }
+    return strcmp(lhs->sql.string(), rhs->sql.string());
+}
+
+void dump_sqlite3_statement_stats(int fd)
+{
+    Vector<SQLiteStatementStats> stats;
+    get_sqlite3_statement_stats(stats);
+    stats.sort(compareStatementStats);
+
+    String8 log;
+    log.appendFormat("Statement statistics (%d statements):\n", int(stats.size()));
+    log.appendFormat("  %8s %10s %8s %8s %10s %8s  %s\n", "prepares", "prepare ms",
+            "execs", "steps", "step ms", "rows", "connection: sql");
+    for (size_t i = 0; i < stats.size(); i++) {
+        const SQLiteStatementStats& s = stats.itemAt(i);
+        log.appendFormat("  %8d %10.3f %8d %8d %10.3f %8d  %s: \"%s\"\n",
+                s.prepareCount, s.prepareTime * 0.000001f, s.executeCount,
+                s.stepCount, s.stepTime * 0.000001f, s.rowCount,
+                s.label.string(), s.sql.string());
+    }
+
+    const char* data = log.string();
+    size_t remaining = log.length();
+    while (remaining > 0) {
+        ssize_t written = write(fd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("Could not write statement statistics: %s", strerror(errno));
+            break;
+        }
+        data += written;
+        remaining -= written;
+    }
+}
+
 /*
  * JNI registration.
  */
@@ -219,6 +219,9 @@ jbyteArray JNICameraContext::getCallbackBuffer(
     return obj;
 }
 
+// Each frame is copied once, straight from the camera heap into the Java
+// array. Apps that care about the cost should use callback buffers
+// (addCallbackBuffer), which are reused rather than allocated per frame.
 void JNICameraContext::copyAndPost(JNIEnv* env, const sp<IMemory>& dataPtr, int msgType)
 {
     jbyteArray obj = NULL;
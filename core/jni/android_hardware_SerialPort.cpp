@@ -23,6 +23,8 @@
 #include "android_runtime/AndroidRuntime.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -32,6 +34,22 @@ using namespace android;
 
 static jfieldID field_context;
 
+// Array reads and writes up to this size are staged on the stack.
+#define STACK_BUFFER_SIZE 1024
+
+// Writes all of buf, which the tty layer may accept in several pieces.
+static int write_fully(int fd, const jbyte* buf, jint length)
+{
+    jint written = 0;
+    while (written < length) {
+        int ret = TEMP_FAILURE_RETRY(write(fd, buf + written, length - written));
+        if (ret < 0)
+            return ret;
+        written += ret;
+    }
+    return written;
+}
+
 static void
 android_hardware_SerialPort_open(JNIEnv *env, jobject thiz, jobject fileDescriptor, jint speed)
 {
@@ -169,19 +187,24 @@ static jint
 android_hardware_SerialPort_read_array(JNIEnv *env, jobject thiz, jbyteArray buffer, jint length)
 {
     int fd = env->GetIntField(thiz, field_context);
-    jbyte* buf = (jbyte *)malloc(length);
-    if (!buf) {
-        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
-        return -1;
+    jbyte stackBuf[STACK_BUFFER_SIZE];
+    jbyte* buf = stackBuf;
+    if (length > STACK_BUFFER_SIZE) {
+        buf = (jbyte *)malloc(length);
+        if (!buf) {
+            jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+            return -1;
+        }
     }
 
-    int ret = read(fd, buf, length);
+    int ret = TEMP_FAILURE_RETRY(read(fd, buf, length));
     if (ret > 0) {
         // copy data from native buffer to Java buffer
         env->SetByteArrayRegion(buffer, 0, ret, buf);
     }
 
-    free(buf);
+    if (buf != stackBuf)
+        free(buf);
     if (ret < 0)
         jniThrowException(env, "java/io/IOException", NULL);
     return ret;
@@ -198,7 +221,7 @@ android_hardware_SerialPort_read_direct(JNIEnv *env, jobject thiz, jobject buffe
         return -1;
     }
 
-    int ret = read(fd, buf, length);
+    int ret = TEMP_FAILURE_RETRY(read(fd, buf, length));
     if (ret < 0)
         jniThrowException(env, "java/io/IOException", NULL);
     return ret;
@@ -208,15 +231,22 @@ static void
 android_hardware_SerialPort_write_array(JNIEnv *env, jobject thiz, jbyteArray buffer, jint length)
 {
     int fd = env->GetIntField(thiz, field_context);
-    jbyte* buf = (jbyte *)malloc(length);
-    if (!buf) {
-        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
-        return;
+    jbyte stackBuf[STACK_BUFFER_SIZE];
+    jbyte* buf = stackBuf;
+    if (length > STACK_BUFFER_SIZE) {
+        buf = (jbyte *)malloc(length);
+        if (!buf) {
+            jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+            return;
+        }
     }
     env->GetByteArrayRegion(buffer, 0, length, buf);
 
-    jint ret = write(fd, buf, length);
-    free(buf);
+    jint ret = 0;
+    if (!env->ExceptionCheck())
+        ret = write_fully(fd, buf, length);
+    if (buf != stackBuf)
+        free(buf);
     if (ret < 0)
         jniThrowException(env, "java/io/IOException", NULL);
 }
@@ -231,7 +261,7 @@ android_hardware_SerialPort_write_direct(JNIEnv *env, jobject thiz, jobject buff
         jniThrowException(env, "java/lang/IllegalArgumentException", "ByteBuffer not direct");
         return;
     }
-    int ret = write(fd, buf, length);
+    int ret = write_fully(fd, buf, length);
     if (ret < 0)
         jniThrowException(env, "java/io/IOException", NULL);
 }
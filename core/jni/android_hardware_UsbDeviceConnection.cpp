@@ -25,6 +25,7 @@
 #include <usbhost/usbhost.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -139,6 +140,32 @@ android_hardware_UsbDeviceConnection_release_interface(JNIEnv *env, jobject thiz
     return ret;
 }
 
+// Transfers up to this size are staged on the stack.
+#define STACK_TRANSFER_SIZE 4096
+
+/*
+ * Native buffer a synchronous transfer is staged in. The Java array is not
+ * pinned or copied as a whole for the duration of the transfer, which may
+ * block until the timeout: OUT data is copied in before the transfer and
+ * only the bytes actually received are copied back after an IN transfer.
+ */
+class TransferBuffer {
+public:
+    TransferBuffer(jint length) : mData(mStackData) {
+        if (length > STACK_TRANSFER_SIZE)
+            mData = (jbyte *)malloc(length);
+    }
+    ~TransferBuffer() {
+        if (mData != mStackData)
+            free(mData);
+    }
+    jbyte* data() const { return mData; }
+
+private:
+    jbyte* mData;
+    jbyte mStackData[STACK_TRANSFER_SIZE];
+};
+
 static jint
 android_hardware_UsbDeviceConnection_control_request(JNIEnv *env, jobject thiz,
         jint requestType, jint request, jint value, jint index,
@@ -150,20 +177,27 @@ android_hardware_UsbDeviceConnection_control_request(JNIEnv *env, jobject thiz,
         return -1;
     }
 
-    jbyte* bufferBytes = NULL;
-    if (buffer) {
-        if (env->GetArrayLength(buffer) < length) {
-            jniThrowException(env, "java/lang/ArrayIndexOutOfBoundsException", NULL);
-            return -1;
-        }
-        bufferBytes = env->GetByteArrayElements(buffer, 0);
+    if (buffer && env->GetArrayLength(buffer) < length) {
+        jniThrowException(env, "java/lang/ArrayIndexOutOfBoundsException", NULL);
+        return -1;
     }
+    if (!buffer || length < 0)
+        length = 0;
+
+    TransferBuffer transfer(length);
+    if (!transfer.data()) {
+        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+        return -1;
+    }
+    bool in = (requestType & USB_ENDPOINT_DIR_MASK) == USB_DIR_IN;
+    if (length && !in)
+        env->GetByteArrayRegion(buffer, 0, length, transfer.data());
 
     jint result = usb_device_control_transfer(device, requestType, request,
-            value, index, bufferBytes, length, timeout);
+            value, index, length ? transfer.data() : NULL, length, timeout);
 
-    if (bufferBytes)
-        env->ReleaseByteArrayElements(buffer, bufferBytes, 0);
+    if (result > 0 && in)
+        env->SetByteArrayRegion(buffer, 0, result < length ? result : length, transfer.data());
 
     return result;
 }
@@ -178,19 +212,27 @@ android_hardware_UsbDeviceConnection_bulk_request(JNIEnv *env, jobject thiz,
         return -1;
     }
 
-    jbyte* bufferBytes = NULL;
-    if (buffer) {
-        if (env->GetArrayLength(buffer) < length) {
-            jniThrowException(env, "java/lang/ArrayIndexOutOfBoundsException", NULL);
-            return -1;
-        }
-        bufferBytes = env->GetByteArrayElements(buffer, 0);
+    if (buffer && env->GetArrayLength(buffer) < length) {
+        jniThrowException(env, "java/lang/ArrayIndexOutOfBoundsException", NULL);
+        return -1;
+    }
+    if (!buffer || length < 0)
+        length = 0;
+
+    TransferBuffer transfer(length);
+    if (!transfer.data()) {
+        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+        return -1;
     }
+    bool in = (endpoint & USB_ENDPOINT_DIR_MASK) == USB_DIR_IN;
+    if (length && !in)
+        env->GetByteArrayRegion(buffer, 0, length, transfer.data());
 
-    jint result = usb_device_bulk_transfer(device, endpoint, bufferBytes, length, timeout);
+    jint result = usb_device_bulk_transfer(device, endpoint,
+            length ? transfer.data() : NULL, length, timeout);
 
-    if (bufferBytes)
-        env->ReleaseByteArrayElements(buffer, bufferBytes, 0);
+    if (result > 0 && in)
+        env->SetByteArrayRegion(buffer, 0, result < length ? result : length, transfer.data());
 
     return result;
 }
@@ -124,10 +124,15 @@ android_hardware_UsbRequest_dequeue_array(JNIEnv *env, jobject thiz,
     }
 
     if (buffer && length && request->buffer && !out) {
-        // copy data from native buffer to Java buffer
-        env->SetByteArrayRegion(buffer, 0, length, (jbyte *)request->buffer);
+        // copy only the data received from native buffer to Java buffer
+        jint received = request->actual_length;
+        if (received > length)
+            received = length;
+        if (received > 0)
+            env->SetByteArrayRegion(buffer, 0, received, (jbyte *)request->buffer);
     }
     free(request->buffer);
+    request->buffer = NULL;
     env->DeleteGlobalRef((jobject)request->client_data);
 
 }
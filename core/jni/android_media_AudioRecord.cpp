@@ -396,11 +396,18 @@ static void android_media_AudioRecord_finalize(JNIEnv *env,  jobject thiz) {
 }
 
 
+// Timeouts of AudioRecord::obtainBuffer(), from private/media/AudioTrackShared.h
+#define MAX_RUN_TIMEOUT_MS 1000
+#define WAIT_PERIOD_MS 10
+// Number of wait periods AudioRecord::read() allows for each buffer
+#define READ_WAIT_COUNT ((2 * MAX_RUN_TIMEOUT_MS) / WAIT_PERIOD_MS)
+
 // ----------------------------------------------------------------------------
-static jint android_media_AudioRecord_readInByteArray(JNIEnv *env,  jobject thiz,
-                                                        jbyteArray javaAudioData,
-                                                        jint offsetInBytes, jint sizeInBytes) {
-    jbyte* recordBuff = NULL;
+// Copies the recorded audio from the buffers of the recorder straight into the
+// Java array, which avoids pinning the array while the read blocks. Returns
+// what AudioRecord::read() would.
+static jint readToJavaArray(JNIEnv *env, jobject thiz, jarray javaAudioData, bool isShortArray,
+                            jint offsetInBytes, jint sizeInBytes) {
     // get the audio recorder from which we'll read new audio samples
     sp<AudioRecord> lpRecorder = getAudioRecord(env, thiz);
     if (lpRecorder == NULL) {
@@ -413,26 +420,59 @@ static jint android_media_AudioRecord_readInByteArray(JNIEnv *env,  jobject thiz
         return 0;
     }
 
-    // get the pointer to where we'll record the audio
-    // NOTE: We may use GetPrimitiveArrayCritical() when the JNI implementation changes in such
-    // a way that it becomes much more efficient. When doing so, we will have to prevent the
-    // AudioSystem callback to be called while in critical section (in case of media server
-    // process crash for instance)
-    recordBuff = (jbyte *)env->GetByteArrayElements(javaAudioData, NULL);
+    if (lpRecorder->stopped()) {
+        return (jint) INVALID_OPERATION;
+    }
 
-    if (recordBuff == NULL) {
-        ALOGE("Error retrieving destination for recorded audio data, can't record");
-        return 0;
+    // read at most one buffer of the recorder
+    const size_t frameSize = lpRecorder->frameSize();
+    ssize_t recorderBuffSize = lpRecorder->frameCount()*frameSize;
+    if (sizeInBytes > (jint)recorderBuffSize) {
+        sizeInBytes = (jint)recorderBuffSize;
     }
 
-    // read the new audio data from the native AudioRecord object
-    ssize_t recorderBuffSize = lpRecorder->frameCount()*lpRecorder->frameSize();
-    ssize_t readSize = lpRecorder->read(recordBuff + offsetInBytes,
-                                        sizeInBytes > (jint)recorderBuffSize ?
-                                            (jint)recorderBuffSize : sizeInBytes );
-    env->ReleaseByteArrayElements(javaAudioData, recordBuff, 0);
+    jint read = 0;
+    while ((size_t)(sizeInBytes - read) >= frameSize) {
+        AudioRecord::Buffer audioBuffer;
+        audioBuffer.frameCount = (sizeInBytes - read) / frameSize;
+        // Same bounded wait as AudioRecord::read(), which gives the recorder a
+        // chance to recover once (if mediaserver died for instance) before
+        // giving up instead of blocking forever
+        status_t err = lpRecorder->obtainBuffer(&audioBuffer, READ_WAIT_COUNT);
+        if (err == status_t(NO_MORE_BUFFERS)) {
+            // the recorder was stopped
+            break;
+        } else if (err < 0) {
+            if (err == TIMED_OUT) {
+                err = 0;
+            }
+            return (jint) err;
+        }
 
-    return (jint) readSize;
+        if (isShortArray) {
+            env->SetShortArrayRegion((jshortArray) javaAudioData, (offsetInBytes + read) / 2,
+                                     audioBuffer.size / 2, audioBuffer.i16);
+        } else {
+            env->SetByteArrayRegion((jbyteArray) javaAudioData, offsetInBytes + read,
+                                    audioBuffer.size, audioBuffer.i8);
+        }
+        if (env->ExceptionCheck()) {
+            // leave the data to the next read
+            audioBuffer.frameCount = 0;
+            lpRecorder->releaseBuffer(&audioBuffer);
+            break;
+        }
+        read += audioBuffer.size;
+        lpRecorder->releaseBuffer(&audioBuffer);
+    }
+    return read;
+}
+
+// ----------------------------------------------------------------------------
+static jint android_media_AudioRecord_readInByteArray(JNIEnv *env,  jobject thiz,
+                                                        jbyteArray javaAudioData,
+                                                        jint offsetInBytes, jint sizeInBytes) {
+    return readToJavaArray(env, thiz, javaAudioData, false, offsetInBytes, sizeInBytes);
 }
 
 // ----------------------------------------------------------------------------
@@ -440,9 +480,8 @@ static jint android_media_AudioRecord_readInShortArray(JNIEnv *env,  jobject thi
                                                         jshortArray javaAudioData,
                                                         jint offsetInShorts, jint sizeInShorts) {
 
-    return (android_media_AudioRecord_readInByteArray(env, thiz,
-                                                        (jbyteArray) javaAudioData,
-                                                        offsetInShorts*2, sizeInShorts*2)
+    return (readToJavaArray(env, thiz, javaAudioData, true,
+                            offsetInShorts*2, sizeInShorts*2)
             / 2);
 }
 
@@ -595,6 +595,62 @@ jint writeToTrack(const sp<AudioTrack>& track, jint audioFormat, jbyte* data,
 
 }
 
+// ----------------------------------------------------------------------------
+static bool copyFromJavaArray(JNIEnv *env, jarray javaAudioData, bool isShortArray,
+                              jint offsetInBytes, jint sizeInBytes, void* dst) {
+    if (isShortArray) {
+        env->GetShortArrayRegion((jshortArray) javaAudioData, offsetInBytes / 2,
+                                 sizeInBytes / 2, (jshort *) dst);
+    } else {
+        env->GetByteArrayRegion((jbyteArray) javaAudioData, offsetInBytes,
+                                sizeInBytes, (jbyte *) dst);
+    }
+    return !env->ExceptionCheck();
+}
+
+// Copies 16 bit PCM from the Java array straight into the buffers of the track,
+// which avoids pinning the array for the whole write. Blocks until all of the
+// data is written, like AudioTrack::write().
+static jint writeArrayToTrack(JNIEnv *env, const sp<AudioTrack>& track,
+                              jarray javaAudioData, bool isShortArray,
+                              jint offsetInBytes, jint sizeInBytes) {
+    if (track->sharedBuffer() != 0) {
+        // writing to shared memory, check for capacity
+        if ((size_t)sizeInBytes > track->sharedBuffer()->size()) {
+            sizeInBytes = track->sharedBuffer()->size();
+        }
+        if (!copyFromJavaArray(env, javaAudioData, isShortArray, offsetInBytes, sizeInBytes,
+                track->sharedBuffer()->pointer())) {
+            return 0;
+        }
+        return sizeInBytes;
+    }
+
+    const size_t frameSize = track->frameSize();
+    jint written = 0;
+    while ((size_t)(sizeInBytes - written) >= frameSize) {
+        AudioTrack::Buffer buffer;
+        buffer.frameCount = (sizeInBytes - written) / frameSize;
+        status_t err = track->obtainBuffer(&buffer, -1);
+        if (err == status_t(NO_MORE_BUFFERS)) {
+            // the track was stopped
+            break;
+        } else if (err < 0) {
+            return written > 0 ? written : err;
+        }
+
+        if (!copyFromJavaArray(env, javaAudioData, isShortArray, offsetInBytes + written,
+                buffer.size, buffer.i8)) {
+            buffer.frameCount = 0;
+            track->releaseBuffer(&buffer);
+            break;
+        }
+        written += buffer.size;
+        track->releaseBuffer(&buffer);
+    }
+    return written;
+}
+
 // ----------------------------------------------------------------------------
 static jint android_media_AudioTrack_native_write_byte(JNIEnv *env,  jobject thiz,
                                                   jbyteArray javaAudioData,
@@ -609,6 +665,12 @@ static jint android_media_AudioTrack_native_write_byte(JNIEnv *env,  jobject thi
         return 0;
     }
 
+    if (javaAudioData && javaAudioFormat == javaAudioTrackFields.PCM16
+            && lpTrack->format() == AUDIO_FORMAT_PCM_16_BIT) {
+        return writeArrayToTrack(env, lpTrack, javaAudioData, false,
+                offsetInBytes, sizeInBytes);
+    }
+
     // get the pointer for the audio data from the java array
     // NOTE: We may use GetPrimitiveArrayCritical() when the JNI implementation changes in such
     // a way that it becomes much more efficient. When doing so, we will have to prevent the
@@ -628,7 +690,8 @@ static jint android_media_AudioTrack_native_write_byte(JNIEnv *env,  jobject thi
 
     jint written = writeToTrack(lpTrack, javaAudioFormat, cAudioData, offsetInBytes, sizeInBytes);
 
-    env->ReleaseByteArrayElements(javaAudioData, cAudioData, 0);
+    // the data is only read, there is nothing to copy back
+    env->ReleaseByteArrayElements(javaAudioData, cAudioData, JNI_ABORT);
 
     //ALOGV("write wrote %d (tried %d) bytes in the native AudioTrack with offset %d",
     //     (int)written, (int)(sizeInBytes), (int)offsetInBytes);
@@ -641,6 +704,13 @@ static jint android_media_AudioTrack_native_write_short(JNIEnv *env,  jobject th
                                                   jshortArray javaAudioData,
                                                   jint offsetInShorts, jint sizeInShorts,
                                                   jint javaAudioFormat) {
+    if (javaAudioData && javaAudioFormat == javaAudioTrackFields.PCM16) {
+        sp<AudioTrack> lpTrack = getAudioTrack(env, thiz);
+        if (lpTrack != NULL && lpTrack->format() == AUDIO_FORMAT_PCM_16_BIT) {
+            return writeArrayToTrack(env, lpTrack, javaAudioData, true,
+                    offsetInShorts*2, sizeInShorts*2) / 2;
+        }
+    }
     return (android_media_AudioTrack_native_write_byte(env, thiz,
                                                  (jbyteArray) javaAudioData,
                                                  offsetInShorts*2, sizeInShorts*2,
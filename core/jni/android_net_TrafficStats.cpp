@@ -28,6 +28,7 @@
 #include <ScopedUtfChars.h>
 #include <utils/misc.h>
 #include <utils/Log.h>
+#include <utils/threads.h>
 
 namespace android {
 
@@ -81,10 +82,29 @@ static jlong readNumber(char const* filename) {
     return atoll(buf);
 }
 
+// The interface stats are polled often, so their file is kept open and
+// rewound, which makes the kernel regenerate it, rather than reopened.
+static Mutex gIfaceStatLock;
+static FILE* gIfaceStatFile = NULL;
+
 static int parseIfaceStat(const char* iface, struct IfaceStat* stat) {
-    FILE *fp = fopen(IFACE_STAT_ALL, "r");
-    if (!fp) {
-        return errno;
+    Mutex::Autolock _l(gIfaceStatLock);
+
+    FILE *fp = gIfaceStatFile;
+    if (fp) {
+        rewind(fp);
+    } else {
+        int fd = open(IFACE_STAT_ALL, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return errno;
+        }
+        fp = fdopen(fd, "r");
+        if (!fp) {
+            int err = errno;
+            close(fd);
+            return err;
+        }
+        gIfaceStatFile = fp;
     }
 
     char buffer[256];
@@ -115,7 +135,13 @@ static int parseIfaceStat(const char* iface, struct IfaceStat* stat) {
         }
     }
 
-    fclose(fp);
+    if (ferror(fp)) {
+        // Reopen the file on the next call.
+        int err = errno;
+        fclose(fp);
+        gIfaceStatFile = NULL;
+        return err ? err : EIO;
+    }
     return 0;
 }
 
@@ -76,6 +76,15 @@ getPointer(JNIEnv *_env, jobject buffer, jarray *array, jint *remaining)
     limit = _env->GetIntField(buffer, limitID);
     elementSizeShift = _env->GetIntField(buffer, elementSizeShiftID);
     *remaining = (limit - position) << elementSizeShift;
+
+    // Direct buffers, which most GL code uses, have their address read
+    // without calling into NIOAccess.
+    data = _env->GetDirectBufferAddress(buffer);
+    if (data != NULL) {
+        *array = NULL;
+        return (void *) ((char *) data + (position << elementSizeShift));
+    }
+
     pointer = _env->CallStaticLongMethod(nioAccessClass,
             getBasePointerID, buffer);
     if (pointer != 0L) {
@@ -117,17 +117,53 @@ static jlong android_os_Debug_getNativeHeapFreeSize(JNIEnv *env, jobject clazz)
 #endif
 }
 
+// smaps files are read with one large buffer, rather than a syscall per kilobyte.
+#define SMAPS_BUFFER_SIZE 16384
+
+static FILE* open_smaps(int pid, const char* name)
+{
+    char tmp[128];
+    snprintf(tmp, sizeof(tmp), "/proc/%d/%s", pid, name);
+    FILE* fp = fopen(tmp, "r");
+    if (fp != 0) {
+        setvbuf(fp, NULL, _IOFBF, SMAPS_BUFFER_SIZE);
+    }
+    return fp;
+}
+
+/*
+ * Matches an smaps line such as "Pss:   12 kB" against the field name, and
+ * stores its value in kB. smaps has a dozen such lines per mapping, too many
+ * to try each of them with sscanf().
+ */
+static inline bool read_kb_field(const char* line, const char* field, size_t fieldLen,
+        unsigned* outValue)
+{
+    if (strncmp(line, field, fieldLen) != 0 || line[fieldLen] != ':') {
+        return false;
+    }
+
+    const char* p = line + fieldLen + 1;
+    while (*p == ' ') {
+        p++;
+    }
+    unsigned value = 0;
+    while (*p >= '0' && *p <= '9') {
+        value = value * 10 + (*p++ - '0');
+    }
+    *outValue = value;
+    return true;
+}
+
 static void read_mapinfo(FILE *fp, stats_t* stats)
 {
     char line[1024];
     int len, nameLen;
     bool skip, done = false;
 
-    unsigned size = 0, resident = 0, pss = 0;
-    unsigned shared_clean = 0, shared_dirty = 0;
-    unsigned private_clean = 0, private_dirty = 0;
-    unsigned referenced = 0;
-    unsigned temp;
+    unsigned pss = 0;
+    unsigned shared_dirty = 0;
+    unsigned private_dirty = 0;
 
     unsigned long int start;
     unsigned long int end = 0;
@@ -196,22 +232,16 @@ static void read_mapinfo(FILE *fp, stats_t* stats)
                 break;
             }
 
-            if (sscanf(line, "Size: %d kB", &temp) == 1) {
-                size = temp;
-            } else if (sscanf(line, "Rss: %d kB", &temp) == 1) {
-                resident = temp;
-            } else if (sscanf(line, "Pss: %d kB", &temp) == 1) {
-                pss = temp;
-            } else if (sscanf(line, "Shared_Clean: %d kB", &temp) == 1) {
-                shared_clean = temp;
-            } else if (sscanf(line, "Shared_Dirty: %d kB", &temp) == 1) {
-                shared_dirty = temp;
-            } else if (sscanf(line, "Private_Clean: %d kB", &temp) == 1) {
-                private_clean = temp;
-            } else if (sscanf(line, "Private_Dirty: %d kB", &temp) == 1) {
-                private_dirty = temp;
-            } else if (sscanf(line, "Referenced: %d kB", &temp) == 1) {
-                referenced = temp;
+            // Field names start with a capital letter, mapping addresses with a
+            // hex digit. Only the fields we report are parsed.
+            if (line[0] >= 'A' && line[0] <= 'Z') {
+                if (line[0] == 'P') {
+                    if (!read_kb_field(line, "Pss", 3, &pss)) {
+                        read_kb_field(line, "Private_Dirty", 13, &private_dirty);
+                    }
+                } else if (line[0] == 'S') {
+                    read_kb_field(line, "Shared_Dirty", 12, &shared_dirty);
+                }
             } else if (strlen(line) > 30 && line[8] == '-' && line[17] == ' ') {
                 // looks like a new mapping
                 // example: "10000000-10001000 ---p 10000000 00:00 0"
@@ -229,11 +259,9 @@ static void read_mapinfo(FILE *fp, stats_t* stats)
 
 static void load_maps(int pid, stats_t* stats)
 {
-    char tmp[128];
     FILE *fp;
     
-    sprintf(tmp, "/proc/%d/smaps", pid);
-    fp = fopen(tmp, "r");
+    fp = open_smaps(pid, "smaps");
     if (fp == 0) return;
 
     read_mapinfo(fp, stats);
@@ -288,11 +316,14 @@ static jlong android_os_Debug_getPssPid(JNIEnv *env, jobject clazz, jint pid)
     jlong pss = 0;
     unsigned temp;
 
-    char tmp[128];
     FILE *fp;
 
-    sprintf(tmp, "/proc/%d/smaps", pid);
-    fp = fopen(tmp, "r");
+    // Kernels that provide smaps_rollup sum up the mappings themselves, which
+    // saves formatting and parsing every one of them.
+    fp = open_smaps(pid, "smaps_rollup");
+    if (fp == 0) {
+        fp = open_smaps(pid, "smaps");
+    }
     if (fp == 0) return 0;
 
     while (true) {
@@ -300,7 +331,7 @@ static jlong android_os_Debug_getPssPid(JNIEnv *env, jobject clazz, jint pid)
             break;
         }
 
-        if (sscanf(line, "Pss: %d kB", &temp) == 1) {
+        if (line[0] == 'P' && read_kb_field(line, "Pss", 3, &temp)) {
             pss += temp;
         }
     }
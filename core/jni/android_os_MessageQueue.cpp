@@ -15,12 +15,18 @@
  */
 
 #define LOG_TAG "MessageQueue-JNI"
+#define ATRACE_TAG ATRACE_TAG_VIEW
 
 #include "JNIHelp.h"
+#include <stdlib.h>
+#include <unistd.h>
 #include <android_runtime/AndroidRuntime.h>
 
+#include <cutils/properties.h>
 #include <utils/Looper.h>
 #include <utils/Log.h>
+#include <utils/Timers.h>
+#include <utils/Trace.h>
 #include "android_os_MessageQueue.h"
 
 namespace android {
@@ -41,12 +47,23 @@ public:
 
     void wake();
 
+    virtual void getStats(Stats* outStats) const;
+
 private:
     bool mInCallback;
     jthrowable mExceptionObj;
+
+    Stats mStats;
+    nsecs_t mLastPollEnd;       // 0 before the first poll
+    nsecs_t mSlowDispatchTime;  // 0 disables the slow dispatch warning
 };
 
 
+MessageQueue::Stats::Stats() :
+        wakeups(0), callbacks(0), timeouts(0), errors(0),
+        blockedTime(0), dispatchTime(0), maxDispatchTime(0) {
+}
+
 MessageQueue::MessageQueue() {
 }
 
@@ -64,7 +81,12 @@ bool MessageQueue::raiseAndClearException(JNIEnv* env, const char* msg) {
     return false;
 }
 
-NativeMessageQueue::NativeMessageQueue() : mInCallback(false), mExceptionObj(NULL) {
+NativeMessageQueue::NativeMessageQueue() : mInCallback(false), mExceptionObj(NULL),
+        mLastPollEnd(0) {
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.messagequeue.slow_ms", value, "0");
+    mSlowDispatchTime = milliseconds_to_nanoseconds(atoi(value));
+
     mLooper = Looper::getForThread();
     if (mLooper == NULL) {
         mLooper = new Looper(false);
@@ -93,9 +115,44 @@ void NativeMessageQueue::raiseException(JNIEnv* env, const char* msg, jthrowable
 }
 
 void NativeMessageQueue::pollOnce(JNIEnv* env, int timeoutMillis) {
+    // Everything the thread did since the last poll returned was dispatching
+    // the messages of the Java queue.
+    nsecs_t pollStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (mLastPollEnd) {
+        nsecs_t dispatchTime = pollStart - mLastPollEnd;
+        mStats.dispatchTime += dispatchTime;
+        if (dispatchTime > mStats.maxDispatchTime) {
+            mStats.maxDispatchTime = dispatchTime;
+        }
+        if (mSlowDispatchTime && dispatchTime > mSlowDispatchTime) {
+            ALOGW("Looper of thread %d held for %lldms between polls",
+                    gettid(), nanoseconds_to_milliseconds(dispatchTime));
+        }
+    }
+
+    ATRACE_BEGIN("pollOnce");
     mInCallback = true;
-    mLooper->pollOnce(timeoutMillis);
+    int result = mLooper->pollOnce(timeoutMillis);
     mInCallback = false;
+    ATRACE_END();
+
+    // The blocked time includes the native fd callbacks the looper ran.
+    mLastPollEnd = systemTime(SYSTEM_TIME_MONOTONIC);
+    mStats.blockedTime += mLastPollEnd - pollStart;
+    switch (result) {
+    case ALOOPER_POLL_WAKE:
+        mStats.wakeups += 1;
+        break;
+    case ALOOPER_POLL_CALLBACK:
+        mStats.callbacks += 1;
+        break;
+    case ALOOPER_POLL_TIMEOUT:
+        mStats.timeouts += 1;
+        break;
+    default:
+        mStats.errors += 1;
+        break;
+    }
     if (mExceptionObj) {
         env->Throw(mExceptionObj);
         env->DeleteLocalRef(mExceptionObj);
@@ -107,6 +164,10 @@ void NativeMessageQueue::wake() {
     mLooper->wake();
 }
 
+void NativeMessageQueue::getStats(Stats* outStats) const {
+    *outStats = mStats;
+}
+
 // ----------------------------------------------------------------------------
 
 static NativeMessageQueue* android_os_MessageQueue_getNativeMessageQueue(JNIEnv* env,
@@ -19,11 +19,32 @@
 
 #include "jni.h"
 #include <utils/Looper.h>
+#include <utils/Timers.h>
 
 namespace android {
 
 class MessageQueue : public RefBase {
 public:
+    /* How the looper of the queue spent its time since the queue was created. */
+    struct Stats {
+        Stats();
+
+        // Number of polls that returned because the looper was woken up, because
+        // native callbacks (file descriptors or native messages) were invoked,
+        // because the timeout expired, or because of an error.
+        uint32_t wakeups;
+        uint32_t callbacks;
+        uint32_t timeouts;
+        uint32_t errors;
+
+        // Time spent polling, which includes running the native callbacks.
+        nsecs_t blockedTime;
+        // Time spent between polls dispatching the messages of the Java queue,
+        // and the longest such stretch.
+        nsecs_t dispatchTime;
+        nsecs_t maxDispatchTime;
+    };
+
     /* Gets the message queue's looper. */
     inline sp<Looper> getLooper() const {
         return mLooper;
@@ -54,6 +75,12 @@ public:
      */
     virtual void raiseException(JNIEnv* env, const char* msg, jthrowable exceptionObj) = 0;
 
+    /* Gets the poll statistics of the queue.
+     *
+     * This method must be called on the thread of the queue.
+     */
+    virtual void getStats(Stats* outStats) const = 0;
+
 protected:
     MessageQueue();
     virtual ~MessageQueue();
@@ -23,6 +23,7 @@
 #include "JNIHelp.h"
 
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -89,6 +90,196 @@ void recycleJavaParcelObject(JNIEnv* env, jobject parcelObj)
     env->CallVoidMethod(parcelObj, gParcelOffsets.recycle);
 }
 
+status_t reserveParcelCapacity(Parcel* parcel, size_t size)
+{
+    const size_t pos = parcel->dataPosition();
+    if (size > size_t(INT_MAX) - pos) {
+        return BAD_VALUE;
+    }
+    return parcel->setDataCapacity(pos + size);
+}
+
+status_t writeArrayToParcel(JNIEnv* env, Parcel* parcel, jarray array, size_t elementSize)
+{
+    if (array == NULL) {
+        return parcel->writeInt32(-1);
+    }
+
+    const jsize len = env->GetArrayLength(array);
+    if (size_t(len) > size_t(INT_MAX) / elementSize) {
+        return BAD_VALUE;
+    }
+
+    status_t err = parcel->writeInt32(len);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    if (len == 0) {
+        return NO_ERROR;
+    }
+
+    void* dest = parcel->writeInplace(len * elementSize);
+    if (dest == NULL) {
+        return NO_MEMORY;
+    }
+
+    void* ar = env->GetPrimitiveArrayCritical(array, 0);
+    if (ar == NULL) {
+        return NO_MEMORY;
+    }
+    memcpy(dest, ar, len * elementSize);
+    env->ReleasePrimitiveArrayCritical(array, ar, JNI_ABORT);
+    return NO_ERROR;
+}
+
+static jarray createArrayFromParcel(JNIEnv* env, Parcel* parcel, size_t elementSize,
+        jarray (*newArray)(JNIEnv* env, jsize len))
+{
+    int32_t len = parcel->readInt32();
+
+    // sanity check the stored length against the true data size
+    if (len < 0 || size_t(len) > parcel->dataAvail() / elementSize) {
+        return NULL;
+    }
+
+    jarray ret = newArray(env, len);
+    if (ret != NULL && len > 0) {
+        void* a2 = env->GetPrimitiveArrayCritical(ret, 0);
+        if (a2) {
+            const void* data = parcel->readInplace(len * elementSize);
+            memcpy(a2, data, len * elementSize);
+            env->ReleasePrimitiveArrayCritical(ret, a2, 0);
+        }
+    }
+    return ret;
+}
+
+static jarray newIntArray(JNIEnv* env, jsize len) { return env->NewIntArray(len); }
+static jarray newLongArray(JNIEnv* env, jsize len) { return env->NewLongArray(len); }
+static jarray newFloatArray(JNIEnv* env, jsize len) { return env->NewFloatArray(len); }
+static jarray newDoubleArray(JNIEnv* env, jsize len) { return env->NewDoubleArray(len); }
+
+jintArray createIntArrayFromParcel(JNIEnv* env, Parcel* parcel)
+{
+    return (jintArray) createArrayFromParcel(env, parcel, sizeof(jint), newIntArray);
+}
+
+jlongArray createLongArrayFromParcel(JNIEnv* env, Parcel* parcel)
+{
+    return (jlongArray) createArrayFromParcel(env, parcel, sizeof(jlong), newLongArray);
+}
+
+jfloatArray createFloatArrayFromParcel(JNIEnv* env, Parcel* parcel)
+{
+    return (jfloatArray) createArrayFromParcel(env, parcel, sizeof(jfloat), newFloatArray);
+}
+
+jdoubleArray createDoubleArrayFromParcel(JNIEnv* env, Parcel* parcel)
+{
+    return (jdoubleArray) createArrayFromParcel(env, parcel, sizeof(jdouble), newDoubleArray);
+}
+
+status_t writeRecordsToParcel(JNIEnv* env, Parcel* parcel, jbyteArray data,
+        jint offset, jint length)
+{
+    if (offset < 0 || length < 0 || length > env->GetArrayLength(data) - offset) {
+        return BAD_VALUE;
+    }
+
+    void* dest = parcel->writeInplace(length);
+    if (dest == NULL) {
+        return NO_MEMORY;
+    }
+
+    jbyte* ar = (jbyte*)env->GetPrimitiveArrayCritical(data, 0);
+    if (ar == NULL) {
+        return NO_MEMORY;
+    }
+    memcpy(dest, ar + offset, length);
+    env->ReleasePrimitiveArrayCritical(data, ar, JNI_ABORT);
+    return NO_ERROR;
+}
+
+status_t readRecordsFromParcel(JNIEnv* env, Parcel* parcel, jbyteArray data,
+        jint offset, jint length)
+{
+    if (offset < 0 || length < 0 || length > env->GetArrayLength(data) - offset) {
+        return BAD_VALUE;
+    }
+
+    const void* src = parcel->readInplace(length);
+    if (src == NULL) {
+        return NOT_ENOUGH_DATA;
+    }
+
+    jbyte* ar = (jbyte*)env->GetPrimitiveArrayCritical(data, 0);
+    if (ar == NULL) {
+        return NO_MEMORY;
+    }
+    memcpy(ar + offset, src, length);
+    env->ReleasePrimitiveArrayCritical(data, ar, 0);
+    return NO_ERROR;
+}
+
+status_t writeByteArrayBlobToParcel(JNIEnv* env, Parcel* parcel, jbyteArray data,
+        jint offset, jint length)
+{
+    if (data == NULL) {
+        return parcel->writeInt32(-1);
+    }
+    if (offset < 0 || length < 0 || length > env->GetArrayLength(data) - offset) {
+        return BAD_VALUE;
+    }
+
+    status_t err = parcel->writeInt32(length);
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    // Parcel::writeBlob() moves blobs above its in-place limit to an ashmem region when
+    // the parcel allows file descriptors, so only the descriptor goes through the driver.
+    Parcel::WritableBlob blob;
+    err = parcel->writeBlob(length, &blob);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    env->GetByteArrayRegion(data, offset, length, static_cast<jbyte*>(blob.data()));
+    blob.release();
+    return NO_ERROR;
+}
+
+status_t readBlobFromParcel(Parcel* parcel, Parcel::ReadableBlob* outBlob, ssize_t* outLength)
+{
+    int32_t len = parcel->readInt32();
+    if (len < 0) {
+        *outLength = -1;
+        return NO_ERROR;
+    }
+
+    status_t err = parcel->readBlob(len, outBlob);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    *outLength = len;
+    return NO_ERROR;
+}
+
+jbyteArray createByteArrayFromParcelBlob(JNIEnv* env, Parcel* parcel)
+{
+    Parcel::ReadableBlob blob;
+    ssize_t len;
+    if (readBlobFromParcel(parcel, &blob, &len) != NO_ERROR || len < 0) {
+        return NULL;
+    }
+
+    jbyteArray ret = env->NewByteArray(len);
+    if (ret != NULL) {
+        env->SetByteArrayRegion(ret, 0, len, static_cast<const jbyte*>(blob.data()));
+    }
+    blob.release();
+    return ret;
+}
+
 static jint android_os_Parcel_dataSize(JNIEnv* env, jclass clazz, jint nativePtr)
 {
     Parcel* parcel = reinterpret_cast<Parcel*>(nativePtr);
@@ -15,6 +15,7 @@
  */
 
 #include <binder/IBinder.h>
+#include <binder/Parcel.h>
 
 #include "jni.h"
 
@@ -26,4 +27,38 @@ extern Parcel* parcelForJavaObject(JNIEnv* env, jobject obj);
 extern jobject createJavaParcelObject(JNIEnv* env);
 extern void recycleJavaParcelObject(JNIEnv* env, jobject object);
 
+// Grows the capacity of the parcel so that size more bytes can be written at the
+// current position without reallocating.
+extern status_t reserveParcelCapacity(Parcel* parcel, size_t size);
+
+// Bulk transfers of int, long, float and double arrays. The element count is followed by
+// the elements laid out exactly as writeInt32(), writeInt64(), writeFloat() or writeDouble()
+// would write them one at a time, so both sides need not use the bulk form. A NULL array
+// is written as a count of -1, and the create functions return NULL for it.
+extern status_t writeArrayToParcel(JNIEnv* env, Parcel* parcel, jarray array, size_t elementSize);
+extern jintArray createIntArrayFromParcel(JNIEnv* env, Parcel* parcel);
+extern jlongArray createLongArrayFromParcel(JNIEnv* env, Parcel* parcel);
+extern jfloatArray createFloatArrayFromParcel(JNIEnv* env, Parcel* parcel);
+extern jdoubleArray createDoubleArrayFromParcel(JNIEnv* env, Parcel* parcel);
+
+// Copies fixed-layout records, flattened into a byte array in native byte order, to or
+// from the parcel without a length prefix. The data is padded to 4 bytes like any other
+// parcel write.
+extern status_t writeRecordsToParcel(JNIEnv* env, Parcel* parcel, jbyteArray data,
+        jint offset, jint length);
+extern status_t readRecordsFromParcel(JNIEnv* env, Parcel* parcel, jbyteArray data,
+        jint offset, jint length);
+
+// Byte arrays written as parcel blobs. Blobs larger than the in-place limit of Parcel are
+// stored in an ashmem region passed as a file descriptor, instead of being copied into the
+// transaction, when the parcel allows file descriptors. Readers map the region read-only:
+// native readers use the data of the ReadableBlob in place, and must release it when done.
+// A NULL array is written as a length of -1, which readBlobFromParcel() returns as is
+// without a blob, and for which createByteArrayFromParcelBlob() returns NULL.
+extern status_t writeByteArrayBlobToParcel(JNIEnv* env, Parcel* parcel, jbyteArray data,
+        jint offset, jint length);
+extern status_t readBlobFromParcel(Parcel* parcel, Parcel::ReadableBlob* outBlob,
+        ssize_t* outLength);
+extern jbyteArray createByteArrayFromParcelBlob(JNIEnv* env, Parcel* parcel);
+
 }
@@ -23,15 +23,95 @@
 #include "jni.h"
 #include "android_runtime/AndroidRuntime.h"
 #include <nativehelper/JNIHelp.h>
+#include <utils/threads.h>
 
 namespace android
 {
 
+/*
+ * Copies the key into buf without allocating. Returns false if the key is
+ * too long to name a property, reads of such a key find nothing.
+ */
+static bool getKey(JNIEnv* env, jstring keyJ, char* buf)
+{
+    jsize len = env->GetStringUTFLength(keyJ);
+    if (len >= PROPERTY_KEY_MAX) {
+        return false;
+    }
+    env->GetStringUTFRegion(keyJ, 0, env->GetStringLength(keyJ), buf);
+    buf[len] = '\0';
+    return true;
+}
+
+static int getProperty(JNIEnv* env, jstring keyJ, char* value)
+{
+    char key[PROPERTY_KEY_MAX];
+    if (!getKey(env, keyJ, key)) {
+        value[0] = '\0';
+        return 0;
+    }
+    return property_get(key, value, "");
+}
+
+/*
+ * The strings last returned for a few properties. Framework code polls some
+ * properties often, returning the same string while the value is unchanged
+ * avoids allocating a new one on every read.
+ */
+#define VALUE_CACHE_SIZE 32
+
+struct CachedValue {
+    char key[PROPERTY_KEY_MAX];
+    char value[PROPERTY_VALUE_MAX];
+    jstring valueJ;
+};
+
+static Mutex sValueCacheLock;
+static CachedValue sValueCache[VALUE_CACHE_SIZE];
+static size_t sValueCacheNext = 0;
+
+static jstring getValueString(JNIEnv* env, const char* key, const char* value)
+{
+    AutoMutex _l(sValueCacheLock);
+
+    CachedValue* entry = NULL;
+    for (size_t i = 0; i < VALUE_CACHE_SIZE; i++) {
+        if (sValueCache[i].valueJ != NULL && !strcmp(sValueCache[i].key, key)) {
+            entry = &sValueCache[i];
+            break;
+        }
+    }
+    if (entry != NULL && !strcmp(entry->value, value)) {
+        return (jstring) env->NewLocalRef(entry->valueJ);
+    }
+
+    jstring valueJ = env->NewStringUTF(value);
+    if (valueJ == NULL) {
+        return NULL;
+    }
+    jstring globalJ = (jstring) env->NewGlobalRef(valueJ);
+    if (globalJ == NULL) {
+        return valueJ;
+    }
+
+    if (entry == NULL) {
+        entry = &sValueCache[sValueCacheNext];
+        sValueCacheNext = (sValueCacheNext + 1) % VALUE_CACHE_SIZE;
+        strcpy(entry->key, key);
+    }
+    if (entry->valueJ != NULL) {
+        env->DeleteGlobalRef(entry->valueJ);
+    }
+    strcpy(entry->value, value);
+    entry->valueJ = globalJ;
+    return valueJ;
+}
+
 static jstring SystemProperties_getSS(JNIEnv *env, jobject clazz,
                                       jstring keyJ, jstring defJ)
 {
     int len;
-    const char* key;
+    char key[PROPERTY_KEY_MAX];
     char buf[PROPERTY_VALUE_MAX];
     jstring rvJ = NULL;
 
@@ -40,19 +120,15 @@ static jstring SystemProperties_getSS(JNIEnv *env, jobject clazz,
         goto error;
     }
 
-    key = env->GetStringUTFChars(keyJ, NULL);
-
-    len = property_get(key, buf, "");
+    len = getKey(env, keyJ, key) ? property_get(key, buf, "") : 0;
     if ((len <= 0) && (defJ != NULL)) {
         rvJ = defJ;
-    } else if (len >= 0) {
-        rvJ = env->NewStringUTF(buf);
+    } else if (len > 0) {
+        rvJ = getValueString(env, key, buf);
     } else {
         rvJ = env->NewStringUTF("");
     }
 
-    env->ReleaseStringUTFChars(keyJ, key);
-
 error:
     return rvJ;
 }
@@ -67,7 +143,6 @@ static jint SystemProperties_get_int(JNIEnv *env, jobject clazz,
                                       jstring keyJ, jint defJ)
 {
     int len;
-    const char* key;
     char buf[PROPERTY_VALUE_MAX];
     char* end;
     jint result = defJ;
@@ -77,9 +152,7 @@ static jint SystemProperties_get_int(JNIEnv *env, jobject clazz,
         goto error;
     }
 
-    key = env->GetStringUTFChars(keyJ, NULL);
-
-    len = property_get(key, buf, "");
+    len = getProperty(env, keyJ, buf);
     if (len > 0) {
         result = strtol(buf, &end, 0);
         if (end == buf) {
@@ -87,8 +160,6 @@ static jint SystemProperties_get_int(JNIEnv *env, jobject clazz,
         }
     }
 
-    env->ReleaseStringUTFChars(keyJ, key);
-
 error:
     return result;
 }
@@ -97,7 +168,6 @@ static jlong SystemProperties_get_long(JNIEnv *env, jobject clazz,
                                       jstring keyJ, jlong defJ)
 {
     int len;
-    const char* key;
     char buf[PROPERTY_VALUE_MAX];
     char* end;
     jlong result = defJ;
@@ -107,9 +177,7 @@ static jlong SystemProperties_get_long(JNIEnv *env, jobject clazz,
         goto error;
     }
 
-    key = env->GetStringUTFChars(keyJ, NULL);
-
-    len = property_get(key, buf, "");
+    len = getProperty(env, keyJ, buf);
     if (len > 0) {
         result = strtoll(buf, &end, 0);
         if (end == buf) {
@@ -117,8 +185,6 @@ static jlong SystemProperties_get_long(JNIEnv *env, jobject clazz,
         }
     }
 
-    env->ReleaseStringUTFChars(keyJ, key);
-
 error:
     return result;
 }
@@ -127,7 +193,6 @@ static jboolean SystemProperties_get_boolean(JNIEnv *env, jobject clazz,
                                       jstring keyJ, jboolean defJ)
 {
     int len;
-    const char* key;
     char buf[PROPERTY_VALUE_MAX];
     jboolean result = defJ;
 
@@ -136,9 +201,7 @@ static jboolean SystemProperties_get_boolean(JNIEnv *env, jobject clazz,
         goto error;
     }
 
-    key = env->GetStringUTFChars(keyJ, NULL);
-
-    len = property_get(key, buf, "");
+    len = getProperty(env, keyJ, buf);
     if (len == 1) {
         char ch = buf[0];
         if (ch == '0' || ch == 'n')
@@ -153,8 +216,6 @@ static jboolean SystemProperties_get_boolean(JNIEnv *env, jobject clazz,
         }
     }
 
-    env->ReleaseStringUTFChars(keyJ, key);
-
 error:
     return result;
 }
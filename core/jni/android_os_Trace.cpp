@@ -17,26 +17,65 @@
 #define LOG_TAG "Trace"
 
 #include <JNIHelp.h>
-#include <ScopedUtfChars.h>
 
 #include <utils/Trace.h>
 #include <cutils/log.h>
 
 namespace android {
 
+/*
+ * Gets the name of a traced section or counter. Names short enough are copied
+ * into a buffer on the stack, sparing the allocation GetStringUTFChars() makes
+ * for every event.
+ */
+class TraceName {
+public:
+    TraceName(JNIEnv* env, jstring nameStr) : mEnv(env), mNameStr(nameStr), mChars(NULL) {
+        if (nameStr == NULL) {
+            jniThrowNullPointerException(env, NULL);
+            mBuffer[0] = '\0';
+            return;
+        }
+        jsize utfLength = env->GetStringUTFLength(nameStr);
+        if (utfLength < (jsize) sizeof(mBuffer)) {
+            env->GetStringUTFRegion(nameStr, 0, env->GetStringLength(nameStr), mBuffer);
+            mBuffer[utfLength] = '\0';
+        } else {
+            mBuffer[0] = '\0';
+            mChars = env->GetStringUTFChars(nameStr, NULL);
+        }
+    }
+
+    ~TraceName() {
+        if (mChars != NULL) {
+            mEnv->ReleaseStringUTFChars(mNameStr, mChars);
+        }
+    }
+
+    const char* c_str() const {
+        return mChars != NULL ? mChars : mBuffer;
+    }
+
+private:
+    JNIEnv* mEnv;
+    jstring mNameStr;
+    const char* mChars;
+    char mBuffer[128];
+};
+
 static jlong android_os_Trace_nativeGetEnabledTags(JNIEnv* env, jclass clazz) {
     return Tracer::getEnabledTags();
 }
 
 static void android_os_Trace_nativeTraceCounter(JNIEnv* env, jclass clazz,
         jlong tag, jstring nameStr, jint value) {
-    ScopedUtfChars name(env, nameStr);
+    TraceName name(env, nameStr);
     Tracer::traceCounter(tag, name.c_str(), value);
 }
 
 static void android_os_Trace_nativeTraceBegin(JNIEnv* env, jclass clazz,
         jlong tag, jstring nameStr) {
-    ScopedUtfChars name(env, nameStr);
+    TraceName name(env, nameStr);
     Tracer::traceBegin(tag, name.c_str());
 }
 
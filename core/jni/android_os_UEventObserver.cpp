@@ -22,6 +22,8 @@
 #include "JNIHelp.h"
 #include "android_runtime/AndroidRuntime.h"
 
+#include <stdlib.h>
+
 namespace android
 {
 
@@ -37,13 +39,25 @@ android_os_UEventObserver_native_setup(JNIEnv *env, jclass clazz)
 static int
 android_os_UEventObserver_next_event(JNIEnv *env, jclass clazz, jbyteArray jbuffer)
 {
+    // Wait for the event in a native buffer rather than keeping the Java
+    // array pinned for as long as the device stays quiet, then copy only the
+    // bytes of the event.
+    char stackBuffer[1024];
     int buf_sz = env->GetArrayLength(jbuffer);
-    char *buffer = (char*)env->GetByteArrayElements(jbuffer, NULL);
+    char *buffer = buf_sz <= (int)sizeof(stackBuffer) ? stackBuffer : (char*)malloc(buf_sz);
+    if (buffer == NULL) {
+        jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+        return 0;
+    }
 
     int length = uevent_next_event(buffer, buf_sz - 1);
+    if (length > 0) {
+        env->SetByteArrayRegion(jbuffer, 0, length, (jbyte*)buffer);
+    }
 
-    env->ReleaseByteArrayElements(jbuffer, (jbyte*)buffer, 0);
-
+    if (buffer != stackBuffer) {
+        free(buffer);
+    }
     return length;
 }
 
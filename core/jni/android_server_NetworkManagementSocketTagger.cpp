@@ -21,15 +21,44 @@
 
 #include "jni.h"
 #include <utils/misc.h>
+#include <utils/KeyedVector.h>
+#include <utils/threads.h>
 #include <cutils/qtaguid.h>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 
 namespace android {
 
+/*
+ * Tags this process last applied to its sockets, so that tagging a socket
+ * again with the same tag and uid skips the write to the qtaguid ctrl file.
+ * Entries are keyed by fd and remember the socket inode, since an fd may be
+ * closed and reused for another socket without being untagged first.
+ */
+struct SocketTag {
+  ino_t ino;
+  int tagNum;
+  uid_t uid;
+};
+
+static const size_t MAX_SOCKET_TAGS = 256;
+
+static Mutex gSocketTagLock;
+static KeyedVector<int, SocketTag> gSocketTags;
+
+static bool getSocketInode(int fd, ino_t* ino) {
+  struct stat st;
+  if (fstat(fd, &st) < 0 || !S_ISSOCK(st.st_mode)) {
+    return false;
+  }
+  *ino = st.st_ino;
+  return true;
+}
+
 static jint QTagUid_tagSocketFd(JNIEnv* env, jclass,
                                 jobject fileDescriptor,
                                 jint tagNum, jint uid) {
@@ -40,9 +69,36 @@ static jint QTagUid_tagSocketFd(JNIEnv* env, jclass,
     return (jint)-1;
   }
 
+  AutoMutex _l(gSocketTagLock);
+  ino_t ino;
+  bool haveIno = getSocketInode(userFd, &ino);
+  if (haveIno) {
+    ssize_t index = gSocketTags.indexOfKey(userFd);
+    if (index >= 0) {
+      const SocketTag& tag = gSocketTags.valueAt(index);
+      if (tag.ino == ino && tag.tagNum == tagNum && tag.uid == (uid_t)uid) {
+        return 0;
+      }
+    }
+  }
+
   int res = qtaguid_tagSocket(userFd, tagNum, uid);
   if (res < 0) {
-    return (jint)-errno;
+    int err = errno;
+    gSocketTags.removeItem(userFd);
+    return (jint)-err;
+  }
+
+  if (haveIno) {
+    // Sockets closed without being untagged leave stale entries behind.
+    if (gSocketTags.size() >= MAX_SOCKET_TAGS) {
+      gSocketTags.clear();
+    }
+    SocketTag tag;
+    tag.ino = ino;
+    tag.tagNum = tagNum;
+    tag.uid = uid;
+    gSocketTags.replaceValueFor(userFd, tag);
   }
   return (jint)res;
 }
@@ -56,6 +112,9 @@ static int QTagUid_untagSocketFd(JNIEnv* env, jclass,
     return (jint)-1;
   }
 
+  AutoMutex _l(gSocketTagLock);
+  gSocketTags.removeItem(userFd);
+
   int res = qtaguid_untagSocket(userFd);
   if (res < 0) {
     return (jint)-errno;
@@ -76,6 +135,10 @@ static jint QTagUid_setCounterSet(JNIEnv* env, jclass,
 static jint QTagUid_deleteTagData(JNIEnv* env, jclass,
                                   jint tagNum, jint uid) {
 
+  AutoMutex _l(gSocketTagLock);
+  // The kernel drops the socket tags of the deleted data as well.
+  gSocketTags.clear();
+
   int res = qtaguid_deleteTagData(tagNum, uid);
   if (res < 0) {
     return (jint)-errno;
@@ -23,8 +23,69 @@
 #include "utils/Log.h"
 #include "unicode/ubidi.h"
 
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__ARM_HAVE_NEON)
+    #include <arm_neon.h>
+#endif
+
 namespace android {
 
+// Characters below the Hebrew block are all left-to-right or neutral, and in a
+// paragraph that is left-to-right (or defaults to it) every one of them
+// resolves to level 0.
+static const jchar FIRST_RTL_CHAR = 0x0590;
+
+static bool isSimpleLtr(const jchar* chs, int n)
+{
+    int i = 0;
+#if defined(__ARM_HAVE_NEON)
+    const uint16x8_t limit = vdupq_n_u16(FIRST_RTL_CHAR);
+    uint16x8_t rtl = vdupq_n_u16(0);
+    for (; i + 8 <= n; i += 8) {
+        rtl = vorrq_u16(rtl, vcgeq_u16(vld1q_u16(chs + i), limit));
+    }
+    uint32x4_t wide = vreinterpretq_u32_u16(rtl);
+    uint32x2_t folded = vorr_u32(vget_low_u32(wide), vget_high_u32(wide));
+    if (vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) {
+        return false;
+    }
+#endif
+    for (; i < n; i++) {
+        if (chs[i] >= FIRST_RTL_CHAR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Each thread keeps one UBiDi object, which grows as needed, rather than
+// opening one for every paragraph.
+static pthread_key_t sBidiKey;
+static pthread_once_t sBidiKeyOnce = PTHREAD_ONCE_INIT;
+
+static void closeBidi(void* bidi)
+{
+    ubidi_close(reinterpret_cast<UBiDi*>(bidi));
+}
+
+static void createBidiKey()
+{
+    pthread_key_create(&sBidiKey, closeBidi);
+}
+
+static UBiDi* getThreadBidi()
+{
+    pthread_once(&sBidiKeyOnce, createBidiKey);
+    UBiDi* bidi = reinterpret_cast<UBiDi*>(pthread_getspecific(sBidiKey));
+    if (bidi == NULL) {
+        bidi = ubidi_open();
+        pthread_setspecific(sBidiKey, bidi);
+    }
+    return bidi;
+}
+
 static jint runBidi(JNIEnv* env, jobject obj, jint dir, jcharArray chsArray,
                     jbyteArray infoArray, int n, jboolean haveInfo)
 {
@@ -36,18 +97,29 @@ static jint runBidi(JNIEnv* env, jobject obj, jint dir, jcharArray chsArray,
     if (chs != NULL) {
         jbyte* info = env->GetByteArrayElements(infoArray, NULL);
         if (info != NULL) {
-            UErrorCode status = U_ZERO_ERROR;
-            UBiDi* bidi = ubidi_openSized(n, 0, &status);
-            ubidi_setPara(bidi, chs, n, dir, NULL, &status);
-            if (U_SUCCESS(status)) {
-                for (int i = 0; i < n; ++i) {
-                  info[i] = ubidi_getLevelAt(bidi, i);
-                }
-                result = ubidi_getParaLevel(bidi);
+            UBiDiLevel paraLevel = (UBiDiLevel) dir;
+            if ((paraLevel == 0 || paraLevel == UBIDI_DEFAULT_LTR) && isSimpleLtr(chs, n)) {
+                memset(info, 0, n);
+                result = 0;
             } else {
-                jniThrowException(env, "java/lang/RuntimeException", NULL);
+                UErrorCode status = U_ZERO_ERROR;
+                UBiDi* bidi = getThreadBidi();
+                if (bidi != NULL) {
+                    ubidi_setPara(bidi, chs, n, paraLevel, NULL, &status);
+                } else {
+                    status = U_MEMORY_ALLOCATION_ERROR;
+                }
+                const UBiDiLevel* levels = NULL;
+                if (U_SUCCESS(status)) {
+                    levels = ubidi_getLevels(bidi, &status);
+                }
+                if (U_SUCCESS(status)) {
+                    memcpy(info, levels, n);
+                    result = ubidi_getParaLevel(bidi);
+                } else {
+                    jniThrowException(env, "java/lang/RuntimeException", NULL);
+                }
             }
-            ubidi_close(bidi);
 
             env->ReleaseByteArrayElements(infoArray, info, 0);
         }
@@ -961,7 +961,10 @@ static jboolean android_content_AssetManager_applyStyle(JNIEnv* env, jobject cla
     }
 
     // Now lock down the resource object and start pulling stuff from it.
+    // The theme is locked as well so that the attributes below are looked
+    // up in its cache without taking its lock for each one.
     res.lock();
+    theme->lock();
 
     // Apply theme redirections to the referenced styles.
     if (defStyleRes != 0) {
@@ -1068,7 +1071,7 @@ static jboolean android_content_AssetManager_applyStyle(JNIEnv* env, jobject cla
         uint32_t resid = 0;
         if (value.dataType != Res_value::TYPE_NULL) {
             // Take care of resolving the found resource to its final value.
-            ssize_t newBlock = theme->resolveAttributeReference(&value, block,
+            ssize_t newBlock = theme->resolveAttributeReferenceLocked(&value, block,
                     &resid, &typeSetFlags, &config);
             if (newBlock >= 0) block = newBlock;
             DEBUG_STYLES(ALOGI("-> Resolved attr: type=0x%x, data=0x%08x",
@@ -1076,7 +1079,7 @@ static jboolean android_content_AssetManager_applyStyle(JNIEnv* env, jobject cla
         } else {
             // If we still don't have a value for this attribute, try to find
             // it in the theme!
-            ssize_t newBlock = theme->getAttribute(curIdent, &value, &typeSetFlags);
+            ssize_t newBlock = theme->getAttributeLocked(curIdent, &value, &typeSetFlags);
             if (newBlock >= 0) {
                 DEBUG_STYLES(ALOGI("-> From theme: type=0x%x, data=0x%08x",
                         value.dataType, value.data));
@@ -1085,6 +1088,8 @@ static jboolean android_content_AssetManager_applyStyle(JNIEnv* env, jobject cla
 #if THROW_ON_BAD_ID
                 if (newBlock == BAD_INDEX) {
                     jniThrowException(env, "java/lang/IllegalStateException", "Bad resource!");
+                    theme->unlock();
+                    res.unlock();
                     return JNI_FALSE;
                 }
 #endif
@@ -1112,6 +1117,8 @@ static jboolean android_content_AssetManager_applyStyle(JNIEnv* env, jobject cla
 #if THROW_ON_BAD_ID
                     if (newBlock == BAD_INDEX) {
                         jniThrowException(env, "java/lang/IllegalStateException", "Bad resource!");
+                        theme->unlock();
+                        res.unlock();
                         return JNI_FALSE;
                     }
 #endif
@@ -1146,6 +1153,7 @@ static jboolean android_content_AssetManager_applyStyle(JNIEnv* env, jobject cla
         dest += STYLE_NUM_ENTRIES;
     }
 
+    theme->unlock();
     res.unlock();
 
     if (indices != NULL) {
@@ -1456,8 +1464,13 @@ static jint android_content_AssetManager_openXmlAssetNative(JNIEnv* env, jobject
         return 0;
     }
 
+    // The parsers of the system packages' trees skip the per-node checks,
+    // their layouts are inflated over and over.
+    const bool validateAll = cookie != 0
+            && strncmp(am->getAssetPath((void*)cookie).string(), "/system/", 8) == 0;
+
     ResXMLTree* block = new ResXMLTree();
-    status_t err = block->setTo(a->getBuffer(true), a->getLength(), true);
+    status_t err = block->setTo(a->getBuffer(true), a->getLength(), true, validateAll);
     a->close();
     delete a;
 
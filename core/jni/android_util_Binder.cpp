@@ -41,6 +41,7 @@
 #include <binder/IServiceManager.h>
 #include <utils/threads.h>
 #include <utils/String8.h>
+#include <utils/Timers.h>
 
 #include <ScopedUtfChars.h>
 #include <ScopedLocalRef.h>
@@ -228,13 +229,126 @@ bail:
     env->DeleteLocalRef(msgstr);
 }
 
+// ----------------------------------------------------------------------------
+// Latency and payload size histograms of the transactions made and received by
+// Java binders, per interface and transaction code. Buckets are powers of two.
+
+#define BINDER_CALL_LATENCY_BUCKETS 24  // microseconds, the last one holds 8s and more
+#define BINDER_CALL_SIZE_BUCKETS 21     // bytes, the last one holds 1MB and more
+#define MAX_BINDER_CALL_STATS 1000
+
+struct BinderCallKey {
+    String16 descriptor;
+    uint32_t code;
+    bool incoming;
+
+    BinderCallKey() : code(0), incoming(false) { }
+    BinderCallKey(const String16& descriptor, uint32_t code, bool incoming)
+        : descriptor(descriptor), code(code), incoming(incoming) { }
+
+    bool operator<(const BinderCallKey& rhs) const {
+        if (incoming != rhs.incoming) return incoming < rhs.incoming;
+        if (code != rhs.code) return code < rhs.code;
+        return descriptor < rhs.descriptor;
+    }
+};
+
+struct BinderCallStats {
+    uint32_t count;
+    nsecs_t totalTime;
+    nsecs_t maxTime;
+    uint32_t latency[BINDER_CALL_LATENCY_BUCKETS];
+    uint32_t size[BINDER_CALL_SIZE_BUCKETS];
+};
+
+static Mutex gBinderCallStatsLock;
+static KeyedVector<BinderCallKey, BinderCallStats*> gBinderCallStats;
+static uint32_t gUntrackedBinderCalls = 0;
+
+static size_t log2Bucket(uint64_t value, size_t count)
+{
+    size_t bucket = 0;
+    while (value > 1 && bucket < count - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// Must be called with gBinderCallStatsLock held.
+static void recordBinderCallLocked(const String16& descriptor, uint32_t code, bool incoming,
+        nsecs_t duration, size_t payloadSize)
+{
+    BinderCallStats* stats;
+    BinderCallKey key(descriptor, code, incoming);
+    ssize_t index = gBinderCallStats.indexOfKey(key);
+    if (index >= 0) {
+        stats = gBinderCallStats.valueAt(index);
+    } else if (gBinderCallStats.size() < MAX_BINDER_CALL_STATS) {
+        stats = new BinderCallStats();
+        memset(stats, 0, sizeof(BinderCallStats));
+        gBinderCallStats.add(key, stats);
+    } else {
+        gUntrackedBinderCalls++;
+        return;
+    }
+
+    stats->count++;
+    stats->totalTime += duration;
+    if (duration > stats->maxTime) {
+        stats->maxTime = duration;
+    }
+    stats->latency[log2Bucket(ns2us(duration), BINDER_CALL_LATENCY_BUCKETS)]++;
+    stats->size[log2Bucket(payloadSize, BINDER_CALL_SIZE_BUCKETS)]++;
+}
+
+namespace android {
+
+void dumpBinderCallStats(int fd)
+{
+    String8 result;
+    {
+        AutoMutex _l(gBinderCallStatsLock);
+        result.appendFormat("Binder call statistics (%d calls not tracked):\n",
+                gUntrackedBinderCalls);
+        for (size_t i = 0; i < gBinderCallStats.size(); i++) {
+            const BinderCallKey& key = gBinderCallStats.keyAt(i);
+            const BinderCallStats* stats = gBinderCallStats.valueAt(i);
+
+            result.appendFormat("  %s %s code %d: %d calls, avg %.3f ms, max %.3f ms\n",
+                    key.incoming ? "in " : "out", String8(key.descriptor).string(), key.code,
+                    stats->count, stats->totalTime / (stats->count * 1000000.0f),
+                    stats->maxTime / 1000000.0f);
+            result.append("    latency:");
+            for (size_t j = 0; j < BINDER_CALL_LATENCY_BUCKETS; j++) {
+                if (stats->latency[j]) {
+                    result.appendFormat(j < BINDER_CALL_LATENCY_BUCKETS - 1 ? " <%dus:%d" : " >=%dus:%d",
+                            j < BINDER_CALL_LATENCY_BUCKETS - 1 ? 2 << j : 1 << j, stats->latency[j]);
+                }
+            }
+            result.append("\n    size:");
+            for (size_t j = 0; j < BINDER_CALL_SIZE_BUCKETS; j++) {
+                if (stats->size[j]) {
+                    result.appendFormat(j < BINDER_CALL_SIZE_BUCKETS - 1 ? " <%dB:%d" : " >=%dB:%d",
+                            j < BINDER_CALL_SIZE_BUCKETS - 1 ? 2 << j : 1 << j, stats->size[j]);
+                }
+            }
+            result.append("\n");
+        }
+    }
+    write(fd, result.string(), result.size());
+}
+
+}
+
 class JavaBBinderHolder;
 
 class JavaBBinder : public BBinder
 {
 public:
     JavaBBinder(JNIEnv* env, jobject object)
-        : mVM(jnienv_to_javavm(env)), mObject(env->NewGlobalRef(object))
+        : mVM(jnienv_to_javavm(env)), mObject(env->NewGlobalRef(object)),
+          mDescriptorKnown(false)
     {
         ALOGV("Creating JavaBBinder %p\n", this);
         android_atomic_inc(&gNumLocalRefs);
@@ -267,6 +381,8 @@ protected:
 
         ALOGV("onTransact() on %p calling object %p in env %p vm %p\n", this, mObject, env, mVM);
 
+        const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+
         IPCThreadState* thread_state = IPCThreadState::self();
         const int strict_policy_before = thread_state->getStrictModePolicy();
         thread_state->setLastTransactionBinderFlags(flags);
@@ -314,6 +430,8 @@ protected:
             BBinder::onTransact(code, data, reply, flags);
         }
 
+        recordTransaction(code, data, reply, systemTime(SYSTEM_TIME_MONOTONIC) - start);
+
         //aout << "onTransact to Java code; result=" << res << endl
         //    << "Transact from " << this << " to Java code returning "
         //    << reply << ": " << *reply << endl;
@@ -326,8 +444,31 @@ protected:
     }
 
 private:
+    void recordTransaction(uint32_t code, const Parcel& data, Parcel* reply, nsecs_t duration)
+    {
+        AutoMutex _l(gBinderCallStatsLock);
+
+        // Local binders have no descriptor of their own: take it from the interface token
+        // of the first call that carries one, which follows the strict mode policy.
+        if (!mDescriptorKnown && code >= FIRST_CALL_TRANSACTION && code <= LAST_CALL_TRANSACTION) {
+            const size_t pos = data.dataPosition();
+            data.setDataPosition(0);
+            data.readInt32();
+            mDescriptor = data.readString16();
+            data.setDataPosition(pos);
+            mDescriptorKnown = true;
+        }
+
+        recordBinderCallLocked(mDescriptor, code, true, duration,
+                data.dataSize() + (reply ? reply->dataSize() : 0));
+    }
+
     JavaVM* const   mVM;
     jobject const   mObject;
+
+    // Guarded by gBinderCallStatsLock.
+    String16        mDescriptor;
+    bool            mDescriptorKnown;
 };
 
 // ----------------------------------------------------------------------------
@@ -1085,13 +1226,24 @@ static jboolean android_os_BinderProxy_transact(JNIEnv* env, jobject obj,
     if (time_binder_calls) {
         start_millis = uptimeMillis();
     }
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
     //printf("Transact from Java code to %p sending: ", target); data->print();
     status_t err = target->transact(code, *data, reply, flags);
     //if (reply) printf("Transact from Java code to %p received: ", target); reply->print();
+    const nsecs_t duration = systemTime(SYSTEM_TIME_MONOTONIC) - start;
     if (time_binder_calls) {
         conditionally_log_binder_call(start_millis, target, code);
     }
 
+    // Calls to local binders are recorded when they are received. A proxy fetches its
+    // descriptor from the remote side the first time only, and caches it.
+    if (target->localBinder() == NULL) {
+        const String16& descriptor = target->getInterfaceDescriptor();
+        AutoMutex _l(gBinderCallStatsLock);
+        recordBinderCallLocked(descriptor, code, false, duration,
+                data->dataSize() + (reply ? reply->dataSize() : 0));
+    }
+
     if (err == NO_ERROR) {
         return JNI_TRUE;
     } else if (err == UNKNOWN_TRANSACTION) {
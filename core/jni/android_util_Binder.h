@@ -35,6 +35,10 @@ extern void set_dalvik_blockguard_policy(JNIEnv* env, jint strict_policy);
 extern void signalExceptionForError(JNIEnv* env, jobject obj, status_t err,
         bool canThrowRemoteException = false);
 
+// Writes the latency and payload size histograms of the transactions made and received
+// by Java binders in this process, per interface and transaction code.
+extern void dumpBinderCallStats(int fd);
+
 }
 
 #endif
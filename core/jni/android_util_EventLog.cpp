@@ -20,6 +20,7 @@
 #include "android_runtime/AndroidRuntime.h"
 #include "jni.h"
 #include "cutils/logger.h"
+#include <utils/SortedVector.h>
 
 // The size of the tag number comes out of the payload size.
 #define MAX_EVENT_PAYLOAD (LOGGER_ENTRY_MAX_PAYLOAD - sizeof(int32_t))
@@ -70,17 +71,24 @@ static jint android_util_EventLog_writeEvent_String(JNIEnv* env, jobject clazz,
 
     // Don't throw NPE -- I feel like it's sort of mean for a logging function
     // to be all crashy if you pass in NULL -- but make the NULL value explicit.
-    const char *str = value != NULL ? env->GetStringUTFChars(value, NULL) : "NULL";
-    jint len = strlen(str);
-    const int max = sizeof(buf) - sizeof(len) - 2;  // Type byte, final newline
-    if (len > max) len = max;
+    const int max = sizeof(buf) - sizeof(jint) - 2;  // Type byte, final newline
+    jint len = value != NULL ? env->GetStringUTFLength(value) : 0;
+    if (value != NULL && len <= max) {
+        // Convert the string right into the payload.
+        env->GetStringUTFRegion(value, 0, env->GetStringLength(value),
+                (char*) &buf[1 + sizeof(len)]);
+    } else {
+        const char *str = value != NULL ? env->GetStringUTFChars(value, NULL) : "NULL";
+        len = strlen(str);
+        if (len > max) len = max;
+        memcpy(&buf[1 + sizeof(len)], str, len);
+        if (value != NULL) env->ReleaseStringUTFChars(value, str);
+    }
 
     buf[0] = EVENT_TYPE_STRING;
     memcpy(&buf[1], &len, sizeof(len));
-    memcpy(&buf[1 + sizeof(len)], str, len);
     buf[1 + sizeof(len) + len] = '\n';
 
-    if (value != NULL) env->ReleaseStringUTFChars(value, str);
     return android_bWriteLog(tag, buf, 2 + sizeof(len) + len);
 }
 
@@ -158,8 +166,16 @@ static void android_util_EventLog_readEvents(JNIEnv* env, jobject clazz,
         return;
     }
 
+    // The log holds far more events than are asked for, so look the tags up
+    // in a sorted copy rather than scanning the Java array for each event.
     jsize tagLength = env->GetArrayLength(tags);
-    jint *tagValues = env->GetIntArrayElements(tags, NULL);
+    jint* tagValues = new jint[tagLength];
+    env->GetIntArrayRegion(tags, 0, tagLength, tagValues);
+    SortedVector<int32_t> tagSet;
+    for (jsize i = 0; i < tagLength; ++i) {
+        tagSet.add(tagValues[i]);
+    }
+    delete[] tagValues;
 
     uint8_t buf[LOGGER_ENTRY_MAX_LEN];
     struct timeval timeout = {0, 0};
@@ -197,19 +213,12 @@ static void android_util_EventLog_readEvents(JNIEnv* env, jobject clazz,
         logger_entry* entry = (logger_entry*) buf;
         int32_t tag = * (int32_t*) (buf + sizeof(*entry));
 
-        int found = 0;
-        for (int i = 0; !found && i < tagLength; ++i) {
-            found = (tag == tagValues[i]);
-        }
-
-        if (found) {
+        if (tagSet.indexOf(tag) >= 0) {
             jsize len = sizeof(*entry) + entry->len;
             jbyteArray array = env->NewByteArray(len);
             if (array == NULL) break;
 
-            jbyte *bytes = env->GetByteArrayElements(array, NULL);
-            memcpy(bytes, buf, len);
-            env->ReleaseByteArrayElements(array, bytes, 0);
+            env->SetByteArrayRegion(array, 0, len, (jbyte*) buf);
 
             jobject event = env->NewObject(gEventClass, gEventInitID, array);
             if (event == NULL) break;
@@ -221,7 +230,6 @@ static void android_util_EventLog_readEvents(JNIEnv* env, jobject clazz,
     }
 
     close(fd);
-    env->ReleaseIntArrayElements(tags, tagValues, 0);
 }
 
 /*
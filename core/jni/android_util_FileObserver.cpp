@@ -37,6 +37,23 @@ namespace android {
 
 static jmethodID method_onEvent;
 
+#ifdef HAVE_INOTIFY
+
+// Events which only say that something changed, so that delivering the
+// first of several identical ones in a batch loses nothing.
+#define COALESCED_EVENTS (IN_ACCESS | IN_MODIFY | IN_ATTRIB)
+
+// Number of files per batch whose last event is remembered to drop its repeats.
+#define MAX_COALESCED_EVENTS 32
+
+static bool isSameFile(const struct inotify_event* a, const struct inotify_event* b)
+{
+    return a->wd == b->wd && a->len == b->len
+            && (a->len == 0 || strcmp(a->name, b->name) == 0);
+}
+
+#endif // HAVE_INOTIFY
+
 static jint android_os_fileobserver_init(JNIEnv* env, jobject object)
 {
 #ifdef HAVE_INOTIFY
@@ -54,12 +71,16 @@ static void android_os_fileobserver_observe(JNIEnv* env, jobject object, jint fd
 {
 #ifdef HAVE_INOTIFY
  
-    char event_buf[512];
+    // Read many events at once: busy directories produce them in bursts, and
+    // the repeats within a burst are dropped below.
+    char event_buf[4096];
     struct inotify_event* event;
+    const struct inotify_event* delivered[MAX_COALESCED_EVENTS];
          
     while (1)
     {
         int event_pos = 0;
+        int num_delivered = 0;
         int num_bytes = read(fd, event_buf, sizeof(event_buf));
         
         if (num_bytes < (int)sizeof(*event))
@@ -76,21 +97,43 @@ static void android_os_fileobserver_observe(JNIEnv* env, jobject object, jint fd
             int event_size;
             event = (struct inotify_event *)(event_buf + event_pos);
 
-            jstring path = NULL;
-            
-            if (event->len > 0)
+            // Only a repeat of the last event delivered for the same file is
+            // dropped, any other event in between is worth delivering again
+            bool duplicate = false;
+            int last = 0;
+            while (last < num_delivered && !isSameFile(event, delivered[last]))
             {
-                path = env->NewStringUTF(event->name);
+                last++;
             }
-
-            env->CallVoidMethod(object, method_onEvent, event->wd, event->mask, path);
-            if (env->ExceptionCheck()) {
-                env->ExceptionDescribe();
-                env->ExceptionClear();
+            if (last < num_delivered)
+            {
+                duplicate = (event->mask & ~COALESCED_EVENTS) == 0
+                        && event->mask == delivered[last]->mask;
+                delivered[last] = event;
             }
-            if (path != NULL)
+            else if (num_delivered < MAX_COALESCED_EVENTS)
+            {
+                delivered[num_delivered++] = event;
+            }
+
+            if (!duplicate)
             {
-                env->DeleteLocalRef(path);
+                jstring path = NULL;
+
+                if (event->len > 0)
+                {
+                    path = env->NewStringUTF(event->name);
+                }
+
+                env->CallVoidMethod(object, method_onEvent, event->wd, event->mask, path);
+                if (env->ExceptionCheck()) {
+                    env->ExceptionDescribe();
+                    env->ExceptionClear();
+                }
+                if (path != NULL)
+                {
+                    env->DeleteLocalRef(path);
+                }
             }
 
             event_size = sizeof(*event) + event->len;
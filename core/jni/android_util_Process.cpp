@@ -597,14 +597,9 @@ jintArray android_os_Process_getPids(JNIEnv* env, jobject clazz,
         return NULL;
     }
 
-    jsize curCount = 0;
-    jint* curData = NULL;
-    if (lastArray != NULL) {
-        curCount = env->GetArrayLength(lastArray);
-        curData = env->GetIntArrayElements(lastArray, 0);
-    }
-
-    jint curPos = 0;
+    // Collect the pids natively and copy them into the array once, rather
+    // than pinning the array and copying it into each larger one.
+    Vector<jint> pids;
 
     struct dirent* entry;
     while ((entry=readdir(dirp)) != NULL) {
@@ -618,43 +613,38 @@ jintArray android_os_Process_getPids(JNIEnv* env, jobject clazz,
         char* end;
         int pid = strtol(entry->d_name, &end, 10);
         //ALOGI("File %s pid=%d\n", entry->d_name, pid);
-        if (curPos >= curCount) {
-            jsize newCount = (curCount == 0) ? 10 : (curCount*2);
-            jintArray newArray = env->NewIntArray(newCount);
-            if (newArray == NULL) {
-                closedir(dirp);
-                jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
-                return NULL;
-            }
-            jint* newData = env->GetIntArrayElements(newArray, 0);
-            if (curData != NULL) {
-                memcpy(newData, curData, sizeof(jint)*curCount);
-                env->ReleaseIntArrayElements(lastArray, curData, 0);
-            }
-            lastArray = newArray;
-            curCount = newCount;
-            curData = newData;
-        }
-
-        curData[curPos] = pid;
-        curPos++;
+        pids.add(pid);
     }
 
     closedir(dirp);
 
-    if (curData != NULL && curPos > 0) {
-        qsort(curData, curPos, sizeof(jint), pid_compare);
+    jsize curCount = lastArray != NULL ? env->GetArrayLength(lastArray) : 0;
+    const jsize pidCount = pids.size();
+    if (pidCount > curCount) {
+        jsize newCount = curCount;
+        do {
+            newCount = (newCount == 0) ? 10 : (newCount*2);
+        } while (newCount < pidCount);
+        jintArray newArray = env->NewIntArray(newCount);
+        if (newArray == NULL) {
+            jniThrowException(env, "java/lang/OutOfMemoryError", NULL);
+            return NULL;
+        }
+        lastArray = newArray;
+        curCount = newCount;
     }
 
-    while (curPos < curCount) {
-        curData[curPos] = -1;
-        curPos++;
+    if (lastArray == NULL) {
+        return NULL;
     }
 
-    if (curData != NULL) {
-        env->ReleaseIntArrayElements(lastArray, curData, 0);
+    if (pidCount > 0) {
+        qsort(pids.editArray(), pidCount, sizeof(jint), pid_compare);
     }
 
+    pids.insertAt(-1, pidCount, curCount - pidCount);
+    env->SetIntArrayRegion(lastArray, 0, curCount, pids.array());
+
     return lastArray;
 }
 
@@ -687,7 +677,7 @@ jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
     if (formatData == NULL || (NL > 0 && longsData == NULL)
             || (NR > 0 && floatsData == NULL)) {
         if (formatData != NULL) {
-            env->ReleaseIntArrayElements(format, formatData, 0);
+            env->ReleaseIntArrayElements(format, formatData, JNI_ABORT);
         }
         if (longsData != NULL) {
             env->ReleaseLongArrayElements(outLongs, longsData, 0);
@@ -718,13 +708,13 @@ jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
 
         jsize end = -1;
         if ((mode&PROC_PARENS) != 0) {
-            while (buffer[i] != ')' && i < endIndex) {
+            while (i < endIndex && buffer[i] != ')') {
                 i++;
             }
             end = i;
             i++;
         }
-        while (buffer[i] != term && i < endIndex) {
+        while (i < endIndex && buffer[i] != term) {
             i++;
         }
         if (end < 0) {
@@ -734,7 +724,7 @@ jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
         if (i < endIndex) {
             i++;
             if ((mode&PROC_COMBINE) != 0) {
-                while (buffer[i] == term && i < endIndex) {
+                while (i < endIndex && buffer[i] == term) {
                     i++;
                 }
             }
@@ -762,7 +752,7 @@ jboolean android_os_Process_parseProcLineArray(JNIEnv* env, jobject clazz,
         }
     }
 
-    env->ReleaseIntArrayElements(format, formatData, 0);
+    env->ReleaseIntArrayElements(format, formatData, JNI_ABORT);
     if (longsData != NULL) {
         env->ReleaseLongArrayElements(outLongs, longsData, 0);
     }
@@ -783,7 +773,8 @@ jboolean android_os_Process_parseProcLine(JNIEnv* env, jobject clazz,
                 (char*) bufferArray, startIndex, endIndex, format, outStrings,
                 outLongs, outFloats);
 
-        env->ReleaseByteArrayElements(buffer, bufferArray, 0);
+        // The parser restores every byte it terminates, so nothing to copy back.
+        env->ReleaseByteArrayElements(buffer, bufferArray, JNI_ABORT);
 
         return result;
 }
@@ -251,6 +251,22 @@ static jint android_content_XmlBlock_nativeGetAttributeStringValue(JNIEnv* env,
     return (jint)st->getAttributeValueStringID(idx);
 }
 
+// Attribute names and namespaces that fit are copied here rather than
+// fetched with GetStringChars, which may allocate a copy.
+#define ATTRIBUTE_STRING_BUFFER_SIZE 128
+
+static const jchar* getStringChars(JNIEnv* env, jstring str,
+                                   jchar* buffer, jsize* outLen)
+{
+    jsize len = env->GetStringLength(str);
+    *outLen = len;
+    if (len <= ATTRIBUTE_STRING_BUFFER_SIZE) {
+        env->GetStringRegion(str, 0, len, buffer);
+        return buffer;
+    }
+    return env->GetStringChars(str, NULL);
+}
+
 static jint android_content_XmlBlock_nativeGetAttributeIndex(JNIEnv* env, jobject clazz,
                                                              jint token,
                                                              jstring ns, jstring name)
@@ -261,22 +277,25 @@ static jint android_content_XmlBlock_nativeGetAttributeIndex(JNIEnv* env, jobjec
         return 0;
     }
 
-    const char16_t* ns16 = NULL;
+    jchar nsBuffer[ATTRIBUTE_STRING_BUFFER_SIZE];
     jsize nsLen = 0;
+    const jchar* ns16 = NULL;
     if (ns) {
-        ns16 = env->GetStringChars(ns, NULL);
-        nsLen = env->GetStringLength(ns);
+        ns16 = getStringChars(env, ns, nsBuffer, &nsLen);
     }
 
-    const char16_t* name16 = env->GetStringChars(name, NULL);
-    jsize nameLen = env->GetStringLength(name);
+    jchar nameBuffer[ATTRIBUTE_STRING_BUFFER_SIZE];
+    jsize nameLen;
+    const jchar* name16 = getStringChars(env, name, nameBuffer, &nameLen);
 
     jint idx = (jint)st->indexOfAttribute(ns16, nsLen, name16, nameLen);
 
-    if (ns) {
+    if (ns && ns16 != nsBuffer) {
         env->ReleaseStringChars(ns, ns16);
     }
-    env->ReleaseStringChars(name, name16);
+    if (name16 != nameBuffer) {
+        env->ReleaseStringChars(name, name16);
+    }
 
     return idx;
 }
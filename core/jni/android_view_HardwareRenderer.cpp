@@ -22,7 +22,11 @@
 
 #include <EGL/egl_cache.h>
 
+#include <utils/String8.h>
+
 #ifdef USE_OPENGL_RENDERER
+    #include <ProgramCache.h>
+
     EGLAPI void EGLAPIENTRY eglBeginFrame(EGLDisplay dpy, EGLSurface surface);
 #endif
 
@@ -133,6 +137,12 @@ static void android_view_HardwareRenderer_setupShadersDiskCache(JNIEnv* env, job
 
     const char* cacheArray = env->GetStringUTFChars(diskCachePath, NULL);
     egl_cache_t::get()->setCacheFilename(cacheArray);
+#ifdef USE_OPENGL_RENDERER
+    // The renderer keeps its linked programs next to the driver's shaders cache
+    String8 programsCache(cacheArray);
+    programsCache.append(".programs");
+    uirenderer::ProgramCache::setBinaryCacheFile(programsCache.string());
+#endif
     env->ReleaseStringUTFChars(diskCachePath, cacheArray);
 }
 
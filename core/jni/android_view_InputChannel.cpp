@@ -209,7 +209,22 @@ static void android_view_InputChannel_nativeReadFromParcel(JNIEnv* env, jobject
                 return;
             }
 
-            InputChannel* inputChannel = new InputChannel(name, dupFd);
+            sp<InputChannel> inputChannel = new InputChannel(name, dupFd);
+
+            bool hasRing = parcel->readInt32();
+            if (hasRing) {
+                bool ringProducer = parcel->readInt32();
+                int rawRingFd = parcel->readFileDescriptor();
+                int dupRingFd = dup(rawRingFd);
+                if (dupRingFd < 0
+                        || inputChannel->attachRing(dupRingFd, ringProducer)) {
+                    ALOGE("Error %d attaching shared ring fd %d.", errno, rawRingFd);
+                    jniThrowRuntimeException(env,
+                            "Could not read input channel shared ring from parcel.");
+                    return;
+                }
+            }
+
             NativeInputChannel* nativeInputChannel = new NativeInputChannel(inputChannel);
 
             android_view_InputChannel_setNativeInputChannel(env, obj, nativeInputChannel);
@@ -229,6 +244,13 @@ static void android_view_InputChannel_nativeWriteToParcel(JNIEnv* env, jobject o
             parcel->writeInt32(1);
             parcel->writeString8(inputChannel->getName());
             parcel->writeDupFileDescriptor(inputChannel->getFd());
+            if (inputChannel->getRingFd() >= 0) {
+                parcel->writeInt32(1);
+                parcel->writeInt32(inputChannel->isRingProducer());
+                parcel->writeDupFileDescriptor(inputChannel->getRingFd());
+            } else {
+                parcel->writeInt32(0);
+            }
         } else {
             parcel->writeInt32(0);
         }
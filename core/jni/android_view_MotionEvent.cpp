@@ -216,18 +216,26 @@ static void pointerCoordsToNative(JNIEnv* env, jobject pointerCoordsObj,
         jfloatArray valuesArray = jfloatArray(env->GetObjectField(pointerCoordsObj,
                 gPointerCoordsClassInfo.mPackedAxisValues));
         if (valuesArray) {
-            jfloat* values = static_cast<jfloat*>(
-                    env->GetPrimitiveArrayCritical(valuesArray, NULL));
-
-            uint32_t index = 0;
-            do {
+            // There are at most a few packed values, copying them is cheaper
+            // than entering a critical section.
+            jfloat values[PointerCoords::MAX_AXES];
+            uint32_t count = __builtin_popcountll(bits);
+            if (count > PointerCoords::MAX_AXES) {
+                count = PointerCoords::MAX_AXES;
+            }
+            uint32_t length = env->GetArrayLength(valuesArray);
+            if (count > length) {
+                count = length;
+            }
+            env->GetFloatArrayRegion(valuesArray, 0, count, values);
+
+            for (uint32_t index = 0; index < count; index++) {
                 uint32_t axis = __builtin_ctzll(bits);
                 uint64_t axisBit = 1LL << axis;
                 bits &= ~axisBit;
-                outRawPointerCoords->setAxisValue(axis, values[index++]);
-            } while (bits);
+                outRawPointerCoords->setAxisValue(axis, values[index]);
+            }
 
-            env->ReleasePrimitiveArrayCritical(valuesArray, values, JNI_ABORT);
             env->DeleteLocalRef(valuesArray);
         }
     }
@@ -296,10 +304,7 @@ static void pointerCoordsFromNative(JNIEnv* env, const PointerCoords* rawPointer
             return; // OOM
         }
 
-        jfloat* outValues = static_cast<jfloat*>(env->GetPrimitiveArrayCritical(
-                outValuesArray, NULL));
-
-        const float* values = rawPointerCoords->values;
+        jfloat outValues[PointerCoords::MAX_AXES];
         uint32_t index = 0;
         do {
             uint32_t axis = __builtin_ctzll(remainingBits);
@@ -309,7 +314,7 @@ static void pointerCoordsFromNative(JNIEnv* env, const PointerCoords* rawPointer
             outValues[index++] = rawPointerCoords->getAxisValue(axis);
         } while (remainingBits);
 
-        env->ReleasePrimitiveArrayCritical(outValuesArray, outValues, 0);
+        env->SetFloatArrayRegion(outValuesArray, 0, index, outValues);
         env->DeleteLocalRef(outValuesArray);
     }
     env->SetLongField(outPointerCoordsObj, gPointerCoordsClassInfo.mPackedAxisBits, outBits);
@@ -368,6 +368,10 @@ static jobject Surface_lockCanvas(JNIEnv* env, jobject clazz, jobject dirtyRect)
         dirtyRegion.set(Rect(0x3FFF,0x3FFF));
     }
 
+    // Surface::lock() copies back from the previous buffer only the part of
+    // the previous frame's dirty region that is outside the new one, and
+    // grows dirtyRegion to whatever must be redrawn. The rest of the back
+    // buffer already holds the right content, so there is no full copyback.
     Surface::SurfaceInfo info;
     status_t err = surface->lock(&info, &dirtyRegion);
     if (err < 0) {
@@ -382,6 +386,8 @@ static jobject Surface_lockCanvas(JNIEnv* env, jobject clazz, jobject dirtyRect)
     jobject canvas = env->GetObjectField(clazz, so.canvas);
     env->SetIntField(canvas, co.surfaceFormat, info.format);
 
+    // The SkCanvas belongs to the Java Surface and is reused for every frame.
+    // Only its device, which wraps the locked buffer, changes between locks.
     SkCanvas* nativeCanvas = (SkCanvas*)env->GetIntField(canvas, no.native_canvas);
     SkBitmap bitmap;
     ssize_t bpr = info.s * bytesPerPixel(info.format);
@@ -404,10 +410,12 @@ static jobject Surface_lockCanvas(JNIEnv* env, jobject clazz, jobject dirtyRect)
     } else {
         size_t count;
         Rect const* r = dirtyRegion.getArray(&count);
-        while (count) {
-            clipReg.op(r->left, r->top, r->right, r->bottom, SkRegion::kUnion_Op);
-            r++, count--;
+        SkAutoSTMalloc<16, SkIRect> rects(count);
+        SkIRect* ir = rects.get();
+        for (size_t i = 0; i < count; i++) {
+            ir[i].set(r[i].left, r[i].top, r[i].right, r[i].bottom);
         }
+        GraphicsJNI::setRegionToUnion(&clipReg, rects.get(), count);
     }
 
     nativeCanvas->clipRegion(clipReg);
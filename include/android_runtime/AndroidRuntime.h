@@ -50,6 +50,13 @@ public:
     static int registerNativeMethods(JNIEnv* env,
         const char* className, const JNINativeMethod* gMethods, int numMethods);
 
+    /**
+     * Register the natives of a group that startReg() skipped because it is
+     * listed in the ro.zygote.deferred_jni property ("gles", "bluetooth" or
+     * "usb"). Does nothing if the group is already registered.
+     */
+    static int registerDeferredNatives(JNIEnv* env, const char* group);
+
     /**
      * Call a class's static main method with the given arguments,
      */
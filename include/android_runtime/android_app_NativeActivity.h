@@ -81,6 +81,11 @@ public:
 
     int32_t getEvent(AInputEvent** outEvent);
 
+    /* Gets up to maxEvents pending events at once, and returns how many were
+     * stored in outEvents. Touch samples are resampled to the current time, as
+     * the framework does for each frame. Each event must be finished as usual. */
+    size_t getEvents(AInputEvent** outEvents, size_t maxEvents);
+
     bool preDispatchEvent(AInputEvent* event);
 
     void finishEvent(AInputEvent* event, bool handled, bool didDefaultHandling);
@@ -101,6 +106,7 @@ public:
     int mWorkWrite;
 
 private:
+    int32_t getEvent(AInputEvent** outEvent, nsecs_t frameTime);
     void doUnhandledKey(android::KeyEvent* keyEvent);
     bool preDispatchKey(android::KeyEvent* keyEvent);
     void wakeupDispatchLocked();
@@ -145,4 +151,13 @@ private:
     android::Vector<finish_pre_dispatch> mFinishPreDispatches;
 };
 
+/*
+ * Gets up to maxEvents pending events of the queue with a single call, and
+ * returns how many were stored in outEvents. Motion events carry their history
+ * resampled to the current time. Each event must be finished with
+ * AInputQueue_finishEvent().
+ */
+extern "C" size_t AInputQueue_getEvents(AInputQueue* queue, AInputEvent** outEvents,
+        size_t maxEvents);
+
 #endif // _ANDROID_APP_NATIVEACTIVITY_H
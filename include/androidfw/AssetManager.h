@@ -232,6 +232,25 @@ public:
     void addRedirections(PackageRedirectionMap* resMap);
     void clearRedirections();
 
+    /*
+     * Write the bags of the system resources, resolved for the current
+     * configuration, to the resource cache.  Processes created afterwards
+     * map the cache instead of resolving the bags, as long as their
+     * configuration matches.
+     *
+     * Returns "true" on success, "false" on failure.
+     */
+    bool createSystemBagCache();
+
+    /*
+     * Makes this process keep the bag cache of the system resources up to
+     * date: whenever an asset manager holding them is given a configuration
+     * the cache was not written for, createSystemBagCache() runs again for
+     * it on a background thread.  Meant for the system server, which owns
+     * the resource cache; the zygote maps the result when it next starts.
+     */
+    static void setWritesSystemBagCache(bool writes);
+
 private:
     struct asset_path
     {
@@ -290,12 +309,31 @@ private:
 
     bool getZipEntryCrcLocked(const String8& zipPath, const char* entryFilename, uint32_t* pCrc);
 
+    void loadSystemBagCacheLocked(ResTable* rt, const asset_path& ap);
+    void updateSystemBagCacheLocked();
+
+    /*
+     * Loads the resource tables of the zipped asset paths in parallel,
+     * before they are parsed in cookie order by getResTable().
+     */
+    void preloadResourceTablesLocked() const;
+
+    class ResourceTableLoader;
+    class BagCacheWriter;
+
     class SharedZip : public RefBase {
     public:
         static sp<SharedZip> get(const String8& path);
 
         ZipFileRO* getZip();
 
+        // "zip:<path>:/", the start of the source name of the assets
+        const String8& getSourcePrefix() const;
+
+        // Files and directories in the specified directory of the zip,
+        // without source names.  The directory tree is built on first use.
+        const SortedVector<AssetDir::FileInfo>* getDirContents(const String8& dirName);
+
         Asset* getResourceTableAsset();
         Asset* setResourceTableAsset(Asset* asset);
 
@@ -311,13 +349,20 @@ private:
         SharedZip(const String8& path, time_t modWhen);
         SharedZip(); // <-- not implemented
 
+        void buildDirTreeLocked();
+
         String8 mPath;
+        String8 mSourcePrefix;
         ZipFileRO* mZipFile;
         time_t mModWhen;
 
         Asset* mResourceTableAsset;
         ResTable* mResourceTable;
 
+        Mutex mDirLock;
+        bool mDirTreeBuilt;
+        KeyedVector<String8, SortedVector<AssetDir::FileInfo>* > mDirs;
+
         static Mutex gLock;
         static DefaultKeyedVector<String8, wp<SharedZip> > gOpen;
     };
@@ -340,6 +385,15 @@ private:
          */
         ZipFileRO* getZip(const String8& path);
 
+        const SortedVector<AssetDir::FileInfo>* getZipDirContents(const String8& path,
+                const String8& dirName);
+
+        /*
+         * Return the source name of an entry of the specified zip, built
+         * without normalizing the zip path again.
+         */
+        String8 getZipSourceName(const String8& path, const char* fileName);
+
         Asset* getZipResourceTableAsset(const String8& path);
         Asset* setZipResourceTableAsset(const String8& path, Asset* asset);
 
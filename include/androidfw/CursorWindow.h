@@ -47,10 +47,14 @@ namespace android {
  * Note that the data types come from sqlite3.h.
  *
  * Strings are stored in UTF-8.
+ *
+ * A window can grow up to MAX_GROWTH_FACTOR times the size it was created with. The
+ * whole ashmem region is reserved and mapped up front, which costs no memory until
+ * its pages are written, so growing never moves the data.
  */
 class CursorWindow {
     CursorWindow(const String8& name, int ashmemFd,
-            void* data, size_t size, bool readOnly);
+            void* data, size_t size, size_t capacity, bool readOnly);
 
 public:
     /* Field types. */
@@ -99,6 +103,13 @@ public:
      * The row is initialized will null entries for each field.
      */
     status_t allocRow();
+    /**
+     * Allocate a row slot and its directory along with dataSize bytes for the
+     * strings and blobs of the row, in a single allocation. The directory and
+     * the data bytes are returned in outFieldDir and outData, the fields are
+     * then set with the setFieldSlot*() methods.
+     */
+    status_t allocRow(size_t dataSize, FieldSlot** outFieldDir, void** outData);
     status_t freeLastRow();
 
     status_t putBlob(uint32_t row, uint32_t column, const void* value, size_t size);
@@ -136,8 +147,42 @@ public:
         return offsetToPtr(fieldSlot->data.buffer.offset);
     }
 
+    inline void setFieldSlotLong(FieldSlot* fieldSlot, int64_t value) {
+        fieldSlot->type = FIELD_TYPE_INTEGER;
+        fieldSlot->data.l = value;
+    }
+
+    inline void setFieldSlotDouble(FieldSlot* fieldSlot, double value) {
+        fieldSlot->type = FIELD_TYPE_FLOAT;
+        fieldSlot->data.d = value;
+    }
+
+    /**
+     * Sets a string or blob field to data already in the window, such as the
+     * data bytes returned by allocRow().
+     */
+    inline void setFieldSlotBuffer(FieldSlot* fieldSlot, int32_t type,
+            const void* data, size_t size) {
+        fieldSlot->type = type;
+        fieldSlot->data.buffer.offset = offsetFromPtr(const_cast<void*>(data));
+        fieldSlot->data.buffer.size = size;
+    }
+
+    /**
+     * Copies the values of a column for a range of rows, converted the same way
+     * as single values are read by the cursor: strings are parsed and nulls are
+     * read as 0. Walks the row slots once, unlike a getFieldSlot() per row.
+     * Returns BAD_VALUE if the range is not in the window, or BAD_TYPE if one
+     * of the fields is a blob.
+     */
+    status_t getColumnLongs(uint32_t startRow, uint32_t numRows, uint32_t column,
+            int64_t* outValues);
+    status_t getColumnDoubles(uint32_t startRow, uint32_t numRows, uint32_t column,
+            double* outValues);
+
 private:
     static const size_t ROW_SLOT_CHUNK_NUM_ROWS = 100;
+    static const size_t MAX_GROWTH_FACTOR = 4;
 
     struct Header {
         // Offset of the lowest unused byte in the window.
@@ -163,6 +208,8 @@ private:
     int mAshmemFd;
     void* mData;
     size_t mSize;
+    // Size of the mapped region, the window grows up to this size
+    size_t mCapacity;
     bool mReadOnly;
     Header* mHeader;
 
@@ -184,6 +231,13 @@ private:
     RowSlot* getRowSlot(uint32_t row);
     RowSlot* allocRowSlot();
 
+    /**
+     * Gets the field slots of a column for a range of rows, in order.
+     * Returns false if the range is not in the window.
+     */
+    bool getColumnFieldSlots(uint32_t startRow, uint32_t numRows, uint32_t column,
+            FieldSlot** outFieldSlots);
+
     status_t putBlobOrString(uint32_t row, uint32_t column,
             const void* value, size_t size, int32_t type);
 };
@@ -28,6 +28,7 @@
  */
 
 #include <androidfw/Input.h>
+#include <androidfw/VelocityTracker.h>
 #include <utils/Errors.h>
 #include <utils/Timers.h>
 #include <utils/RefBase.h>
@@ -45,6 +46,7 @@ struct InputMessage {
         TYPE_KEY = 1,
         TYPE_MOTION = 2,
         TYPE_FINISHED = 3,
+        TYPE_WAKEUP = 4,
     };
 
     struct Header {
@@ -131,6 +133,15 @@ protected:
     virtual ~InputChannel();
 
 public:
+    enum {
+        /* Maximum number of messages that can be sent together by sendMessages(). */
+        MAX_BATCH_MESSAGES = 16,
+
+        /* Maximum combined size of the messages sent together by sendMessages().
+         * This is always large enough to hold several messages of the largest size. */
+        MAX_BATCH_BYTES = 4096,
+    };
+
     InputChannel(const String8& name, int fd);
 
     /* Creates a pair of input channels.
@@ -156,7 +167,21 @@ public:
      */
     status_t sendMessage(const InputMessage* msg);
 
+    /* Sends several messages to the other endpoint with a single write.
+     *
+     * The messages are either all sent or, if the channel is full, none of them are.
+     * At most MAX_BATCH_MESSAGES messages totalling MAX_BATCH_BYTES can be sent at once.
+     *
+     * Returns the same values as sendMessage().
+     * Returns BAD_VALUE if the messages do not fit in a single write.
+     */
+    status_t sendMessages(const InputMessage* msgs, size_t count);
+
     /* Receives a message sent by the other endpoint.
+     *
+     * Messages that were sent together are read at once and then returned one at a
+     * time, so the fd may not be readable while messages are still pending.  Call
+     * hasPendingMessages() to find out.
      *
      * If there is no message present, try again after poll() indicates that the fd
      * is readable.
@@ -168,9 +193,50 @@ public:
      */
     status_t receiveMessage(InputMessage* msg);
 
+    /* Returns true if messages have already been read from the fd or are waiting in
+     * the shared ring but have not yet been returned by receiveMessage(). */
+    bool hasPendingMessages() const;
+
+    /* Attaches a shared memory ring to the channel and takes ownership of its fd.
+     *
+     * The producer end then sends its messages through the ring and only writes to
+     * the socket to wake up the consumer end when it is waiting for messages.  The
+     * consumer end must have the same ring attached.  Messages sent from the consumer
+     * back to the producer still go through the socket.
+     *
+     * Returns OK on success, in which case the channel closes the fd when destroyed.
+     */
+    status_t attachRing(int ringFd, bool producer);
+
+    /* Gets the fd of the shared ring, or -1 if the channel does not have one. */
+    inline int getRingFd() const { return mRingFd; }
+
+    /* Returns true if this end of the channel writes to the shared ring. */
+    inline bool isRingProducer() const { return mRingProducer; }
+
 private:
+    struct Ring;
+
     String8 mName;
     int mFd;
+
+    int mRingFd;
+    Ring* mRing;
+    bool mRingProducer;
+
+    // Messages read from the fd but not yet returned, allocated on first use.
+    uint8_t* mReceiveBuffer;
+    size_t mReceiveOffset;
+    size_t mReceiveSize;
+
+    status_t takePendingMessage(InputMessage* msg);
+    status_t sendSocketMessages(const InputMessage* msgs, size_t count);
+    status_t receiveSocketMessage(InputMessage* msg);
+    status_t sendRingMessages(const InputMessage* msgs, size_t count);
+    status_t receiveRingMessage(InputMessage* msg);
+    void detachRing();
+
+    static bool isSharedRingEnabled();
 };
 
 /*
@@ -235,6 +301,28 @@ public:
             const PointerProperties* pointerProperties,
             const PointerCoords* pointerCoords);
 
+    /* Starts collecting published events into a batch instead of sending them.
+     *
+     * Events published until endBatch() is called are sent together with a single
+     * write, which saves a system call per event when many events are queued.
+     */
+    void beginBatch();
+
+    /* Returns true if another event cannot be added to the current batch. */
+    bool isBatchFull() const;
+
+    /* Sends the events published since beginBatch() and stops batching.
+     *
+     * Either all events of the batch are sent or none of them are.  The batch is
+     * discarded in both cases, so events that were not sent must be published again.
+     *
+     * Returns OK on success or if the batch is empty.
+     * Returns WOULD_BLOCK if the channel is full.
+     * Returns DEAD_OBJECT if the channel's peer has been closed.
+     * Other errors probably indicate that the channel is broken.
+     */
+    status_t endBatch();
+
     /* Receives the finished signal from the consumer in reply to the original dispatch signal.
      * If a signal was received, returns the message sequence number,
      * and whether the consumer handled the message.
@@ -250,6 +338,13 @@ public:
 
 private:
     sp<InputChannel> mChannel;
+
+    // Events collected since beginBatch() while mBatching is true.
+    bool mBatching;
+    Vector<InputMessage> mBatch;
+    size_t mBatchBytes;
+
+    status_t publishMessage(const InputMessage& msg);
 };
 
 /*
@@ -317,6 +412,9 @@ public:
      * Alternately, the caller can call hasDeferredEvent() to determine whether there is
      * a deferred event waiting and then ensure that its event loop wakes up at least
      * one more time to consume the deferred event.
+     *
+     * Events that were sent in the same batch as an event already consumed are
+     * reported as deferred too.
      */
     bool hasDeferredEvent() const;
 
@@ -331,6 +429,10 @@ private:
     // True if touch resampling is enabled.
     const bool mResampleTouch;
 
+    // How far past the frame time to predict touches when there is no newer sample to
+    // interpolate with, or 0 if prediction is disabled.
+    const nsecs_t mPredictionHorizon;
+
     // The input channel.
     sp<InputChannel> mChannel;
 
@@ -377,6 +479,10 @@ private:
         History history[2];
         History lastResample;
 
+        // Recent movements used for prediction, or NULL if prediction is disabled.
+        // Owned by the consumer, which deletes it along with the touch state.
+        VelocityTracker* velocityTracker;
+
         void initialize(int32_t deviceId, int32_t source) {
             this->deviceId = deviceId;
             this->source = source;
@@ -419,6 +525,8 @@ private:
     void rewriteMessage(const TouchState& state, InputMessage* msg);
     void resampleTouchState(nsecs_t frameTime, MotionEvent* event,
             const InputMessage *next);
+    bool predictTouchState(nsecs_t predictTime, MotionEvent* event, TouchState& touchState);
+    static void addMovement(TouchState& touchState, const InputMessage* msg);
 
     ssize_t findBatch(int32_t deviceId, int32_t source) const;
     ssize_t findTouchState(int32_t deviceId, int32_t source) const;
@@ -433,6 +541,7 @@ private:
     static bool shouldResampleTool(int32_t toolType);
 
     static bool isTouchResamplingEnabled();
+    static nsecs_t getTouchPredictionHorizon();
 };
 
 } // namespace android
@@ -68,9 +68,14 @@ public:
         int32_t metaState;
     };
 
-    /* Loads a key character map from a file. */
+    /* Loads a key character map from a file.
+     * Uses the compiled form of the file instead if there is an up to date one. */
     static status_t load(const String8& filename, Format format, sp<KeyCharacterMap>* outMap);
 
+    /* Loads a key character map from the compiled form of a file. */
+    static status_t loadCompiled(const String8& filename, Format format,
+            sp<KeyCharacterMap>* outMap);
+
     /* Loads a key character map from its string contents. */
     static status_t loadContents(const String8& filename,
             const char* contents, Format format, sp<KeyCharacterMap>* outMap);
@@ -124,6 +129,9 @@ public:
      * the mapping in some way. */
     status_t mapKey(int32_t scanCode, int32_t usageCode, int32_t* outKeyCode) const;
 
+    /* Writes the compiled form of the key character map to a file descriptor. */
+    status_t writeCompiled(int fd) const;
+
 #if HAVE_ANDROID_OS
     /* Reads a key map from a parcel. */
     static sp<KeyCharacterMap> readFromParcel(Parcel* parcel);
@@ -211,6 +219,12 @@ private:
         status_t parseCharacterLiteral(char16_t* outCharacter);
     };
 
+    /* The key code and meta state that generate a character. */
+    struct CharacterKey {
+        int32_t keyCode;
+        int32_t metaState;
+    };
+
     static sp<KeyCharacterMap> sEmpty;
 
     KeyedVector<int32_t, Key*> mKeys;
@@ -219,9 +233,17 @@ private:
     KeyedVector<int32_t, int32_t> mKeysByScanCode;
     KeyedVector<int32_t, int32_t> mKeysByUsageCode;
 
+    /* Lookup tables derived from mKeys by buildLookupTables() once the map is complete.
+     * The keys are indexed directly by key code, and each character maps to the key
+     * and meta state that findKey() would choose for it. */
+    Vector<const Key*> mKeysByKeyCode;
+    KeyedVector<char16_t, CharacterKey> mKeysByCharacter;
+
     KeyCharacterMap();
     KeyCharacterMap(const KeyCharacterMap& other);
 
+    void buildLookupTables();
+
     bool getKey(int32_t keyCode, const Key** outKey) const;
     bool getKeyBehavior(int32_t keyCode, int32_t metaState,
             const Key** outKey, const Behavior** outBehavior) const;
@@ -230,6 +252,7 @@ private:
     bool findKey(char16_t ch, int32_t* outKeyCode, int32_t* outMetaState) const;
 
     static status_t load(Tokenizer* tokenizer, Format format, sp<KeyCharacterMap>* outMap);
+    static status_t checkFormat(const sp<KeyCharacterMap>& map, Format format);
 
     static void addKey(Vector<KeyEvent>& outEvents,
             int32_t deviceId, int32_t keyCode, int32_t metaState, bool down, nsecs_t time);
@@ -62,8 +62,16 @@ struct AxisInfo {
  */
 class KeyLayoutMap : public RefBase {
 public:
+    /* Loads a key layout map from a file.
+     * Uses the compiled form of the file instead if there is an up to date one. */
     static status_t load(const String8& filename, sp<KeyLayoutMap>* outMap);
 
+    /* Loads a key layout map from the compiled form of a file. */
+    static status_t loadCompiled(const String8& filename, sp<KeyLayoutMap>* outMap);
+
+    /* Writes the compiled form of the key layout map to a file descriptor. */
+    status_t writeCompiled(int fd) const;
+
     status_t mapKey(int32_t scanCode, int32_t usageCode,
             int32_t* outKeyCode, uint32_t* outFlags) const;
     status_t findScanCodesForKey(int32_t keyCode, Vector<int32_t>* outScanCodes) const;
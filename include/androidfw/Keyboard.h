@@ -36,6 +36,7 @@ enum {
 
 class KeyLayoutMap;
 class KeyCharacterMap;
+class FileMap;
 
 /**
  * Loads the key layout map and key character map for a keyboard device.
@@ -115,6 +116,19 @@ extern int32_t updateMetaState(int32_t keyCode, bool down, int32_t oldMetaState)
  */
 extern bool isMetaKey(int32_t keyCode);
 
+/**
+ * Gets the path of the compiled form of a key layout or key character map file,
+ * as written by validatekeymaps.
+ */
+extern String8 getCompiledKeyMapFilePath(const String8& filename);
+
+/**
+ * Maps the compiled form of a key layout or key character map file read-only,
+ * provided that it is at least as recent as the file itself.
+ * Returns NULL if there is no usable compiled form.  The caller must release the map.
+ */
+extern FileMap* mapCompiledKeyMapFile(const String8& filename);
+
 } // namespace android
 
 #endif // _ANDROIDFW_KEYBOARD_H
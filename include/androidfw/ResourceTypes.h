@@ -24,6 +24,7 @@
 #include <androidfw/Asset.h>
 #include <utils/ByteOrder.h>
 #include <utils/Errors.h>
+#include <utils/KeyedVector.h>
 #include <androidfw/PackageRedirectionMap.h>
 #include <utils/String16.h>
 #include <utils/Vector.h>
@@ -473,6 +474,14 @@ public:
     bool isUTF8() const;
 
 private:
+    // Returns the string in the encoding of the pool, its length is in
+    // bytes for UTF-8 pools and in characters for UTF-16 pools.
+    const void* rawStringAt(size_t idx, size_t* outLen) const;
+
+    // Hash table of the string indices, built the first time a string is
+    // searched for in an unsorted pool.
+    const uint32_t* getStringIndex() const;
+
     status_t                    mError;
     void*                       mOwnedData;
     const ResStringPool_header* mHeader;
@@ -481,10 +490,14 @@ private:
     const uint32_t*             mEntries;
     const uint32_t*             mEntryStyles;
     const void*                 mStrings;
-    char16_t**                  mCache;
+    // UTF-16 copies of the strings of UTF-8 pools, decoded on demand and
+    // allocated in chunks of consecutive strings.
+    mutable char16_t***         mCache;
     uint32_t                    mStringPoolSize;    // number of uint16_t
     const uint32_t*             mStyles;
     uint32_t                    mStylePoolSize;    // number of uint32_t
+    mutable uint32_t*           mStringIndex;
+    mutable size_t              mStringIndexMask;
 };
 
 /** ********************************************************************
@@ -692,6 +705,12 @@ public:
     int32_t getAttributeData(size_t idx) const;
     ssize_t getAttributeValue(size_t idx, Res_value* outValue) const;
 
+    // Returns the attribute records of a START_TAG, or NULL for the other
+    // nodes.  The records are contiguous and outStride bytes apart, which
+    // is sizeof(ResXMLTree_attribute) unless the tree was written with a
+    // larger attribute record; values are in device byte order.
+    const ResXMLTree_attribute* getAttributes(size_t* outCount, size_t* outStride) const;
+
     ssize_t indexOfAttribute(const char* ns, const char* attr) const;
     ssize_t indexOfAttribute(const char16_t* ns, size_t nsLen,
                              const char16_t* attr, size_t attrLen) const;
@@ -707,6 +726,7 @@ private:
     friend class ResXMLTree;
     
     event_code_t nextNode();
+    const ResXMLTree_attribute* attributeAt(size_t idx) const;
 
     const ResXMLTree&           mTree;
     event_code_t                mEventCode;
@@ -724,7 +744,12 @@ public:
     ResXMLTree(const void* data, size_t size, bool copyData=false);
     ~ResXMLTree();
 
-    status_t setTo(const void* data, size_t size, bool copyData=false);
+    // If validateAll is set, every node of the tree is validated here
+    // instead of when the parsers reach it, so that iterating the tree
+    // afterwards does not check the nodes again.  This is meant for the
+    // trees that are parsed many times, like layouts of system packages.
+    status_t setTo(const void* data, size_t size, bool copyData=false,
+                   bool validateAll=false);
 
     status_t getError() const;
 
@@ -734,8 +759,11 @@ private:
     friend class ResXMLParser;
 
     status_t validateNode(const ResXMLTree_node* node) const;
+    bool validateTree();
 
     status_t                    mError;
+    // Every node was validated by setTo()
+    bool                        mValidated;
     void*                       mOwnedData;
     const ResXMLTree_header*    mHeader;
     size_t                      mSize;
@@ -1349,6 +1377,10 @@ public:
      *
      * Note that this function -does- do reference traversal of the bag data.
      *
+     * Bags that were already computed are returned without taking the
+     * table lock.  The bag stays valid until unlockBag() is called, even if
+     * the parameters change in the meantime.
+     *
      * @param resID The desired resource identifier.
      * @param outBag Filled inm with a pointer to the bag mappings.
      *
@@ -1405,6 +1437,22 @@ public:
                 uint32_t* inoutTypeSpecFlags = NULL,
                 ResTable_config* inoutConfig = NULL) const;
 
+        /**
+         * Lock the attributes resolved by the theme, so that many of them
+         * can be retrieved with the Locked variants of the functions above
+         * without locking for each one.  May be called with the table
+         * locked, but the table must not be locked while the theme is.
+         */
+        void lock() const;
+        void unlock() const;
+
+        ssize_t getAttributeLocked(uint32_t resID, Res_value* outValue,
+                uint32_t* outTypeSpecFlags = NULL) const;
+        ssize_t resolveAttributeReferenceLocked(Res_value* inOutValue,
+                ssize_t blockIndex, uint32_t* outLastRef = NULL,
+                uint32_t* inoutTypeSpecFlags = NULL,
+                ResTable_config* inoutConfig = NULL) const;
+
         void dumpToLog() const;
         
     private:
@@ -1425,11 +1473,29 @@ public:
             type_info types[];
         };
 
+        // Result of getAttribute() for an attribute, after following the
+        // attribute references of the theme.
+        struct attr_cache_entry {
+            ssize_t result;
+            uint32_t typeSpecFlags;
+            Res_value value;
+            // True if other attributes were followed to get the result
+            bool chained;
+        };
+
         void free_package(package_info* pi);
         package_info* copy_package(package_info* pi);
 
+        ssize_t findAttribute(uint32_t resID, Res_value* outValue,
+                uint32_t* outTypeSpecFlags, bool* outChained) const;
+
         const ResTable& mTable;
         package_info*   mPackages[Res_MAXPACKAGE];
+
+        // Attributes resolved since the last change to the theme, keyed
+        // by the requested attribute identifier.
+        mutable Mutex mCacheLock;
+        mutable KeyedVector<uint32_t, attr_cache_entry> mAttrCache;
     };
 
     void setParameters(const ResTable_config* params);
@@ -1533,25 +1599,51 @@ public:
 
     void getLocales(Vector<String8>* locales) const;
 
+    // Identifies the version of a package an idmap was generated from.
+    // The modification time and size of the package let the idmap be
+    // checked without reading the CRC of its resources.arsc.
+    struct idmap_package_info {
+        uint32_t crc;
+        uint32_t mtime;
+        uint32_t size;
+    };
+
     // Generate an idmap.
     //
     // Return value: on success: NO_ERROR; caller is responsible for free-ing
     // outData (using free(3)). On failure, any status_t value other than
     // NO_ERROR; the caller should not free outData.
-    status_t createIdmap(const ResTable& overlay, uint32_t originalCrc, uint32_t overlayCrc,
+    status_t createIdmap(const ResTable& overlay, const idmap_package_info& originalInfo,
+                         const idmap_package_info& overlayInfo,
                          void** outData, size_t* outSize) const;
 
     enum {
-        IDMAP_HEADER_SIZE_BYTES = 3 * sizeof(uint32_t),
+        IDMAP_HEADER_SIZE_BYTES = 7 * sizeof(uint32_t),
     };
     // Retrieve idmap meta-data.
     //
     // This function only requires the idmap header (the first
     // IDMAP_HEADER_SIZE_BYTES) bytes of an idmap file.
     static bool getIdmapInfo(const void* idmap, size_t size,
-                             uint32_t* pOriginalCrc, uint32_t* pOverlayCrc);
+                             idmap_package_info* outOriginalInfo,
+                             idmap_package_info* outOverlayInfo);
+    // Write the package meta-data of an idmap header.
+    static void setIdmapInfo(void* idmap, const idmap_package_info& originalInfo,
+                             const idmap_package_info& overlayInfo);
     void removeAssetsByCookie(const String8 &packageName, void* cookie);
 
+    // Writes the bags of the specified package, resolved for the current
+    // parameters, so that other tables can use them instead of computing
+    // them again.  The source CRC identifies the resources the bags were
+    // computed from.  Packages with overlays cannot be cached.
+    status_t writeBagCache(uint32_t packageId, uint32_t sourceCrc, int fd) const;
+
+    // Uses the bags of a file written by writeBagCache(), usually mapped
+    // read-only, while the parameters of the table match those of the
+    // cache.  The data must stay valid for the lifetime of the table and
+    // of the tables it is added to.
+    status_t setBagCache(const void* data, size_t size, uint32_t sourceCrc);
+
 #ifndef HAVE_ANDROID_OS
     void print(bool inclValues) const;
     static String8 normalizeForOutput(const char* input);
@@ -1576,6 +1668,18 @@ private:
     status_t parsePackage(
         const ResTable_package* const pkg, const Header* const header, uint32_t idmap_id);
 
+    ssize_t getCachedBag(uint32_t resID, const bag_entry** outBag,
+            uint32_t* outTypeSpecFlags) const;
+    void freeRetiredBags();
+    void updateBagCacheMatch();
+    const bag_set* getSharedBag(const PackageGroup* grp, int t, int e) const;
+
+    void updateEntryIndices();
+    void invalidateEntryIndices();
+    void clearEntryIndices();
+
+    static void getEntryKeys(const Type* type, Vector<uint32_t>* outKeys);
+
     void print_value(const Package* pkg, const Res_value& value) const;
     
     mutable Mutex               mLock;
@@ -1584,6 +1688,20 @@ private:
 
     ResTable_config             mParams;
 
+    // Best config of every entry of a type for mParams, filled by getEntry()
+    // and invalidated by changing the generation, see setParameters().
+    KeyedVector<const Type*, uint32_t*> mEntryIndices;
+    uint32_t                    mEntryIndexGeneration;
+
+    // Bags handed out by lockBag() and not yet released by unlockBag(), and
+    // the memory of the bags that were cleared while they were in use.
+    mutable volatile int32_t    mBagReaders;
+    Vector<void*>               mRetiredBags;
+
+    // Bags precomputed by writeBagCache(), see setBagCache()
+    const uint8_t*              mBagCache;
+    bool                        mBagCacheMatches;
+
     // Array of all resource tables.
     Vector<Header*>             mHeaders;
 
@@ -1598,6 +1716,12 @@ private:
     // one).  Resources requested which are found in this map will be
     // automatically redirected to the appropriate themed value.
     Vector<PackageRedirectionMap*> mRedirectionMap;
+
+    // The first map of mRedirectionMap for each package ID, so that lookups
+    // don't scan mRedirectionMap.  Maps that were still empty when they
+    // were added have no package yet and are only found by a scan.
+    PackageRedirectionMap*      mRedirectionByPackage[256];
+    bool                        mHasUnmappedRedirections;
 };
 
 }   // namespace android
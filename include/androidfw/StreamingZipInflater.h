@@ -22,6 +22,7 @@
 #include <zlib.h>
 
 #include <utils/Compat.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -29,6 +30,8 @@ class StreamingZipInflater {
 public:
     static const size_t INPUT_CHUNK_SIZE = 64 * 1024;
     static const size_t OUTPUT_CHUNK_SIZE = 64 * 1024;
+    // distance in uncompressed bytes between two seek checkpoints
+    static const size_t CHECKPOINT_INTERVAL = 4 * 1024 * 1024;
 
     // Flavor that pages in the compressed data from a fd
     StreamingZipInflater(int fd, off64_t compDataStart, size_t uncompSize, size_t compSize);
@@ -42,14 +45,26 @@ public:
     // be NULL, in which case the data is consumed and discarded.
     ssize_t read(void* outBuf, size_t count);
 
-    // seeking backwards requires uncompressing fom the beginning, so is very
-    // expensive.  seeking forwards only requires uncompressing from the current
-    // position to the destination.
+    // seeking backwards requires uncompressing from the closest checkpoint
+    // before the destination, or from the beginning if there is none.  seeking
+    // forwards only requires uncompressing from the current position, or from
+    // a checkpoint past it, to the destination.
     off64_t seekAbsolute(off64_t absoluteInputPosition);
 
 private:
+    // Snapshot of the inflater taken once its output buffer was drained,
+    // checkpoints are only taken after the first backwards seek.
+    struct Checkpoint {
+        off64_t outPosition;    // uncompressed offset the stream resumes at
+        size_t inPosition;      // offset in the compressed data of next_in
+        z_stream state;
+    };
+
     void initInflateState();
     int readNextChunk();
+    void takeCheckpoint(off64_t outPosition);
+    const Checkpoint* findCheckpoint(off64_t outPosition) const;
+    bool restoreCheckpoint(const Checkpoint* checkpoint);
 
     // where to find the uncompressed data
     int mFd;
@@ -77,6 +92,11 @@ private:
     // input state bookkeeping
     size_t mInNextChunkOffset;  // offset from start of blob at which the next input chunk lies
     // the z_stream contains state about input block consumption
+
+    // seek checkpoints, sorted by output position.  zlib states point back
+    // to their stream so they are never moved.
+    bool mTakeCheckpoints;
+    Vector<Checkpoint*> mCheckpoints;
 };
 
 }
@@ -268,6 +268,35 @@ Asset::~Asset(void)
 }
 #endif
 
+/*
+ * Tell the kernel how the pages of a mapped asset are going to be used,
+ * so that it reads ahead only what will be accessed.
+ */
+static void adviseMap(FileMap* map, Asset::AccessMode mode)
+{
+    FileMap::MapAdvice advice;
+
+    switch (mode) {
+    case Asset::ACCESS_RANDOM:
+        advice = FileMap::RANDOM;
+        break;
+    case Asset::ACCESS_STREAMING:
+        advice = FileMap::SEQUENTIAL;
+        break;
+    case Asset::ACCESS_BUFFER:
+        /* the whole buffer is about to be used */
+        advice = FileMap::WILLNEED;
+        break;
+    default:
+        return;
+    }
+
+    if (map->advise(advice) != 0) {
+        ALOGV("madvise(%d) failed on %s: %s\n", advice, map->getFileName(),
+            strerror(errno));
+    }
+}
+
 /*
  * Create a new Asset from a memory mapping.
  */
@@ -283,6 +312,7 @@ Asset::~Asset(void)
         return NULL;
 
     pAsset->mAccessMode = mode;
+    adviseMap(dataMap, mode);
     return pAsset;
 }
 
@@ -301,6 +331,8 @@ Asset::~Asset(void)
         return NULL;
 
     pAsset->mAccessMode = mode;
+    /* compressed data is always inflated from the start */
+    adviseMap(dataMap, ACCESS_STREAMING);
     return pAsset;
 }
 
@@ -612,6 +644,7 @@ const void* _FileAsset::getBuffer(bool wordAligned)
 
         ALOGV(" getBuffer: mapped\n");
 
+        adviseMap(map, getAccessMode());
         mMap = map;
         if (!wordAligned) {
             return  mMap->getDataPtr();
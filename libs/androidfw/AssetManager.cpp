@@ -27,6 +27,7 @@
 #include <androidfw/AssetManager.h>
 #include <androidfw/ResourceTypes.h>
 #include <utils/Atomic.h>
+#include <utils/FileMap.h>
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <utils/String8.h>
@@ -64,6 +65,7 @@ static const char* kAssetsRoot = "assets";
 static const char* kAppZipName = NULL; //"classes.jar";
 static const char* kSystemAssets = "framework/framework-res.apk";
 static const char* kIdmapCacheDir = "resource-cache";
+static const char* kBagCacheSuffix = "@bags";
 
 static const char* kExcludeExtension = ".EXCLUDE";
 
@@ -71,9 +73,21 @@ static Asset* const kExcludedAsset = (Asset*) 0xd000000d;
 
 static volatile int32_t gCount = 0;
 
+// Bags of the system resources shared by all the asset managers of the
+// process, mapped once and never unmapped, see loadSystemBagCacheLocked()
+static Mutex gBagCacheLock;
+static FileMap* gBagCacheMap = NULL;
+static uint32_t gBagCacheCrc = 0;
+static bool gBagCacheLoaded = false;
+// Whether this process writes the bag cache, see setWritesSystemBagCache()
+static bool gBagCacheWriter = false;
+static bool gBagCacheWriting = false;
+static bool gBagCacheWritten = false;
+static ResTable_config gBagCacheWrittenConfig;
+
 namespace {
-    // Transform string /a/b/c.apk to /data/resource-cache/a@b@c.apk@idmap
-    String8 idmapPathForPackagePath(const String8& pkgPath)
+    // Transform string /a/b/c.apk to /data/resource-cache/a@b@c.apk@<suffix>
+    String8 resourceCachePathForPackagePath(const String8& pkgPath, const char* suffix)
     {
         const char* root = getenv("ANDROID_DATA");
         LOG_ALWAYS_FATAL_IF(root == NULL, "ANDROID_DATA not set");
@@ -95,8 +109,38 @@ namespace {
             ++p;
         }
         path.appendPath(filename);
-        path.append("@idmap");
+        path.append(suffix);
+
+        return path;
+    }
+
+    // Transform string /a/b/c.apk to /data/resource-cache/a@b@c.apk@idmap
+    String8 idmapPathForPackagePath(const String8& pkgPath)
+    {
+        return resourceCachePathForPackagePath(pkgPath, "@idmap");
+    }
+
+    // Fill in the modification time and size of a package, the CRC is
+    // left for the caller to read if needed
+    bool getIdmapPackageStat(const String8& pkgPath, ResTable::idmap_package_info* outInfo)
+    {
+        struct stat st;
+        if (TEMP_FAILURE_RETRY(stat(pkgPath.string(), &st)) == -1) {
+            ALOGW("failed to stat file %s: %s\n", pkgPath.string(), strerror(errno));
+            return false;
+        }
+        outInfo->crc = 0;
+        outInfo->mtime = (uint32_t)st.st_mtime;
+        outInfo->size = (uint32_t)st.st_size;
+        return true;
+    }
 
+    String8 systemAssetsPath()
+    {
+        const char* root = getenv("ANDROID_ROOT");
+        LOG_ALWAYS_FATAL_IF(root == NULL, "ANDROID_ROOT not set");
+        String8 path(root);
+        path.appendPath(kSystemAssets);
         return path;
     }
 }
@@ -224,7 +268,7 @@ bool AssetManager::isIdmapStaleLocked(const String8& originalPath, const String8
     }
     if (st.st_size < ResTable::IDMAP_HEADER_SIZE_BYTES) {
         ALOGW("file %s has unexpectedly small size=%zd\n", idmapPath.string(), (size_t)st.st_size);
-        return false;
+        return true;
     }
     int fd = TEMP_FAILURE_RETRY(::open(idmapPath.string(), O_RDONLY));
     if (fd == -1) {
@@ -247,20 +291,50 @@ bool AssetManager::isIdmapStaleLocked(const String8& originalPath, const String8
     }
     TEMP_FAILURE_RETRY(close(fd));
 
-    uint32_t cachedOriginalCrc, cachedOverlayCrc;
+    // Idmaps written in an older format are regenerated as well.
+    ResTable::idmap_package_info cachedOriginal, cachedOverlay;
     if (!ResTable::getIdmapInfo(buf, ResTable::IDMAP_HEADER_SIZE_BYTES,
-                                &cachedOriginalCrc, &cachedOverlayCrc)) {
+                                &cachedOriginal, &cachedOverlay)) {
+        return true;
+    }
+
+    // The packages are only opened to read their CRCs when they have been
+    // modified since the idmap was written.
+    ResTable::idmap_package_info actualOriginal, actualOverlay;
+    if (!getIdmapPackageStat(originalPath, &actualOriginal)
+            || !getIdmapPackageStat(overlayPath, &actualOverlay)) {
+        return false;
+    }
+    if (cachedOriginal.mtime == actualOriginal.mtime
+            && cachedOriginal.size == actualOriginal.size
+            && cachedOverlay.mtime == actualOverlay.mtime
+            && cachedOverlay.size == actualOverlay.size) {
         return false;
     }
 
-    uint32_t actualOriginalCrc, actualOverlayCrc;
-    if (!getZipEntryCrcLocked(originalPath, "resources.arsc", &actualOriginalCrc)) {
+    if (!getZipEntryCrcLocked(originalPath, "resources.arsc", &actualOriginal.crc)) {
         return false;
     }
-    if (!getZipEntryCrcLocked(overlayPath, "resources.arsc", &actualOverlayCrc)) {
+    if (!getZipEntryCrcLocked(overlayPath, "resources.arsc", &actualOverlay.crc)) {
         return false;
     }
-    return cachedOriginalCrc != actualOriginalCrc || cachedOverlayCrc != actualOverlayCrc;
+    if (cachedOriginal.crc != actualOriginal.crc || cachedOverlay.crc != actualOverlay.crc) {
+        return true;
+    }
+
+    // The resources did not change, record the new modification times and
+    // sizes so that the next check does not read the CRCs again.  This
+    // fails silently for processes that can't write the resource cache.
+    ResTable::setIdmapInfo(buf, actualOriginal, actualOverlay);
+    fd = TEMP_FAILURE_RETRY(::open(idmapPath.string(), O_WRONLY));
+    if (fd != -1) {
+        if (TEMP_FAILURE_RETRY(pwrite(fd, buf, ResTable::IDMAP_HEADER_SIZE_BYTES, 0))
+                != ResTable::IDMAP_HEADER_SIZE_BYTES) {
+            ALOGW("failed to update idmap file %s: %s\n", idmapPath.string(), strerror(errno));
+        }
+        TEMP_FAILURE_RETRY(close(fd));
+    }
+    return false;
 }
 
 bool AssetManager::getZipEntryCrcLocked(const String8& zipPath, const char* entryFilename,
@@ -289,7 +363,7 @@ bool AssetManager::createIdmapFileLocked(const String8& originalPath, const Stri
          __FUNCTION__, originalPath.string(), overlayPath.string(), idmapPath.string());
     ResTable tables[2];
     const String8* paths[2] = { &originalPath, &overlayPath };
-    uint32_t originalCrc, overlayCrc;
+    ResTable::idmap_package_info originalInfo, overlayInfo;
     bool retval = false;
     ssize_t offset = 0;
     int fd = 0;
@@ -308,16 +382,20 @@ bool AssetManager::createIdmapFileLocked(const String8& originalPath, const Stri
         tables[i].add(ass, (void*)1, false);
     }
 
-    if (!getZipEntryCrcLocked(originalPath, "resources.arsc", &originalCrc)) {
+    if (!getIdmapPackageStat(originalPath, &originalInfo)
+            || !getIdmapPackageStat(overlayPath, &overlayInfo)) {
+        goto error;
+    }
+    if (!getZipEntryCrcLocked(originalPath, "resources.arsc", &originalInfo.crc)) {
         ALOGW("failed to retrieve crc for resources.arsc in %s\n", originalPath.string());
         goto error;
     }
-    if (!getZipEntryCrcLocked(overlayPath, "resources.arsc", &overlayCrc)) {
+    if (!getZipEntryCrcLocked(overlayPath, "resources.arsc", &overlayInfo.crc)) {
         ALOGW("failed to retrieve crc for resources.arsc in %s\n", overlayPath.string());
         goto error;
     }
 
-    if (tables[0].createIdmap(tables[1], originalCrc, overlayCrc,
+    if (tables[0].createIdmap(tables[1], originalInfo, overlayInfo,
                               (void**)&data, &size) != NO_ERROR) {
         ALOGW("failed to generate idmap data for file %s\n", idmapPath.string());
         goto error;
@@ -356,13 +434,7 @@ error:
 
 bool AssetManager::addDefaultAssets()
 {
-    const char* root = getenv("ANDROID_ROOT");
-    LOG_ALWAYS_FATAL_IF(root == NULL, "ANDROID_ROOT not set");
-
-    String8 path(root);
-    path.appendPath(kSystemAssets);
-
-    return addAssetPath(path, NULL);
+    return addAssetPath(systemAssetsPath(), NULL);
 }
 
 void* AssetManager::nextAssetPath(void* cookie) const
@@ -448,6 +520,8 @@ void AssetManager::setConfiguration(const ResTable_config& config, const char* l
     } else {
         updateResourceParamsLocked();
     }
+
+    updateSystemBagCacheLocked();
 }
 
 void AssetManager::getConfiguration(ResTable_config* outConfig) const
@@ -626,6 +700,7 @@ const ResTable* AssetManager::getResTable(bool required) const
     mResources = rt = new ResTable();
 
     if (rt) {
+        preloadResourceTablesLocked();
         const size_t N = mAssetPaths.size();
         for (size_t i=0; i<N; i++) {
             const asset_path& ap = mAssetPaths.itemAt(i);
@@ -641,6 +716,110 @@ const ResTable* AssetManager::getResTable(bool required) const
     return rt;
 }
 
+/*
+ * Opens the resources.arsc entry of a zip and brings its data in memory,
+ * inflating it if needed.  Only touches the zip and the asset, which are
+ * not shared yet, so that several tables can be loaded at the same time.
+ */
+class AssetManager::ResourceTableLoader : public Thread {
+public:
+    ResourceTableLoader(AssetManager* am, const ZipFileRO* zip, ZipEntryRO entry)
+        : Thread(false), mAssetManager(am), mZip(zip), mEntry(entry), mAsset(NULL)
+    {
+    }
+
+    void load()
+    {
+        mAsset = mAssetManager->openAssetFromZipLocked(mZip, mEntry, Asset::ACCESS_BUFFER,
+                String8("resources.arsc"));
+        if (mAsset == NULL) {
+            return;
+        }
+
+        // Stored tables are mapped, fault their pages in now rather than
+        // one at a time while the table is parsed.
+        const uint8_t* data = (const uint8_t*) mAsset->getBuffer(true);
+        const size_t size = mAsset->getLength();
+        if (data != NULL) {
+            for (size_t i = 0; i < size; i += kPageSize) {
+                mTouched = data[i];
+            }
+        }
+    }
+
+    Asset* getAsset() const { return mAsset; }
+
+private:
+    static const size_t kPageSize = 4096;
+
+    virtual bool threadLoop()
+    {
+        load();
+        return false;
+    }
+
+    AssetManager* mAssetManager;
+    const ZipFileRO* mZip;
+    ZipEntryRO mEntry;
+    Asset* mAsset;
+    volatile uint8_t mTouched;
+};
+
+void AssetManager::preloadResourceTablesLocked() const
+{
+    AssetManager* self = const_cast<AssetManager*>(this);
+    Vector<size_t> paths;
+    Vector<sp<ResourceTableLoader> > loaders;
+
+    const size_t N = mAssetPaths.size();
+    for (size_t i=0; i<N; i++) {
+        const asset_path& ap = mAssetPaths.itemAt(i);
+        if (ap.type == kFileTypeDirectory) {
+            continue;
+        }
+        // Skip the tables that other asset managers already loaded
+        if (i == 0 && self->mZipSet.getZipResourceTable(ap.path) != NULL) {
+            continue;
+        }
+        if (self->mZipSet.getZipResourceTableAsset(ap.path) != NULL) {
+            continue;
+        }
+        ZipFileRO* zip = self->getZipFileLocked(ap);
+        if (zip == NULL) {
+            continue;
+        }
+        ZipEntryRO entry = zip->findEntryByName("resources.arsc");
+        if (entry == NULL) {
+            continue;
+        }
+        paths.add(i);
+        loaders.add(new ResourceTableLoader(self, zip, entry));
+    }
+
+    // A single table is not worth a thread, it gets loaded as it is parsed
+    if (loaders.size() < 2) {
+        return;
+    }
+
+    for (size_t i=0; i<loaders.size(); i++) {
+        if (loaders[i]->run("ResTableLoader") != NO_ERROR) {
+            loaders[i]->load();
+        }
+    }
+
+    for (size_t i=0; i<loaders.size(); i++) {
+        loaders[i]->join();
+        Asset* ass = loaders[i]->getAsset();
+        if (ass == NULL) {
+            continue;
+        }
+        const asset_path& ap = mAssetPaths.itemAt(paths[i]);
+        ALOGV("Preloaded resource table %s\n", ap.path.string());
+        ass->setAssetSource(self->mZipSet.getZipSourceName(ap.path, "resources.arsc"));
+        self->mZipSet.setZipResourceTableAsset(ap.path, ass);
+    }
+}
+
 void AssetManager::updateResTableFromAssetPath(ResTable *rt, const asset_path& ap, void *cookie) const
 {
     Asset* ass = NULL;
@@ -697,6 +876,9 @@ void AssetManager::updateResTableFromAssetPath(ResTable *rt, const asset_path& a
         } else {
             ALOGV("Parsing resources for %s", ap.path.string());
             rt->add(ass, cookie, !shared);
+            if (cookiePos == 1 && shared) {
+                const_cast<AssetManager*>(this)->loadSystemBagCacheLocked(rt, ap);
+            }
         }
         if (!shared) {
             delete ass;
@@ -729,6 +911,137 @@ void AssetManager::updateResourceParamsLocked() const
     res->setParameters(mConfig);
 }
 
+void AssetManager::loadSystemBagCacheLocked(ResTable* rt, const asset_path& ap)
+{
+    if (ap.path != systemAssetsPath()) {
+        return;
+    }
+
+    AutoMutex _l(gBagCacheLock);
+    if (!gBagCacheLoaded) {
+        // Only tried once, the zygote maps the cache for all the applications
+        gBagCacheLoaded = true;
+
+        const String8 path = resourceCachePathForPackagePath(ap.path, kBagCacheSuffix);
+        int fd = TEMP_FAILURE_RETRY(::open(path.string(), O_RDONLY));
+        if (fd == -1) {
+            ALOGV("No bag cache %s: %s\n", path.string(), strerror(errno));
+            return;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0
+                && getZipEntryCrcLocked(ap.path, "resources.arsc", &gBagCacheCrc)) {
+            FileMap* map = new FileMap();
+            if (map->create(path.string(), fd, 0, st.st_size, true)) {
+                gBagCacheMap = map;
+            } else {
+                map->release();
+            }
+        }
+        TEMP_FAILURE_RETRY(close(fd));
+    }
+
+    if (gBagCacheMap != NULL) {
+        rt->setBagCache(gBagCacheMap->getDataPtr(), gBagCacheMap->getDataLength(),
+                gBagCacheCrc);
+    }
+}
+
+bool AssetManager::createSystemBagCache()
+{
+    const ResTable& rt = getResources();
+
+    AutoMutex _l(mLock);
+    if (mAssetPaths.size() == 0 || mAssetPaths[0].path != systemAssetsPath()) {
+        ALOGW("Cannot create a bag cache without the system resources\n");
+        return false;
+    }
+
+    const asset_path& ap = mAssetPaths[0];
+    uint32_t crc;
+    if (!getZipEntryCrcLocked(ap.path, "resources.arsc", &crc)) {
+        return false;
+    }
+
+    // Write a temporary file first so that readers never see a partial cache
+    const String8 path = resourceCachePathForPackagePath(ap.path, kBagCacheSuffix);
+    String8 tmpPath(path);
+    tmpPath.append(".tmp");
+    int fd = TEMP_FAILURE_RETRY(::open(tmpPath.string(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    if (fd == -1) {
+        ALOGW("Failed to create %s: %s\n", tmpPath.string(), strerror(errno));
+        return false;
+    }
+
+    status_t err = rt.writeBagCache(0x01, crc, fd);
+    TEMP_FAILURE_RETRY(close(fd));
+    if (err != NO_ERROR || rename(tmpPath.string(), path.string()) != 0) {
+        ALOGW("Failed to write bag cache %s: %d\n", path.string(), err);
+        unlink(tmpPath.string());
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Writes the bag cache of the system resources for a configuration with an
+ * asset manager of its own, so that the one that asked for it is not held
+ * while all the bags are resolved.
+ */
+class AssetManager::BagCacheWriter : public Thread {
+public:
+    BagCacheWriter(const ResTable_config& config)
+        : Thread(false), mConfig(config)
+    {
+    }
+
+private:
+    virtual bool threadLoop()
+    {
+        AssetManager am;
+        if (am.addDefaultAssets()) {
+            am.setConfiguration(mConfig);
+            am.createSystemBagCache();
+        }
+
+        AutoMutex _l(gBagCacheLock);
+        gBagCacheWriting = false;
+        return false;
+    }
+
+    const ResTable_config mConfig;
+};
+
+void AssetManager::setWritesSystemBagCache(bool writes)
+{
+    AutoMutex _l(gBagCacheLock);
+    gBagCacheWriter = writes;
+}
+
+void AssetManager::updateSystemBagCacheLocked()
+{
+    if (mAssetPaths.size() == 0 || mAssetPaths[0].path != systemAssetsPath()) {
+        return;
+    }
+
+    AutoMutex _l(gBagCacheLock);
+    // One write at a time; a configuration set meanwhile is picked up by
+    // the next call
+    if (!gBagCacheWriter || gBagCacheWriting || (gBagCacheWritten
+            && memcmp(&gBagCacheWrittenConfig, mConfig, sizeof(gBagCacheWrittenConfig)) == 0)) {
+        return;
+    }
+
+    sp<BagCacheWriter> writer = new BagCacheWriter(*mConfig);
+    if (writer->run("BagCacheWriter", PRIORITY_BACKGROUND) == NO_ERROR) {
+        gBagCacheWriting = true;
+        gBagCacheWritten = true;
+        gBagCacheWrittenConfig = *mConfig;
+    }
+}
+
 Asset* AssetManager::openIdmapLocked(const struct asset_path& ap) const
 {
     Asset* ass = NULL;
@@ -796,27 +1109,23 @@ Asset* AssetManager::openNonAssetInPathLocked(const char* fileName, AccessMode m
 
     /* look inside the zip file */
     } else {
-        String8 path(fileName);
-
         /* check the appropriate Zip file */
         ZipFileRO* pZip;
         ZipEntryRO entry;
 
         pZip = getZipFileLocked(ap);
         if (pZip != NULL) {
-            //printf("GOT zip, checking NA '%s'\n", (const char*) path);
-            entry = pZip->findEntryByName(path.string());
+            //printf("GOT zip, checking NA '%s'\n", fileName);
+            entry = pZip->findEntryByName(fileName);
             if (entry != NULL) {
                 //printf("FOUND NA in Zip file for %s\n", appName ? appName : kAppCommon);
-                pAsset = openAssetFromZipLocked(pZip, entry, mode, path);
+                pAsset = openAssetFromZipLocked(pZip, entry, mode, String8(fileName));
             }
         }
 
         if (pAsset != NULL) {
             /* create a "source" name, for debug/display */
-            pAsset->setAssetSource(
-                    createZipSourceNameLocked(ZipSet::getPathName(ap.path.string()), String8(""),
-                                                String8(fileName)));
+            pAsset->setAssetSource(mZipSet.getZipSourceName(ap.path, fileName));
         }
     }
 
@@ -969,8 +1278,7 @@ Asset* AssetManager::openInLocaleVendorLocked(const char* fileName, AccessMode m
 
         if (pAsset != NULL) {
             /* create a "source" name, for debug/display */
-            pAsset->setAssetSource(createZipSourceNameLocked(ZipSet::getPathName(ap.path.string()),
-                                                             String8(""), String8(fileName)));
+            pAsset->setAssetSource(mZipSet.getZipSourceName(ap.path, fileName));
         }
     }
 
@@ -1434,10 +1742,8 @@ bool AssetManager::scanAndMergeZipLocked(SortedVector<AssetDir::FileInfo>* pMerg
     const asset_path& ap, const char* rootDir, const char* baseDirName)
 {
     ZipFileRO* pZip;
-    Vector<String8> dirs;
-    AssetDir::FileInfo info;
     SortedVector<AssetDir::FileInfo> contents;
-    String8 sourceName, zipName, dirName;
+    String8 zipName, dirName;
 
     pZip = mZipSet.getZip(ap.path);
     if (pZip == NULL) {
@@ -1452,86 +1758,26 @@ bool AssetManager::scanAndMergeZipLocked(SortedVector<AssetDir::FileInfo>* pMerg
     dirName.appendPath(baseDirName);
 
     /*
-     * Scan through the list of files, looking for a match.  The files in
-     * the Zip table of contents are not in sorted order, so we have to
-     * process the entire list.  We're looking for a string that begins
-     * with the characters in "dirName", is followed by a '/', and has no
-     * subsequent '/' in the stuff that follows.
-     *
-     * What makes this especially fun is that directories are not stored
-     * explicitly in Zip archives, so we have to infer them from context.
-     * When we see "sounds/foo.wav" we have to leave a note to ourselves
-     * to insert a directory called "sounds" into the list.  We store
-     * these in temporary vector so that we only return each one once.
+     * The files in the Zip table of contents are not in sorted order, and
+     * directories are not stored explicitly, so the shared zip indexes the
+     * files by directory the first time one of its directories is listed.
+     * Only the source names are left to add to the contents.
      *
      * Name comparisons are case-sensitive to match UNIX filesystem
      * semantics.
      */
-    int dirNameLen = dirName.length();
-    for (int i = 0; i < pZip->getNumEntries(); i++) {
-        ZipEntryRO entry;
-        char nameBuf[256];
-
-        entry = pZip->findEntryByIndex(i);
-        if (pZip->getEntryFileName(entry, nameBuf, sizeof(nameBuf)) != 0) {
-            // TODO: fix this if we expect to have long names
-            ALOGE("ARGH: name too long?\n");
-            continue;
-        }
-        //printf("Comparing %s in %s?\n", nameBuf, dirName.string());
-        if (dirNameLen == 0 ||
-            (strncmp(nameBuf, dirName.string(), dirNameLen) == 0 &&
-             nameBuf[dirNameLen] == '/'))
-        {
-            const char* cp;
-            const char* nextSlash;
-
-            cp = nameBuf + dirNameLen;
-            if (dirNameLen != 0)
-                cp++;       // advance past the '/'
-
-            nextSlash = strchr(cp, '/');
-//xxx this may break if there are bare directory entries
-            if (nextSlash == NULL) {
-                /* this is a file in the requested directory */
-
-                info.set(String8(nameBuf).getPathLeaf(), kFileTypeRegular);
-
-                info.setSourceName(
-                    createZipSourceNameLocked(zipName, dirName, info.getFileName()));
-
-                contents.add(info);
-                //printf("FOUND: file '%s'\n", info.getFileName().string());
-            } else {
-                /* this is a subdir; add it if we don't already have it*/
-                String8 subdirName(cp, nextSlash - cp);
-                size_t j;
-                size_t N = dirs.size();
-
-                for (j = 0; j < N; j++) {
-                    if (subdirName == dirs[j]) {
-                        break;
-                    }
-                }
-                if (j == N) {
-                    dirs.add(subdirName);
-                }
-
-                //printf("FOUND: dir '%s'\n", subdirName.string());
-            }
+    const SortedVector<AssetDir::FileInfo>* dirContents =
+            mZipSet.getZipDirContents(ap.path, dirName);
+    if (dirContents != NULL) {
+        contents.setCapacity(dirContents->size());
+        for (size_t i = 0; i < dirContents->size(); i++) {
+            AssetDir::FileInfo info(dirContents->itemAt(i));
+            info.setSourceName(
+                createZipSourceNameLocked(zipName, dirName, info.getFileName()));
+            contents.add(info);
         }
     }
 
-    /*
-     * Add the set of unique directories.
-     */
-    for (int i = 0; i < (int) dirs.size(); i++) {
-        info.set(dirs[i], kFileTypeDirectory);
-        info.setSourceName(
-            createZipSourceNameLocked(zipName, dirName, info.getFileName()));
-        contents.add(info);
-    }
-
     mergeInfoLocked(pMergedInfo, &contents);
 
     return true;
@@ -1792,8 +2038,13 @@ DefaultKeyedVector<String8, wp<AssetManager::SharedZip> > AssetManager::SharedZi
 
 AssetManager::SharedZip::SharedZip(const String8& path, time_t modWhen)
     : mPath(path), mZipFile(NULL), mModWhen(modWhen),
-      mResourceTableAsset(NULL), mResourceTable(NULL)
+      mResourceTableAsset(NULL), mResourceTable(NULL), mDirTreeBuilt(false)
 {
+    // Same as createZipSourceNameLocked() with an empty directory
+    mSourcePrefix.append("zip:");
+    mSourcePrefix.append(ZipSet::getPathName(path.string()));
+    mSourcePrefix.append(":/");
+
     //ALOGI("Creating SharedZip %p %s\n", this, (const char*)mPath);
     mZipFile = new ZipFileRO;
     ALOGV("+++ opening zip '%s'\n", mPath.string());
@@ -1823,6 +2074,92 @@ ZipFileRO* AssetManager::SharedZip::getZip()
     return mZipFile;
 }
 
+const String8& AssetManager::SharedZip::getSourcePrefix() const
+{
+    return mSourcePrefix;
+}
+
+const SortedVector<AssetDir::FileInfo>* AssetManager::SharedZip::getDirContents(
+        const String8& dirName)
+{
+    AutoMutex _l(mDirLock);
+    if (!mDirTreeBuilt) {
+        buildDirTreeLocked();
+        mDirTreeBuilt = true;
+    }
+    // The tree does not change once built, the contents can be used unlocked
+    const ssize_t idx = mDirs.indexOfKey(dirName);
+    return idx >= 0 ? mDirs.valueAt(idx) : NULL;
+}
+
+/*
+ * Index the files of the zip by directory, so that listing a directory
+ * does not go through the whole table of contents.  Directories are not
+ * stored explicitly in Zip archives, they are inferred from the names of
+ * the files and take precedence over files with the same name.
+ */
+void AssetManager::SharedZip::buildDirTreeLocked()
+{
+    if (mZipFile == NULL) {
+        return;
+    }
+
+    AssetDir::FileInfo info;
+    const int N = mZipFile->getNumEntries();
+    for (int i = 0; i < N; i++) {
+        ZipEntryRO entry = mZipFile->findEntryByIndex(i);
+        char nameBuf[256];
+        if (mZipFile->getEntryFileName(entry, nameBuf, sizeof(nameBuf)) != 0) {
+            // TODO: fix this if we expect to have long names
+            ALOGE("ARGH: name too long?\n");
+            continue;
+        }
+
+        // Add the file to its directory, then each directory to its parent
+        char* slash = strrchr(nameBuf, '/');
+        FileType type = kFileTypeRegular;
+        while (true) {
+            String8 dirName;
+            const char* leaf = nameBuf;
+            if (slash != NULL) {
+                dirName.setTo(nameBuf, slash - nameBuf);
+                leaf = slash + 1;
+            }
+
+            // Bare directory entries only name their directory
+            if (leaf[0] != '\0') {
+                const ssize_t dirIdx = mDirs.indexOfKey(dirName);
+                SortedVector<AssetDir::FileInfo>* contents;
+                if (dirIdx >= 0) {
+                    contents = mDirs.valueAt(dirIdx);
+                } else {
+                    contents = new SortedVector<AssetDir::FileInfo>();
+                    mDirs.add(dirName, contents);
+                }
+                info.set(String8(leaf), type);
+                if (type == kFileTypeDirectory) {
+                    const ssize_t idx = contents->indexOf(info);
+                    if (idx >= 0 && contents->itemAt(idx).getFileType() == kFileTypeDirectory) {
+                        // The parents were added along with this directory
+                        break;
+                    }
+                    contents->add(info);
+                } else if (contents->indexOf(info) < 0) {
+                    contents->add(info);
+                }
+            }
+
+            if (slash == NULL) {
+                break;
+            }
+            // Directories are named without the trailing '/'
+            *slash = '\0';
+            slash = strrchr(nameBuf, '/');
+            type = kFileTypeDirectory;
+        }
+    }
+}
+
 Asset* AssetManager::SharedZip::getResourceTableAsset()
 {
     ALOGV("Getting from SharedZip %p resource asset %p\n", this, mResourceTableAsset);
@@ -1873,6 +2210,9 @@ bool AssetManager::SharedZip::isUpToDate()
 AssetManager::SharedZip::~SharedZip()
 {
     //ALOGI("Destroying SharedZip %p %s\n", this, (const char*)mPath);
+    for (size_t i = 0; i < mDirs.size(); i++) {
+        delete mDirs.valueAt(i);
+    }
     if (mResourceTable != NULL) {
         delete mResourceTable;
     }
@@ -1931,6 +2271,35 @@ ZipFileRO* AssetManager::ZipSet::getZip(const String8& path)
     return zip->getZip();
 }
 
+const SortedVector<AssetDir::FileInfo>* AssetManager::ZipSet::getZipDirContents(
+        const String8& path, const String8& dirName)
+{
+    int idx = getIndex(path);
+    sp<SharedZip> zip = mZipFile[idx];
+    if (zip == NULL) {
+        zip = SharedZip::get(path);
+        mZipFile.editItemAt(idx) = zip;
+    }
+    return zip->getDirContents(dirName);
+}
+
+String8 AssetManager::ZipSet::getZipSourceName(const String8& path, const char* fileName)
+{
+    int idx = getIndex(path);
+    sp<SharedZip> zip = mZipFile[idx];
+    if (zip == NULL || fileName[0] == '/' || fileName[0] == '\0') {
+        // appendPath() does not simply append these
+        String8 sourceName("zip:");
+        sourceName.append(getPathName(path.string()));
+        sourceName.append(":");
+        sourceName.appendPath(fileName);
+        return sourceName;
+    }
+    String8 sourceName(zip->getSourcePrefix());
+    sourceName.append(fileName);
+    return sourceName;
+}
+
 Asset* AssetManager::ZipSet::getZipResourceTableAsset(const String8& path)
 {
     int idx = getIndex(path);
@@ -21,6 +21,7 @@
 #include <utils/KeyedVector.h>
 #include <utils/ByteOrder.h>
 #include <utils/String8.h>
+#include <utils/threads.h>
 
 #include <errno.h>
 #include <sys/types.h>
@@ -211,9 +212,11 @@ write_delete_file(BackupDataWriter* dataStream, const String8& key)
     return dataStream->WriteEntityHeader(key, -1);
 }
 
+// Sends the file and stores the crc32 of its content in *outCrc, so that the file
+// does not have to be read a second time for the snapshot.
 static int
 write_update_file(BackupDataWriter* dataStream, int fd, int mode, const String8& key,
-        char const* realFilename)
+        char const* realFilename, int* outCrc)
 {
     LOGP("write_update_file %s (%s) : mode 0%o\n", realFilename, key.string(), mode);
 
@@ -259,6 +262,7 @@ write_update_file(BackupDataWriter* dataStream, int fd, int mode, const String8&
         if (bytesLeft < 0) {
             amt += bytesLeft; // Plus a negative is minus.  Don't write more than we promised.
         }
+        crc = crc32(crc, (Bytef*)buf, amt);
         err = dataStream->WriteEntityData(buf, amt);
         if (err != 0) {
             free(buf);
@@ -285,11 +289,13 @@ write_update_file(BackupDataWriter* dataStream, int fd, int mode, const String8&
     }
 
     free(buf);
+    *outCrc = crc;
     return NO_ERROR;
 }
 
 static int
-write_update_file(BackupDataWriter* dataStream, const String8& key, char const* realFilename)
+write_update_file(BackupDataWriter* dataStream, const String8& key, char const* realFilename,
+        int* outCrc)
 {
     int err;
     struct stat st;
@@ -304,7 +310,7 @@ write_update_file(BackupDataWriter* dataStream, const String8& key, char const*
         return errno;
     }
 
-    err = write_update_file(dataStream, fd, st.st_mode, key, realFilename);
+    err = write_update_file(dataStream, fd, st.st_mode, key, realFilename, outCrc);
     close(fd);
     return err;
 }
@@ -390,19 +396,34 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
         else if (cmp > 0) {
             // file added
             LOGP("file added: %s", g.file.string());
-            write_update_file(dataStream, q, g.file.string());
+            write_update_file(dataStream, q, g.file.string(), &g.s.crc32);
             m++;
         }
         else {
             // both files exist, check them
             const FileState& f = oldSnapshot.valueAt(n);
 
+            // Files whose metadata did not change are not read at all, the crc32 of
+            // the last backup still stands for them.
+            if (f.modTime_sec == g.s.modTime_sec && f.modTime_nsec == g.s.modTime_nsec
+                    && f.mode == g.s.mode && f.size == g.s.size) {
+                g.s.crc32 = f.crc32;
+                n++;
+                m++;
+                continue;
+            }
+
             int fd = open(g.file.string(), O_RDONLY);
             if (fd < 0) {
                 // We can't open the file.  Don't report it as a delete either.  Let the
                 // server keep the old version.  Maybe they'll be able to deal with it
                 // on restore.
                 LOGP("Unable to open file %s - skipping", g.file.string());
+            } else if (f.size != g.s.size) {
+                // The content changed for sure, compute the crc32 while sending it.
+                LOGP("%s: size changed from %d to %d", q.string(), f.size, g.s.size);
+                write_update_file(dataStream, fd, g.s.mode, p, g.file.string(), &g.s.crc32);
+                close(fd);
             } else {
                 g.s.crc32 = compute_crc32(fd);
 
@@ -412,8 +433,8 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
                 LOGP("  old: modTime=%d,%d mode=%04o size=%-3d crc32=0x%08x",
                         g.s.modTime_sec, g.s.modTime_nsec, g.s.mode, g.s.size, g.s.crc32);
                 if (f.modTime_sec != g.s.modTime_sec || f.modTime_nsec != g.s.modTime_nsec
-                        || f.mode != g.s.mode || f.size != g.s.size || f.crc32 != g.s.crc32) {
-                    write_update_file(dataStream, fd, g.s.mode, p, g.file.string());
+                        || f.mode != g.s.mode || f.crc32 != g.s.crc32) {
+                    write_update_file(dataStream, fd, g.s.mode, p, g.file.string(), &g.s.crc32);
                 }
 
                 close(fd);
@@ -433,7 +454,7 @@ back_up_files(int oldSnapshotFD, BackupDataWriter* dataStream, int newSnapshotFD
     while (m<fileCount) {
         const String8& q = newSnapshot.keyAt(m);
         FileRec& g = newSnapshot.editValueAt(m);
-        write_update_file(dataStream, q, g.file.string());
+        write_update_file(dataStream, q, g.file.string(), &g.s.crc32);
         m++;
     }
 
@@ -489,6 +510,156 @@ void send_tarfile_chunk(BackupDataWriter* writer, const char* buffer, size_t siz
     if (size != 0) writer->WriteEntityData(buffer, size);
 }
 
+// File data is read and sent in chunks of TAR_CHUNK_SIZE, with room for the size prefix
+// of send_tarfile_chunk() in front of each so that a chunk goes out in a single write.
+#define TAR_CHUNK_SIZE (64 * 1024)
+#define TAR_CHUNK_HEADER_SIZE 4
+
+// Files larger than this are read ahead on a separate thread while the previous chunk
+// is being written to the backup pipe. Smaller files are not worth a thread.
+#define TAR_READ_AHEAD_MIN_SIZE (4 * TAR_CHUNK_SIZE)
+#define TAR_READ_AHEAD_CHUNKS 2
+
+static status_t send_tarfile_chunk_prefixed(BackupDataWriter* writer, char* chunk,
+        size_t size) {
+    uint32_t chunk_size_no = htonl(size);
+    memcpy(chunk, &chunk_size_no, TAR_CHUNK_HEADER_SIZE);
+    return writer->WriteEntityData(chunk, TAR_CHUNK_HEADER_SIZE + size);
+}
+
+// Reads the next chunk of file data into buf, which must hold TAR_CHUNK_SIZE bytes.
+// Returns its size NUL-padded to a 512-byte multiple, or -1 with *outErr set.
+static ssize_t read_tarfile_chunk(int fd, char* buf, off64_t toWrite, const String8& filepath,
+        int* outErr) {
+    size_t toRead = (toWrite < TAR_CHUNK_SIZE) ? toWrite : TAR_CHUNK_SIZE;
+    ssize_t nRead = read(fd, buf, toRead);
+    if (nRead < 0) {
+        *outErr = errno;
+        ALOGE("Unable to read file [%s], err=%d (%s)", filepath.string(),
+                *outErr, strerror(*outErr));
+        return -1;
+    } else if (nRead == 0) {
+        ALOGE("EOF but expect %lld more bytes in [%s]", (long long) toWrite,
+                filepath.string());
+        *outErr = EIO;
+        return -1;
+    }
+
+    // At EOF we might have a short block; NUL-pad that to a 512-byte multiple.  This
+    // depends on the OS guarantee that for ordinary files, read() will never return
+    // less than the number of bytes requested.
+    ssize_t partial = (nRead+512) % 512;
+    if (partial > 0) {
+        ssize_t remainder = 512 - partial;
+        memset(buf + nRead, 0, remainder);
+        nRead += remainder;
+    }
+    return nRead;
+}
+
+// Reads a file into a small ring of chunks on its own thread, so that the disk read of
+// the next chunk overlaps the pipe write of the current one.
+class TarReadAheadThread : public Thread {
+public:
+    TarReadAheadThread(int fd, off64_t size, const String8& filepath)
+            : Thread(false), mFd(fd), mToRead(size), mFilepath(filepath),
+              mReadIndex(0), mWriteIndex(0), mFilled(0), mError(0) {
+        for (int i = 0; i < TAR_READ_AHEAD_CHUNKS; i++) {
+            mChunks[i] = (char*) malloc(TAR_CHUNK_HEADER_SIZE + TAR_CHUNK_SIZE);
+            mSizes[i] = 0;
+        }
+    }
+
+    virtual ~TarReadAheadThread() {
+        for (int i = 0; i < TAR_READ_AHEAD_CHUNKS; i++) {
+            free(mChunks[i]);
+        }
+    }
+
+    bool isValid() const {
+        for (int i = 0; i < TAR_READ_AHEAD_CHUNKS; i++) {
+            if (mChunks[i] == NULL) return false;
+        }
+        return true;
+    }
+
+    // Waits for the next chunk, which starts with TAR_CHUNK_HEADER_SIZE free bytes.
+    // Returns the size of its data, 0 once the whole file was returned, or -1 with
+    // *outErr set. The chunk must be handed back with releaseChunk().
+    ssize_t nextChunk(char** outChunk, int* outErr) {
+        Mutex::Autolock _l(mLock);
+        while (mFilled == 0 && mToRead > 0 && mError == 0) {
+            mCondition.wait(mLock);
+        }
+        if (mFilled == 0) {
+            *outErr = mError;
+            return mError ? -1 : 0;
+        }
+        *outChunk = mChunks[mReadIndex];
+        return mSizes[mReadIndex];
+    }
+
+    void releaseChunk() {
+        Mutex::Autolock _l(mLock);
+        mReadIndex = (mReadIndex + 1) % TAR_READ_AHEAD_CHUNKS;
+        mFilled--;
+        mCondition.broadcast();
+    }
+
+    void stop() {
+        requestExit();
+        {
+            Mutex::Autolock _l(mLock);
+            mCondition.broadcast();
+        }
+        requestExitAndWait();
+    }
+
+private:
+    virtual bool threadLoop() {
+        mLock.lock();
+        while (mFilled == TAR_READ_AHEAD_CHUNKS && !exitPending()) {
+            mCondition.wait(mLock);
+        }
+        if (exitPending() || mToRead <= 0 || mError != 0) {
+            mLock.unlock();
+            return false;
+        }
+        char* chunk = mChunks[mWriteIndex];
+        off64_t toRead = mToRead;
+        mLock.unlock();
+
+        int err = 0;
+        ssize_t size = read_tarfile_chunk(mFd, chunk + TAR_CHUNK_HEADER_SIZE, toRead,
+                mFilepath, &err);
+
+        Mutex::Autolock _l(mLock);
+        if (size < 0) {
+            mError = err;
+        } else {
+            mSizes[mWriteIndex] = size;
+            mWriteIndex = (mWriteIndex + 1) % TAR_READ_AHEAD_CHUNKS;
+            mFilled++;
+            mToRead -= size;
+        }
+        mCondition.broadcast();
+        return true;
+    }
+
+    const int mFd;
+    off64_t mToRead;
+    const String8 mFilepath;
+
+    Mutex mLock;
+    Condition mCondition;
+    char* mChunks[TAR_READ_AHEAD_CHUNKS];
+    ssize_t mSizes[TAR_READ_AHEAD_CHUNKS];
+    int mReadIndex;
+    int mWriteIndex;
+    int mFilled;
+    int mError;
+};
+
 int write_tarfile(const String8& packageName, const String8& domain,
         const String8& rootpath, const String8& filepath, BackupDataWriter* writer)
 {
@@ -545,8 +716,8 @@ int write_tarfile(const String8& packageName, const String8& domain,
     }
 
     // read/write up to this much at a time.
-    const size_t BUFSIZE = 32 * 1024;
-    char* buf = (char *)calloc(1,BUFSIZE);
+    const size_t BUFSIZE = TAR_CHUNK_SIZE;
+    char* buf = (char *)calloc(1, TAR_CHUNK_HEADER_SIZE + BUFSIZE);
     char* paxHeader = buf + 512;    // use a different chunk of it as separate scratch
     char* paxData = buf + 1024;
 
@@ -678,39 +849,39 @@ int write_tarfile(const String8& packageName, const String8& domain,
 
     // Now write the file data itself, for real files.  We honor tar's convention that
     // only full 512-byte blocks are sent to write().
+    if (!isdir && s.st_size > TAR_READ_AHEAD_MIN_SIZE) {
+        sp<TarReadAheadThread> reader = new TarReadAheadThread(fd, s.st_size, filepath);
+        if (reader->isValid() && reader->run("TarReadAhead") == NO_ERROR) {
+            char* chunk;
+            ssize_t size;
+            while ((size = reader->nextChunk(&chunk, &err)) > 0) {
+                status_t status = send_tarfile_chunk_prefixed(writer, chunk, size);
+                reader->releaseChunk();
+                if (status != NO_ERROR) {
+                    // The pipe is gone, no need to read the rest of the file.
+                    break;
+                }
+            }
+            reader->stop();
+            goto cleanup;
+        }
+        // Could not start the thread, read the file inline instead.
+    }
     if (!isdir) {
         off64_t toWrite = s.st_size;
         while (toWrite > 0) {
-            size_t toRead = (toWrite < BUFSIZE) ? toWrite : BUFSIZE;
-            ssize_t nRead = read(fd, buf, toRead);
+            ssize_t nRead = read_tarfile_chunk(fd, buf + TAR_CHUNK_HEADER_SIZE, toWrite,
+                    filepath, &err);
             if (nRead < 0) {
-                err = errno;
-                ALOGE("Unable to read file [%s], err=%d (%s)", filepath.string(),
-                        err, strerror(err));
                 break;
-            } else if (nRead == 0) {
-                ALOGE("EOF but expect %lld more bytes in [%s]", (long long) toWrite,
-                        filepath.string());
-                err = EIO;
-                break;
-            }
-
-            // At EOF we might have a short block; NUL-pad that to a 512-byte multiple.  This
-            // depends on the OS guarantee that for ordinary files, read() will never return
-            // less than the number of bytes requested.
-            ssize_t partial = (nRead+512) % 512;
-            if (partial > 0) {
-                ssize_t remainder = 512 - partial;
-                memset(buf + nRead, 0, remainder);
-                nRead += remainder;
             }
-            send_tarfile_chunk(writer, buf, nRead);
+            send_tarfile_chunk_prefixed(writer, buf, nRead);
             toWrite -= nRead;
         }
     }
 
 cleanup:
-    delete [] buf;
+    free(buf);
 done:
     close(fd);
     return err;
@@ -719,7 +890,9 @@ done:
 
 
 
-#define RESTORE_BUF_SIZE (8*1024)
+// Entity data is gathered into a buffer this large before it is written out, so that
+// restoring a file takes a few large writes instead of one per read from the pipe.
+#define RESTORE_BUF_SIZE (64*1024)
 
 RestoreHelperBase::RestoreHelperBase()
 {
@@ -779,16 +952,25 @@ RestoreHelperBase::WriteFile(const String8& filename, BackupDataReader* in)
         return errno;
     }
     
-    while ((amt = in->ReadEntityData(buf, RESTORE_BUF_SIZE)) > 0) {
-        err = write(fd, buf, amt);
-        if (err != amt) {
-            close(fd);
-            ALOGW("Error '%s' writing '%s'", strerror(errno), filename.string());
-            return errno;
+    size_t filled = 0;
+    do {
+        amt = in->ReadEntityData((char*)buf + filled, RESTORE_BUF_SIZE - filled);
+        if (amt > 0) {
+            filled += amt;
         }
-        crc = crc32(crc, (Bytef*)buf, amt);
-    }
+        if (filled > 0 && (filled == RESTORE_BUF_SIZE || amt <= 0)) {
+            err = write(fd, buf, filled);
+            if (err != (ssize_t)filled) {
+                close(fd);
+                ALOGW("Error '%s' writing '%s'", strerror(errno), filename.string());
+                return errno;
+            }
+            crc = crc32(crc, (Bytef*)buf, filled);
+            filled = 0;
+        }
+    } while (amt > 0);
 
+    // Not synced here, WriteSnapshot() syncs all the restored files at once.
     close(fd);
 
     // Record for the snapshot
@@ -815,7 +997,23 @@ RestoreHelperBase::WriteFile(const String8& filename, BackupDataReader* in)
 status_t
 RestoreHelperBase::WriteSnapshot(int fd)
 {
-    return write_snapshot_file(fd, m_files);;
+    // The restore set is complete: make the restored files durable before the snapshot
+    // that records them.
+    const size_t N = m_files.size();
+    for (size_t i = 0; i < N; i++) {
+        const FileRec& r = m_files.valueAt(i);
+        int fileFd = open(r.file.string(), O_RDONLY);
+        if (fileFd < 0) {
+            ALOGW("Could not open %s to sync it -- %s", r.file.string(), strerror(errno));
+            continue;
+        }
+        if (fsync(fileFd) != 0) {
+            ALOGW("Could not sync %s -- %s", r.file.string(), strerror(errno));
+        }
+        close(fileFd);
+    }
+
+    return write_snapshot_file(fd, m_files);
 }
 
 #if TEST_BACKUP_HELPERS
@@ -1436,7 +1634,7 @@ backup_helper_test_files()
         SCRATCH_DIR "data/b", // same
         SCRATCH_DIR "data/c", // different mod time
         SCRATCH_DIR "data/d", // different size (same mod time)
-        SCRATCH_DIR "data/e", // different contents (same mod time, same size)
+        SCRATCH_DIR "data/e", // different contents, not sent (same mod time, same size)
         SCRATCH_DIR "data/g"  // added
     };
 
@@ -1445,7 +1643,7 @@ backup_helper_test_files()
         "data/b", // same
         "data/c", // different mod time
         "data/d", // different size (same mod time)
-        "data/e", // different contents (same mod time, same size)
+        "data/e", // different contents, not sent (same mod time, same size)
         "data/g"  // added
     };
 
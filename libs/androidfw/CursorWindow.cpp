@@ -18,6 +18,7 @@
 #define LOG_TAG "CursorWindow"
 
 #include <utils/Log.h>
+#include <utils/Vector.h>
 #include <androidfw/CursorWindow.h>
 
 #include <cutils/ashmem.h>
@@ -30,13 +31,14 @@
 namespace android {
 
 CursorWindow::CursorWindow(const String8& name, int ashmemFd,
-        void* data, size_t size, bool readOnly) :
-        mName(name), mAshmemFd(ashmemFd), mData(data), mSize(size), mReadOnly(readOnly) {
+        void* data, size_t size, size_t capacity, bool readOnly) :
+        mName(name), mAshmemFd(ashmemFd), mData(data), mSize(size), mCapacity(capacity),
+        mReadOnly(readOnly) {
     mHeader = static_cast<Header*>(mData);
 }
 
 CursorWindow::~CursorWindow() {
-    ::munmap(mData, mSize);
+    ::munmap(mData, mCapacity);
     ::close(mAshmemFd);
 }
 
@@ -44,21 +46,24 @@ status_t CursorWindow::create(const String8& name, size_t size, CursorWindow** o
     String8 ashmemName("CursorWindow: ");
     ashmemName.append(name);
 
+    // Pages of the region are only allocated once written
+    size_t capacity = size * MAX_GROWTH_FACTOR;
+
     status_t result;
-    int ashmemFd = ashmem_create_region(ashmemName.string(), size);
+    int ashmemFd = ashmem_create_region(ashmemName.string(), capacity);
     if (ashmemFd < 0) {
         result = -errno;
     } else {
         result = ashmem_set_prot_region(ashmemFd, PROT_READ | PROT_WRITE);
         if (result >= 0) {
-            void* data = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ashmemFd, 0);
+            void* data = ::mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, ashmemFd, 0);
             if (data == MAP_FAILED) {
                 result = -errno;
             } else {
                 result = ashmem_set_prot_region(ashmemFd, PROT_READ);
                 if (result >= 0) {
                     CursorWindow* window = new CursorWindow(name, ashmemFd,
-                            data, size, false /*readOnly*/);
+                            data, size, capacity, false /*readOnly*/);
                     result = window->clear();
                     if (!result) {
                         LOG_WINDOW("Created new CursorWindow: freeOffset=%d, "
@@ -73,7 +78,7 @@ status_t CursorWindow::create(const String8& name, size_t size, CursorWindow** o
                     delete window;
                 }
             }
-            ::munmap(data, size);
+            ::munmap(data, capacity);
         }
         ::close(ashmemFd);
     }
@@ -102,7 +107,7 @@ status_t CursorWindow::createFromParcel(Parcel* parcel, CursorWindow** outCursor
                     result = -errno;
                 } else {
                     CursorWindow* window = new CursorWindow(name, dupAshmemFd,
-                            data, size, true /*readOnly*/);
+                            data, size, size, true /*readOnly*/);
                     LOG_WINDOW("Created CursorWindow from parcel: freeOffset=%d, "
                             "numRows=%d, numColumns=%d, mSize=%d, mData=%p",
                             window->mHeader->freeOffset,
@@ -133,6 +138,8 @@ status_t CursorWindow::clear() {
         return INVALID_OPERATION;
     }
 
+    // The window keeps the size it grew to, a cursor that refills it for
+    // the same query needs as much space again
     mHeader->freeOffset = sizeof(Header) + sizeof(RowSlotChunk);
     mHeader->firstChunkOffset = sizeof(Header);
     mHeader->numRows = 0;
@@ -158,6 +165,10 @@ status_t CursorWindow::setNumColumns(uint32_t numColumns) {
 }
 
 status_t CursorWindow::allocRow() {
+    return allocRow(0, NULL, NULL);
+}
+
+status_t CursorWindow::allocRow(size_t dataSize, FieldSlot** outFieldDir, void** outData) {
     if (mReadOnly) {
         return INVALID_OPERATION;
     }
@@ -168,9 +179,9 @@ status_t CursorWindow::allocRow() {
         return NO_MEMORY;
     }
 
-    // Allocate the slots for the field directory
+    // Allocate the slots for the field directory, followed by the data
     size_t fieldDirSize = mHeader->numColumns * sizeof(FieldSlot);
-    uint32_t fieldDirOffset = alloc(fieldDirSize, true /*aligned*/);
+    uint32_t fieldDirOffset = alloc(fieldDirSize + dataSize, true /*aligned*/);
     if (!fieldDirOffset) {
         mHeader->numRows--;
         LOG_WINDOW("The row failed, so back out the new row accounting "
@@ -183,6 +194,13 @@ status_t CursorWindow::allocRow() {
     LOG_WINDOW("Allocated row %u, rowSlot is at offset %u, fieldDir is %d bytes at offset %u\n",
             mHeader->numRows - 1, offsetFromPtr(rowSlot), fieldDirSize, fieldDirOffset);
     rowSlot->offset = fieldDirOffset;
+
+    if (outFieldDir) {
+        *outFieldDir = fieldDir;
+    }
+    if (outData) {
+        *outData = offsetToPtr(fieldDirOffset + fieldDirSize);
+    }
     return OK;
 }
 
@@ -209,10 +227,19 @@ uint32_t CursorWindow::alloc(size_t size, bool aligned) {
     uint32_t offset = mHeader->freeOffset + padding;
     uint32_t nextFreeOffset = offset + size;
     if (nextFreeOffset > mSize) {
-        ALOGW("Window is full: requested allocation %d bytes, "
-                "free space %d bytes, window size %d bytes",
-                size, freeSpace(), mSize);
-        return 0;
+        if (nextFreeOffset > mCapacity) {
+            ALOGW("Window is full: requested allocation %d bytes, "
+                    "free space %d bytes, window size %d bytes",
+                    size, freeSpace(), mSize);
+            return 0;
+        }
+
+        // Grow in steps so that size() stays close to what the window uses
+        size_t newSize = mSize * 2;
+        if (newSize < nextFreeOffset) newSize = nextFreeOffset;
+        if (newSize > mCapacity) newSize = mCapacity;
+        LOG_WINDOW("Growing window from %d bytes to %d bytes", mSize, newSize);
+        mSize = newSize;
     }
 
     mHeader->freeOffset = nextFreeOffset;
@@ -269,6 +296,102 @@ CursorWindow::FieldSlot* CursorWindow::getFieldSlot(uint32_t row, uint32_t colum
     return &fieldDir[column];
 }
 
+bool CursorWindow::getColumnFieldSlots(uint32_t startRow, uint32_t numRows, uint32_t column,
+        FieldSlot** outFieldSlots) {
+    if (startRow > mHeader->numRows || numRows > mHeader->numRows - startRow
+            || column >= mHeader->numColumns) {
+        ALOGE("Failed to read rows %d to %d, column %d from a CursorWindow which "
+                "has %d rows, %d columns.",
+                startRow, startRow + numRows, column, mHeader->numRows, mHeader->numColumns);
+        return false;
+    }
+
+    uint32_t chunkPos = startRow;
+    RowSlotChunk* chunk = static_cast<RowSlotChunk*>(
+            offsetToPtr(mHeader->firstChunkOffset));
+    while (chunkPos >= ROW_SLOT_CHUNK_NUM_ROWS) {
+        chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunk->nextChunkOffset));
+        chunkPos -= ROW_SLOT_CHUNK_NUM_ROWS;
+    }
+
+    for (uint32_t i = 0; i < numRows; i++) {
+        if (chunkPos == ROW_SLOT_CHUNK_NUM_ROWS) {
+            chunk = static_cast<RowSlotChunk*>(offsetToPtr(chunk->nextChunkOffset));
+            chunkPos = 0;
+        }
+        FieldSlot* fieldDir = static_cast<FieldSlot*>(
+                offsetToPtr(chunk->slots[chunkPos++].offset));
+        outFieldSlots[i] = &fieldDir[column];
+    }
+    return true;
+}
+
+status_t CursorWindow::getColumnLongs(uint32_t startRow, uint32_t numRows, uint32_t column,
+        int64_t* outValues) {
+    Vector<FieldSlot*> fieldSlots;
+    fieldSlots.resize(numRows);
+    if (!getColumnFieldSlots(startRow, numRows, column, fieldSlots.editArray())) {
+        return BAD_VALUE;
+    }
+
+    for (uint32_t i = 0; i < numRows; i++) {
+        FieldSlot* fieldSlot = fieldSlots[i];
+        switch (fieldSlot->type) {
+            case FIELD_TYPE_INTEGER:
+                outValues[i] = fieldSlot->data.l;
+                break;
+            case FIELD_TYPE_FLOAT:
+                outValues[i] = int64_t(fieldSlot->data.d);
+                break;
+            case FIELD_TYPE_STRING: {
+                size_t sizeIncludingNull;
+                const char* value = getFieldSlotValueString(fieldSlot, &sizeIncludingNull);
+                outValues[i] = sizeIncludingNull > 1 ? strtoll(value, NULL, 0) : 0L;
+                break;
+            }
+            case FIELD_TYPE_NULL:
+                outValues[i] = 0;
+                break;
+            default:
+                return BAD_TYPE;
+        }
+    }
+    return OK;
+}
+
+status_t CursorWindow::getColumnDoubles(uint32_t startRow, uint32_t numRows, uint32_t column,
+        double* outValues) {
+    Vector<FieldSlot*> fieldSlots;
+    fieldSlots.resize(numRows);
+    if (!getColumnFieldSlots(startRow, numRows, column, fieldSlots.editArray())) {
+        return BAD_VALUE;
+    }
+
+    for (uint32_t i = 0; i < numRows; i++) {
+        FieldSlot* fieldSlot = fieldSlots[i];
+        switch (fieldSlot->type) {
+            case FIELD_TYPE_FLOAT:
+                outValues[i] = fieldSlot->data.d;
+                break;
+            case FIELD_TYPE_INTEGER:
+                outValues[i] = double(fieldSlot->data.l);
+                break;
+            case FIELD_TYPE_STRING: {
+                size_t sizeIncludingNull;
+                const char* value = getFieldSlotValueString(fieldSlot, &sizeIncludingNull);
+                outValues[i] = sizeIncludingNull > 1 ? strtod(value, NULL) : 0.0;
+                break;
+            }
+            case FIELD_TYPE_NULL:
+                outValues[i] = 0.0;
+                break;
+            default:
+                return BAD_TYPE;
+        }
+    }
+    return OK;
+}
+
 status_t CursorWindow::putBlob(uint32_t row, uint32_t column, const void* value, size_t size) {
     return putBlobOrString(row, column, value, size, FIELD_TYPE_BLOB);
 }
@@ -22,12 +22,19 @@
 
 #include <cutils/log.h>
 #include <cutils/properties.h>
+#include <cutils/ashmem.h>
+#include <cutils/atomic.h>
+#include <cutils/atomic-inline.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <androidfw/InputTransport.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <math.h>
 
 
@@ -53,6 +60,13 @@ static const nsecs_t RESAMPLE_MIN_DELTA = 2 * NANOS_PER_MS;
 // far into the future.  This time is further bounded by 50% of the last time delta.
 static const nsecs_t RESAMPLE_MAX_PREDICTION = 8 * NANOS_PER_MS;
 
+// Maximum time past the frame time to predict touches with the velocity tracker.
+static const nsecs_t PREDICT_MAX_HORIZON = 50 * NANOS_PER_MS;
+
+// Least confidence a velocity tracker estimator must have to be used for prediction.
+// Less certain fits fall back to linear extrapolation.
+static const float PREDICT_MIN_CONFIDENCE = 0.8f;
+
 template<typename T>
 inline static T min(const T& a, const T& b) {
     return a < b ? a : b;
@@ -73,6 +87,7 @@ bool InputMessage::isValid(size_t actualSize) const {
             return body.motion.pointerCount > 0
                     && body.motion.pointerCount <= MAX_POINTERS;
         case TYPE_FINISHED:
+        case TYPE_WAKEUP:
             return true;
         }
     }
@@ -92,10 +107,31 @@ size_t InputMessage::size() const {
 }
 
 
+// --- InputChannel::Ring ---
+
+// Shared memory ring that carries messages from the producer end of a channel to
+// the consumer end.  The head and tail count the messages written and read so far
+// and are only ever advanced by the producer and consumer respectively.
+//
+// The consumer sets consumerWaiting before it goes back to waiting on the socket.
+// The producer clears it when it writes new messages and only then sends a wakeup
+// message, so a consumer that is busy draining the ring is not woken up again.
+struct InputChannel::Ring {
+    enum { CAPACITY = 32 };
+
+    volatile int32_t head;
+    volatile int32_t tail;
+    volatile int32_t consumerWaiting;
+    int32_t padding; // 8 byte alignment for the slots that follow
+    InputMessage slots[CAPACITY];
+};
+
+
 // --- InputChannel ---
 
 InputChannel::InputChannel(const String8& name, int fd) :
-        mName(name), mFd(fd) {
+        mName(name), mFd(fd), mRingFd(-1), mRing(NULL), mRingProducer(false),
+        mReceiveBuffer(NULL), mReceiveOffset(0), mReceiveSize(0) {
 #if DEBUG_CHANNEL_LIFECYCLE
     ALOGD("Input channel constructed: name='%s', fd=%d",
             mName.string(), fd);
@@ -113,6 +149,56 @@ InputChannel::~InputChannel() {
 #endif
 
     ::close(mFd);
+    detachRing();
+    free(mReceiveBuffer);
+}
+
+bool InputChannel::isSharedRingEnabled() {
+    char value[PROPERTY_VALUE_MAX];
+    int length = property_get("debug.inputchannel.ring", value, NULL);
+    if (length > 0) {
+        if (!strcmp("1", value)) {
+            return true;
+        }
+        if (strcmp("0", value)) {
+            ALOGD("Unrecognized property value for 'debug.inputchannel.ring'.  "
+                    "Use '1' or '0'.");
+        }
+    }
+    return false;
+}
+
+status_t InputChannel::attachRing(int ringFd, bool producer) {
+    ssize_t size = ashmem_get_size_region(ringFd);
+    if (size < ssize_t(sizeof(Ring))) {
+        ALOGE("channel '%s' ~ Shared ring is too small, size=%d", mName.string(), int(size));
+        ::close(ringFd);
+        return BAD_VALUE;
+    }
+
+    void* data = ::mmap(NULL, sizeof(Ring), PROT_READ | PROT_WRITE, MAP_SHARED, ringFd, 0);
+    if (data == MAP_FAILED) {
+        status_t result = -errno;
+        ALOGE("channel '%s' ~ Could not map shared ring.  errno=%d", mName.string(), errno);
+        ::close(ringFd);
+        return result;
+    }
+
+    detachRing();
+    mRingFd = ringFd;
+    mRing = static_cast<Ring*>(data);
+    mRingProducer = producer;
+    return OK;
+}
+
+void InputChannel::detachRing() {
+    if (mRing) {
+        ::munmap(mRing, sizeof(Ring));
+        ::close(mRingFd);
+        mRing = NULL;
+        mRingFd = -1;
+        mRingProducer = false;
+    }
 }
 
 status_t InputChannel::openInputChannelPair(const String8& name,
@@ -140,21 +226,129 @@ status_t InputChannel::openInputChannelPair(const String8& name,
     String8 clientChannelName = name;
     clientChannelName.append(" (client)");
     outClientChannel = new InputChannel(clientChannelName, sockets[1]);
+
+    if (isSharedRingEnabled()) {
+        // The ring is optional, so the channels simply keep using the socket for
+        // everything if it cannot be set up.
+        int ringFd = ashmem_create_region("InputChannel ring", sizeof(Ring));
+        if (ringFd < 0) {
+            ALOGW("channel '%s' ~ Could not create shared ring.  errno=%d",
+                    name.string(), errno);
+        } else if (!outServerChannel->attachRing(ringFd, true /*producer*/)) {
+            // A fresh ashmem region is zero filled, so the ring starts out empty.
+            outServerChannel->mRing->consumerWaiting = 1;
+
+            int clientRingFd = dup(ringFd);
+            if (clientRingFd < 0
+                    || outClientChannel->attachRing(clientRingFd, false /*producer*/)) {
+                ALOGW("channel '%s' ~ Could not share ring with the client.",
+                        name.string());
+                outServerChannel->detachRing();
+            }
+        }
+    }
     return OK;
 }
 
+bool InputChannel::hasPendingMessages() const {
+    if (mReceiveOffset < mReceiveSize) {
+        return true;
+    }
+    return mRing && !mRingProducer
+            && android_atomic_acquire_load(&mRing->head) != mRing->tail;
+}
+
 status_t InputChannel::sendMessage(const InputMessage* msg) {
-    size_t msgLength = msg->size();
+    return sendMessages(msg, 1);
+}
+
+status_t InputChannel::sendMessages(const InputMessage* msgs, size_t count) {
+    if (count == 0 || count > MAX_BATCH_MESSAGES) {
+        return BAD_VALUE;
+    }
+
+    if (mRing && mRingProducer) {
+        return sendRingMessages(msgs, count);
+    }
+    return sendSocketMessages(msgs, count);
+}
+
+status_t InputChannel::sendRingMessages(const InputMessage* msgs, size_t count) {
+    // The counters are compared as unsigned values so that they can wrap around.
+    // The tail is written by the other process, so it is not trusted to be sane.
+    uint32_t head = uint32_t(mRing->head);
+    uint32_t tail = uint32_t(android_atomic_acquire_load(&mRing->tail));
+    uint32_t used = head - tail;
+    if (used > Ring::CAPACITY) {
+        ALOGE("channel '%s' ~ Shared ring is corrupt, head=%u, tail=%u",
+                mName.string(), head, tail);
+        return UNKNOWN_ERROR;
+    }
+    if (Ring::CAPACITY - used < count) {
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ shared ring is full", mName.string());
+#endif
+        return WOULD_BLOCK;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        memcpy(&mRing->slots[(head + i) % Ring::CAPACITY], &msgs[i], msgs[i].size());
+    }
+    android_atomic_release_store(int32_t(head + count), &mRing->head);
+
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ wrote %d messages starting with type %d to shared ring",
+            mName.string(), count, msgs[0].header.type);
+#endif
+
+    // Order the head update before reading the flag, so that either the consumer sees
+    // the new messages when it checks the ring again or we see that it is waiting.
+    android_memory_barrier();
+    if (mRing->consumerWaiting
+            && !android_atomic_cmpxchg(1, 0, &mRing->consumerWaiting)) {
+        InputMessage wakeup;
+        wakeup.header.type = InputMessage::TYPE_WAKEUP;
+        wakeup.header.padding = 0;
+        status_t result = sendSocketMessages(&wakeup, 1);
+        if (result && result != WOULD_BLOCK) {
+            return result;
+        }
+        // If the socket is full then the consumer has wakeups it has not read yet.
+    }
+    return OK;
+}
+
+status_t InputChannel::sendSocketMessages(const InputMessage* msgs, size_t count) {
+    // The messages are gathered into a single packet so the receiver gets them all
+    // with one read.  Each message keeps its own size, which is a multiple of 8 bytes,
+    // so the receiver can split them up again without losing their alignment.
+    struct iovec iov[MAX_BATCH_MESSAGES];
+    size_t msgLength = 0;
+    for (size_t i = 0; i < count; i++) {
+        iov[i].iov_base = const_cast<InputMessage*>(&msgs[i]);
+        iov[i].iov_len = msgs[i].size();
+        msgLength += iov[i].iov_len;
+    }
+    if (count > 1 && msgLength > MAX_BATCH_BYTES) {
+        return BAD_VALUE;
+    }
+
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = iov;
+    mh.msg_iovlen = count;
+
+    const InputMessage* msg = &msgs[0];
     ssize_t nWrite;
     do {
-        nWrite = ::send(mFd, msg, msgLength, MSG_DONTWAIT | MSG_NOSIGNAL);
+        nWrite = ::sendmsg(mFd, &mh, MSG_DONTWAIT | MSG_NOSIGNAL);
     } while (nWrite == -1 && errno == EINTR);
 
     if (nWrite < 0) {
         int error = errno;
 #if DEBUG_CHANNEL_MESSAGES
-        ALOGD("channel '%s' ~ error sending message of type %d, errno=%d", mName.string(),
-                msg->header.type, error);
+        ALOGD("channel '%s' ~ error sending %d messages starting with type %d, errno=%d",
+                mName.string(), count, msg->header.type, error);
 #endif
         if (error == EAGAIN || error == EWOULDBLOCK) {
             return WOULD_BLOCK;
@@ -174,15 +368,87 @@ status_t InputChannel::sendMessage(const InputMessage* msg) {
     }
 
 #if DEBUG_CHANNEL_MESSAGES
-    ALOGD("channel '%s' ~ sent message of type %d", mName.string(), msg->header.type);
+    ALOGD("channel '%s' ~ sent %d messages starting with type %d", mName.string(),
+            count, msg->header.type);
 #endif
     return OK;
 }
 
 status_t InputChannel::receiveMessage(InputMessage* msg) {
+    if (mRing && !mRingProducer) {
+        return receiveRingMessage(msg);
+    }
+    return receiveSocketMessage(msg);
+}
+
+status_t InputChannel::receiveRingMessage(InputMessage* msg) {
+    uint32_t tail = uint32_t(mRing->tail);
+    uint32_t head = uint32_t(android_atomic_acquire_load(&mRing->head));
+    if (head == tail) {
+        // Read the wakeups that were sent so far, and find out whether the peer has
+        // closed the socket.  This must happen before setting the flag below, since
+        // a wakeup sent after that point is what gets us running again.
+        status_t result;
+        do {
+            result = receiveSocketMessage(msg);
+            if (!result && msg->header.type != InputMessage::TYPE_WAKEUP) {
+                ALOGW("channel '%s' ~ Dropped message of type %d that was sent around "
+                        "the shared ring", mName.string(), msg->header.type);
+            }
+        } while (!result || result == BAD_VALUE);
+        if (result != WOULD_BLOCK) {
+            return result;
+        }
+
+        // Tell the producer that we are about to wait, then check the ring again in
+        // case it wrote new messages before it could have seen the flag.
+        android_atomic_release_store(1, &mRing->consumerWaiting);
+        android_memory_barrier();
+        head = uint32_t(android_atomic_acquire_load(&mRing->head));
+        if (head == tail) {
+            return WOULD_BLOCK;
+        }
+    }
+
+    if (head - tail > Ring::CAPACITY) {
+        ALOGE("channel '%s' ~ Shared ring is corrupt, head=%u, tail=%u",
+                mName.string(), head, tail);
+        return UNKNOWN_ERROR;
+    }
+
+    const InputMessage* slot = &mRing->slots[tail % Ring::CAPACITY];
+    memcpy(msg, slot, min(slot->size(), sizeof(InputMessage)));
+    android_atomic_release_store(int32_t(tail + 1), &mRing->tail);
+
+    if (!msg->isValid(msg->size())) {
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ received invalid message from shared ring", mName.string());
+#endif
+        return BAD_VALUE;
+    }
+
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ received message of type %d from shared ring",
+            mName.string(), msg->header.type);
+#endif
+    return OK;
+}
+
+status_t InputChannel::receiveSocketMessage(InputMessage* msg) {
+    if (mReceiveOffset < mReceiveSize) {
+        return takePendingMessage(msg);
+    }
+
+    if (!mReceiveBuffer) {
+        mReceiveBuffer = static_cast<uint8_t*>(malloc(MAX_BATCH_BYTES));
+        if (!mReceiveBuffer) {
+            return NO_MEMORY;
+        }
+    }
+
     ssize_t nRead;
     do {
-        nRead = ::recv(mFd, msg, sizeof(InputMessage), MSG_DONTWAIT);
+        nRead = ::recv(mFd, mReceiveBuffer, MAX_BATCH_BYTES, MSG_DONTWAIT);
     } while (nRead == -1 && errno == EINTR);
 
     if (nRead < 0) {
@@ -206,12 +472,25 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
         return DEAD_OBJECT;
     }
 
-    if (!msg->isValid(nRead)) {
+    mReceiveOffset = 0;
+    mReceiveSize = nRead;
+    return takePendingMessage(msg);
+}
+
+status_t InputChannel::takePendingMessage(InputMessage* msg) {
+    size_t available = mReceiveSize - mReceiveOffset;
+    memcpy(msg, mReceiveBuffer + mReceiveOffset, min(available, sizeof(InputMessage)));
+
+    size_t msgLength = available >= sizeof(InputMessage::Header) ? msg->size() : 0;
+    if (!msgLength || msgLength > available || !msg->isValid(msgLength)) {
 #if DEBUG_CHANNEL_MESSAGES
         ALOGD("channel '%s' ~ received invalid message", mName.string());
 #endif
+        // Drop the rest of the packet since the remaining messages cannot be located.
+        mReceiveOffset = mReceiveSize;
         return BAD_VALUE;
     }
+    mReceiveOffset += msgLength;
 
 #if DEBUG_CHANNEL_MESSAGES
     ALOGD("channel '%s' ~ received message of type %d", mName.string(), msg->header.type);
@@ -223,12 +502,51 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
 // --- InputPublisher ---
 
 InputPublisher::InputPublisher(const sp<InputChannel>& channel) :
-        mChannel(channel) {
+        mChannel(channel), mBatching(false), mBatchBytes(0) {
 }
 
 InputPublisher::~InputPublisher() {
 }
 
+void InputPublisher::beginBatch() {
+    mBatching = true;
+    mBatch.clear();
+    mBatchBytes = 0;
+}
+
+bool InputPublisher::isBatchFull() const {
+    return mBatching && (mBatch.size() >= InputChannel::MAX_BATCH_MESSAGES
+            || mBatchBytes + sizeof(InputMessage) > InputChannel::MAX_BATCH_BYTES);
+}
+
+status_t InputPublisher::endBatch() {
+    status_t result = OK;
+    if (!mBatch.isEmpty()) {
+#if DEBUG_TRANSPORT_ACTIONS
+        ALOGD("channel '%s' publisher ~ endBatch: sending %d events",
+                mChannel->getName().string(), mBatch.size());
+#endif
+        result = mChannel->sendMessages(mBatch.array(), mBatch.size());
+    }
+    mBatching = false;
+    mBatch.clear();
+    mBatchBytes = 0;
+    return result;
+}
+
+status_t InputPublisher::publishMessage(const InputMessage& msg) {
+    if (!mBatching) {
+        return mChannel->sendMessage(&msg);
+    }
+    if (isBatchFull()) {
+        // The caller is expected to check isBatchFull() before publishing.
+        return WOULD_BLOCK;
+    }
+    mBatch.push(msg);
+    mBatchBytes += msg.size();
+    return OK;
+}
+
 status_t InputPublisher::publishKeyEvent(
         uint32_t seq,
         int32_t deviceId,
@@ -268,7 +586,7 @@ status_t InputPublisher::publishKeyEvent(
     msg.body.key.repeatCount = repeatCount;
     msg.body.key.downTime = downTime;
     msg.body.key.eventTime = eventTime;
-    return mChannel->sendMessage(&msg);
+    return publishMessage(msg);
 }
 
 status_t InputPublisher::publishMotionEvent(
@@ -332,7 +650,7 @@ status_t InputPublisher::publishMotionEvent(
         msg.body.motion.pointers[i].properties.copyFrom(pointerProperties[i]);
         msg.body.motion.pointers[i].coords.copyFrom(pointerCoords[i]);
     }
-    return mChannel->sendMessage(&msg);
+    return publishMessage(msg);
 }
 
 status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandled) {
@@ -362,10 +680,14 @@ status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandle
 
 InputConsumer::InputConsumer(const sp<InputChannel>& channel) :
         mResampleTouch(isTouchResamplingEnabled()),
+        mPredictionHorizon(mResampleTouch ? getTouchPredictionHorizon() : 0),
         mChannel(channel), mMsgDeferred(false) {
 }
 
 InputConsumer::~InputConsumer() {
+    for (size_t i = 0; i < mTouchStates.size(); i++) {
+        delete mTouchStates.itemAt(i).velocityTracker;
+    }
 }
 
 bool InputConsumer::isTouchResamplingEnabled() {
@@ -383,6 +705,22 @@ bool InputConsumer::isTouchResamplingEnabled() {
     return true;
 }
 
+nsecs_t InputConsumer::getTouchPredictionHorizon() {
+    char value[PROPERTY_VALUE_MAX];
+    int length = property_get("debug.inputconsumer.predict", value, NULL);
+    if (length > 0) {
+        char* end;
+        long horizonMillis = strtol(value, &end, 10);
+        if (*end || horizonMillis < 0) {
+            ALOGD("Unrecognized property value for 'debug.inputconsumer.predict'.  "
+                    "Use the prediction horizon in milliseconds or '0'.");
+            return 0;
+        }
+        return min(nsecs_t(horizonMillis) * NANOS_PER_MS, PREDICT_MAX_HORIZON);
+    }
+    return 0;
+}
+
 status_t InputConsumer::consume(InputEventFactoryInterface* factory,
         bool consumeBatches, nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent) {
 #if DEBUG_TRANSPORT_ACTIONS
@@ -581,10 +919,19 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
         if (index < 0) {
             mTouchStates.push();
             index = mTouchStates.size() - 1;
+            mTouchStates.editItemAt(index).velocityTracker = NULL;
         }
         TouchState& touchState = mTouchStates.editItemAt(index);
         touchState.initialize(deviceId, source);
         touchState.addHistory(msg);
+        if (mPredictionHorizon) {
+            if (touchState.velocityTracker) {
+                touchState.velocityTracker->clear();
+            } else {
+                touchState.velocityTracker = new VelocityTracker("lsq2");
+            }
+        }
+        addMovement(touchState, msg);
         break;
     }
 
@@ -593,6 +940,7 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
         if (index >= 0) {
             TouchState& touchState = mTouchStates.editItemAt(index);
             touchState.addHistory(msg);
+            addMovement(touchState, msg);
             if (eventTime < touchState.lastResample.eventTime) {
                 rewriteMessage(touchState, msg);
             } else {
@@ -608,6 +956,13 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
             TouchState& touchState = mTouchStates.editItemAt(index);
             touchState.lastResample.idBits.clearBit(msg->body.motion.getActionId());
             rewriteMessage(touchState, msg);
+            if (touchState.velocityTracker) {
+                // The new pointer may reuse the id of one that went up earlier.
+                BitSet32 idBits;
+                idBits.markBit(msg->body.motion.getActionId());
+                touchState.velocityTracker->clearPointers(idBits);
+                addMovement(touchState, msg);
+            }
         }
         break;
     }
@@ -637,6 +992,7 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
         if (index >= 0) {
             const TouchState& touchState = mTouchStates.itemAt(index);
             rewriteMessage(touchState, msg);
+            delete touchState.velocityTracker;
             mTouchStates.removeAt(index);
         }
         break;
@@ -644,6 +1000,26 @@ void InputConsumer::updateTouchState(InputMessage* msg) {
     }
 }
 
+void InputConsumer::addMovement(TouchState& touchState, const InputMessage* msg) {
+    if (!touchState.velocityTracker) {
+        return;
+    }
+
+    // The velocity tracker wants the positions ordered by increasing pointer id.
+    BitSet32 idBits;
+    for (size_t i = 0; i < msg->body.motion.pointerCount; i++) {
+        idBits.markBit(msg->body.motion.pointers[i].properties.id);
+    }
+    VelocityTracker::Position positions[MAX_POINTERS];
+    for (size_t i = 0; i < msg->body.motion.pointerCount; i++) {
+        const InputMessage::Body::Motion::Pointer& pointer = msg->body.motion.pointers[i];
+        uint32_t index = idBits.getIndexOfBit(pointer.properties.id);
+        positions[index].x = pointer.coords.getX();
+        positions[index].y = pointer.coords.getY();
+    }
+    touchState.velocityTracker->addMovement(msg->body.motion.eventTime, idBits, positions);
+}
+
 void InputConsumer::rewriteMessage(const TouchState& state, InputMessage* msg) {
     for (size_t i = 0; i < msg->body.motion.pointerCount; i++) {
         uint32_t id = msg->body.motion.pointers[i].properties.id;
@@ -700,6 +1076,16 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
         }
     }
 
+    // Predict where the pointers will be once the frame is shown, if there is no newer
+    // sample to interpolate with.
+    if (!next && touchState.velocityTracker) {
+        nsecs_t predictTime = sampleTime + RESAMPLE_LATENCY + mPredictionHorizon;
+        nsecs_t maxPredict = current->eventTime + RESAMPLE_MAX_PREDICTION + mPredictionHorizon;
+        if (predictTouchState(min(predictTime, maxPredict), event, touchState)) {
+            return;
+        }
+    }
+
     // Find the data to use for resampling.
     const History* other;
     History future;
@@ -783,6 +1169,56 @@ void InputConsumer::resampleTouchState(nsecs_t sampleTime, MotionEvent* event,
     event->addSample(sampleTime, touchState.lastResample.pointers);
 }
 
+bool InputConsumer::predictTouchState(nsecs_t predictTime, MotionEvent* event,
+        TouchState& touchState) {
+    const History* current = touchState.getHistory(0);
+    size_t pointerCount = event->getPointerCount();
+
+    PointerCoords predictedCoords[MAX_POINTERS];
+    for (size_t i = 0; i < pointerCount; i++) {
+        uint32_t id = event->getPointerId(i);
+        const PointerCoords& currentCoords = current->getPointerById(id);
+        predictedCoords[i].copyFrom(currentCoords);
+        if (!shouldResampleTool(event->getToolType(i))) {
+            continue;
+        }
+
+        VelocityTracker::Estimator estimator;
+        if (!touchState.velocityTracker->getEstimator(id, &estimator)
+                || estimator.degree < 1
+                || estimator.confidence < PREDICT_MIN_CONFIDENCE) {
+#if DEBUG_RESAMPLING
+            ALOGD("Not predicted, no confident estimator for id %d", id);
+#endif
+            return false;
+        }
+
+        // Evaluate the fitted polynomials, whose time base is in seconds.
+        float t = (predictTime - estimator.time) * 0.000000001f;
+        float x = 0, y = 0, tn = 1;
+        for (uint32_t n = 0; n <= estimator.degree; n++) {
+            x += estimator.xCoeff[n] * tn;
+            y += estimator.yCoeff[n] * tn;
+            tn *= t;
+        }
+        predictedCoords[i].setAxisValue(AMOTION_EVENT_AXIS_X, x);
+        predictedCoords[i].setAxisValue(AMOTION_EVENT_AXIS_Y, y);
+#if DEBUG_RESAMPLING
+        ALOGD("[%d] - predicted (%0.3f, %0.3f) in %lld ns, cur (%0.3f, %0.3f), "
+                "confidence %0.3f",
+                id, x, y, predictTime - current->eventTime,
+                currentCoords.getX(), currentCoords.getY(), estimator.confidence);
+#endif
+    }
+
+    // Predictions are not used to rewrite later samples, since the application should
+    // get to see where the pointers actually went.
+    touchState.lastResample.eventTime = predictTime;
+    touchState.lastResample.idBits.clear();
+    event->addSample(predictTime, predictedCoords);
+    return true;
+}
+
 bool InputConsumer::shouldResampleTool(int32_t toolType) {
     return toolType == AMOTION_EVENT_TOOL_TYPE_FINGER
             || toolType == AMOTION_EVENT_TOOL_TYPE_UNKNOWN;
@@ -842,7 +1278,7 @@ status_t InputConsumer::sendUnchainedFinishedSignal(uint32_t seq, bool handled)
 }
 
 bool InputConsumer::hasDeferredEvent() const {
-    return mMsgDeferred;
+    return mMsgDeferred || mChannel->hasPendingMessages();
 }
 
 bool InputConsumer::hasPendingBatch() const {
@@ -18,6 +18,8 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
 #include <android/keycodes.h>
 #include <androidfw/Keyboard.h>
 #include <androidfw/KeyCharacterMap.h>
@@ -28,6 +30,7 @@
 
 #include <utils/Log.h>
 #include <utils/Errors.h>
+#include <utils/FileMap.h>
 #include <utils/Tokenizer.h>
 #include <utils/Timers.h>
 
@@ -70,6 +73,56 @@ static const Modifier modifiers[] = {
         { "scrolllock", AMETA_SCROLL_LOCK_ON },
 };
 
+// The compiled form of a key character map.  The header is followed by the keys, all
+// of their behaviors, the scan code mappings and the usage code mappings, each sorted.
+static const uint32_t COMPILED_MAGIC = 0x434d434b; // "KCMC"
+static const uint32_t COMPILED_VERSION = 1;
+
+struct CompiledHeader {
+    uint32_t magic;
+    uint32_t version;
+    int32_t type;
+    uint32_t keyCount;
+    uint32_t behaviorCount;
+    uint32_t scanCodeCount;
+    uint32_t usageCodeCount;
+};
+
+struct CompiledKey {
+    int32_t keyCode;
+    uint16_t label;
+    uint16_t number;
+    uint32_t firstBehavior;
+    uint32_t behaviorCount;
+};
+
+struct CompiledBehavior {
+    int32_t metaState;
+    int32_t fallbackKeyCode;
+    uint32_t character;
+};
+
+struct CompiledKeyMapping {
+    int32_t code;
+    int32_t keyCode;
+};
+
+static status_t writeFully(int fd, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size) {
+        ssize_t nWrite = write(fd, bytes, size);
+        if (nWrite < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        bytes += nWrite;
+        size -= nWrite;
+    }
+    return OK;
+}
+
 #if DEBUG_MAPPING
 static String8 toString(const char16_t* chars, size_t numChars) {
     String8 result;
@@ -95,6 +148,7 @@ KeyCharacterMap::KeyCharacterMap(const KeyCharacterMap& other) :
     for (size_t i = 0; i < other.mKeys.size(); i++) {
         mKeys.add(other.mKeys.keyAt(i), new Key(*other.mKeys.valueAt(i)));
     }
+    buildLookupTables();
 }
 
 KeyCharacterMap::~KeyCharacterMap() {
@@ -108,6 +162,10 @@ status_t KeyCharacterMap::load(const String8& filename,
         Format format, sp<KeyCharacterMap>* outMap) {
     outMap->clear();
 
+    if (!loadCompiled(filename, format, outMap)) {
+        return OK;
+    }
+
     Tokenizer* tokenizer;
     status_t status = Tokenizer::open(filename, &tokenizer);
     if (status) {
@@ -119,6 +177,170 @@ status_t KeyCharacterMap::load(const String8& filename,
     return status;
 }
 
+status_t KeyCharacterMap::loadCompiled(const String8& filename, Format format,
+        sp<KeyCharacterMap>* outMap) {
+    outMap->clear();
+
+    FileMap* fileMap = mapCompiledKeyMapFile(filename);
+    if (!fileMap) {
+        return NAME_NOT_FOUND;
+    }
+
+    const uint8_t* data = static_cast<const uint8_t*>(fileMap->getDataPtr());
+    size_t size = fileMap->getDataLength();
+    const CompiledHeader* header = reinterpret_cast<const CompiledHeader*>(data);
+    status_t status = BAD_VALUE;
+    if (size >= sizeof(CompiledHeader)
+            && header->magic == COMPILED_MAGIC
+            && header->version == COMPILED_VERSION
+            && header->keyCount <= size / sizeof(CompiledKey)
+            && header->behaviorCount <= size / sizeof(CompiledBehavior)
+            && header->scanCodeCount <= size / sizeof(CompiledKeyMapping)
+            && header->usageCodeCount <= size / sizeof(CompiledKeyMapping)
+            && size == sizeof(CompiledHeader)
+                    + header->keyCount * sizeof(CompiledKey)
+                    + header->behaviorCount * sizeof(CompiledBehavior)
+                    + (header->scanCodeCount + header->usageCodeCount)
+                            * sizeof(CompiledKeyMapping)) {
+        const CompiledKey* keys = reinterpret_cast<const CompiledKey*>(header + 1);
+        const CompiledBehavior* behaviors =
+                reinterpret_cast<const CompiledBehavior*>(keys + header->keyCount);
+        const CompiledKeyMapping* mappings =
+                reinterpret_cast<const CompiledKeyMapping*>(behaviors + header->behaviorCount);
+
+        sp<KeyCharacterMap> map = new KeyCharacterMap();
+        map->mType = header->type;
+        map->mKeys.setCapacity(header->keyCount);
+        status = OK;
+        for (uint32_t i = 0; i < header->keyCount && !status; i++) {
+            const CompiledKey& compiledKey = keys[i];
+            if (compiledKey.firstBehavior > header->behaviorCount
+                    || compiledKey.behaviorCount
+                            > header->behaviorCount - compiledKey.firstBehavior) {
+                status = BAD_VALUE;
+                break;
+            }
+
+            Key* key = new Key();
+            key->label = compiledKey.label;
+            key->number = compiledKey.number;
+            map->mKeys.add(compiledKey.keyCode, key);
+
+            Behavior* lastBehavior = NULL;
+            for (uint32_t j = 0; j < compiledKey.behaviorCount; j++) {
+                const CompiledBehavior& compiledBehavior =
+                        behaviors[compiledKey.firstBehavior + j];
+                Behavior* behavior = new Behavior();
+                behavior->metaState = compiledBehavior.metaState;
+                behavior->character = compiledBehavior.character;
+                behavior->fallbackKeyCode = compiledBehavior.fallbackKeyCode;
+                if (lastBehavior) {
+                    lastBehavior->next = behavior;
+                } else {
+                    key->firstBehavior = behavior;
+                }
+                lastBehavior = behavior;
+            }
+        }
+
+        if (!status) {
+            map->mKeysByScanCode.setCapacity(header->scanCodeCount);
+            for (uint32_t i = 0; i < header->scanCodeCount; i++) {
+                map->mKeysByScanCode.add(mappings[i].code, mappings[i].keyCode);
+            }
+            mappings += header->scanCodeCount;
+            map->mKeysByUsageCode.setCapacity(header->usageCodeCount);
+            for (uint32_t i = 0; i < header->usageCodeCount; i++) {
+                map->mKeysByUsageCode.add(mappings[i].code, mappings[i].keyCode);
+            }
+            status = checkFormat(map, format);
+        }
+        if (!status) {
+            map->buildLookupTables();
+            *outMap = map;
+        }
+    }
+    if (status) {
+        ALOGE("Compiled key character map for '%s' is invalid.", filename.string());
+    }
+    fileMap->release();
+    return status;
+}
+
+status_t KeyCharacterMap::checkFormat(const sp<KeyCharacterMap>& map, Format format) {
+    if (map->mType == KEYBOARD_TYPE_UNKNOWN) {
+        return BAD_VALUE;
+    }
+    if (format == FORMAT_BASE) {
+        return map->mType == KEYBOARD_TYPE_OVERLAY ? BAD_VALUE : OK;
+    }
+    if (format == FORMAT_OVERLAY) {
+        return map->mType != KEYBOARD_TYPE_OVERLAY ? BAD_VALUE : OK;
+    }
+    return OK;
+}
+
+status_t KeyCharacterMap::writeCompiled(int fd) const {
+    Vector<CompiledKey> keys;
+    Vector<CompiledBehavior> behaviors;
+    keys.setCapacity(mKeys.size());
+    for (size_t i = 0; i < mKeys.size(); i++) {
+        const Key* key = mKeys.valueAt(i);
+        CompiledKey compiledKey;
+        compiledKey.keyCode = mKeys.keyAt(i);
+        compiledKey.label = key->label;
+        compiledKey.number = key->number;
+        compiledKey.firstBehavior = behaviors.size();
+        compiledKey.behaviorCount = 0;
+        for (const Behavior* behavior = key->firstBehavior; behavior != NULL;
+                behavior = behavior->next) {
+            CompiledBehavior compiledBehavior;
+            compiledBehavior.metaState = behavior->metaState;
+            compiledBehavior.fallbackKeyCode = behavior->fallbackKeyCode;
+            compiledBehavior.character = behavior->character;
+            behaviors.push(compiledBehavior);
+            compiledKey.behaviorCount += 1;
+        }
+        keys.push(compiledKey);
+    }
+
+    Vector<CompiledKeyMapping> mappings;
+    mappings.setCapacity(mKeysByScanCode.size() + mKeysByUsageCode.size());
+    for (size_t i = 0; i < mKeysByScanCode.size(); i++) {
+        CompiledKeyMapping mapping;
+        mapping.code = mKeysByScanCode.keyAt(i);
+        mapping.keyCode = mKeysByScanCode.valueAt(i);
+        mappings.push(mapping);
+    }
+    for (size_t i = 0; i < mKeysByUsageCode.size(); i++) {
+        CompiledKeyMapping mapping;
+        mapping.code = mKeysByUsageCode.keyAt(i);
+        mapping.keyCode = mKeysByUsageCode.valueAt(i);
+        mappings.push(mapping);
+    }
+
+    CompiledHeader header;
+    header.magic = COMPILED_MAGIC;
+    header.version = COMPILED_VERSION;
+    header.type = mType;
+    header.keyCount = keys.size();
+    header.behaviorCount = behaviors.size();
+    header.scanCodeCount = mKeysByScanCode.size();
+    header.usageCodeCount = mKeysByUsageCode.size();
+
+    status_t status = writeFully(fd, &header, sizeof(header));
+    if (!status) {
+        status = writeFully(fd, keys.array(), keys.size() * sizeof(CompiledKey));
+    }
+    if (!status) {
+        status = writeFully(fd, behaviors.array(), behaviors.size() * sizeof(CompiledBehavior));
+    }
+    if (!status) {
+        status = writeFully(fd, mappings.array(), mappings.size() * sizeof(CompiledKeyMapping));
+    }
+    return status;
+}
+
 status_t KeyCharacterMap::loadContents(const String8& filename, const char* contents,
         Format format, sp<KeyCharacterMap>* outMap) {
     outMap->clear();
@@ -154,6 +376,7 @@ status_t KeyCharacterMap::load(Tokenizer* tokenizer,
                 elapsedTime / 1000000.0);
 #endif
         if (!status) {
+            map->buildLookupTables();
             *outMap = map;
         }
     }
@@ -191,9 +414,53 @@ sp<KeyCharacterMap> KeyCharacterMap::combine(const sp<KeyCharacterMap>& base,
         map->mKeysByUsageCode.replaceValueFor(overlay->mKeysByUsageCode.keyAt(i),
                 overlay->mKeysByUsageCode.valueAt(i));
     }
+
+    map->buildLookupTables();
     return map;
 }
 
+void KeyCharacterMap::buildLookupTables() {
+    // Key codes are small and dense, so a table indexed by key code replaces the
+    // binary search through mKeys.  Unusually large key codes are still found by search.
+    const int32_t MAX_INDEXED_KEY_CODE = 1024;
+    mKeysByKeyCode.clear();
+    size_t keyCount = 0;
+    for (size_t i = mKeys.size(); i-- > 0; ) {
+        int32_t keyCode = mKeys.keyAt(i);
+        if (keyCode >= 0 && keyCode < MAX_INDEXED_KEY_CODE) {
+            keyCount = keyCode + 1;
+            break;
+        }
+    }
+    if (keyCount) {
+        mKeysByKeyCode.insertAt(NULL, 0, keyCount);
+    }
+    mKeysByCharacter.clear();
+    for (size_t i = 0; i < mKeys.size(); i++) {
+        int32_t keyCode = mKeys.keyAt(i);
+        const Key* key = mKeys.valueAt(i);
+        if (keyCode >= 0 && size_t(keyCode) < keyCount) {
+            mKeysByKeyCode.editItemAt(keyCode) = key;
+        }
+
+        // As in findKey(), the first key that generates a character wins, using the
+        // most general behavior of that key, which is the last one in the list.
+        for (const Behavior* behavior = key->firstBehavior; behavior; behavior = behavior->next) {
+            if (behavior->character) {
+                CharacterKey characterKey;
+                characterKey.keyCode = keyCode;
+                characterKey.metaState = behavior->metaState;
+                ssize_t index = mKeysByCharacter.indexOfKey(behavior->character);
+                if (index < 0) {
+                    mKeysByCharacter.add(behavior->character, characterKey);
+                } else if (mKeysByCharacter.valueAt(index).keyCode == keyCode) {
+                    mKeysByCharacter.editValueAt(index) = characterKey;
+                }
+            }
+        }
+    }
+}
+
 sp<KeyCharacterMap> KeyCharacterMap::empty() {
     return sEmpty;
 }
@@ -358,6 +625,11 @@ status_t KeyCharacterMap::mapKey(int32_t scanCode, int32_t usageCode, int32_t* o
 }
 
 bool KeyCharacterMap::getKey(int32_t keyCode, const Key** outKey) const {
+    if (keyCode >= 0 && size_t(keyCode) < mKeysByKeyCode.size()) {
+        *outKey = mKeysByKeyCode[keyCode];
+        return *outKey != NULL;
+    }
+
     ssize_t index = mKeys.indexOfKey(keyCode);
     if (index >= 0) {
         *outKey = mKeys.valueAt(index);
@@ -419,24 +691,16 @@ bool KeyCharacterMap::findKey(char16_t ch, int32_t* outKeyCode, int32_t* outMeta
         return false;
     }
 
-    for (size_t i = 0; i < mKeys.size(); i++) {
-        const Key* key = mKeys.valueAt(i);
-
-        // Try to find the most general behavior that maps to this character.
-        // For example, the base key behavior will usually be last in the list.
-        const Behavior* found = NULL;
-        for (const Behavior* behavior = key->firstBehavior; behavior; behavior = behavior->next) {
-            if (behavior->character == ch) {
-                found = behavior;
-            }
-        }
-        if (found) {
-            *outKeyCode = mKeys.keyAt(i);
-            *outMetaState = found->metaState;
-            return true;
-        }
+    // Find the first key that maps to this character, using its most general behavior.
+    // For example, the base key behavior will usually be last in the list.
+    ssize_t index = mKeysByCharacter.indexOfKey(ch);
+    if (index < 0) {
+        return false;
     }
-    return false;
+    const CharacterKey& characterKey = mKeysByCharacter.valueAt(index);
+    *outKeyCode = characterKey.keyCode;
+    *outMetaState = characterKey.metaState;
+    return true;
 }
 
 void KeyCharacterMap::addKey(Vector<KeyEvent>& outEvents,
@@ -602,6 +866,7 @@ sp<KeyCharacterMap> KeyCharacterMap::readFromParcel(Parcel* parcel) {
             return NULL;
         }
     }
+    map->buildLookupTables();
     return map;
 }
 
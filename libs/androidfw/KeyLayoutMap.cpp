@@ -17,11 +17,14 @@
 #define LOG_TAG "KeyLayoutMap"
 
 #include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
 #include <android/keycodes.h>
 #include <androidfw/Keyboard.h>
 #include <androidfw/KeyLayoutMap.h>
 #include <utils/Log.h>
 #include <utils/Errors.h>
+#include <utils/FileMap.h>
 #include <utils/Tokenizer.h>
 #include <utils/Timers.h>
 
@@ -39,6 +42,50 @@ namespace android {
 
 static const char* WHITESPACE = " \t\r";
 
+// The compiled form of a key layout map.  The header is followed by the scan code
+// mappings, the usage code mappings and the axes, each sorted.
+static const uint32_t COMPILED_MAGIC = 0x434c4b4b; // "KKLC"
+static const uint32_t COMPILED_VERSION = 1;
+
+struct CompiledHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t scanCodeCount;
+    uint32_t usageCodeCount;
+    uint32_t axisCount;
+};
+
+struct CompiledKey {
+    int32_t code;
+    int32_t keyCode;
+    uint32_t flags;
+};
+
+struct CompiledAxis {
+    int32_t scanCode;
+    int32_t mode;
+    int32_t axis;
+    int32_t highAxis;
+    int32_t splitValue;
+    int32_t flatOverride;
+};
+
+static status_t writeFully(int fd, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size) {
+        ssize_t nWrite = write(fd, bytes, size);
+        if (nWrite < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        bytes += nWrite;
+        size -= nWrite;
+    }
+    return OK;
+}
+
 // --- KeyLayoutMap ---
 
 KeyLayoutMap::KeyLayoutMap() {
@@ -50,6 +97,10 @@ KeyLayoutMap::~KeyLayoutMap() {
 status_t KeyLayoutMap::load(const String8& filename, sp<KeyLayoutMap>* outMap) {
     outMap->clear();
 
+    if (!loadCompiled(filename, outMap)) {
+        return OK;
+    }
+
     Tokenizer* tokenizer;
     status_t status = Tokenizer::open(filename, &tokenizer);
     if (status) {
@@ -80,6 +131,115 @@ status_t KeyLayoutMap::load(const String8& filename, sp<KeyLayoutMap>* outMap) {
     return status;
 }
 
+status_t KeyLayoutMap::loadCompiled(const String8& filename, sp<KeyLayoutMap>* outMap) {
+    outMap->clear();
+
+    FileMap* fileMap = mapCompiledKeyMapFile(filename);
+    if (!fileMap) {
+        return NAME_NOT_FOUND;
+    }
+
+    const uint8_t* data = static_cast<const uint8_t*>(fileMap->getDataPtr());
+    size_t size = fileMap->getDataLength();
+    const CompiledHeader* header = reinterpret_cast<const CompiledHeader*>(data);
+    status_t status = BAD_VALUE;
+    if (size >= sizeof(CompiledHeader)
+            && header->magic == COMPILED_MAGIC
+            && header->version == COMPILED_VERSION
+            && header->scanCodeCount <= size / sizeof(CompiledKey)
+            && header->usageCodeCount <= size / sizeof(CompiledKey)
+            && header->axisCount <= size / sizeof(CompiledAxis)
+            && size == sizeof(CompiledHeader)
+                    + (header->scanCodeCount + header->usageCodeCount) * sizeof(CompiledKey)
+                    + header->axisCount * sizeof(CompiledAxis)) {
+        const CompiledKey* keys = reinterpret_cast<const CompiledKey*>(header + 1);
+        const CompiledAxis* axes = reinterpret_cast<const CompiledAxis*>(
+                keys + header->scanCodeCount + header->usageCodeCount);
+
+        sp<KeyLayoutMap> map = new KeyLayoutMap();
+        map->mKeysByScanCode.setCapacity(header->scanCodeCount);
+        for (uint32_t i = 0; i < header->scanCodeCount; i++) {
+            Key key;
+            key.keyCode = keys[i].keyCode;
+            key.flags = keys[i].flags;
+            map->mKeysByScanCode.add(keys[i].code, key);
+        }
+        keys += header->scanCodeCount;
+        map->mKeysByUsageCode.setCapacity(header->usageCodeCount);
+        for (uint32_t i = 0; i < header->usageCodeCount; i++) {
+            Key key;
+            key.keyCode = keys[i].keyCode;
+            key.flags = keys[i].flags;
+            map->mKeysByUsageCode.add(keys[i].code, key);
+        }
+        map->mAxes.setCapacity(header->axisCount);
+        for (uint32_t i = 0; i < header->axisCount; i++) {
+            AxisInfo axisInfo;
+            axisInfo.mode = AxisInfo::Mode(axes[i].mode);
+            axisInfo.axis = axes[i].axis;
+            axisInfo.highAxis = axes[i].highAxis;
+            axisInfo.splitValue = axes[i].splitValue;
+            axisInfo.flatOverride = axes[i].flatOverride;
+            map->mAxes.add(axes[i].scanCode, axisInfo);
+        }
+        *outMap = map;
+        status = OK;
+    } else {
+        ALOGE("Compiled key layout map for '%s' is invalid.", filename.string());
+    }
+    fileMap->release();
+    return status;
+}
+
+status_t KeyLayoutMap::writeCompiled(int fd) const {
+    Vector<CompiledKey> keys;
+    keys.setCapacity(mKeysByScanCode.size() + mKeysByUsageCode.size());
+    for (size_t i = 0; i < mKeysByScanCode.size(); i++) {
+        CompiledKey compiledKey;
+        compiledKey.code = mKeysByScanCode.keyAt(i);
+        compiledKey.keyCode = mKeysByScanCode.valueAt(i).keyCode;
+        compiledKey.flags = mKeysByScanCode.valueAt(i).flags;
+        keys.push(compiledKey);
+    }
+    for (size_t i = 0; i < mKeysByUsageCode.size(); i++) {
+        CompiledKey compiledKey;
+        compiledKey.code = mKeysByUsageCode.keyAt(i);
+        compiledKey.keyCode = mKeysByUsageCode.valueAt(i).keyCode;
+        compiledKey.flags = mKeysByUsageCode.valueAt(i).flags;
+        keys.push(compiledKey);
+    }
+
+    Vector<CompiledAxis> axes;
+    axes.setCapacity(mAxes.size());
+    for (size_t i = 0; i < mAxes.size(); i++) {
+        const AxisInfo& axisInfo = mAxes.valueAt(i);
+        CompiledAxis compiledAxis;
+        compiledAxis.scanCode = mAxes.keyAt(i);
+        compiledAxis.mode = axisInfo.mode;
+        compiledAxis.axis = axisInfo.axis;
+        compiledAxis.highAxis = axisInfo.highAxis;
+        compiledAxis.splitValue = axisInfo.splitValue;
+        compiledAxis.flatOverride = axisInfo.flatOverride;
+        axes.push(compiledAxis);
+    }
+
+    CompiledHeader header;
+    header.magic = COMPILED_MAGIC;
+    header.version = COMPILED_VERSION;
+    header.scanCodeCount = mKeysByScanCode.size();
+    header.usageCodeCount = mKeysByUsageCode.size();
+    header.axisCount = mAxes.size();
+
+    status_t status = writeFully(fd, &header, sizeof(header));
+    if (!status) {
+        status = writeFully(fd, keys.array(), keys.size() * sizeof(CompiledKey));
+    }
+    if (!status) {
+        status = writeFully(fd, axes.array(), axes.size() * sizeof(CompiledAxis));
+    }
+    return status;
+}
+
 status_t KeyLayoutMap::mapKey(int32_t scanCode, int32_t usageCode,
         int32_t* outKeyCode, uint32_t* outFlags) const {
     const Key* key = getKey(scanCode, usageCode);
@@ -19,6 +19,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #include <androidfw/Keyboard.h>
 #include <androidfw/KeycodeLabels.h>
@@ -26,11 +28,62 @@
 #include <androidfw/KeyCharacterMap.h>
 #include <androidfw/InputDevice.h>
 #include <utils/Errors.h>
+#include <utils/FileMap.h>
 #include <utils/Log.h>
+#include <utils/KeyedVector.h>
+#include <utils/threads.h>
 #include <cutils/properties.h>
 
 namespace android {
 
+// --- KeyMapFileCache ---
+
+// Caches parsed key layouts and key character maps by path.  Base maps are never modified
+// once loaded so they can be shared by every device that uses the same file, for as long as
+// the file keeps the modification time and size it had when it was parsed.
+template<typename T>
+class KeyMapFileCache {
+public:
+    bool get(const String8& path, const struct stat& st, sp<T>* outMap) {
+        AutoMutex _l(mLock);
+        ssize_t index = mEntries.indexOfKey(path);
+        if (index < 0) {
+            return false;
+        }
+        const Entry& entry = mEntries.valueAt(index);
+        if (entry.mtime != st.st_mtime || entry.size != st.st_size) {
+            mEntries.removeItemsAt(index);
+            return false;
+        }
+        *outMap = entry.map;
+        return true;
+    }
+
+    void put(const String8& path, const struct stat& st, const sp<T>& map) {
+        Entry entry;
+        entry.mtime = st.st_mtime;
+        entry.size = st.st_size;
+        entry.map = map;
+
+        AutoMutex _l(mLock);
+        mEntries.replaceValueFor(path, entry);
+    }
+
+private:
+    struct Entry {
+        time_t mtime;
+        off_t size;
+        sp<T> map;
+    };
+
+    Mutex mLock;
+    KeyedVector<String8, Entry> mEntries;
+};
+
+static KeyMapFileCache<KeyLayoutMap> gKeyLayoutMapCache;
+static KeyMapFileCache<KeyCharacterMap> gKeyCharacterMapCache;
+
+
 // --- KeyMap ---
 
 KeyMap::KeyMap() {
@@ -112,9 +165,16 @@ status_t KeyMap::loadKeyLayout(const InputDeviceIdentifier& deviceIdentifier,
         return NAME_NOT_FOUND;
     }
 
-    status_t status = KeyLayoutMap::load(path, &keyLayoutMap);
-    if (status) {
-        return status;
+    struct stat st;
+    bool cacheable = !stat(path.string(), &st);
+    if (!cacheable || !gKeyLayoutMapCache.get(path, st, &keyLayoutMap)) {
+        status_t status = KeyLayoutMap::load(path, &keyLayoutMap);
+        if (status) {
+            return status;
+        }
+        if (cacheable) {
+            gKeyLayoutMapCache.put(path, st, keyLayoutMap);
+        }
     }
 
     keyLayoutFile.setTo(path);
@@ -129,10 +189,17 @@ status_t KeyMap::loadKeyCharacterMap(const InputDeviceIdentifier& deviceIdentifi
         return NAME_NOT_FOUND;
     }
 
-    status_t status = KeyCharacterMap::load(path,
-            KeyCharacterMap::FORMAT_BASE, &keyCharacterMap);
-    if (status) {
-        return status;
+    struct stat st;
+    bool cacheable = !stat(path.string(), &st);
+    if (!cacheable || !gKeyCharacterMapCache.get(path, st, &keyCharacterMap)) {
+        status_t status = KeyCharacterMap::load(path,
+                KeyCharacterMap::FORMAT_BASE, &keyCharacterMap);
+        if (status) {
+            return status;
+        }
+        if (cacheable) {
+            gKeyCharacterMapCache.put(path, st, keyCharacterMap);
+        }
     }
 
     keyCharacterMapFile.setTo(path);
@@ -295,4 +362,36 @@ bool isMetaKey(int32_t keyCode) {
 }
 
 
+String8 getCompiledKeyMapFilePath(const String8& filename) {
+    String8 path(filename);
+    path.append("c");
+    return path;
+}
+
+FileMap* mapCompiledKeyMapFile(const String8& filename) {
+    String8 compiledPath(getCompiledKeyMapFilePath(filename));
+    int fd = open(compiledPath.string(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    FileMap* map = NULL;
+    struct stat compiledStat, sourceStat;
+    if (!fstat(fd, &compiledStat) && compiledStat.st_size > 0) {
+        if (!stat(filename.string(), &sourceStat)
+                && sourceStat.st_mtime > compiledStat.st_mtime) {
+            ALOGW("Ignoring compiled key map '%s' because it is older than '%s'.",
+                    compiledPath.string(), filename.string());
+        } else {
+            map = new FileMap();
+            if (!map->create(compiledPath.string(), fd, 0, compiledStat.st_size, true)) {
+                map->release();
+                map = NULL;
+            }
+        }
+    }
+    close(fd);
+    return map;
+}
+
 } // namespace android
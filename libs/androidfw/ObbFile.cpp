@@ -43,6 +43,8 @@
 
 #define kMaxBufSize    32768 /* Maximum file read buffer */
 
+#define kTailReadSize  4096 /* Bytes read at the end of the file to find the footer */
+
 #define kSignature     0x01059983U /* ObbFile signature */
 
 #define kSigVersion    1 /* We only know about signature version 1 */
@@ -127,61 +129,74 @@ bool ObbFile::parseObbFile(int fd)
         return false;
     }
 
-    ssize_t actual;
+    // Read the end of the file in one go: it holds the whole footer unless
+    // the package name is unusually long.
+    size_t tailSize = fileLength < kTailReadSize ? (size_t)fileLength : kTailReadSize;
+    char* tailBuf = (char*)malloc(tailSize);
+    if (tailBuf == NULL) {
+        ALOGW("couldn't allocate tailBuf: %s\n", strerror(errno));
+        return false;
+    }
+
+    ssize_t actual = TEMP_FAILURE_RETRY(pread64(fd, tailBuf, tailSize, fileLength - tailSize));
+    if (actual != (ssize_t)tailSize) {
+        ALOGW("couldn't read footer signature: %s\n", strerror(errno));
+        free(tailBuf);
+        return false;
+    }
+
     size_t footerSize;
 
     {
-        lseek64(fd, fileLength - kFooterTagSize, SEEK_SET);
-
-        char *footer = new char[kFooterTagSize];
-        actual = TEMP_FAILURE_RETRY(read(fd, footer, kFooterTagSize));
-        if (actual != kFooterTagSize) {
-            ALOGW("couldn't read footer signature: %s\n", strerror(errno));
-            return false;
-        }
+        unsigned char* footer = (unsigned char*)tailBuf + tailSize - kFooterTagSize;
 
-        unsigned int fileSig = get4LE((unsigned char*)footer + sizeof(int32_t));
+        unsigned int fileSig = get4LE(footer + sizeof(int32_t));
         if (fileSig != kSignature) {
             ALOGW("footer didn't match magic string (expected 0x%08x; got 0x%08x)\n",
                     kSignature, fileSig);
+            free(tailBuf);
             return false;
         }
 
-        footerSize = get4LE((unsigned char*)footer);
+        footerSize = get4LE(footer);
         if (footerSize > (size_t)fileLength - kFooterTagSize
                 || footerSize > kMaxBufSize) {
             ALOGW("claimed footer size is too large (0x%08zx; file size is 0x%08llx)\n",
                     footerSize, fileLength);
+            free(tailBuf);
             return false;
         }
 
         if (footerSize < (kFooterMinSize - kFooterTagSize)) {
             ALOGW("claimed footer size is too small (0x%zx; minimum size is 0x%x)\n",
                     footerSize, kFooterMinSize - kFooterTagSize);
+            free(tailBuf);
             return false;
         }
     }
 
     off64_t fileOffset = fileLength - footerSize - kFooterTagSize;
-    if (lseek64(fd, fileOffset, SEEK_SET) != fileOffset) {
-        ALOGW("seek %lld failed: %s\n", fileOffset, strerror(errno));
-        return false;
-    }
-
     mFooterStart = fileOffset;
 
-    char* scanBuf = (char*)malloc(footerSize);
-    if (scanBuf == NULL) {
-        ALOGW("couldn't allocate scanBuf: %s\n", strerror(errno));
-        return false;
-    }
+    char* scanBuf;
+    if (footerSize + kFooterTagSize <= tailSize) {
+        scanBuf = tailBuf + tailSize - footerSize - kFooterTagSize;
+    } else {
+        free(tailBuf);
+        tailBuf = (char*)malloc(footerSize);
+        if (tailBuf == NULL) {
+            ALOGW("couldn't allocate scanBuf: %s\n", strerror(errno));
+            return false;
+        }
+        scanBuf = tailBuf;
 
-    actual = TEMP_FAILURE_RETRY(read(fd, scanBuf, footerSize));
-    // readAmount is guaranteed to be less than kMaxBufSize
-    if (actual != (ssize_t)footerSize) {
-        ALOGI("couldn't read ObbFile footer: %s\n", strerror(errno));
-        free(scanBuf);
-        return false;
+        actual = TEMP_FAILURE_RETRY(pread64(fd, scanBuf, footerSize, fileOffset));
+        // readAmount is guaranteed to be less than kMaxBufSize
+        if (actual != (ssize_t)footerSize) {
+            ALOGI("couldn't read ObbFile footer: %s\n", strerror(errno));
+            free(tailBuf);
+            return false;
+        }
     }
 
 #ifdef DEBUG
@@ -193,7 +208,7 @@ bool ObbFile::parseObbFile(int fd)
     uint32_t sigVersion = get4LE((unsigned char*)scanBuf);
     if (sigVersion != kSigVersion) {
         ALOGW("Unsupported ObbFile version %d\n", sigVersion);
-        free(scanBuf);
+        free(tailBuf);
         return false;
     }
 
@@ -207,14 +222,14 @@ bool ObbFile::parseObbFile(int fd)
             || packageNameLen > (footerSize - kPackageNameOffset)) {
         ALOGW("bad ObbFile package name length (0x%04zx; 0x%04zx possible)\n",
                 packageNameLen, footerSize - kPackageNameOffset);
-        free(scanBuf);
+        free(tailBuf);
         return false;
     }
 
     char* packageName = reinterpret_cast<char*>(scanBuf + kPackageNameOffset);
     mPackageName = String8(const_cast<char*>(packageName), packageNameLen);
 
-    free(scanBuf);
+    free(tailBuf);
 
 #ifdef DEBUG
     ALOGI("Obb scan succeeded: packageName=%s, version=%d\n", mPackageName.string(), mVersion);
@@ -28,11 +28,15 @@
 #include <utils/TextOutput.h>
 #include <utils/misc.h>
 
+#include <cutils/atomic-inline.h>
+
 #include <stdlib.h>
 #include <string.h>
 #include <memory.h>
 #include <ctype.h>
+#include <errno.h>
 #include <stdint.h>
+#include <unistd.h>
 
 #ifndef INT32_MAX
 #define INT32_MAX ((int32_t)(2147483647))
@@ -66,7 +70,8 @@ namespace android {
 #endif
 #endif
 
-#define IDMAP_MAGIC         0x706d6469
+// "idm2": the header also records the modification time and size of the packages
+#define IDMAP_MAGIC         0x326d6469
 // size measured in sizeof(uint32_t)
 #define IDMAP_HEADER_SIZE (ResTable::IDMAP_HEADER_SIZE_BYTES / sizeof(uint32_t))
 
@@ -310,13 +315,20 @@ Res_png_9patch* Res_png_9patch::deserialize(const void* inData)
 // --------------------------------------------------------------------
 // --------------------------------------------------------------------
 
+// Strings of UTF-8 pools are decoded as they are used, the pointers to
+// their UTF-16 copies are only allocated for the chunks that are used.
+static const size_t STRING_CACHE_CHUNK_SHIFT = 6;
+static const size_t STRING_CACHE_CHUNK_SIZE = 1 << STRING_CACHE_CHUNK_SHIFT;
+
 ResStringPool::ResStringPool()
-    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL)
+    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL),
+      mStringIndex(NULL), mStringIndexMask(0)
 {
 }
 
 ResStringPool::ResStringPool(const void* data, size_t size, bool copyData)
-    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL)
+    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL),
+      mStringIndex(NULL), mStringIndexMask(0)
 {
     setTo(data, size, copyData);
 }
@@ -382,7 +394,6 @@ status_t ResStringPool::setTo(const void* data, size_t size, bool copyData)
         size_t charSize;
         if (mHeader->flags&ResStringPool_header::UTF8_FLAG) {
             charSize = sizeof(uint8_t);
-            mCache = (char16_t**)calloc(mHeader->stringCount, sizeof(char16_t**));
         } else {
             charSize = sizeof(char16_t);
         }
@@ -514,15 +525,28 @@ void ResStringPool::uninit()
         mOwnedData = NULL;
     }
     if (mHeader != NULL && mCache != NULL) {
-        for (size_t x = 0; x < mHeader->stringCount; x++) {
-            if (mCache[x] != NULL) {
-                free(mCache[x]);
-                mCache[x] = NULL;
+        const size_t chunkCount = (mHeader->stringCount+STRING_CACHE_CHUNK_SIZE-1)
+                >> STRING_CACHE_CHUNK_SHIFT;
+        for (size_t x = 0; x < chunkCount; x++) {
+            char16_t** chunk = mCache[x];
+            if (chunk == NULL) {
+                continue;
             }
+            for (size_t y = 0; y < STRING_CACHE_CHUNK_SIZE; y++) {
+                if (chunk[y] != NULL) {
+                    free(chunk[y]);
+                }
+            }
+            free(chunk);
         }
         free(mCache);
         mCache = NULL;
     }
+    if (mStringIndex != NULL) {
+        free(mStringIndex);
+        mStringIndex = NULL;
+        mStringIndexMask = 0;
+    }
 }
 
 /**
@@ -597,8 +621,27 @@ const uint16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
                 if ((uint32_t)(u8str+u8len-strings) < mStringPoolSize) {
                     AutoMutex lock(mDecodeLock);
 
-                    if (mCache[idx] != NULL) {
-                        return mCache[idx];
+                    if (mCache == NULL) {
+                        mCache = (char16_t***)calloc((mHeader->stringCount
+                                +STRING_CACHE_CHUNK_SIZE-1) >> STRING_CACHE_CHUNK_SHIFT,
+                                sizeof(char16_t**));
+                        if (mCache == NULL) {
+                            ALOGW("No memory when trying to allocate decode cache\n");
+                            return NULL;
+                        }
+                    }
+                    char16_t**& chunk = mCache[idx >> STRING_CACHE_CHUNK_SHIFT];
+                    if (chunk == NULL) {
+                        chunk = (char16_t**)calloc(STRING_CACHE_CHUNK_SIZE, sizeof(char16_t*));
+                        if (chunk == NULL) {
+                            ALOGW("No memory when trying to allocate decode cache for string #%d\n",
+                                    (int)idx);
+                            return NULL;
+                        }
+                    }
+                    char16_t*& cached = chunk[idx & (STRING_CACHE_CHUNK_SIZE-1)];
+                    if (cached != NULL) {
+                        return cached;
                     }
 
                     ssize_t actualLen = utf8_to_utf16_length(u8str, u8len);
@@ -617,7 +660,7 @@ const uint16_t* ResStringPool::stringAt(size_t idx, size_t* u16len) const
                     }
 
                     utf8_to_utf16(u8str, u8len, u16str);
-                    mCache[idx] = u16str;
+                    cached = u16str;
                     return u16str;
                 } else {
                     ALOGW("Bad string block: string #%lld extends to %lld, past end at %lld\n",
@@ -661,6 +704,33 @@ const char* ResStringPool::string8At(size_t idx, size_t* outLen) const
     return NULL;
 }
 
+const void* ResStringPool::rawStringAt(size_t idx, size_t* outLen) const
+{
+    if (mError == NO_ERROR && idx < mHeader->stringCount) {
+        const bool isUTF8 = (mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0;
+        const uint32_t off = mEntries[idx]/(isUTF8?sizeof(char):sizeof(char16_t));
+        if (off < (mStringPoolSize-1)) {
+            if (isUTF8) {
+                const uint8_t* strings = (uint8_t*)mStrings;
+                const uint8_t* str = strings+off;
+                decodeLength(&str);
+                *outLen = decodeLength(&str);
+                if ((uint32_t)(str+*outLen-strings) < mStringPoolSize) {
+                    return str;
+                }
+            } else {
+                const char16_t* strings = (char16_t*)mStrings;
+                const char16_t* str = strings+off;
+                *outLen = decodeLength(&str);
+                if ((uint32_t)(str+*outLen-strings) < mStringPoolSize) {
+                    return str;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
 const String8 ResStringPool::string8ObjectAt(size_t idx) const
 {
     size_t len;
@@ -691,6 +761,63 @@ const ResStringPool_span* ResStringPool::styleAt(size_t idx) const
     return NULL;
 }
 
+// Slots of the string index that hold no string.
+static const uint32_t STRING_INDEX_EMPTY = 0xffffffff;
+
+// FNV-1a, over the bytes of UTF-8 strings and the characters of UTF-16 strings.
+template<typename T>
+static inline uint32_t hashString(const T* str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ str[i]) * 16777619u;
+    }
+    return hash;
+}
+
+const uint32_t* ResStringPool::getStringIndex() const
+{
+    AutoMutex lock(mDecodeLock);
+
+    if (mStringIndex == NULL) {
+        const size_t N = mHeader->stringCount;
+        const bool isUTF8 = (mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0;
+
+        // Keep the table at most half full so that probe sequences stay short.
+        size_t size = 16;
+        while (size < N*2) {
+            size <<= 1;
+        }
+        uint32_t* index = (uint32_t*)malloc(size*sizeof(uint32_t));
+        if (index == NULL) {
+            ALOGW("No memory when trying to allocate the index of %d strings\n", (int)N);
+            return NULL;
+        }
+        memset(index, 0xff, size*sizeof(uint32_t));
+
+        // Strings are added from the back so that the last of several equal
+        // strings is found first, as a search from the back would.
+        for (size_t i=N; i>0; i--) {
+            size_t len;
+            const void* s = rawStringAt(i-1, &len);
+            if (s == NULL) {
+                continue;
+            }
+            const uint32_t hash = isUTF8 ? hashString((const uint8_t*)s, len)
+                    : hashString((const char16_t*)s, len);
+            size_t slot = hash & (size-1);
+            while (index[slot] != STRING_INDEX_EMPTY) {
+                slot = (slot+1) & (size-1);
+            }
+            index[slot] = i-1;
+        }
+
+        mStringIndexMask = size-1;
+        mStringIndex = index;
+    }
+    return mStringIndex;
+}
+
 ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
 {
     if (mError != NO_ERROR) {
@@ -725,7 +852,35 @@ ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
                 h = mid - 1;
             }
         }
+    } else if (const uint32_t* index = getStringIndex()) {
+        // Most pools are not sorted, look the string up in a hash table
+        // of the pool instead of comparing it with every string.
+        const bool isUTF8 = (mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0;
+        String8 str8;
+        uint32_t hash;
+        if (isUTF8) {
+            str8.setTo(str, strLen);
+            hash = hashString((const uint8_t*)str8.string(), str8.bytes());
+        } else {
+            hash = hashString(str, strLen);
+        }
+
+        for (size_t slot = hash & mStringIndexMask; index[slot] != STRING_INDEX_EMPTY;
+                slot = (slot+1) & mStringIndexMask) {
+            const uint32_t i = index[slot];
+            const void* s = rawStringAt(i, &len);
+            POOL_NOISY(printf("Looking for %s, at slot %d, i=%d\n",
+                         String8(str, strLen).string(), (int)slot, (int)i));
+            if (isUTF8) {
+                if (len == str8.bytes() && memcmp(s, str8.string(), len) == 0) {
+                    return i;
+                }
+            } else if (strzcmp16((const char16_t*)s, len, str, strLen) == 0) {
+                return i;
+            }
+        }
     } else {
+        // Out of memory for the index.
         // It is unusual to get the ID from an unsorted string block...
         // most often this happens because we want to get IDs for style
         // span tags; since those always appear at the end of the string
@@ -917,18 +1072,41 @@ size_t ResXMLParser::getAttributeCount() const
     return 0;
 }
 
-int32_t ResXMLParser::getAttributeNamespaceID(size_t idx) const
+const ResXMLTree_attribute* ResXMLParser::getAttributes(size_t* outCount,
+        size_t* outStride) const
+{
+    if (mEventCode == START_TAG) {
+        const ResXMLTree_attrExt* tag = (const ResXMLTree_attrExt*)mCurExt;
+        *outCount = dtohs(tag->attributeCount);
+        *outStride = dtohs(tag->attributeSize);
+        return (const ResXMLTree_attribute*)
+            (((const uint8_t*)tag) + dtohs(tag->attributeStart));
+    }
+    *outCount = 0;
+    *outStride = 0;
+    return NULL;
+}
+
+const ResXMLTree_attribute* ResXMLParser::attributeAt(size_t idx) const
 {
     if (mEventCode == START_TAG) {
         const ResXMLTree_attrExt* tag = (const ResXMLTree_attrExt*)mCurExt;
         if (idx < dtohs(tag->attributeCount)) {
-            const ResXMLTree_attribute* attr = (const ResXMLTree_attribute*)
+            return (const ResXMLTree_attribute*)
                 (((const uint8_t*)tag)
                  + dtohs(tag->attributeStart)
                  + (dtohs(tag->attributeSize)*idx));
-            return dtohl(attr->ns.index);
         }
     }
+    return NULL;
+}
+
+int32_t ResXMLParser::getAttributeNamespaceID(size_t idx) const
+{
+    const ResXMLTree_attribute* attr = attributeAt(idx);
+    if (attr != NULL) {
+        return dtohl(attr->ns.index);
+    }
     return -2;
 }
 
@@ -942,15 +1120,9 @@ const uint16_t* ResXMLParser::getAttributeNamespace(size_t idx, size_t* outLen)
 
 int32_t ResXMLParser::getAttributeNameID(size_t idx) const
 {
-    if (mEventCode == START_TAG) {
-        const ResXMLTree_attrExt* tag = (const ResXMLTree_attrExt*)mCurExt;
-        if (idx < dtohs(tag->attributeCount)) {
-            const ResXMLTree_attribute* attr = (const ResXMLTree_attribute*)
-                (((const uint8_t*)tag)
-                 + dtohs(tag->attributeStart)
-                 + (dtohs(tag->attributeSize)*idx));
-            return dtohl(attr->name.index);
-        }
+    const ResXMLTree_attribute* attr = attributeAt(idx);
+    if (attr != NULL) {
+        return dtohl(attr->name.index);
     }
     return -1;
 }
@@ -974,15 +1146,9 @@ uint32_t ResXMLParser::getAttributeNameResID(size_t idx) const
 
 int32_t ResXMLParser::getAttributeValueStringID(size_t idx) const
 {
-    if (mEventCode == START_TAG) {
-        const ResXMLTree_attrExt* tag = (const ResXMLTree_attrExt*)mCurExt;
-        if (idx < dtohs(tag->attributeCount)) {
-            const ResXMLTree_attribute* attr = (const ResXMLTree_attribute*)
-                (((const uint8_t*)tag)
-                 + dtohs(tag->attributeStart)
-                 + (dtohs(tag->attributeSize)*idx));
-            return dtohl(attr->rawValue.index);
-        }
+    const ResXMLTree_attribute* attr = attributeAt(idx);
+    if (attr != NULL) {
+        return dtohl(attr->rawValue.index);
     }
     return -1;
 }
@@ -996,46 +1162,28 @@ const uint16_t* ResXMLParser::getAttributeStringValue(size_t idx, size_t* outLen
 
 int32_t ResXMLParser::getAttributeDataType(size_t idx) const
 {
-    if (mEventCode == START_TAG) {
-        const ResXMLTree_attrExt* tag = (const ResXMLTree_attrExt*)mCurExt;
-        if (idx < dtohs(tag->attributeCount)) {
-            const ResXMLTree_attribute* attr = (const ResXMLTree_attribute*)
-                (((const uint8_t*)tag)
-                 + dtohs(tag->attributeStart)
-                 + (dtohs(tag->attributeSize)*idx));
-            return attr->typedValue.dataType;
-        }
+    const ResXMLTree_attribute* attr = attributeAt(idx);
+    if (attr != NULL) {
+        return attr->typedValue.dataType;
     }
     return Res_value::TYPE_NULL;
 }
 
 int32_t ResXMLParser::getAttributeData(size_t idx) const
 {
-    if (mEventCode == START_TAG) {
-        const ResXMLTree_attrExt* tag = (const ResXMLTree_attrExt*)mCurExt;
-        if (idx < dtohs(tag->attributeCount)) {
-            const ResXMLTree_attribute* attr = (const ResXMLTree_attribute*)
-                (((const uint8_t*)tag)
-                 + dtohs(tag->attributeStart)
-                 + (dtohs(tag->attributeSize)*idx));
-            return dtohl(attr->typedValue.data);
-        }
+    const ResXMLTree_attribute* attr = attributeAt(idx);
+    if (attr != NULL) {
+        return dtohl(attr->typedValue.data);
     }
     return 0;
 }
 
 ssize_t ResXMLParser::getAttributeValue(size_t idx, Res_value* outValue) const
 {
-    if (mEventCode == START_TAG) {
-        const ResXMLTree_attrExt* tag = (const ResXMLTree_attrExt*)mCurExt;
-        if (idx < dtohs(tag->attributeCount)) {
-            const ResXMLTree_attribute* attr = (const ResXMLTree_attribute*)
-                (((const uint8_t*)tag)
-                 + dtohs(tag->attributeStart)
-                 + (dtohs(tag->attributeSize)*idx));
-            outValue->copyFrom_dtoh(attr->typedValue);
-            return sizeof(Res_value);
-        }
+    const ResXMLTree_attribute* attr = attributeAt(idx);
+    if (attr != NULL) {
+        outValue->copyFrom_dtoh(attr->typedValue);
+        return sizeof(Res_value);
     }
     return BAD_TYPE;
 }
@@ -1119,7 +1267,7 @@ ResXMLParser::event_code_t ResXMLParser::nextNode()
             return (mEventCode=END_DOCUMENT);
         }
 
-        if (mTree.validateNode(next) != NO_ERROR) {
+        if (!mTree.mValidated && mTree.validateNode(next) != NO_ERROR) {
             mCurNode = NULL;
             return (mEventCode=BAD_DOCUMENT);
         }
@@ -1151,7 +1299,7 @@ ResXMLParser::event_code_t ResXMLParser::nextNode()
                 continue;
         }
         
-        if ((totalSize-headerSize) < minExtSize) {
+        if (!mTree.mValidated && (totalSize-headerSize) < minExtSize) {
             ALOGW("Bad XML block: header type 0x%x in node at 0x%x has size %d, need %d\n",
                  (int)dtohs(next->header.type),
                  (int)(((const uint8_t*)next)-((const uint8_t*)mTree.mHeader)),
@@ -1187,7 +1335,7 @@ static volatile int32_t gCount = 0;
 
 ResXMLTree::ResXMLTree()
     : ResXMLParser(*this)
-    , mError(NO_INIT), mOwnedData(NULL)
+    , mError(NO_INIT), mValidated(false), mOwnedData(NULL)
 {
     //ALOGI("Creating ResXMLTree %p #%d\n", this, android_atomic_inc(&gCount)+1);
     restart();
@@ -1195,7 +1343,7 @@ ResXMLTree::ResXMLTree()
 
 ResXMLTree::ResXMLTree(const void* data, size_t size, bool copyData)
     : ResXMLParser(*this)
-    , mError(NO_INIT), mOwnedData(NULL)
+    , mError(NO_INIT), mValidated(false), mOwnedData(NULL)
 {
     //ALOGI("Creating ResXMLTree %p #%d\n", this, android_atomic_inc(&gCount)+1);
     setTo(data, size, copyData);
@@ -1207,7 +1355,7 @@ ResXMLTree::~ResXMLTree()
     uninit();
 }
 
-status_t ResXMLTree::setTo(const void* data, size_t size, bool copyData)
+status_t ResXMLTree::setTo(const void* data, size_t size, bool copyData, bool validateAll)
 {
     uninit();
     mEventCode = START_DOCUMENT;
@@ -1291,11 +1439,29 @@ status_t ResXMLTree::setTo(const void* data, size_t size, bool copyData)
 
     mError = mStrings.getError();
 
+    // A tree that fails is still checked node by node, so that it can be
+    // parsed up to its first bad node like without validateAll.
+    if (mError == NO_ERROR && validateAll) {
+        mValidated = validateTree();
+    }
+
 done:
     restart();
     return mError;
 }
 
+bool ResXMLTree::validateTree()
+{
+    ResXMLParser parser(*this);
+    event_code_t code;
+    while ((code = parser.next()) != END_DOCUMENT) {
+        if (code == BAD_DOCUMENT) {
+            return false;
+        }
+    }
+    return true;
+}
+
 status_t ResXMLTree::getError() const
 {
     return mError;
@@ -1304,6 +1470,7 @@ status_t ResXMLTree::getError() const
 void ResXMLTree::uninit()
 {
     mError = NO_INIT;
+    mValidated = false;
     mStrings.uninit();
     if (mOwnedData) {
         free(mOwnedData);
@@ -1663,10 +1830,49 @@ bool ResTable_config::isMoreSpecificThan(const ResTable_config& o) const {
     return false;
 }
 
+// Returns a mask covering the bytes of 'x' that are not zero.
+static inline uint32_t nonZeroBytesMask(uint32_t x) {
+    // The high bit of each byte is set when any of its bits is
+    const uint32_t high = (((x & 0x7f7f7f7f) + 0x7f7f7f7f) | x) & 0x80808080;
+    return (high >> 7) * 0xff;
+}
+
+// Returns a mask covering the half words of 'x' that are not zero.
+static inline uint32_t nonZeroHalfWordsMask(uint32_t x) {
+    const uint32_t high = (((x & 0x7fff7fff) + 0x7fff7fff) | x) & 0x80008000;
+    return (high >> 15) * 0xffff;
+}
+
+// Masks of the byte fields of the packed words that match() requires to
+// be equal to the settings, built from the struct to be endian neutral.
+static inline uint32_t screenTypeExactMask() {
+    ResTable_config mask;
+    mask.screenType = 0;
+    mask.orientation = 0xff;
+    mask.touchscreen = 0xff;
+    return mask.screenType;
+}
+
+static inline uint32_t inputExactMask() {
+    ResTable_config mask;
+    mask.input = 0;
+    mask.keyboard = 0xff;
+    mask.navigation = 0xff;
+    return mask.input;
+}
+
 bool ResTable_config::isBetterThan(const ResTable_config& o,
         const ResTable_config* requested) const {
     if (requested) {
-        if (imsi || o.imsi) {
+        // Each group of fields can only decide when its packed word differs
+        // between the two configurations, so equal words are skipped whole.
+        if (imsi == o.imsi && locale == o.locale && screenType == o.screenType
+                && input == o.input && screenSize == o.screenSize && version == o.version
+                && screenConfig == o.screenConfig && screenSizeDp == o.screenSizeDp) {
+            return false;
+        }
+
+        if (imsi != o.imsi) {
             if ((mcc != o.mcc) && requested->mcc) {
                 return (mcc);
             }
@@ -1676,7 +1882,7 @@ bool ResTable_config::isBetterThan(const ResTable_config& o,
             }
         }
 
-        if (locale || o.locale) {
+        if (locale != o.locale) {
             if ((language[0] != o.language[0]) && requested->language[0]) {
                 return (language[0]);
             }
@@ -1686,7 +1892,7 @@ bool ResTable_config::isBetterThan(const ResTable_config& o,
             }
         }
 
-        if (smallestScreenWidthDp || o.smallestScreenWidthDp) {
+        if (smallestScreenWidthDp != o.smallestScreenWidthDp) {
             // The configuration closest to the actual size is best.
             // We assume that larger configs have already been filtered
             // out at this point.  That means we just want the largest one.
@@ -1695,7 +1901,7 @@ bool ResTable_config::isBetterThan(const ResTable_config& o,
             }
         }
 
-        if (screenSizeDp || o.screenSizeDp) {
+        if (screenSizeDp != o.screenSizeDp) {
             // "Better" is based on the sum of the difference between both
             // width and height from the requested dimensions.  We are
             // assuming the invalid configs (with smaller dimens) have
@@ -1721,7 +1927,7 @@ bool ResTable_config::isBetterThan(const ResTable_config& o,
             }
         }
 
-        if (screenLayout || o.screenLayout) {
+        if (screenLayout != o.screenLayout) {
             if (((screenLayout^o.screenLayout) & MASK_SCREENSIZE) != 0
                     && (requested->screenLayout & MASK_SCREENSIZE)) {
                 // A little backwards compatibility here: undefined is
@@ -1759,7 +1965,7 @@ bool ResTable_config::isBetterThan(const ResTable_config& o,
             return (orientation);
         }
 
-        if (uiMode || o.uiMode) {
+        if (uiMode != o.uiMode) {
             if (((uiMode^o.uiMode) & MASK_UI_MODE_TYPE) != 0
                     && (requested->uiMode & MASK_UI_MODE_TYPE)) {
                 return (uiMode & MASK_UI_MODE_TYPE);
@@ -1770,7 +1976,7 @@ bool ResTable_config::isBetterThan(const ResTable_config& o,
             }
         }
 
-        if (screenType || o.screenType) {
+        if (screenType != o.screenType) {
             if (density != o.density) {
                 // density is tough.  Any density is potentially useful
                 // because the system will scale it.  Scaling down
@@ -1809,7 +2015,7 @@ bool ResTable_config::isBetterThan(const ResTable_config& o,
             }
         }
 
-        if (input || o.input) {
+        if (input != o.input) {
             const int keysHidden = inputFlags & MASK_KEYSHIDDEN;
             const int oKeysHidden = o.inputFlags & MASK_KEYSHIDDEN;
             if (keysHidden != oKeysHidden) {
@@ -1848,7 +2054,7 @@ bool ResTable_config::isBetterThan(const ResTable_config& o,
             }
         }
 
-        if (screenSize || o.screenSize) {
+        if (screenSize != o.screenSize) {
             // "Better" is based on the sum of the difference between both
             // width and height from the requested dimensions.  We are
             // assuming the invalid configs (with smaller sizes) have
@@ -1871,7 +2077,7 @@ bool ResTable_config::isBetterThan(const ResTable_config& o,
             }
         }
 
-        if (version || o.version) {
+        if (version != o.version) {
             if ((sdkVersion != o.sdkVersion) && requested->sdkVersion) {
                 return (sdkVersion > o.sdkVersion);
             }
@@ -1888,13 +2094,17 @@ bool ResTable_config::isBetterThan(const ResTable_config& o,
 }
 
 bool ResTable_config::match(const ResTable_config& settings) const {
-    if (imsi != 0) {
-        if (mcc != 0 && mcc != settings.mcc) {
-            return false;
-        }
-        if (mnc != 0 && mnc != settings.mnc) {
-            return false;
-        }
+    // The fields that must be equal to the settings unless they are "any"
+    // are compared a word at a time, masking out the fields that are "any".
+    if (((imsi ^ settings.imsi) & nonZeroHalfWordsMask(imsi)) != 0) {
+        return false;
+    }
+    if (((screenType ^ settings.screenType) & nonZeroBytesMask(screenType)
+            & screenTypeExactMask()) != 0) {
+        return false;
+    }
+    if (((input ^ settings.input) & nonZeroBytesMask(input) & inputExactMask()) != 0) {
+        return false;
     }
     if (locale != 0) {
         if (language[0] != 0
@@ -1950,15 +2160,8 @@ bool ResTable_config::match(const ResTable_config& settings) const {
             return false;
         }
     }
-    if (screenType != 0) {
-        if (orientation != 0 && orientation != settings.orientation) {
-            return false;
-        }
-        // density always matches - we can scale it.  See isBetterThan
-        if (touchscreen != 0 && touchscreen != settings.touchscreen) {
-            return false;
-        }
-    }
+    // orientation and touchscreen are checked above, density always
+    // matches - we can scale it.  See isBetterThan
     if (input != 0) {
         const int keysHidden = inputFlags&MASK_KEYSHIDDEN;
         const int setKeysHidden = settings.inputFlags&MASK_KEYSHIDDEN;
@@ -1977,12 +2180,7 @@ bool ResTable_config::match(const ResTable_config& settings) const {
         if (navHidden != 0 && navHidden != setNavHidden) {
             return false;
         }
-        if (keyboard != 0 && keyboard != settings.keyboard) {
-            return false;
-        }
-        if (navigation != 0 && navigation != settings.navigation) {
-            return false;
-        }
+        // keyboard and navigation are checked above
     }
     if (screenSize != 0) {
         if (screenWidth != 0 && screenWidth > settings.screenWidth) {
@@ -2290,19 +2488,105 @@ struct ResTable::Header
     size_t                          resourceIDMapSize;
 };
 
+// Bags are published with release stores so that cached bags can be read
+// without holding the table lock, see ResTable::lockBag().
+template<typename T>
+static inline T* acquire_load_ptr(T* const* ptr)
+{
+    return (T*)android_atomic_acquire_load((volatile const int32_t*)ptr);
+}
+
+template<typename T>
+static inline void release_store_ptr(T** ptr, T* value)
+{
+    android_atomic_release_store((int32_t)value, (volatile int32_t*)ptr);
+}
+
+// Entries of ResTable::mEntryIndices hold the generation of the parameters
+// in their high 16 bits and the index of the best config in the low 16 bits.
+static const uint32_t ENTRY_INDEX_NO_MATCH = 0xffff;
+
+// Guards the lazy indexing of the configs of all the types, types are
+// shared between tables and each table has its own lock.
+static Mutex gTypeConfigsLock;
+
 struct ResTable::Type
 {
-    Type(const Header* _header, const Package* _package, size_t count)
-        : header(_header), package(_package), entryCount(count),
-          typeSpec(NULL), typeSpecFlags(NULL) { }
+    Type(const Header* _header, const Package* _package, uint8_t _id, size_t count)
+        : header(_header), package(_package), id(_id), entryCount(count),
+          typeSpec(NULL), typeSpecFlags(NULL), configChunks(NULL),
+          configChunksEnd(NULL), configsLoaded(0) { }
     const Header* const             header;
     const Package* const            package;
+    const uint8_t                   id;
     const size_t                    entryCount;
     const ResTable_typeSpec*        typeSpec;
     const uint32_t*                 typeSpecFlags;
-    Vector<const ResTable_type*>    configs;
+
+    // The type chunks of the package are only located when it is added,
+    // they are validated and indexed the first time the configs are used.
+    const uint8_t*                  configChunks;
+    const uint8_t*                  configChunksEnd;
+
+    const Vector<const ResTable_type*>& getConfigs() const {
+        if (android_atomic_acquire_load(&configsLoaded) == 0) {
+            AutoMutex _l(gTypeConfigsLock);
+            if (configsLoaded == 0) {
+                loadConfigs();
+                android_atomic_release_store(1, &configsLoaded);
+            }
+        }
+        return configs;
+    }
+
+private:
+    void loadConfigs() const;
+
+    mutable volatile int32_t        configsLoaded;
+    mutable Vector<const ResTable_type*> configs;
 };
 
+void ResTable::Type::loadConfigs() const
+{
+    const ResChunk_header* chunk = (const ResChunk_header*)configChunks;
+    while (chunk != NULL && ((const uint8_t*)chunk) < configChunksEnd) {
+        // The chunk sizes were checked when the package was added
+        const size_t csize = dtohl(chunk->size);
+        const ResTable_type* type = (const ResTable_type*)(chunk);
+        if (dtohs(chunk->type) != RES_TABLE_TYPE_TYPE || type->id != id) {
+            chunk = (const ResChunk_header*)(((const uint8_t*)chunk) + csize);
+            continue;
+        }
+
+        const size_t typeSize = dtohl(type->header.size);
+
+        LOAD_TABLE_NOISY(printf("Type off %p: type=0x%x, headerSize=0x%x, size=%p\n",
+                                (void*)(((const uint8_t*)chunk)-(const uint8_t*)package->package),
+                                dtohs(type->header.type),
+                                dtohs(type->header.headerSize),
+                                (void*)typeSize));
+        if (dtohs(type->header.headerSize)+(sizeof(uint32_t)*dtohl(type->entryCount))
+            > typeSize) {
+            ALOGW("ResTable_type entry index to %p extends beyond chunk end %p.",
+                 (void*)(dtohs(type->header.headerSize)
+                         +(sizeof(uint32_t)*dtohl(type->entryCount))),
+                 (void*)typeSize);
+        } else if (dtohl(type->entryCount) != 0
+            && dtohl(type->entriesStart) > (typeSize-sizeof(ResTable_entry))) {
+            ALOGW("ResTable_type entriesStart at %p extends beyond chunk end %p.",
+                 (void*)dtohl(type->entriesStart), (void*)typeSize);
+        } else {
+            TABLE_GETENTRY(
+                ResTable_config thisConfig;
+                thisConfig.copyFromDtoH(type->config);
+                ALOGI("Adding config to type %d: %s\n",
+                      type->id, thisConfig.toString().string()));
+            configs.add(type);
+        }
+        chunk = (const ResChunk_header*)(((const uint8_t*)chunk) + csize);
+    }
+}
+
 struct ResTable::Package
 {
     Package(ResTable* _owner, const Header* _header, const ResTable_package* _package)
@@ -2348,6 +2632,16 @@ struct ResTable::PackageGroup
     }
 
     void clearBagCache() {
+        Vector<void*> memory;
+        takeBagCache(memory);
+        for (size_t i=0; i<memory.size(); i++) {
+            free(memory[i]);
+        }
+    }
+
+    // Unpublishes the bags and adds their memory to the specified vector,
+    // readers may still be using them, see ResTable::setParameters()
+    void takeBagCache(Vector<void*>& memory) {
         if (bags) {
             TABLE_NOISY(printf("bags=%p\n", bags));
             Package* pkg = packages[0];
@@ -2363,14 +2657,14 @@ struct ResTable::PackageGroup
                         const size_t N = type->entryCount;
                         for (size_t j=0; j<N; j++) {
                             if (typeBags[j] && typeBags[j] != (bag_set*)0xFFFFFFFF)
-                                free(typeBags[j]);
+                                memory.add(typeBags[j]);
                         }
-                        free(typeBags);
+                        memory.add(typeBags);
                     }
                 }
             }
-            free(bags);
-            bags = NULL;
+            memory.add(bags);
+            android_atomic_release_store(0, (volatile int32_t*)&bags);
         }
     }
     
@@ -2445,6 +2739,9 @@ ResTable::Theme::package_info* ResTable::Theme::copy_package(package_info* pi)
     return newpi;
 }
 
+// Bounds the memory used by a theme that gets asked for arbitrary identifiers.
+static const size_t MAX_THEME_ATTR_CACHE_SIZE = 1024;
+
 status_t ResTable::Theme::applyStyle(uint32_t resID, bool force)
 {
     const bag_entry* bag;
@@ -2471,6 +2768,11 @@ status_t ResTable::Theme::applyStyle(uint32_t resID, bool force)
     size_t numEntries = 0;
     theme_entry* curEntries = NULL;
 
+    // Only the attributes the style changes are forgotten, along with the
+    // results that went through other attributes.
+    AutoMutex _l(mCacheLock);
+    bool changed = false;
+
     const bag_entry* end = bag + N;
     while (bag < end) {
         const uint32_t attrRes = bag->map.name.ident;
@@ -2531,11 +2833,23 @@ status_t ResTable::Theme::applyStyle(uint32_t resID, bool force)
             curEntry->stringBlock = bag->stringBlock;
             curEntry->typeSpecFlags |= bagTypeSpecFlags;
             curEntry->value = bag->map.value;
+            if (!mAttrCache.isEmpty()) {
+                mAttrCache.removeItem(attrRes);
+            }
+            changed = true;
         }
 
         bag++;
     }
 
+    if (changed) {
+        for (size_t i = mAttrCache.size(); i > 0; i--) {
+            if (mAttrCache.valueAt(i - 1).chained) {
+                mAttrCache.removeItemsAt(i - 1);
+            }
+        }
+    }
+
     mTable.unlock();
 
     //ALOGI("Applying style 0x%08x (force=%d)  theme %p...\n", resID, force, this);
@@ -2551,6 +2865,12 @@ status_t ResTable::Theme::setTo(const Theme& other)
     //other.dumpToLog();
     
     if (&mTable == &other.mTable) {
+        if (this != &other) {
+            AutoMutex _l(mCacheLock);
+            AutoMutex _ol(other.mCacheLock);
+            mAttrCache = other.mAttrCache;
+        }
+
         for (size_t i=0; i<Res_MAXPACKAGE; i++) {
             if (mPackages[i] != NULL) {
                 free_package(mPackages[i]);
@@ -2565,6 +2885,10 @@ status_t ResTable::Theme::setTo(const Theme& other)
         // @todo: need to really implement this, not just copy
         // the system package (which is still wrong because it isn't
         // fixing up resource references).
+        {
+            AutoMutex _l(mCacheLock);
+            mAttrCache.clear();
+        }
         for (size_t i=0; i<Res_MAXPACKAGE; i++) {
             if (mPackages[i] != NULL) {
                 free_package(mPackages[i]);
@@ -2583,12 +2907,57 @@ status_t ResTable::Theme::setTo(const Theme& other)
     return NO_ERROR;
 }
 
+void ResTable::Theme::lock() const
+{
+    mCacheLock.lock();
+}
+
+void ResTable::Theme::unlock() const
+{
+    mCacheLock.unlock();
+}
+
 ssize_t ResTable::Theme::getAttribute(uint32_t resID, Res_value* outValue,
         uint32_t* outTypeSpecFlags) const
+{
+    AutoMutex _l(mCacheLock);
+    return getAttributeLocked(resID, outValue, outTypeSpecFlags);
+}
+
+ssize_t ResTable::Theme::getAttributeLocked(uint32_t resID, Res_value* outValue,
+        uint32_t* outTypeSpecFlags) const
+{
+    const ssize_t idx = mAttrCache.indexOfKey(resID);
+    if (idx >= 0) {
+        const attr_cache_entry& entry = mAttrCache.valueAt(idx);
+        if (outTypeSpecFlags != NULL) *outTypeSpecFlags = entry.typeSpecFlags;
+        if (entry.result >= 0) *outValue = entry.value;
+        return entry.result;
+    }
+
+    // Only reads the theme and the package map of the table, which does
+    // not need the table lock.
+    attr_cache_entry entry;
+    entry.typeSpecFlags = 0;
+    entry.chained = false;
+    entry.result = findAttribute(resID, &entry.value, &entry.typeSpecFlags, &entry.chained);
+
+    if (outTypeSpecFlags != NULL) *outTypeSpecFlags = entry.typeSpecFlags;
+    if (entry.result >= 0) *outValue = entry.value;
+
+    if (mAttrCache.size() < MAX_THEME_ATTR_CACHE_SIZE) {
+        mAttrCache.add(resID, entry);
+    }
+    return entry.result;
+}
+
+ssize_t ResTable::Theme::findAttribute(uint32_t resID, Res_value* outValue,
+        uint32_t* outTypeSpecFlags, bool* outChained) const
 {
     int cnt = 20;
 
-    if (outTypeSpecFlags != NULL) *outTypeSpecFlags = 0;
+    *outTypeSpecFlags = 0;
+    *outChained = false;
     
     do {
         const ssize_t p = mTable.getResourcePackageIndex(resID);
@@ -2607,9 +2976,7 @@ ssize_t ResTable::Theme::getAttribute(uint32_t resID, Res_value* outValue,
                     TABLE_THEME(ALOGI("Desired entry index is %ld in avail %d", e, ti.numEntries));
                     if (e < ti.numEntries) {
                         const theme_entry& te = ti.entries[e];
-                        if (outTypeSpecFlags != NULL) {
-                            *outTypeSpecFlags |= te.typeSpecFlags;
-                        }
+                        *outTypeSpecFlags |= te.typeSpecFlags;
                         TABLE_THEME(ALOGI("Theme value: type=0x%x, data=0x%08x",
                                 te.value.dataType, te.value.data));
                         const uint8_t type = te.value.dataType;
@@ -2617,6 +2984,7 @@ ssize_t ResTable::Theme::getAttribute(uint32_t resID, Res_value* outValue,
                             if (cnt > 0) {
                                 cnt--;
                                 resID = te.value.data;
+                                *outChained = true;
                                 continue;
                             }
                             ALOGW("Too many attribute references, stopped at: 0x%08x\n", resID);
@@ -2640,11 +3008,20 @@ ssize_t ResTable::Theme::getAttribute(uint32_t resID, Res_value* outValue,
 ssize_t ResTable::Theme::resolveAttributeReference(Res_value* inOutValue,
         ssize_t blockIndex, uint32_t* outLastRef,
         uint32_t* inoutTypeSpecFlags, ResTable_config* inoutConfig) const
+{
+    AutoMutex _l(mCacheLock);
+    return resolveAttributeReferenceLocked(inOutValue, blockIndex, outLastRef,
+            inoutTypeSpecFlags, inoutConfig);
+}
+
+ssize_t ResTable::Theme::resolveAttributeReferenceLocked(Res_value* inOutValue,
+        ssize_t blockIndex, uint32_t* outLastRef,
+        uint32_t* inoutTypeSpecFlags, ResTable_config* inoutConfig) const
 {
     //printf("Resolving type=0x%x\n", inOutValue->dataType);
     if (inOutValue->dataType == Res_value::TYPE_ATTRIBUTE) {
         uint32_t newTypeSpecFlags;
-        blockIndex = getAttribute(inOutValue->data, inOutValue, &newTypeSpecFlags);
+        blockIndex = getAttributeLocked(inOutValue->data, inOutValue, &newTypeSpecFlags);
         TABLE_THEME(ALOGI("Resolving attr reference: blockIndex=%d, type=0x%x, data=%p\n",
              (int)blockIndex, (int)inOutValue->dataType, (void*)inOutValue->data));
         if (inoutTypeSpecFlags != NULL) *inoutTypeSpecFlags |= newTypeSpecFlags;
@@ -2682,18 +3059,22 @@ void ResTable::Theme::dumpToLog() const
 }
 
 ResTable::ResTable()
-    : mError(NO_INIT)
+    : mError(NO_INIT), mEntryIndexGeneration(1), mBagReaders(0), mBagCache(NULL),
+      mBagCacheMatches(false), mHasUnmappedRedirections(false)
 {
     memset(&mParams, 0, sizeof(mParams));
     memset(mPackageMap, 0, sizeof(mPackageMap));
+    memset(mRedirectionByPackage, 0, sizeof(mRedirectionByPackage));
     //ALOGI("Creating ResTable %p\n", this);
 }
 
 ResTable::ResTable(const void* data, size_t size, void* cookie, bool copyData)
-    : mError(NO_INIT)
+    : mError(NO_INIT), mEntryIndexGeneration(1), mBagReaders(0), mBagCache(NULL),
+      mBagCacheMatches(false), mHasUnmappedRedirections(false)
 {
     memset(&mParams, 0, sizeof(mParams));
     memset(mPackageMap, 0, sizeof(mPackageMap));
+    memset(mRedirectionByPackage, 0, sizeof(mRedirectionByPackage));
     add(data, size, cookie, copyData);
     LOG_FATAL_IF(mError != NO_ERROR, "Error parsing resource table");
     //ALOGI("Creating ResTable %p\n", this);
@@ -2747,6 +3128,11 @@ status_t ResTable::add(ResTable* src)
     }
     
     memcpy(mPackageMap, src->mPackageMap, sizeof(mPackageMap));
+
+    if (mBagCache == NULL && src->mBagCache != NULL) {
+        mBagCache = src->mBagCache;
+        updateBagCacheMatch();
+    }
     
     return mError;
 }
@@ -2905,7 +3291,12 @@ void ResTable::uninit()
     mPackageGroups.clear();
     mHeaders.clear();
 
+    clearEntryIndices();
+    freeRetiredBags();
     clearRedirections();
+
+    mBagCache = NULL;
+    mBagCacheMatches = false;
 }
 
 bool ResTable::getResourceName(uint32_t resID, resource_name* outName) const
@@ -3171,9 +3562,17 @@ uint32_t ResTable::lookupRedirectionMap(uint32_t resID) const
 
     const int p = Res_GETPACKAGE(resID)+1;
 
+    PackageRedirectionMap* resMap = mRedirectionByPackage[p & 0xff];
+    if (resMap != NULL) {
+        return resMap->lookupRedirection(resID);
+    }
+    if (!mHasUnmappedRedirections) {
+        return 0;
+    }
+
     const size_t N = mRedirectionMap.size();
     for (size_t i=0; i<N; i++) {
-        PackageRedirectionMap* resMap = mRedirectionMap[i];
+        resMap = mRedirectionMap[i];
         if (resMap->getPackage() == p) {
             return resMap->lookupRedirection(resID);
         }
@@ -3197,11 +3596,22 @@ const char16_t* ResTable::valueToString(
 
 ssize_t ResTable::lockBag(uint32_t resID, const bag_entry** outBag) const
 {
+    // The bags are not freed while they have readers, see setParameters()
+    android_atomic_inc(&mBagReaders);
+    ANDROID_MEMBAR_FULL();
+
+    // Bags that were already computed do not need the lock
+    ssize_t err = getCachedBag(resID, outBag, NULL);
+    if (err >= NO_ERROR) {
+        return err;
+    }
+
     mLock.lock();
-    ssize_t err = getBagLocked(resID, outBag);
+    err = getBagLocked(resID, outBag);
+    mLock.unlock();
     if (err < NO_ERROR) {
         //printf("*** get failed!  unlocking\n");
-        mLock.unlock();
+        android_atomic_dec(&mBagReaders);
     }
     return err;
 }
@@ -3209,7 +3619,61 @@ ssize_t ResTable::lockBag(uint32_t resID, const bag_entry** outBag) const
 void ResTable::unlockBag(const bag_entry* bag) const
 {
     //printf("<<< unlockBag %p\n", this);
-    mLock.unlock();
+    android_atomic_dec(&mBagReaders);
+}
+
+ssize_t ResTable::getCachedBag(uint32_t resID, const bag_entry** outBag,
+        uint32_t* outTypeSpecFlags) const
+{
+    if (mError != NO_ERROR) {
+        return mError;
+    }
+
+    const ssize_t p = getResourcePackageIndex(resID);
+    const int t = Res_GETTYPE(resID);
+    const int e = Res_GETENTRY(resID);
+    if (p < 0 || t < 0) {
+        return BAD_INDEX;
+    }
+
+    const PackageGroup* const grp = mPackageGroups[p];
+    if (grp == NULL || t >= (int)grp->typeCount) {
+        return BAD_INDEX;
+    }
+
+    const Type* const typeConfigs = grp->packages[0]->getType(t);
+    if (typeConfigs == NULL || e >= (int)typeConfigs->entryCount) {
+        return BAD_INDEX;
+    }
+
+    const bag_set* const sharedSet = getSharedBag(grp, t, e);
+    if (sharedSet != NULL) {
+        if (outTypeSpecFlags != NULL) {
+            *outTypeSpecFlags = sharedSet->typeSpecFlags;
+        }
+        *outBag = (const bag_entry*)(sharedSet+1);
+        return sharedSet->numAttrs;
+    }
+
+    bag_set** const* const bags = acquire_load_ptr(&grp->bags);
+    if (bags == NULL) {
+        return NAME_NOT_FOUND;
+    }
+    bag_set* const* const typeSet = acquire_load_ptr(&bags[t]);
+    if (typeSet == NULL) {
+        return NAME_NOT_FOUND;
+    }
+    // The bag may be in the process of being computed
+    const bag_set* const set = acquire_load_ptr(&typeSet[e]);
+    if (set == NULL || set == (bag_set*)0xFFFFFFFF) {
+        return NAME_NOT_FOUND;
+    }
+
+    if (outTypeSpecFlags != NULL) {
+        *outTypeSpecFlags = set->typeSpecFlags;
+    }
+    *outBag = (const bag_entry*)(set+1);
+    return set->numAttrs;
 }
 
 void ResTable::lock() const
@@ -3267,6 +3731,15 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
     }
 
     // First see if we've already computed this bag...
+    const bag_set* const sharedSet = getSharedBag(grp, t, e);
+    if (sharedSet != NULL) {
+        if (outTypeSpecFlags != NULL) {
+            *outTypeSpecFlags = sharedSet->typeSpecFlags;
+        }
+        *outBag = (const bag_entry*)(sharedSet+1);
+        return sharedSet->numAttrs;
+    }
+
     if (grp->bags) {
         bag_set** typeSet = grp->bags[t];
         if (typeSet) {
@@ -3289,15 +3762,16 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
 
     // Bag not found, we need to compute it!
     if (!grp->bags) {
-        grp->bags = (bag_set***)calloc(grp->typeCount, sizeof(bag_set*));
-        if (!grp->bags) return NO_MEMORY;
+        bag_set*** bags = (bag_set***)calloc(grp->typeCount, sizeof(bag_set*));
+        if (!bags) return NO_MEMORY;
+        release_store_ptr(&grp->bags, bags);
     }
 
     bag_set** typeSet = grp->bags[t];
     if (!typeSet) {
         typeSet = (bag_set**)calloc(NENTRY, sizeof(bag_set*));
         if (!typeSet) return NO_MEMORY;
-        grp->bags[t] = typeSet;
+        release_store_ptr(&grp->bags[t], typeSet);
     }
 
     // Mark that we are currently working on this one.
@@ -3509,7 +3983,7 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
     }
 
     // And this is it...
-    typeSet[e] = set;
+    release_store_ptr(&typeSet[e], set);
     if (set) {
         if (outTypeSpecFlags != NULL) {
             *outTypeSpecFlags = set->typeSpecFlags;
@@ -3525,14 +3999,308 @@ void ResTable::setParameters(const ResTable_config* params)
 {
     mLock.lock();
     TABLE_GETENTRY(ALOGI("Setting parameters: %s\n", params->toString().string()));
+    if (memcmp(&mParams, params, sizeof(mParams)) != 0) {
+        invalidateEntryIndices();
+    }
     mParams = *params;
+    updateBagCacheMatch();
     for (size_t i=0; i<mPackageGroups.size(); i++) {
         TABLE_NOISY(ALOGI("CLEARING BAGS FOR GROUP %d!", i));
-        mPackageGroups[i]->clearBagCache();
+        mPackageGroups[i]->takeBagCache(mRetiredBags);
+    }
+    // Bags returned by lockBag() stay valid until unlockBag(), the memory
+    // is reclaimed the next time the parameters are set without readers
+    ANDROID_MEMBAR_FULL();
+    if (android_atomic_acquire_load(&mBagReaders) == 0) {
+        freeRetiredBags();
     }
+    updateEntryIndices();
     mLock.unlock();
 }
 
+void ResTable::freeRetiredBags()
+{
+    for (size_t i=0; i<mRetiredBags.size(); i++) {
+        free(mRetiredBags[i]);
+    }
+    mRetiredBags.clear();
+}
+
+// --------------------------------------------------------------------
+// Bag cache files
+// --------------------------------------------------------------------
+
+#define BAG_CACHE_MAGIC     0x67616272 // "rbag"
+#define BAG_CACHE_VERSION   1
+
+// A bag cache file starts with this header, followed by the offsets of the
+// entry tables of every type, 0 for types without bags.  An entry table is
+// the number of entries of the type followed by the offset of the bag_set
+// of every entry, 0 for entries that are not bags.  Offsets are relative to
+// the start of the file.
+struct bag_cache_header
+{
+    uint32_t magic;
+    uint32_t version;
+    // CRC of the resources.arsc the bags were computed from
+    uint32_t sourceCrc;
+    uint32_t packageId;
+    // Index of the package header, used as the string block of the bags
+    uint32_t headerIndex;
+    uint32_t typeCount;
+    uint32_t bagSetSize;
+    uint32_t bagEntrySize;
+    // Parameters the bags were computed for
+    ResTable_config config;
+};
+
+static inline void append_u32(Vector<uint8_t>& data, uint32_t value)
+{
+    data.appendArray((const uint8_t*)&value, sizeof(value));
+}
+
+static inline void set_u32(Vector<uint8_t>& data, size_t offset, uint32_t value)
+{
+    memcpy(data.editArray() + offset, &value, sizeof(value));
+}
+
+status_t ResTable::writeBagCache(uint32_t packageId, uint32_t sourceCrc, int fd) const
+{
+    AutoMutex _l(mLock);
+
+    if (mError != NO_ERROR) {
+        return mError;
+    }
+    const ssize_t p = getResourcePackageIndex(Res_MAKEID(packageId-1, 0, 0));
+    if (p < 0) {
+        return BAD_INDEX;
+    }
+
+    // Overlays and redirections change the bags independently of the table
+    const PackageGroup* const grp = mPackageGroups[p];
+    if (grp->packages.size() != 1 || !mRedirectionMap.isEmpty()) {
+        return INVALID_OPERATION;
+    }
+    const Package* const package = grp->packages[0];
+
+    bag_cache_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = BAG_CACHE_MAGIC;
+    header.version = BAG_CACHE_VERSION;
+    header.sourceCrc = sourceCrc;
+    header.packageId = packageId;
+    header.headerIndex = package->header->index;
+    header.typeCount = grp->typeCount;
+    header.bagSetSize = sizeof(bag_set);
+    header.bagEntrySize = sizeof(bag_entry);
+    header.config = mParams;
+
+    Vector<uint8_t> data;
+    data.appendArray((const uint8_t*)&header, sizeof(header));
+    const size_t typeOffsets = data.size();
+    for (size_t t=0; t<grp->typeCount; t++) {
+        append_u32(data, 0);
+    }
+
+    size_t bagCount = 0;
+    for (size_t t=0; t<grp->typeCount; t++) {
+        const Type* const type = package->getType(t);
+        if (type == NULL) {
+            continue;
+        }
+
+        Vector<uint32_t> bagOffsets;
+        bagOffsets.insertAt(0, 0, type->entryCount);
+        bool hasBags = false;
+
+        for (size_t e=0; e<type->entryCount; e++) {
+            const ResTable_type* entryType;
+            const ResTable_entry* entry;
+            if (getEntry(package, t, e, &mParams, &entryType, &entry, NULL) <= 0
+                    || (dtohs(entry->flags)&ResTable_entry::FLAG_COMPLEX) == 0) {
+                continue;
+            }
+
+            const bag_entry* bag;
+            uint32_t typeSpecFlags = 0;
+            const ssize_t N = getBagLocked(Res_MAKEID(packageId-1, t, e), &bag, &typeSpecFlags);
+            if (N < 0) {
+                continue;
+            }
+
+            bag_set set;
+            set.numAttrs = N;
+            set.availAttrs = N;
+            set.typeSpecFlags = typeSpecFlags;
+            bagOffsets.editItemAt(e) = data.size();
+            data.appendArray((const uint8_t*)&set, sizeof(set));
+            data.appendArray((const uint8_t*)bag, N*sizeof(bag_entry));
+            hasBags = true;
+            bagCount++;
+        }
+
+        if (hasBags) {
+            set_u32(data, typeOffsets + t*sizeof(uint32_t), data.size());
+            append_u32(data, type->entryCount);
+            data.appendArray((const uint8_t*)bagOffsets.array(),
+                    bagOffsets.size()*sizeof(uint32_t));
+        }
+    }
+
+    const uint8_t* pos = data.array();
+    size_t remaining = data.size();
+    while (remaining > 0) {
+        const ssize_t written = TEMP_FAILURE_RETRY(write(fd, pos, remaining));
+        if (written <= 0) {
+            ALOGW("Failed to write bag cache: %s", strerror(errno));
+            return UNKNOWN_ERROR;
+        }
+        pos += written;
+        remaining -= written;
+    }
+
+    TABLE_NOISY(ALOGI("Wrote %d bags of package 0x%02x (%d bytes)\n",
+            (int)bagCount, packageId, (int)data.size()));
+    return NO_ERROR;
+}
+
+status_t ResTable::setBagCache(const void* data, size_t size, uint32_t sourceCrc)
+{
+    AutoMutex _l(mLock);
+
+    const uint8_t* const base = (const uint8_t*)data;
+    const bag_cache_header* const header = (const bag_cache_header*)data;
+    if (size < sizeof(*header) || header->magic != BAG_CACHE_MAGIC
+            || header->version != BAG_CACHE_VERSION || header->sourceCrc != sourceCrc
+            || header->bagSetSize != sizeof(bag_set)
+            || header->bagEntrySize != sizeof(bag_entry)) {
+        ALOGW("Ignoring invalid or stale bag cache");
+        return BAD_TYPE;
+    }
+
+    const ssize_t p = header->packageId > 0 && header->packageId < 256
+            ? getResourcePackageIndex(Res_MAKEID(header->packageId-1, 0, 0)) : -1;
+    if (p < 0) {
+        return BAD_INDEX;
+    }
+    const PackageGroup* const grp = mPackageGroups[p];
+    if (header->typeCount != grp->typeCount
+            || header->headerIndex != grp->packages[0]->header->index
+            || size < sizeof(*header) + header->typeCount*sizeof(uint32_t)) {
+        ALOGW("Bag cache does not match package 0x%02x", header->packageId);
+        return BAD_TYPE;
+    }
+
+    // Check every offset once so that lookups do not have to
+    const uint32_t* const typeOffsets = (const uint32_t*)(header+1);
+    for (size_t t=0; t<header->typeCount; t++) {
+        const uint32_t typeOffset = typeOffsets[t];
+        if (typeOffset == 0) {
+            continue;
+        }
+        const Type* const type = grp->packages[0]->getType(t);
+        if (type == NULL || (typeOffset&0x3) != 0 || typeOffset > size - sizeof(uint32_t)) {
+            return BAD_TYPE;
+        }
+        const uint32_t* const entries = (const uint32_t*)(base + typeOffset);
+        const uint32_t entryCount = entries[0];
+        if (entryCount != type->entryCount
+                || entryCount > (size - typeOffset)/sizeof(uint32_t) - 1) {
+            return BAD_TYPE;
+        }
+        for (size_t e=0; e<entryCount; e++) {
+            const uint32_t offset = entries[e+1];
+            if (offset == 0) {
+                continue;
+            }
+            if ((offset&0x3) != 0 || offset > size - sizeof(bag_set)) {
+                return BAD_TYPE;
+            }
+            const bag_set* const set = (const bag_set*)(base + offset);
+            if (set->numAttrs > (size - offset - sizeof(bag_set))/sizeof(bag_entry)) {
+                return BAD_TYPE;
+            }
+        }
+    }
+
+    mBagCache = base;
+    updateBagCacheMatch();
+    return NO_ERROR;
+}
+
+void ResTable::updateBagCacheMatch()
+{
+    mBagCacheMatches = mBagCache != NULL && memcmp(&mParams,
+            &((const bag_cache_header*)mBagCache)->config, sizeof(mParams)) == 0;
+}
+
+const ResTable::bag_set* ResTable::getSharedBag(const PackageGroup* grp, int t, int e) const
+{
+    if (!mBagCacheMatches) {
+        return NULL;
+    }
+
+    const bag_cache_header* const header = (const bag_cache_header*)mBagCache;
+    if (grp->id != header->packageId || grp->packages.size() != 1
+            || !mRedirectionMap.isEmpty() || (uint32_t)t >= header->typeCount) {
+        return NULL;
+    }
+
+    const uint32_t typeOffset = ((const uint32_t*)(header+1))[t];
+    if (typeOffset == 0) {
+        return NULL;
+    }
+    const uint32_t* const entries = (const uint32_t*)(mBagCache + typeOffset);
+    if ((uint32_t)e >= entries[0] || entries[e+1] == 0) {
+        return NULL;
+    }
+    return (const bag_set*)(mBagCache + entries[e+1]);
+}
+
+void ResTable::updateEntryIndices()
+{
+    // Tables can be added after the parameters are set, the types of
+    // the new packages are indexed the next time the parameters are set
+    for (size_t i=0; i<mPackageGroups.size(); i++) {
+        const PackageGroup* group = mPackageGroups[i];
+        for (size_t j=0; j<group->packages.size(); j++) {
+            const Package* package = group->packages[j];
+            for (size_t k=0; k<package->types.size(); k++) {
+                const Type* type = package->types[k];
+                if (type == NULL || type->entryCount == 0
+                        || mEntryIndices.indexOfKey(type) >= 0) {
+                    continue;
+                }
+                uint32_t* bestConfigs = (uint32_t*)calloc(type->entryCount, sizeof(uint32_t));
+                if (bestConfigs != NULL) {
+                    mEntryIndices.add(type, bestConfigs);
+                }
+            }
+        }
+    }
+}
+
+void ResTable::invalidateEntryIndices()
+{
+    // Entries of previous generations are ignored by getEntry()
+    mEntryIndexGeneration = (mEntryIndexGeneration + 1) & 0xffff;
+    if (mEntryIndexGeneration == 0) {
+        for (size_t i=0; i<mEntryIndices.size(); i++) {
+            memset(mEntryIndices.valueAt(i), 0,
+                    mEntryIndices.keyAt(i)->entryCount * sizeof(uint32_t));
+        }
+        mEntryIndexGeneration = 1;
+    }
+}
+
+void ResTable::clearEntryIndices()
+{
+    for (size_t i=0; i<mEntryIndices.size(); i++) {
+        free(mEntryIndices.valueAt(i));
+    }
+    mEntryIndices.clear();
+}
+
 void ResTable::getParameters(ResTable_config* params) const
 {
     mLock.lock();
@@ -3688,14 +4456,15 @@ nope:
         TABLE_NOISY(printf("Search indices: type=%d, name=%d\n", ti, ei));
 
         const Type* const typeConfigs = group->packages[0]->getType(ti);
-        if (typeConfigs == NULL || typeConfigs->configs.size() <= 0) {
+        if (typeConfigs == NULL || typeConfigs->getConfigs().size() <= 0) {
             TABLE_NOISY(printf("Expected type structure not found in package %s for idnex %d\n",
                                String8(group->name).string(), ti));
         }
         
-        size_t NTC = typeConfigs->configs.size();
+        const Vector<const ResTable_type*>& configs = typeConfigs->getConfigs();
+        size_t NTC = configs.size();
         for (size_t tci=0; tci<NTC; tci++) {
-            const ResTable_type* const ty = typeConfigs->configs[tci];
+            const ResTable_type* const ty = configs[tci];
             const uint32_t typeOffset = dtohl(ty->entriesStart);
 
             const uint8_t* const end = ((const uint8_t*)ty) + dtohl(ty->header.size);
@@ -4793,9 +5562,10 @@ void ResTable::getConfigurations(Vector<ResTable_config>* configs) const
             for (size_t k=0; k<K; k++) {
                 const Type* type = package->types[k];
                 if (type == NULL) continue;
-                const size_t L = type->configs.size();
+                const Vector<const ResTable_type*>& typeConfigs = type->getConfigs();
+                const size_t L = typeConfigs.size();
                 for (size_t l=0; l<L; l++) {
-                    const ResTable_type* config = type->configs[l];
+                    const ResTable_type* config = typeConfigs[l];
                     const ResTable_config* cfg = &config->config;
                     // only insert unique
                     const size_t M = configs->size();
@@ -4865,9 +5635,37 @@ ssize_t ResTable::getEntry(
     ResTable_config bestConfig;
     memset(&bestConfig, 0, sizeof(bestConfig)); // make the compiler shut up
     
-    const size_t NT = allTypes->configs.size();
-    for (size_t i=0; i<NT; i++) {
-        const ResTable_type* const thisType = allTypes->configs[i];
+    const Vector<const ResTable_type*>& configs = allTypes->getConfigs();
+    const size_t NT = configs.size();
+
+    // The best config of an entry for the current parameters only has to
+    // be found once, see setParameters().
+    uint32_t* bestConfigs = NULL;
+    bool cached = false;
+    const uint32_t generation = mEntryIndexGeneration << 16;
+    if (config == &mParams && NT < ENTRY_INDEX_NO_MATCH) {
+        ssize_t idx = mEntryIndices.indexOfKey(allTypes);
+        if (idx >= 0) {
+            bestConfigs = mEntryIndices.valueAt(idx);
+            const uint32_t slot = bestConfigs[entryIndex];
+            if ((slot & 0xffff0000) == generation) {
+                const uint32_t configIndex = slot & 0xffff;
+                if (configIndex == ENTRY_INDEX_NO_MATCH) {
+                    TABLE_GETENTRY(ALOGI("No value found for requested entry (cached)!\n"));
+                    return BAD_INDEX;
+                }
+                type = configs[configIndex];
+                const uint32_t* const eindex = (const uint32_t*)
+                    (((const uint8_t*)type) + dtohs(type->header.headerSize));
+                offset = dtohl(eindex[entryIndex]);
+                cached = true;
+            }
+        }
+    }
+
+    size_t bestIndex = 0;
+    for (size_t i=0; !cached && i<NT; i++) {
+        const ResTable_type* const thisType = configs[i];
         if (thisType == NULL) continue;
         
         ResTable_config thisConfig;
@@ -4909,9 +5707,14 @@ ssize_t ResTable::getEntry(
         type = thisType;
         offset = thisOffset;
         bestConfig = thisConfig;
+        bestIndex = i;
         TABLE_GETENTRY(ALOGI("Best entry so far -- using it!\n"));
         if (!config) break;
     }
+
+    if (bestConfigs != NULL && !cached) {
+        bestConfigs[entryIndex] = generation | (type != NULL ? bestIndex : ENTRY_INDEX_NO_MATCH);
+    }
     
     if (type == NULL) {
         TABLE_GETENTRY(ALOGI("No value found for requested entry!\n"));
@@ -5050,6 +5853,7 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
     
     // Iterate through all chunks.
     size_t curPackage = 0;
+    bool hasConfigs = false;
     
     const ResChunk_header* chunk =
         (const ResChunk_header*)(((const uint8_t*)pkg)
@@ -5098,7 +5902,7 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
             }
             Type* t = package->types[typeSpec->id-1];
             if (t == NULL) {
-                t = new Type(header, package, dtohl(typeSpec->entryCount));
+                t = new Type(header, package, typeSpec->id, dtohl(typeSpec->entryCount));
                 package->types.editItemAt(typeSpec->id-1) = t;
             } else if (dtohl(typeSpec->entryCount) != t->entryCount) {
                 ALOGW("ResTable_typeSpec entry count inconsistent: given %d, previously %d",
@@ -5117,27 +5921,6 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
                 return (mError=err);
             }
             
-            const size_t typeSize = dtohl(type->header.size);
-            
-            LOAD_TABLE_NOISY(printf("Type off %p: type=0x%x, headerSize=0x%x, size=%p\n",
-                                    (void*)(base-(const uint8_t*)chunk),
-                                    dtohs(type->header.type),
-                                    dtohs(type->header.headerSize),
-                                    (void*)typeSize));
-            if (dtohs(type->header.headerSize)+(sizeof(uint32_t)*dtohl(type->entryCount))
-                > typeSize) {
-                ALOGW("ResTable_type entry index to %p extends beyond chunk end %p.",
-                     (void*)(dtohs(type->header.headerSize)
-                             +(sizeof(uint32_t)*dtohl(type->entryCount))),
-                     (void*)typeSize);
-                return (mError=BAD_TYPE);
-            }
-            if (dtohl(type->entryCount) != 0
-                && dtohl(type->entriesStart) > (typeSize-sizeof(ResTable_entry))) {
-                ALOGW("ResTable_type entriesStart at %p extends beyond chunk end %p.",
-                     (void*)dtohl(type->entriesStart), (void*)typeSize);
-                return (mError=BAD_TYPE);
-            }
             if (type->id == 0) {
                 ALOGW("ResTable_type has an id of 0.");
                 return (mError=BAD_TYPE);
@@ -5148,20 +5931,21 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
             }
             Type* t = package->types[type->id-1];
             if (t == NULL) {
-                t = new Type(header, package, dtohl(type->entryCount));
+                t = new Type(header, package, type->id, dtohl(type->entryCount));
                 package->types.editItemAt(type->id-1) = t;
             } else if (dtohl(type->entryCount) != t->entryCount) {
                 ALOGW("ResTable_type entry count inconsistent: given %d, previously %d",
                     (int)dtohl(type->entryCount), (int)t->entryCount);
                 return (mError=BAD_TYPE);
             }
-            
-            TABLE_GETENTRY(
-                ResTable_config thisConfig;
-                thisConfig.copyFromDtoH(type->config);
-                ALOGI("Adding config to type %d: %s\n",
-                      type->id, thisConfig.toString().string()));
-            t->configs.add(type);
+
+            // The configs are indexed the first time the type is used,
+            // see Type::getConfigs().
+            if (t->configChunks == NULL) {
+                t->configChunks = (const uint8_t*)chunk;
+            }
+            t->configChunksEnd = ((const uint8_t*)chunk) + csize;
+            hasConfigs = true;
         } else {
             status_t err = validate_chunk(chunk, sizeof(ResChunk_header),
                                           endPos, "ResTable_package:unknown");
@@ -5173,6 +5957,10 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
             (((const uint8_t*)chunk) + csize);
     }
 
+    if (hasConfigs) {
+        invalidateEntryIndices();
+    }
+
     if (group->typeCount == 0) {
         group->typeCount = package->types.size();
     }
@@ -5180,7 +5968,46 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
     return NO_ERROR;
 }
 
-status_t ResTable::createIdmap(const ResTable& overlay, uint32_t originalCrc, uint32_t overlayCrc,
+void ResTable::getEntryKeys(const Type* type, Vector<uint32_t>* outKeys)
+{
+    const size_t NE = type->entryCount;
+    outKeys->clear();
+    outKeys->insertAt(ResTable_type::NO_ENTRY, 0, NE);
+
+    // Use the key of the first configuration defining each entry, like
+    // getEntry() does when no configuration is requested.
+    const Vector<const ResTable_type*>& configs = type->getConfigs();
+    const size_t NTC = configs.size();
+    for (size_t tci=0; tci<NTC; tci++) {
+        const ResTable_type* const ty = configs[tci];
+        const uint32_t typeOffset = dtohl(ty->entriesStart);
+        const uint32_t typeSize = dtohl(ty->header.size);
+        const uint32_t* const eindex = (const uint32_t*)
+            (((const uint8_t*)ty) + dtohs(ty->header.headerSize));
+
+        size_t N = dtohl(ty->entryCount);
+        if (N > NE) N = NE;
+        for (size_t i=0; i<N; i++) {
+            if (outKeys->itemAt(i) != ResTable_type::NO_ENTRY) {
+                continue;
+            }
+            uint32_t offset = dtohl(eindex[i]);
+            if (offset == ResTable_type::NO_ENTRY) {
+                continue;
+            }
+            offset += typeOffset;
+            if (offset > (typeSize-sizeof(ResTable_entry)) || (offset&0x3) != 0) {
+                continue;
+            }
+            const ResTable_entry* const entry = (const ResTable_entry*)
+                (((const uint8_t*)ty) + offset);
+            outKeys->editItemAt(i) = dtohl(entry->key.index);
+        }
+    }
+}
+
+status_t ResTable::createIdmap(const ResTable& overlay, const idmap_package_info& originalInfo,
+                               const idmap_package_info& overlayInfo,
                                void** outData, size_t* outSize) const
 {
     // see README for details on the format of map
@@ -5190,6 +6017,12 @@ status_t ResTable::createIdmap(const ResTable& overlay, uint32_t originalCrc, ui
     if (mPackageGroups[0]->packages.size() == 0) {
         return UNKNOWN_ERROR;
     }
+    if (overlay.mPackageGroups.size() == 0) {
+        return UNKNOWN_ERROR;
+    }
+    if (overlay.mPackageGroups[0]->packages.size() == 0) {
+        return UNKNOWN_ERROR;
+    }
 
     Vector<Vector<uint32_t> > map;
     const PackageGroup* pg = mPackageGroups[0];
@@ -5197,9 +6030,24 @@ status_t ResTable::createIdmap(const ResTable& overlay, uint32_t originalCrc, ui
     size_t typeCount = pkg->types.size();
     // starting size is header + first item (number of types in map)
     *outSize = (IDMAP_HEADER_SIZE + 1) * sizeof(uint32_t);
-    const String16 overlayPackage(overlay.mPackageGroups[0]->packages[0]->package->name);
     const uint32_t pkg_id = pkg->package->id << 24;
 
+    // Resources are matched by joining the names of the two packages: the
+    // keys of every type are collected once and looked up in the hashed
+    // string pools of the overlay, instead of resolving each resource with
+    // getResourceName() and identifierForName().
+    const PackageGroup* overlayGroup = overlay.mPackageGroups[0];
+    const Package* overlayPkg = overlayGroup->packages[0];
+    const ResStringPool& typeStrings = pg->basePackage->typeStrings;
+    const ResStringPool& keyStrings = pg->basePackage->keyStrings;
+    const ResStringPool& overlayTypeStrings = overlayGroup->basePackage->typeStrings;
+    const ResStringPool& overlayKeyStrings = overlayGroup->basePackage->keyStrings;
+
+    Vector<uint32_t> keys;
+    Vector<uint32_t> overlayKeys;
+    // Entry index in the overlay type of each overlay key string
+    Vector<uint32_t> overlayEntries;
+
     for (size_t typeIndex = 0; typeIndex < typeCount; ++typeIndex) {
         ssize_t offset = -1;
         const Type* typeConfigs = pkg->getType(typeIndex);
@@ -5208,27 +6056,57 @@ status_t ResTable::createIdmap(const ResTable& overlay, uint32_t originalCrc, ui
             return NO_MEMORY;
         }
         Vector<uint32_t>& vector = map.editItemAt(mapIndex);
+        if (typeConfigs == NULL) {
+            // reserve space for type offset
+            *outSize += 1 * sizeof(uint32_t);
+            continue;
+        }
+
+        const Type* overlayType = NULL;
+        size_t typeNameLen;
+        const char16_t* typeName = typeStrings.stringAt(typeIndex, &typeNameLen);
+        const ssize_t overlayTypeIndex = typeName != NULL
+                ? overlayTypeStrings.indexOfString(typeName, typeNameLen) : -1;
+        if (overlayTypeIndex >= 0) {
+            overlayType = overlayPkg->getType(overlayTypeIndex);
+        }
+
+        if (overlayType != NULL) {
+            overlayEntries.clear();
+            overlayEntries.insertAt(ResTable_type::NO_ENTRY, 0, overlayKeyStrings.size());
+            getEntryKeys(overlayType, &overlayKeys);
+            for (size_t i = 0; i < overlayKeys.size(); ++i) {
+                const uint32_t key = overlayKeys[i];
+                if (key < overlayEntries.size()
+                        && overlayEntries[key] == ResTable_type::NO_ENTRY) {
+                    overlayEntries.editItemAt(key) = i;
+                }
+            }
+        }
+
+        getEntryKeys(typeConfigs, &keys);
         for (size_t entryIndex = 0; entryIndex < typeConfigs->entryCount; ++entryIndex) {
             uint32_t resID = (0xff000000 & ((pkg->package->id)<<24))
                 | (0x00ff0000 & ((typeIndex+1)<<16))
                 | (0x0000ffff & (entryIndex));
-            resource_name resName;
-            if (!this->getResourceName(resID, &resName)) {
+            const uint32_t key = keys[entryIndex];
+            if (key == ResTable_type::NO_ENTRY) {
                 ALOGW("idmap: resource 0x%08x has spec but lacks values, skipping\n", resID);
                 continue;
             }
 
-            const String16 overlayType(resName.type, resName.typeLen);
-            const String16 overlayName(resName.name, resName.nameLen);
-            uint32_t overlayResID = overlay.identifierForName(overlayName.string(),
-                                                              overlayName.size(),
-                                                              overlayType.string(),
-                                                              overlayType.size(),
-                                                              overlayPackage.string(),
-                                                              overlayPackage.size());
-            if (overlayResID != 0) {
-                // overlay package has package ID == 0, use original package's ID instead
-                overlayResID |= pkg_id;
+            uint32_t overlayResID = 0;
+            if (overlayType != NULL) {
+                size_t nameLen;
+                const char16_t* name = keyStrings.stringAt(key, &nameLen);
+                const ssize_t overlayKey = name != NULL
+                        ? overlayKeyStrings.indexOfString(name, nameLen) : -1;
+                if (overlayKey >= 0 && overlayEntries[overlayKey] != ResTable_type::NO_ENTRY) {
+                    // overlay package has package ID == 0, use original package's ID instead
+                    overlayResID = pkg_id
+                        | (0x00ff0000 & ((overlayTypeIndex+1)<<16))
+                        | (0x0000ffff & overlayEntries[overlayKey]);
+                }
             }
             vector.push(overlayResID);
             if (overlayResID != 0 && offset == -1) {
@@ -5236,9 +6114,11 @@ status_t ResTable::createIdmap(const ResTable& overlay, uint32_t originalCrc, ui
             }
 #if 0
             if (overlayResID != 0) {
+                size_t len;
+                const char16_t* name = keyStrings.stringAt(key, &len);
                 ALOGD("%s/%s 0x%08x -> 0x%08x\n",
-                     String8(String16(resName.type)).string(),
-                     String8(String16(resName.name)).string(),
+                     String8(typeName, typeNameLen).string(),
+                     String8(name, len).string(),
                      resID, overlayResID);
             }
 #endif
@@ -5265,9 +6145,9 @@ status_t ResTable::createIdmap(const ResTable& overlay, uint32_t originalCrc, ui
         return NO_MEMORY;
     }
     uint32_t* data = (uint32_t*)*outData;
-    *data++ = htodl(IDMAP_MAGIC);
-    *data++ = htodl(originalCrc);
-    *data++ = htodl(overlayCrc);
+    *data = htodl(IDMAP_MAGIC);
+    setIdmapInfo(data, originalInfo, overlayInfo);
+    data += IDMAP_HEADER_SIZE;
     const size_t mapSize = map.size();
     *data++ = htodl(mapSize);
     size_t offset = mapSize;
@@ -5299,17 +6179,34 @@ status_t ResTable::createIdmap(const ResTable& overlay, uint32_t originalCrc, ui
 }
 
 bool ResTable::getIdmapInfo(const void* idmap, size_t sizeBytes,
-                            uint32_t* pOriginalCrc, uint32_t* pOverlayCrc)
+                            idmap_package_info* outOriginalInfo,
+                            idmap_package_info* outOverlayInfo)
 {
     const uint32_t* map = (const uint32_t*)idmap;
     if (!assertIdmapHeader(map, sizeBytes)) {
         return false;
     }
-    *pOriginalCrc = map[1];
-    *pOverlayCrc = map[2];
+    outOriginalInfo->crc = dtohl(map[1]);
+    outOverlayInfo->crc = dtohl(map[2]);
+    outOriginalInfo->mtime = dtohl(map[3]);
+    outOriginalInfo->size = dtohl(map[4]);
+    outOverlayInfo->mtime = dtohl(map[5]);
+    outOverlayInfo->size = dtohl(map[6]);
     return true;
 }
 
+void ResTable::setIdmapInfo(void* idmap, const idmap_package_info& originalInfo,
+                            const idmap_package_info& overlayInfo)
+{
+    uint32_t* map = (uint32_t*)idmap;
+    map[1] = htodl(originalInfo.crc);
+    map[2] = htodl(overlayInfo.crc);
+    map[3] = htodl(originalInfo.mtime);
+    map[4] = htodl(originalInfo.size);
+    map[5] = htodl(overlayInfo.mtime);
+    map[6] = htodl(overlayInfo.size);
+}
+
 void ResTable::removeAssetsByCookie(const String8 &packageName, void* cookie)
 {
     mError = NO_ERROR;
@@ -5343,6 +6240,8 @@ void ResTable::removeAssetsByCookie(const String8 &packageName, void* cookie)
         }
         if (index < pkgCount) {
             const Package* pkg = pg->packages[index];
+            // The types of the package are about to be deleted
+            clearEntryIndices();
             uint32_t id = dtohl(pkg->package->id);
             if (id != 0 && id < 256) {
                 mPackageMap[id] = 0;
@@ -5375,12 +6274,25 @@ void ResTable::addRedirections(PackageRedirectionMap* resMap)
 {
     // TODO: Replace an existing entry matching the same package.
     mRedirectionMap.add(resMap);
+
+    const int p = resMap->getPackage();
+    if (p > 0 && p < 256) {
+        if (mRedirectionByPackage[p] == NULL && !mHasUnmappedRedirections) {
+            mRedirectionByPackage[p] = resMap;
+        }
+    } else {
+        // The map may still get its package, and then it comes before the
+        // maps added after it.
+        mHasUnmappedRedirections = true;
+    }
 }
 
 void ResTable::clearRedirections()
 {
     /* This memory is being managed by strong references at the Java layer. */
     mRedirectionMap.clear();
+    memset(mRedirectionByPackage, 0, sizeof(mRedirectionByPackage));
+    mHasUnmappedRedirections = false;
 }
 
 #ifndef HAVE_ANDROID_OS
@@ -5535,7 +6447,8 @@ void ResTable::print(bool inclValues) const
                     printf("    type %d NULL\n", (int)typeIndex);
                     continue;
                 }
-                const size_t NTC = typeConfigs->configs.size();
+                const Vector<const ResTable_type*>& configs = typeConfigs->getConfigs();
+                const size_t NTC = configs.size();
                 printf("    type %d configCount=%d entryCount=%d\n",
                        (int)typeIndex, (int)NTC, (int)typeConfigs->entryCount);
                 if (typeConfigs->typeSpecFlags != NULL) {
@@ -5557,7 +6470,7 @@ void ResTable::print(bool inclValues) const
                     }
                 }
                 for (size_t configIndex=0; configIndex<NTC; configIndex++) {
-                    const ResTable_type* type = typeConfigs->configs[configIndex];
+                    const ResTable_type* type = configs[configIndex];
                     if ((((uint64_t)type)&0x3) != 0) {
                         printf("      NON-INTEGER ResTable_type ADDRESS: %p\n", type);
                         continue;
@@ -45,6 +45,7 @@ StreamingZipInflater::StreamingZipInflater(int fd, off64_t compDataStart,
     mOutBufSize = StreamingZipInflater::OUTPUT_CHUNK_SIZE;
     mOutBuf = new uint8_t[mOutBufSize];
 
+    mTakeCheckpoints = false;
     initInflateState();
 }
 
@@ -63,6 +64,7 @@ StreamingZipInflater::StreamingZipInflater(FileMap* dataMap, size_t uncompSize)
     mOutBufSize = StreamingZipInflater::OUTPUT_CHUNK_SIZE;
     mOutBuf = new uint8_t[mOutBufSize];
 
+    mTakeCheckpoints = false;
     initInflateState();
 }
 
@@ -70,6 +72,11 @@ StreamingZipInflater::~StreamingZipInflater() {
     // tear down the in-flight zip state just in case
     ::inflateEnd(&mInflateState);
 
+    for (size_t i = 0; i < mCheckpoints.size(); i++) {
+        ::inflateEnd(&mCheckpoints[i]->state);
+        delete mCheckpoints[i];
+    }
+
     if (mDataMap == NULL) {
         delete [] mInBuf;
     }
@@ -170,15 +177,18 @@ ssize_t StreamingZipInflater::read(void* outBuf, size_t count) {
                 initInflateState();
                 return -1;
             } else {
+                // Note how much data we got, and off we go
+                mOutDeliverable = 0;
+                mOutLastDecoded = mOutBufSize - mInflateState.avail_out;
+
                 if (result == Z_STREAM_END) {
                     // we know we have to have reached the target size here and will
                     // not try to read any further, so just wind things up.
                     ::inflateEnd(&mInflateState);
+                } else if (mTakeCheckpoints) {
+                    // the stream is now past everything in the output buffer
+                    takeCheckpoint(mOutCurPosition + mOutLastDecoded);
                 }
-
-                // Note how much data we got, and off we go
-                mOutDeliverable = 0;
-                mOutLastDecoded = mOutBufSize - mInflateState.avail_out;
             }
         }
     }
@@ -207,18 +217,103 @@ int StreamingZipInflater::readNextChunk() {
     return 0;
 }
 
-// seeking backwards requires uncompressing fom the beginning, so is very
-// expensive.  seeking forwards only requires uncompressing from the current
-// position to the destination.
+void StreamingZipInflater::takeCheckpoint(off64_t outPosition) {
+    // the beginning of the stream needs no checkpoint
+    off64_t next = CHECKPOINT_INTERVAL;
+    if (!mCheckpoints.isEmpty()) {
+        next = mCheckpoints.top()->outPosition + CHECKPOINT_INTERVAL;
+    }
+    if (outPosition < next) {
+        return;
+    }
+
+    Checkpoint* checkpoint = new Checkpoint;
+    memset(&checkpoint->state, 0, sizeof(checkpoint->state));
+    if (::inflateCopy(&checkpoint->state, &mInflateState) != Z_OK) {
+        ALOGW("Unable to take an inflate checkpoint at %lld", (long long) outPosition);
+        delete checkpoint;
+        // don't retry on every chunk if we're out of memory
+        mTakeCheckpoints = false;
+        return;
+    }
+    checkpoint->outPosition = outPosition;
+    // when paging in from the fd, the unconsumed input is read again on restore
+    checkpoint->inPosition = (mDataMap == NULL)
+            ? mInNextChunkOffset - mInflateState.avail_in
+            : mInflateState.next_in - mInBuf;
+    mCheckpoints.add(checkpoint);
+    ALOGV("Inflate checkpoint at %lld", (long long) outPosition);
+}
+
+const StreamingZipInflater::Checkpoint* StreamingZipInflater::findCheckpoint(
+        off64_t outPosition) const {
+    // last checkpoint at or before the position
+    ssize_t l = 0;
+    ssize_t h = ssize_t(mCheckpoints.size()) - 1;
+    const Checkpoint* found = NULL;
+    while (l <= h) {
+        ssize_t mid = l + (h - l) / 2;
+        if (mCheckpoints[mid]->outPosition <= outPosition) {
+            found = mCheckpoints[mid];
+            l = mid + 1;
+        } else {
+            h = mid - 1;
+        }
+    }
+    return found;
+}
+
+bool StreamingZipInflater::restoreCheckpoint(const Checkpoint* checkpoint) {
+    if (!mStreamNeedsInit) {
+        ::inflateEnd(&mInflateState);
+    }
+    initInflateState();
+    if (::inflateCopy(&mInflateState, const_cast<z_stream*>(&checkpoint->state)) != Z_OK) {
+        ALOGW("Unable to restore the inflate checkpoint at %lld",
+                (long long) checkpoint->outPosition);
+        initInflateState();
+        return false;
+    }
+    mStreamNeedsInit = false;
+    mOutCurPosition = checkpoint->outPosition;
+
+    if (mDataMap == NULL) {
+        mInNextChunkOffset = checkpoint->inPosition;
+        ::lseek(mFd, mInFileStart + checkpoint->inPosition, SEEK_SET);
+        mInflateState.avail_in = 0;
+    } else {
+        mInflateState.next_in = (Bytef*) mInBuf + checkpoint->inPosition;
+        mInflateState.avail_in = mInTotalSize - checkpoint->inPosition;
+    }
+    ALOGV("Restored inflate checkpoint at %lld", (long long) mOutCurPosition);
+    return true;
+}
+
+// seeking backwards requires uncompressing from the closest checkpoint, or
+// from the beginning if there is none.  seeking forwards only requires
+// uncompressing from the current position to the destination, unless a
+// checkpoint is closer.
 off64_t StreamingZipInflater::seekAbsolute(off64_t absoluteInputPosition) {
+    const Checkpoint* checkpoint = findCheckpoint(absoluteInputPosition);
+    // position the stream has decoded up to
+    const off64_t decodedPosition = mOutCurPosition + (mOutLastDecoded - mOutDeliverable);
+
     if (absoluteInputPosition < mOutCurPosition) {
-        // rewind and reprocess the data from the beginning
-        if (!mStreamNeedsInit) {
-            ::inflateEnd(&mInflateState);
+        // the data is decoded again on the way, remember where to resume
+        // for the next backwards seek
+        mTakeCheckpoints = true;
+        if (checkpoint == NULL || !restoreCheckpoint(checkpoint)) {
+            // rewind and reprocess the data from the beginning
+            if (!mStreamNeedsInit) {
+                ::inflateEnd(&mInflateState);
+            }
+            initInflateState();
         }
-        initInflateState();
-        read(NULL, absoluteInputPosition);
-    } else if (absoluteInputPosition > mOutCurPosition) {
+    } else if (checkpoint != NULL && checkpoint->outPosition > decodedPosition) {
+        restoreCheckpoint(checkpoint);
+    }
+
+    if (absoluteInputPosition > mOutCurPosition) {
         read(NULL, absoluteInputPosition - mOutCurPosition);
     }
     // else if the target position *is* our current position, do nothing
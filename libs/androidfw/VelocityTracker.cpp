@@ -555,6 +555,143 @@ static bool solveLeastSquares(const float* x, const float* y,
     return true;
 }
 
+/**
+ * Solves the same weighted least squares problem as solveLeastSquares() for both the
+ * X and Y axes at once, using the normal equations of a polynomial with N coefficients.
+ *
+ * For the first and second degree polynomials used by the default strategies the
+ * normal equations form a small symmetric system whose entries are the weighted
+ * moments of the sample times.  The moments are accumulated in a single pass over the
+ * samples that is shared by both axes, in double precision because the normal equations
+ * square the condition number of the problem.  The system is then solved by Gaussian
+ * elimination, which is exact up to rounding for these sizes.
+ *
+ * Returns false if the system is too close to singular, in which case the caller should
+ * fall back on solveLeastSquares() to decide whether there is a solution.
+ */
+template<uint32_t N>
+static bool solveLeastSquaresXY(const float* t, const float* x, const float* y,
+        const float* w, uint32_t m, float* outXB, float* outYB,
+        float* outXDet, float* outYDet) {
+    // Accumulate the weighted moments of time, sum(w^2 t^k) for k < 2N - 1,
+    // and the weighted moments of each axis, sum(w^2 t^k x) for k < N.
+    double tMoments[2 * N - 1];
+    double xMoments[N];
+    double yMoments[N];
+    double xMean = 0, yMean = 0;
+    for (uint32_t k = 0; k < 2 * N - 1; k++) {
+        tMoments[k] = 0;
+    }
+    for (uint32_t k = 0; k < N; k++) {
+        xMoments[k] = 0;
+        yMoments[k] = 0;
+    }
+    for (uint32_t h = 0; h < m; h++) {
+        double ww = double(w[h]) * w[h];
+        double term = ww;
+        for (uint32_t k = 0; k < 2 * N - 1; k++) {
+            tMoments[k] += term;
+            if (k < N) {
+                xMoments[k] += term * x[h];
+                yMoments[k] += term * y[h];
+            }
+            term *= t[h];
+        }
+        xMean += x[h];
+        yMean += y[h];
+    }
+    xMean /= m;
+    yMean /= m;
+
+    // Build the augmented system [A | bx by] and reduce it to upper triangular form.
+    double a[N][N + 2];
+    for (uint32_t i = 0; i < N; i++) {
+        for (uint32_t j = 0; j < N; j++) {
+            a[i][j] = tMoments[i + j];
+        }
+        a[i][N] = xMoments[i];
+        a[i][N + 1] = yMoments[i];
+    }
+    for (uint32_t i = 0; i < N; i++) {
+        // The matrix is symmetric positive semi-definite so no pivoting is needed,
+        // but a vanishing pivot means the samples do not determine the polynomial.
+        if (!(a[i][i] > tMoments[2 * i] * 1e-9)) {
+            return false;
+        }
+        for (uint32_t r = i + 1; r < N; r++) {
+            double factor = a[r][i] / a[i][i];
+            for (uint32_t c = i; c < N + 2; c++) {
+                a[r][c] -= factor * a[i][c];
+            }
+        }
+    }
+
+    // Back substitute to find the coefficients of both axes.
+    double xb[N], yb[N];
+    for (uint32_t i = N; i-- != 0; ) {
+        double sx = a[i][N];
+        double sy = a[i][N + 1];
+        for (uint32_t j = i + 1; j < N; j++) {
+            sx -= a[i][j] * xb[j];
+            sy -= a[i][j] * yb[j];
+        }
+        xb[i] = sx / a[i][i];
+        yb[i] = sy / a[i][i];
+    }
+
+    // Calculate the coefficients of determination, as in solveLeastSquares().
+    double xsserr = 0, xsstot = 0, ysserr = 0, ysstot = 0;
+    for (uint32_t h = 0; h < m; h++) {
+        double xerr = x[h] - xb[0];
+        double yerr = y[h] - yb[0];
+        double term = 1;
+        for (uint32_t i = 1; i < N; i++) {
+            term *= t[h];
+            xerr -= term * xb[i];
+            yerr -= term * yb[i];
+        }
+        double ww = double(w[h]) * w[h];
+        double xvar = x[h] - xMean;
+        double yvar = y[h] - yMean;
+        xsserr += ww * xerr * xerr;
+        xsstot += ww * xvar * xvar;
+        ysserr += ww * yerr * yerr;
+        ysstot += ww * yvar * yvar;
+    }
+
+    for (uint32_t i = 0; i < N; i++) {
+        outXB[i] = float(xb[i]);
+        outYB[i] = float(yb[i]);
+    }
+    *outXDet = xsstot > 0.000001 ? float(1.0 - xsserr / xsstot) : 1;
+    *outYDet = ysstot > 0.000001 ? float(1.0 - ysserr / ysstot) : 1;
+#if DEBUG_STRATEGY
+    ALOGD("solveLeastSquaresXY: n=%d, xb=%s, yb=%s, xdet=%f, ydet=%f", int(N),
+            vectorToString(outXB, N).string(), vectorToString(outYB, N).string(),
+            *outXDet, *outYDet);
+#endif
+    return true;
+}
+
+static bool solveLeastSquaresXY(const float* t, const float* x, const float* y,
+        const float* w, uint32_t m, uint32_t n, float* outXB, float* outYB,
+        float* outXDet, float* outYDet) {
+    switch (n) {
+    case 2:
+        if (solveLeastSquaresXY<2>(t, x, y, w, m, outXB, outYB, outXDet, outYDet)) {
+            return true;
+        }
+        break;
+    case 3:
+        if (solveLeastSquaresXY<3>(t, x, y, w, m, outXB, outYB, outXDet, outYDet)) {
+            return true;
+        }
+        break;
+    }
+    return solveLeastSquares(t, x, w, m, n, outXB, outXDet)
+            && solveLeastSquares(t, y, w, m, n, outYB, outYDet);
+}
+
 bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
         VelocityTracker::Estimator* outEstimator) const {
     outEstimator->clear();
@@ -598,8 +735,8 @@ bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
     if (degree >= 1) {
         float xdet, ydet;
         uint32_t n = degree + 1;
-        if (solveLeastSquares(time, x, w, m, n, outEstimator->xCoeff, &xdet)
-                && solveLeastSquares(time, y, w, m, n, outEstimator->yCoeff, &ydet)) {
+        if (solveLeastSquaresXY(time, x, y, w, m, n,
+                outEstimator->xCoeff, outEstimator->yCoeff, &xdet, &ydet)) {
             outEstimator->time = newestMovement.eventTime;
             outEstimator->degree = degree;
             outEstimator->confidence = xdet * ydet;
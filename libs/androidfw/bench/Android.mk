@@ -0,0 +1,30 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	AndroidfwBench.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libandroidfw \
+	libcutils \
+	libutils
+
+LOCAL_MODULE:= androidfwbench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	VelocityTrackerBench.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libandroidfw \
+	libcutils \
+	libutils
+
+LOCAL_MODULE:= velocitytrackerbench
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
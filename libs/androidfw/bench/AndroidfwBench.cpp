@@ -0,0 +1,513 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "androidfwbench"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <malloc.h>
+
+#include <cutils/atomic.h>
+
+#include <utils/String8.h>
+#include <utils/String16.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <androidfw/Asset.h>
+#include <androidfw/AssetManager.h>
+#include <androidfw/ResourceTypes.h>
+
+using namespace android;
+
+// Loads the framework resources, plus the given packages, and reports the
+// cost of the resource lookup paths: time per operation, operator new calls
+// per operation and the native heap retained by the run. With -t, every
+// benchmark runs on that many threads at once against the same tables to
+// measure lock contention.
+//
+// Usage: androidfwbench [-n iterations] [-w warmup] [-t threads] [package...]
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define DEFAULT_ITERATION_COUNT 10000
+#define DEFAULT_WARMUP_COUNT 100
+
+// Number of consecutive missing identifiers after which a package or a type
+// is considered fully enumerated
+#define MAX_MISSING_IDS 32
+// Number of strings sampled from each string pool
+#define MAX_POOL_STRINGS 256
+
+struct Options {
+    Options(): iterationCount(DEFAULT_ITERATION_COUNT), warmupCount(DEFAULT_WARMUP_COUNT),
+            threadCount(1) { }
+
+    int iterationCount;
+    int warmupCount;
+    int threadCount;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocations
+///////////////////////////////////////////////////////////////////////////////
+
+// Replacing the global operators counts the allocations made by libandroidfw
+// as well. Allocations made directly with malloc(), such as the bag tables
+// and the String8/String16 buffers, only show up in the heap usage.
+static volatile int32_t gNewCount = 0;
+
+void* operator new(size_t size) {
+    android_atomic_inc(&gNewCount);
+    return malloc(size);
+}
+
+void* operator new[](size_t size) {
+    android_atomic_inc(&gNewCount);
+    return malloc(size);
+}
+
+void operator delete(void* p) {
+    free(p);
+}
+
+void operator delete[](void* p) {
+    free(p);
+}
+
+static inline size_t heapUsage() {
+    struct mallinfo info = mallinfo();
+    return info.uordblks;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Fixture
+///////////////////////////////////////////////////////////////////////////////
+
+struct XmlFile {
+    void* cookie;
+    String8 path;
+    // Kept open so that the parser benchmark does not measure inflation
+    Asset* asset;
+};
+
+struct PoolString {
+    const ResStringPool* pool;
+    String16 string;
+};
+
+/**
+ * Resources the benchmarks pick their work from, enumerated from the
+ * loaded packages once before any measurement.
+ */
+class Fixture {
+public:
+    Fixture() { }
+
+    ~Fixture() {
+        for (size_t i = 0; i < xmlFiles.size(); i++) {
+            delete xmlFiles[i].asset;
+        }
+    }
+
+    bool load(const Vector<const char*>& packages);
+    void dump() const;
+
+    AssetManager assets;
+
+    Vector<uint32_t> values;
+    Vector<uint32_t> bags;
+    Vector<uint32_t> styles;
+    Vector<XmlFile> xmlFiles;
+    Vector<PoolString> strings;
+
+private:
+    void addResource(const ResTable& table, uint32_t id, const ResTable::resource_name& name);
+    void addStrings(const ResStringPool* pool);
+}; // class Fixture
+
+static bool isType(const ResTable::resource_name& name, const char* type) {
+    return name.type != NULL && String8(name.type, name.typeLen) == type;
+}
+
+static bool isXmlFile(const String8& path) {
+    return !strncmp(path.string(), "res/", 4) &&
+            !strcmp(path.getPathExtension().string(), ".xml");
+}
+
+bool Fixture::load(const Vector<const char*>& packages) {
+    if (!assets.addDefaultAssets()) {
+        fprintf(stderr, "Could not load the framework resources\n");
+        return false;
+    }
+    for (size_t i = 0; i < packages.size(); i++) {
+        if (!assets.addAssetPath(String8(packages[i]), NULL)) {
+            fprintf(stderr, "Could not load %s\n", packages[i]);
+            return false;
+        }
+    }
+
+    const ResTable& table = assets.getResources();
+    if (table.getError() != NO_ERROR) {
+        fprintf(stderr, "Could not load the resource tables\n");
+        return false;
+    }
+
+    // Identifiers are dense within a type, and types within a package, so
+    // probe each of them until enough consecutive ones are missing
+    for (size_t p = 0; p < table.getBasePackageCount(); p++) {
+        const uint32_t package = table.getBasePackageId(p);
+
+        int missingTypes = 0;
+        for (uint32_t type = 1; type <= 0xff && missingTypes < MAX_MISSING_IDS; type++) {
+            bool found = false;
+            int missingEntries = 0;
+            for (uint32_t entry = 0; entry <= 0xffff && missingEntries < MAX_MISSING_IDS;
+                    entry++) {
+                const uint32_t id = (package << 24) | (type << 16) | entry;
+                ResTable::resource_name name;
+                if (!table.getResourceName(id, &name)) {
+                    missingEntries++;
+                    continue;
+                }
+                missingEntries = 0;
+                found = true;
+                addResource(table, id, name);
+            }
+            missingTypes = found ? 0 : missingTypes + 1;
+        }
+    }
+
+    for (size_t i = 0; i < table.getTableCount(); i++) {
+        addStrings(table.getTableStringBlock(i));
+    }
+
+    if (values.isEmpty() || bags.isEmpty() || styles.isEmpty() || xmlFiles.isEmpty() ||
+            strings.isEmpty()) {
+        fprintf(stderr, "Could not find resources to benchmark\n");
+        return false;
+    }
+
+    return true;
+}
+
+void Fixture::addResource(const ResTable& table, uint32_t id,
+        const ResTable::resource_name& name) {
+    Res_value value;
+    const ssize_t block = table.getResource(id, &value, true);
+    if (block < 0) {
+        // Complex entries are not returned by getResource()
+        const ResTable::bag_entry* bag;
+        if (table.lockBag(id, &bag) >= 0) {
+            table.unlockBag(bag);
+            bags.add(id);
+            if (isType(name, "style")) styles.add(id);
+        }
+        return;
+    }
+
+    values.add(id);
+
+    if (value.dataType == Res_value::TYPE_STRING) {
+        const ResStringPool* pool = table.getTableStringBlock(block);
+        size_t length;
+        const char16_t* path = pool != NULL ? pool->stringAt(value.data, &length) : NULL;
+        if (path == NULL) return;
+
+        XmlFile file;
+        file.cookie = table.getTableCookie(block);
+        file.path = String8(path, length);
+        if (!isXmlFile(file.path)) return;
+
+        file.asset = assets.openNonAsset(file.cookie, file.path.string(), Asset::ACCESS_BUFFER);
+        if (file.asset == NULL) return;
+        if (file.asset->getBuffer(true) == NULL) {
+            delete file.asset;
+            return;
+        }
+
+        // Layouts and drawables are shared by several configurations
+        for (size_t i = 0; i < xmlFiles.size(); i++) {
+            if (xmlFiles[i].cookie == file.cookie && xmlFiles[i].path == file.path) {
+                delete file.asset;
+                return;
+            }
+        }
+        xmlFiles.add(file);
+    }
+}
+
+void Fixture::addStrings(const ResStringPool* pool) {
+    if (pool == NULL || pool->size() == 0) return;
+
+    const size_t count = pool->size() < MAX_POOL_STRINGS ? pool->size() : MAX_POOL_STRINGS;
+    const size_t step = pool->size() / count;
+    for (size_t i = 0; i < count; i++) {
+        size_t length;
+        const char16_t* string = pool->stringAt(i * step, &length);
+        if (string == NULL) continue;
+
+        PoolString poolString;
+        poolString.pool = pool;
+        poolString.string = String16(string, length);
+        strings.add(poolString);
+    }
+}
+
+void Fixture::dump() const {
+    printf("%d values, %d bags, %d styles, %d XML files, %d pool strings\n",
+            values.size(), bags.size(), styles.size(), xmlFiles.size(), strings.size());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+///////////////////////////////////////////////////////////////////////////////
+
+// Each operation picks its work from the fixture with the given index, the
+// threads start at different offsets so they do not move in lockstep
+
+static void benchGetResource(Fixture& fixture, size_t index) {
+    const uint32_t id = fixture.values[index % fixture.values.size()];
+    Res_value value;
+    fixture.assets.getResources().getResource(id, &value);
+}
+
+static void benchGetBagLocked(Fixture& fixture, size_t index) {
+    const uint32_t id = fixture.bags[index % fixture.bags.size()];
+    const ResTable& table = fixture.assets.getResources();
+    const ResTable::bag_entry* bag;
+    table.lock();
+    table.getBagLocked(id, &bag);
+    table.unlock();
+}
+
+static void benchLockBag(Fixture& fixture, size_t index) {
+    const uint32_t id = fixture.bags[index % fixture.bags.size()];
+    const ResTable& table = fixture.assets.getResources();
+    const ResTable::bag_entry* bag;
+    if (table.lockBag(id, &bag) >= 0) {
+        table.unlockBag(bag);
+    }
+}
+
+static void benchApplyStyle(Fixture& fixture, size_t index) {
+    const uint32_t id = fixture.styles[index % fixture.styles.size()];
+    ResTable::Theme theme(fixture.assets.getResources());
+    theme.applyStyle(id);
+}
+
+static void benchXmlParser(Fixture& fixture, size_t index) {
+    Asset* asset = fixture.xmlFiles[index % fixture.xmlFiles.size()].asset;
+    ResXMLTree tree(asset->getBuffer(true), asset->getLength());
+
+    ResXMLParser::event_code_t code;
+    while ((code = tree.next()) != ResXMLParser::END_DOCUMENT &&
+            code != ResXMLParser::BAD_DOCUMENT) {
+    }
+}
+
+static void benchOpenAsset(Fixture& fixture, size_t index) {
+    const XmlFile& file = fixture.xmlFiles[index % fixture.xmlFiles.size()];
+    Asset* asset = fixture.assets.openNonAsset(file.cookie, file.path.string(),
+            Asset::ACCESS_BUFFER);
+    if (asset != NULL) {
+        asset->getBuffer(true);
+        delete asset;
+    }
+}
+
+static void benchIndexOfString(Fixture& fixture, size_t index) {
+    const PoolString& string = fixture.strings[index % fixture.strings.size()];
+    string.pool->indexOfString(string.string.string(), string.string.size());
+}
+
+typedef void (*BenchmarkFunc)(Fixture& fixture, size_t index);
+
+struct Benchmark {
+    const char* name;
+    BenchmarkFunc func;
+};
+
+static const Benchmark gBenchmarks[] = {
+    { "ResTable::getResource", benchGetResource },
+    { "ResTable::getBagLocked", benchGetBagLocked },
+    { "ResTable::lockBag", benchLockBag },
+    { "Theme::applyStyle", benchApplyStyle },
+    { "ResXMLParser::next", benchXmlParser },
+    { "AssetManager::openNonAsset", benchOpenAsset },
+    { "ResStringPool::indexOfString", benchIndexOfString },
+};
+
+#define BENCHMARK_COUNT (sizeof(gBenchmarks) / sizeof(gBenchmarks[0]))
+
+///////////////////////////////////////////////////////////////////////////////
+// Threads
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Holds the worker threads back until all of them are running, so that
+ * they contend for the whole measurement.
+ */
+class StartGate {
+public:
+    StartGate(): mOpen(false) { }
+
+    void wait() {
+        Mutex::Autolock _l(mLock);
+        while (!mOpen) {
+            mCondition.wait(mLock);
+        }
+    }
+
+    void open() {
+        Mutex::Autolock _l(mLock);
+        mOpen = true;
+        mCondition.broadcast();
+    }
+
+private:
+    Mutex mLock;
+    Condition mCondition;
+    bool mOpen;
+}; // class StartGate
+
+class BenchmarkThread: public Thread {
+public:
+    BenchmarkThread(Fixture& fixture, const Benchmark& benchmark, StartGate& gate,
+            size_t offset, int iterationCount): Thread(false), mFixture(fixture),
+            mBenchmark(benchmark), mGate(gate), mOffset(offset),
+            mIterationCount(iterationCount), mTime(0) { }
+
+    nsecs_t getTime() const {
+        return mTime;
+    }
+
+private:
+    virtual bool threadLoop() {
+        mGate.wait();
+
+        const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < mIterationCount; i++) {
+            mBenchmark.func(mFixture, mOffset + i);
+        }
+        mTime = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+        return false;
+    }
+
+    Fixture& mFixture;
+    const Benchmark& mBenchmark;
+    StartGate& mGate;
+    size_t mOffset;
+    int mIterationCount;
+    nsecs_t mTime;
+}; // class BenchmarkThread
+
+///////////////////////////////////////////////////////////////////////////////
+// Benchmark
+///////////////////////////////////////////////////////////////////////////////
+
+static void runBenchmark(Fixture& fixture, const Benchmark& benchmark, const Options& options) {
+    for (int i = 0; i < options.warmupCount; i++) {
+        benchmark.func(fixture, i);
+    }
+
+    StartGate gate;
+    Vector<sp<BenchmarkThread> > threads;
+    for (int i = 0; i < options.threadCount; i++) {
+        const size_t offset = (size_t) i * options.iterationCount / options.threadCount;
+        sp<BenchmarkThread> thread = new BenchmarkThread(fixture, benchmark, gate, offset,
+                options.iterationCount);
+        thread->run(benchmark.name);
+        threads.add(thread);
+    }
+
+    const size_t heapStart = heapUsage();
+    const int32_t newStart = android_atomic_acquire_load(&gNewCount);
+
+    gate.open();
+
+    nsecs_t totalTime = 0;
+    for (size_t i = 0; i < threads.size(); i++) {
+        threads[i]->join();
+        totalTime += threads[i]->getTime();
+    }
+
+    const int32_t newCount = android_atomic_acquire_load(&gNewCount) - newStart;
+    const ssize_t heapGrowth = (ssize_t) heapUsage() - (ssize_t) heapStart;
+
+    const double opCount = (double) options.iterationCount * options.threadCount;
+    printf("  %-30s %10.1f ns/op %8.2f new/op %8.1f KB heap\n", benchmark.name,
+            totalTime / opCount, newCount / opCount, heapGrowth / 1024.0);
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-n iterations] [-w warmup] [-t threads] [package...]\n", name);
+    fprintf(stderr, "  -n  number of measured operations per thread, %d by default\n",
+            DEFAULT_ITERATION_COUNT);
+    fprintf(stderr, "  -w  number of warmup operations, %d by default\n",
+            DEFAULT_WARMUP_COUNT);
+    fprintf(stderr, "  -t  number of threads running each benchmark, 1 by default\n");
+}
+
+int main(int argc, char** argv) {
+    Options options;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:t:")) != -1) {
+        switch (opt) {
+            case 'n':
+                options.iterationCount = atoi(optarg);
+                break;
+            case 'w':
+                options.warmupCount = atoi(optarg);
+                break;
+            case 't':
+                options.threadCount = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (options.iterationCount <= 0 || options.warmupCount < 0 || options.threadCount <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Vector<const char*> packages;
+    for (int i = optind; i < argc; i++) {
+        packages.add(argv[i]);
+    }
+
+    Fixture fixture;
+    if (!fixture.load(packages)) return 1;
+    fixture.dump();
+
+    printf("%d operations per thread, %d thread%s\n", options.iterationCount,
+            options.threadCount, options.threadCount > 1 ? "s" : "");
+    for (size_t i = 0; i < BENCHMARK_COUNT; i++) {
+        runBenchmark(fixture, gBenchmarks[i], options);
+    }
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "velocitytrackerbench"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <androidfw/VelocityTracker.h>
+#include <utils/BitSet.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+// Reports the cost of a velocity estimate for each least squares strategy,
+// with ten pointers moving together as in a multi-finger gesture, so that
+// changes to the solver can be compared.
+//
+// Usage: velocitytrackerbench [-n iterations]
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define DEFAULT_ITERATION_COUNT 20000
+
+// Nanoseconds per millisecond.
+static const nsecs_t NANOS_PER_MS = 1000000;
+
+static const char* STRATEGIES[] = { "lsq1", "lsq2", "lsq3" };
+
+#define STRATEGY_COUNT (sizeof(STRATEGIES) / sizeof(STRATEGIES[0]))
+#define POINTER_COUNT 10
+#define MOVEMENT_COUNT 12
+
+///////////////////////////////////////////////////////////////////////////////
+// Benchmark
+///////////////////////////////////////////////////////////////////////////////
+
+static bool runStrategy(const char* strategy, int iterationCount) {
+    VelocityTracker tracker(strategy);
+    BitSet32 idBits;
+    for (uint32_t id = 0; id < POINTER_COUNT; id++) {
+        idBits.markBit(id);
+    }
+    for (size_t i = 0; i < MOVEMENT_COUNT; i++) {
+        float t = i * 0.008f;
+        VelocityTracker::Position positions[POINTER_COUNT];
+        for (uint32_t id = 0; id < POINTER_COUNT; id++) {
+            positions[id].x = id * 50 + (500 + id * 50) * t + 1500 * t * t;
+            positions[id].y = 800 * t - 500 * t * t;
+        }
+        tracker.addMovement(nsecs_t(i) * 8 * NANOS_PER_MS, idBits, positions);
+    }
+
+    VelocityTracker::Estimator estimator;
+    // Printed so that the estimates cannot be optimized away
+    float sum = 0;
+    nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < iterationCount; i++) {
+        if (!tracker.getEstimator(i % POINTER_COUNT, &estimator)) {
+            fprintf(stderr, "%s: no estimate for pointer %d\n", strategy, i % POINTER_COUNT);
+            return false;
+        }
+        sum += estimator.xCoeff[1];
+    }
+    nsecs_t elapsedTime = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
+
+    printf("%s: %0.3fus per estimate (checksum %f)\n", strategy,
+            elapsedTime * 0.001 / iterationCount, sum);
+    return true;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-n iterations]\n", name);
+    fprintf(stderr, "  -n  number of estimates per strategy, %d by default\n",
+            DEFAULT_ITERATION_COUNT);
+}
+
+int main(int argc, char** argv) {
+    int iterationCount = DEFAULT_ITERATION_COUNT;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterationCount = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind != argc || iterationCount <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < STRATEGY_COUNT; i++) {
+        if (!runStrategy(STRATEGIES[i], iterationCount)) failures++;
+    }
+
+    return failures == 0 ? 0 : 1;
+}
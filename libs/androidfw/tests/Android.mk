@@ -7,7 +7,8 @@ test_src_files := \
     InputChannel_test.cpp \
     InputEvent_test.cpp \
     InputPublisherAndConsumer_test.cpp \
-    ObbFile_test.cpp
+    ObbFile_test.cpp \
+    VelocityTracker_test.cpp
 
 shared_libraries := \
 	libandroidfw \
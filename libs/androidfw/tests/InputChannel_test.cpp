@@ -22,6 +22,7 @@
 #include <unistd.h>
 #include <time.h>
 #include <errno.h>
+#include <cutils/ashmem.h>
 
 #include "TestHelpers.h"
 
@@ -154,5 +155,97 @@ TEST_F(InputChannelTest, SendSignal_WhenPeerClosed_ReturnsAnError) {
             << "sendMessage should have returned DEAD_OBJECT";
 }
 
+TEST_F(InputChannelTest, SendAndReceiveMessages_WhenBatched_ReturnsEachMessageInOrder) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    InputMessage serverMsgs[3];
+    memset(serverMsgs, 0, sizeof(serverMsgs));
+    serverMsgs[0].header.type = InputMessage::TYPE_KEY;
+    serverMsgs[0].body.key.seq = 1;
+    serverMsgs[1].header.type = InputMessage::TYPE_MOTION;
+    serverMsgs[1].body.motion.seq = 2;
+    serverMsgs[1].body.motion.pointerCount = 2;
+    serverMsgs[2].header.type = InputMessage::TYPE_KEY;
+    serverMsgs[2].body.key.seq = 3;
+    EXPECT_EQ(OK, serverChannel->sendMessages(serverMsgs, 3))
+            << "server channel should be able to send several messages at once";
+
+    InputMessage clientMsg;
+    EXPECT_EQ(OK, clientChannel->receiveMessage(&clientMsg))
+            << "client channel should be able to receive the first message";
+    EXPECT_EQ(uint32_t(InputMessage::TYPE_KEY), clientMsg.header.type);
+    EXPECT_EQ(1U, clientMsg.body.key.seq);
+    EXPECT_TRUE(clientChannel->hasPendingMessages())
+            << "the rest of the batch should be pending";
+
+    EXPECT_EQ(OK, clientChannel->receiveMessage(&clientMsg))
+            << "client channel should be able to receive the second message";
+    EXPECT_EQ(uint32_t(InputMessage::TYPE_MOTION), clientMsg.header.type);
+    EXPECT_EQ(2U, clientMsg.body.motion.seq);
+    EXPECT_EQ(2U, clientMsg.body.motion.pointerCount);
+
+    EXPECT_EQ(OK, clientChannel->receiveMessage(&clientMsg))
+            << "client channel should be able to receive the third message";
+    EXPECT_EQ(uint32_t(InputMessage::TYPE_KEY), clientMsg.header.type);
+    EXPECT_EQ(3U, clientMsg.body.key.seq);
+    EXPECT_FALSE(clientChannel->hasPendingMessages())
+            << "the batch should have been fully consumed";
+
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&clientMsg))
+            << "receiveMessage should have returned WOULD_BLOCK";
+}
+
+TEST_F(InputChannelTest, SendAndReceiveMessages_ThroughSharedRing_Succeeds) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    int ringFd = ashmem_create_region("InputChannelTest ring", 64 * 1024);
+    ASSERT_LE(0, ringFd);
+    int clientRingFd = dup(ringFd);
+    ASSERT_LE(0, clientRingFd);
+    ASSERT_EQ(OK, serverChannel->attachRing(ringFd, true /*producer*/));
+    ASSERT_EQ(OK, clientChannel->attachRing(clientRingFd, false /*producer*/));
+
+    InputMessage serverMsg;
+    memset(&serverMsg, 0, sizeof(InputMessage));
+    serverMsg.header.type = InputMessage::TYPE_KEY;
+    serverMsg.body.key.seq = 7;
+    EXPECT_EQ(OK, serverChannel->sendMessage(&serverMsg))
+            << "server channel should be able to write a message to the ring";
+    EXPECT_TRUE(clientChannel->hasPendingMessages())
+            << "the message should be waiting in the ring";
+
+    InputMessage clientMsg;
+    EXPECT_EQ(OK, clientChannel->receiveMessage(&clientMsg))
+            << "client channel should be able to read the message from the ring";
+    EXPECT_EQ(uint32_t(InputMessage::TYPE_KEY), clientMsg.header.type);
+    EXPECT_EQ(7U, clientMsg.body.key.seq);
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessage(&clientMsg))
+            << "receiveMessage should have returned WOULD_BLOCK";
+
+    // Replies still go through the socket.
+    InputMessage clientReply;
+    memset(&clientReply, 0, sizeof(InputMessage));
+    clientReply.header.type = InputMessage::TYPE_FINISHED;
+    clientReply.body.finished.seq = 7;
+    EXPECT_EQ(OK, clientChannel->sendMessage(&clientReply));
+
+    InputMessage serverReply;
+    EXPECT_EQ(OK, serverChannel->receiveMessage(&serverReply));
+    EXPECT_EQ(uint32_t(InputMessage::TYPE_FINISHED), serverReply.header.type);
+    EXPECT_EQ(7U, serverReply.body.finished.seq);
+}
+
 
 } // namespace android
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <androidfw/VelocityTracker.h>
+#include <utils/Timers.h>
+#include <gtest/gtest.h>
+
+#include <math.h>
+
+namespace android {
+
+// Nanoseconds per millisecond.
+static const nsecs_t NANOS_PER_MS = 1000000;
+
+class VelocityTrackerTest : public testing::Test {
+protected:
+    virtual void SetUp() { }
+    virtual void TearDown() { }
+
+    // Adds samples of a pointer moving along x = x0 + vx t + ax t^2 / 2 and
+    // y = y0 + vy t + ay t^2 / 2, with t in seconds, one sample every 8ms.
+    static void addTrajectory(VelocityTracker& tracker, uint32_t id, size_t count,
+            float vx, float ax, float vy, float ay) {
+        BitSet32 idBits;
+        idBits.markBit(id);
+        for (size_t i = 0; i < count; i++) {
+            float t = i * 0.008f;
+            VelocityTracker::Position position;
+            position.x = 100 + vx * t + ax * t * t * 0.5f;
+            position.y = 200 + vy * t + ay * t * t * 0.5f;
+            tracker.addMovement(nsecs_t(i) * 8 * NANOS_PER_MS, idBits, &position);
+        }
+    }
+};
+
+TEST_F(VelocityTrackerTest, LinearMotionHasConstantVelocity) {
+    VelocityTracker tracker("lsq1");
+    addTrajectory(tracker, 0, 10, 1000, 0, -500, 0);
+
+    float vx, vy;
+    ASSERT_TRUE(tracker.getVelocity(0, &vx, &vy));
+    EXPECT_NEAR(1000, vx, 1);
+    EXPECT_NEAR(-500, vy, 1);
+
+    VelocityTracker::Estimator estimator;
+    ASSERT_TRUE(tracker.getEstimator(0, &estimator));
+    EXPECT_EQ(1U, estimator.degree);
+    EXPECT_NEAR(1, estimator.confidence, 0.001);
+}
+
+TEST_F(VelocityTrackerTest, QuadraticMotionHasAcceleration) {
+    VelocityTracker tracker("lsq2");
+    addTrajectory(tracker, 0, 10, 800, 4000, 300, -2000);
+
+    // The estimator is relative to the newest sample, where t = 72ms.
+    VelocityTracker::Estimator estimator;
+    ASSERT_TRUE(tracker.getEstimator(0, &estimator));
+    ASSERT_EQ(2U, estimator.degree);
+    EXPECT_NEAR(800 + 4000 * 0.072f, estimator.xCoeff[1], 1);
+    EXPECT_NEAR(4000 * 0.5f, estimator.xCoeff[2], 5);
+    EXPECT_NEAR(300 - 2000 * 0.072f, estimator.yCoeff[1], 1);
+    EXPECT_NEAR(-2000 * 0.5f, estimator.yCoeff[2], 5);
+    EXPECT_NEAR(1, estimator.confidence, 0.001);
+}
+
+TEST_F(VelocityTrackerTest, SingleSampleHasNoVelocity) {
+    VelocityTracker tracker("lsq2");
+    addTrajectory(tracker, 0, 1, 1000, 0, 1000, 0);
+
+    VelocityTracker::Estimator estimator;
+    ASSERT_TRUE(tracker.getEstimator(0, &estimator));
+    EXPECT_EQ(0U, estimator.degree);
+    EXPECT_EQ(100, estimator.xCoeff[0]);
+    EXPECT_EQ(200, estimator.yCoeff[0]);
+}
+
+TEST_F(VelocityTrackerTest, StationaryPointerHasZeroVelocity) {
+    VelocityTracker tracker("lsq2");
+    addTrajectory(tracker, 0, 10, 0, 0, 0, 0);
+
+    float vx, vy;
+    ASSERT_TRUE(tracker.getVelocity(0, &vx, &vy));
+    EXPECT_NEAR(0, vx, 0.001);
+    EXPECT_NEAR(0, vy, 0.001);
+}
+
+} // namespace android
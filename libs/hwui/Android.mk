@@ -5,14 +5,20 @@ include $(CLEAR_VARS)
 # defined in the current device/board configuration
 ifeq ($(USE_OPENGL_RENDERER),true)
 	LOCAL_SRC_FILES:= \
+		utils/Blur.cpp \
 		utils/SortedListImpl.cpp \
 		FontRenderer.cpp \
 		GammaFontRenderer.cpp \
+		GlyphPrecacher.cpp \
+		BitmapMeshCache.cpp \
 		Caches.cpp \
 		DisplayListLogBuffer.cpp \
 		DisplayListRenderer.cpp \
+		DisplayListSerializer.cpp \
 		FboCache.cpp \
+		FrameStats.cpp \
 		GradientCache.cpp \
+		Layer.cpp \
 		LayerCache.cpp \
 		LayerRenderer.cpp \
 		Matrix.cpp \
@@ -20,14 +26,21 @@ ifeq ($(USE_OPENGL_RENDERER),true)
 		Patch.cpp \
 		PatchCache.cpp \
 		PathCache.cpp \
+		PathMeshCache.cpp \
+		PathTessellator.cpp \
+		PictureCache.cpp \
 		Program.cpp \
 		ProgramCache.cpp \
+		RenderThread.cpp \
 		ResourceCache.cpp \
 		ShapeCache.cpp \
 		SkiaColorFilter.cpp \
 		SkiaShader.cpp \
 		Snapshot.cpp \
+		Texture.cpp \
+		TextureAtlas.cpp \
 		TextureCache.cpp \
+		TextureUploader.cpp \
 		TextDropShadowCache.cpp
 	
 	LOCAL_C_INCLUDES += \
@@ -48,10 +61,14 @@ ifeq ($(TARGET_BOARD_PLATFORM),exynos4)
 	LOCAL_CFLAGS += -DDONT_DISCARD_FRAMEBUFFER
 endif
 
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+	LOCAL_CFLAGS += -D__ARM_HAVE_NEON
+endif
+
 	LOCAL_CFLAGS += -DUSE_OPENGL_RENDERER -DGL_GLEXT_PROTOTYPES
 	LOCAL_CFLAGS += -fvisibility=hidden
 	LOCAL_MODULE_CLASS := SHARED_LIBRARIES
-	LOCAL_SHARED_LIBRARIES := libcutils libutils libGLESv2 libskia libui
+	LOCAL_SHARED_LIBRARIES := libcutils libutils libEGL libGLESv2 libETC1 libskia libui
 ifeq ($(BOARD_USES_QCOM_HARDWARE),true)
 	LOCAL_SHARED_LIBRARIES += libtilerenderer
 endif
@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <float.h>
+#include <math.h>
+
+#include <SkColor.h>
+
+#include "BitmapMeshCache.h"
+#include "Caches.h"
+#include "Debug.h"
+#include "Properties.h"
+#include "Vertex.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Meshes are indexed with unsigned shorts
+#define MAX_BITMAP_MESH_VERTICES 65536
+
+///////////////////////////////////////////////////////////////////////////////
+// Meshes
+///////////////////////////////////////////////////////////////////////////////
+
+BitmapMesh::BitmapMesh(): hash(0), indicesCount(0), hasColors(false), size(0) {
+    glGenBuffers(1, &meshBuffer);
+    glGenBuffers(1, &indicesBuffer);
+}
+
+BitmapMesh::~BitmapMesh() {
+    // The buffers may be bound, and their names reused by the next buffers
+    Caches& caches = Caches::getInstance();
+    caches.unbindMeshBuffer();
+    caches.unbindIndicesBuffer();
+    glDeleteBuffers(1, &meshBuffer);
+    glDeleteBuffers(1, &indicesBuffer);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+BitmapMeshCache::BitmapMeshCache():
+        mCache(GenerationCache<BitmapMeshCacheEntry, BitmapMesh*>::kUnlimitedCapacity),
+        mSize(0), mMaxSize(MB(DEFAULT_BITMAP_MESH_CACHE_SIZE)) {
+    char property[PROPERTY_VALUE_MAX];
+    if (property_get(PROPERTY_BITMAP_MESH_CACHE_SIZE, property, NULL) > 0) {
+        INIT_LOGD("  Setting bitmap mesh cache size to %sMB", property);
+        setMaxSize(MB(atof(property)));
+    } else {
+        INIT_LOGD("  Using default bitmap mesh cache size of %.2fMB",
+                DEFAULT_BITMAP_MESH_CACHE_SIZE);
+    }
+
+    mCache.setOnEntryRemovedListener(this);
+}
+
+BitmapMeshCache::~BitmapMeshCache() {
+    mCache.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Size management
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t BitmapMeshCache::getSize() {
+    return mSize;
+}
+
+uint32_t BitmapMeshCache::getMaxSize() {
+    return mMaxSize;
+}
+
+void BitmapMeshCache::setMaxSize(uint32_t maxSize) {
+    mMaxSize = maxSize;
+    while (mSize > mMaxSize) {
+        mCache.removeOldest();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Callbacks
+///////////////////////////////////////////////////////////////////////////////
+
+void BitmapMeshCache::operator()(BitmapMeshCacheEntry& entry, BitmapMesh*& mesh) {
+    if (mesh) {
+        mSize -= mesh->size;
+        delete mesh;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Caching
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t BitmapMeshCache::computeHash(const float* vertices, const int* colors,
+        uint32_t count) {
+    // FNV-1a over 32 bit words, much cheaper than uploading the mesh again
+    uint32_t hash = 2166136261u;
+    const uint32_t* words = (const uint32_t*) vertices;
+    for (uint32_t i = 0; i < count * 2; i++) {
+        hash = (hash ^ words[i]) * 16777619u;
+    }
+    if (colors) {
+        words = (const uint32_t*) colors;
+        for (uint32_t i = 0; i < count; i++) {
+            hash = (hash ^ words[i]) * 16777619u;
+        }
+    }
+    return hash;
+}
+
+void BitmapMeshCache::uploadVertices(BitmapMesh* mesh, int meshWidth, int meshHeight,
+        const float* vertices, const int* colors) {
+    const uint32_t count = (meshWidth + 1) * (meshHeight + 1);
+
+    float left = FLT_MAX;
+    float top = FLT_MAX;
+    float right = -FLT_MAX;
+    float bottom = -FLT_MAX;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const float x = vertices[i * 2];
+        const float y = vertices[i * 2 + 1];
+        left = fminf(left, x);
+        top = fminf(top, y);
+        right = fmaxf(right, x);
+        bottom = fmaxf(bottom, y);
+    }
+    mesh->bounds.set(left, top, right, bottom);
+
+    GLsizeiptr size;
+    void* data;
+    if (colors) {
+        ColorTextureVertex* buffer = new ColorTextureVertex[count];
+        ColorTextureVertex* vertex = buffer;
+        for (int32_t y = 0; y <= meshHeight; y++) {
+            for (int32_t x = 0; x <= meshWidth; x++) {
+                const uint32_t i = y * (meshWidth + 1) + x;
+                const SkColor color = colors[i];
+                // The shader expects premultiplied colors
+                const float a = SkColorGetA(color) / 255.0f;
+                ColorTextureVertex::set(vertex++, vertices[i * 2], vertices[i * 2 + 1],
+                        float(x) / meshWidth, float(y) / meshHeight,
+                        a * SkColorGetR(color) / 255.0f, a * SkColorGetG(color) / 255.0f,
+                        a * SkColorGetB(color) / 255.0f, a);
+            }
+        }
+        size = count * sizeof(ColorTextureVertex);
+        data = buffer;
+    } else {
+        TextureVertex* buffer = new TextureVertex[count];
+        TextureVertex* vertex = buffer;
+        for (int32_t y = 0; y <= meshHeight; y++) {
+            for (int32_t x = 0; x <= meshWidth; x++) {
+                const uint32_t i = y * (meshWidth + 1) + x;
+                TextureVertex::set(vertex++, vertices[i * 2], vertices[i * 2 + 1],
+                        float(x) / meshWidth, float(y) / meshHeight);
+            }
+        }
+        size = count * sizeof(TextureVertex);
+        data = buffer;
+    }
+
+    Caches& caches = Caches::getInstance();
+    caches.bindMeshBuffer(mesh->meshBuffer);
+    glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+    caches.resetVertexPointers();
+
+    if (colors) {
+        delete[] (ColorTextureVertex*) data;
+    } else {
+        delete[] (TextureVertex*) data;
+    }
+
+    mesh->hasColors = colors != NULL;
+}
+
+void BitmapMeshCache::uploadIndices(BitmapMesh* mesh, int meshWidth, int meshHeight) {
+    const uint32_t count = meshWidth * meshHeight * 6;
+    uint16_t* indices = new uint16_t[count];
+    uint16_t* index = indices;
+
+    // Same triangles as the meshes drawn from client memory
+    for (int32_t y = 0; y < meshHeight; y++) {
+        for (int32_t x = 0; x < meshWidth; x++) {
+            const uint16_t a = (y + 1) * (meshWidth + 1) + x;
+            const uint16_t b = y * (meshWidth + 1) + x;
+            const uint16_t c = b + 1;
+            const uint16_t d = a + 1;
+
+            *index++ = a;
+            *index++ = b;
+            *index++ = c;
+
+            *index++ = a;
+            *index++ = c;
+            *index++ = d;
+        }
+    }
+
+    Caches::getInstance().bindIndicesBuffer(mesh->indicesBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(uint16_t), indices, GL_STATIC_DRAW);
+    mesh->indicesCount = count;
+
+    delete[] indices;
+}
+
+BitmapMesh* BitmapMeshCache::get(int meshWidth, int meshHeight,
+        const float* vertices, const int* colors) {
+    if (meshWidth <= 0 || meshHeight <= 0) return NULL;
+
+    const uint32_t count = (meshWidth + 1) * (meshHeight + 1);
+    if (count > MAX_BITMAP_MESH_VERTICES) return NULL;
+
+    const uint32_t hash = computeHash(vertices, colors, count);
+
+    BitmapMeshCacheEntry entry(vertices, colors, meshWidth, meshHeight);
+    BitmapMesh* mesh = mCache.get(entry);
+
+    if (mesh) {
+        // The arrays were updated or reused for another mesh of the same
+        // size, the indices are still valid
+        if (mesh->hash != hash) {
+            uploadVertices(mesh, meshWidth, meshHeight, vertices, colors);
+            mesh->hash = hash;
+        }
+        return mesh;
+    }
+
+    const uint32_t size = count * (colors ? sizeof(ColorTextureVertex) : sizeof(TextureVertex)) +
+            meshWidth * meshHeight * 6 * sizeof(uint16_t);
+    if (size > mMaxSize) {
+        return NULL;
+    }
+
+    while (mSize + size > mMaxSize) {
+        mCache.removeOldest();
+    }
+
+    mesh = new BitmapMesh;
+    uploadVertices(mesh, meshWidth, meshHeight, vertices, colors);
+    uploadIndices(mesh, meshWidth, meshHeight);
+    mesh->hash = hash;
+    mesh->size = size;
+
+    mSize += size;
+    mCache.put(entry, mesh);
+
+    return mesh;
+}
+
+void BitmapMeshCache::clear() {
+    mCache.clear();
+}
+
+}; // namespace uirenderer
+}; // namespace android
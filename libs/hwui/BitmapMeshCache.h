@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_BITMAP_MESH_CACHE_H
+#define ANDROID_HWUI_BITMAP_MESH_CACHE_H
+
+#include <GLES2/gl2.h>
+
+#include "Rect.h"
+#include "utils/Compare.h"
+#include "utils/GenerationCache.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Identifies the arrays of a bitmap mesh. Display lists keep the arrays
+ * they record at the same address for as long as they live.
+ */
+struct BitmapMeshCacheEntry {
+    BitmapMeshCacheEntry() {
+        vertices = NULL;
+        colors = NULL;
+        meshWidth = 0;
+        meshHeight = 0;
+    }
+
+    BitmapMeshCacheEntry(const float* vertices, const int* colors,
+            int meshWidth, int meshHeight) {
+        this->vertices = vertices;
+        this->colors = colors;
+        this->meshWidth = meshWidth;
+        this->meshHeight = meshHeight;
+    }
+
+    bool operator<(const BitmapMeshCacheEntry& rhs) const {
+        LTE_INT(vertices) {
+            LTE_INT(colors) {
+                LTE_INT(meshWidth) {
+                    LTE_INT(meshHeight) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    const float* vertices;
+    const int* colors;
+    int meshWidth;
+    int meshHeight;
+}; // struct BitmapMeshCacheEntry
+
+/**
+ * A bitmap mesh uploaded in a VBO, one vertex per point of the grid, and
+ * the indices of its triangles. Vertices are ColorTextureVertex when the
+ * mesh has colors and TextureVertex otherwise.
+ */
+struct BitmapMesh {
+    BitmapMesh();
+    ~BitmapMesh();
+
+    // Hash of the vertices and colors the buffers hold
+    uint32_t hash;
+
+    GLuint meshBuffer;
+    GLuint indicesBuffer;
+    GLsizei indicesCount;
+    bool hasColors;
+
+    // Bounds of the vertices, used to dirty layers
+    Rect bounds;
+
+    // Size of the buffers in bytes
+    uint32_t size;
+}; // struct BitmapMesh
+
+/**
+ * A simple LRU cache of bitmap meshes. The cache has a maximum size
+ * expressed in bytes. A mesh found at the same arrays but with different
+ * contents, when the arrays are reused by a new frame, is uploaded again
+ * in the same buffers.
+ */
+class BitmapMeshCache: public OnEntryRemoved<BitmapMeshCacheEntry, BitmapMesh*> {
+public:
+    BitmapMeshCache();
+    ~BitmapMeshCache();
+
+    /**
+     * Used as a callback when an entry is removed from the cache.
+     * Do not invoke directly.
+     */
+    void operator()(BitmapMeshCacheEntry& entry, BitmapMesh*& mesh);
+
+    /**
+     * Returns the mesh of the specified vertices and colors, which can be
+     * NULL. Returns NULL if the mesh has too many vertices to be indexed
+     * with 16 bit indices or is too large to be cached, in which case it
+     * must be drawn from client memory.
+     */
+    BitmapMesh* get(int meshWidth, int meshHeight, const float* vertices, const int* colors);
+
+    /**
+     * Clears the cache. This causes all meshes to be deleted.
+     */
+    void clear();
+
+    /**
+     * Sets the maximum size of the cache in bytes.
+     */
+    void setMaxSize(uint32_t maxSize);
+    /**
+     * Returns the maximum size of the cache in bytes.
+     */
+    uint32_t getMaxSize();
+    /**
+     * Returns the current size of the cache in bytes.
+     */
+    uint32_t getSize();
+
+private:
+    static uint32_t computeHash(const float* vertices, const int* colors, uint32_t count);
+
+    static void uploadVertices(BitmapMesh* mesh, int meshWidth, int meshHeight,
+            const float* vertices, const int* colors);
+    static void uploadIndices(BitmapMesh* mesh, int meshWidth, int meshHeight);
+
+    GenerationCache<BitmapMeshCacheEntry, BitmapMesh*> mCache;
+    uint32_t mSize;
+    uint32_t mMaxSize;
+}; // class BitmapMeshCache
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_BITMAP_MESH_CACHE_H
@@ -43,6 +43,13 @@ namespace uirenderer {
     #define FLUSH_LOGD(...)
 #endif
 
+// Number of frames between two rebalancing of the cache sizes
+#define BALANCE_CACHES_INTERVAL 120
+
+static inline uint32_t minSize(uint32_t a, uint32_t b) {
+    return a < b ? a : b;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Constructors/destructor
 ///////////////////////////////////////////////////////////////////////////////
@@ -55,6 +62,35 @@ Caches::Caches(): Singleton<Caches>(), mInitialized(false) {
     mDebugLevel = readDebugLevel();
     ALOGD("Enabling debug mode %d", mDebugLevel);
 
+    char property[PROPERTY_VALUE_MAX];
+    mDeferredReplay = property_get(PROPERTY_DEFERRED_REPLAY, property, NULL) > 0 &&
+            !strcmp(property, "true");
+    if (mDeferredReplay) {
+        INIT_LOGD("Display lists will be replayed in deferred mode");
+    }
+
+    mOcclusion = property_get(PROPERTY_OCCLUSION, property, NULL) > 0 &&
+            !strcmp(property, "true");
+    if (mOcclusion) {
+        INIT_LOGD("Display lists will skip occluded operations");
+    }
+
+    mStreamVertices = property_get(PROPERTY_STREAM_VERTICES, property, NULL) > 0 &&
+            !strcmp(property, "true");
+    if (mStreamVertices) {
+        INIT_LOGD("Lines and points will be streamed in a VBO");
+    }
+
+    mCacheBalancing = property_get(PROPERTY_CACHE_BALANCING, property, NULL) > 0 &&
+            !strcmp(property, "true");
+    if (mCacheBalancing) {
+        INIT_LOGD("Caches will lend unused memory to each other");
+    }
+    for (int i = 0; i < kBalancedCacheCount; i++) {
+        mBalancedCacheSizes[i] = getBalancedCacheMaxSize(i);
+    }
+    mFramesSinceBalance = 0;
+
 #if RENDER_LAYERS_AS_REGIONS
     INIT_LOGD("Layers will be composited as regions");
 #endif
@@ -78,14 +114,29 @@ void Caches::init() {
 
     glActiveTexture(gTextureUnits[0]);
     mTextureUnit = 0;
+    resetBoundTextures();
+
+    mCurrentFramebuffer = 0;
+    mFramebufferBound = false;
 
     mRegionMesh = NULL;
 
+    mStreamBuffer = 0;
+    mStreamOffset = 0;
+
     blend = false;
     lastSrcMode = GL_ZERO;
     lastDstMode = GL_ZERO;
     currentProgram = NULL;
 
+    programCache.loadCache(extensions.hasProgramBinary());
+    programCache.startWarmup();
+
+    char property[PROPERTY_VALUE_MAX];
+    bool frameStatsEnabled = property_get(PROPERTY_FRAME_STATS, property, NULL) > 0 &&
+            !strcmp(property, "true");
+    frameStats.init(frameStatsEnabled, extensions.hasDisjointTimerQuery());
+
     mInitialized = true;
 }
 
@@ -129,11 +180,24 @@ void Caches::terminate() {
     delete[] mRegionMesh;
     mRegionMesh = NULL;
 
+    if (mStreamBuffer) {
+        glDeleteBuffers(1, &mStreamBuffer);
+        mStreamBuffer = 0;
+    }
+
     fboCache.clear();
+    bitmapMeshCache.clear();
+    pictureCache.clear();
 
+    textureCache.stopUploads();
+
+    programCache.stopWarmup();
+    programCache.saveCache();
     programCache.clear();
     currentProgram = NULL;
 
+    frameStats.terminate();
+
     mInitialized = false;
 }
 
@@ -157,6 +221,12 @@ void Caches::dumpMemoryUsage(String8 &log) {
             gradientCache.getSize(), gradientCache.getMaxSize());
     log.appendFormat("  PathCache            %8d / %8d\n",
             pathCache.getSize(), pathCache.getMaxSize());
+    log.appendFormat("  PathMeshCache        %8d / %8d\n",
+            pathMeshCache.getSize(), pathMeshCache.getMaxSize());
+    log.appendFormat("  BitmapMeshCache      %8d / %8d\n",
+            bitmapMeshCache.getSize(), bitmapMeshCache.getMaxSize());
+    log.appendFormat("  PictureCache         %8d / %8d\n",
+            pictureCache.getSize(), pictureCache.getMaxSize());
     log.appendFormat("  CircleShapeCache     %8d / %8d\n",
             circleShapeCache.getSize(), circleShapeCache.getMaxSize());
     log.appendFormat("  OvalShapeCache       %8d / %8d\n",
@@ -184,6 +254,9 @@ void Caches::dumpMemoryUsage(String8 &log) {
     total += layerCache.getSize();
     total += gradientCache.getSize();
     total += pathCache.getSize();
+    total += pathMeshCache.getSize();
+    total += bitmapMeshCache.getSize();
+    total += pictureCache.getSize();
     total += dropShadowCache.getSize();
     total += roundRectShapeCache.getSize();
     total += circleShapeCache.getSize();
@@ -196,6 +269,19 @@ void Caches::dumpMemoryUsage(String8 &log) {
 
     log.appendFormat("Total memory usage:\n");
     log.appendFormat("  %d bytes, %.2f MB\n", total, total / 1024.0f / 1024.0f);
+
+    if (mCacheBalancing) {
+        static const char* names[kBalancedCacheCount] = {
+            "TextureCache", "GradientCache", "PathCache", "PictureCache", "TextDropShadowCache"
+        };
+        log.appendFormat("Balanced cache size / configured size (bytes), usage:\n");
+        for (int i = 0; i < kBalancedCacheCount; i++) {
+            const uint32_t maxSize = getBalancedCacheMaxSize(i);
+            log.appendFormat("  %-20s %8d / %8d, %3d%%\n", names[i], maxSize,
+                    mBalancedCacheSizes[i],
+                    maxSize ? int(100.0f * getBalancedCacheSize(i) / maxSize) : 0);
+        }
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -203,8 +289,15 @@ void Caches::dumpMemoryUsage(String8 &log) {
 ///////////////////////////////////////////////////////////////////////////////
 
 void Caches::clearGarbage() {
+    if (mCacheBalancing && ++mFramesSinceBalance >= BALANCE_CACHES_INTERVAL) {
+        balanceCaches();
+        mFramesSinceBalance = 0;
+    }
+
     textureCache.clearGarbage();
     pathCache.clearGarbage();
+    pathMeshCache.clearGarbage();
+    pictureCache.clearGarbage();
 
     Mutex::Autolock _l(mGarbageLock);
 
@@ -223,6 +316,108 @@ void Caches::clearGarbage() {
     mDisplayListGarbage.clear();
 }
 
+uint32_t Caches::getBalancedCacheSize(int cache) {
+    switch (cache) {
+        case kBalancedCache_Texture: return textureCache.getSize();
+        case kBalancedCache_Gradient: return gradientCache.getSize();
+        case kBalancedCache_Path: return pathCache.getSize();
+        case kBalancedCache_Picture: return pictureCache.getSize();
+        case kBalancedCache_DropShadow: return dropShadowCache.getSize();
+    }
+    return 0;
+}
+
+uint32_t Caches::getBalancedCacheMaxSize(int cache) {
+    switch (cache) {
+        case kBalancedCache_Texture: return textureCache.getMaxSize();
+        case kBalancedCache_Gradient: return gradientCache.getMaxSize();
+        case kBalancedCache_Path: return pathCache.getMaxSize();
+        case kBalancedCache_Picture: return pictureCache.getMaxSize();
+        case kBalancedCache_DropShadow: return dropShadowCache.getMaxSize();
+    }
+    return 0;
+}
+
+void Caches::setBalancedCacheMaxSize(int cache, uint32_t maxSize) {
+    switch (cache) {
+        case kBalancedCache_Texture: textureCache.setMaxSize(maxSize); break;
+        case kBalancedCache_Gradient: gradientCache.setMaxSize(maxSize); break;
+        case kBalancedCache_Path: pathCache.setMaxSize(maxSize); break;
+        case kBalancedCache_Picture: pictureCache.setMaxSize(maxSize); break;
+        case kBalancedCache_DropShadow: dropShadowCache.setMaxSize(maxSize); break;
+    }
+}
+
+/**
+ * Moves memory from the caches that do not use most of theirs to the caches
+ * that are full, and therefore evicting entries to make room for new ones.
+ * A cache never goes below half or above four times its configured size and
+ * the sum of the sizes never exceeds the sum of the configured sizes.
+ */
+void Caches::balanceCaches() {
+    uint32_t spare = 0;
+    uint32_t fullCount = 0;
+    bool full[kBalancedCacheCount];
+
+    for (int i = 0; i < kBalancedCacheCount; i++) {
+        const uint32_t size = getBalancedCacheSize(i);
+        const uint32_t maxSize = getBalancedCacheMaxSize(i);
+
+        full[i] = size >= maxSize - maxSize / 8 && maxSize < mBalancedCacheSizes[i] * 4;
+        if (full[i]) {
+            fullCount++;
+        } else if (size < maxSize / 2) {
+            // Keep a quarter of headroom above the current usage
+            uint32_t newMaxSize = size + size / 4;
+            if (newMaxSize < mBalancedCacheSizes[i] / 2) {
+                newMaxSize = mBalancedCacheSizes[i] / 2;
+            }
+            if (newMaxSize < maxSize) {
+                spare += maxSize - newMaxSize;
+                setBalancedCacheMaxSize(i, newMaxSize);
+            }
+        }
+    }
+
+    // Memory nobody needs goes back to the caches below their configured size
+    for (int i = 0; i < kBalancedCacheCount && fullCount == 0 && spare > 0; i++) {
+        const uint32_t maxSize = getBalancedCacheMaxSize(i);
+        if (maxSize < mBalancedCacheSizes[i]) {
+            const uint32_t grant = minSize(spare, mBalancedCacheSizes[i] - maxSize);
+            setBalancedCacheMaxSize(i, maxSize + grant);
+            spare -= grant;
+        }
+    }
+
+    if (fullCount > 0) {
+        const uint32_t share = spare / fullCount;
+        for (int i = 0; i < kBalancedCacheCount; i++) {
+            if (!full[i]) continue;
+            const uint32_t maxSize = getBalancedCacheMaxSize(i);
+            const uint32_t grant = minSize(share, mBalancedCacheSizes[i] * 4 - maxSize);
+            setBalancedCacheMaxSize(i, maxSize + grant);
+            spare -= grant;
+        }
+    }
+
+    // Whatever could not be lent goes back to the caches it was taken from
+    for (int i = 0; i < kBalancedCacheCount && spare > 0; i++) {
+        const uint32_t maxSize = getBalancedCacheMaxSize(i);
+        if (!full[i] && maxSize < mBalancedCacheSizes[i]) {
+            const uint32_t grant = minSize(spare, mBalancedCacheSizes[i] - maxSize);
+            setBalancedCacheMaxSize(i, maxSize + grant);
+            spare -= grant;
+        }
+    }
+}
+
+void Caches::resetCacheBalance() {
+    for (int i = 0; i < kBalancedCacheCount; i++) {
+        setBalancedCacheMaxSize(i, mBalancedCacheSizes[i]);
+    }
+    mFramesSinceBalance = 0;
+}
+
 void Caches::deleteLayerDeferred(Layer* layer) {
     Mutex::Autolock _l(mGarbageLock);
     mLayerGarbage.push(layer);
@@ -237,6 +432,7 @@ void Caches::flush(FlushMode mode) {
     FLUSH_LOGD("Flushing caches (mode %d)", mode);
 
     clearGarbage();
+    programCache.saveCache();
 
     switch (mode) {
         case kFlushMode_Full:
@@ -247,9 +443,17 @@ void Caches::flush(FlushMode mode) {
             fontRenderer.clear();
             // fall through
         case kFlushMode_Moderate:
+            // Memory is tight, no cache gets to keep memory lent by another
+            if (mCacheBalancing) {
+                resetCacheBalance();
+            }
             fontRenderer.flush();
             textureCache.flush();
+            layerCache.clear();
             pathCache.clear();
+            pathMeshCache.clear();
+            bitmapMeshCache.clear();
+            pictureCache.clear();
             roundRectShapeCache.clear();
             circleShapeCache.clear();
             ovalShapeCache.clear();
@@ -257,7 +461,8 @@ void Caches::flush(FlushMode mode) {
             arcShapeCache.clear();
             // fall through
         case kFlushMode_Layers:
-            layerCache.clear();
+            // Keep the most recently used layers unless memory is tight
+            layerCache.flush();
             break;
     }
 }
@@ -276,6 +481,7 @@ bool Caches::bindMeshBuffer(const GLuint buffer) {
         mCurrentBuffer = buffer;
         return true;
     }
+    frameStats.countRedundantCall();
     return false;
 }
 
@@ -306,10 +512,39 @@ bool Caches::unbindIndicesBuffer() {
     return false;
 }
 
+bool Caches::streamVertices(const GLvoid* vertices, GLsizeiptr size, GLvoid** offset) {
+    if (!mStreamVertices || size > STREAM_BUFFER_SIZE) return false;
+
+    if (!mStreamBuffer) {
+        glGenBuffers(1, &mStreamBuffer);
+        bindMeshBuffer(mStreamBuffer);
+        glBufferData(GL_ARRAY_BUFFER, STREAM_BUFFER_SIZE, NULL, GL_STREAM_DRAW);
+        mStreamOffset = 0;
+    } else {
+        bindMeshBuffer(mStreamBuffer);
+    }
+
+    // Keep the vertices aligned on floats
+    GLsizeiptr start = (mStreamOffset + 3) & ~3;
+    if (start + size > STREAM_BUFFER_SIZE) {
+        // Orphan the storage instead of waiting for the GPU to be done with it
+        glBufferData(GL_ARRAY_BUFFER, STREAM_BUFFER_SIZE, NULL, GL_STREAM_DRAW);
+        start = 0;
+    }
+
+    glBufferSubData(GL_ARRAY_BUFFER, start, size, vertices);
+    mStreamOffset = start + size;
+
+    *offset = (GLvoid*) start;
+    return true;
+}
+
 void Caches::bindPositionVertexPointer(bool force, GLuint slot, GLvoid* vertices, GLsizei stride) {
     if (force || vertices != mCurrentPositionPointer) {
         glVertexAttribPointer(slot, 2, GL_FLOAT, GL_FALSE, stride, vertices);
         mCurrentPositionPointer = vertices;
+    } else {
+        frameStats.countRedundantCall();
     }
 }
 
@@ -317,6 +552,8 @@ void Caches::bindTexCoordsVertexPointer(bool force, GLuint slot, GLvoid* vertice
     if (force || vertices != mCurrentTexCoordsPointer) {
         glVertexAttribPointer(slot, 2, GL_FLOAT, GL_FALSE, gMeshStride, vertices);
         mCurrentTexCoordsPointer = vertices;
+    } else {
+        frameStats.countRedundantCall();
     }
 }
 
@@ -344,13 +581,112 @@ void Caches::disbaleTexCoordsVertexArray() {
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Textures
+///////////////////////////////////////////////////////////////////////////////
+
 void Caches::activeTexture(GLuint textureUnit) {
     if (mTextureUnit != textureUnit) {
         glActiveTexture(gTextureUnits[textureUnit]);
         mTextureUnit = textureUnit;
+    } else {
+        frameStats.countRedundantCall();
+    }
+}
+
+void Caches::bindTexture(GLuint texture) {
+    bindTexture(GL_TEXTURE_2D, texture);
+}
+
+void Caches::bindTexture(GLenum target, GLuint texture) {
+    GLuint* boundTextures = target == GL_TEXTURE_EXTERNAL_OES ?
+            mBoundExternalTextures : mBoundTextures;
+    if (boundTextures[mTextureUnit] != texture) {
+        glBindTexture(target, texture);
+        boundTextures[mTextureUnit] = texture;
+    } else {
+        frameStats.countRedundantCall();
+    }
+}
+
+void Caches::deleteTexture(GLuint texture) {
+    // Deleting a texture reverts its bindings to 0, and the name can be
+    // reused by the next generated texture
+    glDeleteTextures(1, &texture);
+
+    for (uint32_t i = 0; i < REQUIRED_TEXTURE_UNITS_COUNT; i++) {
+        if (mBoundTextures[i] == texture) mBoundTextures[i] = 0;
+        if (mBoundExternalTextures[i] == texture) mBoundExternalTextures[i] = 0;
     }
 }
 
+void Caches::resetBoundTextures() {
+    memset(mBoundTextures, 0, sizeof(mBoundTextures));
+    memset(mBoundExternalTextures, 0, sizeof(mBoundExternalTextures));
+}
+
+void Caches::resetActiveTextureBindings() {
+    mBoundTextures[mTextureUnit] = 0;
+    mBoundExternalTextures[mTextureUnit] = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Framebuffers
+///////////////////////////////////////////////////////////////////////////////
+
+void Caches::bindFramebuffer(GLuint fbo) {
+    if (!mFramebufferBound || mCurrentFramebuffer != fbo) {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        mCurrentFramebuffer = fbo;
+        mFramebufferBound = true;
+        frameStats.countFboSwitch();
+    } else {
+        frameStats.countRedundantCall();
+    }
+}
+
+void Caches::deleteFramebuffer(GLuint fbo) {
+    glDeleteFramebuffers(1, &fbo);
+    if (mCurrentFramebuffer == fbo) {
+        mCurrentFramebuffer = 0;
+    }
+}
+
+void Caches::resetFramebuffer() {
+    mFramebufferBound = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Blending
+///////////////////////////////////////////////////////////////////////////////
+
+void Caches::setBlend(bool enable) {
+    if (blend != enable) {
+        if (enable) {
+            glEnable(GL_BLEND);
+        } else {
+            glDisable(GL_BLEND);
+        }
+        blend = enable;
+    } else {
+        frameStats.countRedundantCall();
+    }
+}
+
+void Caches::setBlendFunc(GLenum sourceMode, GLenum destMode) {
+    if (sourceMode != lastSrcMode || destMode != lastDstMode) {
+        glBlendFunc(sourceMode, destMode);
+        lastSrcMode = sourceMode;
+        lastDstMode = destMode;
+    } else {
+        frameStats.countRedundantCall();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Scissor
+///////////////////////////////////////////////////////////////////////////////
+
 void Caches::setScissor(GLint x, GLint y, GLint width, GLint height) {
     if (x != mScissorX || y != mScissorY || width != mScissorWidth || height != mScissorHeight) {
         glScissor(x, y, width, height);
@@ -359,6 +695,8 @@ void Caches::setScissor(GLint x, GLint y, GLint width, GLint height) {
         mScissorY = y;
         mScissorWidth = width;
         mScissorHeight = height;
+    } else {
+        frameStats.countRedundantCall();
     }
 }
 
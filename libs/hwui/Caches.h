@@ -26,8 +26,10 @@
 #include <cutils/compiler.h>
 
 #include "Extensions.h"
+#include "FrameStats.h"
 #include "FontRenderer.h"
 #include "GammaFontRenderer.h"
+#include "GlyphPrecacher.h"
 #include "TextureCache.h"
 #include "LayerCache.h"
 #include "GradientCache.h"
@@ -35,6 +37,9 @@
 #include "ProgramCache.h"
 #include "ShapeCache.h"
 #include "PathCache.h"
+#include "PathMeshCache.h"
+#include "BitmapMeshCache.h"
+#include "PictureCache.h"
 #include "TextDropShadowCache.h"
 #include "FboCache.h"
 #include "ResourceCache.h"
@@ -50,6 +55,9 @@ namespace uirenderer {
 
 #define REGION_MESH_QUAD_COUNT 512
 
+// Size in bytes of the VBO used to stream the vertices of lines and points
+#define STREAM_BUFFER_SIZE (512 * 1024)
+
 // Generates simple and textured vertices
 #define FV(x, y, u, v) { { x, y }, { u, v } }
 
@@ -68,6 +76,7 @@ static const GLsizei gAAVertexStride = sizeof(AAVertex);
 static const GLsizei gMeshTextureOffset = 2 * sizeof(float);
 static const GLsizei gVertexAAWidthOffset = 2 * sizeof(float);
 static const GLsizei gVertexAALengthOffset = 3 * sizeof(float);
+static const GLsizei gVertexAlphaOffset = 2 * sizeof(float);
 static const GLsizei gMeshCount = 4;
 
 static const GLenum gTextureUnits[] = {
@@ -132,6 +141,22 @@ public:
         return mDebugLevel;
     }
 
+    /**
+     * Indicates whether display lists should batch compatible drawing
+     * operations when replayed. See DisplayList::replay().
+     */
+    bool isDeferredReplayEnabled() const {
+        return mDeferredReplay;
+    }
+
+    /**
+     * Indicates whether display lists should skip the operations hidden by
+     * the opaque operations recorded after them.
+     */
+    bool isOcclusionEnabled() const {
+        return mOcclusion;
+    }
+
     /**
      * Call this on each frame to ensure that garbage is deleted from
      * GPU memory.
@@ -166,6 +191,18 @@ public:
     bool bindIndicesBuffer(const GLuint buffer);
     bool unbindIndicesBuffer();
 
+    /**
+     * Copies the specified vertices after the ones previously streamed in
+     * the streaming VBO and binds that VBO. When the VBO is full its storage
+     * is orphaned so queued draws can keep reading the old vertices, then
+     * streaming starts over at the beginning of the new storage.
+     *
+     * Returns false if streaming is disabled or if the vertices do not fit
+     * in the VBO, in which case they must be drawn from client memory.
+     * Otherwise offset is set to the position of the vertices in the VBO.
+     */
+    bool streamVertices(const GLvoid* vertices, GLsizeiptr size, GLvoid** offset);
+
     /**
      * Binds an attrib to the specified float vertex pointer.
      * Assumes a stride of gMeshStride and a size of 2.
@@ -194,6 +231,54 @@ public:
      */
     void activeTexture(GLuint textureUnit);
 
+    /**
+     * Binds the specified texture to the active texture unit, if needed.
+     * All the textures must be bound with these methods, and deleted with
+     * deleteTexture(), for the bindings to be tracked correctly.
+     */
+    void bindTexture(GLuint texture);
+    void bindTexture(GLenum target, GLuint texture);
+
+    /**
+     * Deletes the specified texture and forgets its bindings.
+     */
+    void deleteTexture(GLuint texture);
+
+    /**
+     * Forgets the tracked texture bindings. Must be called after textures
+     * are bound without this class, by a functor or a SurfaceTexture.
+     */
+    void resetBoundTextures();
+    /**
+     * Forgets the tracked bindings of the active texture unit only.
+     */
+    void resetActiveTextureBindings();
+
+    /**
+     * Binds the specified framebuffer, if needed.
+     */
+    void bindFramebuffer(GLuint fbo);
+
+    /**
+     * Deletes the specified framebuffer and forgets its binding.
+     */
+    void deleteFramebuffer(GLuint fbo);
+
+    /**
+     * Forgets the tracked framebuffer binding.
+     */
+    void resetFramebuffer();
+
+    /**
+     * Enables or disables blending, if needed.
+     */
+    void setBlend(bool enable);
+
+    /**
+     * Sets the blending function, if needed.
+     */
+    void setBlendFunc(GLenum sourceMode, GLenum destMode);
+
     /**
      * Sets the scissor for the current surface.
      */
@@ -236,6 +321,9 @@ public:
     GradientCache gradientCache;
     ProgramCache programCache;
     PathCache pathCache;
+    PathMeshCache pathMeshCache;
+    BitmapMeshCache bitmapMeshCache;
+    PictureCache pictureCache;
     RoundRectShapeCache roundRectShapeCache;
     CircleShapeCache circleShapeCache;
     OvalShapeCache ovalShapeCache;
@@ -245,6 +333,8 @@ public:
     TextDropShadowCache dropShadowCache;
     FboCache fboCache;
     GammaFontRenderer fontRenderer;
+    GlyphPrecacher glyphPrecacher;
+    FrameStats frameStats;
     ResourceCache resourceCache;
 
     // Debug methods
@@ -279,6 +369,11 @@ private:
     bool mTexCoordsArrayEnabled;
 
     GLuint mTextureUnit;
+    GLuint mBoundTextures[REQUIRED_TEXTURE_UNITS_COUNT];
+    GLuint mBoundExternalTextures[REQUIRED_TEXTURE_UNITS_COUNT];
+
+    GLuint mCurrentFramebuffer;
+    bool mFramebufferBound;
 
     GLint mScissorX;
     GLint mScissorY;
@@ -289,11 +384,42 @@ private:
     TextureVertex* mRegionMesh;
     GLuint mRegionMeshIndices;
 
+    // Used to stream lines and points
+    GLuint mStreamBuffer;
+    GLsizeiptr mStreamOffset;
+
     mutable Mutex mGarbageLock;
     Vector<Layer*> mLayerGarbage;
     Vector<DisplayList*> mDisplayListGarbage;
 
+    /**
+     * Caches whose memory can be lent to each other, see balanceCaches().
+     */
+    enum BalancedCache {
+        kBalancedCache_Texture = 0,
+        kBalancedCache_Gradient,
+        kBalancedCache_Path,
+        kBalancedCache_Picture,
+        kBalancedCache_DropShadow,
+        kBalancedCacheCount
+    };
+
+    void balanceCaches();
+    void resetCacheBalance();
+
+    uint32_t getBalancedCacheSize(int cache);
+    uint32_t getBalancedCacheMaxSize(int cache);
+    void setBalancedCacheMaxSize(int cache, uint32_t maxSize);
+
+    // Sizes the balanced caches were configured with
+    uint32_t mBalancedCacheSizes[kBalancedCacheCount];
+    uint32_t mFramesSinceBalance;
+
     DebugLevel mDebugLevel;
+    bool mDeferredReplay;
+    bool mOcclusion;
+    bool mStreamVertices;
+    bool mCacheBalancing;
     bool mInitialized;
 }; // class Caches
 
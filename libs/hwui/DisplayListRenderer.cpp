@@ -91,6 +91,12 @@ void DisplayList::outputLogBuffer(int fd) {
     fprintf(file, "\nCaches:\n%s", cachesLog.string());
     fprintf(file, "\n");
 
+    String8 statsLog;
+    Caches::getInstance().frameStats.dump(statsLog, OP_NAMES, DrawGLFunction + 1);
+    if (!statsLog.isEmpty()) {
+        fprintf(file, "%s\n", statsLog.string());
+    }
+
     fflush(file);
 }
 
@@ -180,15 +186,17 @@ void DisplayList::clearResources() {
     }
     mShaders.clear();
 
+    // Paints, paths and matrices live in the allocators
     for (size_t i = 0; i < mPaints.size(); i++) {
-        delete mPaints.itemAt(i);
+        mPaints.itemAt(i)->~SkPaint();
     }
     mPaints.clear();
 
     for (size_t i = 0; i < mPaths.size(); i++) {
         SkPath* path = mPaths.itemAt(i);
         caches.pathCache.remove(path);
-        delete path;
+        caches.pathMeshCache.remove(path);
+        path->~SkPath();
     }
     mPaths.clear();
 
@@ -197,10 +205,18 @@ void DisplayList::clearResources() {
     }
     mSourcePaths.clear();
 
-    for (size_t i = 0; i < mMatrices.size(); i++) {
-        delete mMatrices.itemAt(i);
-    }
     mMatrices.clear();
+
+    for (size_t i = 0; i < mAllocators.size(); i++) {
+        delete mAllocators.itemAt(i);
+    }
+    mAllocators.clear();
+}
+
+void DisplayList::addAllocator(SkChunkAlloc* allocator) {
+    if (allocator) {
+        mAllocators.add(allocator);
+    }
 }
 
 void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorder, bool reusing) {
@@ -222,6 +238,20 @@ void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorde
     writer.flatten(buffer);
     mReader.setMemory(buffer, mSize);
 
+    addResources(recorder);
+
+    const Vector<DisplayListRange>& ranges = recorder.getRanges();
+    for (size_t i = 0; i < ranges.size(); i++) {
+        mRanges.add(ranges.itemAt(i));
+    }
+
+    const Vector<OccludedOp>& occludedOps = recorder.getOccludedOps();
+    for (size_t i = 0; i < occludedOps.size(); i++) {
+        mOccludedOps.add(occludedOps.itemAt(i));
+    }
+}
+
+void DisplayList::addResources(const DisplayListRenderer& recorder) {
     Caches& caches = Caches::getInstance();
 
     const Vector<SkBitmap*>& bitmapResources = recorder.getBitmapResources();
@@ -277,6 +307,63 @@ void DisplayList::initFromDisplayListRenderer(const DisplayListRenderer& recorde
 void DisplayList::init() {
     mSize = 0;
     mIsRenderable = true;
+    mRanges.clear();
+    mOccludedOps.clear();
+    mPatchedSize = 0;
+}
+
+bool DisplayList::patchRange(int32_t range, DisplayListRenderer& recorder) {
+    if (!getRange(range)) return false;
+
+    const uint32_t offset = mRanges.itemAt(range).offset;
+    const uint32_t oldSize = mRanges.itemAt(range).size;
+
+    // The resources of the replaced operations are kept until the next
+    // recording, don't let them grow larger than the display list itself
+    if (mPatchedSize + oldSize > mSize) return false;
+
+    const SkWriter32& writer = recorder.writeStream();
+    const uint32_t newSize = writer.size();
+    const uint32_t tail = mSize - offset - oldSize;
+    const size_t size = mSize - oldSize + newSize;
+
+    const uint8_t* base = (const uint8_t*) mReader.base();
+    uint8_t* buffer = (uint8_t*) sk_malloc_throw(size);
+    memcpy(buffer, base, offset);
+    if (newSize > 0) {
+        writer.flatten(buffer + offset);
+    }
+    memcpy(buffer + offset + newSize, base + offset + oldSize, tail);
+
+    sk_free((void*) base);
+    mReader.setMemory(buffer, size);
+    mSize = size;
+    mPatchedSize += oldSize;
+
+    // The patch may uncover operations, or move them
+    mOccludedOps.clear();
+
+    addResources(recorder);
+    addAllocator(recorder.takeAllocator());
+    mIsRenderable = mIsRenderable || recorder.mHasDrawOps;
+
+    // Shift the ranges that follow the patch, grow the ranges that contain it
+    // and invalidate the ranges it replaced
+    const int32_t delta = int32_t(newSize) - int32_t(oldSize);
+    for (size_t i = 0; i < mRanges.size(); i++) {
+        DisplayListRange& r = mRanges.editItemAt(i);
+        if (int32_t(i) == range) {
+            r.size = newSize;
+        } else if (r.offset > offset && r.offset >= offset + oldSize) {
+            r.offset += delta;
+        } else if (r.offset <= offset && r.offset + r.size >= offset + oldSize) {
+            r.size += delta;
+        } else {
+            r.valid = false;
+        }
+    }
+
+    return true;
 }
 
 size_t DisplayList::getSize() {
@@ -863,8 +950,36 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
     }
 
     DisplayListLogBuffer& logBuffer = DisplayListLogBuffer::getInstance();
+    FrameStats& frameStats = Caches::getInstance().frameStats;
+    const bool deferred = Caches::getInstance().isDeferredReplayEnabled();
     int saveCount = renderer.getSaveCount() - 1;
+
+    // Occlusion was computed for opaque paints, cached display lists apply
+    // their alpha to the paints of bitmaps and layers. The occluding bounds
+    // are clipped to the view as recorded, which replay only enforces when
+    // clipping children: otherwise a skipped operation could lose the part
+    // that overhangs the view
+    const size_t occludedCount = mOccludedOps.size();
+    const bool skipOccluded = occludedCount > 0 && (flags & kReplayFlag_ClipChildren) &&
+            (!mCaching || mAlpha >= 1.0f) && renderer.preservesOpacity();
+    size_t occludedIndex = 0;
+
     while (!mReader.eof()) {
+        if (CC_UNLIKELY(skipOccluded)) {
+            const uint32_t offset = mReader.offset();
+            while (occludedIndex < occludedCount &&
+                    mOccludedOps.itemAt(occludedIndex).offset < offset) {
+                occludedIndex++;
+            }
+            if (occludedIndex < occludedCount &&
+                    mOccludedOps.itemAt(occludedIndex).offset == offset) {
+                const uint32_t size = mOccludedOps.itemAt(occludedIndex++).size;
+                mReader.skip(size);
+                DISPLAY_LIST_LOGD("%sskipping %d occluded bytes", (char*) indent, size);
+                continue;
+            }
+        }
+
         int op = mReader.readInt();
         if (op & OP_MAY_BE_SKIPPED_MASK) {
             int32_t skip = mReader.readInt();
@@ -878,6 +993,11 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
             }
         }
         logBuffer.writeCommand(level, op);
+        frameStats.countOp(op);
+
+        if (deferred && !canDeferOp(op)) {
+            drawGlStatus |= renderer.flushDeferredBitmaps();
+        }
 
         switch (op) {
             case DrawGLFunction: {
@@ -1015,7 +1135,10 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
                 }
                 DISPLAY_LIST_LOGD("%s%s %p, %.2f, %.2f, %p", (char*) indent, OP_NAMES[op],
                         bitmap, x, y, paint);
-                drawGlStatus |= renderer.drawBitmap(bitmap, x, y, paint);
+                if (!deferred || !renderer.deferBitmap(bitmap, x, y, paint)) {
+                    drawGlStatus |= renderer.flushDeferredBitmaps();
+                    drawGlStatus |= renderer.drawBitmap(bitmap, x, y, paint);
+                }
             }
             break;
             case DrawBitmapMatrix: {
@@ -1280,6 +1403,10 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
         }
     }
 
+    if (deferred) {
+        drawGlStatus |= renderer.flushDeferredBitmaps();
+    }
+
     DISPLAY_LIST_LOGD("%s%s %d", (char*) indent, "RestoreToCount", restoreTo);
     renderer.restoreToCount(restoreTo);
     renderer.endMark();
@@ -1293,7 +1420,9 @@ status_t DisplayList::replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flag
 // Base structure
 ///////////////////////////////////////////////////////////////////////////////
 
-DisplayListRenderer::DisplayListRenderer() : mWriter(MIN_WRITER_SIZE),
+DisplayListRenderer::DisplayListRenderer() : mAllocator(NULL), mTrackOcclusion(false),
+        mLastOpOffset(0), mHasShader(false), mHasColorFilter(false), mHasPaintFilter(false),
+        mHasComplexClip(false), mWriter(MIN_WRITER_SIZE),
         mTranslateX(0.0f), mTranslateY(0.0f), mHasTranslate(false), mHasDrawOps(false) {
 }
 
@@ -1332,27 +1461,244 @@ void DisplayListRenderer::reset() {
     }
     mSourcePaths.clear();
 
+    // The copies belong to the display list once it took the allocator
+    if (mAllocator) {
+        for (size_t i = 0; i < mPaints.size(); i++) {
+            mPaints.itemAt(i)->~SkPaint();
+        }
+        for (size_t i = 0; i < mPaths.size(); i++) {
+            mPaths.itemAt(i)->~SkPath();
+        }
+        delete mAllocator;
+        mAllocator = NULL;
+    }
+
     mPaints.clear();
     mPaintMap.clear();
+    mPaintHashMap.clear();
 
     mPaths.clear();
     mPathMap.clear();
 
     mMatrices.clear();
 
+    mRanges.clear();
+
+    mOcclusionCandidates.clear();
+    mOccludedOps.clear();
+    mLayerSaveCounts.clear();
+
     mHasDrawOps = false;
 }
 
+static inline uint32_t hashPaint(const SkPaint* paint) {
+    uint32_t hash = paint->getColor();
+    hash = hash * 31 + paint->getFlags();
+    hash = hash * 31 + ((paint->getStyle() << 16) | (paint->getStrokeCap() << 8) |
+            paint->getStrokeJoin());
+    hash = hash * 31 + uint32_t(paint->getStrokeWidth() * 64.0f);
+    hash = hash * 31 + uint32_t(paint->getTextSize() * 64.0f);
+    hash = hash * 31 + uintptr_t(paint->getTypeface());
+    hash = hash * 31 + uintptr_t(paint->getShader());
+    hash = hash * 31 + uintptr_t(paint->getXfermode());
+    return hash;
+}
+
+SkPaint* DisplayListRenderer::copyPaint(SkPaint* paint) {
+    // Views often draw with distinct but identical paints, let them share a
+    // copy. SkPaint's equality operator ignores the generation ID
+    const uint32_t hash = hashPaint(paint);
+    SkPaint* paintCopy = mPaintHashMap.valueFor(hash);
+    if (paintCopy && *paintCopy == *paint) {
+        return paintCopy;
+    }
+
+    paintCopy = allocate(*paint);
+    // replaceValueFor() performs an add if the entry doesn't exist
+    mPaintHashMap.replaceValueFor(hash, paintCopy);
+    mPaints.add(paintCopy);
+    return paintCopy;
+}
+
+SkChunkAlloc* DisplayListRenderer::takeAllocator() {
+    SkChunkAlloc* allocator = mAllocator;
+    mAllocator = NULL;
+    return allocator;
+}
+
+int32_t DisplayListRenderer::beginRange() {
+    // Pending operations belong to what precedes the range
+    insertRestoreToCount();
+    insertTranlate();
+
+    DisplayListRange range;
+    range.offset = mWriter.size();
+    range.saveCount = getSaveCount();
+    range.transform.load(*mSnapshot->transform);
+    range.clipRect.set(*mSnapshot->clipRect);
+
+    return mRanges.add(range);
+}
+
+void DisplayListRenderer::endRange(int32_t range) {
+    if (range < 0 || range >= (int32_t) mRanges.size()) return;
+
+    insertRestoreToCount();
+    insertTranlate();
+
+    DisplayListRange& r = mRanges.editItemAt(range);
+    r.size = mWriter.size() - r.offset;
+    r.valid = true;
+}
+
+bool DisplayListRenderer::beginPatch(const DisplayList* displayList, int32_t range) {
+    const DisplayListRange* r = displayList->getRange(range);
+    if (!r) return false;
+
+    // Recorded restore operations use absolute save counts
+    while (getSaveCount() < r->saveCount) {
+        OpenGLRenderer::save(SkCanvas::kMatrix_SaveFlag | SkCanvas::kClip_SaveFlag);
+    }
+
+    // Operations rejected at record time are skipped at replay time
+    mSnapshot->editTransform()->load(r->transform);
+    mSnapshot->setClip(r->clipRect.left, r->clipRect.top,
+            r->clipRect.right, r->clipRect.bottom);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Occlusion
+///////////////////////////////////////////////////////////////////////////////
+
+bool DisplayListRenderer::isOpaquePaint(SkPaint* paint) const {
+    // Shaders and color filters are not part of the paint when recorded
+    if (mHasShader || mHasColorFilter || mHasPaintFilter) return false;
+    if (!paint) return true;
+
+    SkXfermode::Mode mode;
+    if (!SkXfermode::AsMode(paint->getXfermode(), &mode)) return false;
+
+    return paint->getAlpha() == 255 && !paint->isAntiAlias() &&
+            (mode == SkXfermode::kSrcOver_Mode || mode == SkXfermode::kSrc_Mode) &&
+            paint->getStyle() == SkPaint::kFill_Style && !paint->getShader() &&
+            !paint->getColorFilter() && !paint->getMaskFilter() && !paint->getPathEffect() &&
+            !paint->getLooper() && !paint->getRasterizer();
+}
+
+void DisplayListRenderer::addOcclusion(float left, float top, float right, float bottom,
+        SkPaint* paint, bool opaque) {
+    if (!mTrackOcclusion) return;
+
+    Rect bounds(left, top, right, bottom);
+    if (paint && paint->getStyle() != SkPaint::kFill_Style) {
+        const float outset = fmaxf(paint->getStrokeWidth() * 0.5f, 1.0f);
+        bounds.left -= outset;
+        bounds.top -= outset;
+        bounds.right += outset;
+        bounds.bottom += outset;
+    }
+
+    // Rotated rectangles do not cover their bounds
+    mat4& transform = *mSnapshot->transform;
+    transform.mapRect(bounds);
+    addOcclusionBounds(bounds, opaque && transform.isSimple());
+}
+
+void DisplayListRenderer::addOcclusionBounds(Rect& bounds, bool opaque) {
+    // Operations drawn in layers are composited later, with an alpha
+    if (!mLayerSaveCounts.isEmpty()) return;
+
+    const Rect& clip = *mSnapshot->clipRect;
+
+    OcclusionCandidate candidate;
+    candidate.offset = mLastOpOffset;
+    candidate.size = mWriter.size() - mLastOpOffset;
+
+    // Keep only the pixels fully covered by opaque operations, the renderer
+    // may snap them to the pixel grid
+    if (opaque) {
+        candidate.opaqueBounds.set(ceilf(bounds.left), ceilf(bounds.top),
+                floorf(bounds.right), floorf(bounds.bottom));
+        if (!candidate.opaqueBounds.intersect(ceilf(clip.left), ceilf(clip.top),
+                floorf(clip.right), floorf(clip.bottom))) {
+            candidate.opaqueBounds.setEmpty();
+        }
+    }
+
+    // Antialiasing and bitmap filtering touch the neighbouring pixels
+    candidate.bounds.set(floorf(bounds.left) - 1.0f, floorf(bounds.top) - 1.0f,
+            ceilf(bounds.right) + 1.0f, ceilf(bounds.bottom) + 1.0f);
+    if (!candidate.bounds.intersect(floorf(clip.left), floorf(clip.top),
+            ceilf(clip.right), ceilf(clip.bottom))) {
+        candidate.bounds.setEmpty();
+    }
+
+    mOcclusionCandidates.add(candidate);
+}
+
+void DisplayListRenderer::popLayers() {
+    while (!mLayerSaveCounts.isEmpty() && mLayerSaveCounts.top() >= getSaveCount()) {
+        mLayerSaveCounts.pop();
+    }
+}
+
+void DisplayListRenderer::computeOcclusion() {
+    mOccludedOps.clear();
+
+    // Difference and union clips are tracked with their bounds only
+    if (mTrackOcclusion && !mHasComplexClip) {
+        Vector<Rect> occluders;
+        Vector<OccludedOp> occluded;
+
+        // Walk the operations from the top, an operation is hidden if one of
+        // the opaque operations drawn after it covers it entirely
+        for (ssize_t i = mOcclusionCandidates.size() - 1; i >= 0; i--) {
+            const OcclusionCandidate& candidate = mOcclusionCandidates.itemAt(i);
+            if (candidate.bounds.isEmpty()) continue;
+
+            bool hidden = false;
+            for (size_t j = 0; j < occluders.size(); j++) {
+                Rect occluder(occluders.itemAt(j));
+                if (occluder.contains(candidate.bounds)) {
+                    hidden = true;
+                    break;
+                }
+            }
+
+            if (hidden) {
+                occluded.add(OccludedOp(candidate.offset, candidate.size));
+            } else if (!candidate.opaqueBounds.isEmpty() &&
+                    occluders.size() < OCCLUSION_MAX_OCCLUDERS) {
+                occluders.add(candidate.opaqueBounds);
+            }
+        }
+
+        for (ssize_t i = occluded.size() - 1; i >= 0; i--) {
+            mOccludedOps.add(occluded.itemAt(i));
+        }
+
+        DISPLAY_LIST_LOGD("%d operations out of %d are occluded", mOccludedOps.size(),
+                mOcclusionCandidates.size());
+    }
+
+    mOcclusionCandidates.clear();
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Operations
 ///////////////////////////////////////////////////////////////////////////////
 
 DisplayList* DisplayListRenderer::getDisplayList(DisplayList* displayList) {
+    computeOcclusion();
+
     if (!displayList) {
         displayList = new DisplayList(*this);
     } else {
         displayList->initFromDisplayListRenderer(*this, true);
     }
+    displayList->addAllocator(takeAllocator());
     displayList->setRenderable(mHasDrawOps);
     return displayList;
 }
@@ -1375,12 +1721,20 @@ int DisplayListRenderer::prepareDirty(float left, float top,
     mSaveCount = 1;
     mSnapshot->setClip(0.0f, 0.0f, mWidth, mHeight);
     mRestoreSaveCount = -1;
+
+    Caches& caches = Caches::getInstance();
+    mTrackOcclusion = caches.isOcclusionEnabled();
+    mLayerSaveCounts.clear();
+    mHasShader = mHasColorFilter = mHasPaintFilter = mHasComplexClip = false;
+
+    caches.frameStats.beginRecording();
     return DrawGlInfo::kStatusDone; // No invalidate needed at record-time
 }
 
 void DisplayListRenderer::finish() {
     insertRestoreToCount();
     insertTranlate();
+    Caches::getInstance().frameStats.endRecording();
 }
 
 void DisplayListRenderer::interrupt() {
@@ -1411,12 +1765,14 @@ void DisplayListRenderer::restore() {
     mRestoreSaveCount--;
     insertTranlate();
     OpenGLRenderer::restore();
+    popLayers();
 }
 
 void DisplayListRenderer::restoreToCount(int saveCount) {
     mRestoreSaveCount = saveCount;
     insertTranlate();
     OpenGLRenderer::restoreToCount(saveCount);
+    popLayers();
 }
 
 int DisplayListRenderer::saveLayer(float left, float top, float right, float bottom,
@@ -1425,7 +1781,9 @@ int DisplayListRenderer::saveLayer(float left, float top, float right, float bot
     addBounds(left, top, right, bottom);
     addPaint(p);
     addInt(flags);
-    return OpenGLRenderer::save(flags);
+    const int saveCount = OpenGLRenderer::save(flags);
+    mLayerSaveCounts.push(saveCount);
+    return saveCount;
 }
 
 int DisplayListRenderer::saveLayerAlpha(float left, float top, float right, float bottom,
@@ -1434,7 +1792,9 @@ int DisplayListRenderer::saveLayerAlpha(float left, float top, float right, floa
     addBounds(left, top, right, bottom);
     addInt(alpha);
     addInt(flags);
-    return OpenGLRenderer::save(flags);
+    const int saveCount = OpenGLRenderer::save(flags);
+    mLayerSaveCounts.push(saveCount);
+    return saveCount;
 }
 
 void DisplayListRenderer::translate(float dx, float dy) {
@@ -1480,6 +1840,8 @@ bool DisplayListRenderer::clipRect(float left, float top, float right, float bot
     addOp(DisplayList::ClipRect);
     addBounds(left, top, right, bottom);
     addInt(op);
+    mHasComplexClip = mHasComplexClip ||
+            (op != SkRegion::kIntersect_Op && op != SkRegion::kReplace_Op);
     return OpenGLRenderer::clipRect(left, top, right, bottom, op);
 }
 
@@ -1494,6 +1856,13 @@ status_t DisplayListRenderer::drawDisplayList(DisplayList* displayList,
     return DrawGlInfo::kStatusDone;
 }
 
+status_t DisplayListRenderer::drawPicture(SkPicture* picture, Rect& dirty) {
+    // The operations of the picture are recorded in place, a picture that
+    // is recorded again requires the display list to be recorded again
+    PictureCache::translate(picture, *this);
+    return DrawGlInfo::kStatusDone;
+}
+
 status_t DisplayListRenderer::drawLayer(Layer* layer, float x, float y, SkPaint* paint) {
     addOp(DisplayList::DrawLayer);
     addInt((int) layer);
@@ -1509,6 +1878,8 @@ status_t DisplayListRenderer::drawBitmap(SkBitmap* bitmap, float left, float top
     addPoint(left, top);
     addPaint(paint);
     addSkip(location);
+    addOcclusion(left, top, left + bitmap->width(), top + bitmap->height(), paint,
+            bitmap->isOpaque() && isOpaquePaint(paint));
     return DrawGlInfo::kStatusDone;
 }
 
@@ -1523,6 +1894,7 @@ status_t DisplayListRenderer::drawBitmap(SkBitmap* bitmap, SkMatrix* matrix, SkP
     addMatrix(matrix);
     addPaint(paint);
     addSkip(location);
+    addOcclusion(r.left, r.top, r.right, r.bottom, paint, false);
     return DrawGlInfo::kStatusDone;
 }
 
@@ -1536,6 +1908,8 @@ status_t DisplayListRenderer::drawBitmap(SkBitmap* bitmap, float srcLeft, float
     addBounds(dstLeft, dstTop, dstRight, dstBottom);
     addPaint(paint);
     addSkip(location);
+    addOcclusion(dstLeft, dstTop, dstRight, dstBottom, paint,
+            bitmap->isOpaque() && isOpaquePaint(paint));
     return DrawGlInfo::kStatusDone;
 }
 
@@ -1547,6 +1921,8 @@ status_t DisplayListRenderer::drawBitmapData(SkBitmap* bitmap, float left, float
     addPoint(left, top);
     addPaint(paint);
     addSkip(location);
+    addOcclusion(left, top, left + bitmap->width(), top + bitmap->height(), paint,
+            bitmap->isOpaque() && isOpaquePaint(paint));
     return DrawGlInfo::kStatusDone;
 }
 
@@ -1579,6 +1955,8 @@ status_t DisplayListRenderer::drawPatch(SkBitmap* bitmap, const int32_t* xDivs,
     addBounds(left, top, right, bottom);
     addPaint(paint);
     addSkip(location);
+    // Patches can have transparent areas
+    addOcclusion(left, top, right, bottom, paint, false);
     return DrawGlInfo::kStatusDone;
 }
 
@@ -1586,6 +1964,14 @@ status_t DisplayListRenderer::drawColor(int color, SkXfermode::Mode mode) {
     addOp(DisplayList::DrawColor);
     addInt(color);
     addInt(mode);
+    if (mTrackOcclusion) {
+        // The color fills the clip
+        Rect bounds(*mSnapshot->clipRect);
+        const bool opaque = !mHasShader && !mHasColorFilter && !mHasPaintFilter &&
+                (mode == SkXfermode::kSrc_Mode || mode == SkXfermode::kClear_Mode ||
+                (mode == SkXfermode::kSrcOver_Mode && ((color >> 24) & 0xff) == 0xff));
+        addOcclusionBounds(bounds, opaque);
+    }
     return DrawGlInfo::kStatusDone;
 }
 
@@ -1597,6 +1983,7 @@ status_t DisplayListRenderer::drawRect(float left, float top, float right, float
     addBounds(left, top, right, bottom);
     addPaint(paint);
     addSkip(location);
+    addOcclusion(left, top, right, bottom, paint, isOpaquePaint(paint));
     return DrawGlInfo::kStatusDone;
 }
 
@@ -1609,6 +1996,7 @@ status_t DisplayListRenderer::drawRoundRect(float left, float top, float right,
     addPoint(rx, ry);
     addPaint(paint);
     addSkip(location);
+    addOcclusion(left, top, right, bottom, paint, false);
     return DrawGlInfo::kStatusDone;
 }
 
@@ -1617,6 +2005,7 @@ status_t DisplayListRenderer::drawCircle(float x, float y, float radius, SkPaint
     addPoint(x, y);
     addFloat(radius);
     addPaint(paint);
+    addOcclusion(x - radius, y - radius, x + radius, y + radius, paint, false);
     return DrawGlInfo::kStatusDone;
 }
 
@@ -1625,6 +2014,7 @@ status_t DisplayListRenderer::drawOval(float left, float top, float right, float
     addOp(DisplayList::DrawOval);
     addBounds(left, top, right, bottom);
     addPaint(paint);
+    addOcclusion(left, top, right, bottom, paint, false);
     return DrawGlInfo::kStatusDone;
 }
 
@@ -1635,6 +2025,7 @@ status_t DisplayListRenderer::drawArc(float left, float top, float right, float
     addPoint(startAngle, sweepAngle);
     addInt(useCenter ? 1 : 0);
     addPaint(paint);
+    addOcclusion(left, top, right, bottom, paint, false);
     return DrawGlInfo::kStatusDone;
 }
 
@@ -1651,6 +2042,7 @@ status_t DisplayListRenderer::drawPath(SkPath* path, SkPaint* paint) {
     addPath(path);
     addPaint(paint);
     addSkip(location);
+    addOcclusion(left, top, left + width, top + height, paint, false);
     return DrawGlInfo::kStatusDone;
 }
 
@@ -1691,6 +2083,7 @@ status_t DisplayListRenderer::drawText(const char* text, int bytesCount, int cou
 
     uint32_t* location = addOp(DisplayList::DrawText, reject);
     addText(text, bytesCount);
+    if (!reject) precacheText(text, bytesCount, paint);
     addInt(count);
     addPoint(x, y);
     addPaint(paint);
@@ -1710,6 +2103,7 @@ status_t DisplayListRenderer::drawTextOnPath(const char* text, int bytesCount, i
     addFloat(vOffset);
     paint->setAntiAlias(true);
     addPaint(paint);
+    precacheText(text, bytesCount, paint);
     return DrawGlInfo::kStatusDone;
 }
 
@@ -1722,25 +2116,30 @@ status_t DisplayListRenderer::drawPosText(const char* text, int bytesCount, int
     addFloats(positions, count * 2);
     paint->setAntiAlias(true);
     addPaint(paint);
+    precacheText(text, bytesCount, paint);
     return DrawGlInfo::kStatusDone;
 }
 
 void DisplayListRenderer::resetShader() {
     addOp(DisplayList::ResetShader);
+    mHasShader = false;
 }
 
 void DisplayListRenderer::setupShader(SkiaShader* shader) {
     addOp(DisplayList::SetupShader);
     addShader(shader);
+    mHasShader = shader != NULL;
 }
 
 void DisplayListRenderer::resetColorFilter() {
     addOp(DisplayList::ResetColorFilter);
+    mHasColorFilter = false;
 }
 
 void DisplayListRenderer::setupColorFilter(SkiaColorFilter* filter) {
     addOp(DisplayList::SetupColorFilter);
     addColorFilter(filter);
+    mHasColorFilter = filter != NULL;
 }
 
 void DisplayListRenderer::resetShadow() {
@@ -1756,12 +2155,14 @@ void DisplayListRenderer::setupShadow(float radius, float dx, float dy, int colo
 
 void DisplayListRenderer::resetPaintFilter() {
     addOp(DisplayList::ResetPaintFilter);
+    mHasPaintFilter = false;
 }
 
 void DisplayListRenderer::setupPaintFilter(int clearBits, int setBits) {
     addOp(DisplayList::SetupPaintFilter);
     addInt(clearBits);
     addInt(setBits);
+    mHasPaintFilter = true;
 }
 
 }; // namespace uirenderer
@@ -17,6 +17,8 @@
 #ifndef ANDROID_HWUI_DISPLAY_LIST_RENDERER_H
 #define ANDROID_HWUI_DISPLAY_LIST_RENDERER_H
 
+#include <new>
+
 #include <SkChunkAlloc.h>
 #include <SkFlattenable.h>
 #include <SkMatrix.h>
@@ -40,7 +42,11 @@ namespace uirenderer {
 ///////////////////////////////////////////////////////////////////////////////
 
 #define MIN_WRITER_SIZE 4096
+// Size of the blocks holding the paints, paths and matrices copied by the recorder
+#define MIN_ALLOCATOR_CHUNK_SIZE 4096
 #define OP_MAY_BE_SKIPPED_MASK 0xff000000
+// Maximum number of opaque operations each recorded operation is tested against
+#define OCCLUSION_MAX_OCCLUDERS 32
 
 // Debug
 #if DEBUG_DISPLAY_LIST
@@ -61,6 +67,44 @@ namespace uirenderer {
 
 class DisplayListRenderer;
 
+/**
+ * Location of a sequence of operations in the stream of a display list,
+ * delimited with DisplayListRenderer::beginRange() and endRange(). The
+ * state of the renderer at the beginning of the range is kept so the
+ * operations can be recorded again on their own.
+ */
+struct DisplayListRange {
+    DisplayListRange(): offset(0), size(0), saveCount(0), valid(false) {
+    }
+
+    // Offset and size of the operations, in bytes
+    uint32_t offset;
+    uint32_t size;
+
+    int saveCount;
+    mat4 transform;
+    Rect clipRect;
+
+    // False while the range is open or once its content was replaced
+    bool valid;
+}; // struct DisplayListRange
+
+/**
+ * Drawing operation hidden by the opaque operations recorded after it in
+ * the same display list, skipped at replay time.
+ */
+struct OccludedOp {
+    OccludedOp(): offset(0), size(0) {
+    }
+
+    OccludedOp(uint32_t offset, uint32_t size): offset(offset), size(size) {
+    }
+
+    // Offset and size of the operation, in bytes
+    uint32_t offset;
+    uint32_t size;
+}; // struct OccludedOp
+
 /**
  * Replays recorded drawing commands.
  */
@@ -122,7 +166,7 @@ public:
         kReplayFlag_ClipChildren = 0x1
     };
 
-    static const char* OP_NAMES[];
+    ANDROID_API static const char* OP_NAMES[];
 
     void setViewProperties(OpenGLRenderer& renderer, uint32_t level);
     void outputViewProperties(OpenGLRenderer& renderer, char* indent);
@@ -133,6 +177,24 @@ public:
 
     void initFromDisplayListRenderer(const DisplayListRenderer& recorder, bool reusing = false);
 
+    /**
+     * Replaces the operations of the specified range with the operations
+     * recorded by the specified renderer, which must have been set up with
+     * DisplayListRenderer::beginPatch(). The ranges nested in the replaced
+     * range become invalid and the ranges recorded by the patch are ignored.
+     *
+     * Returns false if the range is invalid or if too many operations were
+     * replaced since the display list was recorded, in which case the whole
+     * display list must be recorded again.
+     */
+    ANDROID_API bool patchRange(int32_t range, DisplayListRenderer& recorder);
+
+    const DisplayListRange* getRange(int32_t range) const {
+        if (range < 0 || range >= (int32_t) mRanges.size()) return NULL;
+        const DisplayListRange& r = mRanges.itemAt(range);
+        return r.valid ? &r : NULL;
+    }
+
     status_t replay(OpenGLRenderer& renderer, Rect& dirty, int32_t flags, uint32_t level = 0);
 
     void output(OpenGLRenderer& renderer, uint32_t level = 0);
@@ -398,13 +460,37 @@ public:
     }
 
 private:
+    friend class DisplayListSerializer;
+
     void init();
     void initProperties();
 
     void clearResources();
+    void addResources(const DisplayListRenderer& recorder);
+    void addAllocator(SkChunkAlloc* allocator);
 
     void updateMatrix();
 
+    /**
+     * Indicates whether the specified operation can be executed while bitmaps
+     * are deferred by the renderer. Operations that modify the clip or the
+     * current layer, or that draw, require deferred bitmaps to be flushed first.
+     */
+    static inline bool canDeferOp(int op) {
+        switch (op) {
+            case Save:
+            case Translate:
+            case Rotate:
+            case Scale:
+            case Skew:
+            case SetMatrix:
+            case ConcatMatrix:
+            case DrawBitmap:
+                return true;
+        }
+        return false;
+    }
+
     class TextContainer {
     public:
         size_t length() const {
@@ -497,10 +583,20 @@ private:
     Vector<SkMatrix*> mMatrices;
     Vector<SkiaShader*> mShaders;
 
+    // Hold the copies of the paints, paths and matrices
+    Vector<SkChunkAlloc*> mAllocators;
+
     mutable SkFlattenableReadBuffer mReader;
 
     size_t mSize;
 
+    Vector<DisplayListRange> mRanges;
+    // Sorted by offset, see DisplayListRenderer::computeOcclusion()
+    Vector<OccludedOp> mOccludedOps;
+    // Size of the operations replaced by patchRange() since the last recording,
+    // their resources are only released when the display list is recorded again
+    size_t mPatchedSize;
+
     bool mIsRenderable;
 
     String8 mName;
@@ -576,6 +672,7 @@ public:
 
     virtual status_t drawDisplayList(DisplayList* displayList, Rect& dirty, int32_t flags,
             uint32_t level = 0);
+    virtual status_t drawPicture(SkPicture* picture, Rect& dirty);
     virtual status_t drawLayer(Layer* layer, float x, float y, SkPaint* paint);
     virtual status_t drawBitmap(SkBitmap* bitmap, float left, float top, SkPaint* paint);
     virtual status_t drawBitmap(SkBitmap* bitmap, SkMatrix* matrix, SkPaint* paint);
@@ -620,6 +717,36 @@ public:
 
     ANDROID_API void reset();
 
+    /**
+     * Returns a copy of the specified paint that lives as long as the
+     * display list being recorded, for callers whose paints do not.
+     */
+    SkPaint* allocatePaint(const SkPaint& paint) {
+        SkPaint* copy = allocate(paint);
+        mPaints.add(copy);
+        return copy;
+    }
+
+    /**
+     * Starts a range of operations that can later be replaced without
+     * recording the whole display list again, see DisplayList::patchRange().
+     * Ranges can be nested but must be balanced with the save/restore
+     * operations they contain. Returns the index of the range.
+     */
+    ANDROID_API int32_t beginRange();
+    /**
+     * Ends the specified range, which must be the last one started.
+     */
+    ANDROID_API void endRange(int32_t range);
+
+    /**
+     * Restores the save count, transform and clip the renderer had when
+     * the specified range of the display list was started. Must be called
+     * after prepare() to record the replacement of the range. Returns false
+     * if the range is invalid.
+     */
+    ANDROID_API bool beginPatch(const DisplayList* displayList, int32_t range);
+
     const SkWriter32& writeStream() const {
         return mWriter;
     }
@@ -656,7 +783,43 @@ public:
         return mMatrices;
     }
 
+    const Vector<DisplayListRange>& getRanges() const {
+        return mRanges;
+    }
+
+    const Vector<OccludedOp>& getOccludedOps() const {
+        return mOccludedOps;
+    }
+
 private:
+    /**
+     * Screen bounds of a recorded drawing operation. The opaque bounds are
+     * the pixels the operation is guaranteed to cover with opaque colors,
+     * they are empty if the operation may be translucent.
+     */
+    struct OcclusionCandidate {
+        uint32_t offset;
+        uint32_t size;
+        Rect bounds;
+        Rect opaqueBounds;
+    };
+
+    /**
+     * Remembers the operation that was just recorded so it can be skipped if
+     * it is later covered by opaque operations. The bounds are in the local
+     * coordinates of the operation.
+     */
+    void addOcclusion(float left, float top, float right, float bottom,
+            SkPaint* paint, bool opaque);
+    void addOcclusionBounds(Rect& bounds, bool opaque);
+    /**
+     * Indicates whether operations drawn with the specified paint, which
+     * can be null, are opaque.
+     */
+    bool isOpaquePaint(SkPaint* paint) const;
+    void popLayers();
+    void computeOcclusion();
+
     void insertRestoreToCount() {
         if (mRestoreSaveCount >= 0) {
             mWriter.writeInt(DisplayList::RestoreToCount);
@@ -679,6 +842,7 @@ private:
     inline void addOp(const DisplayList::Op drawOp) {
         insertRestoreToCount();
         insertTranlate();
+        mLastOpOffset = mWriter.size();
         mWriter.writeInt(drawOp);
         mHasDrawOps = mHasDrawOps || drawOp >= DisplayList::DrawDisplayList;
     }
@@ -686,6 +850,7 @@ private:
     uint32_t* addOp(const DisplayList::Op drawOp, const bool reject) {
         insertRestoreToCount();
         insertTranlate();
+        mLastOpOffset = mWriter.size();
         mHasDrawOps = mHasDrawOps || drawOp >= DisplayList::DrawDisplayList;
         if (reject) {
             mWriter.writeInt(OP_MAY_BE_SKIPPED_MASK | drawOp);
@@ -748,6 +913,31 @@ private:
         mWriter.writePad(text, byteLength);
     }
 
+    /**
+     * Hands recorded text to the background glyph precacher so the glyphs
+     * are rasterized by the time the display list is replayed.
+     */
+    inline void precacheText(const char* text, size_t byteLength, SkPaint* paint) {
+        GlyphPrecacher& precacher = Caches::getInstance().glyphPrecacher;
+        if (CC_UNLIKELY(precacher.isEnabled())) {
+            precacher.precache(paint, text, byteLength);
+        }
+    }
+
+    /**
+     * Copies the specified object in the allocator handed to the display list.
+     */
+    template<typename T>
+    inline T* allocate(const T& source) {
+        if (!mAllocator) {
+            mAllocator = new SkChunkAlloc(MIN_ALLOCATOR_CHUNK_SIZE);
+        }
+        return new (mAllocator->allocThrow(sizeof(T))) T(source);
+    }
+
+    SkPaint* copyPaint(SkPaint* paint);
+    SkChunkAlloc* takeAllocator();
+
     inline void addPath(SkPath* path) {
         if (!path) {
             addInt((int) NULL);
@@ -756,7 +946,7 @@ private:
 
         SkPath* pathCopy = mPathMap.valueFor(path);
         if (pathCopy == NULL || pathCopy->getGenerationID() != path->getGenerationID()) {
-            pathCopy = new SkPath(*path);
+            pathCopy = allocate(*path);
             pathCopy->setSourcePath(path);
             // replaceValueFor() performs an add if the entry doesn't exist
             mPathMap.replaceValueFor(path, pathCopy);
@@ -778,10 +968,9 @@ private:
 
         SkPaint* paintCopy = mPaintMap.valueFor(paint);
         if (paintCopy == NULL || paintCopy->getGenerationID() != paint->getGenerationID()) {
-            paintCopy = new SkPaint(*paint);
+            paintCopy = copyPaint(paint);
             // replaceValueFor() performs an add if the entry doesn't exist
             mPaintMap.replaceValueFor(paint, paintCopy);
-            mPaints.add(paintCopy);
         }
 
         addInt((int) paintCopy);
@@ -797,7 +986,7 @@ private:
     inline void addMatrix(SkMatrix* matrix) {
         // Copying the matrix is cheap and prevents against the user changing the original
         // matrix before the operation that uses it
-        SkMatrix* copy = new SkMatrix(*matrix);
+        SkMatrix* copy = allocate(*matrix);
         addInt((int) copy);
         mMatrices.add(copy);
     }
@@ -847,8 +1036,11 @@ private:
     Vector<SkBitmap*> mOwnedBitmapResources;
     Vector<SkiaColorFilter*> mFilterResources;
 
+    SkChunkAlloc* mAllocator;
+
     Vector<SkPaint*> mPaints;
     DefaultKeyedVector<SkPaint*, SkPaint*> mPaintMap;
+    DefaultKeyedVector<uint32_t, SkPaint*> mPaintHashMap;
 
     Vector<SkPath*> mPaths;
     DefaultKeyedVector<SkPath*, SkPath*> mPathMap;
@@ -860,6 +1052,20 @@ private:
 
     Vector<SkMatrix*> mMatrices;
 
+    Vector<DisplayListRange> mRanges;
+
+    // Occlusion tracking, see computeOcclusion()
+    bool mTrackOcclusion;
+    Vector<OcclusionCandidate> mOcclusionCandidates;
+    Vector<OccludedOp> mOccludedOps;
+    // Save counts of the active layers
+    Vector<int> mLayerSaveCounts;
+    uint32_t mLastOpOffset;
+    bool mHasShader;
+    bool mHasColorFilter;
+    bool mHasPaintFilter;
+    bool mHasComplexClip;
+
     SkWriter32 mWriter;
     uint32_t mBufferSize;
 
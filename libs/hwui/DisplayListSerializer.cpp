@@ -0,0 +1,1232 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <SkTypeface.h>
+
+#include <cutils/ashmem.h>
+#include <utils/Log.h>
+
+#include "Caches.h"
+#include "DisplayListRenderer.h"
+#include "DisplayListSerializer.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define MIN_SERIALIZER_WRITER_SIZE 4096
+
+enum BitmapStorage {
+    kBitmapStorage_Inline = 0,
+    kBitmapStorage_Ashmem = 1
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Utils
+///////////////////////////////////////////////////////////////////////////////
+
+static void writeText(SkWriter32& writer, const void* text, size_t byteLength) {
+    writer.writeInt(byteLength);
+    writer.writePad(text, byteLength);
+}
+
+static void writeMatrix(SkWriter32& writer, const SkMatrix& matrix) {
+    for (int i = 0; i < 9; i++) {
+        writer.writeScalar(matrix.get(i));
+    }
+}
+
+static void writeBounds(SkWriter32& writer, float left, float top, float right, float bottom) {
+    writer.writeScalar(left);
+    writer.writeScalar(top);
+    writer.writeScalar(right);
+    writer.writeScalar(bottom);
+}
+
+static void appendWriter(SkWriter32& writer, const SkWriter32& source) {
+    source.flatten(writer.reserve(source.size()));
+}
+
+static void appendWriter(Vector<uint8_t>& data, const SkWriter32& writer) {
+    const size_t offset = data.size();
+    data.insertAt((uint8_t) 0, offset, writer.size());
+    writer.flatten(data.editArray() + offset);
+}
+
+/**
+ * Returns true if size bytes can be read before the specified end offset.
+ */
+static inline bool canRead(SkReader32& reader, size_t end, size_t size) {
+    return reader.offset() <= end && size <= end - reader.offset();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Serializer
+///////////////////////////////////////////////////////////////////////////////
+
+DisplayListSerializer::DisplayListSerializer(bool shareBitmaps): mShareBitmaps(shareBitmaps),
+        mDisplayLists(MIN_SERIALIZER_WRITER_SIZE), mBitmaps(MIN_SERIALIZER_WRITER_SIZE),
+        mPaints(MIN_SERIALIZER_WRITER_SIZE), mPaths(MIN_SERIALIZER_WRITER_SIZE),
+        mMatrices(MIN_SERIALIZER_WRITER_SIZE), mDroppedOps(0), mFailed(false) {
+}
+
+DisplayListSerializer::~DisplayListSerializer() {
+    reset();
+}
+
+void DisplayListSerializer::reset() {
+    mDisplayListIndices.clear();
+    mBitmapIndices.clear();
+    mPaintIndices.clear();
+    mPathIndices.clear();
+    mMatrixIndices.clear();
+
+    mDisplayLists.reset();
+    mBitmaps.reset();
+    mPaints.reset();
+    mPaths.reset();
+    mMatrices.reset();
+
+    mData.clear();
+    for (size_t i = 0; i < mBitmapFds.size(); i++) {
+        close(mBitmapFds.itemAt(i));
+    }
+    mBitmapFds.clear();
+
+    mDroppedOps = 0;
+    mFailed = false;
+}
+
+bool DisplayListSerializer::serialize(DisplayList* displayList, int width, int height) {
+    reset();
+    if (!displayList) return false;
+
+    addDisplayList(displayList);
+    if (mFailed) {
+        reset();
+        return false;
+    }
+
+    SkWriter32 header(MIN_SERIALIZER_WRITER_SIZE);
+    header.writeInt(DISPLAY_LIST_SERIALIZATION_MAGIC);
+    header.writeInt(DISPLAY_LIST_SERIALIZATION_VERSION);
+    header.writeInt(width);
+    header.writeInt(height);
+    header.writeInt(mBitmapIndices.size());
+    header.writeInt(mPaintIndices.size());
+    header.writeInt(mPathIndices.size());
+    header.writeInt(mMatrixIndices.size());
+    header.writeInt(mDisplayListIndices.size());
+
+    appendWriter(mData, header);
+    appendWriter(mData, mBitmaps);
+    appendWriter(mData, mPaints);
+    appendWriter(mData, mPaths);
+    appendWriter(mData, mMatrices);
+    appendWriter(mData, mDisplayLists);
+
+    if (mDroppedOps > 0) {
+        ALOGD("Serialized display list %p, %d operations were dropped", displayList, mDroppedOps);
+    }
+
+    return true;
+}
+
+void DisplayListSerializer::copyTo(void* buffer) const {
+    memcpy(buffer, mData.array(), mData.size());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Resources
+///////////////////////////////////////////////////////////////////////////////
+
+int32_t DisplayListSerializer::addBitmap(SkBitmap* bitmap) {
+    if (!bitmap) return -1;
+
+    ssize_t index = mBitmapIndices.indexOfKey(bitmap);
+    if (index >= 0) return mBitmapIndices.valueAt(index);
+
+    SkAutoLockPixels alp(*bitmap);
+    switch (bitmap->getConfig()) {
+        case SkBitmap::kA8_Config:
+        case SkBitmap::kRGB_565_Config:
+        case SkBitmap::kARGB_8888_Config:
+            writeBitmap(*bitmap);
+            break;
+        default: {
+            // Color tables are not serialized
+            SkBitmap copy;
+            bitmap->copyTo(&copy, SkBitmap::kARGB_8888_Config);
+            SkAutoLockPixels alpCopy(copy);
+            writeBitmap(copy);
+        }
+        break;
+    }
+
+    const int32_t result = mBitmapIndices.size();
+    mBitmapIndices.add(bitmap, result);
+    return result;
+}
+
+void DisplayListSerializer::writeBitmap(const SkBitmap& bitmap) {
+    const bool ready = bitmap.readyToDraw();
+    const uint32_t size = ready ? bitmap.rowBytes() * bitmap.height() : 0;
+
+    mBitmaps.writeInt(ready ? bitmap.getConfig() : SkBitmap::kNo_Config);
+    mBitmaps.writeInt(ready ? bitmap.width() : 0);
+    mBitmaps.writeInt(ready ? bitmap.height() : 0);
+    mBitmaps.writeInt(ready ? bitmap.rowBytes() : 0);
+    mBitmaps.writeBool(bitmap.isOpaque());
+
+    if (mShareBitmaps && size > 0) {
+        int fd = ashmem_create_region("hwui-display-list-bitmap", size);
+        if (fd >= 0) {
+            void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (addr != MAP_FAILED) {
+                memcpy(addr, bitmap.getPixels(), size);
+                munmap(addr, size);
+                ashmem_set_prot_region(fd, PROT_READ);
+
+                mBitmaps.writeInt(kBitmapStorage_Ashmem);
+                mBitmaps.writeInt(mBitmapFds.size());
+                mBitmapFds.add(fd);
+                return;
+            }
+            close(fd);
+        }
+        ALOGW("Could not share a %dx%d bitmap, copying it", bitmap.width(), bitmap.height());
+    }
+
+    mBitmaps.writeInt(kBitmapStorage_Inline);
+    writeText(mBitmaps, bitmap.getPixels(), size);
+}
+
+int32_t DisplayListSerializer::addPaint(SkPaint* paint) {
+    if (!paint) return -1;
+
+    ssize_t index = mPaintIndices.indexOfKey(paint);
+    if (index >= 0) return mPaintIndices.valueAt(index);
+
+    SkXfermode::Mode mode = SkXfermode::kSrcOver_Mode;
+    SkXfermode::IsMode(paint->getXfermode(), &mode);
+    SkTypeface* typeface = paint->getTypeface();
+
+    mPaints.writeInt(paint->getFlags());
+    mPaints.writeInt(paint->getColor());
+    mPaints.writeInt(paint->getStyle());
+    mPaints.writeScalar(paint->getStrokeWidth());
+    mPaints.writeScalar(paint->getStrokeMiter());
+    mPaints.writeInt(paint->getStrokeCap());
+    mPaints.writeInt(paint->getStrokeJoin());
+    mPaints.writeInt(mode);
+    mPaints.writeInt(paint->getTextAlign());
+    mPaints.writeScalar(paint->getTextSize());
+    mPaints.writeScalar(paint->getTextScaleX());
+    mPaints.writeScalar(paint->getTextSkewX());
+    mPaints.writeInt(paint->getTextEncoding());
+    mPaints.writeInt(paint->getHinting());
+    mPaints.writeInt(typeface ? typeface->style() : -1);
+
+    const int32_t result = mPaintIndices.size();
+    mPaintIndices.add(paint, result);
+    return result;
+}
+
+int32_t DisplayListSerializer::addPath(SkPath* path) {
+    if (!path) return -1;
+
+    ssize_t index = mPathIndices.indexOfKey(path);
+    if (index >= 0) return mPathIndices.valueAt(index);
+
+    mPaths.writeInt(path->getFillType());
+
+    SkPath::RawIter iter(*path);
+    SkPoint pts[4];
+    SkPath::Verb verb;
+    while ((verb = iter.next(pts)) != SkPath::kDone_Verb) {
+        mPaths.writeInt(verb);
+        switch (verb) {
+            case SkPath::kMove_Verb:
+                mPaths.writeScalar(pts[0].fX);
+                mPaths.writeScalar(pts[0].fY);
+                break;
+            case SkPath::kLine_Verb:
+                mPaths.writeScalar(pts[1].fX);
+                mPaths.writeScalar(pts[1].fY);
+                break;
+            case SkPath::kQuad_Verb:
+                mPaths.write(&pts[1], 2 * sizeof(SkPoint));
+                break;
+            case SkPath::kCubic_Verb:
+                mPaths.write(&pts[1], 3 * sizeof(SkPoint));
+                break;
+            default:
+                break;
+        }
+    }
+    mPaths.writeInt(SkPath::kDone_Verb);
+
+    const int32_t result = mPathIndices.size();
+    mPathIndices.add(path, result);
+    return result;
+}
+
+int32_t DisplayListSerializer::addMatrix(SkMatrix* matrix) {
+    if (!matrix) return -1;
+
+    ssize_t index = mMatrixIndices.indexOfKey(matrix);
+    if (index >= 0) return mMatrixIndices.valueAt(index);
+
+    writeMatrix(mMatrices, *matrix);
+
+    const int32_t result = mMatrixIndices.size();
+    mMatrixIndices.add(matrix, result);
+    return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Display lists
+///////////////////////////////////////////////////////////////////////////////
+
+int32_t DisplayListSerializer::addDisplayList(DisplayList* displayList) {
+    if (!displayList) return -1;
+
+    ssize_t index = mDisplayListIndices.indexOfKey(displayList);
+    if (index >= 0) return mDisplayListIndices.valueAt(index);
+
+    // The children are written first by writeOps()
+    SkWriter32 ops(MIN_SERIALIZER_WRITER_SIZE);
+    if (!writeOps(ops, displayList)) {
+        mFailed = true;
+        return -1;
+    }
+
+    writeText(mDisplayLists, displayList->mName.string(), displayList->mName.length());
+    mDisplayLists.writeInt(displayList->mLeft);
+    mDisplayLists.writeInt(displayList->mTop);
+    mDisplayLists.writeInt(displayList->mRight);
+    mDisplayLists.writeInt(displayList->mBottom);
+    mDisplayLists.writeInt(ops.size());
+    appendWriter(mDisplayLists, ops);
+    writeProperties(mDisplayLists, displayList);
+
+    const int32_t result = mDisplayListIndices.size();
+    mDisplayListIndices.add(displayList, result);
+    return result;
+}
+
+void DisplayListSerializer::writeProperties(SkWriter32& writer, DisplayList* displayList) {
+    writer.writeBool(displayList->mClipChildren);
+    writer.writeScalar(displayList->mAlpha);
+    writer.writeBool(displayList->mHasOverlappingRendering);
+    writer.writeScalar(displayList->mTranslationX);
+    writer.writeScalar(displayList->mTranslationY);
+    writer.writeScalar(displayList->mRotation);
+    writer.writeScalar(displayList->mRotationX);
+    writer.writeScalar(displayList->mRotationY);
+    writer.writeScalar(displayList->mScaleX);
+    writer.writeScalar(displayList->mScaleY);
+    writer.writeBool(displayList->mPivotExplicitlySet);
+    writer.writeScalar(displayList->mPivotX);
+    writer.writeScalar(displayList->mPivotY);
+    writer.writeBool(displayList->mTransformCamera != NULL);
+    writer.writeScalar(displayList->mCameraDistance);
+    writer.writeBool(displayList->mCaching);
+
+    writer.writeBool(displayList->mStaticMatrix != NULL);
+    if (displayList->mStaticMatrix) writeMatrix(writer, *displayList->mStaticMatrix);
+    writer.writeBool(displayList->mAnimationMatrix != NULL);
+    if (displayList->mAnimationMatrix) writeMatrix(writer, *displayList->mAnimationMatrix);
+}
+
+bool DisplayListSerializer::writeOps(SkWriter32& writer, DisplayList* displayList) {
+    SkFlattenableReadBuffer& reader = displayList->mReader;
+    reader.rewind();
+
+    while (!reader.eof()) {
+        int op = reader.readInt();
+        if (op & OP_MAY_BE_SKIPPED_MASK) {
+            // The recorder computes the skips again
+            reader.readInt();
+            op &= ~OP_MAY_BE_SKIPPED_MASK;
+        }
+
+        switch (op) {
+            case DisplayList::DrawGLFunction:
+            case DisplayList::SetupShader:
+            case DisplayList::SetupColorFilter:
+                displayList->getInt();
+                mDroppedOps++;
+                continue;
+            case DisplayList::DrawLayer:
+                displayList->getInt();
+                displayList->getFloat();
+                displayList->getFloat();
+                displayList->getInt();
+                mDroppedOps++;
+                continue;
+        }
+
+        writer.writeInt(op);
+
+        switch (op) {
+            case DisplayList::Save:
+            case DisplayList::RestoreToCount:
+                writer.writeInt(displayList->getInt());
+                break;
+            case DisplayList::Restore:
+            case DisplayList::ResetShader:
+            case DisplayList::ResetColorFilter:
+            case DisplayList::ResetShadow:
+            case DisplayList::ResetPaintFilter:
+                break;
+            case DisplayList::SaveLayer: {
+                for (int i = 0; i < 4; i++) writer.writeScalar(displayList->getFloat());
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+                writer.writeInt(displayList->getInt());
+            }
+            break;
+            case DisplayList::SaveLayerAlpha: {
+                for (int i = 0; i < 4; i++) writer.writeScalar(displayList->getFloat());
+                writer.writeInt(displayList->getInt());
+                writer.writeInt(displayList->getInt());
+            }
+            break;
+            case DisplayList::Translate:
+            case DisplayList::Scale:
+            case DisplayList::Skew: {
+                writer.writeScalar(displayList->getFloat());
+                writer.writeScalar(displayList->getFloat());
+            }
+            break;
+            case DisplayList::Rotate:
+                writer.writeScalar(displayList->getFloat());
+                break;
+            case DisplayList::SetMatrix:
+            case DisplayList::ConcatMatrix:
+                writer.writeInt(addMatrix(displayList->getMatrix()));
+                break;
+            case DisplayList::ClipRect: {
+                for (int i = 0; i < 4; i++) writer.writeScalar(displayList->getFloat());
+                writer.writeInt(displayList->getInt());
+            }
+            break;
+            case DisplayList::DrawDisplayList: {
+                const int32_t child = addDisplayList(displayList->getDisplayList());
+                if (child < 0) return false;
+                writer.writeInt(child);
+                writer.writeInt(displayList->getInt());
+            }
+            break;
+            case DisplayList::DrawBitmap:
+            case DisplayList::DrawBitmapData: {
+                writer.writeInt(addBitmap(displayList->getBitmap()));
+                writer.writeScalar(displayList->getFloat());
+                writer.writeScalar(displayList->getFloat());
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+            }
+            break;
+            case DisplayList::DrawBitmapMatrix: {
+                writer.writeInt(addBitmap(displayList->getBitmap()));
+                writer.writeInt(addMatrix(displayList->getMatrix()));
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+            }
+            break;
+            case DisplayList::DrawBitmapRect: {
+                writer.writeInt(addBitmap(displayList->getBitmap()));
+                for (int i = 0; i < 8; i++) writer.writeScalar(displayList->getFloat());
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+            }
+            break;
+            case DisplayList::DrawBitmapMesh: {
+                int32_t verticesCount = 0;
+                uint32_t colorsCount = 0;
+
+                writer.writeInt(addBitmap(displayList->getBitmap()));
+                writer.writeInt(displayList->getInt());
+                writer.writeInt(displayList->getInt());
+                float* vertices = displayList->getFloats(verticesCount);
+                writer.writeInt(verticesCount);
+                writer.write(vertices, verticesCount * sizeof(float));
+                bool hasColors = displayList->getInt();
+                writer.writeBool(hasColors);
+                if (hasColors) {
+                    int32_t* colors = displayList->getInts(colorsCount);
+                    writer.writeInt(colorsCount);
+                    writer.write(colors, colorsCount * sizeof(int32_t));
+                }
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+            }
+            break;
+            case DisplayList::DrawPatch: {
+                uint32_t xDivsCount = 0;
+                uint32_t yDivsCount = 0;
+                int8_t numColors = 0;
+
+                writer.writeInt(addBitmap(displayList->getBitmap()));
+                int32_t* xDivs = displayList->getInts(xDivsCount);
+                int32_t* yDivs = displayList->getInts(yDivsCount);
+                uint32_t* colors = displayList->getUInts(numColors);
+                writer.writeInt(xDivsCount);
+                writer.write(xDivs, xDivsCount * sizeof(int32_t));
+                writer.writeInt(yDivsCount);
+                writer.write(yDivs, yDivsCount * sizeof(int32_t));
+                writer.writeInt(numColors);
+                writer.write(colors, numColors * sizeof(uint32_t));
+                for (int i = 0; i < 4; i++) writer.writeScalar(displayList->getFloat());
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+            }
+            break;
+            case DisplayList::DrawColor: {
+                writer.writeInt(displayList->getInt());
+                writer.writeInt(displayList->getInt());
+            }
+            break;
+            case DisplayList::DrawRect:
+            case DisplayList::DrawOval: {
+                for (int i = 0; i < 4; i++) writer.writeScalar(displayList->getFloat());
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+            }
+            break;
+            case DisplayList::DrawRoundRect: {
+                for (int i = 0; i < 6; i++) writer.writeScalar(displayList->getFloat());
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+            }
+            break;
+            case DisplayList::DrawCircle: {
+                for (int i = 0; i < 3; i++) writer.writeScalar(displayList->getFloat());
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+            }
+            break;
+            case DisplayList::DrawArc: {
+                for (int i = 0; i < 6; i++) writer.writeScalar(displayList->getFloat());
+                writer.writeInt(displayList->getInt());
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+            }
+            break;
+            case DisplayList::DrawPath: {
+                writer.writeInt(addPath(displayList->getPath()));
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+            }
+            break;
+            case DisplayList::DrawLines:
+            case DisplayList::DrawPoints: {
+                int32_t count = 0;
+                float* points = displayList->getFloats(count);
+                writer.writeInt(count);
+                writer.write(points, count * sizeof(float));
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+            }
+            break;
+            case DisplayList::DrawText: {
+                DisplayList::TextContainer text;
+                displayList->getText(&text);
+                writeText(writer, text.text(), text.length());
+                writer.writeInt(displayList->getInt());
+                writer.writeScalar(displayList->getFloat());
+                writer.writeScalar(displayList->getFloat());
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+                writer.writeScalar(displayList->getFloat());
+            }
+            break;
+            case DisplayList::DrawTextOnPath: {
+                DisplayList::TextContainer text;
+                displayList->getText(&text);
+                writeText(writer, text.text(), text.length());
+                writer.writeInt(displayList->getInt());
+                writer.writeInt(addPath(displayList->getPath()));
+                writer.writeScalar(displayList->getFloat());
+                writer.writeScalar(displayList->getFloat());
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+            }
+            break;
+            case DisplayList::DrawPosText: {
+                DisplayList::TextContainer text;
+                int32_t positionsCount = 0;
+                displayList->getText(&text);
+                writeText(writer, text.text(), text.length());
+                writer.writeInt(displayList->getInt());
+                float* positions = displayList->getFloats(positionsCount);
+                writer.writeInt(positionsCount);
+                writer.write(positions, positionsCount * sizeof(float));
+                writer.writeInt(addPaint((SkPaint*) displayList->getInt()));
+            }
+            break;
+            case DisplayList::SetupShadow: {
+                for (int i = 0; i < 3; i++) writer.writeScalar(displayList->getFloat());
+                writer.writeInt(displayList->getInt());
+            }
+            break;
+            case DisplayList::SetupPaintFilter: {
+                writer.writeInt(displayList->getInt());
+                writer.writeInt(displayList->getInt());
+            }
+            break;
+            default:
+                ALOGW("Cannot serialize display list operation %d", op);
+                return false;
+        }
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Capture
+///////////////////////////////////////////////////////////////////////////////
+
+DisplayListCapture::DisplayListCapture(): mWidth(0), mHeight(0) {
+}
+
+DisplayListCapture::~DisplayListCapture() {
+    clear();
+}
+
+void DisplayListCapture::clear() {
+    // The display lists hold references to the bitmaps and paths
+    for (size_t i = 0; i < mDisplayLists.size(); i++) {
+        delete mDisplayLists.itemAt(i);
+    }
+    mDisplayLists.clear();
+
+    Caches& caches = Caches::getInstance();
+    for (size_t i = 0; i < mBitmaps.size(); i++) {
+        caches.resourceCache.destructor(mBitmaps.itemAt(i));
+    }
+    mBitmaps.clear();
+
+    for (size_t i = 0; i < mPaths.size(); i++) {
+        caches.resourceCache.destructor(mPaths.itemAt(i));
+    }
+    mPaths.clear();
+
+    for (size_t i = 0; i < mPaints.size(); i++) {
+        delete mPaints.itemAt(i);
+    }
+    mPaints.clear();
+
+    mMatrices.clear();
+    mWidth = mHeight = 0;
+}
+
+bool DisplayListCapture::read(const void* data, size_t size, const int* fds, size_t fdCount) {
+    clear();
+
+    SkReader32 reader(data, size & ~3);
+    if (!canRead(reader, size, 9 * sizeof(int32_t)) ||
+            reader.readInt() != DISPLAY_LIST_SERIALIZATION_MAGIC) {
+        ALOGW("Invalid display list capture");
+        return false;
+    }
+
+    const int32_t version = reader.readInt();
+    if (version != DISPLAY_LIST_SERIALIZATION_VERSION) {
+        ALOGW("Unsupported display list capture version %d", version);
+        return false;
+    }
+
+    mWidth = reader.readInt();
+    mHeight = reader.readInt();
+    const int32_t bitmapCount = reader.readInt();
+    const int32_t paintCount = reader.readInt();
+    const int32_t pathCount = reader.readInt();
+    const int32_t matrixCount = reader.readInt();
+    const int32_t displayListCount = reader.readInt();
+
+    bool result = true;
+    for (int32_t i = 0; result && i < bitmapCount; i++) {
+        result = readBitmap(reader, fds, fdCount);
+    }
+    for (int32_t i = 0; result && i < paintCount; i++) {
+        result = readPaint(reader);
+    }
+    for (int32_t i = 0; result && i < pathCount; i++) {
+        result = readPath(reader);
+    }
+    for (int32_t i = 0; result && i < matrixCount; i++) {
+        SkMatrix matrix;
+        result = readMatrix(reader, &matrix);
+        mMatrices.add(matrix);
+    }
+
+    if (result) {
+        DisplayListRenderer recorder;
+        for (int32_t i = 0; result && i < displayListCount; i++) {
+            result = readDisplayList(reader, recorder);
+        }
+    }
+
+    if (!result || mDisplayLists.isEmpty()) {
+        ALOGW("Corrupted display list capture");
+        clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool DisplayListCapture::readBitmap(SkReader32& reader, const int* fds, size_t fdCount) {
+    const size_t end = reader.size();
+    if (!canRead(reader, end, 6 * sizeof(int32_t))) return false;
+
+    const SkBitmap::Config config = (SkBitmap::Config) reader.readInt();
+    const int32_t width = reader.readInt();
+    const int32_t height = reader.readInt();
+    const int32_t rowBytes = reader.readInt();
+    const bool opaque = reader.readBool();
+    const int32_t storage = reader.readInt();
+
+    SkBitmap* bitmap = new SkBitmap;
+    mBitmaps.add(bitmap);
+
+    if (width <= 0 || height <= 0) {
+        // The bitmap could not be read when it was serialized
+        reader.skip(reader.readInt());
+        return true;
+    }
+
+    bitmap->setConfig(config, width, height, rowBytes);
+    bitmap->setIsOpaque(opaque);
+    const size_t size = bitmap->getSize();
+    if (size != size_t(rowBytes) * height) return false;
+
+    if (storage == kBitmapStorage_Ashmem) {
+        const int32_t fdIndex = reader.readInt();
+        if (fdIndex < 0 || size_t(fdIndex) >= fdCount) return false;
+
+        void* addr = mmap(NULL, size, PROT_READ, MAP_SHARED, fds[fdIndex], 0);
+        if (addr == MAP_FAILED) return false;
+
+        bitmap->allocPixels();
+        memcpy(bitmap->getPixels(), addr, size);
+        munmap(addr, size);
+    } else {
+        if (!canRead(reader, end, sizeof(int32_t))) return false;
+        const int32_t length = reader.readInt();
+        if (size_t(length) != size || !canRead(reader, end, SkAlign4(size))) return false;
+
+        bitmap->allocPixels();
+        memcpy(bitmap->getPixels(), reader.skip(size), size);
+    }
+
+    bitmap->setImmutable();
+    return true;
+}
+
+bool DisplayListCapture::readPaint(SkReader32& reader) {
+    if (!canRead(reader, reader.size(), 15 * sizeof(int32_t))) return false;
+
+    SkPaint* paint = new SkPaint;
+    mPaints.add(paint);
+
+    paint->setFlags(reader.readInt());
+    paint->setColor(reader.readInt());
+    paint->setStyle((SkPaint::Style) reader.readInt());
+    paint->setStrokeWidth(reader.readScalar());
+    paint->setStrokeMiter(reader.readScalar());
+    paint->setStrokeCap((SkPaint::Cap) reader.readInt());
+    paint->setStrokeJoin((SkPaint::Join) reader.readInt());
+    paint->setXfermodeMode((SkXfermode::Mode) reader.readInt());
+    paint->setTextAlign((SkPaint::Align) reader.readInt());
+    paint->setTextSize(reader.readScalar());
+    paint->setTextScaleX(reader.readScalar());
+    paint->setTextSkewX(reader.readScalar());
+    paint->setTextEncoding((SkPaint::TextEncoding) reader.readInt());
+    paint->setHinting((SkPaint::Hinting) reader.readInt());
+
+    const int32_t typefaceStyle = reader.readInt();
+    if (typefaceStyle >= 0) {
+        SkTypeface* typeface = SkTypeface::CreateFromName(NULL, (SkTypeface::Style) typefaceStyle);
+        SkSafeUnref(paint->setTypeface(typeface));
+    }
+
+    return true;
+}
+
+bool DisplayListCapture::readPath(SkReader32& reader) {
+    const size_t end = reader.size();
+    if (!canRead(reader, end, sizeof(int32_t))) return false;
+
+    SkPath* path = new SkPath;
+    mPaths.add(path);
+    path->setFillType((SkPath::FillType) reader.readInt());
+
+    while (canRead(reader, end, sizeof(int32_t))) {
+        const SkPath::Verb verb = (SkPath::Verb) reader.readInt();
+        switch (verb) {
+            case SkPath::kMove_Verb:
+            case SkPath::kLine_Verb: {
+                if (!canRead(reader, end, sizeof(SkPoint))) return false;
+                const float x = reader.readScalar();
+                const float y = reader.readScalar();
+                if (verb == SkPath::kMove_Verb) {
+                    path->moveTo(x, y);
+                } else {
+                    path->lineTo(x, y);
+                }
+            }
+            break;
+            case SkPath::kQuad_Verb: {
+                if (!canRead(reader, end, 2 * sizeof(SkPoint))) return false;
+                const SkPoint* pts = (const SkPoint*) reader.skip(2 * sizeof(SkPoint));
+                path->quadTo(pts[0], pts[1]);
+            }
+            break;
+            case SkPath::kCubic_Verb: {
+                if (!canRead(reader, end, 3 * sizeof(SkPoint))) return false;
+                const SkPoint* pts = (const SkPoint*) reader.skip(3 * sizeof(SkPoint));
+                path->cubicTo(pts[0], pts[1], pts[2]);
+            }
+            break;
+            case SkPath::kClose_Verb:
+                path->close();
+                break;
+            case SkPath::kDone_Verb:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    return false;
+}
+
+bool DisplayListCapture::readMatrix(SkReader32& reader, SkMatrix* matrix) {
+    if (!canRead(reader, reader.size(), 9 * sizeof(float))) return false;
+
+    for (int i = 0; i < 9; i++) {
+        matrix->set(i, reader.readScalar());
+    }
+    return true;
+}
+
+bool DisplayListCapture::readDisplayList(SkReader32& reader, DisplayListRenderer& recorder) {
+    const size_t end = reader.size();
+    if (!canRead(reader, end, sizeof(int32_t))) return false;
+
+    const int32_t nameLength = reader.readInt();
+    if (nameLength < 0 || !canRead(reader, end, SkAlign4(nameLength))) return false;
+    String8 name((const char*) reader.skip(nameLength), nameLength);
+
+    if (!canRead(reader, end, 5 * sizeof(int32_t))) return false;
+    const int32_t left = reader.readInt();
+    const int32_t top = reader.readInt();
+    const int32_t right = reader.readInt();
+    const int32_t bottom = reader.readInt();
+    const int32_t opsSize = reader.readInt();
+    if (opsSize < 0 || !canRead(reader, end, opsSize)) return false;
+
+    recorder.reset();
+    recorder.setViewport(right - left, bottom - top);
+    recorder.prepare(false);
+    const bool result = readOps(reader, reader.offset() + opsSize, recorder);
+    recorder.finish();
+    if (!result) return false;
+
+    DisplayList* displayList = recorder.getDisplayList(NULL);
+    mDisplayLists.add(displayList);
+
+    displayList->setName(name.string());
+    displayList->setLeftTopRightBottom(left, top, right, bottom);
+    readProperties(reader, displayList);
+
+    return true;
+}
+
+void DisplayListCapture::readProperties(SkReader32& reader, DisplayList* displayList) {
+    if (!canRead(reader, reader.size(), 18 * sizeof(int32_t))) return;
+
+    displayList->setClipChildren(reader.readBool());
+    displayList->setAlpha(reader.readScalar());
+    displayList->setHasOverlappingRendering(reader.readBool());
+    displayList->setTranslationX(reader.readScalar());
+    displayList->setTranslationY(reader.readScalar());
+    displayList->setRotation(reader.readScalar());
+    displayList->setRotationX(reader.readScalar());
+    displayList->setRotationY(reader.readScalar());
+    displayList->setScaleX(reader.readScalar());
+    displayList->setScaleY(reader.readScalar());
+
+    const bool pivotExplicitlySet = reader.readBool();
+    const float pivotX = reader.readScalar();
+    const float pivotY = reader.readScalar();
+    if (pivotExplicitlySet) {
+        displayList->setPivotX(pivotX);
+        displayList->setPivotY(pivotY);
+    }
+
+    const bool hasCamera = reader.readBool();
+    const float cameraDistance = reader.readScalar();
+    if (hasCamera) {
+        displayList->setCameraDistance(cameraDistance);
+    }
+
+    displayList->setCaching(reader.readBool());
+
+    SkMatrix matrix;
+    if (reader.readBool() && readMatrix(reader, &matrix)) {
+        displayList->setStaticMatrix(&matrix);
+    }
+    if (canRead(reader, reader.size(), sizeof(int32_t)) && reader.readBool() &&
+            readMatrix(reader, &matrix)) {
+        displayList->setAnimationMatrix(&matrix);
+    }
+}
+
+bool DisplayListCapture::readOps(SkReader32& reader, size_t end, DisplayListRenderer& recorder) {
+    const int32_t bitmapCount = mBitmaps.size();
+    const int32_t paintCount = mPaints.size();
+    const int32_t pathCount = mPaths.size();
+    const int32_t matrixCount = mMatrices.size();
+    const int32_t displayListCount = mDisplayLists.size();
+
+    #define READ_INT(v) \
+        if (!canRead(reader, end, sizeof(int32_t))) return false; \
+        const int32_t v = reader.readInt()
+    #define READ_FLOAT(v) \
+        if (!canRead(reader, end, sizeof(float))) return false; \
+        const float v = reader.readScalar()
+    #define READ_ARRAY(type, v, count) \
+        READ_INT(count); \
+        if (count < 0 || !canRead(reader, end, count * sizeof(type))) return false; \
+        type* v = (type*) reader.skip(count * sizeof(type))
+    #define READ_TEXT(v, length) \
+        READ_INT(length); \
+        if (length < 0 || !canRead(reader, end, SkAlign4(length))) return false; \
+        const char* v = (const char*) reader.skip(length)
+    #define READ_RESOURCE(type, v, resources, count) \
+        READ_INT(v##Index); \
+        if (v##Index >= count) return false; \
+        type v = v##Index < 0 ? NULL : resources
+    #define READ_BITMAP(v) READ_RESOURCE(SkBitmap*, v, mBitmaps.itemAt(v##Index), bitmapCount)
+    #define READ_PAINT(v) READ_RESOURCE(SkPaint*, v, mPaints.itemAt(v##Index), paintCount)
+    #define READ_PATH(v) READ_RESOURCE(SkPath*, v, mPaths.itemAt(v##Index), pathCount)
+    #define READ_MATRIX(v) READ_RESOURCE(SkMatrix*, v, \
+            &mMatrices.editItemAt(v##Index), matrixCount)
+
+    while (reader.offset() < end) {
+        READ_INT(op);
+
+        switch (op) {
+            case DisplayList::Save: {
+                READ_INT(flags);
+                recorder.save(flags);
+            }
+            break;
+            case DisplayList::Restore:
+                recorder.restore();
+                break;
+            case DisplayList::RestoreToCount: {
+                // Save counts are relative to the start of the display list
+                READ_INT(saveCount);
+                recorder.restoreToCount(saveCount);
+            }
+            break;
+            case DisplayList::SaveLayer: {
+                READ_FLOAT(left);
+                READ_FLOAT(top);
+                READ_FLOAT(right);
+                READ_FLOAT(bottom);
+                READ_PAINT(paint);
+                READ_INT(flags);
+                recorder.saveLayer(left, top, right, bottom, paint, flags);
+            }
+            break;
+            case DisplayList::SaveLayerAlpha: {
+                READ_FLOAT(left);
+                READ_FLOAT(top);
+                READ_FLOAT(right);
+                READ_FLOAT(bottom);
+                READ_INT(alpha);
+                READ_INT(flags);
+                recorder.saveLayerAlpha(left, top, right, bottom, alpha, flags);
+            }
+            break;
+            case DisplayList::Translate: {
+                READ_FLOAT(dx);
+                READ_FLOAT(dy);
+                recorder.translate(dx, dy);
+            }
+            break;
+            case DisplayList::Rotate: {
+                READ_FLOAT(degrees);
+                recorder.rotate(degrees);
+            }
+            break;
+            case DisplayList::Scale: {
+                READ_FLOAT(sx);
+                READ_FLOAT(sy);
+                recorder.scale(sx, sy);
+            }
+            break;
+            case DisplayList::Skew: {
+                READ_FLOAT(sx);
+                READ_FLOAT(sy);
+                recorder.skew(sx, sy);
+            }
+            break;
+            case DisplayList::SetMatrix: {
+                READ_MATRIX(matrix);
+                recorder.setMatrix(matrix);
+            }
+            break;
+            case DisplayList::ConcatMatrix: {
+                READ_MATRIX(matrix);
+                if (!matrix) return false;
+                recorder.concatMatrix(matrix);
+            }
+            break;
+            case DisplayList::ClipRect: {
+                READ_FLOAT(left);
+                READ_FLOAT(top);
+                READ_FLOAT(right);
+                READ_FLOAT(bottom);
+                READ_INT(regionOp);
+                recorder.clipRect(left, top, right, bottom, (SkRegion::Op) regionOp);
+            }
+            break;
+            case DisplayList::DrawDisplayList: {
+                // Children are always decoded before their parents
+                READ_RESOURCE(DisplayList*, child, mDisplayLists.itemAt(childIndex),
+                        displayListCount);
+                READ_INT(flags);
+                Rect dirty;
+                recorder.drawDisplayList(child, dirty, flags);
+            }
+            break;
+            case DisplayList::DrawBitmap:
+            case DisplayList::DrawBitmapData: {
+                READ_BITMAP(bitmap);
+                READ_FLOAT(x);
+                READ_FLOAT(y);
+                READ_PAINT(paint);
+                if (!bitmap) return false;
+                recorder.drawBitmap(bitmap, x, y, paint);
+            }
+            break;
+            case DisplayList::DrawBitmapMatrix: {
+                READ_BITMAP(bitmap);
+                READ_MATRIX(matrix);
+                READ_PAINT(paint);
+                if (!bitmap || !matrix) return false;
+                recorder.drawBitmap(bitmap, matrix, paint);
+            }
+            break;
+            case DisplayList::DrawBitmapRect: {
+                READ_BITMAP(bitmap);
+                READ_FLOAT(srcLeft);
+                READ_FLOAT(srcTop);
+                READ_FLOAT(srcRight);
+                READ_FLOAT(srcBottom);
+                READ_FLOAT(dstLeft);
+                READ_FLOAT(dstTop);
+                READ_FLOAT(dstRight);
+                READ_FLOAT(dstBottom);
+                READ_PAINT(paint);
+                if (!bitmap) return false;
+                recorder.drawBitmap(bitmap, srcLeft, srcTop, srcRight, srcBottom,
+                        dstLeft, dstTop, dstRight, dstBottom, paint);
+            }
+            break;
+            case DisplayList::DrawBitmapMesh: {
+                READ_BITMAP(bitmap);
+                READ_INT(meshWidth);
+                READ_INT(meshHeight);
+                READ_ARRAY(float, vertices, verticesCount);
+                READ_INT(hasColors);
+                int32_t* colors = NULL;
+                if (hasColors) {
+                    READ_ARRAY(int32_t, meshColors, colorsCount);
+                    colors = meshColors;
+                }
+                READ_PAINT(paint);
+                if (!bitmap) return false;
+                recorder.drawBitmapMesh(bitmap, meshWidth, meshHeight, vertices, colors, paint);
+            }
+            break;
+            case DisplayList::DrawPatch: {
+                READ_BITMAP(bitmap);
+                READ_ARRAY(int32_t, xDivs, xDivsCount);
+                READ_ARRAY(int32_t, yDivs, yDivsCount);
+                READ_ARRAY(uint32_t, colors, numColors);
+                READ_FLOAT(left);
+                READ_FLOAT(top);
+                READ_FLOAT(right);
+                READ_FLOAT(bottom);
+                READ_PAINT(paint);
+                if (!bitmap) return false;
+                recorder.drawPatch(bitmap, xDivs, yDivs, colors, xDivsCount, yDivsCount,
+                        numColors, left, top, right, bottom, paint);
+            }
+            break;
+            case DisplayList::DrawColor: {
+                READ_INT(color);
+                READ_INT(mode);
+                recorder.drawColor(color, (SkXfermode::Mode) mode);
+            }
+            break;
+            case DisplayList::DrawRect: {
+                READ_FLOAT(left);
+                READ_FLOAT(top);
+                READ_FLOAT(right);
+                READ_FLOAT(bottom);
+                READ_PAINT(paint);
+                recorder.drawRect(left, top, right, bottom, paint);
+            }
+            break;
+            case DisplayList::DrawRoundRect: {
+                READ_FLOAT(left);
+                READ_FLOAT(top);
+                READ_FLOAT(right);
+                READ_FLOAT(bottom);
+                READ_FLOAT(rx);
+                READ_FLOAT(ry);
+                READ_PAINT(paint);
+                recorder.drawRoundRect(left, top, right, bottom, rx, ry, paint);
+            }
+            break;
+            case DisplayList::DrawCircle: {
+                READ_FLOAT(x);
+                READ_FLOAT(y);
+                READ_FLOAT(radius);
+                READ_PAINT(paint);
+                recorder.drawCircle(x, y, radius, paint);
+            }
+            break;
+            case DisplayList::DrawOval: {
+                READ_FLOAT(left);
+                READ_FLOAT(top);
+                READ_FLOAT(right);
+                READ_FLOAT(bottom);
+                READ_PAINT(paint);
+                recorder.drawOval(left, top, right, bottom, paint);
+            }
+            break;
+            case DisplayList::DrawArc: {
+                READ_FLOAT(left);
+                READ_FLOAT(top);
+                READ_FLOAT(right);
+                READ_FLOAT(bottom);
+                READ_FLOAT(startAngle);
+                READ_FLOAT(sweepAngle);
+                READ_INT(useCenter);
+                READ_PAINT(paint);
+                recorder.drawArc(left, top, right, bottom, startAngle, sweepAngle,
+                        useCenter == 1, paint);
+            }
+            break;
+            case DisplayList::DrawPath: {
+                READ_PATH(path);
+                READ_PAINT(paint);
+                if (!path) return false;
+                recorder.drawPath(path, paint);
+            }
+            break;
+            case DisplayList::DrawLines:
+            case DisplayList::DrawPoints: {
+                READ_ARRAY(float, points, count);
+                READ_PAINT(paint);
+                if (op == DisplayList::DrawLines) {
+                    recorder.drawLines(points, count, paint);
+                } else {
+                    recorder.drawPoints(points, count, paint);
+                }
+            }
+            break;
+            case DisplayList::DrawText: {
+                READ_TEXT(text, length);
+                READ_INT(count);
+                READ_FLOAT(x);
+                READ_FLOAT(y);
+                READ_PAINT(paint);
+                READ_FLOAT(totalAdvance);
+                recorder.drawText(text, length, count, x, y, paint, totalAdvance);
+            }
+            break;
+            case DisplayList::DrawTextOnPath: {
+                READ_TEXT(text, length);
+                READ_INT(count);
+                READ_PATH(path);
+                READ_FLOAT(hOffset);
+                READ_FLOAT(vOffset);
+                READ_PAINT(paint);
+                if (!path) return false;
+                recorder.drawTextOnPath(text, length, count, path, hOffset, vOffset, paint);
+            }
+            break;
+            case DisplayList::DrawPosText: {
+                READ_TEXT(text, length);
+                READ_INT(count);
+                READ_ARRAY(float, positions, positionsCount);
+                READ_PAINT(paint);
+                recorder.drawPosText(text, length, count, positions, paint);
+            }
+            break;
+            case DisplayList::ResetShader:
+                recorder.resetShader();
+                break;
+            case DisplayList::ResetColorFilter:
+                recorder.resetColorFilter();
+                break;
+            case DisplayList::ResetShadow:
+                recorder.resetShadow();
+                break;
+            case DisplayList::SetupShadow: {
+                READ_FLOAT(radius);
+                READ_FLOAT(dx);
+                READ_FLOAT(dy);
+                READ_INT(color);
+                recorder.setupShadow(radius, dx, dy, color);
+            }
+            break;
+            case DisplayList::ResetPaintFilter:
+                recorder.resetPaintFilter();
+                break;
+            case DisplayList::SetupPaintFilter: {
+                READ_INT(clearBits);
+                READ_INT(setBits);
+                recorder.setupPaintFilter(clearBits, setBits);
+            }
+            break;
+            default:
+                return false;
+        }
+    }
+
+    #undef READ_MATRIX
+    #undef READ_PATH
+    #undef READ_PAINT
+    #undef READ_BITMAP
+    #undef READ_RESOURCE
+    #undef READ_TEXT
+    #undef READ_ARRAY
+    #undef READ_FLOAT
+    #undef READ_INT
+
+    return reader.offset() == end;
+}
+
+}; // namespace uirenderer
+}; // namespace android
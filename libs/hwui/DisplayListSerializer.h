@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_DISPLAY_LIST_SERIALIZER_H
+#define ANDROID_HWUI_DISPLAY_LIST_SERIALIZER_H
+
+#include <SkBitmap.h>
+#include <SkMatrix.h>
+#include <SkPaint.h>
+#include <SkPath.h>
+#include <SkReader32.h>
+#include <SkWriter32.h>
+
+#include <cutils/compiler.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/Vector.h>
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// "HWDL"
+#define DISPLAY_LIST_SERIALIZATION_MAGIC 0x4c445748
+// Must be incremented whenever the format or the display list ops change
+#define DISPLAY_LIST_SERIALIZATION_VERSION 1
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+class DisplayList;
+class DisplayListRenderer;
+
+/**
+ * Encodes a display list, the display lists it draws and their resources
+ * into a self-contained buffer that can be saved, sent to another process
+ * and replayed with DisplayListCapture.
+ *
+ * Paints, paths, matrices and bitmaps are written by value and referenced
+ * by index from the operations. Bitmaps are either copied in the buffer or,
+ * when sharing is enabled, copied once into ashmem regions whose file
+ * descriptors must be transferred along with the buffer.
+ *
+ * Layers, GL functors, shaders and color filters cannot be serialized,
+ * their operations are dropped and counted. The shader and typeface of
+ * paints, as well as their path effects and mask filters, are not kept.
+ *
+ * Reads the streams of the display lists and must therefore be used on
+ * the thread that replays them.
+ */
+class DisplayListSerializer {
+public:
+    ANDROID_API DisplayListSerializer(bool shareBitmaps = false);
+    ANDROID_API ~DisplayListSerializer();
+
+    /**
+     * Serializes the specified display list, replacing the result of the
+     * previous call. The width and height are those of the viewport the
+     * display list is drawn into. Returns false if the display list could
+     * not be serialized.
+     */
+    ANDROID_API bool serialize(DisplayList* displayList, int width, int height);
+
+    /**
+     * Size in bytes of the serialized data.
+     */
+    size_t getSize() const {
+        return mData.size();
+    }
+
+    /**
+     * Copies the serialized data into the specified buffer, which must be
+     * at least getSize() bytes long.
+     */
+    ANDROID_API void copyTo(void* buffer) const;
+
+    /**
+     * File descriptors of the ashmem regions holding the shared bitmaps.
+     * They stay owned by the serializer and are closed by the next call
+     * to serialize() and by the destructor.
+     */
+    const Vector<int>& getBitmapFds() const {
+        return mBitmapFds;
+    }
+
+    /**
+     * Number of operations that were dropped by the last serialization.
+     */
+    uint32_t getDroppedOpCount() const {
+        return mDroppedOps;
+    }
+
+private:
+    void reset();
+
+    int32_t addDisplayList(DisplayList* displayList);
+    int32_t addBitmap(SkBitmap* bitmap);
+    int32_t addPaint(SkPaint* paint);
+    int32_t addPath(SkPath* path);
+    int32_t addMatrix(SkMatrix* matrix);
+
+    void writeBitmap(const SkBitmap& bitmap);
+    void writeProperties(SkWriter32& writer, DisplayList* displayList);
+    bool writeOps(SkWriter32& writer, DisplayList* displayList);
+
+    bool mShareBitmaps;
+
+    KeyedVector<DisplayList*, int32_t> mDisplayListIndices;
+    KeyedVector<SkBitmap*, int32_t> mBitmapIndices;
+    KeyedVector<SkPaint*, int32_t> mPaintIndices;
+    KeyedVector<SkPath*, int32_t> mPathIndices;
+    KeyedVector<SkMatrix*, int32_t> mMatrixIndices;
+
+    SkWriter32 mDisplayLists;
+    SkWriter32 mBitmaps;
+    SkWriter32 mPaints;
+    SkWriter32 mPaths;
+    SkWriter32 mMatrices;
+
+    Vector<uint8_t> mData;
+    Vector<int> mBitmapFds;
+    uint32_t mDroppedOps;
+    bool mFailed;
+}; // class DisplayListSerializer
+
+/**
+ * Display lists and resources decoded from the output of a
+ * DisplayListSerializer. The display lists are recorded again with a
+ * DisplayListRenderer and are owned by the capture, as are the bitmaps
+ * they draw.
+ *
+ * Must be used with a current GL context, like display list recording.
+ */
+class DisplayListCapture {
+public:
+    ANDROID_API DisplayListCapture();
+    ANDROID_API ~DisplayListCapture();
+
+    /**
+     * Decodes the specified data. The file descriptors are the ones of the
+     * ashmem regions the serializer shared, if any; they are not closed.
+     * Returns false if the data is invalid.
+     */
+    ANDROID_API bool read(const void* data, size_t size, const int* fds = NULL,
+            size_t fdCount = 0);
+
+    /**
+     * Display list that was serialized, NULL if nothing was read.
+     */
+    DisplayList* getDisplayList() const {
+        return mDisplayLists.isEmpty() ? NULL : mDisplayLists.top();
+    }
+
+    int getWidth() const {
+        return mWidth;
+    }
+
+    int getHeight() const {
+        return mHeight;
+    }
+
+private:
+    void clear();
+
+    bool readBitmap(SkReader32& reader, const int* fds, size_t fdCount);
+    bool readPaint(SkReader32& reader);
+    bool readPath(SkReader32& reader);
+    bool readMatrix(SkReader32& reader, SkMatrix* matrix);
+    bool readDisplayList(SkReader32& reader, DisplayListRenderer& recorder);
+    void readProperties(SkReader32& reader, DisplayList* displayList);
+    bool readOps(SkReader32& reader, size_t end, DisplayListRenderer& recorder);
+
+    int mWidth;
+    int mHeight;
+
+    // Children first, the last display list is the one that was serialized
+    Vector<DisplayList*> mDisplayLists;
+    Vector<SkBitmap*> mBitmaps;
+    Vector<SkPaint*> mPaints;
+    Vector<SkPath*> mPaths;
+    Vector<SkMatrix> mMatrices;
+}; // class DisplayListCapture
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_DISPLAY_LIST_SERIALIZER_H
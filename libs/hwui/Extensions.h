@@ -68,6 +68,16 @@ public:
         mHasDiscardFramebuffer = hasExtension("GL_EXT_discard_framebuffer");
         mHasDebugMarker = hasExtension("GL_EXT_debug_marker");
         mHasDebugLabel = hasExtension("GL_EXT_debug_label");
+        mHasUnpackSubImage = hasExtension("GL_EXT_unpack_subimage");
+        mHasDisjointTimerQuery = hasExtension("GL_EXT_disjoint_timer_query");
+        mHasETC1 = hasExtension("GL_OES_compressed_ETC1_RGB8_texture");
+
+        mHasProgramBinary = false;
+        if (hasExtension("GL_OES_get_program_binary")) {
+            GLint formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+            mHasProgramBinary = formats > 0;
+        }
 
         const char* vendor = (const char*) glGetString(GL_VENDOR);
         EXT_LOGD("Vendor: %s", vendor);
@@ -85,6 +95,10 @@ public:
     inline bool hasDiscardFramebuffer() const { return mHasDiscardFramebuffer; }
     inline bool hasDebugMarker() const { return mHasDebugMarker; }
     inline bool hasDebugLabel() const { return mHasDebugLabel; }
+    inline bool hasUnpackSubImage() const { return mHasUnpackSubImage; }
+    inline bool hasProgramBinary() const { return mHasProgramBinary; }
+    inline bool hasDisjointTimerQuery() const { return mHasDisjointTimerQuery; }
+    inline bool hasETC1() const { return mHasETC1; }
 
     bool hasExtension(const char* extension) const {
         const String8 s(extension);
@@ -106,6 +120,10 @@ private:
     bool mHasDiscardFramebuffer;
     bool mHasDebugMarker;
     bool mHasDebugLabel;
+    bool mHasUnpackSubImage;
+    bool mHasProgramBinary;
+    bool mHasDisjointTimerQuery;
+    bool mHasETC1;
 }; // class Extensions
 
 }; // namespace uirenderer
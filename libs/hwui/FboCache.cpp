@@ -18,6 +18,7 @@
 
 #include <stdlib.h>
 
+#include "Caches.h"
 #include "Debug.h"
 #include "FboCache.h"
 #include "Properties.h"
@@ -62,7 +63,7 @@ uint32_t FboCache::getMaxSize() {
 void FboCache::clear() {
     for (size_t i = 0; i < mCache.size(); i++) {
         const GLuint fbo = mCache.itemAt(i);
-        glDeleteFramebuffers(1, &fbo);
+        Caches::getInstance().deleteFramebuffer(fbo);
     }
     mCache.clear();
 }
@@ -84,7 +85,7 @@ bool FboCache::put(GLuint fbo) {
         return true;
     }
 
-    glDeleteFramebuffers(1, &fbo);
+    Caches::getInstance().deleteFramebuffer(fbo);
     return false;
 }
 
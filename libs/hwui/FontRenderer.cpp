@@ -26,6 +26,7 @@
 #include "Debug.h"
 #include "FontRenderer.h"
 #include "Caches.h"
+#include "utils/Blur.h"
 
 namespace android {
 namespace uirenderer {
@@ -37,28 +38,169 @@ namespace uirenderer {
 #define DEFAULT_TEXT_CACHE_WIDTH 1024
 #define DEFAULT_TEXT_CACHE_HEIGHT 256
 #define MAX_TEXT_CACHE_WIDTH 2048
+#define LARGE_TEXT_CACHE_PAGE_HEIGHT 256
+#define MAX_TEXT_CACHE_PAGE_HEIGHT 512
+#define MAX_TEXT_CACHE_PAGES 4
 #define TEXTURE_BORDER_SIZE 2
 
+#ifndef GL_UNPACK_ROW_LENGTH_EXT
+    #define GL_UNPACK_ROW_LENGTH_EXT 0x0CF2
+#endif
+
 #define AUTO_KERN(prev, next) (((next) - (prev) + 32) >> 6 << 16)
 
 ///////////////////////////////////////////////////////////////////////////////
-// CacheTextureLine
+// CacheTexture
 ///////////////////////////////////////////////////////////////////////////////
 
-bool CacheTextureLine::fitBitmap(const SkGlyph& glyph, uint32_t *retOriginX, uint32_t *retOriginY) {
-    if (glyph.fHeight + TEXTURE_BORDER_SIZE > mMaxHeight) {
-        return false;
+CacheTexture::~CacheTexture() {
+    if (mTexture) {
+        delete[] mTexture;
+    }
+    if (mTextureId) {
+        Caches::getInstance().deleteTexture(mTextureId);
     }
+}
+
+void CacheTexture::reset() {
+    mSkyline.clear();
+
+    CacheSkylineNode node;
+    node.x = 0;
+    node.y = 0;
+    node.width = mWidth;
+    mSkyline.add(node);
+}
 
-    if (mCurrentCol + glyph.fWidth + TEXTURE_BORDER_SIZE < mMaxWidth) {
-        *retOriginX = mCurrentCol + 1;
-        *retOriginY = mCurrentRow + 1;
-        mCurrentCol += glyph.fWidth + TEXTURE_BORDER_SIZE;
+void CacheTexture::markDirty(uint32_t left, uint32_t top, uint32_t right, uint32_t bottom) {
+    if (!mDirty) {
+        mDirtyLeft = left;
+        mDirtyTop = top;
+        mDirtyRight = right;
+        mDirtyBottom = bottom;
         mDirty = true;
-        return true;
+    } else {
+        if (left < mDirtyLeft) mDirtyLeft = left;
+        if (top < mDirtyTop) mDirtyTop = top;
+        if (right > mDirtyRight) mDirtyRight = right;
+        if (bottom > mDirtyBottom) mDirtyBottom = bottom;
+    }
+}
+
+uint32_t CacheTexture::getRemainingCapacity() const {
+    uint32_t remaining = 0;
+    for (size_t i = 0; i < mSkyline.size(); i++) {
+        const CacheSkylineNode& node = mSkyline.itemAt(i);
+        remaining += (mHeight - node.y) * node.width;
+    }
+    return (remaining * 100) / (mWidth * mHeight);
+}
+
+/**
+ * Returns the lowest y coordinate at which a rectangle of the specified size
+ * can be placed if its left edge is aligned with the skyline node at the
+ * specified index, or -1 if the rectangle does not fit.
+ */
+int32_t CacheTexture::fitSkyline(size_t index, uint32_t width, uint32_t height) const {
+    const CacheSkylineNode& first = mSkyline.itemAt(index);
+    if (first.x + width > mWidth) {
+        return -1;
+    }
+
+    // The skyline always covers the entire width of the texture
+    uint32_t y = first.y;
+    uint32_t remaining = width;
+    for (size_t i = index; remaining > 0; i++) {
+        const CacheSkylineNode& node = mSkyline.itemAt(i);
+        if (node.y > y) {
+            y = node.y;
+        }
+        if (y + height > mHeight) {
+            return -1;
+        }
+        remaining = node.width >= remaining ? 0 : remaining - node.width;
+    }
+
+    return y;
+}
+
+void CacheTexture::addSkylineLevel(size_t index, uint32_t x, uint32_t y, uint32_t width) {
+    CacheSkylineNode node;
+    node.x = x;
+    node.y = y;
+    node.width = width;
+    mSkyline.insertAt(node, index);
+
+    // Shrink or remove the levels covered by the new one
+    const uint32_t right = x + width;
+    size_t i = index + 1;
+    while (i < mSkyline.size()) {
+        CacheSkylineNode& current = mSkyline.editItemAt(i);
+        if (current.x >= right) {
+            break;
+        }
+
+        const uint32_t currentRight = current.x + current.width;
+        if (currentRight <= right) {
+            mSkyline.removeAt(i);
+            continue;
+        }
+
+        current.width = currentRight - right;
+        current.x = right;
+        break;
+    }
+
+    // Merge adjacent levels of identical height
+    i = 0;
+    while (i + 1 < mSkyline.size()) {
+        CacheSkylineNode& current = mSkyline.editItemAt(i);
+        const uint16_t nextWidth = mSkyline.itemAt(i + 1).width;
+        if (current.y == mSkyline.itemAt(i + 1).y) {
+            current.width += nextWidth;
+            mSkyline.removeAt(i + 1);
+        } else {
+            i++;
+        }
+    }
+}
+
+bool CacheTexture::fitBitmap(const SkGlyph& glyph, uint32_t* retOriginX, uint32_t* retOriginY) {
+    const uint32_t width = glyph.fWidth + TEXTURE_BORDER_SIZE;
+    const uint32_t height = glyph.fHeight + TEXTURE_BORDER_SIZE;
+
+    if (width > mWidth || height > mHeight) {
+        return false;
     }
 
-    return false;
+    // Bottom-left heuristic: pick the lowest position, then the narrowest level
+    ssize_t bestIndex = -1;
+    uint32_t bestY = mHeight;
+    uint32_t bestWidth = 0;
+
+    for (size_t i = 0; i < mSkyline.size(); i++) {
+        int32_t y = fitSkyline(i, width, height);
+        if (y >= 0) {
+            const CacheSkylineNode& node = mSkyline.itemAt(i);
+            if ((uint32_t) y < bestY || ((uint32_t) y == bestY && node.width < bestWidth)) {
+                bestIndex = i;
+                bestY = y;
+                bestWidth = node.width;
+            }
+        }
+    }
+
+    if (bestIndex < 0) {
+        return false;
+    }
+
+    const uint32_t x = mSkyline.itemAt(bestIndex).x;
+    addSkylineLevel(bestIndex, x, bestY + height, width);
+
+    *retOriginX = x + 1;
+    *retOriginY = bestY + 1;
+
+    return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -87,10 +229,10 @@ Font::~Font() {
     }
 }
 
-void Font::invalidateTextureCache(CacheTextureLine *cacheLine) {
+void Font::invalidateTextureCache(CacheTexture* cacheTexture) {
     for (uint32_t i = 0; i < mCachedGlyphs.size(); i++) {
         CachedGlyphInfo* cachedGlyph = mCachedGlyphs.valueAt(i);
-        if (cacheLine == NULL || cachedGlyph->mCachedTextureLine == cacheLine) {
+        if (cacheTexture == NULL || cachedGlyph->mCacheTexture == cacheTexture) {
             cachedGlyph->mIsValid = false;
         }
     }
@@ -134,7 +276,7 @@ void Font::drawCachedGlyph(CachedGlyphInfo* glyph, int x, int y,
     mState->appendMeshQuad(nPenX, nPenY, u1, v2,
             nPenX + width, nPenY, u2, v2,
             nPenX + width, nPenY - height, u2, v1,
-            nPenX, nPenY - height, u1, v1, glyph->mCachedTextureLine->mCacheTexture);
+            nPenX, nPenY - height, u1, v1, glyph->mCacheTexture);
 }
 
 void Font::drawCachedGlyphBitmap(CachedGlyphInfo* glyph, int x, int y,
@@ -145,7 +287,7 @@ void Font::drawCachedGlyphBitmap(CachedGlyphInfo* glyph, int x, int y,
     uint32_t endX = glyph->mStartX + glyph->mBitmapWidth;
     uint32_t endY = glyph->mStartY + glyph->mBitmapHeight;
 
-    CacheTexture *cacheTexture = glyph->mCachedTextureLine->mCacheTexture;
+    CacheTexture *cacheTexture = glyph->mCacheTexture;
     uint32_t cacheWidth = cacheTexture->mWidth;
     const uint8_t* cacheBuffer = cacheTexture->mTexture;
 
@@ -199,7 +341,7 @@ void Font::drawCachedGlyph(CachedGlyphInfo* glyph, float x, float hOffset, float
             position->fY + destination[2].fY, u2, v1,
             position->fX + destination[3].fX,
             position->fY + destination[3].fY, u1, v1,
-            glyph->mCachedTextureLine->mCacheTexture);
+            glyph->mCacheTexture);
 }
 
 CachedGlyphInfo* Font::getCachedGlyph(SkPaint* paint, glyph_t textUnit) {
@@ -409,8 +551,8 @@ void Font::updateGlyphCache(SkPaint* paint, const SkGlyph& skiaGlyph, CachedGlyp
     glyph->mBitmapWidth = skiaGlyph.fWidth;
     glyph->mBitmapHeight = skiaGlyph.fHeight;
 
-    uint32_t cacheWidth = glyph->mCachedTextureLine->mCacheTexture->mWidth;
-    uint32_t cacheHeight = glyph->mCachedTextureLine->mCacheTexture->mHeight;
+    uint32_t cacheWidth = glyph->mCacheTexture->mWidth;
+    uint32_t cacheHeight = glyph->mCacheTexture->mHeight;
 
     glyph->mBitmapMinU = (float) startX / (float) cacheWidth;
     glyph->mBitmapMinV = (float) startY / (float) cacheHeight;
@@ -473,10 +615,6 @@ FontRenderer::FontRenderer() {
     mTextMeshPtr = NULL;
     mCurrentCacheTexture = NULL;
     mLastCacheTexture = NULL;
-    mCacheTextureSmall = NULL;
-    mCacheTexture128 = NULL;
-    mCacheTexture256 = NULL;
-    mCacheTexture512 = NULL;
 
     mLinearFiltering = false;
 
@@ -484,6 +622,7 @@ FontRenderer::FontRenderer() {
 
     mSmallCacheWidth = DEFAULT_TEXT_CACHE_WIDTH;
     mSmallCacheHeight = DEFAULT_TEXT_CACHE_HEIGHT;
+    mLargeCacheWidth = MAX_TEXT_CACHE_WIDTH;
 
     char property[PROPERTY_VALUE_MAX];
     if (property_get(PROPERTY_TEXT_CACHE_WIDTH, property, NULL) > 0) {
@@ -512,23 +651,19 @@ FontRenderer::FontRenderer() {
 }
 
 FontRenderer::~FontRenderer() {
-    for (uint32_t i = 0; i < mCacheLines.size(); i++) {
-        delete mCacheLines[i];
-    }
-    mCacheLines.clear();
-
     if (mInitialized) {
         // Unbinding the buffer shouldn't be necessary but it crashes with some drivers
         Caches::getInstance().unbindIndicesBuffer();
         glDeleteBuffers(1, &mIndexBufferID);
 
         delete[] mTextMeshPtr;
-        delete mCacheTextureSmall;
-        delete mCacheTexture128;
-        delete mCacheTexture256;
-        delete mCacheTexture512;
     }
 
+    for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+        delete mCacheTextures[i];
+    }
+    mCacheTextures.clear();
+
     Vector<Font*> fontsToDereference = mActiveFonts;
     for (uint32_t i = 0; i < fontsToDereference.size(); i++) {
         delete fontsToDereference[i];
@@ -545,14 +680,14 @@ void FontRenderer::flushAllAndInvalidate() {
         mActiveFonts[i]->invalidateTextureCache();
     }
 
-    for (uint32_t i = 0; i < mCacheLines.size(); i++) {
-        mCacheLines[i]->mCurrentCol = 0;
+    for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+        mCacheTextures[i]->reset();
     }
 }
 
 void FontRenderer::deallocateTextureMemory(CacheTexture *cacheTexture) {
     if (cacheTexture && cacheTexture->mTexture) {
-        glDeleteTextures(1, &cacheTexture->mTextureId);
+        Caches::getInstance().deleteTexture(cacheTexture->mTextureId);
         delete[] cacheTexture->mTexture;
         cacheTexture->mTexture = NULL;
         cacheTexture->mTextureId = 0;
@@ -560,29 +695,30 @@ void FontRenderer::deallocateTextureMemory(CacheTexture *cacheTexture) {
 }
 
 void FontRenderer::flushLargeCaches() {
-    if ((!mCacheTexture128 || !mCacheTexture128->mTexture) &&
-            (!mCacheTexture256 || !mCacheTexture256->mTexture) &&
-            (!mCacheTexture512 || !mCacheTexture512->mTexture)) {
+    if (mCacheTextures.size() <= 1) {
         // Typical case; no large glyph caches allocated
         return;
     }
 
-    for (uint32_t i = 0; i < mCacheLines.size(); i++) {
-        CacheTextureLine* cacheLine = mCacheLines[i];
-        if ((cacheLine->mCacheTexture == mCacheTexture128 ||
-                cacheLine->mCacheTexture == mCacheTexture256 ||
-                cacheLine->mCacheTexture == mCacheTexture512) &&
-                cacheLine->mCacheTexture->mTexture != NULL) {
-            cacheLine->mCurrentCol = 0;
-            for (uint32_t i = 0; i < mActiveFonts.size(); i++) {
-                mActiveFonts[i]->invalidateTextureCache(cacheLine);
-            }
-        }
+    if (mCurrentQuadIndex != 0) {
+        issueDrawCommand();
+        mCurrentQuadIndex = 0;
     }
 
-    deallocateTextureMemory(mCacheTexture128);
-    deallocateTextureMemory(mCacheTexture256);
-    deallocateTextureMemory(mCacheTexture512);
+    for (uint32_t i = 1; i < mCacheTextures.size(); i++) {
+        CacheTexture* cacheTexture = mCacheTextures[i];
+        for (uint32_t j = 0; j < mActiveFonts.size(); j++) {
+            mActiveFonts[j]->invalidateTextureCache(cacheTexture);
+        }
+        if (mCurrentCacheTexture == cacheTexture) {
+            mCurrentCacheTexture = mCacheTextures[0];
+        }
+        if (mLastCacheTexture == cacheTexture) {
+            mLastCacheTexture = NULL;
+        }
+        delete cacheTexture;
+    }
+    mCacheTextures.resize(1);
 }
 
 void FontRenderer::allocateTextureMemory(CacheTexture* cacheTexture) {
@@ -598,8 +734,9 @@ void FontRenderer::allocateTextureMemory(CacheTexture* cacheTexture) {
         glGenTextures(1, &cacheTexture->mTextureId);
     }
 
-    Caches::getInstance().activeTexture(0);
-    glBindTexture(GL_TEXTURE_2D, cacheTexture->mTextureId);
+    Caches& caches = Caches::getInstance();
+    caches.activeTexture(0);
+    caches.bindTexture(cacheTexture->mTextureId);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     // Initialize texture dimensions
     glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, width, height, 0,
@@ -613,11 +750,29 @@ void FontRenderer::allocateTextureMemory(CacheTexture* cacheTexture) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 }
 
+CacheTexture* FontRenderer::addCacheTexture(const SkGlyph& glyph) {
+    if (mCacheTextures.size() >= MAX_TEXT_CACHE_PAGES) {
+        return NULL;
+    }
+
+    // Large pages are shared by all glyphs too big for the first page, the
+    // page is made taller only when the glyph requires it
+    uint32_t height = LARGE_TEXT_CACHE_PAGE_HEIGHT;
+    if (glyph.fHeight + TEXTURE_BORDER_SIZE > height) {
+        height = MAX_TEXT_CACHE_PAGE_HEIGHT;
+    }
+
+    CacheTexture* cacheTexture = createCacheTexture(mLargeCacheWidth, height, true);
+    mCacheTextures.push(cacheTexture);
+    return cacheTexture;
+}
+
 void FontRenderer::cacheBitmap(const SkGlyph& glyph, CachedGlyphInfo* cachedGlyph,
         uint32_t* retOriginX, uint32_t* retOriginY) {
     cachedGlyph->mIsValid = false;
     // If the glyph is too tall, don't cache it
-    if (glyph.fHeight + TEXTURE_BORDER_SIZE > mCacheLines[mCacheLines.size() - 1]->mMaxHeight) {
+    if (glyph.fHeight + TEXTURE_BORDER_SIZE > MAX_TEXT_CACHE_PAGE_HEIGHT ||
+            glyph.fWidth + TEXTURE_BORDER_SIZE > mLargeCacheWidth) {
         ALOGE("Font size to large to fit in cache. width, height = %i, %i",
                 (int) glyph.fWidth, (int) glyph.fHeight);
         return;
@@ -627,36 +782,41 @@ void FontRenderer::cacheBitmap(const SkGlyph& glyph, CachedGlyphInfo* cachedGlyp
     uint32_t startX = 0;
     uint32_t startY = 0;
 
-    bool bitmapFit = false;
-    CacheTextureLine *cacheLine;
-    for (uint32_t i = 0; i < mCacheLines.size(); i++) {
-        bitmapFit = mCacheLines[i]->fitBitmap(glyph, &startX, &startY);
-        if (bitmapFit) {
-            cacheLine = mCacheLines[i];
+    CacheTexture* cacheTexture = NULL;
+    for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+        if (mCacheTextures[i]->fitBitmap(glyph, &startX, &startY)) {
+            cacheTexture = mCacheTextures[i];
             break;
         }
     }
 
-    // If the new glyph didn't fit, flush the state so far and invalidate everything
-    if (!bitmapFit) {
+    // If the glyph didn't fit in any page, grow the cache by one page
+    if (!cacheTexture) {
+        cacheTexture = addCacheTexture(glyph);
+        if (cacheTexture && !cacheTexture->fitBitmap(glyph, &startX, &startY)) {
+            cacheTexture = NULL;
+        }
+    }
+
+    // If the cache cannot grow anymore, flush the state so far and invalidate everything
+    if (!cacheTexture) {
         flushAllAndInvalidate();
 
         // Try to fit it again
-        for (uint32_t i = 0; i < mCacheLines.size(); i++) {
-            bitmapFit = mCacheLines[i]->fitBitmap(glyph, &startX, &startY);
-            if (bitmapFit) {
-                cacheLine = mCacheLines[i];
+        for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+            if (mCacheTextures[i]->fitBitmap(glyph, &startX, &startY)) {
+                cacheTexture = mCacheTextures[i];
                 break;
             }
         }
 
         // if we still don't fit, something is wrong and we shouldn't draw
-        if (!bitmapFit) {
+        if (!cacheTexture) {
             return;
         }
     }
 
-    cachedGlyph->mCachedTextureLine = cacheLine;
+    cachedGlyph->mCacheTexture = cacheTexture;
 
     *retOriginX = startX;
     *retOriginY = startY;
@@ -664,9 +824,8 @@ void FontRenderer::cacheBitmap(const SkGlyph& glyph, CachedGlyphInfo* cachedGlyp
     uint32_t endX = startX + glyph.fWidth;
     uint32_t endY = startY + glyph.fHeight;
 
-    uint32_t cacheWidth = cacheLine->mMaxWidth;
+    uint32_t cacheWidth = cacheTexture->mWidth;
 
-    CacheTexture* cacheTexture = cacheLine->mCacheTexture;
     if (!cacheTexture->mTexture) {
         // Large-glyph texture memory is allocated only as needed
         allocateTextureMemory(cacheTexture);
@@ -676,6 +835,11 @@ void FontRenderer::cacheBitmap(const SkGlyph& glyph, CachedGlyphInfo* cachedGlyp
     uint8_t* bitmapBuffer = (uint8_t*) glyph.fImage;
     unsigned int stride = glyph.rowBytes();
 
+    // Clear the border around the glyph, the space may have been used before
+    for (uint32_t cacheY = startY - 1; cacheY < endY + 1; cacheY++) {
+        memset(cacheBuffer + cacheY * cacheWidth + startX - 1, 0, glyph.fWidth + 2);
+    }
+
     uint32_t cacheX = 0, bX = 0, cacheY = 0, bY = 0;
     for (cacheX = startX, bX = 0; cacheX < endX; cacheX++, bX++) {
         for (cacheY = startY, bY = 0; cacheY < endY; cacheY++, bY++) {
@@ -684,12 +848,12 @@ void FontRenderer::cacheBitmap(const SkGlyph& glyph, CachedGlyphInfo* cachedGlyp
         }
     }
 
+    cacheTexture->markDirty(startX - 1, startY - 1, endX + 1, endY + 1);
     cachedGlyph->mIsValid = true;
 }
 
 CacheTexture* FontRenderer::createCacheTexture(int width, int height, bool allocate) {
-    uint8_t* textureMemory = NULL;
-    CacheTexture* cacheTexture = new CacheTexture(textureMemory, width, height);
+    CacheTexture* cacheTexture = new CacheTexture(width, height);
 
     if (allocate) {
         allocateTextureMemory(cacheTexture);
@@ -699,19 +863,12 @@ CacheTexture* FontRenderer::createCacheTexture(int width, int height, bool alloc
 }
 
 void FontRenderer::initTextTexture() {
-    for (uint32_t i = 0; i < mCacheLines.size(); i++) {
-        delete mCacheLines[i];
-    }
-    mCacheLines.clear();
-
-    if (mCacheTextureSmall) {
-        delete mCacheTextureSmall;
-        delete mCacheTexture128;
-        delete mCacheTexture256;
-        delete mCacheTexture512;
+    for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+        delete mCacheTextures[i];
     }
+    mCacheTextures.clear();
 
-    // Next, use other, separate caches for large glyphs.
+    // Larger glyphs are stored in additional pages as wide as possible
     uint16_t maxWidth = 0;
     if (Caches::hasInstance()) {
         maxWidth = Caches::getInstance().maxTextureSize;
@@ -720,36 +877,13 @@ void FontRenderer::initTextTexture() {
     if (maxWidth > MAX_TEXT_CACHE_WIDTH || maxWidth == 0) {
         maxWidth = MAX_TEXT_CACHE_WIDTH;
     }
+    mLargeCacheWidth = maxWidth;
 
-    mCacheTextureSmall = createCacheTexture(mSmallCacheWidth, mSmallCacheHeight, true);
-    mCacheTexture128 = createCacheTexture(maxWidth, 256, false);
-    mCacheTexture256 = createCacheTexture(maxWidth, 256, false);
-    mCacheTexture512 = createCacheTexture(maxWidth, 512, false);
-    mCurrentCacheTexture = mCacheTextureSmall;
+    mCurrentCacheTexture = createCacheTexture(mSmallCacheWidth, mSmallCacheHeight, true);
+    mCacheTextures.push(mCurrentCacheTexture);
+    mLastCacheTexture = NULL;
 
     mUploadTexture = false;
-    // Split up our default cache texture into lines of certain widths
-    int nextLine = 0;
-    mCacheLines.push(new CacheTextureLine(mSmallCacheWidth, 18, nextLine, 0, mCacheTextureSmall));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(mSmallCacheWidth, 26, nextLine, 0, mCacheTextureSmall));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(mSmallCacheWidth, 26, nextLine, 0, mCacheTextureSmall));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(mSmallCacheWidth, 34, nextLine, 0, mCacheTextureSmall));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(mSmallCacheWidth, 34, nextLine, 0, mCacheTextureSmall));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(mSmallCacheWidth, 42, nextLine, 0, mCacheTextureSmall));
-    nextLine += mCacheLines.top()->mMaxHeight;
-    mCacheLines.push(new CacheTextureLine(mSmallCacheWidth, mSmallCacheHeight - nextLine,
-            nextLine, 0, mCacheTextureSmall));
-
-    //  The first cache is split into 2 lines of height 128, the rest have just one cache line.
-    mCacheLines.push(new CacheTextureLine(maxWidth, 128, 0, 0, mCacheTexture128));
-    mCacheLines.push(new CacheTextureLine(maxWidth, 128, 128, 0, mCacheTexture128));
-    mCacheLines.push(new CacheTextureLine(maxWidth, 256, 0, 0, mCacheTexture256));
-    mCacheLines.push(new CacheTextureLine(maxWidth, 512, 0, 0, mCacheTexture512));
 }
 
 // Avoid having to reallocate memory and render quad by quad
@@ -797,38 +931,64 @@ void FontRenderer::checkInit() {
     mInitialized = true;
 }
 
+void FontRenderer::uploadCacheTexture(CacheTexture* cacheTexture) {
+    const uint32_t width = cacheTexture->mWidth;
+    const uint32_t top = cacheTexture->mDirtyTop;
+    const uint32_t height = cacheTexture->mDirtyBottom - top;
+
+    if (Caches::getInstance().extensions.hasUnpackSubImage()) {
+        // Only upload the modified sub-region of the page
+        const uint32_t left = cacheTexture->mDirtyLeft;
+        void* textureData = cacheTexture->mTexture + top * width + left;
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, width);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, left, top, cacheTexture->mDirtyRight - left, height,
+                GL_ALPHA, GL_UNSIGNED_BYTE, textureData);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH_EXT, 0);
+    } else {
+        // Without GL_EXT_unpack_subimage, upload the modified rows only
+        void* textureData = cacheTexture->mTexture + top * width;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, top, width, height,
+                GL_ALPHA, GL_UNSIGNED_BYTE, textureData);
+    }
+
+    cacheTexture->mDirty = false;
+}
+
+GLuint FontRenderer::getTexture(bool linearFiltering) {
+    checkInit();
+
+    if (linearFiltering != mCurrentCacheTexture->mLinearFiltering) {
+        mCurrentCacheTexture->mLinearFiltering = linearFiltering;
+        mLinearFiltering = linearFiltering;
+        const GLenum filtering = linearFiltering ? GL_LINEAR : GL_NEAREST;
+
+        Caches::getInstance().bindTexture(mCurrentCacheTexture->mTextureId);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filtering);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filtering);
+    }
+
+    return mCurrentCacheTexture->mTextureId;
+}
+
 void FontRenderer::checkTextureUpdate() {
     if (!mUploadTexture && mLastCacheTexture == mCurrentCacheTexture) {
         return;
     }
 
     Caches& caches = Caches::getInstance();
-    GLuint lastTextureId = 0;
-    // Iterate over all the cache lines and see which ones need to be updated
-    for (uint32_t i = 0; i < mCacheLines.size(); i++) {
-        CacheTextureLine* cl = mCacheLines[i];
-        if (cl->mDirty && cl->mCacheTexture->mTexture != NULL) {
-            CacheTexture* cacheTexture = cl->mCacheTexture;
-            uint32_t xOffset = 0;
-            uint32_t yOffset = cl->mCurrentRow;
-            uint32_t width   = cl->mMaxWidth;
-            uint32_t height  = cl->mMaxHeight;
-            void* textureData = cacheTexture->mTexture + (yOffset * width);
-
-            if (cacheTexture->mTextureId != lastTextureId) {
-                caches.activeTexture(0);
-                glBindTexture(GL_TEXTURE_2D, cacheTexture->mTextureId);
-                lastTextureId = cacheTexture->mTextureId;
-            }
-            glTexSubImage2D(GL_TEXTURE_2D, 0, xOffset, yOffset, width, height,
-                    GL_ALPHA, GL_UNSIGNED_BYTE, textureData);
-
-            cl->mDirty = false;
+    // Iterate over all the pages and upload the ones that were modified
+    for (uint32_t i = 0; i < mCacheTextures.size(); i++) {
+        CacheTexture* cacheTexture = mCacheTextures[i];
+        if (cacheTexture->mDirty && cacheTexture->mTexture != NULL) {
+            caches.activeTexture(0);
+            caches.bindTexture(cacheTexture->mTextureId);
+            uploadCacheTexture(cacheTexture);
         }
     }
 
     caches.activeTexture(0);
-    glBindTexture(GL_TEXTURE_2D, mCurrentCacheTexture->mTextureId);
+    caches.bindTexture(mCurrentCacheTexture->mTextureId);
     if (mLinearFiltering != mCurrentCacheTexture->mLinearFiltering) {
         const GLenum filtering = mLinearFiltering ? GL_LINEAR : GL_NEAREST;
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filtering);
@@ -944,14 +1104,8 @@ void FontRenderer::appendRotatedMeshQuad(float x1, float y1, float u1, float v1,
 }
 
 uint32_t FontRenderer::getRemainingCacheCapacity() {
-    uint32_t remainingCapacity = 0;
-    float totalPixels = 0;
-    for(uint32_t i = 0; i < mCacheLines.size(); i ++) {
-         remainingCapacity += (mCacheLines[i]->mMaxWidth - mCacheLines[i]->mCurrentCol);
-         totalPixels += mCacheLines[i]->mMaxWidth;
-    }
-    remainingCapacity = (remainingCapacity * 100) / totalPixels;
-    return remainingCapacity;
+    // Common glyphs are precached in the first page only
+    return mCacheTextures[0]->getRemainingCapacity();
 }
 
 void FontRenderer::precacheLatin(SkPaint* paint) {
@@ -999,7 +1153,7 @@ void FontRenderer::setFont(SkPaint* paint, uint32_t fontId, float fontSize) {
 }
 
 FontRenderer::DropShadow FontRenderer::renderDropShadow(SkPaint* paint, const char *text,
-        uint32_t startIndex, uint32_t len, int numGlyphs, uint32_t radius) {
+        uint32_t startIndex, uint32_t len, int numGlyphs, uint32_t radius, bool blur) {
     checkInit();
 
     if (!mCurrentFont) {
@@ -1032,7 +1186,9 @@ FontRenderer::DropShadow FontRenderer::renderDropShadow(SkPaint* paint, const ch
 
     mCurrentFont->render(paint, text, startIndex, len, numGlyphs, penX, penY,
             dataBuffer, paddedWidth, paddedHeight);
-    blurImage(dataBuffer, paddedWidth, paddedHeight, radius);
+    if (blur) {
+        Blur::blurImage(dataBuffer, paddedWidth, paddedHeight, radius);
+    }
 
     DropShadow image;
     image.width = paddedWidth;
@@ -1106,145 +1262,5 @@ bool FontRenderer::renderTextOnPath(SkPaint* paint, const Rect* clip, const char
     return mDrawn;
 }
 
-void FontRenderer::computeGaussianWeights(float* weights, int32_t radius) {
-    // Compute gaussian weights for the blur
-    // e is the euler's number
-    float e = 2.718281828459045f;
-    float pi = 3.1415926535897932f;
-    // g(x) = ( 1 / sqrt( 2 * pi ) * sigma) * e ^ ( -x^2 / 2 * sigma^2 )
-    // x is of the form [-radius .. 0 .. radius]
-    // and sigma varies with radius.
-    // Based on some experimental radius values and sigma's
-    // we approximately fit sigma = f(radius) as
-    // sigma = radius * 0.3  + 0.6
-    // The larger the radius gets, the more our gaussian blur
-    // will resemble a box blur since with large sigma
-    // the gaussian curve begins to lose its shape
-    float sigma = 0.3f * (float) radius + 0.6f;
-
-    // Now compute the coefficints
-    // We will store some redundant values to save some math during
-    // the blur calculations
-    // precompute some values
-    float coeff1 = 1.0f / (sqrt( 2.0f * pi ) * sigma);
-    float coeff2 = - 1.0f / (2.0f * sigma * sigma);
-
-    float normalizeFactor = 0.0f;
-    for (int32_t r = -radius; r <= radius; r ++) {
-        float floatR = (float) r;
-        weights[r + radius] = coeff1 * pow(e, floatR * floatR * coeff2);
-        normalizeFactor += weights[r + radius];
-    }
-
-    //Now we need to normalize the weights because all our coefficients need to add up to one
-    normalizeFactor = 1.0f / normalizeFactor;
-    for (int32_t r = -radius; r <= radius; r ++) {
-        weights[r + radius] *= normalizeFactor;
-    }
-}
-
-void FontRenderer::horizontalBlur(float* weights, int32_t radius,
-        const uint8_t* source, uint8_t* dest, int32_t width, int32_t height) {
-    float blurredPixel = 0.0f;
-    float currentPixel = 0.0f;
-
-    for (int32_t y = 0; y < height; y ++) {
-
-        const uint8_t* input = source + y * width;
-        uint8_t* output = dest + y * width;
-
-        for (int32_t x = 0; x < width; x ++) {
-            blurredPixel = 0.0f;
-            const float* gPtr = weights;
-            // Optimization for non-border pixels
-            if (x > radius && x < (width - radius)) {
-                const uint8_t *i = input + (x - radius);
-                for (int r = -radius; r <= radius; r ++) {
-                    currentPixel = (float) (*i);
-                    blurredPixel += currentPixel * gPtr[0];
-                    gPtr++;
-                    i++;
-                }
-            } else {
-                for (int32_t r = -radius; r <= radius; r ++) {
-                    // Stepping left and right away from the pixel
-                    int validW = x + r;
-                    if (validW < 0) {
-                        validW = 0;
-                    }
-                    if (validW > width - 1) {
-                        validW = width - 1;
-                    }
-
-                    currentPixel = (float) input[validW];
-                    blurredPixel += currentPixel * gPtr[0];
-                    gPtr++;
-                }
-            }
-            *output = (uint8_t)blurredPixel;
-            output ++;
-        }
-    }
-}
-
-void FontRenderer::verticalBlur(float* weights, int32_t radius,
-        const uint8_t* source, uint8_t* dest, int32_t width, int32_t height) {
-    float blurredPixel = 0.0f;
-    float currentPixel = 0.0f;
-
-    for (int32_t y = 0; y < height; y ++) {
-
-        uint8_t* output = dest + y * width;
-
-        for (int32_t x = 0; x < width; x ++) {
-            blurredPixel = 0.0f;
-            const float* gPtr = weights;
-            const uint8_t* input = source + x;
-            // Optimization for non-border pixels
-            if (y > radius && y < (height - radius)) {
-                const uint8_t *i = input + ((y - radius) * width);
-                for (int32_t r = -radius; r <= radius; r ++) {
-                    currentPixel = (float)(*i);
-                    blurredPixel += currentPixel * gPtr[0];
-                    gPtr++;
-                    i += width;
-                }
-            } else {
-                for (int32_t r = -radius; r <= radius; r ++) {
-                    int validH = y + r;
-                    // Clamp to zero and width
-                    if (validH < 0) {
-                        validH = 0;
-                    }
-                    if (validH > height - 1) {
-                        validH = height - 1;
-                    }
-
-                    const uint8_t *i = input + validH * width;
-                    currentPixel = (float) (*i);
-                    blurredPixel += currentPixel * gPtr[0];
-                    gPtr++;
-                }
-            }
-            *output = (uint8_t) blurredPixel;
-            output ++;
-        }
-    }
-}
-
-
-void FontRenderer::blurImage(uint8_t *image, int32_t width, int32_t height, int32_t radius) {
-    float *gaussian = new float[2 * radius + 1];
-    computeGaussianWeights(gaussian, radius);
-
-    uint8_t* scratch = new uint8_t[width * height];
-
-    horizontalBlur(gaussian, radius, image, scratch, width, height);
-    verticalBlur(gaussian, radius, scratch, image, width, height);
-
-    delete[] gaussian;
-    delete[] scratch;
-}
-
 }; // namespace uirenderer
 }; // namespace android
@@ -59,48 +59,69 @@ namespace uirenderer {
 
 class FontRenderer;
 
+/**
+ * Horizontal segment of the skyline used to pack glyphs in a cache texture.
+ * All the pixels of the texture above y, between x and x + width, are used.
+ */
+struct CacheSkylineNode {
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+};
+
+/**
+ * A page of the glyph cache. Glyphs are packed in the page using a bottom-left
+ * skyline packer. The page keeps track of the area modified since the last
+ * upload so that only that sub-region is sent to the GPU.
+ */
 class CacheTexture {
 public:
-    CacheTexture() { }
-    CacheTexture(uint8_t* texture, uint16_t width, uint16_t height) :
-            mTexture(texture), mTextureId(0), mWidth(width), mHeight(height),
-            mLinearFiltering(false) { }
-    ~CacheTexture() {
-        if (mTexture) {
-            delete[] mTexture;
-        }
-        if (mTextureId) {
-            glDeleteTextures(1, &mTextureId);
-        }
+    CacheTexture(uint16_t width, uint16_t height) :
+            mTexture(NULL), mTextureId(0), mWidth(width), mHeight(height),
+            mLinearFiltering(false), mDirty(false) {
+        reset();
     }
 
+    ~CacheTexture();
+
+    /**
+     * Finds room for the specified glyph in this page. Returns false if the
+     * glyph does not fit. The returned origin excludes the glyph's border.
+     */
+    bool fitBitmap(const SkGlyph& glyph, uint32_t* retOriginX, uint32_t* retOriginY);
+
+    /**
+     * Marks all the space in this page as free.
+     */
+    void reset();
+
+    /**
+     * Adds the specified area to the region that must be uploaded.
+     */
+    void markDirty(uint32_t left, uint32_t top, uint32_t right, uint32_t bottom);
+
+    /**
+     * Returns the percentage of the page still available above the skyline.
+     */
+    uint32_t getRemainingCapacity() const;
+
     uint8_t* mTexture;
     GLuint mTextureId;
     uint16_t mWidth;
     uint16_t mHeight;
     bool mLinearFiltering;
-};
 
-class CacheTextureLine {
-public:
-    CacheTextureLine(uint16_t maxWidth, uint16_t maxHeight, uint32_t currentRow,
-            uint32_t currentCol, CacheTexture* cacheTexture):
-                mMaxHeight(maxHeight),
-                mMaxWidth(maxWidth),
-                mCurrentRow(currentRow),
-                mCurrentCol(currentCol),
-                mDirty(false),
-                mCacheTexture(cacheTexture) {
-    }
+    bool mDirty;
+    uint32_t mDirtyLeft;
+    uint32_t mDirtyTop;
+    uint32_t mDirtyRight;
+    uint32_t mDirtyBottom;
 
-    bool fitBitmap(const SkGlyph& glyph, uint32_t *retOriginX, uint32_t *retOriginY);
+private:
+    int32_t fitSkyline(size_t index, uint32_t width, uint32_t height) const;
+    void addSkylineLevel(size_t index, uint32_t x, uint32_t y, uint32_t width);
 
-    uint16_t mMaxHeight;
-    uint16_t mMaxWidth;
-    uint32_t mCurrentRow;
-    uint32_t mCurrentCol;
-    bool mDirty;
-    CacheTexture* mCacheTexture;
+    Vector<CacheSkylineNode> mSkyline;
 };
 
 struct CachedGlyphInfo {
@@ -128,7 +149,7 @@ struct CachedGlyphInfo {
     // Auto-kerning
     SkFixed mLsbDelta;
     SkFixed mRsbDelta;
-    CacheTextureLine* mCachedTextureLine;
+    CacheTexture* mCacheTexture;
 };
 
 
@@ -193,7 +214,7 @@ protected:
     // Cache of glyphs
     DefaultKeyedVector<glyph_t, CachedGlyphInfo*> mCachedGlyphs;
 
-    void invalidateTextureCache(CacheTextureLine *cacheLine = NULL);
+    void invalidateTextureCache(CacheTexture* cacheTexture = NULL);
 
     CachedGlyphInfo* cacheGlyph(SkPaint* paint, glyph_t glyph);
     void updateGlyphCache(SkPaint* paint, const SkGlyph& skiaGlyph, CachedGlyphInfo* glyph);
@@ -273,38 +294,20 @@ public:
 
     // After renderDropShadow returns, the called owns the memory in DropShadow.image
     // and is responsible for releasing it when it's done with it
+    // If blur is false, the text is rendered with the padding required by the
+    // radius but the caller is responsible for blurring the image
     DropShadow renderDropShadow(SkPaint* paint, const char *text, uint32_t startIndex,
-            uint32_t len, int numGlyphs, uint32_t radius);
+            uint32_t len, int numGlyphs, uint32_t radius, bool blur = true);
 
-    GLuint getTexture(bool linearFiltering = false) {
-        checkInit();
-
-        if (linearFiltering != mCurrentCacheTexture->mLinearFiltering) {
-            mCurrentCacheTexture->mLinearFiltering = linearFiltering;
-            mLinearFiltering = linearFiltering;
-            const GLenum filtering = linearFiltering ? GL_LINEAR : GL_NEAREST;
-
-            glBindTexture(GL_TEXTURE_2D, mCurrentCacheTexture->mTextureId);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filtering);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filtering);
-        }
-
-        return mCurrentCacheTexture->mTextureId;
-    }
+    GLuint getTexture(bool linearFiltering = false);
 
     uint32_t getCacheSize() const {
         uint32_t size = 0;
-        if (mCacheTextureSmall != NULL && mCacheTextureSmall->mTexture != NULL) {
-            size += mCacheTextureSmall->mWidth * mCacheTextureSmall->mHeight;
-        }
-        if (mCacheTexture128 != NULL && mCacheTexture128->mTexture != NULL) {
-            size += mCacheTexture128->mWidth * mCacheTexture128->mHeight;
-        }
-        if (mCacheTexture256 != NULL && mCacheTexture256->mTexture != NULL) {
-            size += mCacheTexture256->mWidth * mCacheTexture256->mHeight;
-        }
-        if (mCacheTexture512 != NULL && mCacheTexture512->mTexture != NULL) {
-            size += mCacheTexture512->mWidth * mCacheTexture512->mHeight;
+        for (size_t i = 0; i < mCacheTextures.size(); i++) {
+            CacheTexture* cacheTexture = mCacheTextures.itemAt(i);
+            if (cacheTexture->mTexture != NULL) {
+                size += cacheTexture->mWidth * cacheTexture->mHeight;
+            }
         }
         return size;
     }
@@ -318,6 +321,7 @@ protected:
     void deallocateTextureMemory(CacheTexture* cacheTexture);
     void initTextTexture();
     CacheTexture* createCacheTexture(int width, int height, bool allocate);
+    CacheTexture* addCacheTexture(const SkGlyph& glyph);
     void cacheBitmap(const SkGlyph& glyph, CachedGlyphInfo* cachedGlyph,
             uint32_t *retOriginX, uint32_t *retOriginY);
 
@@ -346,8 +350,11 @@ protected:
 
     uint32_t mSmallCacheWidth;
     uint32_t mSmallCacheHeight;
+    uint32_t mLargeCacheWidth;
 
-    Vector<CacheTextureLine*> mCacheLines;
+    // The first page is always allocated, the other pages are added
+    // on demand and released by flushLargeCaches()
+    Vector<CacheTexture*> mCacheTextures;
     uint32_t getRemainingCacheCapacity();
 
     Font* mCurrentFont;
@@ -355,11 +362,8 @@ protected:
 
     CacheTexture* mCurrentCacheTexture;
     CacheTexture* mLastCacheTexture;
-    CacheTexture* mCacheTextureSmall;
-    CacheTexture* mCacheTexture128;
-    CacheTexture* mCacheTexture256;
-    CacheTexture* mCacheTexture512;
 
+    void uploadCacheTexture(CacheTexture* cacheTexture);
     void checkTextureUpdate();
     bool mUploadTexture;
 
@@ -377,13 +381,6 @@ protected:
     bool mInitialized;
 
     bool mLinearFiltering;
-
-    void computeGaussianWeights(float* weights, int32_t radius);
-    void horizontalBlur(float* weights, int32_t radius, const uint8_t *source, uint8_t *dest,
-            int32_t width, int32_t height);
-    void verticalBlur(float* weights, int32_t radius, const uint8_t *source, uint8_t *dest,
-            int32_t width, int32_t height);
-    void blurImage(uint8_t* image, int32_t width, int32_t height, int32_t radius);
 };
 
 }; // namespace uirenderer
@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <string.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2ext.h>
+
+#include <utils/Log.h>
+
+#include "FrameStats.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Timer queries
+///////////////////////////////////////////////////////////////////////////////
+
+// GL_EXT_disjoint_timer_query
+#ifndef GL_TIME_ELAPSED_EXT
+    #define GL_TIME_ELAPSED_EXT 0x88BF
+#endif
+#ifndef GL_QUERY_RESULT_EXT
+    #define GL_QUERY_RESULT_EXT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE_EXT
+    #define GL_QUERY_RESULT_AVAILABLE_EXT 0x8867
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+    #define GL_GPU_DISJOINT_EXT 0x8FBB
+#endif
+
+typedef void (GL_APIENTRYP GenQueriesProc) (GLsizei n, GLuint* ids);
+typedef void (GL_APIENTRYP DeleteQueriesProc) (GLsizei n, const GLuint* ids);
+typedef void (GL_APIENTRYP BeginQueryProc) (GLenum target, GLuint id);
+typedef void (GL_APIENTRYP EndQueryProc) (GLenum target);
+typedef void (GL_APIENTRYP GetQueryObjectuivProc) (GLuint id, GLenum pname, GLuint* params);
+typedef void (GL_APIENTRYP GetQueryObjectui64vProc) (GLuint id, GLenum pname, uint64_t* params);
+
+static GenQueriesProc sGenQueries = NULL;
+static DeleteQueriesProc sDeleteQueries = NULL;
+static BeginQueryProc sBeginQuery = NULL;
+static EndQueryProc sEndQuery = NULL;
+static GetQueryObjectuivProc sGetQueryObjectuiv = NULL;
+static GetQueryObjectui64vProc sGetQueryObjectui64v = NULL;
+
+static bool loadTimerQueries() {
+    sGenQueries = (GenQueriesProc) eglGetProcAddress("glGenQueriesEXT");
+    sDeleteQueries = (DeleteQueriesProc) eglGetProcAddress("glDeleteQueriesEXT");
+    sBeginQuery = (BeginQueryProc) eglGetProcAddress("glBeginQueryEXT");
+    sEndQuery = (EndQueryProc) eglGetProcAddress("glEndQueryEXT");
+    sGetQueryObjectuiv = (GetQueryObjectuivProc) eglGetProcAddress("glGetQueryObjectuivEXT");
+    sGetQueryObjectui64v = (GetQueryObjectui64vProc)
+            eglGetProcAddress("glGetQueryObjectui64vEXT");
+
+    return sGenQueries && sDeleteQueries && sBeginQuery && sEndQuery &&
+            sGetQueryObjectuiv && sGetQueryObjectui64v;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+FrameStats::FrameStats(): mEnabled(false), mHasTimerQuery(false), mFrameStart(0),
+        mActiveQuery(NULL), mTimeOps(false), mTimedOp(-1), mTimedOpStart(0), mFrameCount(0), mRecordTime(0), mRecordStart(0), mRecordDepth(0) {
+    resetCurrent();
+    memset(mOpTimes, 0, sizeof(mOpTimes));
+}
+
+FrameStats::~FrameStats() {
+}
+
+void FrameStats::init(bool enabled, bool hasTimerQuery) {
+    mEnabled = enabled;
+    mHasTimerQuery = enabled && hasTimerQuery && loadTimerQueries();
+
+    if (mHasTimerQuery) {
+        for (uint32_t i = 0; i < FRAME_STATS_GPU_QUERIES; i++) {
+            mQueries[i] = Query();
+            sGenQueries(1, &mQueries[i].id);
+        }
+    }
+}
+
+void FrameStats::terminate() {
+    if (mHasTimerQuery) {
+        if (mActiveQuery) sEndQuery(GL_TIME_ELAPSED_EXT);
+        for (uint32_t i = 0; i < FRAME_STATS_GPU_QUERIES; i++) {
+            sDeleteQueries(1, &mQueries[i].id);
+            mQueries[i] = Query();
+        }
+        mHasTimerQuery = false;
+    }
+    mActiveQuery = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Recording
+///////////////////////////////////////////////////////////////////////////////
+
+void FrameStats::beginRecording() {
+    if (!mEnabled) return;
+
+    // Display lists are recorded while their parents are recorded
+    Mutex::Autolock _l(mLock);
+    if (mRecordDepth++ == 0) {
+        mRecordStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+}
+
+void FrameStats::endRecording() {
+    if (!mEnabled) return;
+
+    Mutex::Autolock _l(mLock);
+    if (mRecordDepth > 0 && --mRecordDepth == 0) {
+        mRecordTime += systemTime(SYSTEM_TIME_MONOTONIC) - mRecordStart;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Frames
+///////////////////////////////////////////////////////////////////////////////
+
+void FrameStats::resetCurrent() {
+    memset(&mCurrent, 0, sizeof(FrameInfo));
+    mCurrent.gpuTime = -1;
+}
+
+void FrameStats::beginFrame() {
+    if (!mEnabled) return;
+
+    resetCurrent();
+    mFrameStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    mTimedOp = -1;
+
+    if (mHasTimerQuery) {
+        collectQueries();
+
+        for (uint32_t i = 0; i < FRAME_STATS_GPU_QUERIES; i++) {
+            if (!mQueries[i].pending) {
+                mActiveQuery = &mQueries[i];
+                break;
+            }
+        }
+
+        // Frames are skipped when the GPU is too far behind
+        if (mActiveQuery) {
+            sBeginQuery(GL_TIME_ELAPSED_EXT, mActiveQuery->id);
+        }
+    }
+}
+
+void FrameStats::endFrame() {
+    if (!mEnabled) return;
+
+    mCurrent.replayTime = systemTime(SYSTEM_TIME_MONOTONIC) - mFrameStart;
+    if (mTimeOps) timeOp(-1);
+
+    Mutex::Autolock _l(mLock);
+    mCurrent.frame = mFrameCount;
+    mCurrent.recordTime = mRecordTime;
+    mRecordTime = 0;
+
+    if (mActiveQuery) {
+        sEndQuery(GL_TIME_ELAPSED_EXT);
+        mActiveQuery->frame = mFrameCount;
+        mActiveQuery->pending = true;
+        mActiveQuery = NULL;
+    }
+
+    mFrames[mFrameCount % FRAME_STATS_COUNT] = mCurrent;
+    mFrameCount++;
+}
+
+void FrameStats::collectQueries() {
+    // Measures are meaningless after a disjoint operation
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+    for (uint32_t i = 0; i < FRAME_STATS_GPU_QUERIES; i++) {
+        Query& query = mQueries[i];
+        if (!query.pending) continue;
+
+        GLuint available = 0;
+        sGetQueryObjectuiv(query.id, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+        if (!available) continue;
+
+        uint64_t elapsed = 0;
+        sGetQueryObjectui64v(query.id, GL_QUERY_RESULT_EXT, &elapsed);
+        query.pending = false;
+
+        Mutex::Autolock _l(mLock);
+        if (!disjoint && mFrameCount - query.frame <= FRAME_STATS_COUNT) {
+            mFrames[query.frame % FRAME_STATS_COUNT].gpuTime = nsecs_t(elapsed);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Operations
+///////////////////////////////////////////////////////////////////////////////
+
+void FrameStats::setOpTimingEnabled(bool enabled) {
+    mTimeOps = enabled;
+    mTimedOp = -1;
+    memset(mOpTimes, 0, sizeof(mOpTimes));
+}
+
+void FrameStats::timeOp(int op) {
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (mTimedOp >= 0 && mTimedOp < FRAME_STATS_OP_COUNT) {
+        mOpTimes[mTimedOp] += now - mTimedOpStart;
+    }
+    mTimedOp = op;
+    mTimedOpStart = now;
+}
+
+void FrameStats::getOpTimes(nsecs_t* times) {
+    memcpy(times, mOpTimes, sizeof(mOpTimes));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Output
+///////////////////////////////////////////////////////////////////////////////
+
+size_t FrameStats::getFrames(FrameInfo* frames, size_t count) {
+    Mutex::Autolock _l(mLock);
+
+    const uint32_t available = mFrameCount < FRAME_STATS_COUNT ? mFrameCount : FRAME_STATS_COUNT;
+    if (count > available) count = available;
+
+    for (size_t i = 0; i < count; i++) {
+        frames[i] = mFrames[(mFrameCount - count + i) % FRAME_STATS_COUNT];
+    }
+
+    return count;
+}
+
+static inline float toMs(nsecs_t time) {
+    return time / 1000000.0f;
+}
+
+void FrameStats::dump(String8& log, const char* opNames[], uint32_t opNameCount) {
+    if (!mEnabled) return;
+
+    FrameInfo* frames = new FrameInfo[FRAME_STATS_COUNT];
+    const size_t count = getFrames(frames, FRAME_STATS_COUNT);
+
+    log.appendFormat("Frame statistics (%d frames):\n", count);
+    log.appendFormat("  %8s %8s %8s %8s %6s %8s %8s %8s %5s %8s\n", "Frame", "Record",
+            "Replay", "GPU", "Ops", "Uploads", "Compiles", "Programs", "FBOs", "Skipped");
+
+    nsecs_t maxRecord = 0, maxReplay = 0, maxGpu = -1;
+    uint32_t opTotals[FRAME_STATS_OP_COUNT];
+    memset(opTotals, 0, sizeof(opTotals));
+
+    for (size_t i = 0; i < count; i++) {
+        const FrameInfo& info = frames[i];
+        log.appendFormat("  %8d %8.2f %8.2f ", info.frame,
+                toMs(info.recordTime), toMs(info.replayTime));
+        if (info.gpuTime >= 0) {
+            log.appendFormat("%8.2f", toMs(info.gpuTime));
+        } else {
+            log.appendFormat("%8s", "-");
+        }
+        log.appendFormat(" %6d %8d %8d %8d %5d %8d\n", info.opCount, info.textureUploads,
+                info.shaderCompiles, info.programSwitches, info.fboSwitches, info.redundantCalls);
+
+        if (info.recordTime > maxRecord) maxRecord = info.recordTime;
+        if (info.replayTime > maxReplay) maxReplay = info.replayTime;
+        if (info.gpuTime > maxGpu) maxGpu = info.gpuTime;
+        for (uint32_t op = 0; op < FRAME_STATS_OP_COUNT; op++) {
+            opTotals[op] += info.ops[op];
+        }
+    }
+
+    log.appendFormat("  Max record: %.2f ms, max replay: %.2f ms", toMs(maxRecord),
+            toMs(maxReplay));
+    if (maxGpu >= 0) {
+        log.appendFormat(", max GPU: %.2f ms", toMs(maxGpu));
+    }
+    log.append("\n");
+
+    log.append("  Operations:\n");
+    for (uint32_t op = 0; op < FRAME_STATS_OP_COUNT && op < opNameCount; op++) {
+        if (opTotals[op] > 0) {
+            log.appendFormat("    %-20s %8d\n", opNames[op], opTotals[op]);
+        }
+    }
+
+    delete[] frames;
+}
+
+}; // namespace uirenderer
+}; // namespace android
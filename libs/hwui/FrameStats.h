@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_FRAME_STATS_H
+#define ANDROID_HWUI_FRAME_STATS_H
+
+#include <GLES2/gl2.h>
+
+#include <cutils/compiler.h>
+
+#include <utils/String8.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Number of frames kept in the history
+#define FRAME_STATS_COUNT 128
+// Must be larger than the number of display list operations
+#define FRAME_STATS_OP_COUNT 64
+// Number of GPU timer queries in flight
+#define FRAME_STATS_GPU_QUERIES 4
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Statistics of a frame drawn to a window. Times are in nanoseconds.
+ */
+struct FrameInfo {
+    // Sequence number of the frame
+    uint32_t frame;
+
+    // Time spent recording display lists since the previous frame
+    nsecs_t recordTime;
+    // Time spent between the beginning and the end of the frame
+    nsecs_t replayTime;
+    // Time the GPU spent executing the frame, -1 if unknown
+    nsecs_t gpuTime;
+
+    uint32_t opCount;
+    uint32_t ops[FRAME_STATS_OP_COUNT];
+
+    uint32_t textureUploads;
+    uint32_t shaderCompiles;
+    uint32_t programSwitches;
+    uint32_t fboSwitches;
+    // GL calls skipped because they would not have changed the GL state
+    uint32_t redundantCalls;
+}; // struct FrameInfo
+
+/**
+ * Keeps the statistics of the most recent frames drawn by the renderers
+ * targeting a window. The counters must be updated from the thread that
+ * draws, display lists can be recorded on another thread.
+ *
+ * GPU times are measured with GL_EXT_disjoint_timer_query when available
+ * and become known a few frames after the frame was drawn.
+ */
+class FrameStats {
+public:
+    FrameStats();
+    ~FrameStats();
+
+    /**
+     * Must be called with a current context.
+     */
+    ANDROID_API void init(bool enabled, bool hasTimerQuery);
+    ANDROID_API void terminate();
+
+    bool isEnabled() const {
+        return mEnabled;
+    }
+
+    void beginRecording();
+    void endRecording();
+
+    void beginFrame();
+    void endFrame();
+
+    inline void countOp(int op) {
+        if (CC_UNLIKELY(mEnabled)) {
+            mCurrent.opCount++;
+            if (op >= 0 && op < FRAME_STATS_OP_COUNT) mCurrent.ops[op]++;
+            if (CC_UNLIKELY(mTimeOps)) timeOp(op);
+        }
+    }
+
+    inline void countTextureUpload() {
+        if (CC_UNLIKELY(mEnabled)) mCurrent.textureUploads++;
+    }
+
+    inline void countShaderCompile() {
+        if (CC_UNLIKELY(mEnabled)) mCurrent.shaderCompiles++;
+    }
+
+    inline void countProgramSwitch() {
+        if (CC_UNLIKELY(mEnabled)) mCurrent.programSwitches++;
+    }
+
+    inline void countFboSwitch() {
+        if (CC_UNLIKELY(mEnabled)) mCurrent.fboSwitches++;
+    }
+
+    inline void countRedundantCall() {
+        if (CC_UNLIKELY(mEnabled)) mCurrent.redundantCalls++;
+    }
+
+    /**
+     * Copies up to count of the most recent frames, oldest first, and
+     * returns the number of frames copied.
+     */
+    ANDROID_API size_t getFrames(FrameInfo* frames, size_t count);
+
+    /**
+     * Enables the measure of the CPU time spent in each type of operation.
+     * Reading the clock for every operation is too expensive to be done
+     * outside of benchmarks. The accumulated times are reset.
+     */
+    ANDROID_API void setOpTimingEnabled(bool enabled);
+
+    /**
+     * Copies the CPU time accumulated by each type of operation since op
+     * timing was enabled. The array must hold FRAME_STATS_OP_COUNT entries.
+     */
+    ANDROID_API void getOpTimes(nsecs_t* times);
+
+    /**
+     * Appends a summary of the recent frames to the specified log.
+     */
+    void dump(String8& log, const char* opNames[], uint32_t opNameCount);
+
+private:
+    struct Query {
+        Query(): id(0), frame(0), pending(false) { }
+
+        GLuint id;
+        uint32_t frame;
+        bool pending;
+    };
+
+    void resetCurrent();
+    void collectQueries();
+    void timeOp(int op);
+
+    bool mEnabled;
+    bool mHasTimerQuery;
+
+    // Drawing thread
+    FrameInfo mCurrent;
+    nsecs_t mFrameStart;
+    Query mQueries[FRAME_STATS_GPU_QUERIES];
+    Query* mActiveQuery;
+
+    // Time spent in an operation is measured up to the next operation,
+    // a display list operation only accounts for its own setup
+    bool mTimeOps;
+    int mTimedOp;
+    nsecs_t mTimedOpStart;
+    nsecs_t mOpTimes[FRAME_STATS_OP_COUNT];
+
+    // Shared with the recording thread
+    FrameInfo mFrames[FRAME_STATS_COUNT];
+    uint32_t mFrameCount;
+    nsecs_t mRecordTime;
+    nsecs_t mRecordStart;
+    uint32_t mRecordDepth;
+    Mutex mLock;
+}; // class FrameStats
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_FRAME_STATS_H
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <cutils/properties.h>
+
+#include <SkGlyph.h>
+#include <SkTypeface.h>
+
+#include "GlyphPrecacher.h"
+#include "Properties.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Requests queued beyond this limit are dropped; they will simply be
+// rasterized on the render thread as before
+#define MAX_PENDING_REQUESTS 64
+// Only this many glyphs are remembered to avoid rasterizing them twice
+#define MAX_PRECACHED_GLYPHS 2048
+
+///////////////////////////////////////////////////////////////////////////////
+// Glyphs
+///////////////////////////////////////////////////////////////////////////////
+
+PrecachedGlyph::PrecachedGlyph(const SkPaint& paint, uint16_t glyph) {
+    memset(this, 0, sizeof(PrecachedGlyph));
+
+    const float textSize = paint.getTextSize();
+    const float skewX = paint.getTextSkewX();
+    const float scaleXFloat = paint.getTextScaleX();
+    const float strokeWidthFloat = paint.getStrokeWidth();
+
+    fontId = SkTypeface::UniqueID(paint.getTypeface());
+    fontSize = *(uint32_t*) &textSize;
+    flags = paint.getFlags();
+    italicStyle = *(uint32_t*) &skewX;
+    scaleX = *(uint32_t*) &scaleXFloat;
+    style = paint.getStyle();
+    strokeWidth = *(uint32_t*) &strokeWidthFloat;
+    this->glyph = glyph;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+GlyphPrecacher::GlyphPrecacher(): mExiting(false) {
+    char property[PROPERTY_VALUE_MAX];
+    mEnabled = property_get(PROPERTY_TEXT_PRECACHE, property, NULL) > 0 &&
+            !strcmp(property, "true");
+    if (mEnabled) {
+        INIT_LOGD("  Glyphs will be precached in the background");
+    }
+}
+
+GlyphPrecacher::~GlyphPrecacher() {
+    sp<PrecacheThread> thread;
+    {
+        Mutex::Autolock _l(mLock);
+        mExiting = true;
+        thread = mThread;
+        mCondition.signal();
+    }
+
+    if (thread != NULL) {
+        thread->requestExitAndWait();
+    }
+
+    for (size_t i = 0; i < mQueue.size(); i++) {
+        delete mQueue.itemAt(i);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Queueing
+///////////////////////////////////////////////////////////////////////////////
+
+void GlyphPrecacher::precache(const SkPaint* paint, const char* text, size_t bytesCount) {
+    if (!mEnabled || !paint || !text || bytesCount < sizeof(uint16_t)) return;
+    if (paint->getTextEncoding() != SkPaint::kGlyphID_TextEncoding) return;
+
+    Mutex::Autolock _l(mLock);
+    if (mExiting || mQueue.size() >= MAX_PENDING_REQUESTS) return;
+
+    PrecacheRequest* request = new PrecacheRequest;
+    request->paint = *paint;
+    request->glyphs.appendArray((const uint16_t*) text, bytesCount / sizeof(uint16_t));
+    mQueue.push(request);
+
+    if (mThread == NULL) {
+        mThread = new PrecacheThread(this);
+        mThread->run("hwuiGlyphPrecache", PRIORITY_BACKGROUND);
+    }
+
+    mCondition.signal();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Worker
+///////////////////////////////////////////////////////////////////////////////
+
+bool GlyphPrecacher::PrecacheThread::threadLoop() {
+    return mPrecacher->processNextRequest(this);
+}
+
+bool GlyphPrecacher::processNextRequest(Thread* thread) {
+    PrecacheRequest* request = NULL;
+    {
+        Mutex::Autolock _l(mLock);
+        while (mQueue.isEmpty()) {
+            if (mExiting || thread->exitPending()) return false;
+            mCondition.wait(mLock);
+        }
+        if (mExiting) return false;
+
+        request = mQueue.itemAt(0);
+        mQueue.removeAt(0);
+    }
+
+    rasterize(request);
+    delete request;
+
+    return true;
+}
+
+void GlyphPrecacher::rasterize(PrecacheRequest* request) {
+    SkPaint& paint = request->paint;
+    size_t rasterized = 0;
+
+    for (size_t i = 0; i < request->glyphs.size(); i++) {
+        PrecachedGlyph key(paint, request->glyphs.itemAt(i));
+        if (mPrecached.indexOf(key) >= 0) continue;
+
+        if (mPrecached.size() >= MAX_PRECACHED_GLYPHS) {
+            mPrecached.clear();
+        }
+        mPrecached.add(key);
+
+        // Skia's glyph cache is shared by all threads; the render thread
+        // will find the image already generated when it calls findImage()
+        const SkGlyph& skiaGlyph = paint.getGlyphMetrics(key.glyph);
+        paint.findImage(skiaGlyph);
+        rasterized++;
+    }
+
+    PRECACHE_LOGD("Precached %d glyphs out of %d", rasterized, request->glyphs.size());
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_GLYPH_PRECACHER_H
+#define ANDROID_HWUI_GLYPH_PRECACHER_H
+
+#include <utils/SortedVector.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+#include <SkPaint.h>
+
+#include "Debug.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Debug
+#if DEBUG_GLYPHS
+    #define PRECACHE_LOGD(...) ALOGD(__VA_ARGS__)
+#else
+    #define PRECACHE_LOGD(...)
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Identifies a glyph rasterized with a given set of font attributes. The
+ * attributes are the same ones used by FontRenderer to select a Font.
+ */
+struct PrecachedGlyph {
+    PrecachedGlyph() {
+        memset(this, 0, sizeof(PrecachedGlyph));
+    }
+
+    PrecachedGlyph(const SkPaint& paint, uint16_t glyph);
+
+    bool operator<(const PrecachedGlyph& rhs) const {
+        return memcmp(this, &rhs, sizeof(PrecachedGlyph)) < 0;
+    }
+
+    uint32_t fontId;
+    uint32_t fontSize;
+    uint32_t flags;
+    uint32_t italicStyle;
+    uint32_t scaleX;
+    uint32_t style;
+    uint32_t strokeWidth;
+    uint32_t glyph;
+}; // struct PrecachedGlyph
+
+/**
+ * Rasterizes glyphs on a background thread before they are drawn. Text is
+ * handed to the precacher when display lists are recorded; the worker thread
+ * asks Skia to render the glyph images, which are kept in Skia's glyph cache.
+ * When the display list is later replayed, the font renderer only has to copy
+ * the finished images into its cache textures and upload them.
+ *
+ * The precacher never touches GL state and can be fed from any thread.
+ */
+class GlyphPrecacher {
+public:
+    GlyphPrecacher();
+    ~GlyphPrecacher();
+
+    /**
+     * Returns true if glyphs are precached in the background.
+     */
+    bool isEnabled() const {
+        return mEnabled;
+    }
+
+    /**
+     * Queues the specified glyph-encoded text for rasterization with the
+     * specified paint. The text and the paint are copied.
+     */
+    void precache(const SkPaint* paint, const char* text, size_t bytesCount);
+
+private:
+    struct PrecacheRequest {
+        SkPaint paint;
+        Vector<uint16_t> glyphs;
+    };
+
+    class PrecacheThread: public Thread {
+    public:
+        PrecacheThread(GlyphPrecacher* precacher):
+                Thread(false), mPrecacher(precacher) { }
+
+    private:
+        virtual bool threadLoop();
+
+        GlyphPrecacher* mPrecacher;
+    }; // class PrecacheThread
+
+    /**
+     * Waits for the next queued request and rasterizes its glyphs. Returns
+     * false once the worker thread was asked to exit.
+     */
+    bool processNextRequest(Thread* thread);
+
+    void rasterize(PrecacheRequest* request);
+
+    bool mEnabled;
+    bool mExiting;
+
+    Vector<PrecacheRequest*> mQueue;
+    SortedVector<PrecachedGlyph> mPrecached;
+
+    sp<PrecacheThread> mThread;
+
+    mutable Mutex mLock;
+    Condition mCondition;
+}; // class GlyphPrecacher
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_GLYPH_PRECACHER_H
@@ -23,6 +23,7 @@
 
 #include <utils/threads.h>
 
+#include "Caches.h"
 #include "Debug.h"
 #include "GradientCache.h"
 #include "Properties.h"
@@ -88,11 +89,70 @@ void GradientCache::operator()(GradientCacheEntry& shader, Texture*& texture) {
     }
 
     if (texture) {
-        glDeleteTextures(1, &texture->id);
+        if (texture->page) {
+            releaseRow(texture);
+        } else if (texture->id) {
+            Caches::getInstance().deleteTexture(texture->id);
+        }
         delete texture;
     }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Pages
+///////////////////////////////////////////////////////////////////////////////
+
+GradientCache::Page* GradientCache::allocateRow(uint32_t* row) {
+    Page* page = NULL;
+    for (size_t i = 0; i < mPages.size(); i++) {
+        if (mPages.itemAt(i)->freeRows) {
+            page = mPages.itemAt(i);
+            break;
+        }
+    }
+
+    if (!page) {
+        page = new Page;
+
+        glGenTextures(1, &page->texture.id);
+        Caches::getInstance().bindTexture(page->texture.id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, GRADIENT_TEXTURE_WIDTH, GRADIENT_PAGE_ROWS, 0,
+                GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+        page->texture.width = GRADIENT_TEXTURE_WIDTH;
+        page->texture.height = GRADIENT_PAGE_ROWS;
+        page->texture.generation = 0;
+        page->texture.blend = true;
+        page->texture.setFilter(GL_LINEAR);
+        page->texture.setWrap(GL_CLAMP_TO_EDGE);
+
+        mPages.push(page);
+    }
+
+    *row = __builtin_ctz(page->freeRows);
+    page->freeRows &= ~(1 << *row);
+
+    return page;
+}
+
+void GradientCache::releaseRow(Texture* texture) {
+    for (size_t i = 0; i < mPages.size(); i++) {
+        Page* page = mPages.itemAt(i);
+        if (&page->texture == texture->page) {
+            const uint32_t row = uint32_t(texture->v1 * GRADIENT_PAGE_ROWS);
+            page->freeRows |= 1 << row;
+
+            if (page->freeRows == 0xffffffff) {
+                Caches::getInstance().deleteTexture(page->texture.id);
+                mPages.removeAt(i);
+                delete page;
+            }
+            break;
+        }
+    }
+    texture->page = NULL;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Caching
 ///////////////////////////////////////////////////////////////////////////////
@@ -117,7 +177,7 @@ void GradientCache::clear() {
 Texture* GradientCache::addLinearGradient(GradientCacheEntry& gradient,
         uint32_t* colors, float* positions, int count, SkShader::TileMode tileMode) {
     SkBitmap bitmap;
-    bitmap.setConfig(SkBitmap::kARGB_8888_Config, 1024, 1);
+    bitmap.setConfig(SkBitmap::kARGB_8888_Config, GRADIENT_TEXTURE_WIDTH, 1);
     bitmap.allocPixels();
     bitmap.eraseColor(0);
 
@@ -152,27 +212,31 @@ Texture* GradientCache::addLinearGradient(GradientCacheEntry& gradient,
 }
 
 void GradientCache::generateTexture(SkBitmap* bitmap, Texture* texture) {
+    texture->generation = bitmap->getGenerationID();
+    texture->width = bitmap->width();
+    texture->height = bitmap->height();
+    texture->blend = !bitmap->isOpaque();
+
     SkAutoLockPixels autoLock(*bitmap);
     if (!bitmap->readyToDraw()) {
         ALOGE("Cannot generate texture from shader");
+        texture->id = 0;
         return;
     }
 
-    texture->generation = bitmap->getGenerationID();
-    texture->width = bitmap->width();
-    texture->height = bitmap->height();
+    uint32_t row;
+    Page* page = allocateRow(&row);
 
-    glGenTextures(1, &texture->id);
+    // Only the row of the gradient is uploaded
+    texture->id = page->texture.id;
+    texture->page = &page->texture;
+    texture->v1 = row / float(GRADIENT_PAGE_ROWS);
+    texture->v2 = (row + 1) / float(GRADIENT_PAGE_ROWS);
 
-    glBindTexture(GL_TEXTURE_2D, texture->id);
+    Caches::getInstance().bindTexture(page->texture.id);
     glPixelStorei(GL_UNPACK_ALIGNMENT, bitmap->bytesPerPixel());
-
-    texture->blend = !bitmap->isOpaque();
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bitmap->rowBytesAsPixels(), texture->height, 0,
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, row, bitmap->width(), 1,
             GL_RGBA, GL_UNSIGNED_BYTE, bitmap->getPixels());
-
-    texture->setFilter(GL_LINEAR);
-    texture->setWrap(GL_CLAMP_TO_EDGE);
 }
 
 }; // namespace uirenderer
@@ -29,6 +29,21 @@
 namespace android {
 namespace uirenderer {
 
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Width of the gradient textures, the banding of the narrower textures
+// is hidden by dithering in the fragment shaders
+#define GRADIENT_TEXTURE_WIDTH 256
+// Gradients are stored as the rows of shared textures, the free rows of
+// a page are tracked in a 32 bits mask
+#define GRADIENT_PAGE_ROWS 32
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
 struct GradientCacheEntry {
     GradientCacheEntry() {
         count = 0;
@@ -100,6 +115,12 @@ private:
  * A simple LRU gradient cache. The cache has a maximum size expressed in bytes.
  * Any texture added to the cache causing the cache to grow beyond the maximum
  * allowed size will also cause the oldest texture to be kicked out.
+ *
+ * Gradients are GRADIENT_TEXTURE_WIDTH texels wide and are packed as rows
+ * of shared pages: the returned textures have their page set and their v1
+ * and v2 fields locate the row in the page. A page is deleted when its last
+ * gradient is removed. Gradients with two stops should not be cached, see
+ * SkiaShader.
  */
 class GradientCache: public OnEntryRemoved<GradientCacheEntry, Texture*> {
 public:
@@ -147,7 +168,18 @@ private:
 
     void generateTexture(SkBitmap* bitmap, Texture* texture);
 
+    struct Page {
+        Page(): freeRows(0xffffffff) { }
+
+        Texture texture;
+        uint32_t freeRows;
+    };
+
+    Page* allocateRow(uint32_t* row);
+    void releaseRow(Texture* texture);
+
     GenerationCache<GradientCacheEntry, Texture*> mCache;
+    Vector<Page*> mPages;
 
     uint32_t mSize;
     uint32_t mMaxSize;
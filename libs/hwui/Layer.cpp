@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include "Caches.h"
+#include "Layer.h"
+
+namespace android {
+namespace uirenderer {
+
+void Layer::bindTexture() {
+    Caches::getInstance().bindTexture(renderTarget, texture.id);
+}
+
+void Layer::deleteTexture() {
+    if (texture.id) Caches::getInstance().deleteTexture(texture.id);
+}
+
+void Layer::deleteFbo() {
+    if (fbo) Caches::getInstance().deleteFramebuffer(fbo);
+}
+
+void Layer::updateDeferred(OpenGLRenderer* renderer, DisplayList* displayList,
+        int left, int top, int right, int bottom) {
+    this->renderer = renderer;
+    this->displayList = displayList;
+
+    Rect r(left, top, right, bottom);
+    if (!contentValid) {
+        r.set(0.0f, 0.0f, layer.getWidth(), layer.getHeight());
+    } else if (!r.intersect(0.0f, 0.0f, layer.getWidth(), layer.getHeight())) {
+        r.setEmpty();
+    }
+    dirtyRect.unionWith(r);
+
+    deferredUpdateScheduled = true;
+}
+
+}; // namespace uirenderer
+}; // namespace android
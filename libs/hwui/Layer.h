@@ -56,6 +56,7 @@ struct Layer {
         texture.height = layerHeight;
         colorFilter = NULL;
         deferredUpdateScheduled = false;
+        contentValid = false;
         renderer = NULL;
         displayList = NULL;
     }
@@ -84,13 +85,20 @@ struct Layer {
         regionRect.translate(layer.left, layer.top);
     }
 
+    /**
+     * Schedules the redraw of the specified area of the layer, in layer
+     * coordinates, the next time the layer is drawn. Updates accumulate
+     * until then. The whole layer is redrawn if its content was lost.
+     */
     void updateDeferred(OpenGLRenderer* renderer, DisplayList* displayList,
-            int left, int top, int right, int bottom) {
-        this->renderer = renderer;
-        this->displayList = displayList;
-        const Rect r(left, top, right, bottom);
-        dirtyRect.unionWith(r);
-        deferredUpdateScheduled = true;
+            int left, int top, int right, int bottom);
+
+    /**
+     * Indicates that the content of the FBO was discarded or is undefined,
+     * for instance after a resize or when the layer comes from the cache.
+     */
+    inline void invalidateContent() {
+        contentValid = false;
     }
 
     inline uint32_t getWidth() {
@@ -195,21 +203,14 @@ struct Layer {
         colorFilter = filter;
     }
 
-    inline void bindTexture() {
-        glBindTexture(renderTarget, texture.id);
-    }
+    void bindTexture();
 
     inline void generateTexture() {
         glGenTextures(1, &texture.id);
     }
 
-    inline void deleteTexture() {
-        if (texture.id) glDeleteTextures(1, &texture.id);
-    }
-
-    inline void deleteFbo() {
-        if (fbo) glDeleteFramebuffers(1, &fbo);
-    }
+    void deleteTexture();
+    void deleteFbo();
 
     inline void allocateTexture(GLenum format, GLenum storage) {
         glTexImage2D(renderTarget, 0, format, getWidth(), getHeight(), 0, format, storage, NULL);
@@ -254,6 +255,8 @@ struct Layer {
      * Used for deferred updates.
      */
     bool deferredUpdateScheduled;
+    // False when the next update must redraw the whole layer
+    bool contentValid;
     OpenGLRenderer* renderer;
     DisplayList* displayList;
     Rect dirtyRect;
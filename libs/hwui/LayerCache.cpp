@@ -32,7 +32,8 @@ namespace uirenderer {
 // Constructors/destructor
 ///////////////////////////////////////////////////////////////////////////////
 
-LayerCache::LayerCache(): mSize(0), mMaxSize(MB(DEFAULT_LAYER_CACHE_SIZE)) {
+LayerCache::LayerCache(): mSize(0), mMaxSize(MB(DEFAULT_LAYER_CACHE_SIZE)),
+        mFlushRate(DEFAULT_LAYER_CACHE_FLUSH_RATE), mClock(0) {
     char property[PROPERTY_VALUE_MAX];
     if (property_get(PROPERTY_LAYER_CACHE_SIZE, property, NULL) > 0) {
         INIT_LOGD("  Setting layer cache size to %sMB", property);
@@ -40,6 +41,15 @@ LayerCache::LayerCache(): mSize(0), mMaxSize(MB(DEFAULT_LAYER_CACHE_SIZE)) {
     } else {
         INIT_LOGD("  Using default layer cache size of %.2fMB", DEFAULT_LAYER_CACHE_SIZE);
     }
+
+    if (property_get(PROPERTY_LAYER_CACHE_FLUSH_RATE, property, NULL) > 0) {
+        float flushRate = atof(property);
+        INIT_LOGD("  Setting layer cache flush rate to %.2f%%", flushRate * 100.0f);
+        setFlushRate(flushRate);
+    } else {
+        INIT_LOGD("  Using default layer cache flush rate of %.2f%%",
+                DEFAULT_LAYER_CACHE_FLUSH_RATE * 100.0f);
+    }
 }
 
 LayerCache::~LayerCache() {
@@ -63,6 +73,10 @@ void LayerCache::setMaxSize(uint32_t maxSize) {
     mMaxSize = maxSize;
 }
 
+void LayerCache::setFlushRate(float flushRate) {
+    mFlushRate = fmaxf(0.0f, fminf(1.0f, flushRate));
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Caching
 ///////////////////////////////////////////////////////////////////////////////
@@ -89,11 +103,86 @@ void LayerCache::clear() {
     mCache.clear();
 }
 
+void LayerCache::flush() {
+    if (mFlushRate >= 1.0f || mCache.size() == 0) return;
+    if (mFlushRate <= 0.0f) {
+        clear();
+        return;
+    }
+
+    uint32_t targetSize = uint32_t(mSize * mFlushRate);
+    LAYER_LOGD("LayerCache::flush: target size: %d", targetSize);
+
+    while (mSize > targetSize) {
+        removeAt(findVictim());
+    }
+}
+
+void LayerCache::removeAt(size_t index) {
+    Layer* victim = mCache.itemAt(index).mLayer;
+    LAYER_LOGD("  Deleting layer %dx%d", victim->getWidth(), victim->getHeight());
+
+    deleteLayer(victim);
+    mCache.removeAt(index);
+}
+
+size_t LayerCache::findVictim() const {
+#if LAYER_REMOVE_BIGGEST_FIRST
+    size_t victim = 0;
+    uint32_t victimArea = 0;
+    for (size_t i = 0; i < mCache.size(); i++) {
+        const LayerEntry& entry = mCache.itemAt(i);
+        if (entry.mWidth * entry.mHeight > victimArea) {
+            victimArea = entry.mWidth * entry.mHeight;
+            victim = i;
+        }
+    }
+    return victim;
+#else
+    size_t victim = 0;
+    for (size_t i = 1; i < mCache.size(); i++) {
+        // The clock may wrap around, compare distances instead of values
+        if (mClock - mCache.itemAt(i).mLastUsed > mClock - mCache.itemAt(victim).mLastUsed) {
+            victim = i;
+        }
+    }
+    return victim;
+#endif
+}
+
+ssize_t LayerCache::findBestFit(const uint32_t width, const uint32_t height) const {
+    LayerEntry entry(width, height);
+    ssize_t index = mCache.indexOf(entry);
+    if (index >= 0) return index;
+
+    // Entries are sorted by width so the search can start at the first
+    // wide enough entry
+    const float maxArea = entry.mWidth * entry.mHeight * LAYER_MAX_WASTE;
+    ssize_t bestFit = -1;
+    uint32_t bestArea = 0;
+
+    for (size_t i = mCache.orderOf(entry); i < mCache.size(); i++) {
+        const LayerEntry& candidate = mCache.itemAt(i);
+        // The following candidates are at least as wide
+        if (candidate.mWidth * entry.mHeight > maxArea) break;
+
+        const uint32_t area = candidate.mWidth * candidate.mHeight;
+        if (area > maxArea || candidate.mHeight < entry.mHeight) continue;
+
+        if (bestFit < 0 || area < bestArea) {
+            bestFit = i;
+            bestArea = area;
+        }
+    }
+
+    return bestFit;
+}
+
 Layer* LayerCache::get(const uint32_t width, const uint32_t height) {
     Layer* layer = NULL;
 
     LayerEntry entry(width, height);
-    ssize_t index = mCache.indexOf(entry);
+    ssize_t index = findBestFit(width, height);
 
     if (index >= 0) {
         entry = mCache.itemAt(index);
@@ -102,7 +191,8 @@ Layer* LayerCache::get(const uint32_t width, const uint32_t height) {
         layer = entry.mLayer;
         mSize -= layer->getWidth() * layer->getHeight() * 4;
 
-        LAYER_LOGD("Reusing layer %dx%d", layer->getWidth(), layer->getHeight());
+        LAYER_LOGD("Reusing layer %dx%d for %dx%d", layer->getWidth(), layer->getHeight(),
+                width, height);
     } else {
         LAYER_LOGD("Creating new layer %dx%d", entry.mWidth, entry.mHeight);
 
@@ -129,14 +219,12 @@ void LayerCache::dump() {
     size_t size = mCache.size();
     for (size_t i = 0; i < size; i++) {
         const LayerEntry& entry = mCache.itemAt(i);
-        LAYER_LOGD("  Layer size %dx%d", entry.mWidth, entry.mHeight);
+        LAYER_LOGD("  Layer size %dx%d, last used %d", entry.mWidth, entry.mHeight,
+                mClock - entry.mLastUsed);
     }
 }
 
 bool LayerCache::resize(Layer* layer, const uint32_t width, const uint32_t height) {
-    // TODO: We should be smarter and see if we have a texture of the appropriate
-    //       size already in the cache, and reuse it instead of creating a new one
-
     LayerEntry entry(width, height);
     if (entry.mWidth <= layer->getWidth() && entry.mHeight <= layer->getHeight()) {
         return true;
@@ -164,25 +252,17 @@ bool LayerCache::put(Layer* layer) {
     const uint32_t size = layer->getWidth() * layer->getHeight() * 4;
     // Don't even try to cache a layer that's bigger than the cache
     if (size < mMaxSize) {
-        // TODO: Use an LRU
         while (mSize + size > mMaxSize) {
-            size_t position = 0;
-#if LAYER_REMOVE_BIGGEST_FIRST
-            position = mCache.size() - 1;
-#endif
-            Layer* victim = mCache.itemAt(position).mLayer;
-            deleteLayer(victim);
-            mCache.removeAt(position);
-
-            LAYER_LOGD("  Deleting layer %.2fx%.2f", victim->layer.getWidth(),
-                    victim->layer.getHeight());
+            removeAt(findVictim());
         }
 
         layer->deferredUpdateScheduled = false;
+        layer->dirtyRect.setEmpty();
+        layer->invalidateContent();
         layer->renderer = NULL;
         layer->displayList = NULL;
 
-        LayerEntry entry(layer);
+        LayerEntry entry(layer, ++mClock);
 
         mCache.add(entry);
         mSize += size;
@@ -36,6 +36,16 @@ namespace uirenderer {
     #define LAYER_LOGD(...)
 #endif
 
+// Layer dimensions are rounded up to a multiple of LAYER_SIZE below
+// this threshold and to a multiple of LAYER_LARGE_SIZE above, which
+// limits the number of distinct sizes of large layers
+#define LAYER_SIZE_CLASS_THRESHOLD 256
+#define LAYER_LARGE_SIZE 128
+
+// A cached layer larger than requested is reused if its area is at most
+// this many times the area of the request
+#define LAYER_MAX_WASTE 1.5f
+
 ///////////////////////////////////////////////////////////////////////////////
 // Cache
 ///////////////////////////////////////////////////////////////////////////////
@@ -50,6 +60,10 @@ public:
      * layer can be found, a new one is created and returned. If creating a new
      * layer fails, NULL is returned.
      *
+     * A layer of the same size class is preferred, otherwise the smallest
+     * larger layer is reused if it does not waste too much memory (see
+     * LAYER_MAX_WASTE).
+     *
      * When a layer is obtained from the cache, it is removed and the total
      * size of the cache goes down.
      *
@@ -72,6 +86,17 @@ public:
      * Clears the cache. This causes all layers to be deleted.
      */
     void clear();
+    /**
+     * Partially flushes the cache, deleting the least recently used layers
+     * first. The amount of memory freed by a flush is defined by the flush
+     * rate.
+     */
+    void flush();
+    /**
+     * Indicates the percentage of the cache to retain when a
+     * memory trim is requested (see Caches::flush).
+     */
+    void setFlushRate(float flushRate);
     /**
      * Resize the specified layer if needed.
      *
@@ -105,18 +130,39 @@ public:
 private:
     void deleteLayer(Layer* layer);
 
+    /**
+     * Returns the index of the cached layer to reuse for the specified
+     * size class, or a negative value if none is suitable.
+     */
+    ssize_t findBestFit(const uint32_t width, const uint32_t height) const;
+    /**
+     * Returns the index of the layer to delete first.
+     */
+    size_t findVictim() const;
+    void removeAt(size_t index);
+
+    /**
+     * Rounds the specified dimension up to its size class.
+     */
+    static uint32_t getSizeClass(const uint32_t size) {
+        const float step = size > LAYER_SIZE_CLASS_THRESHOLD ? LAYER_LARGE_SIZE : LAYER_SIZE;
+        return uint32_t(ceilf(size / step) * step);
+    }
+
     struct LayerEntry {
         LayerEntry():
-            mLayer(NULL), mWidth(0), mHeight(0) {
+            mLayer(NULL), mWidth(0), mHeight(0), mLastUsed(0) {
         }
 
-        LayerEntry(const uint32_t layerWidth, const uint32_t layerHeight): mLayer(NULL) {
-            mWidth = uint32_t(ceilf(layerWidth / float(LAYER_SIZE)) * LAYER_SIZE);
-            mHeight = uint32_t(ceilf(layerHeight / float(LAYER_SIZE)) * LAYER_SIZE);
+        LayerEntry(const uint32_t layerWidth, const uint32_t layerHeight):
+                mLayer(NULL), mLastUsed(0) {
+            mWidth = getSizeClass(layerWidth);
+            mHeight = getSizeClass(layerHeight);
         }
 
-        LayerEntry(Layer* layer):
-            mLayer(layer), mWidth(layer->getWidth()), mHeight(layer->getHeight()) {
+        LayerEntry(Layer* layer, uint32_t lastUsed):
+            mLayer(layer), mWidth(layer->getWidth()), mHeight(layer->getHeight()),
+            mLastUsed(lastUsed) {
         }
 
         bool operator<(const LayerEntry& rhs) const {
@@ -133,12 +179,18 @@ private:
         Layer* mLayer;
         uint32_t mWidth;
         uint32_t mHeight;
+        // Value of mClock when the layer was put back in the cache
+        uint32_t mLastUsed;
     }; // struct LayerEntry
 
     SortedList<LayerEntry> mCache;
 
     uint32_t mSize;
     uint32_t mMaxSize;
+    float mFlushRate;
+
+    // Incremented every time a layer is put in the cache
+    uint32_t mClock;
 }; // class LayerCache
 
 }; // namespace uirenderer
@@ -18,6 +18,7 @@
 
 #include <ui/Rect.h>
 
+#include "Caches.h"
 #include "LayerCache.h"
 #include "LayerRenderer.h"
 #include "Matrix.h"
@@ -50,7 +51,7 @@ int LayerRenderer::prepareDirty(float left, float top, float right, float bottom
 #ifdef QCOM_HARDWARE
     TILERENDERING_END(previousFbo, mLayer->getFbo());
 #endif
-    glBindFramebuffer(GL_FRAMEBUFFER, mLayer->getFbo());
+    Caches::getInstance().bindFramebuffer(mLayer->getFbo());
 
     const float width = mLayer->layer.getWidth();
     const float height = mLayer->layer.getHeight();
@@ -219,6 +220,7 @@ Layer* LayerRenderer::createLayer(uint32_t width, uint32_t height, bool isOpaque
     layer->setBlend(!isOpaque);
     layer->setColorFilter(NULL);
     layer->region.clear();
+    layer->invalidateContent();
 
     GLuint previousFbo;
     glGetIntegerv(GL_FRAMEBUFFER_BINDING, (GLint*) &previousFbo);
@@ -226,7 +228,7 @@ Layer* LayerRenderer::createLayer(uint32_t width, uint32_t height, bool isOpaque
 #ifdef QCOM_HARDWARE
     TILERENDERING_END(previousFbo, layer->getFbo());
 #endif
-    glBindFramebuffer(GL_FRAMEBUFFER, layer->getFbo());
+    caches.bindFramebuffer(layer->getFbo());
     layer->bindTexture();
 
     // Initialize the texture if needed
@@ -237,7 +239,7 @@ Layer* LayerRenderer::createLayer(uint32_t width, uint32_t height, bool isOpaque
         if (glGetError() != GL_NO_ERROR) {
             ALOGD("Could not allocate texture for layer (fbo=%d %dx%d)",
                     fbo, width, height);
-            glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+            caches.bindFramebuffer(previousFbo);
 #ifdef QCOM_HARDWARE
             TILERENDERING_START(previousFbo, layer->getFbo());
             TILERENDERING_CLEARCACHE(fbo);
@@ -258,7 +260,7 @@ Layer* LayerRenderer::createLayer(uint32_t width, uint32_t height, bool isOpaque
     glClear(GL_COLOR_BUFFER_BIT);
     glEnable(GL_SCISSOR_TEST);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+    caches.bindFramebuffer(previousFbo);
 #ifdef QCOM_HARDWARE
     TILERENDERING_START(previousFbo, layer->getFbo(), true);
 #endif
@@ -274,6 +276,7 @@ bool LayerRenderer::resizeLayer(Layer* layer, uint32_t width, uint32_t height) {
             layer->layer.set(0.0f, 0.0f, width, height);
             layer->texCoords.set(0.0f, height / float(layer->getHeight()),
                     width / float(layer->getWidth()), 0.0f);
+            layer->invalidateContent();
         } else {
             layer->deleteTexture();
             delete layer;
@@ -307,6 +310,10 @@ Layer* LayerRenderer::createTextureLayer(bool isOpaque) {
 
 void LayerRenderer::updateTextureLayer(Layer* layer, uint32_t width, uint32_t height,
         bool isOpaque, GLenum renderTarget, float* transform) {
+    // The SurfaceTexture bound its texture to the active unit when it was
+    // updated; the other units are untouched
+    Caches::getInstance().resetActiveTextureBindings();
+
     if (layer) {
         layer->setBlend(!isOpaque);
         layer->setSize(width, height);
@@ -372,10 +379,11 @@ void LayerRenderer::flushLayer(Layer* layer) {
             glGetIntegerv(GL_FRAMEBUFFER_BINDING, (GLint*) &previousFbo);
 
             GLenum attachments = GL_COLOR_ATTACHMENT0;
-            if (fbo != previousFbo) glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+            if (fbo != previousFbo) Caches::getInstance().bindFramebuffer(fbo);
             glDiscardFramebufferEXT(GL_FRAMEBUFFER, 1, &attachments);
+            layer->invalidateContent();
 
-            if (fbo != previousFbo) glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+            if (fbo != previousFbo) Caches::getInstance().bindFramebuffer(previousFbo);
         }
     }
 #endif
@@ -433,7 +441,7 @@ bool LayerRenderer::copyLayer(Layer* layer, SkBitmap* bitmap) {
 #ifdef QCOM_HARDWARE
         TILERENDERING_END(previousFbo, fbo);
 #endif
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        caches.bindFramebuffer(fbo);
 #ifdef QCOM_HARDWARE
         TILERENDERING_START(fbo, previousFbo, 0, 0, bitmap->width(), bitmap->height(),
                             bitmap->width(), bitmap->height());
@@ -442,7 +450,7 @@ bool LayerRenderer::copyLayer(Layer* layer, SkBitmap* bitmap) {
         if ((error = glGetError()) != GL_NO_ERROR) goto error;
 
         caches.activeTexture(0);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        caches.bindTexture(texture);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -503,13 +511,13 @@ error:
 #ifdef QCOM_HARDWARE
         TILERENDERING_END(fbo, previousFbo, true);
 #endif
-        glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+        caches.bindFramebuffer(previousFbo);
 #ifdef QCOM_HARDWARE
         TILERENDERING_START(previousFbo, fbo);
 #endif
         layer->setAlpha(alpha, mode);
         layer->setFbo(0);
-        glDeleteTextures(1, &texture);
+        caches.deleteTexture(texture);
         caches.fboCache.put(fbo);
 
         return status;
@@ -24,6 +24,10 @@
 
 #include <SkMatrix.h>
 
+#if defined(__ARM_HAVE_NEON)
+    #include <arm_neon.h>
+#endif
+
 #include "utils/Compare.h"
 #include "Matrix.h"
 
@@ -176,6 +180,25 @@ void Matrix4::multiply(float v) {
     mIsIdentity = false;
 }
 
+// Post-multiplying by a translation only changes the last column, which
+// becomes this matrix applied to (x, y, z, 1).
+void Matrix4::translate(float x, float y, float z) {
+    for (int i = 0; i < 4; i++) {
+        data[12 + i] += data[i] * x + data[4 + i] * y + data[8 + i] * z;
+    }
+    mIsIdentity = false;
+}
+
+// Post-multiplying by a scale only scales the first three columns.
+void Matrix4::scale(float sx, float sy, float sz) {
+    for (int i = 0; i < 4; i++) {
+        data[i] *= sx;
+        data[4 + i] *= sy;
+        data[8 + i] *= sz;
+    }
+    mIsIdentity = false;
+}
+
 void Matrix4::loadTranslate(float x, float y, float z) {
     loadIdentity();
 
@@ -257,6 +280,24 @@ void Matrix4::loadRotate(float angle, float x, float y, float z) {
 }
 
 void Matrix4::loadMultiply(const Matrix4& u, const Matrix4& v) {
+#if defined(__ARM_HAVE_NEON)
+    // Column i of the result is u applied to column i of v. The columns of u
+    // are loaded first and each column of v is read before its result column
+    // is stored, so this may alias either operand.
+    const float32x4_t u0 = vld1q_f32(&u.data[0]);
+    const float32x4_t u1 = vld1q_f32(&u.data[4]);
+    const float32x4_t u2 = vld1q_f32(&u.data[8]);
+    const float32x4_t u3 = vld1q_f32(&u.data[12]);
+
+    for (int i = 0 ; i < 4 ; i++) {
+        const float32x4_t e = vld1q_f32(&v.data[i * 4]);
+        float32x4_t r = vmulq_lane_f32(u0, vget_low_f32(e), 0);
+        r = vmlaq_lane_f32(r, u1, vget_low_f32(e), 1);
+        r = vmlaq_lane_f32(r, u2, vget_high_f32(e), 0);
+        r = vmlaq_lane_f32(r, u3, vget_high_f32(e), 1);
+        vst1q_f32(&data[i * 4], r);
+    }
+#else
     for (int i = 0 ; i < 4 ; i++) {
         float x = 0;
         float y = 0;
@@ -276,6 +317,7 @@ void Matrix4::loadMultiply(const Matrix4& u, const Matrix4& v) {
         set(i, 2, z);
         set(i, 3, w);
     }
+#endif
 
     mSimpleMatrix = u.mSimpleMatrix && v.mSimpleMatrix;
     mIsIdentity = false;
@@ -312,6 +354,55 @@ void Matrix4::mapPoint(float& x, float& y) const {
     y = dy * dz;
 }
 
+// Maps the four corners of r without the perspective divide and sets r to
+// their bounds.
+void Matrix4::mapAffineRect(Rect& r) const {
+    const float xs[] = { r.left, r.right, r.right, r.left };
+    const float ys[] = { r.top, r.top, r.bottom, r.bottom };
+
+#if defined(__ARM_HAVE_NEON)
+    const float32x4_t px = vld1q_f32(xs);
+    const float32x4_t py = vld1q_f32(ys);
+
+    float32x4_t x = vdupq_n_f32(data[kTranslateX]);
+    x = vmlaq_n_f32(x, px, data[kScaleX]);
+    x = vmlaq_n_f32(x, py, data[kSkewX]);
+    float32x4_t y = vdupq_n_f32(data[kTranslateY]);
+    y = vmlaq_n_f32(y, px, data[kSkewY]);
+    y = vmlaq_n_f32(y, py, data[kScaleY]);
+
+    float32x2_t minX = vpmin_f32(vget_low_f32(x), vget_high_f32(x));
+    float32x2_t maxX = vpmax_f32(vget_low_f32(x), vget_high_f32(x));
+    float32x2_t minY = vpmin_f32(vget_low_f32(y), vget_high_f32(y));
+    float32x2_t maxY = vpmax_f32(vget_low_f32(y), vget_high_f32(y));
+    minX = vpmin_f32(minX, minX);
+    maxX = vpmax_f32(maxX, maxX);
+    minY = vpmin_f32(minY, minY);
+    maxY = vpmax_f32(maxY, maxY);
+
+    r.left = vget_lane_f32(minX, 0);
+    r.right = vget_lane_f32(maxX, 0);
+    r.top = vget_lane_f32(minY, 0);
+    r.bottom = vget_lane_f32(maxY, 0);
+#else
+    for (int i = 0; i < 4; i++) {
+        float x = xs[i] * data[kScaleX] + ys[i] * data[kSkewX] + data[kTranslateX];
+        float y = xs[i] * data[kSkewY] + ys[i] * data[kScaleY] + data[kTranslateY];
+
+        if (i == 0) {
+            r.left = r.right = x;
+            r.top = r.bottom = y;
+            continue;
+        }
+
+        if (x < r.left) r.left = x;
+        else if (x > r.right) r.right = x;
+        if (y < r.top) r.top = y;
+        else if (y > r.bottom) r.bottom = y;
+    }
+#endif
+}
+
 void Matrix4::mapRect(Rect& r) const {
     if (mSimpleMatrix) {
         MUL_ADD_STORE(r.left, data[kScaleX], data[kTranslateX]);
@@ -334,6 +425,12 @@ void Matrix4::mapRect(Rect& r) const {
         return;
     }
 
+    if (data[kPerspective0] == 0.0f && data[kPerspective1] == 0.0f &&
+            data[kPerspective2] == 1.0f) {
+        mapAffineRect(r);
+        return;
+    }
+
     float vertices[] = {
         r.left, r.top,
         r.right, r.top,
@@ -81,6 +81,11 @@ public:
     void loadOrtho(float left, float right, float bottom, float top, float near, float far);
 
     void multiply(const Matrix4& v) {
+        if (v.mIsIdentity) return;
+        if (mIsIdentity) {
+            load(v);
+            return;
+        }
         Matrix4 u;
         u.loadMultiply(*this, v);
         load(u);
@@ -88,17 +93,8 @@ public:
 
     void multiply(float v);
 
-    void translate(float x, float y, float z) {
-        Matrix4 u;
-        u.loadTranslate(x, y, z);
-        multiply(u);
-    }
-
-    void scale(float sx, float sy, float sz) {
-        Matrix4 u;
-        u.loadScale(sx, sy, sz);
-        multiply(u);
-    }
+    void translate(float x, float y, float z);
+    void scale(float sx, float sy, float sz);
 
     void skew(float sx, float sy) {
         Matrix4 u;
@@ -133,6 +129,8 @@ private:
     bool mSimpleMatrix;
     bool mIsIdentity;
 
+    void mapAffineRect(Rect& r) const;
+
     inline float get(int i, int j) const {
         return data[i * 4 + j];
     }
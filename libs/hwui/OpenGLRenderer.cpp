@@ -17,6 +17,7 @@
 #define LOG_TAG "OpenGLRenderer"
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -52,6 +53,9 @@ namespace uirenderer {
 
 #define FILTER(paint) (paint && paint->isFilterBitmap() ? GL_LINEAR : GL_NEAREST)
 
+// Maximum number of bitmaps that can be queued by deferBitmap()
+#define MAX_DEFERRED_BITMAPS 128
+
 ///////////////////////////////////////////////////////////////////////////////
 // Globals
 ///////////////////////////////////////////////////////////////////////////////
@@ -180,6 +184,10 @@ int OpenGLRenderer::prepare(bool opaque) {
 int OpenGLRenderer::prepareDirty(float left, float top, float right, float bottom, bool opaque) {
     mCaches.clearGarbage();
 
+    if (getTargetFbo() == 0) {
+        mCaches.frameStats.beginFrame();
+    }
+
     mSnapshot = new Snapshot(mFirstSnapshot,
             SkCanvas::kMatrix_SaveFlag | SkCanvas::kClip_SaveFlag);
     mSnapshot->fbo = getTargetFbo();
@@ -216,6 +224,10 @@ void OpenGLRenderer::syncState() {
 }
 
 void OpenGLRenderer::finish() {
+    if (getTargetFbo() == 0) {
+        mCaches.frameStats.endFrame();
+    }
+
 #if DEBUG_OPENGL
     GLenum status = GL_NO_ERROR;
     while ((status = glGetError()) != GL_NO_ERROR) {
@@ -273,11 +285,15 @@ void OpenGLRenderer::resume() {
     mCaches.resetScissor();
     dirtyClip();
 
+    // Functors can bind textures and framebuffers behind our back
+    mCaches.resetBoundTextures();
+    mCaches.resetFramebuffer();
+
     mCaches.activeTexture(0);
 #ifdef QCOM_HARDWARE
     TILERENDERING_END(previousFbo, snapshot->fbo);
 #endif
-    glBindFramebuffer(GL_FRAMEBUFFER, snapshot->fbo);
+    mCaches.bindFramebuffer(snapshot->fbo);
 #ifdef QCOM_HARDWARE
     TILERENDERING_START(snapshot->fbo, previousFbo, 0, 0,
                         snapshot->viewport.getWidth(),
@@ -655,7 +671,7 @@ bool OpenGLRenderer::createFboLayer(Layer* layer, Rect& bounds, sp<Snapshot> sna
 #ifdef QCOM_HARDWARE
     TILERENDERING_END(previousFbo, layer->getFbo());
 #endif
-    glBindFramebuffer(GL_FRAMEBUFFER, layer->getFbo());
+    mCaches.bindFramebuffer(layer->getFbo());
     layer->bindTexture();
 
     // Initialize the texture if needed
@@ -671,7 +687,7 @@ bool OpenGLRenderer::createFboLayer(Layer* layer, Rect& bounds, sp<Snapshot> sna
     GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     if (status != GL_FRAMEBUFFER_COMPLETE) {
         ALOGE("Framebuffer incomplete (GL error code 0x%x)", status);
-        glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+        mCaches.bindFramebuffer(previousFbo);
 #ifdef QCOM_HARDWARE
         TILERENDERING_START(previousFbo, layer->getFbo(), true);
 #endif
@@ -722,7 +738,7 @@ void OpenGLRenderer::composeLayer(sp<Snapshot> current, sp<Snapshot> previous) {
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
 
         // Unbind current FBO and restore previous one
-        glBindFramebuffer(GL_FRAMEBUFFER, previous->fbo);
+        mCaches.bindFramebuffer(previous->fbo);
 #ifdef QCOM_HARDWARE
         TILERENDERING_START(previous->fbo, current->fbo, true);
 #endif
@@ -788,7 +804,7 @@ void OpenGLRenderer::drawTextureLayer(Layer* layer, const Rect& rect) {
     mat4& transform = layer->getTransform();
     if (!transform.isIdentity()) {
         save(0);
-        mSnapshot->transform->multiply(transform);
+        mSnapshot->editTransform()->multiply(transform);
     }
 
     setupDraw();
@@ -1072,26 +1088,26 @@ void OpenGLRenderer::clearLayerRegions() {
 ///////////////////////////////////////////////////////////////////////////////
 
 void OpenGLRenderer::translate(float dx, float dy) {
-    mSnapshot->transform->translate(dx, dy, 0.0f);
+    mSnapshot->editTransform()->translate(dx, dy, 0.0f);
 }
 
 void OpenGLRenderer::rotate(float degrees) {
-    mSnapshot->transform->rotate(degrees, 0.0f, 0.0f, 1.0f);
+    mSnapshot->editTransform()->rotate(degrees, 0.0f, 0.0f, 1.0f);
 }
 
 void OpenGLRenderer::scale(float sx, float sy) {
-    mSnapshot->transform->scale(sx, sy, 1.0f);
+    mSnapshot->editTransform()->scale(sx, sy, 1.0f);
 }
 
 void OpenGLRenderer::skew(float sx, float sy) {
-    mSnapshot->transform->skew(sx, sy);
+    mSnapshot->editTransform()->skew(sx, sy);
 }
 
 void OpenGLRenderer::setMatrix(SkMatrix* matrix) {
     if (matrix) {
-        mSnapshot->transform->load(*matrix);
+        mSnapshot->editTransform()->load(*matrix);
     } else {
-        mSnapshot->transform->loadIdentity();
+        mSnapshot->editTransform()->loadIdentity();
     }
 }
 
@@ -1103,7 +1119,7 @@ void OpenGLRenderer::concatMatrix(SkMatrix* matrix) {
     SkMatrix transform;
     mSnapshot->transform->copyTo(transform);
     transform.preConcat(*matrix);
-    mSnapshot->transform->load(transform);
+    mSnapshot->editTransform()->load(transform);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1136,7 +1152,11 @@ bool OpenGLRenderer::quickReject(float left, float top, float right, float botto
     Rect clipRect(*mSnapshot->clipRect);
     clipRect.snapToPixelBoundaries();
 
-    return !clipRect.intersects(r);
+    if (!clipRect.intersects(r)) return true;
+
+    // Complex clips are made of several rects, the space between them is
+    // clipped away as well
+    return !mSnapshot->clipRects->intersects(r);
 }
 
 bool OpenGLRenderer::clipRect(float left, float top, float right, float bottom, SkRegion::Op op) {
@@ -1185,11 +1205,23 @@ void OpenGLRenderer::setupDrawAALine() {
     mDescription.isAA = true;
 }
 
+void OpenGLRenderer::setupDrawVertexAlpha() {
+    mDescription.hasVertexAlpha = true;
+}
+
+void OpenGLRenderer::setupDrawVertexColor() {
+    mDescription.hasVertexColor = true;
+}
+
 void OpenGLRenderer::setupDrawPoint(float pointSize) {
     mDescription.isPoint = true;
     mDescription.pointSize = pointSize;
 }
 
+void OpenGLRenderer::setupDrawNinePatch() {
+    mDescription.isNinePatch = true;
+}
+
 void OpenGLRenderer::setupDrawColor(int color) {
     setupDrawColor(color, (color >> 24) & 0xFF);
 }
@@ -1372,6 +1404,57 @@ void OpenGLRenderer::setupDrawTextureTransformUniforms(mat4& transform) {
             GL_FALSE, &transform.data[0]);
 }
 
+void OpenGLRenderer::setupDrawNinePatchUniforms(const Patch* mesh, float width, float height) {
+    float stretch[4];
+    mesh->getStretch(width, height, stretch);
+
+    glUniform4fv(mCaches.currentProgram->getUniform("patchStretch"), 1, stretch);
+    glUniform2f(mCaches.currentProgram->getUniform("patchTextureScale"),
+            1.0f / mesh->bitmapWidth, 1.0f / mesh->bitmapHeight);
+}
+
+void OpenGLRenderer::setupDrawNinePatchMesh(GLuint vbo) {
+    mCaches.bindMeshBuffer(vbo);
+
+    // The position and the texture coordinates both have 4 components
+    glVertexAttribPointer(mCaches.currentProgram->position, 4, GL_FLOAT, GL_FALSE,
+            sizeof(PatchVertex), 0);
+    glVertexAttribPointer(mCaches.currentProgram->texCoords, 4, GL_FLOAT, GL_FALSE,
+            sizeof(PatchVertex), (GLvoid*) (4 * sizeof(float)));
+    // Subsequent draws must bind their own pointers
+    mCaches.resetVertexPointers();
+
+    mCaches.unbindIndicesBuffer();
+}
+
+void OpenGLRenderer::setupDrawBitmapMesh(const BitmapMesh* mesh, int& colorSlot) {
+    const GLsizei stride = mesh->hasColors ? sizeof(ColorTextureVertex) : sizeof(TextureVertex);
+
+    mCaches.bindMeshBuffer(mesh->meshBuffer);
+    glVertexAttribPointer(mCaches.currentProgram->position, 2, GL_FLOAT, GL_FALSE,
+            stride, 0);
+    glVertexAttribPointer(mCaches.currentProgram->texCoords, 2, GL_FLOAT, GL_FALSE,
+            stride, (GLvoid*) gMeshTextureOffset);
+    // Subsequent draws must bind their own pointers
+    mCaches.resetVertexPointers();
+
+    colorSlot = -1;
+    if (mesh->hasColors) {
+        colorSlot = mCaches.currentProgram->getAttrib("vtxColor");
+        glEnableVertexAttribArray(colorSlot);
+        glVertexAttribPointer(colorSlot, 4, GL_FLOAT, GL_FALSE, stride,
+                (GLvoid*) offsetof(ColorTextureVertex, color));
+    }
+
+    mCaches.bindIndicesBuffer(mesh->indicesBuffer);
+}
+
+void OpenGLRenderer::finishDrawBitmapMesh(const int colorSlot) {
+    if (colorSlot >= 0) {
+        glDisableVertexAttribArray(colorSlot);
+    }
+}
+
 void OpenGLRenderer::setupDrawMesh(GLvoid* vertices, GLvoid* texCoords, GLuint vbo) {
     bool force = false;
     if (!vertices) {
@@ -1438,11 +1521,61 @@ void OpenGLRenderer::setupDrawAALine(GLvoid* vertices, GLvoid* widthCoords,
     glUniform1f(inverseBoundaryWidthSlot, 1.0f / boundaryWidthProportion);
 }
 
+/**
+ * Moves the positions previously bound from client memory with
+ * setupDrawVertices() or setupDrawMesh() to the streaming VBO. The vertices
+ * are left in client memory if they cannot be streamed.
+ */
+void OpenGLRenderer::setupDrawStreamedVertices(GLvoid* vertices, GLsizeiptr size,
+        GLsizei stride) {
+    GLvoid* offset;
+    if (!mCaches.streamVertices(vertices, size, &offset)) return;
+
+    mCaches.bindPositionVertexPointer(true, mCaches.currentProgram->position, offset, stride);
+}
+
+/**
+ * Same as setupDrawStreamedVertices() for vertices bound with setupDrawAALine().
+ */
+void OpenGLRenderer::setupDrawStreamedAALine(GLvoid* vertices, GLsizeiptr size,
+        int widthSlot, int lengthSlot) {
+    GLvoid* offset;
+    if (!mCaches.streamVertices(vertices, size, &offset)) return;
+
+    mCaches.bindPositionVertexPointer(true, mCaches.currentProgram->position,
+            offset, gAAVertexStride);
+    glVertexAttribPointer(widthSlot, 1, GL_FLOAT, GL_FALSE, gAAVertexStride,
+            ((GLbyte*) offset) + gVertexAAWidthOffset);
+    glVertexAttribPointer(lengthSlot, 1, GL_FLOAT, GL_FALSE, gAAVertexStride,
+            ((GLbyte*) offset) + gVertexAALengthOffset);
+}
+
 void OpenGLRenderer::finishDrawAALine(const int widthSlot, const int lengthSlot) {
     glDisableVertexAttribArray(widthSlot);
     glDisableVertexAttribArray(lengthSlot);
 }
 
+void OpenGLRenderer::setupDrawAlphaVertices(GLvoid* vertices, int& alphaSlot) {
+    bool force = mCaches.unbindMeshBuffer();
+    mCaches.bindPositionVertexPointer(force, mCaches.currentProgram->position,
+            vertices, gAlphaVertexStride);
+    mCaches.unbindIndicesBuffer();
+
+    alphaSlot = -1;
+    if (mDescription.hasVertexAlpha) {
+        alphaSlot = mCaches.currentProgram->getAttrib("vtxAlpha");
+        glEnableVertexAttribArray(alphaSlot);
+        glVertexAttribPointer(alphaSlot, 1, GL_FLOAT, GL_FALSE, gAlphaVertexStride,
+                ((GLbyte*) vertices) + gVertexAlphaOffset);
+    }
+}
+
+void OpenGLRenderer::finishDrawAlphaVertices(const int alphaSlot) {
+    if (alphaSlot >= 0) {
+        glDisableVertexAttribArray(alphaSlot);
+    }
+}
+
 void OpenGLRenderer::finishDrawTexture() {
 }
 
@@ -1456,7 +1589,19 @@ status_t OpenGLRenderer::drawDisplayList(DisplayList* displayList,
     // All the usual checks and setup operations (quickReject, setupDraw, etc.)
     // will be performed by the display list itself
     if (displayList && displayList->isRenderable()) {
-        return displayList->replay(*this, dirty, flags, level);
+        if (level > 0) {
+            return displayList->replay(*this, dirty, flags, level);
+        }
+
+        mPendingDirty.setEmpty();
+        status_t status = displayList->replay(*this, dirty, flags, level);
+
+        // Redraw until the textures uploaded in the background are ready
+        if (!mPendingDirty.isEmpty()) {
+            dirty.unionWith(mPendingDirty);
+            status |= DrawGlInfo::kStatusDraw;
+        }
+        return status;
     }
 
     return DrawGlInfo::kStatusDone;
@@ -1468,6 +1613,12 @@ void OpenGLRenderer::outputDisplayList(DisplayList* displayList, uint32_t level)
     }
 }
 
+status_t OpenGLRenderer::drawPicture(SkPicture* picture, Rect& dirty) {
+    // The display list is translated once and replayed until the picture
+    // is recorded again
+    return drawDisplayList(mCaches.pictureCache.get(picture), dirty, 0);
+}
+
 void OpenGLRenderer::drawAlphaBitmap(Texture* texture, float left, float top, SkPaint* paint) {
     int alpha;
     SkXfermode::Mode mode;
@@ -1521,8 +1672,12 @@ status_t OpenGLRenderer::drawBitmap(SkBitmap* bitmap, float left, float top, SkP
     }
 
     mCaches.activeTexture(0);
-    Texture* texture = mCaches.textureCache.get(bitmap);
+    Texture* texture = mCaches.textureCache.get(bitmap, true, allowPendingTextures());
     if (!texture) return DrawGlInfo::kStatusDone;
+    if (texture->pending) {
+        drawPendingTexture(left, top, right, bottom);
+        return DrawGlInfo::kStatusDrew;
+    }
     const AutoTexture autoCleanup(texture);
 
     if (CC_UNLIKELY(bitmap->getConfig() == SkBitmap::kA8_Config)) {
@@ -1544,7 +1699,7 @@ status_t OpenGLRenderer::drawBitmap(SkBitmap* bitmap, SkMatrix* matrix, SkPaint*
     }
 
     mCaches.activeTexture(0);
-    Texture* texture = mCaches.textureCache.get(bitmap);
+    Texture* texture = mCaches.textureCache.get(bitmap, true, allowPendingTextures());
     if (!texture) return DrawGlInfo::kStatusDone;
     const AutoTexture autoCleanup(texture);
 
@@ -1552,7 +1707,11 @@ status_t OpenGLRenderer::drawBitmap(SkBitmap* bitmap, SkMatrix* matrix, SkPaint*
     // to the vertex shader. The save/restore is a bit overkill.
     save(SkCanvas::kMatrix_SaveFlag);
     concatMatrix(matrix);
-    drawTextureRect(0.0f, 0.0f, bitmap->width(), bitmap->height(), texture, paint);
+    if (texture->pending) {
+        drawPendingTexture(0.0f, 0.0f, bitmap->width(), bitmap->height());
+    } else {
+        drawTextureRect(0.0f, 0.0f, bitmap->width(), bitmap->height(), texture, paint);
+    }
     restore();
 
     return DrawGlInfo::kStatusDrew;
@@ -1575,6 +1734,195 @@ status_t OpenGLRenderer::drawBitmapData(SkBitmap* bitmap, float left, float top,
     return DrawGlInfo::kStatusDrew;
 }
 
+bool OpenGLRenderer::deferBitmap(SkBitmap* bitmap, float left, float top, SkPaint* paint) {
+    if (CC_UNLIKELY(bitmap->getConfig() == SkBitmap::kA8_Config) ||
+            !mSnapshot->transform->isPureTranslate()) {
+        return false;
+    }
+
+    const float right = left + bitmap->width();
+    const float bottom = top + bitmap->height();
+
+    if (quickReject(left, top, right, bottom)) {
+        return true;
+    }
+
+    if (!mDeferredBitmaps.isEmpty() && (*mSnapshot->clipRect != mDeferredClip ||
+            mDeferredBitmaps.size() >= MAX_DEFERRED_BITMAPS)) {
+        flushDeferredBitmaps();
+    }
+
+    mCaches.activeTexture(0);
+    Texture* texture = mCaches.textureCache.get(bitmap, true, allowPendingTextures());
+    if (!texture) return true;
+
+    if (texture->pending) {
+        flushDeferredBitmaps();
+        drawPendingTexture(left, top, right, bottom);
+        return true;
+    }
+
+    if (CC_UNLIKELY(texture->cleanup)) {
+        // The texture is not cached and will be gone by the time the queue is flushed
+        const AutoTexture autoCleanup(texture);
+        flushDeferredBitmaps();
+        drawTextureRect(left, top, right, bottom, texture, paint);
+        return true;
+    }
+
+    DeferredBitmap deferred;
+    deferred.bitmap = bitmap;
+    deferred.texture = texture->id;
+    deferred.blend = texture->blend;
+    getAlphaAndMode(paint, &deferred.alpha, &deferred.mode);
+
+    const float x = (int) floorf(left + mSnapshot->transform->getTranslateX() + 0.5f);
+    const float y = (int) floorf(top + mSnapshot->transform->getTranslateY() + 0.5f);
+    deferred.bounds.set(x, y, x + bitmap->width(), y + bitmap->height());
+
+    // Batches are drawn out of order, a bitmap can only be added to the
+    // queue if it does not overlap with a bitmap drawn by another batch
+    const size_t count = mDeferredBitmaps.size();
+    for (size_t i = 0; i < count; i++) {
+        const DeferredBitmap& queued = mDeferredBitmaps.itemAt(i);
+        if ((queued.texture != deferred.texture || queued.alpha != deferred.alpha ||
+                queued.mode != deferred.mode) && queued.bounds.intersects(deferred.bounds)) {
+            flushDeferredBitmaps();
+            break;
+        }
+    }
+
+    if (mDeferredBitmaps.isEmpty()) {
+        mDeferredClip.set(*mSnapshot->clipRect);
+    }
+    mDeferredBitmaps.add(deferred);
+
+    return true;
+}
+
+status_t OpenGLRenderer::flushDeferredBitmaps() {
+    const size_t count = mDeferredBitmaps.size();
+    if (count == 0) return DrawGlInfo::kStatusDone;
+
+    bool drawn[count];
+    memset(drawn, 0, sizeof(drawn));
+
+    // Batches are keyed by texture name, if a texture was evicted or moved
+    // since it was queued draw each bitmap on its own, in order
+    bool merge = true;
+    mCaches.activeTexture(0);
+    for (size_t i = 0; i < count; i++) {
+        const DeferredBitmap& deferred = mDeferredBitmaps.itemAt(i);
+        Texture* texture = mCaches.textureCache.get(deferred.bitmap, true);
+        const AutoTexture autoCleanup(texture);
+        if (!texture || texture->id != deferred.texture) {
+            merge = false;
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (!drawn[i]) {
+            drawDeferredBitmapBatch(i, drawn, merge);
+        }
+    }
+
+    mDeferredBitmaps.clear();
+    return DrawGlInfo::kStatusDrew;
+}
+
+void OpenGLRenderer::drawPendingTexture(float left, float top, float right, float bottom) {
+    Rect bounds(left, top, right, bottom);
+    mSnapshot->transform->mapRect(bounds);
+    bounds.intersect(*mSnapshot->clipRect);
+    mPendingDirty.unionWith(bounds);
+
+    if (mCaches.textureCache.hasPlaceholder()) {
+        drawColorRect(left, top, right, bottom, mCaches.textureCache.getPlaceholderColor(),
+                SkXfermode::kSrcOver_Mode);
+    }
+}
+
+void OpenGLRenderer::drawDeferredBitmapBatch(size_t start, bool* drawn, bool merge) {
+    const DeferredBitmap& first = mDeferredBitmaps.itemAt(start);
+    const size_t count = merge ? mDeferredBitmaps.size() : start + 1;
+
+    // The batch needs blending if any of its bitmaps does
+    bool blend = false;
+    for (size_t i = start; i < count; i++) {
+        const DeferredBitmap& deferred = mDeferredBitmaps.itemAt(i);
+        if (!drawn[i] && deferred.texture == first.texture && deferred.alpha == first.alpha &&
+                deferred.mode == first.mode) {
+            blend |= deferred.blend;
+        }
+    }
+
+    mCaches.activeTexture(0);
+    Texture* texture = mCaches.textureCache.get(first.bitmap, true);
+    if (!texture) {
+        drawn[start] = true;
+        return;
+    }
+    const AutoTexture autoCleanup(texture);
+
+    texture->setWrap(GL_CLAMP_TO_EDGE, true);
+    texture->setFilter(GL_NEAREST, true);
+
+    const float alpha = first.alpha / 255.0f;
+
+    setupDraw();
+    setupDrawWithTexture();
+    setupDrawColor(alpha, alpha, alpha, alpha);
+    setupDrawColorFilter();
+    setupDrawBlending(blend || texture->blend, first.mode, false);
+    setupDrawProgram();
+    setupDrawDirtyRegionsDisabled();
+    setupDrawModelViewTranslate(0.0f, 0.0f, 0.0f, 0.0f, true);
+    setupDrawPureColorUniforms();
+    setupDrawColorFilterUniforms();
+    setupDrawTexture(texture->id);
+
+    TextureVertex* mesh = mCaches.getRegionMesh();
+    setupDrawMeshIndices(&mesh[0].position[0], &mesh[0].texture[0]);
+    GLsizei numQuads = 0;
+
+    for (size_t i = start; i < count; i++) {
+        const DeferredBitmap& deferred = mDeferredBitmaps.itemAt(i);
+        if (drawn[i] || deferred.texture != first.texture || deferred.alpha != first.alpha ||
+                deferred.mode != first.mode) {
+            continue;
+        }
+
+        // Bitmaps sharing an atlas page each have their own texture coordinates
+        const Texture* entry = i == start ? texture :
+                mCaches.textureCache.get(deferred.bitmap, true);
+        if (!entry || entry->id != texture->id) continue;
+        drawn[i] = true;
+
+        const Rect& r = deferred.bounds;
+        TextureVertex::set(mesh++, r.left, r.top, entry->u1, entry->v1);
+        TextureVertex::set(mesh++, r.right, r.top, entry->u2, entry->v1);
+        TextureVertex::set(mesh++, r.left, r.bottom, entry->u1, entry->v2);
+        TextureVertex::set(mesh++, r.right, r.bottom, entry->u2, entry->v2);
+
+        dirtyLayer(r.left, r.top, r.right, r.bottom);
+
+        numQuads++;
+
+        if (numQuads >= REGION_MESH_QUAD_COUNT) {
+            glDrawElements(GL_TRIANGLES, numQuads * 6, GL_UNSIGNED_SHORT, NULL);
+            numQuads = 0;
+            mesh = mCaches.getRegionMesh();
+        }
+    }
+
+    if (numQuads > 0) {
+        glDrawElements(GL_TRIANGLES, numQuads * 6, GL_UNSIGNED_SHORT, NULL);
+    }
+
+    finishDrawTexture();
+}
+
 status_t OpenGLRenderer::drawBitmapMesh(SkBitmap* bitmap, int meshWidth, int meshHeight,
         float* vertices, int* colors, SkPaint* paint) {
     // TODO: Do a quickReject
@@ -1594,6 +1942,21 @@ status_t OpenGLRenderer::drawBitmapMesh(SkBitmap* bitmap, int meshWidth, int mes
     SkXfermode::Mode mode;
     getAlphaAndMode(paint, &alpha, &mode);
 
+    // Meshes are uploaded once and drawn from VBOs while their arrays don't change
+    const BitmapMesh* bitmapMesh = mCaches.bitmapMeshCache.get(meshWidth, meshHeight,
+            vertices, colors);
+    if (bitmapMesh) {
+#if RENDER_LAYERS_AS_REGIONS
+        if (hasLayer()) {
+            const Rect& bounds = bitmapMesh->bounds;
+            dirtyLayer(bounds.left, bounds.top, bounds.right, bounds.bottom,
+                    *mSnapshot->transform);
+        }
+#endif
+        drawBitmapMeshBuffers(bitmapMesh, texture, alpha / 255.0f, mode);
+        return DrawGlInfo::kStatusDrew;
+    }
+
     const uint32_t count = meshWidth * meshHeight * 6;
 
     float left = FLT_MAX;
@@ -1607,7 +1970,7 @@ status_t OpenGLRenderer::drawBitmapMesh(SkBitmap* bitmap, int meshWidth, int mes
     const bool hasActiveLayer = false;
 #endif
 
-    // TODO: Support the colors array
+    // TODO: Support the colors array, only meshes drawn from VBOs have colors
     TextureVertex mesh[count];
     TextureVertex* vertex = mesh;
     for (int32_t y = 0; y < meshHeight; y++) {
@@ -1670,17 +2033,24 @@ status_t OpenGLRenderer::drawBitmap(SkBitmap* bitmap,
     }
 
     mCaches.activeTexture(0);
-    Texture* texture = mCaches.textureCache.get(bitmap);
+    Texture* texture = mCaches.textureCache.get(bitmap, true, allowPendingTextures());
     if (!texture) return DrawGlInfo::kStatusDone;
+    if (texture->pending) {
+        drawPendingTexture(dstLeft, dstTop, dstRight, dstBottom);
+        return DrawGlInfo::kStatusDrew;
+    }
     const AutoTexture autoCleanup(texture);
 
     const float width = texture->width;
     const float height = texture->height;
 
-    const float u1 = fmax(0.0f, srcLeft / width);
-    const float v1 = fmax(0.0f, srcTop / height);
-    const float u2 = fmin(1.0f, srcRight / width);
-    const float v2 = fmin(1.0f, srcBottom / height);
+    // Map the source rectangle to the area covered by the bitmap in its texture
+    const float uScale = texture->u2 - texture->u1;
+    const float vScale = texture->v2 - texture->v1;
+    const float u1 = texture->u1 + fmax(0.0f, srcLeft / width) * uScale;
+    const float v1 = texture->v1 + fmax(0.0f, srcTop / height) * vScale;
+    const float u2 = texture->u1 + fmin(1.0f, srcRight / width) * uScale;
+    const float v2 = texture->v1 + fmin(1.0f, srcBottom / height) * vScale;
 
     mCaches.unbindMeshBuffer();
     resetDrawTextureTexCoords(u1, v1, u2, v2);
@@ -1737,7 +2107,7 @@ status_t OpenGLRenderer::drawPatch(SkBitmap* bitmap, const int32_t* xDivs, const
     getAlphaAndMode(paint, &alpha, &mode);
 
     const Patch* mesh = mCaches.patchCache.get(bitmap->width(), bitmap->height(),
-            right - left, bottom - top, xDivs, yDivs, colors, width, height, numColors);
+            xDivs, yDivs, colors, width, height, numColors);
 
     if (CC_LIKELY(mesh && mesh->verticesCount > 0)) {
         const bool pureTranslate = mSnapshot->transform->isPureTranslate();
@@ -1746,9 +2116,14 @@ status_t OpenGLRenderer::drawPatch(SkBitmap* bitmap, const int32_t* xDivs, const
         if (hasLayer() && mesh->hasEmptyQuads) {
             const float offsetX = left + mSnapshot->transform->getTranslateX();
             const float offsetY = top + mSnapshot->transform->getTranslateY();
+
+            float stretch[4];
+            mesh->getStretch(right - left, bottom - top, stretch);
+
+            Rect bounds;
             const size_t count = mesh->quads.size();
             for (size_t i = 0; i < count; i++) {
-                const Rect& bounds = mesh->quads.itemAt(i);
+                Patch::getQuadBounds(mesh->quads.itemAt(i), stretch, bounds);
                 if (CC_LIKELY(pureTranslate)) {
                     const float x = (int) floorf(bounds.left + offsetX + 0.5f);
                     const float y = (int) floorf(bounds.top + offsetY + 0.5f);
@@ -1765,15 +2140,11 @@ status_t OpenGLRenderer::drawPatch(SkBitmap* bitmap, const int32_t* xDivs, const
             const float x = (int) floorf(left + mSnapshot->transform->getTranslateX() + 0.5f);
             const float y = (int) floorf(top + mSnapshot->transform->getTranslateY() + 0.5f);
 
-            drawTextureMesh(x, y, x + right - left, y + bottom - top, texture->id, alpha / 255.0f,
-                    mode, texture->blend, (GLvoid*) 0, (GLvoid*) gMeshTextureOffset,
-                    GL_TRIANGLES, mesh->verticesCount, false, true, mesh->meshBuffer,
-                    true, !mesh->hasEmptyQuads);
+            drawPatchMesh(x, y, x + right - left, y + bottom - top, mesh, texture->id,
+                    alpha / 255.0f, mode, texture->blend, true);
         } else {
-            drawTextureMesh(left, top, right, bottom, texture->id, alpha / 255.0f,
-                    mode, texture->blend, (GLvoid*) 0, (GLvoid*) gMeshTextureOffset,
-                    GL_TRIANGLES, mesh->verticesCount, false, false, mesh->meshBuffer,
-                    true, !mesh->hasEmptyQuads);
+            drawPatchMesh(left, top, right, bottom, mesh, texture->id,
+                    alpha / 255.0f, mode, texture->blend, false);
         }
     }
 
@@ -2129,7 +2500,14 @@ status_t OpenGLRenderer::drawLines(float* points, int count, SkPaint* paint) {
     }
 
     if (generatedVerticesCount > 0) {
-       glDrawArrays(GL_TRIANGLE_STRIP, 0, generatedVerticesCount);
+        if (!isAA) {
+            setupDrawStreamedVertices(&lines[0], generatedVerticesCount * gVertexStride,
+                    gVertexStride);
+        } else {
+            setupDrawStreamedAALine(&wLines[0], generatedVerticesCount * gAAVertexStride,
+                    widthSlot, lengthSlot);
+        }
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, generatedVerticesCount);
     }
 
     if (isAA) {
@@ -2191,6 +2569,7 @@ status_t OpenGLRenderer::drawPoints(float* points, int count, SkPaint* paint) {
         dirtyLayer(left, top, right, bottom, *mSnapshot->transform);
     }
 
+    setupDrawStreamedVertices(&pointsData[0], generatedVerticesCount * gMeshStride, gMeshStride);
     glDrawArrays(GL_POINTS, 0, generatedVerticesCount);
 
     return DrawGlInfo::kStatusDrew;
@@ -2200,7 +2579,7 @@ status_t OpenGLRenderer::drawColor(int color, SkXfermode::Mode mode) {
     // No need to check against the clip, we fill the clip region
     if (mSnapshot->isIgnored()) return DrawGlInfo::kStatusDone;
 
-    Rect& clip(*mSnapshot->clipRect);
+    Rect clip(*mSnapshot->clipRect);
     clip.snapToPixelBoundaries();
 
     drawColorRect(clip.left, clip.top, clip.right, clip.bottom, color, mode, true);
@@ -2558,6 +2937,14 @@ status_t OpenGLRenderer::drawTextOnPath(const char* text, int bytesCount, int co
 status_t OpenGLRenderer::drawPath(SkPath* path, SkPaint* paint) {
     if (mSnapshot->isIgnored()) return DrawGlInfo::kStatusDone;
 
+    if (canDrawPathMesh(paint)) {
+        const PathMesh* mesh = mCaches.pathMeshCache.get(path, paint, *mSnapshot->transform);
+        if (mesh) {
+            drawPathMesh(mesh, paint);
+            return DrawGlInfo::kStatusDrew;
+        }
+    }
+
     mCaches.activeTexture(0);
 
     // TODO: Perform early clip test before we rasterize the path
@@ -2582,12 +2969,28 @@ status_t OpenGLRenderer::drawLayer(Layer* layer, float x, float y, SkPaint* pain
         OpenGLRenderer* renderer = layer->renderer;
         Rect& dirty = layer->dirtyRect;
 
-        interrupt();
-        renderer->setViewport(layer->layer.getWidth(), layer->layer.getHeight());
-        renderer->prepareDirty(dirty.left, dirty.top, dirty.right, dirty.bottom, !layer->isBlend());
-        renderer->drawDisplayList(layer->displayList, dirty, DisplayList::kReplayFlag_ClipChildren);
-        renderer->finish();
-        resume();
+        // The content may have been invalidated since the update was
+        // scheduled, the whole layer must then be redrawn
+        if (!layer->contentValid) {
+            dirty.set(0.0f, 0.0f, layer->layer.getWidth(), layer->layer.getHeight());
+        }
+
+        // The FBO keeps the rest of the layer, only the damaged area is
+        // cleared and replayed, under a scissor
+        if (!dirty.isEmpty()) {
+            Rect unused(dirty);
+
+            interrupt();
+            renderer->setViewport(layer->layer.getWidth(), layer->layer.getHeight());
+            renderer->prepareDirty(dirty.left, dirty.top, dirty.right, dirty.bottom,
+                    !layer->isBlend());
+            renderer->drawDisplayList(layer->displayList, unused,
+                    DisplayList::kReplayFlag_ClipChildren);
+            renderer->finish();
+            resume();
+
+            layer->contentValid = true;
+        }
 
         dirty.setEmpty();
         layer->deferredUpdateScheduled = false;
@@ -2724,6 +3127,54 @@ SkPaint* OpenGLRenderer::filterPaint(SkPaint* paint) {
 // Drawing implementation
 ///////////////////////////////////////////////////////////////////////////////
 
+bool OpenGLRenderer::canDrawPathMesh(SkPaint* paint) {
+    if (paint->getStyle() == SkPaint::kFill_Style) return true;
+
+    // The triangles of a stroke overlap at joins and crossings; drawing
+    // them twice only gives the same result if the stroke is opaque
+    int alpha;
+    SkXfermode::Mode mode;
+    getAlphaAndMode(paint, &alpha, &mode);
+
+    return alpha == 255 && mode == SkXfermode::kSrcOver_Mode &&
+            (!mShader || !mShader->blend()) && (!mColorFilter || !mColorFilter->blend());
+}
+
+void OpenGLRenderer::drawPathMesh(const PathMesh* mesh, SkPaint* paint) {
+    const Rect& bounds = mesh->bounds;
+    if (mesh->vertices.isEmpty() ||
+            quickReject(bounds.left, bounds.top, bounds.right, bounds.bottom)) {
+        return;
+    }
+
+    int alpha;
+    SkXfermode::Mode mode;
+    getAlphaAndMode(paint, &alpha, &mode);
+
+    setupDraw();
+    setupDrawNoTexture();
+    if (mesh->hasAlpha) {
+        setupDrawVertexAlpha();
+    }
+    setupDrawColor(paint->getColor(), alpha);
+    setupDrawColorFilter();
+    setupDrawShader();
+    setupDrawBlending(mesh->hasAlpha, mode);
+    setupDrawProgram();
+    // The mesh is in the path's coordinates
+    setupDrawModelView(bounds.left, bounds.top, bounds.right, bounds.bottom, false, true);
+    setupDrawColorUniforms();
+    setupDrawColorFilterUniforms();
+    setupDrawShaderUniforms();
+
+    int alphaSlot;
+    setupDrawAlphaVertices((GLvoid*) mesh->vertices.array(), alphaSlot);
+
+    glDrawArrays(GL_TRIANGLES, 0, mesh->vertices.size());
+
+    finishDrawAlphaVertices(alphaSlot);
+}
+
 void OpenGLRenderer::drawPathTexture(const PathTexture* texture,
         float x, float y, SkPaint* paint) {
     if (quickReject(x, y, x + texture->width, y + texture->height)) {
@@ -2851,19 +3302,32 @@ void OpenGLRenderer::drawTextureRect(float left, float top, float right, float b
 
     texture->setWrap(GL_CLAMP_TO_EDGE, true);
 
+    // Textures stored in an atlas page cannot use the default unit quad
+    GLvoid* vertices = (GLvoid*) NULL;
+    GLvoid* texCoords = (GLvoid*) gMeshTextureOffset;
+    if (texture->page) {
+        mCaches.unbindMeshBuffer();
+        resetDrawTextureTexCoords(texture->u1, texture->v1, texture->u2, texture->v2);
+        vertices = &mMeshVertices[0].position[0];
+        texCoords = &mMeshVertices[0].texture[0];
+    }
+
     if (CC_LIKELY(mSnapshot->transform->isPureTranslate())) {
         const float x = (int) floorf(left + mSnapshot->transform->getTranslateX() + 0.5f);
         const float y = (int) floorf(top + mSnapshot->transform->getTranslateY() + 0.5f);
 
         texture->setFilter(GL_NEAREST, true);
         drawTextureMesh(x, y, x + texture->width, y + texture->height, texture->id,
-                alpha / 255.0f, mode, texture->blend, (GLvoid*) NULL,
-                (GLvoid*) gMeshTextureOffset, GL_TRIANGLE_STRIP, gMeshCount, false, true);
+                alpha / 255.0f, mode, texture->blend, vertices, texCoords,
+                GL_TRIANGLE_STRIP, gMeshCount, false, true);
     } else {
         texture->setFilter(FILTER(paint), true);
         drawTextureMesh(left, top, right, bottom, texture->id, alpha / 255.0f, mode,
-                texture->blend, (GLvoid*) NULL, (GLvoid*) gMeshTextureOffset,
-                GL_TRIANGLE_STRIP, gMeshCount);
+                texture->blend, vertices, texCoords, GL_TRIANGLE_STRIP, gMeshCount);
+    }
+
+    if (texture->page) {
+        resetDrawTextureTexCoords(0.0f, 0.0f, 1.0f, 1.0f);
     }
 }
 
@@ -2902,6 +3366,59 @@ void OpenGLRenderer::drawTextureMesh(float left, float top, float right, float b
     finishDrawTexture();
 }
 
+void OpenGLRenderer::drawBitmapMeshBuffers(const BitmapMesh* mesh, Texture* texture,
+        float alpha, SkXfermode::Mode mode) {
+    setupDraw();
+    setupDrawWithTexture();
+    if (mesh->hasColors) {
+        setupDrawVertexColor();
+    }
+    setupDrawColor(alpha, alpha, alpha, alpha);
+    setupDrawColorFilter();
+    setupDrawBlending(texture->blend || mesh->hasColors, mode);
+    setupDrawProgram();
+    setupDrawDirtyRegionsDisabled();
+    setupDrawModelView(0.0f, 0.0f, 1.0f, 1.0f);
+    setupDrawPureColorUniforms();
+    setupDrawColorFilterUniforms();
+    setupDrawTexture(texture->id);
+
+    int colorSlot;
+    setupDrawBitmapMesh(mesh, colorSlot);
+
+    glDrawElements(GL_TRIANGLES, mesh->indicesCount, GL_UNSIGNED_SHORT, NULL);
+
+    finishDrawBitmapMesh(colorSlot);
+    finishDrawTexture();
+}
+
+void OpenGLRenderer::drawPatchMesh(float left, float top, float right, float bottom,
+        const Patch* mesh, GLuint texture, float alpha, SkXfermode::Mode mode, bool blend,
+        bool ignoreTransform) {
+
+    setupDraw();
+    setupDrawWithTexture();
+    setupDrawNinePatch();
+    setupDrawColor(alpha, alpha, alpha, alpha);
+    setupDrawColorFilter();
+    setupDrawBlending(blend, mode);
+    setupDrawProgram();
+    // Patches with empty quads dirty the layer quad by quad
+    if (mesh->hasEmptyQuads) {
+        setupDrawDirtyRegionsDisabled();
+    }
+    setupDrawModelViewTranslate(left, top, right, bottom, ignoreTransform);
+    setupDrawPureColorUniforms();
+    setupDrawColorFilterUniforms();
+    setupDrawTexture(texture);
+    setupDrawNinePatchUniforms(mesh, right - left, bottom - top);
+    setupDrawNinePatchMesh(mesh->meshBuffer);
+
+    glDrawArrays(GL_TRIANGLES, 0, mesh->verticesCount);
+
+    finishDrawTexture();
+}
+
 void OpenGLRenderer::chooseBlending(bool blend, SkXfermode::Mode mode,
         ProgramDescription& description, bool swapSrcDst) {
     blend = blend || mode != SkXfermode::kSrcOver_Mode;
@@ -2917,33 +3434,21 @@ void OpenGLRenderer::chooseBlending(bool blend, SkXfermode::Mode mode,
                 description.framebufferMode = mode;
                 description.swapSrcDst = swapSrcDst;
 
-                if (mCaches.blend) {
-                    glDisable(GL_BLEND);
-                    mCaches.blend = false;
-                }
-
+                mCaches.setBlend(false);
                 return;
             } else {
                 mode = SkXfermode::kSrcOver_Mode;
             }
         }
 
-        if (!mCaches.blend) {
-            glEnable(GL_BLEND);
-        }
+        mCaches.setBlend(true);
 
         GLenum sourceMode = swapSrcDst ? gBlendsSwap[mode].src : gBlends[mode].src;
         GLenum destMode = swapSrcDst ? gBlendsSwap[mode].dst : gBlends[mode].dst;
-
-        if (sourceMode != mCaches.lastSrcMode || destMode != mCaches.lastDstMode) {
-            glBlendFunc(sourceMode, destMode);
-            mCaches.lastSrcMode = sourceMode;
-            mCaches.lastDstMode = destMode;
-        }
-    } else if (mCaches.blend) {
-        glDisable(GL_BLEND);
+        mCaches.setBlendFunc(sourceMode, destMode);
+    } else {
+        mCaches.setBlend(false);
     }
-    mCaches.blend = blend;
 }
 
 bool OpenGLRenderer::useProgram(Program* program) {
@@ -2951,8 +3456,10 @@ bool OpenGLRenderer::useProgram(Program* program) {
         if (mCaches.currentProgram != NULL) mCaches.currentProgram->remove();
         program->use();
         mCaches.currentProgram = program;
+        mCaches.frameStats.countProgramSwitch();
         return false;
     }
+    mCaches.frameStats.countRedundantCall();
     return true;
 }
 
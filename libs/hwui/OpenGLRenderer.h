@@ -54,6 +54,21 @@ namespace uirenderer {
 
 class DisplayList;
 
+/**
+ * Describes a bitmap draw deferred by OpenGLRenderer::deferBitmap(). The
+ * bounds are expressed in window coordinates and snapped to pixels. The
+ * texture is the name of the GL texture the bitmap was stored in when it
+ * was deferred, bitmaps packed in the same atlas page share it.
+ */
+struct DeferredBitmap {
+    SkBitmap* bitmap;
+    GLuint texture;
+    bool blend;
+    int alpha;
+    SkXfermode::Mode mode;
+    Rect bounds;
+}; // struct DeferredBitmap
+
 /**
  * OpenGL renderer used to draw accelerated 2D graphics. The API is a
  * simplified version of Skia's Canvas API.
@@ -114,6 +129,7 @@ public:
     virtual status_t drawDisplayList(DisplayList* displayList, Rect& dirty, int32_t flags,
             uint32_t level = 0);
     virtual void outputDisplayList(DisplayList* displayList, uint32_t level = 0);
+    virtual status_t drawPicture(SkPicture* picture, Rect& dirty);
     virtual status_t drawLayer(Layer* layer, float x, float y, SkPaint* paint);
     virtual status_t drawBitmap(SkBitmap* bitmap, float left, float top, SkPaint* paint);
     virtual status_t drawBitmap(SkBitmap* bitmap, SkMatrix* matrix, SkPaint* paint);
@@ -158,6 +174,33 @@ public:
 
     SkPaint* filterPaint(SkPaint* paint);
 
+    /**
+     * Indicates whether opaque paints are drawn opaque: no global alpha,
+     * shader, color filter or paint filter is applied to them.
+     */
+    bool preservesOpacity() const {
+        return mSnapshot->alpha >= 1.0f && !mShader && !mColorFilter && !mHasDrawFilter;
+    }
+
+    /**
+     * Queues the specified bitmap to be drawn later by flushDeferredBitmaps().
+     * Queued bitmaps that share the same texture, alpha and blending mode are
+     * drawn with a single draw call. Bitmaps can only be deferred when the
+     * current transform is a pure translation; the caller must draw the bitmap
+     * with drawBitmap() when this method returns false.
+     *
+     * The caller is responsible for flushing deferred bitmaps before any
+     * operation that modifies the clip, the current layer or draws anything.
+     *
+     * @return True if the bitmap was deferred or rejected, false otherwise
+     */
+    bool deferBitmap(SkBitmap* bitmap, float left, float top, SkPaint* paint);
+
+    /**
+     * Draws all the bitmaps queued with deferBitmap().
+     */
+    status_t flushDeferredBitmaps();
+
     ANDROID_API static uint32_t getStencilSize();
 
     void startMark(const char* name) const;
@@ -209,7 +252,9 @@ protected:
     }
 
     /**
-     * Renders the specified layer as a textured quad.
+     * Renders the specified texture layer as a textured quad. The quad
+     * samples the layer's texture, which can be the GL_TEXTURE_EXTERNAL_OES
+     * texture of a SurfaceTexture, directly into the current target.
      *
      * @param layer The layer to render
      * @param rect The bounds of the layer
@@ -436,6 +481,36 @@ private:
             bool swapSrcDst = false, bool ignoreTransform = false, GLuint vbo = 0,
             bool ignoreScale = false, bool dirty = true);
 
+    /**
+     * Draws the specified 9-patch mesh, stretched by the vertex shader to
+     * fill the specified bounds.
+     *
+     * @param left The left coordinate of the patch
+     * @param top The top coordinate of the patch
+     * @param right The right coordinate of the patch
+     * @param bottom The bottom coordinate of the patch
+     * @param mesh The mesh of the patch
+     * @param texture The texture name to map onto the patch
+     * @param alpha An additional translucency parameter, between 0.0f and 1.0f
+     * @param mode The blending mode
+     * @param blend True if the texture contains an alpha channel
+     * @param ignoreTransform True if the current transform should be ignored
+     */
+    void drawPatchMesh(float left, float top, float right, float bottom, const Patch* mesh,
+            GLuint texture, float alpha, SkXfermode::Mode mode, bool blend,
+            bool ignoreTransform);
+
+    /**
+     * Draws a bitmap mesh stored in VBOs.
+     *
+     * @param mesh The mesh, see BitmapMeshCache
+     * @param texture The texture of the bitmap
+     * @param alpha An additional translucency parameter, between 0.0f and 1.0f
+     * @param mode The blending mode
+     */
+    void drawBitmapMeshBuffers(const BitmapMesh* mesh, Texture* texture, float alpha,
+            SkXfermode::Mode mode);
+
     /**
      * Draws text underline and strike-through if needed.
      *
@@ -460,6 +535,20 @@ private:
      */
     void drawPathTexture(const PathTexture* texture, float x, float y, SkPaint* paint);
 
+    /**
+     * Indicates whether a path drawn with the specified paint may be drawn
+     * with a tessellated mesh.
+     */
+    bool canDrawPathMesh(SkPaint* paint);
+
+    /**
+     * Draws a tessellated path.
+     *
+     * @param mesh The mesh generated for the path
+     * @param paint The paint to render with
+     */
+    void drawPathMesh(const PathMesh* mesh, SkPaint* paint);
+
     /**
      * Resets the texture coordinates stored in mMeshVertices. Setting the values
      * back to default is achieved by calling:
@@ -488,7 +577,7 @@ private:
      * prior to calling this method.
      */
     inline void bindTexture(GLuint texture) {
-        glBindTexture(GL_TEXTURE_2D, texture);
+        mCaches.bindTexture(texture);
     }
 
     /**
@@ -496,7 +585,7 @@ private:
      * prior to calling this method.
      */
     inline void bindExternalTexture(GLuint texture) {
-        glBindTexture(GL_TEXTURE_EXTERNAL_OES, texture);
+        mCaches.bindTexture(GL_TEXTURE_EXTERNAL_OES, texture);
     }
 
     /**
@@ -535,7 +624,10 @@ private:
     void setupDrawWithExternalTexture();
     void setupDrawNoTexture();
     void setupDrawAALine();
+    void setupDrawVertexAlpha();
+    void setupDrawVertexColor();
     void setupDrawPoint(float pointSize);
+    void setupDrawNinePatch();
     void setupDrawColor(int color);
     void setupDrawColor(int color, int alpha);
     void setupDrawColor(float r, float g, float b, float a);
@@ -564,17 +656,49 @@ private:
     void setupDrawExternalTexture(GLuint texture);
     void setupDrawTextureTransform();
     void setupDrawTextureTransformUniforms(mat4& transform);
+    void setupDrawNinePatchUniforms(const Patch* mesh, float width, float height);
+    void setupDrawNinePatchMesh(GLuint vbo);
+    void setupDrawBitmapMesh(const BitmapMesh* mesh, int& colorSlot);
+    void finishDrawBitmapMesh(const int colorSlot);
     void setupDrawMesh(GLvoid* vertices, GLvoid* texCoords = NULL, GLuint vbo = 0);
     void setupDrawMeshIndices(GLvoid* vertices, GLvoid* texCoords);
     void setupDrawVertices(GLvoid* vertices);
     void setupDrawAALine(GLvoid* vertices, GLvoid* distanceCoords, GLvoid* lengthCoords,
             float strokeWidth, int& widthSlot, int& lengthSlot);
+    void setupDrawStreamedVertices(GLvoid* vertices, GLsizeiptr size, GLsizei stride);
+    void setupDrawStreamedAALine(GLvoid* vertices, GLsizeiptr size,
+            int widthSlot, int lengthSlot);
     void finishDrawAALine(const int widthSlot, const int lengthSlot);
+    void setupDrawAlphaVertices(GLvoid* vertices, int& alphaSlot);
+    void finishDrawAlphaVertices(const int alphaSlot);
     void finishDrawTexture();
     void accountForClear(SkXfermode::Mode mode);
 
     void drawRegionRects(const Region& region);
 
+    /**
+     * Returns true if bitmaps drawn by this renderer may be uploaded in the
+     * background. Only renderers targeting the window are redrawn until
+     * the uploads complete.
+     */
+    bool allowPendingTextures() {
+        return getTargetFbo() == 0;
+    }
+
+    /**
+     * Invoked in place of drawing a bitmap whose texture is still pending.
+     * Draws the placeholder, if any, and records the area that must be
+     * redrawn once the texture is ready.
+     */
+    void drawPendingTexture(float left, float top, float right, float bottom);
+
+    /**
+     * Draws the deferred bitmaps matching the entry at the specified index,
+     * starting at that index, in a single batch. If merge is false, only
+     * the entry at the specified index is drawn.
+     */
+    void drawDeferredBitmapBatch(size_t start, bool* drawn, bool merge = true);
+
     /**
      * Should be invoked every time the glScissor is modified.
      */
@@ -647,6 +771,15 @@ private:
     // Track dirty regions, true by default
     bool mTrackDirtyRegions;
 
+    // Bitmaps waiting to be drawn in batches, see deferBitmap()
+    Vector<DeferredBitmap> mDeferredBitmaps;
+    // Clip the deferred bitmaps were recorded with
+    Rect mDeferredClip;
+
+    // Window area covered by bitmaps whose texture is still pending,
+    // reported as dirty by drawDisplayList()
+    Rect mPendingDirty;
+
     friend class DisplayListRenderer;
 
 }; // class OpenGLRenderer
@@ -32,12 +32,13 @@ namespace uirenderer {
 ///////////////////////////////////////////////////////////////////////////////
 
 Patch::Patch(const uint32_t xCount, const uint32_t yCount, const int8_t emptyQuads):
-        mXCount(xCount), mYCount(yCount), mEmptyQuads(emptyQuads) {
+        bitmapWidth(0.0f), bitmapHeight(0.0f), mXCount(xCount), mYCount(yCount),
+        mEmptyQuads(emptyQuads), mStretchableWidth(0.0f), mStretchableHeight(0.0f),
+        mStretchLastColumn(false) {
     // Initialized with the maximum number of vertices we will need
     // 2 triangles per patch, 3 vertices per triangle
     uint32_t maxVertices = ((xCount + 1) * (yCount + 1) - emptyQuads) * 2 * 3;
-    mVertices = new TextureVertex[maxVertices];
-    mUploaded = false;
+    mVertices = new PatchVertex[maxVertices];
 
     verticesCount = 0;
     hasEmptyQuads = emptyQuads > 0;
@@ -106,165 +107,186 @@ bool Patch::matches(const int32_t* xDivs, const int32_t* yDivs, const uint32_t c
 // Vertices management
 ///////////////////////////////////////////////////////////////////////////////
 
-void Patch::updateVertices(const float bitmapWidth, const float bitmapHeight,
-        float left, float top, float right, float bottom) {
+float Patch::getStretchableSize(const int32_t* divs, const uint32_t count,
+        const float bitmapSize, bool& stretchLast) {
+    float stretchable = 0.0f;
+    for (uint32_t i = 1; i < count; i += 2) {
+        stretchable += divs[i] - divs[i - 1];
+    }
+
+    // Without stretchable segments, the last segment fills the patch
+    stretchLast = stretchable == 0.0f;
+    if (stretchLast) {
+        stretchable = bitmapSize - (count > 0 ? divs[count - 1] : 0.0f);
+    }
+
+    return stretchable;
+}
+
+void Patch::computeStretch(const float size, const float bitmapSize,
+        const float stretchable, float& stretch, float& inset) {
+    stretch = 0.0f;
+    inset = 0.0f;
+
+    if (stretchable > 0.0f) {
+        stretch = (size - (bitmapSize - stretchable)) / stretchable;
+        // Inset stretched segments so their first and last pixels sample
+        // the center of the edge texels instead of the neighbouring segments
+        if (stretch != 0.0f) {
+            inset = 0.5f - 0.5f / stretch;
+        }
+    }
+}
+
+void Patch::getStretch(const float width, const float height, float* stretch) const {
+    computeStretch(width, bitmapWidth, mStretchableWidth, stretch[0], stretch[2]);
+    computeStretch(height, bitmapHeight, mStretchableHeight, stretch[1], stretch[3]);
+}
+
+void Patch::updateVertices(const float bitmapWidth, const float bitmapHeight) {
 #if RENDER_LAYERS_AS_REGIONS
     if (hasEmptyQuads) quads.clear();
 #endif
 
+    this->bitmapWidth = bitmapWidth;
+    this->bitmapHeight = bitmapHeight;
+
     // Reset the vertices count here, we will count exactly how many
     // vertices we actually need when generating the quads
     verticesCount = 0;
 
-    const uint32_t xStretchCount = (mXCount + 1) >> 1;
-    const uint32_t yStretchCount = (mYCount + 1) >> 1;
+    bool stretchLastRow = false;
+    mStretchableWidth = getStretchableSize(mXDivs, mXCount, bitmapWidth, mStretchLastColumn);
+    mStretchableHeight = getStretchableSize(mYDivs, mYCount, bitmapHeight, stretchLastRow);
 
-    float stretchX = 0.0f;
-    float stretchY = 0.0;
-
-    const float meshWidth = right - left;
-
-    if (xStretchCount > 0) {
-        uint32_t stretchSize = 0;
-        for (uint32_t i = 1; i < mXCount; i += 2) {
-            stretchSize += mXDivs[i] - mXDivs[i - 1];
-        }
-        const float xStretchTex = stretchSize;
-        const float fixed = bitmapWidth - stretchSize;
-        const float xStretch = right - left - fixed;
-        stretchX = xStretch / xStretchTex;
-    }
-
-    if (yStretchCount > 0) {
-        uint32_t stretchSize = 0;
-        for (uint32_t i = 1; i < mYCount; i += 2) {
-            stretchSize += mYDivs[i] - mYDivs[i - 1];
-        }
-        const float yStretchTex = stretchSize;
-        const float fixed = bitmapHeight - stretchSize;
-        const float yStretch = bottom - top - fixed;
-        stretchY = yStretch / yStretchTex;
-    }
-
-    TextureVertex* vertex = mVertices;
+    PatchVertex* vertex = mVertices;
     uint32_t quadCount = 0;
 
     float previousStepY = 0.0f;
 
-    float y1 = 0.0f;
-    float y2 = 0.0f;
-    float v1 = 0.0f;
+    Edge y1;
+    Edge y2;
 
     for (uint32_t i = 0; i < mYCount; i++) {
-        float stepY = mYDivs[i];
+        const float stepY = mYDivs[i];
         const float segment = stepY - previousStepY;
+        const bool stretch = i & 1;
 
-        if (i & 1) {
-            y2 = y1 + floorf(segment * stretchY + 0.5f);
+        y2 = y1;
+        y2.texel = stepY;
+        if (stretch) {
+            y2.stretchable += segment;
         } else {
-            y2 = y1 + segment;
+            y2.position += segment;
         }
-
-        float vOffset = y1 == y2 ? 0.0f : 0.5 - (0.5 * segment / (y2 - y1));
-        float v2 = fmax(0.0f, stepY - vOffset) / bitmapHeight;
-        v1 += vOffset / bitmapHeight;
+        y1.inset = stretch ? 1.0f : 0.0f;
+        y2.inset = stretch ? -1.0f : 0.0f;
 
         if (stepY > 0.0f) {
 #if DEBUG_EXPLODE_PATCHES
-            y1 += i * EXPLODE_GAP;
-            y2 += i * EXPLODE_GAP;
+            y1.position += i * EXPLODE_GAP;
+            y2.position += i * EXPLODE_GAP;
 #endif
-            generateRow(vertex, y1, y2, v1, v2, stretchX, right - left,
-                    bitmapWidth, quadCount);
+            generateRow(vertex, y1, y2, quadCount);
 #if DEBUG_EXPLODE_PATCHES
-            y2 -= i * EXPLODE_GAP;
+            y2.position -= i * EXPLODE_GAP;
 #endif
         }
 
         y1 = y2;
-        v1 = stepY / bitmapHeight;
-
         previousStepY = stepY;
     }
 
     if (previousStepY != bitmapHeight) {
-        y2 = bottom - top;
+        const float segment = bitmapHeight - previousStepY;
+
+        y2 = y1;
+        y2.texel = bitmapHeight;
+        if (stretchLastRow) {
+            y2.stretchable += segment;
+        } else {
+            y2.position += segment;
+        }
+        y1.inset = y2.inset = 0.0f;
 #if DEBUG_EXPLODE_PATCHES
-        y1 += mYCount * EXPLODE_GAP;
-        y2 += mYCount * EXPLODE_GAP;
+        y1.position += mYCount * EXPLODE_GAP;
+        y2.position += mYCount * EXPLODE_GAP;
 #endif
-        generateRow(vertex, y1, y2, v1, 1.0f, stretchX, right - left, bitmapWidth, quadCount);
+        generateRow(vertex, y1, y2, quadCount);
     }
 
+    // The mesh only changes with the divs, it does not depend on the size
+    // the patch is drawn at
     if (verticesCount > 0) {
         Caches& caches = Caches::getInstance();
         caches.bindMeshBuffer(meshBuffer);
-        if (!mUploaded) {
-            glBufferData(GL_ARRAY_BUFFER, sizeof(TextureVertex) * verticesCount,
-                    mVertices, GL_DYNAMIC_DRAW);
-            mUploaded = true;
-        } else {
-            glBufferSubData(GL_ARRAY_BUFFER, 0,
-                    sizeof(TextureVertex) * verticesCount, mVertices);
-        }
+        glBufferData(GL_ARRAY_BUFFER, sizeof(PatchVertex) * verticesCount,
+                mVertices, GL_STATIC_DRAW);
         caches.resetVertexPointers();
     }
 
     PATCH_LOGD("    patch: new vertices count = %d", verticesCount);
 }
 
-void Patch::generateRow(TextureVertex*& vertex, float y1, float y2, float v1, float v2,
-        float stretchX, float width, float bitmapWidth, uint32_t& quadCount) {
+void Patch::generateRow(PatchVertex*& vertex, const Edge& top, const Edge& bottom,
+        uint32_t& quadCount) {
     float previousStepX = 0.0f;
 
-    float x1 = 0.0f;
-    float x2 = 0.0f;
-    float u1 = 0.0f;
+    Edge x1;
+    Edge x2;
 
     // Generate the row quad by quad
     for (uint32_t i = 0; i < mXCount; i++) {
-        float stepX = mXDivs[i];
+        const float stepX = mXDivs[i];
         const float segment = stepX - previousStepX;
+        const bool stretch = i & 1;
 
-        if (i & 1) {
-            x2 = x1 + floorf(segment * stretchX + 0.5f);
+        x2 = x1;
+        x2.texel = stepX;
+        if (stretch) {
+            x2.stretchable += segment;
         } else {
-            x2 = x1 + segment;
+            x2.position += segment;
         }
-
-        float uOffset = x1 == x2 ? 0.0f : 0.5 - (0.5 * segment / (x2 - x1));
-        float u2 = fmax(0.0f, stepX - uOffset) / bitmapWidth;
-        u1 += uOffset / bitmapWidth;
+        x1.inset = stretch ? 1.0f : 0.0f;
+        x2.inset = stretch ? -1.0f : 0.0f;
 
         if (stepX > 0.0f) {
 #if DEBUG_EXPLODE_PATCHES
-            x1 += i * EXPLODE_GAP;
-            x2 += i * EXPLODE_GAP;
+            x1.position += i * EXPLODE_GAP;
+            x2.position += i * EXPLODE_GAP;
 #endif
-            generateQuad(vertex, x1, y1, x2, y2, u1, v1, u2, v2, quadCount);
+            generateQuad(vertex, x1, top, x2, bottom, quadCount);
 #if DEBUG_EXPLODE_PATCHES
-            x2 -= i * EXPLODE_GAP;
+            x2.position -= i * EXPLODE_GAP;
 #endif
         }
 
         x1 = x2;
-        u1 = stepX / bitmapWidth;
-
         previousStepX = stepX;
     }
 
     if (previousStepX != bitmapWidth) {
-        x2 = width;
+        const float segment = bitmapWidth - previousStepX;
+
+        x2 = x1;
+        x2.texel = bitmapWidth;
+        if (mStretchLastColumn) {
+            x2.stretchable += segment;
+        } else {
+            x2.position += segment;
+        }
+        x1.inset = x2.inset = 0.0f;
 #if DEBUG_EXPLODE_PATCHES
-        x1 += mXCount * EXPLODE_GAP;
-        x2 += mXCount * EXPLODE_GAP;
+        x1.position += mXCount * EXPLODE_GAP;
+        x2.position += mXCount * EXPLODE_GAP;
 #endif
-        generateQuad(vertex, x1, y1, x2, y2, u1, v1, 1.0f, v2, quadCount);
+        generateQuad(vertex, x1, top, x2, bottom, quadCount);
     }
 }
 
-void Patch::generateQuad(TextureVertex*& vertex, float x1, float y1, float x2, float y2,
-            float u1, float v1, float u2, float v2, uint32_t& quadCount) {
+void Patch::generateQuad(PatchVertex*& vertex, const Edge& left, const Edge& top,
+        const Edge& right, const Edge& bottom, uint32_t& quadCount) {
     const uint32_t oldQuadCount = quadCount;
     quadCount++;
 
@@ -272,8 +294,12 @@ void Patch::generateQuad(TextureVertex*& vertex, float x1, float y1, float x2, f
     if ((mColorKey >> oldQuadCount) & 0x1) {
 #if DEBUG_PATCHES_EMPTY_VERTICES
         PATCH_LOGD("    quad %d (empty)", oldQuadCount);
-        PATCH_LOGD("        left,  top    = %.2f, %.2f\t\tu1, v1 = %.4f, %.4f", x1, y1, u1, v1);
-        PATCH_LOGD("        right, bottom = %.2f, %.2f\t\tu2, v2 = %.4f, %.4f", x2, y2, u2, v2);
+        PATCH_LOGD("        left,  top    = %.2f+%.2fs, %.2f+%.2fs\t\tu1, v1 = %.2f, %.2f",
+                left.position, left.stretchable, top.position, top.stretchable,
+                left.texel, top.texel);
+        PATCH_LOGD("        right, bottom = %.2f+%.2fs, %.2f+%.2fs\t\tu2, v2 = %.2f, %.2f",
+                right.position, right.stretchable, bottom.position, bottom.stretchable,
+                right.texel, bottom.texel);
 #endif
         return;
     }
@@ -281,28 +307,35 @@ void Patch::generateQuad(TextureVertex*& vertex, float x1, float y1, float x2, f
 #if RENDER_LAYERS_AS_REGIONS
     // Record all non empty quads
     if (hasEmptyQuads) {
-        Rect bounds(x1, y1, x2, y2);
-        quads.add(bounds);
+        PatchQuad quad;
+        quad.fixed.set(left.position, top.position, right.position, bottom.position);
+        quad.stretchable.set(left.stretchable, top.stretchable,
+                right.stretchable, bottom.stretchable);
+        quads.add(quad);
     }
 #endif
 
     // Left triangle
-    TextureVertex::set(vertex++, x1, y1, u1, v1);
-    TextureVertex::set(vertex++, x2, y1, u2, v1);
-    TextureVertex::set(vertex++, x1, y2, u1, v2);
+    setVertex(vertex++, left, top);
+    setVertex(vertex++, right, top);
+    setVertex(vertex++, left, bottom);
 
     // Right triangle
-    TextureVertex::set(vertex++, x1, y2, u1, v2);
-    TextureVertex::set(vertex++, x2, y1, u2, v1);
-    TextureVertex::set(vertex++, x2, y2, u2, v2);
+    setVertex(vertex++, left, bottom);
+    setVertex(vertex++, right, top);
+    setVertex(vertex++, right, bottom);
 
     // A quad is made of 2 triangles, 6 vertices
     verticesCount += 6;
 
 #if DEBUG_PATCHES_VERTICES
     PATCH_LOGD("    quad %d", oldQuadCount);
-    PATCH_LOGD("        left,  top    = %.2f, %.2f\t\tu1, v1 = %.4f, %.4f", x1, y1, u1, v1);
-    PATCH_LOGD("        right, bottom = %.2f, %.2f\t\tu2, v2 = %.4f, %.4f", x2, y2, u2, v2);
+    PATCH_LOGD("        left,  top    = %.2f+%.2fs, %.2f+%.2fs\t\tu1, v1 = %.2f, %.2f",
+            left.position, left.stretchable, top.position, top.stretchable,
+            left.texel, top.texel);
+    PATCH_LOGD("        right, bottom = %.2f+%.2fs, %.2f+%.2fs\t\tu2, v2 = %.2f, %.2f",
+            right.position, right.stretchable, bottom.position, bottom.stretchable,
+            right.texel, bottom.texel);
 #endif
 }
 
@@ -19,6 +19,8 @@
 
 #include <sys/types.h>
 
+#include <cmath>
+
 #include <GLES2/gl2.h>
 
 #include <utils/Vector.h>
@@ -40,16 +42,46 @@ namespace uirenderer {
 // 9-patch structures
 ///////////////////////////////////////////////////////////////////////////////
 
+/**
+ * Bounds of a quad of a patch. The actual bounds are computed for a given
+ * size by adding the stretchable bounds scaled by the stretch factors to
+ * the fixed bounds.
+ */
+struct PatchQuad {
+    Rect fixed;
+    Rect stretchable;
+}; // struct PatchQuad
+
 /**
  * An OpenGL patch. This contains an array of vertices and an array of
  * indices to render the vertices.
+ *
+ * The vertices do not depend on the size the patch is drawn at: they are
+ * uploaded once and stretched by the vertex shader using the stretch
+ * factors returned by getStretch().
  */
 struct Patch {
     Patch(const uint32_t xCount, const uint32_t yCount, const int8_t emptyQuads = 0);
     ~Patch();
 
-    void updateVertices(const float bitmapWidth, const float bitmapHeight,
-            float left, float top, float right, float bottom);
+    void updateVertices(const float bitmapWidth, const float bitmapHeight);
+
+    /**
+     * Computes the stretch factors (x, y) and the texture insets, in texels,
+     * (z, w) required to draw this patch at the specified size.
+     */
+    void getStretch(const float width, const float height, float* stretch) const;
+
+    /**
+     * Computes the bounds of the specified quad for the stretch factors
+     * returned by getStretch().
+     */
+    static inline void getQuadBounds(const PatchQuad& quad, const float* stretch, Rect& bounds) {
+        bounds.set(quad.fixed.left + floorf(quad.stretchable.left * stretch[0] + 0.5f),
+                quad.fixed.top + floorf(quad.stretchable.top * stretch[1] + 0.5f),
+                quad.fixed.right + floorf(quad.stretchable.right * stretch[0] + 0.5f),
+                quad.fixed.bottom + floorf(quad.stretchable.bottom * stretch[1] + 0.5f));
+    }
 
     void updateColorKey(const uint32_t colorKey);
     void copy(const int32_t* xDivs, const int32_t* yDivs);
@@ -58,11 +90,26 @@ struct Patch {
     GLuint meshBuffer;
     uint32_t verticesCount;
     bool hasEmptyQuads;
-    Vector<Rect> quads;
+    Vector<PatchQuad> quads;
+
+    float bitmapWidth;
+    float bitmapHeight;
 
 private:
-    TextureVertex* mVertices;
-    bool mUploaded;
+    /**
+     * Edge of a row or of a column of the mesh.
+     */
+    struct Edge {
+        Edge(): position(0.0f), stretchable(0.0f), texel(0.0f), inset(0.0f) {
+        }
+
+        float position;
+        float stretchable;
+        float texel;
+        float inset;
+    };
+
+    PatchVertex* mVertices;
 
     int32_t* mXDivs;
     int32_t* mYDivs;
@@ -72,15 +119,28 @@ private:
     uint32_t mYCount;
     int8_t mEmptyQuads;
 
+    // Stretchable size of the bitmap, in bitmap pixels
+    float mStretchableWidth;
+    float mStretchableHeight;
+    // The last column is stretched when no other column is stretchable
+    bool mStretchLastColumn;
+
     void copy(const int32_t* yDivs);
 
-    void generateRow(TextureVertex*& vertex, float y1, float y2,
-            float v1, float v2, float stretchX, float width, float bitmapWidth,
-            uint32_t& quadCount);
-    void generateQuad(TextureVertex*& vertex,
-            float x1, float y1, float x2, float y2,
-            float u1, float v1, float u2, float v2,
+    static float getStretchableSize(const int32_t* divs, const uint32_t count,
+            const float bitmapSize, bool& stretchLast);
+    static void computeStretch(const float size, const float bitmapSize,
+            const float stretchable, float& stretch, float& inset);
+
+    static inline void setVertex(PatchVertex* vertex, const Edge& x, const Edge& y) {
+        PatchVertex::set(vertex, x.position, y.position, x.stretchable, y.stretchable,
+                x.texel, y.texel, x.inset, y.inset);
+    }
+
+    void generateRow(PatchVertex*& vertex, const Edge& top, const Edge& bottom,
             uint32_t& quadCount);
+    void generateQuad(PatchVertex*& vertex, const Edge& left, const Edge& top,
+            const Edge& right, const Edge& bottom, uint32_t& quadCount);
 }; // struct Patch
 
 }; // namespace uirenderer
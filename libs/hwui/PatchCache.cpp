@@ -51,7 +51,6 @@ void PatchCache::clear() {
 }
 
 Patch* PatchCache::get(const float bitmapWidth, const float bitmapHeight,
-        const float pixelWidth, const float pixelHeight,
         const int32_t* xDivs, const int32_t* yDivs, const uint32_t* colors,
         const uint32_t width, const uint32_t height, const int8_t numColors) {
 
@@ -73,7 +72,7 @@ Patch* PatchCache::get(const float bitmapWidth, const float bitmapHeight,
     }
 
     const PatchDescription description(bitmapWidth, bitmapHeight,
-            pixelWidth, pixelHeight, width, height, transparentQuads, colorKey);
+            width, height, transparentQuads, colorKey);
 
     ssize_t index = mCache.indexOfKey(description);
     Patch* mesh = NULL;
@@ -83,13 +82,13 @@ Patch* PatchCache::get(const float bitmapWidth, const float bitmapHeight,
 
     if (!mesh) {
         PATCH_LOGD("New patch mesh "
-                "xCount=%d yCount=%d, w=%.2f h=%.2f, bw=%.2f bh=%.2f",
-                width, height, pixelWidth, pixelHeight, bitmapWidth, bitmapHeight);
+                "xCount=%d yCount=%d, bw=%.2f bh=%.2f",
+                width, height, bitmapWidth, bitmapHeight);
 
         mesh = new Patch(width, height, transparentQuads);
         mesh->updateColorKey(colorKey);
         mesh->copy(xDivs, yDivs);
-        mesh->updateVertices(bitmapWidth, bitmapHeight, 0.0f, 0.0f, pixelWidth, pixelHeight);
+        mesh->updateVertices(bitmapWidth, bitmapHeight);
 
         if (mCache.size() >= mMaxEntries) {
             delete mCache.valueAt(mCache.size() - 1);
@@ -99,7 +98,7 @@ Patch* PatchCache::get(const float bitmapWidth, const float bitmapHeight,
         mCache.add(description, mesh);
     } else if (!mesh->matches(xDivs, yDivs, colorKey)) {
         PATCH_LOGD("Patch mesh does not match, refreshing vertices");
-        mesh->updateVertices(bitmapWidth, bitmapHeight, 0.0f, 0.0f, pixelWidth, pixelHeight);
+        mesh->updateVertices(bitmapWidth, bitmapHeight);
     }
 
     return mesh;
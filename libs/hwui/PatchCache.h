@@ -47,8 +47,11 @@ public:
     PatchCache(uint32_t maxCapacity);
     ~PatchCache();
 
+    /**
+     * Returns the mesh of the specified patch. Meshes do not depend on the
+     * size the patch is drawn at, see Patch::getStretch().
+     */
     Patch* get(const float bitmapWidth, const float bitmapHeight,
-            const float pixelWidth, const float pixelHeight,
             const int32_t* xDivs, const int32_t* yDivs, const uint32_t* colors,
             const uint32_t width, const uint32_t height, const int8_t numColors);
     void clear();
@@ -66,16 +69,14 @@ private:
      * Description of a patch.
      */
     struct PatchDescription {
-        PatchDescription(): bitmapWidth(0), bitmapHeight(0), pixelWidth(0), pixelHeight(0),
+        PatchDescription(): bitmapWidth(0), bitmapHeight(0),
                 xCount(0), yCount(0), emptyCount(0), colorKey(0) {
         }
 
         PatchDescription(const float bitmapWidth, const float bitmapHeight,
-                const float pixelWidth, const float pixelHeight,
                 const uint32_t xCount, const uint32_t yCount,
                 const int8_t emptyCount, const uint32_t colorKey):
                 bitmapWidth(bitmapWidth), bitmapHeight(bitmapHeight),
-                pixelWidth(pixelWidth), pixelHeight(pixelHeight),
                 xCount(xCount), yCount(yCount),
                 emptyCount(emptyCount), colorKey(colorKey) {
         }
@@ -83,14 +84,10 @@ private:
         bool operator<(const PatchDescription& rhs) const {
             LTE_FLOAT(bitmapWidth) {
                 LTE_FLOAT(bitmapHeight) {
-                    LTE_FLOAT(pixelWidth) {
-                        LTE_FLOAT(pixelHeight) {
-                            LTE_INT(xCount) {
-                                LTE_INT(yCount) {
-                                    LTE_INT(emptyCount) {
-                                        LTE_INT(colorKey) return false;
-                                    }
-                                }
+                    LTE_INT(xCount) {
+                        LTE_INT(yCount) {
+                            LTE_INT(emptyCount) {
+                                LTE_INT(colorKey) return false;
                             }
                         }
                     }
@@ -102,8 +99,6 @@ private:
     private:
         float bitmapWidth;
         float bitmapHeight;
-        float pixelWidth;
-        float pixelHeight;
         uint32_t xCount;
         uint32_t yCount;
         int8_t emptyCount;
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <math.h>
+
+#include "Debug.h"
+#include "PathMeshCache.h"
+#include "Properties.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+PathMeshCache::PathMeshCache():
+        mCache(GenerationCache<PathMeshCacheEntry, PathMesh*>::kUnlimitedCapacity),
+        mSize(0), mMaxSize(MB(DEFAULT_PATH_MESH_CACHE_SIZE)), mEnabled(false) {
+    char property[PROPERTY_VALUE_MAX];
+    if (property_get(PROPERTY_PATH_MESH_CACHE_SIZE, property, NULL) > 0) {
+        INIT_LOGD("  Setting path mesh cache size to %sMB", property);
+        setMaxSize(MB(atof(property)));
+    } else {
+        INIT_LOGD("  Using default path mesh cache size of %.2fMB",
+                DEFAULT_PATH_MESH_CACHE_SIZE);
+    }
+
+    mEnabled = property_get(PROPERTY_PATH_TESSELLATION, property, NULL) > 0 &&
+            !strcmp(property, "true");
+    if (mEnabled) {
+        INIT_LOGD("  Tessellating paths");
+    }
+
+    mCache.setOnEntryRemovedListener(this);
+}
+
+PathMeshCache::~PathMeshCache() {
+    mCache.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Size management
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t PathMeshCache::getSize() {
+    return mSize;
+}
+
+uint32_t PathMeshCache::getMaxSize() {
+    return mMaxSize;
+}
+
+void PathMeshCache::setMaxSize(uint32_t maxSize) {
+    mMaxSize = maxSize;
+    while (mSize > mMaxSize) {
+        mCache.removeOldest();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Callbacks
+///////////////////////////////////////////////////////////////////////////////
+
+void PathMeshCache::operator()(PathMeshCacheEntry& entry, PathMesh*& mesh) {
+    if (mesh) {
+        mSize -= sizeof(PathMesh) + mesh->getSize();
+        delete mesh;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Caching
+///////////////////////////////////////////////////////////////////////////////
+
+float PathMeshCache::computeScale(const mat4& transform) {
+    const float* data = transform.data;
+    if (data[Matrix4::kPerspective0] != 0.0f || data[Matrix4::kPerspective1] != 0.0f ||
+            data[Matrix4::kPerspective2] != 1.0f) {
+        return 0.0f;
+    }
+
+    const float scaleX = sqrtf(data[Matrix4::kScaleX] * data[Matrix4::kScaleX] +
+            data[Matrix4::kSkewY] * data[Matrix4::kSkewY]);
+    const float scaleY = sqrtf(data[Matrix4::kSkewX] * data[Matrix4::kSkewX] +
+            data[Matrix4::kScaleY] * data[Matrix4::kScaleY]);
+    const float scale = fmaxf(scaleX, scaleY);
+    if (scale < 0.0001f) return 0.0f;
+
+    // Round up to the next power of sqrt(2) so curves are never less precise
+    // than requested
+    return powf(2.0f, ceilf(log2f(scale) * 2.0f) * 0.5f);
+}
+
+PathMesh* PathMeshCache::get(SkPath* path, SkPaint* paint, const mat4& transform) {
+    if (!mEnabled || !PathTessellator::canTessellate(*path, paint)) return NULL;
+
+    const float scale = computeScale(transform);
+    if (scale <= 0.0f) return NULL;
+
+    const SkPath* sourcePath = path->getSourcePath();
+    if (sourcePath && sourcePath->getGenerationID() == path->getGenerationID()) {
+        path = const_cast<SkPath*>(sourcePath);
+    }
+
+    PathMeshCacheEntry entry(path, paint, scale);
+    PathMesh* mesh = mCache.get(entry);
+
+    if (mesh && mesh->generation != path->getGenerationID()) {
+        mCache.remove(entry);
+        mesh = NULL;
+    }
+
+    if (!mesh) {
+        mesh = new PathMesh;
+        mesh->tessellated = PathTessellator::tessellate(*path, paint, scale, mesh);
+        if (!mesh->tessellated) {
+            mesh->vertices.clear();
+        }
+        mesh->generation = path->getGenerationID();
+
+        const uint32_t size = sizeof(PathMesh) + mesh->getSize();
+        if (size > mMaxSize) {
+            ALOGW("Path mesh too large to be cached (%d bytes)", size);
+            delete mesh;
+            return NULL;
+        }
+
+        while (mSize + size > mMaxSize) {
+            mCache.removeOldest();
+        }
+
+        mSize += size;
+        mCache.put(entry, mesh);
+    }
+
+    return mesh->tessellated ? mesh : NULL;
+}
+
+void PathMeshCache::remove(SkPath* path) {
+    Vector<size_t> meshesToRemove;
+    for (size_t i = 0; i < mCache.size(); i++) {
+        if (mCache.getKeyAt(i).path == path) {
+            meshesToRemove.push(i);
+        }
+    }
+
+    // The indices are sorted and the listener keeps the size up to date
+    for (size_t i = 0; i < meshesToRemove.size(); i++) {
+        mCache.removeAt(meshesToRemove.itemAt(i) - i);
+    }
+}
+
+void PathMeshCache::removeDeferred(SkPath* path) {
+    Mutex::Autolock _l(mLock);
+    mGarbage.push(path);
+}
+
+void PathMeshCache::clearGarbage() {
+    Mutex::Autolock _l(mLock);
+    size_t count = mGarbage.size();
+    for (size_t i = 0; i < count; i++) {
+        remove(mGarbage.itemAt(i));
+    }
+    mGarbage.clear();
+}
+
+void PathMeshCache::clear() {
+    mCache.clear();
+}
+
+}; // namespace uirenderer
+}; // namespace android
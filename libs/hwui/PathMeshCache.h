@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_PATH_MESH_CACHE_H
+#define ANDROID_HWUI_PATH_MESH_CACHE_H
+
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+#include "Matrix.h"
+#include "PathTessellator.h"
+#include "ShapeCache.h"
+#include "utils/Compare.h"
+#include "utils/GenerationCache.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+struct PathMeshCacheEntry: public ShapeCacheEntry {
+    PathMeshCacheEntry(SkPath* path, SkPaint* paint, float scale):
+            ShapeCacheEntry(ShapeCacheEntry::kShapePath, paint) {
+        this->path = path;
+        this->scale = *(uint32_t*) &scale;
+        antiAlias = paint->isAntiAlias() ? 1 : 0;
+    }
+
+    PathMeshCacheEntry(): ShapeCacheEntry() {
+        path = NULL;
+        scale = 0;
+        antiAlias = 0;
+    }
+
+    bool lessThan(const ShapeCacheEntry& r) const {
+        const PathMeshCacheEntry& rhs = (const PathMeshCacheEntry&) r;
+        LTE_INT(path) {
+            LTE_INT(scale) {
+                LTE_INT(antiAlias) {
+                    return false;
+                }
+            }
+        }
+        return false;
+    }
+
+    SkPath* path;
+    uint32_t scale;
+    uint32_t antiAlias;
+}; // PathMeshCacheEntry
+
+/**
+ * A simple LRU cache of tessellated paths. The cache has a maximum size
+ * expressed in bytes. Meshes depend on the scale of the transform they
+ * are drawn with; the scale is rounded so that a mesh can be reused while
+ * a path is animated.
+ *
+ * Paths that cannot be tessellated are remembered as well so they are
+ * not tessellated again on every frame.
+ */
+class PathMeshCache: public OnEntryRemoved<PathMeshCacheEntry, PathMesh*> {
+public:
+    PathMeshCache();
+    ~PathMeshCache();
+
+    /**
+     * Used as a callback when an entry is removed from the cache.
+     * Do not invoke directly.
+     */
+    void operator()(PathMeshCacheEntry& entry, PathMesh*& mesh);
+
+    /**
+     * Returns the mesh of the specified path drawn with the specified
+     * transform. Returns NULL if path tessellation is disabled or if the
+     * path cannot be tessellated, in which case the path cache must be used.
+     */
+    PathMesh* get(SkPath* path, SkPaint* paint, const mat4& transform);
+    /**
+     * Removes all the meshes of the specified path.
+     */
+    void remove(SkPath* path);
+    /**
+     * Removes the specified path. This is meant to be called from threads
+     * that are not the EGL context thread.
+     */
+    void removeDeferred(SkPath* path);
+    /**
+     * Process deferred removals.
+     */
+    void clearGarbage();
+
+    /**
+     * Clears the cache. This causes all meshes to be deleted.
+     */
+    void clear();
+
+    /**
+     * Sets the maximum size of the cache in bytes.
+     */
+    void setMaxSize(uint32_t maxSize);
+    /**
+     * Returns the maximum size of the cache in bytes.
+     */
+    uint32_t getMaxSize();
+    /**
+     * Returns the current size of the cache in bytes.
+     */
+    uint32_t getSize();
+
+private:
+    /**
+     * Returns the rounded scale factor of the transform, or 0 if meshes
+     * cannot be drawn with the transform.
+     */
+    static float computeScale(const mat4& transform);
+
+    GenerationCache<PathMeshCacheEntry, PathMesh*> mCache;
+    uint32_t mSize;
+    uint32_t mMaxSize;
+    bool mEnabled;
+
+    Vector<SkPath*> mGarbage;
+    mutable Mutex mLock;
+}; // class PathMeshCache
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_PATH_MESH_CACHE_H
@@ -0,0 +1,617 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <math.h>
+
+#include "PathTessellator.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Geometry
+///////////////////////////////////////////////////////////////////////////////
+
+static const float kEpsilon = 0.00001f;
+
+static inline float orientation(const Vertex& a, const Vertex& b, const Vertex& c) {
+    return (b.position[0] - a.position[0]) * (c.position[1] - a.position[1]) -
+            (b.position[1] - a.position[1]) * (c.position[0] - a.position[0]);
+}
+
+static float computeArea(const Vector<Vertex>& points) {
+    const size_t count = points.size();
+    float area = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        const Vertex& a = points.itemAt(i);
+        const Vertex& b = points.itemAt((i + 1) % count);
+        area += a.position[0] * b.position[1] - a.position[1] * b.position[0];
+    }
+    return area * 0.5f;
+}
+
+static void reverse(Vector<Vertex>& points) {
+    const size_t count = points.size();
+    for (size_t i = 0; i < count / 2; i++) {
+        const Vertex tmp = points.itemAt(i);
+        points.editItemAt(i) = points.itemAt(count - 1 - i);
+        points.editItemAt(count - 1 - i) = tmp;
+    }
+}
+
+static bool segmentsIntersect(const Vertex& a, const Vertex& b, const Vertex& c, const Vertex& d) {
+    const float d1 = orientation(c, d, a);
+    const float d2 = orientation(c, d, b);
+    const float d3 = orientation(a, b, c);
+    const float d4 = orientation(a, b, d);
+    return ((d1 > 0.0f && d2 < 0.0f) || (d1 < 0.0f && d2 > 0.0f)) &&
+            ((d3 > 0.0f && d4 < 0.0f) || (d3 < 0.0f && d4 > 0.0f));
+}
+
+static bool isSimple(const Vector<Vertex>& points) {
+    const size_t count = points.size();
+    for (size_t i = 0; i < count; i++) {
+        const Vertex& a = points.itemAt(i);
+        const Vertex& b = points.itemAt((i + 1) % count);
+        // Adjacent edges share a vertex and cannot cross
+        for (size_t j = i + 2; j < count; j++) {
+            if (i == 0 && j == count - 1) continue;
+            if (segmentsIntersect(a, b, points.itemAt(j), points.itemAt((j + 1) % count))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Computes the normal of the segment going from the first vertex to the
+ * second one. The normal points outside of a polygon of positive area.
+ */
+static void computeNormal(const Vertex& from, const Vertex& to, float* nx, float* ny) {
+    const float dx = to.position[0] - from.position[0];
+    const float dy = to.position[1] - from.position[1];
+    const float length = sqrtf(dx * dx + dy * dy);
+    if (length < kEpsilon) {
+        *nx = *ny = 0.0f;
+        return;
+    }
+    *nx = dy / length;
+    *ny = -dx / length;
+}
+
+static void computeDirection(const Vertex& from, const Vertex& to, float* dx, float* dy) {
+    *dx = to.position[0] - from.position[0];
+    *dy = to.position[1] - from.position[1];
+    const float length = sqrtf(*dx * *dx + *dy * *dy);
+    if (length < kEpsilon) {
+        *dx = *dy = 0.0f;
+        return;
+    }
+    *dx /= length;
+    *dy /= length;
+}
+
+/**
+ * Computes the offset of a vertex shared by two segments of normals n1 and
+ * n2, so that the segments are moved by one unit along their normals. The
+ * offset is clamped to maxMiter units. Returns the unclamped length of the
+ * offset.
+ */
+static float computeOffset(float n1x, float n1y, float n2x, float n2y, float maxMiter,
+        float* ox, float* oy) {
+    const float bx = n1x + n2x;
+    const float by = n1y + n2y;
+    const float length = sqrtf(bx * bx + by * by);
+    if (length < kEpsilon) {
+        // The path turns back on itself
+        *ox = n1x;
+        *oy = n1y;
+        return INFINITY;
+    }
+
+    // |n1 + n2| = 2 * cos(angle / 2)
+    const float miter = 2.0f / length;
+    const float scale = (miter < maxMiter ? miter : maxMiter) / length;
+    *ox = bx * scale;
+    *oy = by * scale;
+
+    return miter;
+}
+
+static inline void addQuad(Vector<AlphaVertex>& vertices, const AlphaVertex& a1,
+        const AlphaVertex& a2, const AlphaVertex& b1, const AlphaVertex& b2) {
+    vertices.push(a1);
+    vertices.push(a2);
+    vertices.push(b1);
+    vertices.push(a2);
+    vertices.push(b2);
+    vertices.push(b1);
+}
+
+static inline bool pointInTriangle(const Vertex& p, const Vertex& a, const Vertex& b,
+        const Vertex& c) {
+    return orientation(a, b, p) >= 0.0f && orientation(b, c, p) >= 0.0f &&
+            orientation(c, a, p) >= 0.0f;
+}
+
+/**
+ * Triangulates a simple polygon of positive area by ear clipping.
+ */
+static bool triangulateConcave(const Vector<AlphaVertex>& polygon,
+        Vector<AlphaVertex>& vertices) {
+    Vector<uint32_t> indices;
+    indices.setCapacity(polygon.size());
+    for (size_t i = 0; i < polygon.size(); i++) {
+        indices.push(i);
+    }
+
+    while (indices.size() > 3) {
+        const size_t count = indices.size();
+        bool clipped = false;
+
+        for (size_t k = 0; k < count && !clipped; k++) {
+            const uint32_t prev = indices.itemAt((k + count - 1) % count);
+            const uint32_t current = indices.itemAt(k);
+            const uint32_t next = indices.itemAt((k + 1) % count);
+
+            const AlphaVertex& a = polygon.itemAt(prev);
+            const AlphaVertex& b = polygon.itemAt(current);
+            const AlphaVertex& c = polygon.itemAt(next);
+
+            const float turn = orientation(a, b, c);
+            if (fabs(turn) < kEpsilon) {
+                // Collinear vertices do not contribute any area
+                indices.removeAt(k);
+                clipped = true;
+                break;
+            }
+            if (turn < 0.0f) continue;
+
+            bool ear = true;
+            for (size_t m = 0; m < count; m++) {
+                const uint32_t index = indices.itemAt(m);
+                if (index == prev || index == current || index == next) continue;
+                if (pointInTriangle(polygon.itemAt(index), a, b, c)) {
+                    ear = false;
+                    break;
+                }
+            }
+
+            if (ear) {
+                vertices.push(a);
+                vertices.push(b);
+                vertices.push(c);
+                indices.removeAt(k);
+                clipped = true;
+            }
+        }
+
+        if (!clipped) return false;
+    }
+
+    if (indices.size() == 3) {
+        vertices.push(polygon.itemAt(indices.itemAt(0)));
+        vertices.push(polygon.itemAt(indices.itemAt(1)));
+        vertices.push(polygon.itemAt(indices.itemAt(2)));
+    }
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Flattening
+///////////////////////////////////////////////////////////////////////////////
+
+static void addPoint(Vector<Vertex>& points, float x, float y) {
+    if (!points.isEmpty()) {
+        const Vertex& last = points.top();
+        if (fabs(last.position[0] - x) < kEpsilon && fabs(last.position[1] - y) < kEpsilon) {
+            return;
+        }
+    }
+
+    Vertex vertex;
+    Vertex::set(&vertex, x, y);
+    points.push(vertex);
+}
+
+/**
+ * Returns the number of segments required to approximate a curve whose
+ * second derivative has the specified length. The error of a segment is
+ * proportional to the square of its length.
+ */
+static uint32_t computeSegmentCount(float dx, float dy, float factor, float tolerance) {
+    const float distance = sqrtf(dx * dx + dy * dy) * factor;
+    uint32_t segments = (uint32_t) ceilf(sqrtf(distance / tolerance));
+    if (segments < 1) segments = 1;
+    if (segments > PATH_MAX_CURVE_SEGMENTS) segments = PATH_MAX_CURVE_SEGMENTS;
+    return segments;
+}
+
+static void addQuadCurve(Vector<Vertex>& points, const SkPoint* pts, float tolerance) {
+    const float dx = pts[0].fX - 2.0f * pts[1].fX + pts[2].fX;
+    const float dy = pts[0].fY - 2.0f * pts[1].fY + pts[2].fY;
+    const uint32_t segments = computeSegmentCount(dx, dy, 0.25f, tolerance);
+
+    for (uint32_t i = 1; i <= segments; i++) {
+        const float t = i / float(segments);
+        const float u = 1.0f - t;
+        const float a = u * u;
+        const float b = 2.0f * u * t;
+        const float c = t * t;
+        addPoint(points, a * pts[0].fX + b * pts[1].fX + c * pts[2].fX,
+                a * pts[0].fY + b * pts[1].fY + c * pts[2].fY);
+    }
+}
+
+static void addCubicCurve(Vector<Vertex>& points, const SkPoint* pts, float tolerance) {
+    const float dx1 = pts[0].fX - 2.0f * pts[1].fX + pts[2].fX;
+    const float dy1 = pts[0].fY - 2.0f * pts[1].fY + pts[2].fY;
+    const float dx2 = pts[1].fX - 2.0f * pts[2].fX + pts[3].fX;
+    const float dy2 = pts[1].fY - 2.0f * pts[2].fY + pts[3].fY;
+    const bool first = dx1 * dx1 + dy1 * dy1 > dx2 * dx2 + dy2 * dy2;
+    const uint32_t segments = computeSegmentCount(first ? dx1 : dx2, first ? dy1 : dy2,
+            0.75f, tolerance);
+
+    for (uint32_t i = 1; i <= segments; i++) {
+        const float t = i / float(segments);
+        const float u = 1.0f - t;
+        const float a = u * u * u;
+        const float b = 3.0f * u * u * t;
+        const float c = 3.0f * u * t * t;
+        const float d = t * t * t;
+        addPoint(points, a * pts[0].fX + b * pts[1].fX + c * pts[2].fX + d * pts[3].fX,
+                a * pts[0].fY + b * pts[1].fY + c * pts[2].fY + d * pts[3].fY);
+    }
+}
+
+void PathTessellator::pushContour(Vector<Contour>& contours, Contour& contour) {
+    Vector<Vertex>& points = contour.points;
+    if (contour.closed && points.size() > 1) {
+        const Vertex& first = points.itemAt(0);
+        const Vertex& last = points.top();
+        if (fabs(last.position[0] - first.position[0]) < kEpsilon &&
+                fabs(last.position[1] - first.position[1]) < kEpsilon) {
+            points.pop();
+        }
+    }
+
+    if (!points.isEmpty()) {
+        contours.push(contour);
+    }
+
+    contour.points.clear();
+    contour.closed = false;
+}
+
+void PathTessellator::flatten(const SkPath& path, float tolerance, Vector<Contour>& contours) {
+    SkPath::Iter iter(path, false);
+    SkPath::Verb verb;
+    SkPoint pts[4];
+
+    Contour contour;
+    while ((verb = iter.next(pts)) != SkPath::kDone_Verb) {
+        switch (verb) {
+            case SkPath::kMove_Verb:
+                pushContour(contours, contour);
+                addPoint(contour.points, pts[0].fX, pts[0].fY);
+                break;
+            case SkPath::kLine_Verb:
+                addPoint(contour.points, pts[1].fX, pts[1].fY);
+                break;
+            case SkPath::kQuad_Verb:
+                addQuadCurve(contour.points, pts, tolerance);
+                break;
+            case SkPath::kCubic_Verb:
+                addCubicCurve(contour.points, pts, tolerance);
+                break;
+            case SkPath::kClose_Verb:
+                contour.closed = true;
+                pushContour(contours, contour);
+                break;
+            default:
+                break;
+        }
+    }
+    pushContour(contours, contour);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Tessellation
+///////////////////////////////////////////////////////////////////////////////
+
+bool PathTessellator::canTessellate(const SkPath& path, const SkPaint* paint) {
+    if (path.isInverseFillType()) return false;
+    if (paint->getPathEffect() || paint->getMaskFilter() || paint->getRasterizer()) {
+        return false;
+    }
+    return paint->getStyle() != SkPaint::kStrokeAndFill_Style;
+}
+
+bool PathTessellator::tessellate(const SkPath& path, const SkPaint* paint, float scale,
+        PathMesh* mesh) {
+    if (scale <= 0.0f || !canTessellate(path, paint)) return false;
+
+    const float tolerance = PATH_TESSELLATION_TOLERANCE / scale;
+    const float fringe = paint->isAntiAlias() ? PATH_AA_FRINGE_WIDTH / scale : 0.0f;
+
+    Vector<Contour> contours;
+    flatten(path, tolerance, contours);
+
+    mesh->vertices.clear();
+    mesh->hasAlpha = false;
+    mesh->generation = path.getGenerationID();
+
+    if (paint->getStyle() == SkPaint::kFill_Style) {
+        // Several contours can overlap or define holes
+        if (contours.size() > 1) return false;
+        if (contours.size() == 1 && !tessellateFill(path, contours.itemAt(0), fringe, mesh)) {
+            return false;
+        }
+    } else {
+        for (size_t i = 0; i < contours.size(); i++) {
+            if (!tessellateStroke(contours.itemAt(i), paint, scale, fringe, mesh)) {
+                return false;
+            }
+        }
+    }
+
+    mesh->bounds.setEmpty();
+    const size_t count = mesh->vertices.size();
+    if (count > 0) {
+        const AlphaVertex& first = mesh->vertices.itemAt(0);
+        Rect& bounds = mesh->bounds;
+        bounds.set(first.position[0], first.position[1], first.position[0], first.position[1]);
+        for (size_t i = 1; i < count; i++) {
+            const AlphaVertex& vertex = mesh->vertices.itemAt(i);
+            bounds.left = fminf(bounds.left, vertex.position[0]);
+            bounds.top = fminf(bounds.top, vertex.position[1]);
+            bounds.right = fmaxf(bounds.right, vertex.position[0]);
+            bounds.bottom = fmaxf(bounds.bottom, vertex.position[1]);
+        }
+    }
+
+    return true;
+}
+
+bool PathTessellator::tessellateFill(const SkPath& path, const Contour& contour, float fringe,
+        PathMesh* mesh) {
+    Vector<Vertex> points(contour.points);
+    const size_t count = points.size();
+    if (count < 3) return true;
+
+    const bool convex = path.isConvex();
+    if (!convex && (count > PATH_MAX_CONCAVE_VERTICES || !isSimple(points))) {
+        return false;
+    }
+
+    // Simple polygons without area cover no pixels
+    const float area = computeArea(points);
+    if (fabs(area) < kEpsilon) return true;
+    if (area < 0.0f) reverse(points);
+
+    Vector<AlphaVertex> inner;
+    inner.setCapacity(count);
+
+    if (fringe > 0.0f) {
+        // The fringe is centered on the outline, fading out to the outside
+        const float half = fringe * 0.5f;
+        Vector<AlphaVertex> outer;
+        outer.setCapacity(count);
+
+        for (size_t i = 0; i < count; i++) {
+            const Vertex& prev = points.itemAt((i + count - 1) % count);
+            const Vertex& current = points.itemAt(i);
+            const Vertex& next = points.itemAt((i + 1) % count);
+
+            float n1x, n1y, n2x, n2y, ox, oy;
+            computeNormal(prev, current, &n1x, &n1y);
+            computeNormal(current, next, &n2x, &n2y);
+            computeOffset(n1x, n1y, n2x, n2y, PATH_MAX_FRINGE_MITER, &ox, &oy);
+
+            AlphaVertex vertex;
+            AlphaVertex::set(&vertex, current.position[0] - ox * half,
+                    current.position[1] - oy * half, 1.0f);
+            inner.push(vertex);
+            AlphaVertex::set(&vertex, current.position[0] + ox * half,
+                    current.position[1] + oy * half, 0.0f);
+            outer.push(vertex);
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            const size_t j = (i + 1) % count;
+            addQuad(mesh->vertices, inner.itemAt(i), outer.itemAt(i),
+                    inner.itemAt(j), outer.itemAt(j));
+        }
+        mesh->hasAlpha = true;
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            const Vertex& current = points.itemAt(i);
+            AlphaVertex vertex;
+            AlphaVertex::set(&vertex, current.position[0], current.position[1], 1.0f);
+            inner.push(vertex);
+        }
+    }
+
+    if (convex) {
+        for (size_t i = 1; i < count - 1; i++) {
+            mesh->vertices.push(inner.itemAt(0));
+            mesh->vertices.push(inner.itemAt(i));
+            mesh->vertices.push(inner.itemAt(i + 1));
+        }
+        return true;
+    }
+
+    return triangulateConcave(inner, mesh->vertices);
+}
+
+bool PathTessellator::tessellateStroke(const Contour& contour, const SkPaint* paint,
+        float scale, float fringe, PathMesh* mesh) {
+    Vector<Vertex> points(contour.points);
+    const size_t count = points.size();
+
+    const bool hairline = paint->getStrokeWidth() == 0.0f;
+    const float halfWidth = hairline ? 0.5f / scale : paint->getStrokeWidth() * 0.5f;
+    const bool thin = halfWidth * 2.0f * scale <= PATH_THIN_STROKE_WIDTH;
+    const SkPaint::Cap cap = paint->getStrokeCap();
+
+    if (count < 2) {
+        // Degenerate contours are only drawn with round or square caps
+        return cap == SkPaint::kButt_Cap;
+    }
+
+    if (!thin) {
+        if (paint->getStrokeJoin() != SkPaint::kMiter_Join) return false;
+        if (!contour.closed && cap == SkPaint::kRound_Cap) return false;
+    }
+
+    const bool closed = contour.closed && count > 2;
+    const float miterLimit = paint->getStrokeMiter();
+
+    Vector<Vertex> offsets;
+    offsets.setCapacity(count);
+
+    for (size_t i = 0; i < count; i++) {
+        const bool hasPrev = closed || i > 0;
+        const bool hasNext = closed || i < count - 1;
+
+        float n1x = 0.0f, n1y = 0.0f, n2x = 0.0f, n2y = 0.0f;
+        if (hasPrev) {
+            computeNormal(points.itemAt((i + count - 1) % count), points.itemAt(i), &n1x, &n1y);
+        }
+        if (hasNext) {
+            computeNormal(points.itemAt(i), points.itemAt((i + 1) % count), &n2x, &n2y);
+        }
+        if (!hasPrev) {
+            n1x = n2x;
+            n1y = n2y;
+        } else if (!hasNext) {
+            n2x = n1x;
+            n2y = n1y;
+        }
+
+        float ox, oy;
+        const float miter = computeOffset(n1x, n1y, n2x, n2y, miterLimit, &ox, &oy);
+        // Skia bevels the joins beyond the miter limit
+        if (miter > miterLimit && !thin) return false;
+
+        Vertex offset;
+        Vertex::set(&offset, ox, oy);
+        offsets.push(offset);
+    }
+
+    // Tangents at the ends of open contours, pointing outwards
+    float startX = 0.0f, startY = 0.0f, endX = 0.0f, endY = 0.0f;
+    if (!closed) {
+        computeDirection(points.itemAt(1), points.itemAt(0), &startX, &startY);
+        computeDirection(points.itemAt(count - 2), points.itemAt(count - 1), &endX, &endY);
+
+        if (cap == SkPaint::kSquare_Cap) {
+            Vertex& start = points.editItemAt(0);
+            Vertex::set(&start, start.position[0] + startX * halfWidth,
+                    start.position[1] + startY * halfWidth);
+            Vertex& end = points.editItemAt(count - 1);
+            Vertex::set(&end, end.position[0] + endX * halfWidth,
+                    end.position[1] + endY * halfWidth);
+        }
+    }
+
+    // Each vertex is extruded into lanes running along the stroke
+    float laneOffsets[4];
+    float laneAlphas[4];
+    uint32_t lanes;
+
+    if (fringe > 0.0f) {
+        const float half = fringe * 0.5f;
+        const float outer = halfWidth + half;
+        const float core = halfWidth - half;
+
+        if (core > 0.0f) {
+            lanes = 4;
+            laneOffsets[0] = outer;
+            laneOffsets[1] = core;
+            laneOffsets[2] = -core;
+            laneOffsets[3] = -outer;
+            laneAlphas[0] = laneAlphas[3] = 0.0f;
+            laneAlphas[1] = laneAlphas[2] = 1.0f;
+        } else {
+            // Strokes thinner than the fringe fade out from their center
+            lanes = 3;
+            laneOffsets[0] = outer;
+            laneOffsets[1] = 0.0f;
+            laneOffsets[2] = -outer;
+            laneAlphas[0] = laneAlphas[2] = 0.0f;
+            laneAlphas[1] = halfWidth < half ? halfWidth / half : 1.0f;
+        }
+        mesh->hasAlpha = true;
+    } else {
+        lanes = 2;
+        laneOffsets[0] = halfWidth;
+        laneOffsets[1] = -halfWidth;
+        laneAlphas[0] = laneAlphas[1] = 1.0f;
+    }
+
+    Vector<AlphaVertex> rails;
+    rails.setCapacity(count * lanes);
+    for (size_t i = 0; i < count; i++) {
+        const Vertex& point = points.itemAt(i);
+        const Vertex& offset = offsets.itemAt(i);
+        for (uint32_t l = 0; l < lanes; l++) {
+            AlphaVertex vertex;
+            AlphaVertex::set(&vertex, point.position[0] + offset.position[0] * laneOffsets[l],
+                    point.position[1] + offset.position[1] * laneOffsets[l], laneAlphas[l]);
+            rails.push(vertex);
+        }
+    }
+
+    const size_t segments = closed ? count : count - 1;
+    for (size_t s = 0; s < segments; s++) {
+        const size_t i = s * lanes;
+        const size_t j = ((s + 1) % count) * lanes;
+        for (uint32_t l = 0; l < lanes - 1; l++) {
+            addQuad(mesh->vertices, rails.itemAt(i + l), rails.itemAt(i + l + 1),
+                    rails.itemAt(j + l), rails.itemAt(j + l + 1));
+        }
+    }
+
+    // Fade out past the ends of open contours
+    if (fringe > 0.0f && !closed) {
+        const float half = fringe * 0.5f;
+        for (uint32_t end = 0; end < 2; end++) {
+            const size_t i = end == 0 ? 0 : (count - 1) * lanes;
+            const float dx = (end == 0 ? startX : endX) * half;
+            const float dy = (end == 0 ? startY : endY) * half;
+
+            AlphaVertex cap[4];
+            for (uint32_t l = 0; l < lanes; l++) {
+                const AlphaVertex& vertex = rails.itemAt(i + l);
+                AlphaVertex::set(&cap[l], vertex.position[0] + dx, vertex.position[1] + dy, 0.0f);
+            }
+            for (uint32_t l = 0; l < lanes - 1; l++) {
+                addQuad(mesh->vertices, rails.itemAt(i + l), rails.itemAt(i + l + 1),
+                        cap[l], cap[l + 1]);
+            }
+        }
+    }
+
+    return true;
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_PATH_TESSELLATOR_H
+#define ANDROID_HWUI_PATH_TESSELLATOR_H
+
+#include <SkPaint.h>
+#include <SkPath.h>
+
+#include <utils/Vector.h>
+
+#include "Rect.h"
+#include "Vertex.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Maximum distance, in pixels, between a curve and its flattened segments
+#define PATH_TESSELLATION_TOLERANCE 0.25f
+#define PATH_MAX_CURVE_SEGMENTS 32
+
+// Concave polygons with more vertices than this are left to the path cache
+#define PATH_MAX_CONCAVE_VERTICES 256
+
+// Width of the antialiasing fringe, in pixels
+#define PATH_AA_FRINGE_WIDTH 1.0f
+
+// Maximum length of the fringe offset at sharp corners of filled paths,
+// in multiples of the fringe width
+#define PATH_MAX_FRINGE_MITER 4.0f
+
+// Strokes narrower than this width, in pixels, are tessellated regardless
+// of their joins and caps since the difference is not visible
+#define PATH_THIN_STROKE_WIDTH 2.0f
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Triangles generated for a path, in the path's coordinates. The vertices
+ * are meant to be drawn with GL_TRIANGLES.
+ */
+struct PathMesh {
+    PathMesh(): generation(0), hasAlpha(false), tessellated(false) {
+    }
+
+    uint32_t getSize() const {
+        return vertices.size() * sizeof(AlphaVertex);
+    }
+
+    Vector<AlphaVertex> vertices;
+    Rect bounds;
+    uint32_t generation;
+    // True if some of the vertices are translucent (antialiasing fringe)
+    bool hasAlpha;
+    // False if the path must be drawn with the path cache instead
+    bool tessellated;
+}; // struct PathMesh
+
+/**
+ * Converts paths into triangle meshes. Convex fills are triangulated as a
+ * fan, concave single-contour fills are triangulated by ear clipping and
+ * strokes are extruded along the normals of their segments. Antialiasing
+ * is achieved by surrounding the mesh with a fringe whose vertices have an
+ * alpha of 0.
+ *
+ * Paths that cannot be tessellated exactly (multiple contours, holes,
+ * self-intersections, round joins on wide strokes, path effects, etc.)
+ * are rejected and must be rendered with the path cache.
+ */
+class PathTessellator {
+public:
+    /**
+     * Tessellates the specified path. The scale is the scale factor of the
+     * transform the mesh will be drawn with and determines the precision of
+     * the curves and the width of the antialiasing fringe. Strokes must only
+     * be tessellated for opaque paints, overlapping triangles would otherwise
+     * be blended twice.
+     *
+     * Returns false if the path cannot be tessellated.
+     */
+    static bool tessellate(const SkPath& path, const SkPaint* paint, float scale, PathMesh* mesh);
+
+    /**
+     * Indicates whether the paint can be used with a tessellated path.
+     */
+    static bool canTessellate(const SkPath& path, const SkPaint* paint);
+
+private:
+    struct Contour {
+        Contour(): closed(false) {
+        }
+
+        Vector<Vertex> points;
+        bool closed;
+    };
+
+    static void pushContour(Vector<Contour>& contours, Contour& contour);
+    static void flatten(const SkPath& path, float tolerance, Vector<Contour>& contours);
+
+    static bool tessellateFill(const SkPath& path, const Contour& contour, float fringe,
+            PathMesh* mesh);
+    static bool tessellateStroke(const Contour& contour, const SkPaint* paint, float scale,
+            float fringe, PathMesh* mesh);
+}; // class PathTessellator
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_PATH_TESSELLATOR_H
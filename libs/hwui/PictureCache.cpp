@@ -0,0 +1,552 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <SkCanvas.h>
+#include <SkTemplates.h>
+#include <SkXfermode.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/Vector.h>
+
+#include "Caches.h"
+#include "Debug.h"
+#include "DisplayListRenderer.h"
+#include "PictureCache.h"
+#include "Properties.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Translator
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Canvas forwarding the operations of a picture to a display list renderer.
+ * Without a renderer, the canvas only checks whether the picture can be
+ * translated: pictures are played back once to check them, and once more
+ * to translate them, since operations cannot be removed from a renderer.
+ *
+ * The canvas keeps track of the transform and clip itself so the quick
+ * rejects done while playing back the picture behave as in software.
+ */
+class PictureTranslator: public SkCanvas {
+public:
+    PictureTranslator(const SkBitmap& bounds, DisplayListRenderer* renderer):
+            SkCanvas(bounds), mRenderer(renderer), mSupported(true) {
+    }
+
+    ~PictureTranslator() {
+        // The display list holds references to the copies, they are
+        // deleted when it is
+        Caches& caches = Caches::getInstance();
+        for (size_t i = 0; i < mBitmaps.size(); i++) {
+            caches.resourceCache.destructor(mBitmaps.valueAt(i));
+        }
+        for (size_t i = 0; i < mPaths.size(); i++) {
+            caches.resourceCache.destructor(mPaths.valueAt(i));
+        }
+    }
+
+    bool isSupported() const {
+        return mSupported;
+    }
+
+    virtual int save(SaveFlags flags) {
+        if (mRenderer) mRenderer->save(flags);
+        return INHERITED::save(flags);
+    }
+
+    virtual int saveLayer(const SkRect* bounds, const SkPaint* paint, SaveFlags flags) {
+        if (record(paint)) {
+            SkRect layerBounds;
+            if (bounds) {
+                layerBounds = *bounds;
+            } else {
+                getClipBounds(&layerBounds);
+            }
+            mRenderer->saveLayer(layerBounds.fLeft, layerBounds.fTop,
+                    layerBounds.fRight, layerBounds.fBottom, copyPaint(paint), flags);
+        }
+
+        // The layer itself is drawn by the renderer, only its clip matters here
+        int saveCount = INHERITED::save(flags);
+        if (bounds) INHERITED::clipRect(*bounds);
+        return saveCount;
+    }
+
+    virtual void restore() {
+        if (mRenderer) mRenderer->restore();
+        INHERITED::restore();
+    }
+
+    virtual bool translate(SkScalar dx, SkScalar dy) {
+        if (mRenderer) mRenderer->translate(dx, dy);
+        return INHERITED::translate(dx, dy);
+    }
+
+    virtual bool scale(SkScalar sx, SkScalar sy) {
+        if (mRenderer) mRenderer->scale(sx, sy);
+        return INHERITED::scale(sx, sy);
+    }
+
+    virtual bool rotate(SkScalar degrees) {
+        if (mRenderer) mRenderer->rotate(degrees);
+        return INHERITED::rotate(degrees);
+    }
+
+    virtual bool skew(SkScalar sx, SkScalar sy) {
+        if (mRenderer) mRenderer->skew(sx, sy);
+        return INHERITED::skew(sx, sy);
+    }
+
+    virtual bool concat(const SkMatrix& matrix) {
+        if (mRenderer) {
+            SkMatrix copy(matrix);
+            mRenderer->concatMatrix(&copy);
+        }
+        return INHERITED::concat(matrix);
+    }
+
+    virtual void setMatrix(const SkMatrix& matrix) {
+        // The matrix is relative to the origin of the picture, not to the
+        // origin of the renderer
+        SkMatrix inverse;
+        if (!getTotalMatrix().invert(&inverse)) {
+            mSupported = false;
+        } else if (mRenderer) {
+            SkMatrix delta;
+            delta.setConcat(inverse, matrix);
+            mRenderer->concatMatrix(&delta);
+        }
+        INHERITED::setMatrix(matrix);
+    }
+
+    virtual bool clipRect(const SkRect& rect, SkRegion::Op op, bool doAntiAlias) {
+        if (op != SkRegion::kIntersect_Op && op != SkRegion::kDifference_Op) {
+            mSupported = false;
+        } else if (mRenderer) {
+            mRenderer->clipRect(rect.fLeft, rect.fTop, rect.fRight, rect.fBottom, op);
+        }
+        return INHERITED::clipRect(rect, op, doAntiAlias);
+    }
+
+    virtual bool clipPath(const SkPath& path, SkRegion::Op op, bool doAntiAlias) {
+        SkRect rect;
+        if (!path.isInverseFillType() && path.isRect(&rect)) {
+            return clipRect(rect, op, doAntiAlias);
+        }
+        mSupported = false;
+        return INHERITED::clipPath(path, op, doAntiAlias);
+    }
+
+    virtual bool clipRegion(const SkRegion& deviceRgn, SkRegion::Op op) {
+        mSupported = false;
+        return INHERITED::clipRegion(deviceRgn, op);
+    }
+
+    virtual void clear(SkColor color) {
+        if (mRenderer) mRenderer->drawColor(color, SkXfermode::kSrc_Mode);
+    }
+
+    virtual void drawPaint(const SkPaint& paint) {
+        if (record(&paint)) {
+            SkXfermode::Mode mode = SkXfermode::kSrcOver_Mode;
+            SkXfermode::AsMode(paint.getXfermode(), &mode);
+            mRenderer->drawColor(paint.getColor(), mode);
+        }
+    }
+
+    virtual void drawPoints(PointMode mode, size_t count, const SkPoint points[],
+            const SkPaint& paint) {
+        if (!record(&paint) || count == 0) return;
+
+        float* coordinates = (float*) points;
+        switch (mode) {
+            case kPoints_PointMode:
+                mRenderer->drawPoints(coordinates, count * 2, copyPaint(&paint));
+                break;
+            case kLines_PointMode:
+                mRenderer->drawLines(coordinates, (count & ~1) * 2, copyPaint(&paint));
+                break;
+            case kPolygon_PointMode: {
+                if (count < 2) break;
+                SkAutoSTMalloc<64, float> lines((count - 1) * 4);
+                float* line = lines.get();
+                for (size_t i = 0; i < count - 1; i++) {
+                    *line++ = points[i].fX;
+                    *line++ = points[i].fY;
+                    *line++ = points[i + 1].fX;
+                    *line++ = points[i + 1].fY;
+                }
+                mRenderer->drawLines(lines.get(), (count - 1) * 4, copyPaint(&paint));
+                break;
+            }
+        }
+    }
+
+    virtual void drawRect(const SkRect& rect, const SkPaint& paint) {
+        if (record(&paint)) {
+            mRenderer->drawRect(rect.fLeft, rect.fTop, rect.fRight, rect.fBottom,
+                    copyPaint(&paint));
+        }
+    }
+
+    virtual void drawPath(const SkPath& path, const SkPaint& paint) {
+        if (record(&paint)) {
+            mRenderer->drawPath(copyPath(path), copyPaint(&paint));
+        }
+    }
+
+    virtual void drawBitmap(const SkBitmap& bitmap, SkScalar left, SkScalar top,
+            const SkPaint* paint) {
+        if (record(paint)) {
+            mRenderer->drawBitmap(copyBitmap(bitmap), left, top, copyPaint(paint));
+        }
+    }
+
+    virtual void drawBitmapRect(const SkBitmap& bitmap, const SkIRect* src,
+            const SkRect& dst, const SkPaint* paint) {
+        if (record(paint)) {
+            SkIRect srcRect;
+            if (src) {
+                srcRect = *src;
+            } else {
+                srcRect.set(0, 0, bitmap.width(), bitmap.height());
+            }
+            mRenderer->drawBitmap(copyBitmap(bitmap),
+                    srcRect.fLeft, srcRect.fTop, srcRect.fRight, srcRect.fBottom,
+                    dst.fLeft, dst.fTop, dst.fRight, dst.fBottom, copyPaint(paint));
+        }
+    }
+
+    virtual void drawBitmapMatrix(const SkBitmap& bitmap, const SkMatrix& matrix,
+            const SkPaint* paint) {
+        if (record(paint)) {
+            SkMatrix copy(matrix);
+            mRenderer->drawBitmap(copyBitmap(bitmap), &copy, copyPaint(paint));
+        }
+    }
+
+    virtual void drawBitmapNine(const SkBitmap& bitmap, const SkIRect& center,
+            const SkRect& dst, const SkPaint* paint) {
+        mSupported = false;
+    }
+
+    virtual void drawSprite(const SkBitmap& bitmap, int left, int top, const SkPaint* paint) {
+        // Sprites ignore the transform
+        mSupported = false;
+    }
+
+    virtual void drawText(const void* text, size_t byteLength, SkScalar x, SkScalar y,
+            const SkPaint& paint) {
+        if (!record(&paint)) return;
+
+        Vector<uint16_t> glyphs;
+        SkPaint* glyphPaint = copyTextPaint(paint, &text, &byteLength, glyphs);
+        mRenderer->drawText((const char*) text, byteLength, byteLength >> 1, x, y, glyphPaint);
+    }
+
+    virtual void drawPosText(const void* text, size_t byteLength, const SkPoint pos[],
+            const SkPaint& paint) {
+        if (!record(&paint)) return;
+
+        Vector<uint16_t> glyphs;
+        SkPaint* glyphPaint = copyTextPaint(paint, &text, &byteLength, glyphs);
+        mRenderer->drawPosText((const char*) text, byteLength, byteLength >> 1,
+                (const float*) pos, glyphPaint);
+    }
+
+    virtual void drawPosTextH(const void* text, size_t byteLength, const SkScalar xpos[],
+            SkScalar constY, const SkPaint& paint) {
+        if (!record(&paint)) return;
+
+        Vector<uint16_t> glyphs;
+        SkPaint* glyphPaint = copyTextPaint(paint, &text, &byteLength, glyphs);
+
+        const int count = byteLength >> 1;
+        SkAutoSTMalloc<128, float> positions(count * 2);
+        float* position = positions.get();
+        for (int i = 0; i < count; i++) {
+            *position++ = xpos[i];
+            *position++ = constY;
+        }
+        mRenderer->drawPosText((const char*) text, byteLength, count,
+                positions.get(), glyphPaint);
+    }
+
+    virtual void drawTextOnPath(const void* text, size_t byteLength, const SkPath& path,
+            const SkMatrix* matrix, const SkPaint& paint) {
+        if (matrix && (matrix->getType() & ~SkMatrix::kTranslate_Mask)) {
+            mSupported = false;
+            return;
+        }
+        if (!record(&paint)) return;
+
+        Vector<uint16_t> glyphs;
+        SkPaint* glyphPaint = copyTextPaint(paint, &text, &byteLength, glyphs);
+        const float hOffset = matrix ? matrix->getTranslateX() : 0.0f;
+        const float vOffset = matrix ? matrix->getTranslateY() : 0.0f;
+        mRenderer->drawTextOnPath((const char*) text, byteLength, byteLength >> 1,
+                copyPath(path), hOffset, vOffset, glyphPaint);
+    }
+
+    virtual void drawVertices(VertexMode mode, int vertexCount, const SkPoint vertices[],
+            const SkPoint texs[], const SkColor colors[], SkXfermode* xfermode,
+            const uint16_t indices[], int indexCount, const SkPaint& paint) {
+        mSupported = false;
+    }
+
+private:
+    /**
+     * Paint features the renderer ignores. Shaders and color filters are
+     * set up separately from the paint by the renderer.
+     */
+    static bool isSupported(const SkPaint& paint) {
+        SkXfermode::Mode mode;
+        return !paint.getShader() && !paint.getColorFilter() && !paint.getMaskFilter() &&
+                !paint.getPathEffect() && !paint.getLooper() && !paint.getRasterizer() &&
+                SkXfermode::AsMode(paint.getXfermode(), &mode);
+    }
+
+    /**
+     * Returns true if the operation using the specified paint must be
+     * forwarded to the renderer.
+     */
+    inline bool record(const SkPaint* paint) {
+        if (paint && !isSupported(*paint)) {
+            mSupported = false;
+        }
+        return mRenderer != NULL;
+    }
+
+    /**
+     * The renderer records the paints, paths and bitmaps by address: the
+     * copies keep their address for as long as the display list lives,
+     * unlike the objects of the picture.
+     */
+    SkPaint* copyPaint(const SkPaint* paint) {
+        if (!paint) return NULL;
+        SkPaint* copy = mPaints.valueFor(paint);
+        if (!copy) {
+            copy = mRenderer->allocatePaint(*paint);
+            mPaints.add(paint, copy);
+        }
+        return copy;
+    }
+
+    SkPath* copyPath(const SkPath& path) {
+        SkPath* copy = mPaths.valueFor(&path);
+        if (!copy) {
+            copy = new SkPath(path);
+            mPaths.add(&path, copy);
+        }
+        return copy;
+    }
+
+    SkBitmap* copyBitmap(const SkBitmap& bitmap) {
+        SkBitmap* copy = mBitmaps.valueFor(&bitmap);
+        if (!copy) {
+            // Shares the pixels of the picture's bitmap
+            copy = new SkBitmap(bitmap);
+            mBitmaps.add(&bitmap, copy);
+        }
+        return copy;
+    }
+
+    /**
+     * The font renderer expects glyph IDs, pictures recorded by the
+     * framework already use them.
+     */
+    SkPaint* copyTextPaint(const SkPaint& paint, const void** text, size_t* byteLength,
+            Vector<uint16_t>& glyphs) {
+        if (paint.getTextEncoding() == SkPaint::kGlyphID_TextEncoding) {
+            return copyPaint(&paint);
+        }
+
+        const int count = paint.textToGlyphs(*text, *byteLength, NULL);
+        glyphs.resize(count);
+        paint.textToGlyphs(*text, *byteLength, glyphs.editArray());
+        *text = glyphs.array();
+        *byteLength = count << 1;
+
+        SkPaint glyphPaint(paint);
+        glyphPaint.setTextEncoding(SkPaint::kGlyphID_TextEncoding);
+        return mRenderer->allocatePaint(glyphPaint);
+    }
+
+    DisplayListRenderer* mRenderer;
+    bool mSupported;
+
+    DefaultKeyedVector<const SkPaint*, SkPaint*> mPaints;
+    DefaultKeyedVector<const SkPath*, SkPath*> mPaths;
+    DefaultKeyedVector<const SkBitmap*, SkBitmap*> mBitmaps;
+
+    typedef SkCanvas INHERITED;
+}; // class PictureTranslator
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+PictureCache::PictureCache():
+        mCache(GenerationCache<SkPicture*, PictureDisplayList*>::kUnlimitedCapacity),
+        mSize(0), mMaxSize(MB(DEFAULT_PICTURE_CACHE_SIZE)) {
+    char property[PROPERTY_VALUE_MAX];
+    if (property_get(PROPERTY_PICTURE_CACHE_SIZE, property, NULL) > 0) {
+        INIT_LOGD("  Setting picture cache size to %sMB", property);
+        setMaxSize(MB(atof(property)));
+    } else {
+        INIT_LOGD("  Using default picture cache size of %.2fMB", DEFAULT_PICTURE_CACHE_SIZE);
+    }
+
+    mCache.setOnEntryRemovedListener(this);
+}
+
+PictureCache::~PictureCache() {
+    mCache.clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Size management
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t PictureCache::getSize() {
+    return mSize;
+}
+
+uint32_t PictureCache::getMaxSize() {
+    return mMaxSize;
+}
+
+void PictureCache::setMaxSize(uint32_t maxSize) {
+    mMaxSize = maxSize;
+    while (mSize > mMaxSize) {
+        mCache.removeOldest();
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Callbacks
+///////////////////////////////////////////////////////////////////////////////
+
+void PictureCache::operator()(SkPicture*& picture, PictureDisplayList*& entry) {
+    if (entry) {
+        mSize -= entry->size;
+        delete entry->displayList;
+        delete entry;
+    }
+    picture->unref();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Caching
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t PictureCache::translate(SkPicture* picture, DisplayListRenderer& renderer) {
+    const int width = picture->width();
+    const int height = picture->height();
+    if (width <= 0 || height <= 0) return 0;
+
+    SkBitmap bounds;
+    bounds.setConfig(SkBitmap::kNo_Config, width, height);
+
+    bool supported;
+    {
+        PictureTranslator checker(bounds, NULL);
+        picture->draw(&checker);
+        supported = checker.isSupported();
+    }
+
+    uint32_t size = 0;
+    int saveCount = renderer.save(SkCanvas::kMatrix_SaveFlag | SkCanvas::kClip_SaveFlag);
+
+    if (supported) {
+        PictureTranslator translator(bounds, &renderer);
+        picture->draw(&translator);
+    } else {
+        SkBitmap* bitmap = new SkBitmap;
+        bitmap->setConfig(SkBitmap::kARGB_8888_Config, width, height);
+        if (bitmap->allocPixels()) {
+            bitmap->eraseColor(0);
+            SkCanvas canvas(*bitmap);
+            picture->draw(&canvas);
+
+            renderer.drawBitmap(bitmap, 0.0f, 0.0f, NULL);
+            size = bitmap->getSize();
+        }
+        // The display list now holds the only reference to the bitmap
+        Caches::getInstance().resourceCache.destructor(bitmap);
+    }
+
+    renderer.restoreToCount(saveCount);
+    return size;
+}
+
+DisplayList* PictureCache::get(SkPicture* picture) {
+    PictureDisplayList* entry = mCache.get(picture);
+
+    if (!entry) {
+        DisplayListRenderer recorder;
+        recorder.setViewport(picture->width(), picture->height());
+        recorder.prepareDirty(0.0f, 0.0f, picture->width(), picture->height(), false);
+        const uint32_t bitmapSize = translate(picture, recorder);
+        recorder.finish();
+
+        entry = new PictureDisplayList;
+        entry->displayList = recorder.getDisplayList(NULL);
+        entry->size = entry->displayList->getSize() + bitmapSize;
+
+        // A display list larger than the cache is kept until another
+        // picture is translated, so it can be drawn
+        while (mSize + entry->size > mMaxSize && mCache.size() > 0) {
+            mCache.removeOldest();
+        }
+
+        picture->ref();
+        mSize += entry->size;
+        mCache.put(picture, entry);
+    }
+
+    return entry->displayList;
+}
+
+void PictureCache::remove(SkPicture* picture) {
+    mCache.remove(picture);
+}
+
+void PictureCache::removeDeferred(SkPicture* picture) {
+    Mutex::Autolock _l(mLock);
+    mGarbage.push(picture);
+}
+
+void PictureCache::clearGarbage() {
+    Mutex::Autolock _l(mLock);
+    size_t count = mGarbage.size();
+    for (size_t i = 0; i < count; i++) {
+        remove(mGarbage.itemAt(i));
+    }
+    mGarbage.clear();
+}
+
+void PictureCache::clear() {
+    mCache.clear();
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_PICTURE_CACHE_H
+#define ANDROID_HWUI_PICTURE_CACHE_H
+
+#include <SkPicture.h>
+
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+#include "utils/GenerationCache.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+class DisplayList;
+class DisplayListRenderer;
+
+/**
+ * Display list translated from a picture. The size accounts for the
+ * recorded operations and for the pixels of the bitmap the picture was
+ * rasterized into when it could not be translated.
+ */
+struct PictureDisplayList {
+    DisplayList* displayList;
+    uint32_t size;
+};
+
+/**
+ * A simple LRU cache of pictures translated into display lists, so drawing
+ * a picture replays OpenGL operations instead of playing the picture back
+ * in software every time. The cache has a maximum size expressed in bytes.
+ *
+ * A picture is translated once per recording: recording it again, or
+ * destroying it, must be followed by a call to removeDeferred(). The cache
+ * holds a reference to the pictures it contains.
+ *
+ * Translated display lists own copies of the bitmaps, paths and paints of
+ * their picture and do not depend on it once translated.
+ */
+class PictureCache: public OnEntryRemoved<SkPicture*, PictureDisplayList*> {
+public:
+    PictureCache();
+    ~PictureCache();
+
+    /**
+     * Used as a callback when an entry is removed from the cache.
+     * Do not invoke directly.
+     */
+    void operator()(SkPicture*& picture, PictureDisplayList*& entry);
+
+    /**
+     * Returns the display list translated from the specified picture,
+     * translating it if needed. The display list belongs to the cache and
+     * must not be kept after the next call to get().
+     */
+    DisplayList* get(SkPicture* picture);
+    /**
+     * Removes the display list of the specified picture.
+     */
+    void remove(SkPicture* picture);
+    /**
+     * Removes the specified picture. This is meant to be called from threads
+     * that are not the EGL context thread.
+     */
+    void removeDeferred(SkPicture* picture);
+    /**
+     * Process deferred removals.
+     */
+    void clearGarbage();
+
+    /**
+     * Clears the cache. This causes all display lists to be deleted.
+     */
+    void clear();
+
+    /**
+     * Sets the maximum size of the cache in bytes.
+     */
+    void setMaxSize(uint32_t maxSize);
+    /**
+     * Returns the maximum size of the cache in bytes.
+     */
+    uint32_t getMaxSize();
+    /**
+     * Returns the current size of the cache in bytes.
+     */
+    uint32_t getSize();
+
+    /**
+     * Records the operations of the specified picture in the renderer, which
+     * must be ready to record. Pictures using features the renderer cannot
+     * draw are rasterized into a bitmap which is recorded instead. Returns
+     * the size in bytes of that bitmap, 0 if the picture was translated.
+     */
+    static uint32_t translate(SkPicture* picture, DisplayListRenderer& renderer);
+
+private:
+    GenerationCache<SkPicture*, PictureDisplayList*> mCache;
+    uint32_t mSize;
+    uint32_t mMaxSize;
+
+    Vector<SkPicture*> mGarbage;
+    mutable Mutex mLock;
+}; // class PictureCache
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_PICTURE_CACHE_H
@@ -16,6 +16,9 @@
 
 #define LOG_TAG "OpenGLRenderer"
 
+#include <string.h>
+
+#include "Caches.h"
 #include "Program.h"
 
 namespace android {
@@ -29,11 +32,17 @@ namespace uirenderer {
 Program::Program(const ProgramDescription& description, const char* vertex, const char* fragment) {
     mInitialized = false;
     mHasColorUniform = false;
+    mHasColor = false;
+    mHasTransform = false;
     mHasSampler = false;
     mUse = false;
+    mProgramId = 0;
+    mVertexShader = 0;
+    mFragmentShader = 0;
 
     // No need to cache compiled shaders, rely instead on Android's
-    // persistent shaders cache
+    // persistent shaders cache; linked programs can also be restored
+    // from ProgramCache's binary cache
     mVertexShader = buildShader(vertex, GL_VERTEX_SHADER);
     if (mVertexShader) {
         mFragmentShader = buildShader(fragment, GL_FRAGMENT_SHADER);
@@ -79,23 +88,86 @@ Program::Program(const ProgramDescription& description, const char* vertex, cons
         }
     }
 
-    if (mInitialized) {
-        transform = addUniform("transform");
+    initUniforms();
+}
+
+Program::Program(const ProgramDescription& description, GLenum binaryFormat,
+        const void* binary, GLsizei length) {
+    mInitialized = false;
+    mHasColorUniform = false;
+    mHasColor = false;
+    mHasTransform = false;
+    mHasSampler = false;
+    mUse = false;
+    mVertexShader = 0;
+    mFragmentShader = 0;
+
+    // Attribute bindings are part of the binary
+    position = kBindingPosition;
+    mAttributes.add("position", kBindingPosition);
+    if (description.hasTexture || description.hasExternalTexture) {
+        texCoords = kBindingTexCoords;
+        mAttributes.add("texCoords", kBindingTexCoords);
+    } else {
+        texCoords = -1;
     }
+
+    mProgramId = glCreateProgram();
+    glProgramBinaryOES(mProgramId, binaryFormat, binary, length);
+
+    GLint status;
+    glGetProgramiv(mProgramId, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        // This happens when the driver was updated, the caller
+        // is expected to fall back to compiling the sources
+        PROGRAM_LOGD("Program binary rejected by the driver");
+        glDeleteProgram(mProgramId);
+        mProgramId = 0;
+    } else {
+        mInitialized = true;
+    }
+
+    initUniforms();
 }
 
 Program::~Program() {
     if (mInitialized) {
-        glDetachShader(mProgramId, mVertexShader);
-        glDetachShader(mProgramId, mFragmentShader);
-
-        glDeleteShader(mVertexShader);
-        glDeleteShader(mFragmentShader);
+        if (mVertexShader) {
+            glDetachShader(mProgramId, mVertexShader);
+            glDeleteShader(mVertexShader);
+        }
+        if (mFragmentShader) {
+            glDetachShader(mProgramId, mFragmentShader);
+            glDeleteShader(mFragmentShader);
+        }
 
         glDeleteProgram(mProgramId);
     }
 }
 
+void Program::initUniforms() {
+    if (mInitialized) {
+        transform = addUniform("transform");
+    }
+}
+
+uint8_t* Program::getBinary(GLenum* binaryFormat, GLsizei* length) const {
+    if (!mInitialized) return NULL;
+
+    GLint binaryLength = 0;
+    glGetProgramiv(mProgramId, GL_PROGRAM_BINARY_LENGTH_OES, &binaryLength);
+    if (binaryLength <= 0) return NULL;
+
+    uint8_t* binary = new uint8_t[binaryLength];
+    glGetProgramBinaryOES(mProgramId, binaryLength, length, binaryFormat, binary);
+    if (*length <= 0 || glGetError() != GL_NO_ERROR) {
+        delete[] binary;
+        return NULL;
+    }
+
+    return binary;
+}
+
 int Program::addAttrib(const char* name) {
     int slot = glGetAttribLocation(mProgramId, name);
     mAttributes.add(name, slot);
@@ -164,6 +236,14 @@ void Program::set(const mat4& projectionMatrix, const mat4& modelViewMatrix,
     t.multiply(transformMatrix);
     t.multiply(modelViewMatrix);
 
+    // Uniforms are part of the program's state and survive program switches
+    if (mHasTransform && !memcmp(&mTransform.data[0], &t.data[0], sizeof(t.data))) {
+        Caches::getInstance().frameStats.countRedundantCall();
+        return;
+    }
+    mTransform.load(t);
+    mHasTransform = true;
+
     glUniformMatrix4fv(transform, 1, GL_FALSE, &t.data[0]);
 }
 
@@ -172,6 +252,16 @@ void Program::setColor(const float r, const float g, const float b, const float
         mColorUniform = getUniform("color");
         mHasColorUniform = true;
     }
+    if (mHasColor && mColor[0] == r && mColor[1] == g && mColor[2] == b && mColor[3] == a) {
+        Caches::getInstance().frameStats.countRedundantCall();
+        return;
+    }
+    mColor[0] = r;
+    mColor[1] = g;
+    mColor[2] = b;
+    mColor[3] = a;
+    mHasColor = true;
+
     glUniform4f(mColorUniform, r, g, b, a);
 }
 
@@ -77,6 +77,14 @@ namespace uirenderer {
 #define PROGRAM_HAS_EXTERNAL_TEXTURE_SHIFT 38
 #define PROGRAM_HAS_TEXTURE_TRANSFORM_SHIFT 39
 
+#define PROGRAM_HAS_VERTEX_ALPHA_SHIFT 40
+
+#define PROGRAM_IS_SIMPLE_GRADIENT_SHIFT 41
+
+#define PROGRAM_IS_NINE_PATCH_SHIFT 42
+
+#define PROGRAM_HAS_VERTEX_COLOR_SHIFT 43
+
 ///////////////////////////////////////////////////////////////////////////////
 // Types
 ///////////////////////////////////////////////////////////////////////////////
@@ -115,6 +123,10 @@ struct ProgramDescription {
     bool hasAlpha8Texture;
     bool hasExternalTexture;
     bool hasTextureTransform;
+    // 9-patch meshes are stretched in the vertex shader, see PatchVertex
+    bool isNinePatch;
+    // Bitmap meshes with colors modulate the texture with a color per vertex
+    bool hasVertexColor;
 
     // Modulate, this should only be set when setColor() return true
     bool modulate;
@@ -124,9 +136,12 @@ struct ProgramDescription {
     bool isBitmapNpot;
 
     bool isAA;
+    bool hasVertexAlpha;
 
     bool hasGradient;
     Gradient gradientType;
+    // Two stops gradients are interpolated in the shader, without texture
+    bool isSimpleGradient;
 
     SkXfermode::Mode shadersMode;
 
@@ -155,8 +170,11 @@ struct ProgramDescription {
         hasAlpha8Texture = false;
         hasExternalTexture = false;
         hasTextureTransform = false;
+        isNinePatch = false;
+        hasVertexColor = false;
 
         isAA = false;
+        hasVertexAlpha = false;
 
         modulate = false;
 
@@ -165,6 +183,7 @@ struct ProgramDescription {
 
         hasGradient = false;
         gradientType = kGradientLinear;
+        isSimpleGradient = false;
 
         shadersMode = SkXfermode::kClear_Mode;
 
@@ -246,6 +265,12 @@ struct ProgramDescription {
         if (isAA) key |= programid(0x1) << PROGRAM_HAS_AA_SHIFT;
         if (hasExternalTexture) key |= programid(0x1) << PROGRAM_HAS_EXTERNAL_TEXTURE_SHIFT;
         if (hasTextureTransform) key |= programid(0x1) << PROGRAM_HAS_TEXTURE_TRANSFORM_SHIFT;
+        if (hasVertexAlpha) key |= programid(0x1) << PROGRAM_HAS_VERTEX_ALPHA_SHIFT;
+        if (hasGradient && isSimpleGradient) {
+            key |= programid(0x1) << PROGRAM_IS_SIMPLE_GRADIENT_SHIFT;
+        }
+        if (isNinePatch) key |= programid(0x1) << PROGRAM_IS_NINE_PATCH_SHIFT;
+        if (hasVertexColor) key |= programid(0x1) << PROGRAM_HAS_VERTEX_COLOR_SHIFT;
         return key;
     }
 
@@ -291,8 +316,22 @@ public:
      * shaders sources.
      */
     Program(const ProgramDescription& description, const char* vertex, const char* fragment);
+    /**
+     * Creates a new program from a binary previously obtained with
+     * getBinary(). The program is not initialized if the driver rejects
+     * the binary.
+     */
+    Program(const ProgramDescription& description, GLenum binaryFormat,
+            const void* binary, GLsizei length);
     virtual ~Program();
 
+    /**
+     * Retrieves the driver specific binary of this program. Requires the
+     * GL_OES_get_program_binary extension. The caller owns the returned
+     * buffer and must release it with delete[]. Returns NULL on failure.
+     */
+    uint8_t* getBinary(GLenum* binaryFormat, GLsizei* length) const;
+
     /**
      * Binds this program to the GL context.
      */
@@ -377,6 +416,11 @@ protected:
     int addUniform(const char* name);
 
 private:
+    /**
+     * Initializes the uniforms common to all programs once linked.
+     */
+    void initUniforms();
+
     /**
      * Compiles the specified shader of the specified type.
      *
@@ -399,6 +443,12 @@ private:
     bool mHasColorUniform;
     int mColorUniform;
 
+    // Last values set for the transform and color uniforms
+    bool mHasTransform;
+    mat4 mTransform;
+    bool mHasColor;
+    float mColor[4];
+
     bool mHasSampler;
 }; // class Program
 
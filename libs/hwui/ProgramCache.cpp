@@ -16,6 +16,10 @@
 
 #define LOG_TAG "OpenGLRenderer"
 
+#include <stdio.h>
+#include <unistd.h>
+
+#include <utils/Mutex.h>
 #include <utils/String8.h>
 
 #include "Caches.h"
@@ -32,6 +36,12 @@ namespace uirenderer {
 #define MODULATE_OP_MODULATE 1
 #define MODULATE_OP_MODULATE_A8 2
 
+// Program binaries cache file
+#define PROGRAM_CACHE_MAGIC 0x43505748 // 'HWPC'
+#define PROGRAM_CACHE_VERSION 4
+#define PROGRAM_CACHE_MAX_ENTRIES 1024
+#define PROGRAM_CACHE_MAX_BINARY_SIZE (1024 * 1024)
+
 ///////////////////////////////////////////////////////////////////////////////
 // Vertex shaders snippets
 ///////////////////////////////////////////////////////////////////////////////
@@ -40,13 +50,22 @@ const char* gVS_Header_Attributes =
         "attribute vec4 position;\n";
 const char* gVS_Header_Attributes_TexCoords =
         "attribute vec2 texCoords;\n";
+const char* gVS_Header_Attributes_NinePatchTexCoords =
+        "attribute vec4 texCoords;\n";
 const char* gVS_Header_Attributes_AAParameters =
         "attribute float vtxWidth;\n"
         "attribute float vtxLength;\n";
+const char* gVS_Header_Attributes_VertexAlpha =
+        "attribute float vtxAlpha;\n";
+const char* gVS_Header_Attributes_VertexColor =
+        "attribute vec4 vtxColor;\n";
 const char* gVS_Header_Uniforms_TextureTransform =
         "uniform mat4 mainTextureTransform;\n";
 const char* gVS_Header_Uniforms =
         "uniform mat4 transform;\n";
+const char* gVS_Header_Uniforms_IsNinePatch =
+        "uniform vec4 patchStretch;\n"
+        "uniform vec2 patchTextureScale;\n";
 const char* gVS_Header_Uniforms_IsPoint =
         "uniform mediump float pointSize;\n";
 const char* gVS_Header_Uniforms_HasGradient[3] = {
@@ -65,6 +84,10 @@ const char* gVS_Header_Varyings_HasTexture =
 const char* gVS_Header_Varyings_IsAA =
         "varying float widthProportion;\n"
         "varying float lengthProportion;\n";
+const char* gVS_Header_Varyings_HasVertexAlpha =
+        "varying float alpha;\n";
+const char* gVS_Header_Varyings_HasVertexColor =
+        "varying vec4 vertexColor;\n";
 const char* gVS_Header_Varyings_HasBitmap[2] = {
         // Default precision
         "varying vec2 outBitmapTexCoords;\n",
@@ -91,6 +114,8 @@ const char* gVS_Main_OutTexCoords =
         "    outTexCoords = texCoords;\n";
 const char* gVS_Main_OutTransformedTexCoords =
         "    outTexCoords = (mainTextureTransform * vec4(texCoords, 0.0, 1.0)).xy;\n";
+const char* gVS_Main_OutNinePatchTexCoords =
+        "    outTexCoords = (texCoords.xy + texCoords.zw * patchStretch.zw) * patchTextureScale;\n";
 const char* gVS_Main_OutGradient[3] = {
         // Linear
         "    linear = vec2((screenSpace * position).x, 0.5);\n",
@@ -105,11 +130,18 @@ const char* gVS_Main_OutPointBitmapTexCoords =
         "    outPointBitmapTexCoords = (textureTransform * position).xy * textureDimension;\n";
 const char* gVS_Main_Position =
         "    gl_Position = transform * position;\n";
+const char* gVS_Main_NinePatchPosition =
+        "    gl_Position = transform * vec4(position.xy +\n"
+        "            floor(position.zw * patchStretch.xy + 0.5), 0.0, 1.0);\n";
 const char* gVS_Main_PointSize =
         "    gl_PointSize = pointSize;\n";
 const char* gVS_Main_AA =
         "    widthProportion = vtxWidth;\n"
         "    lengthProportion = vtxLength;\n";
+const char* gVS_Main_VertexAlpha =
+        "    alpha = vtxAlpha;\n";
+const char* gVS_Main_VertexColor =
+        "    vertexColor = vtxColor;\n";
 const char* gVS_Footer =
         "}\n\n";
 
@@ -137,13 +169,13 @@ const char* gFS_Uniforms_TextureSampler =
         "uniform sampler2D sampler;\n";
 const char* gFS_Uniforms_ExternalTextureSampler =
         "uniform samplerExternalOES sampler;\n";
-const char* gFS_Uniforms_GradientSampler[3] = {
-        // Linear
-        "uniform sampler2D gradientSampler;\n",
-        // Circular
-        "uniform sampler2D gradientSampler;\n",
-        // Sweep
+const char* gFS_Uniforms_GradientSampler[2] = {
+        // Texture, the uniform is the vertical coordinate of the gradient's row
         "uniform sampler2D gradientSampler;\n"
+        "uniform float gradientRow;\n",
+        // Simple, unpremultiplied colors
+        "uniform vec4 startColor;\n"
+        "uniform vec4 endColor;\n"
 };
 const char* gFS_Uniforms_BitmapSampler =
         "uniform sampler2D bitmapSampler;\n";
@@ -188,13 +220,12 @@ const char* gFS_Fast_SingleModulateA8Texture =
         "\nvoid main(void) {\n"
         "    gl_FragColor = color * texture2D(sampler, outTexCoords).a;\n"
         "}\n\n";
+// Appended to gFS_Main, gFS_Main_FetchGradient and gFS_Main_DitherGradient
 const char* gFS_Fast_SingleGradient =
-        "\nvoid main(void) {\n"
-        "    gl_FragColor = texture2D(gradientSampler, linear);\n"
+        "    gl_FragColor = gradientColor;\n"
         "}\n\n";
 const char* gFS_Fast_SingleModulateGradient =
-        "\nvoid main(void) {\n"
-        "    gl_FragColor = color.a * texture2D(gradientSampler, linear);\n"
+        "    gl_FragColor = color.a * gradientColor;\n"
         "}\n\n";
 
 // General case
@@ -225,16 +256,29 @@ const char* gFS_Main_FetchA8Texture[2] = {
         // Modulate
         "    fragColor = color * texture2D(sampler, outTexCoords).a;\n"
 };
-const char* gFS_Main_FetchGradient[3] = {
+// Indexed by gradientIndex()
+const char* gFS_Main_FetchGradient[6] = {
         // Linear
-        "    vec4 gradientColor = texture2D(gradientSampler, linear);\n",
+        "    vec4 gradientColor = texture2D(gradientSampler, vec2(linear.x, gradientRow));\n",
+        "    vec4 gradientColor = mix(startColor, endColor, clamp(linear.x, 0.0, 1.0));\n"
+        "    gradientColor = vec4(gradientColor.rgb * gradientColor.a, gradientColor.a);\n",
         // Circular
         "    float index = length(circular);\n"
-        "    vec4 gradientColor = texture2D(gradientSampler, vec2(index, 0.5));\n",
+        "    vec4 gradientColor = texture2D(gradientSampler, vec2(index, gradientRow));\n",
+        "    float index = length(circular);\n"
+        "    vec4 gradientColor = mix(startColor, endColor, clamp(index, 0.0, 1.0));\n"
+        "    gradientColor = vec4(gradientColor.rgb * gradientColor.a, gradientColor.a);\n",
         // Sweep
         "    float index = atan(sweep.y, sweep.x) * 0.15915494309; // inv(2 * PI)\n"
-        "    vec4 gradientColor = texture2D(gradientSampler, vec2(index - floor(index), 0.5));\n"
+        "    vec4 gradientColor = texture2D(gradientSampler, vec2(index - floor(index), gradientRow));\n",
+        "    float index = atan(sweep.y, sweep.x) * 0.15915494309; // inv(2 * PI)\n"
+        "    vec4 gradientColor = mix(startColor, endColor, index - floor(index));\n"
+        "    gradientColor = vec4(gradientColor.rgb * gradientColor.a, gradientColor.a);\n"
 };
+// Adds a 2x2 ordered dither of +/- 3/8 of a color step to hide the banding
+const char* gFS_Main_DitherGradient =
+        "    gradientColor.rgb += (mod(dot(mod(gl_FragCoord.xy - 0.5, 2.0), vec2(2.0, 3.0)), 4.0) *\n"
+        "            0.25 - 0.375) * 0.00392156862 * gradientColor.a;\n";
 const char* gFS_Main_FetchBitmap =
         "    vec4 bitmapColor = texture2D(bitmapSampler, outBitmapTexCoords);\n";
 const char* gFS_Main_FetchBitmapNpot =
@@ -267,6 +311,10 @@ const char* gFS_Main_BitmapShader_Modulate[3] = {
         // Modulate with alpha 8 texture
         "    fragColor = bitmapColor * texture2D(sampler, outTexCoords).a;\n"
     };
+const char* gFS_Main_ApplyVertexAlpha =
+        "    fragColor *= alpha;\n";
+const char* gFS_Main_ApplyVertexColor =
+        "    fragColor *= vertexColor;\n";
 const char* gFS_Main_FragColor =
         "    gl_FragColor = fragColor;\n";
 const char* gFS_Main_FragColor_Blend =
@@ -345,11 +393,21 @@ const char* gBlendOps[18] = {
 // Constructors/destructors
 ///////////////////////////////////////////////////////////////////////////////
 
-ProgramCache::ProgramCache() {
+static Mutex sBinaryCacheLock;
+static String8 sBinaryCacheFile;
+
+ProgramCache::ProgramCache(): mBinariesSupported(false), mCacheLoaded(false),
+        mCacheDirty(false) {
 }
 
 ProgramCache::~ProgramCache() {
+    stopWarmup();
     clear();
+
+    for (size_t i = 0; i < mBinaries.size(); i++) {
+        delete mBinaries.valueAt(i);
+    }
+    mBinaries.clear();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -369,17 +427,401 @@ void ProgramCache::clear() {
 Program* ProgramCache::get(const ProgramDescription& description) {
     programid key = description.key();
     ssize_t index = mCache.indexOfKey(key);
+    if (index < 0 && mWarmupThread != NULL) {
+        adoptWarmedPrograms();
+        index = mCache.indexOfKey(key);
+    }
+
     Program* program = NULL;
     if (index < 0) {
         description.log("Could not find program");
-        program = generateProgram(description, key);
+        program = loadProgram(description, key);
+        if (!program) {
+            program = generateProgram(description, key);
+            Caches::getInstance().frameStats.countShaderCompile();
+            if (mBinariesSupported && program->isInitialized()) {
+                mCacheDirty = true;
+            }
+        }
         mCache.add(key, program);
+        recordDescription(description, key);
     } else {
         program = mCache.valueAt(index);
     }
     return program;
 }
 
+void ProgramCache::recordDescription(const ProgramDescription& description, programid key) {
+    if (mDescriptions.indexOfKey(key) < 0 && mDescriptions.size() < PROGRAM_CACHE_MAX_ENTRIES) {
+        mDescriptions.add(key, description);
+        mCacheDirty = true;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Persistent cache
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgramCache::setBinaryCacheFile(const char* filename) {
+    Mutex::Autolock _l(sBinaryCacheLock);
+    sBinaryCacheFile.setTo(filename);
+}
+
+/**
+ * Binaries are only valid for the driver that produced them.
+ */
+static String8 getDriverIdentity() {
+    String8 identity;
+    identity.appendFormat("%s|%s|%s", glGetString(GL_VENDOR), glGetString(GL_RENDERER),
+            glGetString(GL_VERSION));
+    return identity;
+}
+
+static String8 getBinaryCacheFile() {
+    Mutex::Autolock _l(sBinaryCacheLock);
+    return sBinaryCacheFile;
+}
+
+static bool readValue(FILE* file, void* value, size_t size) {
+    return fread(value, size, 1, file) == 1;
+}
+
+static bool writeValue(FILE* file, const void* value, size_t size) {
+    return fwrite(value, size, 1, file) == 1;
+}
+
+void ProgramCache::loadCache(bool binariesSupported) {
+    mBinariesSupported = binariesSupported;
+    if (mCacheLoaded) return;
+    mCacheLoaded = true;
+
+    const String8 filename = getBinaryCacheFile();
+    if (filename.isEmpty()) return;
+
+    FILE* file = fopen(filename.string(), "rb");
+    if (!file) return;
+
+    // Descriptions are stored as is, the file is ignored if the
+    // layout of the description changed
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t descriptionSize = 0;
+    uint32_t count = 0;
+    bool valid = readValue(file, &magic, sizeof(magic)) && magic == PROGRAM_CACHE_MAGIC &&
+            readValue(file, &version, sizeof(version)) && version == PROGRAM_CACHE_VERSION &&
+            readValue(file, &descriptionSize, sizeof(descriptionSize)) &&
+            descriptionSize == sizeof(ProgramDescription) &&
+            readValue(file, &count, sizeof(count)) && count <= PROGRAM_CACHE_MAX_ENTRIES;
+
+    for (uint32_t i = 0; valid && i < count; i++) {
+        programid key;
+        ProgramDescription description;
+        valid = readValue(file, &key, sizeof(key)) &&
+                readValue(file, &description, sizeof(description)) &&
+                description.key() == key;
+        if (valid) {
+            mDescriptions.replaceValueFor(key, description);
+        }
+    }
+
+    if (!valid) {
+        mDescriptions.clear();
+    }
+
+    const String8 identity = getDriverIdentity();
+    uint32_t identityLength = 0;
+    valid = valid && mBinariesSupported &&
+            readValue(file, &identityLength, sizeof(identityLength)) &&
+            identityLength == identity.length();
+
+    if (valid) {
+        char storedIdentity[identityLength];
+        valid = readValue(file, storedIdentity, identityLength) &&
+                !memcmp(storedIdentity, identity.string(), identityLength);
+    }
+
+    valid = valid && readValue(file, &count, sizeof(count)) &&
+            count <= PROGRAM_CACHE_MAX_ENTRIES;
+
+    for (uint32_t i = 0; valid && i < count; i++) {
+        programid key;
+        uint32_t format;
+        uint32_t length;
+        valid = readValue(file, &key, sizeof(key)) &&
+                readValue(file, &format, sizeof(format)) &&
+                readValue(file, &length, sizeof(length)) &&
+                length > 0 && length <= PROGRAM_CACHE_MAX_BINARY_SIZE;
+        if (!valid) break;
+
+        ProgramBinary* binary = new ProgramBinary;
+        binary->format = format;
+        binary->length = length;
+        binary->data = new uint8_t[length];
+
+        valid = readValue(file, binary->data, length) && mBinaries.indexOfKey(key) < 0;
+        if (valid) {
+            mBinaries.add(key, binary);
+        } else {
+            delete binary;
+        }
+    }
+
+    fclose(file);
+
+    if (!valid) {
+        // Stale, corrupted or unsupported binaries, they will be
+        // rewritten on the next save
+        for (size_t i = 0; i < mBinaries.size(); i++) {
+            delete mBinaries.valueAt(i);
+        }
+        mBinaries.clear();
+    }
+
+    PROGRAM_LOGD("Loaded %d program descriptions and %d binaries from %s",
+            mDescriptions.size(), mBinaries.size(), filename.string());
+}
+
+void ProgramCache::saveCache() {
+    if (!mCacheDirty) return;
+    mCacheDirty = false;
+
+    const String8 filename = getBinaryCacheFile();
+    if (filename.isEmpty()) return;
+
+    // Collect the binaries of programs compiled since the cache was loaded
+    if (mBinariesSupported) {
+        for (size_t i = 0; i < mCache.size(); i++) {
+            const programid key = mCache.keyAt(i);
+            if (mBinaries.indexOfKey(key) >= 0) continue;
+
+            ProgramBinary binary;
+            binary.data = mCache.valueAt(i)->getBinary(&binary.format, &binary.length);
+            if (binary.data && binary.length <= PROGRAM_CACHE_MAX_BINARY_SIZE &&
+                    mBinaries.size() < PROGRAM_CACHE_MAX_ENTRIES) {
+                ProgramBinary* entry = new ProgramBinary;
+                entry->format = binary.format;
+                entry->length = binary.length;
+                entry->data = binary.data;
+                binary.data = NULL;
+                mBinaries.add(key, entry);
+            }
+        }
+    }
+
+    // Write to a temporary file first so a crash cannot leave a truncated cache
+    String8 temporary(filename);
+    temporary.append(".tmp");
+
+    FILE* file = fopen(temporary.string(), "wb");
+    if (!file) {
+        ALOGW("Could not open program cache %s", temporary.string());
+        return;
+    }
+
+    const uint32_t magic = PROGRAM_CACHE_MAGIC;
+    const uint32_t version = PROGRAM_CACHE_VERSION;
+    const uint32_t descriptionSize = sizeof(ProgramDescription);
+    const uint32_t descriptionsCount = mDescriptions.size();
+
+    bool written = writeValue(file, &magic, sizeof(magic)) &&
+            writeValue(file, &version, sizeof(version)) &&
+            writeValue(file, &descriptionSize, sizeof(descriptionSize)) &&
+            writeValue(file, &descriptionsCount, sizeof(descriptionsCount));
+
+    for (size_t i = 0; written && i < mDescriptions.size(); i++) {
+        const programid key = mDescriptions.keyAt(i);
+        written = writeValue(file, &key, sizeof(key)) &&
+                writeValue(file, &mDescriptions.valueAt(i), sizeof(ProgramDescription));
+    }
+
+    if (mBinariesSupported) {
+        const String8 identity = getDriverIdentity();
+        const uint32_t identityLength = identity.length();
+        const uint32_t binariesCount = mBinaries.size();
+
+        written = written && writeValue(file, &identityLength, sizeof(identityLength)) &&
+                writeValue(file, identity.string(), identityLength) &&
+                writeValue(file, &binariesCount, sizeof(binariesCount));
+
+        for (size_t i = 0; written && i < mBinaries.size(); i++) {
+            const programid key = mBinaries.keyAt(i);
+            const ProgramBinary* binary = mBinaries.valueAt(i);
+            const uint32_t format = binary->format;
+            const uint32_t length = binary->length;
+
+            written = writeValue(file, &key, sizeof(key)) &&
+                    writeValue(file, &format, sizeof(format)) &&
+                    writeValue(file, &length, sizeof(length)) &&
+                    writeValue(file, binary->data, length);
+        }
+    }
+
+    written = fclose(file) == 0 && written;
+    if (!written || rename(temporary.string(), filename.string())) {
+        ALOGW("Could not write program cache %s", filename.string());
+        unlink(temporary.string());
+        return;
+    }
+
+    PROGRAM_LOGD("Saved %d program descriptions and %d binaries to %s",
+            mDescriptions.size(), mBinaries.size(), filename.string());
+}
+
+Program* ProgramCache::loadProgram(const ProgramDescription& description, programid key) {
+    ssize_t index = mBinaries.indexOfKey(key);
+    if (index < 0) return NULL;
+
+    const ProgramBinary* binary = mBinaries.valueAt(index);
+    Program* program = new Program(description, binary->format, binary->data, binary->length);
+    if (!program->isInitialized()) {
+        // The binary is stale, recompile and save the new binary
+        delete program;
+        delete mBinaries.valueAt(index);
+        mBinaries.removeItemsAt(index);
+        mCacheDirty = true;
+        return NULL;
+    }
+
+    return program;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Warmup
+///////////////////////////////////////////////////////////////////////////////
+
+void ProgramCache::startWarmup() {
+    if (mWarmupThread != NULL) return;
+
+    // Programs that can be restored from a binary are cheap enough
+    // to be loaded on demand
+    Vector<ProgramDescription> queue;
+    for (size_t i = 0; i < mDescriptions.size(); i++) {
+        const programid key = mDescriptions.keyAt(i);
+        if (mCache.indexOfKey(key) < 0 && mBinaries.indexOfKey(key) < 0) {
+            queue.push(mDescriptions.valueAt(i));
+        }
+    }
+    if (queue.isEmpty()) return;
+
+    EGLDisplay display = eglGetCurrentDisplay();
+    EGLContext context = eglGetCurrentContext();
+    if (display == EGL_NO_DISPLAY || context == EGL_NO_CONTEXT) return;
+
+    {
+        Mutex::Autolock _l(mWarmupLock);
+        mWarmupQueue = queue;
+    }
+
+    PROGRAM_LOGD("Warming up %d programs", queue.size());
+
+    mWarmupThread = new WarmupThread(this, display, context);
+    mWarmupThread->run("hwuiProgramWarmup", PRIORITY_BACKGROUND);
+}
+
+void ProgramCache::stopWarmup() {
+    if (mWarmupThread == NULL) return;
+
+    mWarmupThread->requestExitAndWait();
+    mWarmupThread.clear();
+
+    {
+        Mutex::Autolock _l(mWarmupLock);
+        mWarmupQueue.clear();
+    }
+
+    adoptWarmedPrograms();
+}
+
+void ProgramCache::adoptWarmedPrograms() {
+    Mutex::Autolock _l(mWarmupLock);
+
+    for (size_t i = 0; i < mWarmedPrograms.size(); i++) {
+        const programid key = mWarmedPrograms.keyAt(i);
+        Program* program = mWarmedPrograms.valueAt(i);
+        if (mCache.indexOfKey(key) < 0) {
+            mCache.add(key, program);
+            if (mBinariesSupported) mCacheDirty = true;
+        } else {
+            // The render thread needed this program before it was ready
+            delete program;
+        }
+    }
+    mWarmedPrograms.clear();
+}
+
+ProgramCache::WarmupThread::WarmupThread(ProgramCache* cache, EGLDisplay display,
+        EGLContext sharedContext): Thread(false),
+        mProgramCache(cache), mDisplay(display), mSharedContext(sharedContext) {
+}
+
+bool ProgramCache::WarmupThread::threadLoop() {
+    EGLint configAttribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_NONE
+    };
+    EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    EGLint surfaceAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(mDisplay, configAttribs, &config, 1, &configCount) ||
+            configCount == 0) {
+        ALOGW("Could not find an EGL config to warm up programs");
+        return false;
+    }
+
+    EGLContext context = eglCreateContext(mDisplay, config, mSharedContext, contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        ALOGW("Could not create an EGL context to warm up programs");
+        return false;
+    }
+
+    EGLSurface surface = eglCreatePbufferSurface(mDisplay, config, surfaceAttribs);
+    if (surface != EGL_NO_SURFACE && eglMakeCurrent(mDisplay, surface, surface, context)) {
+        while (mProgramCache->warmup(this)) { }
+        eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    } else {
+        ALOGW("Could not make the program warmup context current");
+    }
+
+    if (surface != EGL_NO_SURFACE) eglDestroySurface(mDisplay, surface);
+    eglDestroyContext(mDisplay, context);
+
+    // The thread only runs once
+    return false;
+}
+
+bool ProgramCache::warmup(Thread* thread) {
+    ProgramDescription description;
+    {
+        Mutex::Autolock _l(mWarmupLock);
+        if (mWarmupQueue.isEmpty() || thread->exitPending()) return false;
+        description = mWarmupQueue.itemAt(0);
+        mWarmupQueue.removeAt(0);
+    }
+
+    const programid key = description.key();
+    Program* program = generateProgram(description, key);
+
+    // The program must be complete before the render context can use it
+    glFinish();
+
+    if (!program->isInitialized()) {
+        delete program;
+        return true;
+    }
+
+    Mutex::Autolock _l(mWarmupLock);
+    if (mWarmedPrograms.indexOfKey(key) < 0) {
+        mWarmedPrograms.add(key, program);
+    } else {
+        delete program;
+    }
+
+    return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Program generation
 ///////////////////////////////////////////////////////////////////////////////
@@ -395,12 +837,20 @@ Program* ProgramCache::generateProgram(const ProgramDescription& description, pr
 String8 ProgramCache::generateVertexShader(const ProgramDescription& description) {
     // Add attributes
     String8 shader(gVS_Header_Attributes);
-    if (description.hasTexture || description.hasExternalTexture) {
+    if (description.isNinePatch) {
+        shader.append(gVS_Header_Attributes_NinePatchTexCoords);
+    } else if (description.hasTexture || description.hasExternalTexture) {
         shader.append(gVS_Header_Attributes_TexCoords);
     }
     if (description.isAA) {
         shader.append(gVS_Header_Attributes_AAParameters);
     }
+    if (description.hasVertexAlpha) {
+        shader.append(gVS_Header_Attributes_VertexAlpha);
+    }
+    if (description.hasVertexColor) {
+        shader.append(gVS_Header_Attributes_VertexColor);
+    }
     // Uniforms
     shader.append(gVS_Header_Uniforms);
     if (description.hasTextureTransform) {
@@ -415,6 +865,9 @@ String8 ProgramCache::generateVertexShader(const ProgramDescription& description
     if (description.isPoint) {
         shader.append(gVS_Header_Uniforms_IsPoint);
     }
+    if (description.isNinePatch) {
+        shader.append(gVS_Header_Uniforms_IsNinePatch);
+    }
     // Varyings
     if (description.hasTexture || description.hasExternalTexture) {
         shader.append(gVS_Header_Varyings_HasTexture);
@@ -422,6 +875,12 @@ String8 ProgramCache::generateVertexShader(const ProgramDescription& description
     if (description.isAA) {
         shader.append(gVS_Header_Varyings_IsAA);
     }
+    if (description.hasVertexAlpha) {
+        shader.append(gVS_Header_Varyings_HasVertexAlpha);
+    }
+    if (description.hasVertexColor) {
+        shader.append(gVS_Header_Varyings_HasVertexColor);
+    }
     if (description.hasGradient) {
         shader.append(gVS_Header_Varyings_HasGradient[description.gradientType]);
     }
@@ -434,7 +893,9 @@ String8 ProgramCache::generateVertexShader(const ProgramDescription& description
 
     // Begin the shader
     shader.append(gVS_Main); {
-        if (description.hasTextureTransform) {
+        if (description.isNinePatch) {
+            shader.append(gVS_Main_OutNinePatchTexCoords);
+        } else if (description.hasTextureTransform) {
             shader.append(gVS_Main_OutTransformedTexCoords);
         } else if (description.hasTexture || description.hasExternalTexture) {
             shader.append(gVS_Main_OutTexCoords);
@@ -442,6 +903,12 @@ String8 ProgramCache::generateVertexShader(const ProgramDescription& description
         if (description.isAA) {
             shader.append(gVS_Main_AA);
         }
+        if (description.hasVertexAlpha) {
+            shader.append(gVS_Main_VertexAlpha);
+        }
+        if (description.hasVertexColor) {
+            shader.append(gVS_Main_VertexColor);
+        }
         if (description.hasGradient) {
             shader.append(gVS_Main_OutGradient[description.gradientType]);
         }
@@ -454,7 +921,8 @@ String8 ProgramCache::generateVertexShader(const ProgramDescription& description
             shader.append(gVS_Main_PointSize);
         }
         // Output transformed position
-        shader.append(gVS_Main_Position);
+        shader.append(description.isNinePatch ?
+                gVS_Main_NinePatchPosition : gVS_Main_Position);
     }
     // End the shader
     shader.append(gVS_Footer);
@@ -464,6 +932,10 @@ String8 ProgramCache::generateVertexShader(const ProgramDescription& description
     return shader;
 }
 
+static inline size_t gradientIndex(const ProgramDescription& description) {
+    return description.gradientType * 2 + description.isSimpleGradient;
+}
+
 String8 ProgramCache::generateFragmentShader(const ProgramDescription& description) {
     String8 shader;
 
@@ -484,6 +956,12 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
     if (description.isAA) {
         shader.append(gVS_Header_Varyings_IsAA);
     }
+    if (description.hasVertexAlpha) {
+        shader.append(gVS_Header_Varyings_HasVertexAlpha);
+    }
+    if (description.hasVertexColor) {
+        shader.append(gVS_Header_Varyings_HasVertexColor);
+    }
     if (description.hasGradient) {
         shader.append(gVS_Header_Varyings_HasGradient[description.gradientType]);
     }
@@ -512,15 +990,15 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
         shader.append(gFS_Uniforms_AA);
     }
     if (description.hasGradient) {
-        shader.append(gFS_Uniforms_GradientSampler[description.gradientType]);
+        shader.append(gFS_Uniforms_GradientSampler[description.isSimpleGradient]);
     }
     if (description.hasBitmap && description.isPoint) {
         shader.append(gFS_Header_Uniforms_PointHasBitmap);
     }
 
     // Optimization for common cases
-    if (!description.isAA && !blendFramebuffer &&
-            description.colorOp == ProgramDescription::kColorNone && !description.isPoint) {
+    if (!description.isAA && !description.hasVertexAlpha && !description.hasVertexColor &&
+            !blendFramebuffer && description.colorOp == ProgramDescription::kColorNone && !description.isPoint) {
         bool fast = false;
 
         const bool noShader = !description.hasGradient && !description.hasBitmap;
@@ -550,6 +1028,9 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
             }
             fast = true;
         } else if (singleGradient) {
+            shader.append(gFS_Main);
+            shader.append(gFS_Main_FetchGradient[gradientIndex(description)]);
+            shader.append(gFS_Main_DitherGradient);
             if (!description.modulate) {
                 shader.append(gFS_Fast_SingleGradient);
             } else {
@@ -608,7 +1089,8 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
             shader.append(gFS_Main_AccountForAA);
         }
         if (description.hasGradient) {
-            shader.append(gFS_Main_FetchGradient[description.gradientType]);
+            shader.append(gFS_Main_FetchGradient[gradientIndex(description)]);
+            shader.append(gFS_Main_DitherGradient);
         }
         if (description.hasBitmap) {
             if (description.isPoint) {
@@ -645,8 +1127,15 @@ String8 ProgramCache::generateFragmentShader(const ProgramDescription& descripti
         if (description.modulate && applyModulate) {
             shader.append(gFS_Main_ModulateColor);
         }
+        // Vertex colors modulate the texture before the color filter, as in Skia
+        if (description.hasVertexColor) {
+            shader.append(gFS_Main_ApplyVertexColor);
+        }
         // Apply the color op if needed
         shader.append(gFS_Main_ApplyColorOp[description.colorOp]);
+        if (description.hasVertexAlpha) {
+            shader.append(gFS_Main_ApplyVertexAlpha);
+        }
         // Output the fragment
         if (!blendFramebuffer) {
             shader.append(gFS_Main_FragColor);
@@ -20,7 +20,10 @@
 #include <utils/KeyedVector.h>
 #include <utils/Log.h>
 #include <utils/String8.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 
+#include <EGL/egl.h>
 #include <GLES2/gl2.h>
 
 #include "Debug.h"
@@ -58,7 +61,76 @@ public:
 
     void clear();
 
+    /**
+     * Sets the file used to persist programs between runs of the
+     * application. Must be called before the caches are initialized.
+     */
+    static void setBinaryCacheFile(const char* filename);
+
+    /**
+     * Loads the cache file, if any. The file records the descriptions of
+     * the programs used by previous runs and, when the driver supports it,
+     * their binaries. Binaries are discarded if they were produced by a
+     * different driver. Programs are only created from the binaries when
+     * first requested.
+     */
+    void loadCache(bool binariesSupported);
+    /**
+     * Writes the descriptions and the binaries of all the programs used so
+     * far to the cache file. Does nothing if no new program was used.
+     */
+    void saveCache();
+
+    /**
+     * Compiles, on a background thread, the programs recorded by previous
+     * runs that could not be restored from a binary. The thread renders with
+     * an EGL context that shares objects with the current context, so this
+     * method must be called from the render thread.
+     */
+    void startWarmup();
+    /**
+     * Stops the background compilation started by startWarmup() and waits
+     * for it to complete. Must be called before the current context is
+     * destroyed.
+     */
+    void stopWarmup();
+
 private:
+    struct ProgramBinary {
+        ProgramBinary(): format(0), length(0), data(NULL) { }
+        ~ProgramBinary() {
+            delete[] data;
+        }
+
+        GLenum format;
+        GLsizei length;
+        uint8_t* data;
+    };
+
+    class WarmupThread: public Thread {
+    public:
+        WarmupThread(ProgramCache* cache, EGLDisplay display, EGLContext sharedContext);
+
+    private:
+        virtual bool threadLoop();
+
+        ProgramCache* mProgramCache;
+        EGLDisplay mDisplay;
+        EGLContext mSharedContext;
+    }; // class WarmupThread
+
+    /**
+     * Invoked on the warmup thread, returns false if the thread must exit.
+     */
+    bool warmup(Thread* thread);
+    /**
+     * Moves the programs compiled by the warmup thread to the cache.
+     */
+    void adoptWarmedPrograms();
+
+    void recordDescription(const ProgramDescription& description, programid key);
+
+    Program* loadProgram(const ProgramDescription& description, programid key);
     Program* generateProgram(const ProgramDescription& description, programid key);
     String8 generateVertexShader(const ProgramDescription& description);
     String8 generateFragmentShader(const ProgramDescription& description);
@@ -68,6 +140,18 @@ private:
     void printLongString(const String8& shader) const;
 
     KeyedVector<programid, Program*> mCache;
+    KeyedVector<programid, ProgramBinary*> mBinaries;
+    KeyedVector<programid, ProgramDescription> mDescriptions;
+
+    bool mBinariesSupported;
+    bool mCacheLoaded;
+    bool mCacheDirty;
+
+    // Shared with the warmup thread
+    sp<WarmupThread> mWarmupThread;
+    Vector<ProgramDescription> mWarmupQueue;
+    KeyedVector<programid, Program*> mWarmedPrograms;
+    mutable Mutex mWarmupLock;
 }; // class ProgramCache
 
 }; // namespace uirenderer
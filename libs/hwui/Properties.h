@@ -31,7 +31,8 @@
 // If turned on, text is interpreted as glyphs instead of UTF-16
 #define RENDER_TEXT_AS_GLYPHS 1
 
-// Indicates whether to remove the biggest layers first, or the smaller ones
+// Indicates whether to remove the biggest layers first, or the least
+// recently used ones
 #define LAYER_REMOVE_BIGGEST_FIRST 0
 
 // Textures used by layers must have dimensions multiples of this number
@@ -57,17 +58,65 @@ enum DebugLevel {
     kDebugMoreCaches = kDebugMemory | kDebugCaches
 };
 
+// Set to "true" to batch compatible operations when replaying display lists
+#define PROPERTY_DEFERRED_REPLAY "hwui.deferred_replay"
+
+// Set to "true" to skip display list operations hidden by opaque operations
+#define PROPERTY_OCCLUSION "hwui.occlusion"
+
+// Set to "true" to rasterize recorded text in a background thread
+#define PROPERTY_TEXT_PRECACHE "hwui.text_precache"
+
+// Set to "true" to blur text shadows on the GPU instead of the CPU
+#define PROPERTY_GPU_TEXT_BLUR "hwui.gpu_text_blur"
+
+// Set to "true" to pack small bitmaps into shared atlas textures
+#define PROPERTY_TEXTURE_ATLAS "hwui.texture_atlas"
+
+// Set to "true" to upload large bitmaps in a background thread
+#define PROPERTY_ASYNC_TEXTURE_UPLOAD "hwui.async_texture_upload"
+// Color, in hexadecimal ARGB, drawn in place of bitmaps still being uploaded
+// in the background. Nothing is drawn if this property is not set
+#define PROPERTY_TEXTURE_PLACEHOLDER "hwui.texture_placeholder"
+// Set to "true" to compress large, opaque and immutable bitmaps to ETC1
+// in the background thread used for asynchronous uploads
+#define PROPERTY_TEXTURE_COMPRESSION "hwui.texture_compression"
+
+// Set to "true" to stream the vertices of lines and points in a VBO instead
+// of drawing them from client memory
+#define PROPERTY_STREAM_VERTICES "hwui.stream_vertices"
+
+// Set to "true" to draw paths as triangle meshes instead of alpha textures
+// whenever possible
+#define PROPERTY_PATH_TESSELLATION "hwui.path_tessellation"
+
+// Set to "true" to keep timing statistics of the recent frames, they are
+// output with dumpsys gfxinfo
+#define PROPERTY_FRAME_STATS "hwui.frame_stats"
+
+// Set to "true" to replay display lists and swap buffers on a dedicated
+// render thread instead of the thread that records them
+#define PROPERTY_RENDER_THREAD "hwui.render_thread"
+
+// Set to "true" to let the texture, gradient, path, picture and drop shadow
+// caches lend unused memory to each other within their combined sizes
+#define PROPERTY_CACHE_BALANCING "hwui.cache_balancing"
+
 // These properties are defined in mega-bytes
 #define PROPERTY_TEXTURE_CACHE_SIZE "ro.hwui.texture_cache_size"
 #define PROPERTY_LAYER_CACHE_SIZE "ro.hwui.layer_cache_size"
 #define PROPERTY_GRADIENT_CACHE_SIZE "ro.hwui.gradient_cache_size"
 #define PROPERTY_PATH_CACHE_SIZE "ro.hwui.path_cache_size"
 #define PROPERTY_SHAPE_CACHE_SIZE "ro.hwui.shape_cache_size"
+#define PROPERTY_PATH_MESH_CACHE_SIZE "ro.hwui.path_mesh_cache_size"
+#define PROPERTY_BITMAP_MESH_CACHE_SIZE "ro.hwui.bitmap_mesh_cache_size"
+#define PROPERTY_PICTURE_CACHE_SIZE "ro.hwui.picture_cache_size"
 #define PROPERTY_DROP_SHADOW_CACHE_SIZE "ro.hwui.drop_shadow_cache_size"
 #define PROPERTY_FBO_CACHE_SIZE "ro.hwui.fbo_cache_size"
 
 // These properties are defined in percentage (range 0..1)
 #define PROPERTY_TEXTURE_CACHE_FLUSH_RATE "ro.hwui.texture_cache_flush_rate"
+#define PROPERTY_LAYER_CACHE_FLUSH_RATE "ro.hwui.layer_cache_flush_rate"
 
 // These properties are defined in pixels
 #define PROPERTY_TEXT_CACHE_WIDTH "ro.hwui.text_cache_width"
@@ -88,12 +137,16 @@ enum DebugLevel {
 #define DEFAULT_LAYER_CACHE_SIZE 16.0f
 #define DEFAULT_PATH_CACHE_SIZE 4.0f
 #define DEFAULT_SHAPE_CACHE_SIZE 1.0f
+#define DEFAULT_PATH_MESH_CACHE_SIZE 1.0f
+#define DEFAULT_BITMAP_MESH_CACHE_SIZE 1.0f
+#define DEFAULT_PICTURE_CACHE_SIZE 2.0f
 #define DEFAULT_PATCH_CACHE_SIZE 512
 #define DEFAULT_GRADIENT_CACHE_SIZE 0.5f
 #define DEFAULT_DROP_SHADOW_CACHE_SIZE 2.0f
 #define DEFAULT_FBO_CACHE_SIZE 16
 
 #define DEFAULT_TEXTURE_CACHE_FLUSH_RATE 0.6f
+#define DEFAULT_LAYER_CACHE_FLUSH_RATE 0.5f
 
 #define DEFAULT_TEXT_GAMMA 1.4f
 #define DEFAULT_TEXT_BLACK_GAMMA_THRESHOLD 64
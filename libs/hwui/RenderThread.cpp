@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <cutils/properties.h>
+#include <utils/Log.h>
+
+#include "Caches.h"
+#include "DisplayListRenderer.h"
+#include "Properties.h"
+#include "RenderThread.h"
+
+namespace android {
+namespace uirenderer {
+
+// Whether Caches was created by a render thread, with a context current
+static bool sCachesCreatedOnRenderThread = false;
+
+///////////////////////////////////////////////////////////////////////////////
+// Tasks
+///////////////////////////////////////////////////////////////////////////////
+
+class RenderThread::InitTask: public RenderTask {
+public:
+    InitTask(RenderThread* renderThread): mRenderThread(renderThread), result(false) { }
+
+    virtual void run() {
+        result = mRenderThread->createContext();
+    }
+
+private:
+    RenderThread* mRenderThread;
+
+public:
+    bool result;
+}; // class InitTask
+
+class RenderThread::TerminateTask: public RenderTask {
+public:
+    TerminateTask(RenderThread* renderThread): mRenderThread(renderThread) { }
+
+    virtual void run() {
+        mRenderThread->destroyContext();
+    }
+
+private:
+    RenderThread* mRenderThread;
+}; // class TerminateTask
+
+class RenderThread::DrawFrameTask: public RenderTask {
+public:
+    DrawFrameTask(RenderThread* renderThread, DisplayList* displayList,
+            int width, int height, bool opaque): mRenderThread(renderThread),
+            mDisplayList(displayList), mWidth(width), mHeight(height), mOpaque(opaque) { }
+
+    virtual void run() {
+        mRenderThread->renderFrame(mDisplayList, mWidth, mHeight, mOpaque);
+    }
+
+private:
+    RenderThread* mRenderThread;
+    DisplayList* mDisplayList;
+    int mWidth;
+    int mHeight;
+    bool mOpaque;
+}; // class DrawFrameTask
+
+class RenderThread::GetDisplayListTask: public RenderTask {
+public:
+    GetDisplayListTask(DisplayListRenderer* recorder, DisplayList* displayList):
+            mRecorder(recorder), displayList(displayList) { }
+
+    virtual void run() {
+        // Releasing the previous resources may delete textures
+        displayList = mRecorder->getDisplayList(displayList);
+    }
+
+private:
+    DisplayListRenderer* mRecorder;
+
+public:
+    DisplayList* displayList;
+}; // class GetDisplayListTask
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+RenderThread::RenderThread(): mWindow(0), mDisplay(EGL_NO_DISPLAY), mContext(EGL_NO_CONTEXT),
+        mSurface(EGL_NO_SURFACE), mRenderer(NULL), mWidth(0), mHeight(0), mInitialized(false),
+        mPosted(0), mCompleted(0), mPendingFrames(0), mExit(false) {
+}
+
+RenderThread::~RenderThread() {
+    terminate();
+}
+
+bool RenderThread::isEnabled() {
+    char property[PROPERTY_VALUE_MAX];
+    return property_get(PROPERTY_RENDER_THREAD, property, NULL) > 0 &&
+            !strcmp(property, "true");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Recording thread
+///////////////////////////////////////////////////////////////////////////////
+
+bool RenderThread::initialize(EGLNativeWindowType window) {
+    if (mThread != NULL) return mInitialized;
+
+    // Caches makes its GL calls when it is constructed, on whichever thread
+    // gets it first. Created without the render thread's context, it would
+    // be marked initialized with nothing set up.
+    if (Caches::hasInstance() && !sCachesCreatedOnRenderThread) {
+        ALOGW("Caches were created before the render thread was initialized, "
+                "display lists cannot be replayed on a render thread");
+        return false;
+    }
+
+    mWindow = window;
+    mExit = false;
+
+    mThread = new WorkerThread(this);
+    mThread->run("hwuiRenderThread", PRIORITY_URGENT_DISPLAY);
+
+    InitTask task(this);
+    runSync(&task);
+
+    if (!task.result) {
+        terminate();
+        return false;
+    }
+
+    INIT_LOGD("Display lists will be replayed on a render thread");
+    return true;
+}
+
+void RenderThread::terminate() {
+    if (mThread == NULL) return;
+
+    TerminateTask task(this);
+    runSync(&task);
+
+    {
+        Mutex::Autolock _l(mLock);
+        mExit = true;
+        mTaskCondition.signal();
+    }
+
+    mThread->requestExitAndWait();
+    mThread.clear();
+}
+
+void RenderThread::drawFrame(DisplayList* displayList, int width, int height, bool opaque) {
+    if (!mInitialized) return;
+
+    {
+        Mutex::Autolock _l(mLock);
+        while (mPendingFrames >= RENDER_THREAD_MAX_PENDING_FRAMES) {
+            mCompletedCondition.wait(mLock);
+        }
+        mPendingFrames++;
+    }
+
+    post(new DrawFrameTask(this, displayList, width, height, opaque), true);
+}
+
+DisplayList* RenderThread::getDisplayList(DisplayListRenderer* recorder,
+        DisplayList* displayList) {
+    GetDisplayListTask task(recorder, displayList);
+    runSync(&task);
+    return task.displayList;
+}
+
+void RenderThread::runSync(RenderTask* task) {
+    if (mThread == NULL) {
+        task->run();
+        return;
+    }
+    waitFor(post(task, false));
+}
+
+uint32_t RenderThread::post(RenderTask* task, bool frame) {
+    Mutex::Autolock _l(mLock);
+    mTasks.push(Entry(task, frame));
+    mTaskCondition.signal();
+    return ++mPosted;
+}
+
+void RenderThread::waitFor(uint32_t sequence) {
+    Mutex::Autolock _l(mLock);
+    while (mCompleted < sequence) {
+        mCompletedCondition.wait(mLock);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Render thread
+///////////////////////////////////////////////////////////////////////////////
+
+RenderThread::WorkerThread::WorkerThread(RenderThread* renderThread): Thread(false),
+        mRenderThread(renderThread) {
+}
+
+bool RenderThread::WorkerThread::threadLoop() {
+    while (mRenderThread->runNext()) { }
+    // The thread loops in runNext()
+    return false;
+}
+
+bool RenderThread::runNext() {
+    Entry entry;
+    {
+        Mutex::Autolock _l(mLock);
+        while (mTasks.isEmpty() && !mExit) {
+            mTaskCondition.wait(mLock);
+        }
+        if (mTasks.isEmpty()) return false;
+
+        entry = mTasks.itemAt(0);
+        mTasks.removeAt(0);
+    }
+
+    entry.task->run();
+    if (entry.frame) {
+        delete entry.task;
+    }
+
+    Mutex::Autolock _l(mLock);
+    if (entry.frame) {
+        mPendingFrames--;
+    }
+    mCompleted++;
+    mCompletedCondition.broadcast();
+
+    return true;
+}
+
+bool RenderThread::createContext() {
+    mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (mDisplay == EGL_NO_DISPLAY || !eglInitialize(mDisplay, NULL, NULL)) {
+        ALOGW("Could not initialize the EGL display for the render thread");
+        return false;
+    }
+
+    EGLint configAttribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+            EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+            EGL_RED_SIZE, 8,
+            EGL_GREEN_SIZE, 8,
+            EGL_BLUE_SIZE, 8,
+            EGL_ALPHA_SIZE, 8,
+            EGL_DEPTH_SIZE, 0,
+            EGL_STENCIL_SIZE, 0,
+            EGL_NONE
+    };
+    EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(mDisplay, configAttribs, &config, 1, &configCount) ||
+            configCount == 0) {
+        ALOGW("Could not find an EGL config for the render thread");
+        return false;
+    }
+
+    mContext = eglCreateContext(mDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+    if (mContext == EGL_NO_CONTEXT) {
+        ALOGW("Could not create an EGL context for the render thread");
+        return false;
+    }
+
+    mSurface = eglCreateWindowSurface(mDisplay, config, mWindow, NULL);
+    if (mSurface == EGL_NO_SURFACE || !eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+        ALOGW("Could not make the render thread context current");
+        destroyContext();
+        return false;
+    }
+
+    // Caches and its GL objects belong to this thread from now on
+    sCachesCreatedOnRenderThread |= !Caches::hasInstance();
+    Caches::getInstance().init();
+    mRenderer = new OpenGLRenderer;
+    mInitialized = true;
+
+    return true;
+}
+
+void RenderThread::destroyContext() {
+    if (mInitialized) {
+        delete mRenderer;
+        mRenderer = NULL;
+        Caches& caches = Caches::getInstance();
+        caches.flush(Caches::kFlushMode_Full);
+        caches.terminate();
+        mInitialized = false;
+    }
+
+    if (mDisplay == EGL_NO_DISPLAY) return;
+
+    eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (mSurface != EGL_NO_SURFACE) eglDestroySurface(mDisplay, mSurface);
+    if (mContext != EGL_NO_CONTEXT) eglDestroyContext(mDisplay, mContext);
+
+    mSurface = EGL_NO_SURFACE;
+    mContext = EGL_NO_CONTEXT;
+    mWidth = mHeight = 0;
+}
+
+void RenderThread::renderFrame(DisplayList* displayList, int width, int height, bool opaque) {
+    if (width != mWidth || height != mHeight) {
+        mRenderer->setViewport(width, height);
+        mWidth = width;
+        mHeight = height;
+    }
+
+    mRenderer->prepare(opaque);
+    if (displayList) {
+        Rect dirty;
+        mRenderer->drawDisplayList(displayList, dirty, DisplayList::kReplayFlag_ClipChildren);
+    }
+    mRenderer->finish();
+
+    if (!eglSwapBuffers(mDisplay, mSurface)) {
+        ALOGW("eglSwapBuffers failed on the render thread: 0x%x", eglGetError());
+    }
+}
+
+}; // namespace uirenderer
+}; // namespace android
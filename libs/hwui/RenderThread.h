@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_RENDER_THREAD_H
+#define ANDROID_HWUI_RENDER_THREAD_H
+
+#include <EGL/egl.h>
+
+#include <cutils/compiler.h>
+
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Number of frames the recording thread can queue ahead of the render thread
+#define RENDER_THREAD_MAX_PENDING_FRAMES 1
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+class DisplayList;
+class DisplayListRenderer;
+class OpenGLRenderer;
+
+/**
+ * Unit of work executed on the render thread.
+ */
+class RenderTask {
+public:
+    virtual ~RenderTask() { }
+    virtual void run() = 0;
+}; // class RenderTask
+
+/**
+ * Replays display lists on a dedicated thread that owns the EGL context,
+ * and therefore Caches and all the GL resources, so that the thread that
+ * records frame N + 1 does not wait for frame N to be submitted and swapped.
+ *
+ * Tasks run in the order they are posted. Display lists must only be
+ * modified on the render thread, between frames: recordings are committed
+ * with getDisplayList() and other changes go through runSync(). Recording
+ * in a DisplayListRenderer does not touch GL and can overlap with a frame.
+ *
+ * All the methods must be called from the recording thread.
+ */
+class RenderThread {
+public:
+    ANDROID_API RenderThread();
+    ANDROID_API ~RenderThread();
+
+    /**
+     * Indicates whether display lists should be replayed on a render thread.
+     */
+    ANDROID_API static bool isEnabled();
+
+    /**
+     * Starts the render thread and creates a context and a surface for the
+     * specified window. Returns false if the context could not be created.
+     * Must be called before anything else in the process uses hwui, which
+     * would create the caches without the render thread's context; it
+     * returns false if that already happened.
+     */
+    ANDROID_API bool initialize(EGLNativeWindowType window);
+    /**
+     * Waits for the queued frames, then destroys the caches, the surface
+     * and the context, and stops the render thread.
+     */
+    ANDROID_API void terminate();
+
+    /**
+     * Queues a frame that replays the specified display list and swaps the
+     * buffers. Blocks only while RENDER_THREAD_MAX_PENDING_FRAMES frames
+     * are already queued.
+     */
+    ANDROID_API void drawFrame(DisplayList* displayList, int width, int height, bool opaque);
+
+    /**
+     * Commits the operations recorded by the specified renderer into the
+     * display list, once the queued frames are drawn.
+     */
+    ANDROID_API DisplayList* getDisplayList(DisplayListRenderer* recorder,
+            DisplayList* displayList);
+
+    /**
+     * Runs the specified task on the render thread, after the queued frames,
+     * and waits for its completion. The task is not deleted.
+     */
+    ANDROID_API void runSync(RenderTask* task);
+
+private:
+    class DrawFrameTask;
+    class InitTask;
+    class TerminateTask;
+    class GetDisplayListTask;
+
+    struct Entry {
+        Entry(): task(NULL), frame(false) { }
+        Entry(RenderTask* task, bool frame): task(task), frame(frame) { }
+
+        RenderTask* task;
+        // Frames are deleted once executed
+        bool frame;
+    };
+
+    class WorkerThread: public Thread {
+    public:
+        WorkerThread(RenderThread* renderThread);
+
+    private:
+        virtual bool threadLoop();
+
+        RenderThread* mRenderThread;
+    }; // class WorkerThread
+
+    /**
+     * Queues a task and returns its sequence number.
+     */
+    uint32_t post(RenderTask* task, bool frame);
+    void waitFor(uint32_t sequence);
+
+    /**
+     * Invoked on the render thread, returns false if the thread must exit.
+     */
+    bool runNext();
+
+    // Render thread only
+    bool createContext();
+    void destroyContext();
+    void renderFrame(DisplayList* displayList, int width, int height, bool opaque);
+
+    EGLNativeWindowType mWindow;
+    EGLDisplay mDisplay;
+    EGLContext mContext;
+    EGLSurface mSurface;
+    OpenGLRenderer* mRenderer;
+    int mWidth;
+    int mHeight;
+    bool mInitialized;
+
+    // Shared with the render thread
+    sp<WorkerThread> mThread;
+    Vector<Entry> mTasks;
+    uint32_t mPosted;
+    uint32_t mCompleted;
+    uint32_t mPendingFrames;
+    bool mExit;
+    Mutex mLock;
+    Condition mTaskCondition;
+    Condition mCompletedCondition;
+}; // class RenderThread
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_RENDER_THREAD_H
@@ -134,6 +134,7 @@ void ResourceCache::destructor(SkPath* resource) {
         // If we're not tracking this resource, just delete it
         if (Caches::hasInstance()) {
             Caches::getInstance().pathCache.removeDeferred(resource);
+            Caches::getInstance().pathMeshCache.removeDeferred(resource);
         }
         delete resource;
         return;
@@ -211,6 +212,7 @@ void ResourceCache::deleteResourceReference(void* resource, ResourceReference* r
                 SkPath* path = (SkPath*) resource;
                 if (Caches::hasInstance()) {
                     Caches::getInstance().pathCache.removeDeferred(path);
+                    Caches::getInstance().pathMeshCache.removeDeferred(path);
                 }
                 delete path;
             }
@@ -497,7 +497,7 @@ void ShapeCache<Entry>::removeTexture(PathTexture* texture) {
             ALOGD("Shape %s deleted, size = %d", mName, size);
         }
 
-        glDeleteTextures(1, &texture->id);
+        texture->deleteTexture();
         delete texture;
     }
 }
@@ -621,7 +621,7 @@ void ShapeCache<Entry>::generateTexture(SkBitmap& bitmap, Texture* texture) {
 
     glGenTextures(1, &texture->id);
 
-    glBindTexture(GL_TEXTURE_2D, texture->id);
+    texture->bind();
     // Textures are Alpha8
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
@@ -38,6 +38,46 @@ static const GLint gTileModes[] = {
         GL_MIRRORED_REPEAT  // == SkShader::kMirror_TileMode
 };
 
+/**
+ * Gradients with two stops at the ends are interpolated in the fragment
+ * shader instead of being sampled from the gradient cache.
+ */
+static bool isSimpleGradient(const float* positions, int count, SkShader::TileMode tileMode) {
+    return count == 2 && positions[0] == 0.0f && positions[1] == 1.0f &&
+            tileMode == SkShader::kClamp_TileMode;
+}
+
+static void setGradientColor(Program* program, const char* name, uint32_t color) {
+    const float a = ((color >> 24) & 0xff) / 255.0f;
+    const float r = ((color >> 16) & 0xff) / 255.0f;
+    const float g = ((color >>  8) & 0xff) / 255.0f;
+    const float b = ((color      ) & 0xff) / 255.0f;
+    glUniform4f(program->getUniform(name), r, g, b, a);
+}
+
+/**
+ * Binds the cached gradient, or sets the colors of a simple gradient.
+ */
+static void setupGradient(Program* program, GradientCache* gradientCache, uint32_t* colors,
+        float* positions, int count, SkShader::TileMode tileMode, GLuint* textureUnit) {
+    if (isSimpleGradient(positions, count, tileMode)) {
+        setGradientColor(program, "startColor", colors[0]);
+        setGradientColor(program, "endColor", colors[1]);
+        return;
+    }
+
+    GLuint textureSlot = (*textureUnit)++;
+    Caches::getInstance().activeTexture(textureSlot);
+
+    Texture* texture = gradientCache->get(colors, positions, count, tileMode);
+
+    Caches::getInstance().bindTexture(texture->id);
+    texture->setWrapST(gTileModes[tileMode], gTileModes[tileMode]);
+    glUniform1i(program->getUniform("gradientSampler"), textureSlot);
+    // Sample the middle of the gradient's row
+    glUniform1f(program->getUniform("gradientRow"), (texture->v1 + texture->v2) * 0.5f);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // Base shader
 ///////////////////////////////////////////////////////////////////////////////
@@ -71,7 +111,7 @@ void SkiaShader::setupProgram(Program* program, const mat4& modelView, const Sna
 }
 
 void SkiaShader::bindTexture(Texture* texture, GLenum wrapS, GLenum wrapT) {
-    glBindTexture(GL_TEXTURE_2D, texture->id);
+    Caches::getInstance().bindTexture(texture->id);
     texture->setWrapST(wrapS, wrapT);
 }
 
@@ -213,21 +253,17 @@ void SkiaLinearGradientShader::describe(ProgramDescription& description,
         const Extensions& extensions) {
     description.hasGradient = true;
     description.gradientType = ProgramDescription::kGradientLinear;
+    description.isSimpleGradient = isSimpleGradient(mPositions, mCount, mTileX);
 }
 
 void SkiaLinearGradientShader::setupProgram(Program* program, const mat4& modelView,
         const Snapshot& snapshot, GLuint* textureUnit) {
-    GLuint textureSlot = (*textureUnit)++;
-    Caches::getInstance().activeTexture(textureSlot);
-
-    Texture* texture = mGradientCache->get(mColors, mPositions, mCount, mTileX);
+    setupGradient(program, mGradientCache, mColors, mPositions, mCount, mTileX, textureUnit);
 
     mat4 screenSpace;
     computeScreenSpaceMatrix(screenSpace, modelView);
 
     // Uniforms
-    bindTexture(texture, gTileModes[mTileX], gTileModes[mTileY]);
-    glUniform1i(program->getUniform("gradientSampler"), textureSlot);
     glUniformMatrix4fv(program->getUniform("screenSpace"), 1, GL_FALSE, &screenSpace.data[0]);
 }
 
@@ -276,6 +312,7 @@ void SkiaCircularGradientShader::describe(ProgramDescription& description,
         const Extensions& extensions) {
     description.hasGradient = true;
     description.gradientType = ProgramDescription::kGradientCircular;
+    description.isSimpleGradient = isSimpleGradient(mPositions, mCount, mTileX);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -325,21 +362,17 @@ void SkiaSweepGradientShader::describe(ProgramDescription& description,
         const Extensions& extensions) {
     description.hasGradient = true;
     description.gradientType = ProgramDescription::kGradientSweep;
+    description.isSimpleGradient = isSimpleGradient(mPositions, mCount, mTileX);
 }
 
 void SkiaSweepGradientShader::setupProgram(Program* program, const mat4& modelView,
         const Snapshot& snapshot, GLuint* textureUnit) {
-    GLuint textureSlot = (*textureUnit)++;
-    Caches::getInstance().activeTexture(textureSlot);
-
-    Texture* texture = mGradientCache->get(mColors, mPositions, mCount);
+    setupGradient(program, mGradientCache, mColors, mPositions, mCount, mTileX, textureUnit);
 
     mat4 screenSpace;
     computeScreenSpaceMatrix(screenSpace, modelView);
 
     // Uniforms
-    bindTexture(texture, gTileModes[mTileX], gTileModes[mTileY]);
-    glUniform1i(program->getUniform("gradientSampler"), textureSlot);
     glUniformMatrix4fv(program->getUniform("screenSpace"), 1, GL_FALSE, &screenSpace.data[0]);
 }
 
@@ -26,10 +26,12 @@ namespace uirenderer {
 ///////////////////////////////////////////////////////////////////////////////
 
 Snapshot::Snapshot(): flags(0), previous(NULL), layer(NULL), fbo(0),
-        invisible(false), empty(false), alpha(1.0f) {
+        invisible(false), empty(false), alpha(1.0f),
+        mSharedTransform(false), mSharedClip(false) {
 
     transform = &mTransformRoot;
     clipRect = &mClipRectRoot;
+    clipRects = &mClipRectsRoot;
     region = NULL;
     clipRegion = NULL;
 }
@@ -37,36 +39,34 @@ Snapshot::Snapshot(): flags(0), previous(NULL), layer(NULL), fbo(0),
 /**
  * Copies the specified snapshot/ The specified snapshot is stored as
  * the previous snapshot.
+ *
+ * The saved transform and clip are only copied when they are first
+ * modified, most snapshots are restored without changing either. The
+ * state that is not saved is shared with the previous snapshot, which
+ * must then own it since modifications have to reach it.
  */
 Snapshot::Snapshot(const sp<Snapshot>& s, int saveFlags):
         flags(0), previous(s), layer(NULL), fbo(s->fbo),
         invisible(s->invisible), empty(false),
         viewport(s->viewport), height(s->height), alpha(s->alpha) {
 
-    clipRegion = NULL;
-
-    if (saveFlags & SkCanvas::kMatrix_SaveFlag) {
-        mTransformRoot.load(*s->transform);
-        transform = &mTransformRoot;
-    } else {
-        transform = s->transform;
+    mSharedTransform = saveFlags & SkCanvas::kMatrix_SaveFlag;
+    if (!mSharedTransform) {
+        s->copyTransformOnWrite();
     }
+    transform = s->transform;
 
-    if (saveFlags & SkCanvas::kClip_SaveFlag) {
-        mClipRectRoot.set(*s->clipRect);
-        clipRect = &mClipRectRoot;
-#if STENCIL_BUFFER_SIZE
-        if (s->clipRegion) {
-            mClipRegionRoot.merge(*s->clipRegion);
-            clipRegion = &mClipRegionRoot;
-        }
-#endif
-    } else {
-        clipRect = s->clipRect;
+    mSharedClip = saveFlags & SkCanvas::kClip_SaveFlag;
+    if (!mSharedClip) {
+        s->copyClipOnWrite();
+    }
+    clipRect = s->clipRect;
+    clipRects = s->clipRects;
 #if STENCIL_BUFFER_SIZE
-        clipRegion = s->clipRegion;
+    clipRegion = s->clipRegion;
+#else
+    clipRegion = NULL;
 #endif
-    }
 
     if (s->flags & Snapshot::kFlagFboTarget) {
         flags |= Snapshot::kFlagFboTarget;
@@ -80,6 +80,23 @@ Snapshot::Snapshot(const sp<Snapshot>& s, int saveFlags):
 // Clipping
 ///////////////////////////////////////////////////////////////////////////////
 
+void Snapshot::copyClipOnWrite() {
+    if (!mSharedClip) return;
+
+    mClipRectRoot.set(*clipRect);
+    clipRect = &mClipRectRoot;
+    mClipRectsRoot = *clipRects;
+    clipRects = &mClipRectsRoot;
+#if STENCIL_BUFFER_SIZE
+    if (clipRegion) {
+        mClipRegionRoot.merge(*clipRegion);
+        clipRegion = &mClipRegionRoot;
+    }
+#endif
+
+    mSharedClip = false;
+}
+
 void Snapshot::ensureClipRegion() {
 #if STENCIL_BUFFER_SIZE
     if (!clipRegion) {
@@ -151,6 +168,140 @@ bool Snapshot::clipRegionNand(float left, float top, float right, float bottom)
 #endif
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Clip rects
+///////////////////////////////////////////////////////////////////////////////
+
+bool ClipRects::intersects(const Rect& r) const {
+    if (count == 0) return true;
+
+    for (uint32_t i = 0; i < count; i++) {
+        Rect rect(rects[i]);
+        rect.snapToPixelBoundaries();
+        if (rect.intersects(r)) return true;
+    }
+
+    return false;
+}
+
+bool Snapshot::intersectClipRects(const Rect& r) {
+    ClipRects& list = *clipRects;
+    if (list.count == 0) return false;
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < list.count; i++) {
+        Rect rect(list.rects[i]);
+        if (rect.intersect(r)) {
+            list.rects[count++].set(rect);
+        }
+    }
+    list.count = count;
+
+    if (count == 0) {
+        clipRect->setEmpty();
+    }
+    return true;
+}
+
+bool Snapshot::unionClipRects(const Rect& r) {
+    ClipRects& list = *clipRects;
+    if (r.isEmpty()) return false;
+
+    if (list.count == 0) {
+        if (clipRect->isEmpty()) return false;
+        list.rects[0].set(*clipRect);
+        list.count = 1;
+    }
+
+    for (uint32_t i = 0; i < list.count; i++) {
+        if (list.rects[i].contains(r)) return true;
+    }
+
+    // Drop the rects covered by the new one
+    Rect bounds(r);
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < list.count; i++) {
+        if (!bounds.contains(list.rects[i])) {
+            list.rects[count++].set(list.rects[i]);
+        }
+    }
+
+    // Past the maximum the clip is only known by its bounds
+    if (count >= SNAPSHOT_MAX_CLIP_RECTS) {
+        list.count = 0;
+        return true;
+    }
+
+    list.rects[count++].set(r);
+    list.count = count;
+    return true;
+}
+
+bool Snapshot::subtractClipRects(const Rect& r) {
+    ClipRects& list = *clipRects;
+
+    Rect pieces[SNAPSHOT_MAX_CLIP_RECTS];
+    uint32_t count = 0;
+
+    const uint32_t sourceCount = list.count > 0 ? list.count : 1;
+    for (uint32_t i = 0; i < sourceCount; i++) {
+        const Rect& source = list.count > 0 ? list.rects[i] : *clipRect;
+        if (source.isEmpty()) continue;
+
+        if (!source.intersects(r)) {
+            if (count >= SNAPSHOT_MAX_CLIP_RECTS) return false;
+            pieces[count++].set(source);
+            continue;
+        }
+
+        // Up to 4 pieces surround the subtracted rect
+        Rect remains[4];
+        uint32_t remainCount = 0;
+
+        const float top = fmaxf(source.top, r.top);
+        const float bottom = fminf(source.bottom, r.bottom);
+        if (r.top > source.top) {
+            remains[remainCount++].set(source.left, source.top, source.right, r.top);
+        }
+        if (r.bottom < source.bottom) {
+            remains[remainCount++].set(source.left, r.bottom, source.right, source.bottom);
+        }
+        if (r.left > source.left) {
+            remains[remainCount++].set(source.left, top, r.left, bottom);
+        }
+        if (r.right < source.right) {
+            remains[remainCount++].set(r.right, top, source.right, bottom);
+        }
+
+        // Too complex, keep the current clip which is larger than the real one
+        if (count + remainCount > SNAPSHOT_MAX_CLIP_RECTS) return false;
+
+        for (uint32_t j = 0; j < remainCount; j++) {
+            pieces[count++].set(remains[j]);
+        }
+    }
+
+    if (count == 0) {
+        clipRect->setEmpty();
+        list.count = 0;
+        return true;
+    }
+
+    Rect bounds;
+    for (uint32_t i = 0; i < count; i++) {
+        list.rects[i].set(pieces[i]);
+        bounds.unionWith(pieces[i]);
+    }
+    list.count = count;
+    clipRect->set(bounds);
+
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Clipping operations
+///////////////////////////////////////////////////////////////////////////////
+
 bool Snapshot::clip(float left, float top, float right, float bottom, SkRegion::Op op) {
     Rect r(left, top, right, bottom);
     transform->mapRect(r);
@@ -160,10 +311,15 @@ bool Snapshot::clip(float left, float top, float right, float bottom, SkRegion::
 bool Snapshot::clipTransformed(const Rect& r, SkRegion::Op op) {
     bool clipped = false;
 
+    copyClipOnWrite();
+
     switch (op) {
         case SkRegion::kDifference_Op: {
             ensureClipRegion();
             clipped = clipRegionNand(r.left, r.top, r.right, r.bottom);
+            if (!clipped) {
+                clipped = subtractClipRects(r);
+            }
             break;
         }
         case SkRegion::kIntersect_Op: {
@@ -173,7 +329,10 @@ bool Snapshot::clipTransformed(const Rect& r, SkRegion::Op op) {
                 clipped = clipRect->intersect(r);
                 if (!clipped) {
                     clipRect->setEmpty();
+                    clipRects->count = 0;
                     clipped = true;
+                } else {
+                    intersectClipRects(r);
                 }
             }
             break;
@@ -182,6 +341,7 @@ bool Snapshot::clipTransformed(const Rect& r, SkRegion::Op op) {
             if (CC_UNLIKELY(clipRegion)) {
                 clipped = clipRegionAnd(r.left, r.top, r.right, r.bottom);
             } else {
+                unionClipRects(r);
                 clipped = clipRect->unionWith(r);
             }
             break;
@@ -189,10 +349,12 @@ bool Snapshot::clipTransformed(const Rect& r, SkRegion::Op op) {
         case SkRegion::kXOR_Op: {
             ensureClipRegion();
             clipped = clipRegionXor(r.left, r.top, r.right, r.bottom);
+            clipRects->count = 0;
             break;
         }
         case SkRegion::kReverseDifference_Op: {
             // TODO!!!!!!!
+            clipRects->count = 0;
             break;
         }
         case SkRegion::kReplace_Op: {
@@ -210,7 +372,9 @@ bool Snapshot::clipTransformed(const Rect& r, SkRegion::Op op) {
 }
 
 void Snapshot::setClip(float left, float top, float right, float bottom) {
+    copyClipOnWrite();
     clipRect->set(left, top, right, bottom);
+    clipRects->count = 0;
 #if STENCIL_BUFFER_SIZE
     if (clipRegion) {
         clipRegion->clear();
@@ -232,6 +396,8 @@ const Rect& Snapshot::getLocalClip() {
 
 void Snapshot::resetClip(float left, float top, float right, float bottom) {
     clipRect = &mClipRectRoot;
+    clipRects = &mClipRectsRoot;
+    mSharedClip = false;
     setClip(left, top, right, bottom);
 }
 
@@ -242,6 +408,20 @@ void Snapshot::resetClip(float left, float top, float right, float bottom) {
 void Snapshot::resetTransform(float x, float y, float z) {
     transform = &mTransformRoot;
     transform->loadTranslate(x, y, z);
+    mSharedTransform = false;
+}
+
+void Snapshot::copyTransformOnWrite() {
+    if (!mSharedTransform) return;
+
+    mTransformRoot.load(*transform);
+    transform = &mTransformRoot;
+    mSharedTransform = false;
+}
+
+mat4* Snapshot::editTransform() {
+    copyTransformOnWrite();
+    return transform;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -32,6 +32,29 @@
 namespace android {
 namespace uirenderer {
 
+// Maximum number of rects used to describe a complex clip
+#define SNAPSHOT_MAX_CLIP_RECTS 8
+
+/**
+ * Short list of rects whose union contains a clip that is not a simple
+ * rect. The list is only used to reject drawing operations that fall
+ * between the rects, drawing is still clipped to the bounds of the clip.
+ * An empty list means that the clip is only known by its bounds.
+ */
+struct ClipRects {
+    ClipRects(): count(0) {
+    }
+
+    /**
+     * Returns true if the specified rect, snapped to pixel boundaries,
+     * intersects one of the rects or if the list is empty.
+     */
+    bool intersects(const Rect& r) const;
+
+    Rect rects[SNAPSHOT_MAX_CLIP_RECTS];
+    uint32_t count;
+}; // struct ClipRects
+
 /**
  * A snapshot holds information about the current state of the rendering
  * surface. A snapshot is usually created whenever the user calls save()
@@ -114,6 +137,13 @@ public:
      */
     void resetTransform(float x, float y, float z);
 
+    /**
+     * Returns the current transform for modification. A transform saved
+     * with kMatrix_SaveFlag is shared with the previous snapshot until it
+     * is first modified, so it must only be modified through this method.
+     */
+    mat4* editTransform();
+
     /**
      * Indicates whether this snapshot should be ignored. A snapshot
      * is typicalled ignored if its layer is invisible or empty.
@@ -177,6 +207,8 @@ public:
      *
      * This is a reference to a matrix owned by this snapshot or another
      *  snapshot. This pointer must not be freed. See ::mTransformRoot.
+     *
+     * Use editTransform() to modify the transform.
      */
     mat4* transform;
 
@@ -200,6 +232,16 @@ public:
      */
     Region* clipRegion;
 
+    /**
+     * Rects describing the current clip more precisely than ::clipRect
+     * after union and difference operations. Stored in the same space as
+     * ::clipRect.
+     *
+     * This is a reference to a list owned by this snapshot or another
+     * snapshot. This pointer must not be freed. See ::mClipRectsRoot.
+     */
+    ClipRects* clipRects;
+
     /**
      * The ancestor layer's dirty region.
      *
@@ -220,6 +262,9 @@ public:
     float alpha;
 
 private:
+    void copyClipOnWrite();
+    void copyTransformOnWrite();
+
     void ensureClipRegion();
     void copyClipRectFromRegion();
 
@@ -228,8 +273,18 @@ private:
     bool clipRegionAnd(float left, float top, float right, float bottom);
     bool clipRegionNand(float left, float top, float right, float bottom);
 
+    bool intersectClipRects(const Rect& r);
+    bool unionClipRects(const Rect& r);
+    bool subtractClipRects(const Rect& r);
+
+    // Set when the transform, or the clip, was saved but is still shared
+    // with the previous snapshot because it has not been modified yet
+    bool mSharedTransform;
+    bool mSharedClip;
+
     mat4 mTransformRoot;
     Rect mClipRectRoot;
+    ClipRects mClipRectsRoot;
     Rect mLocalClip;
 
 #if STENCIL_BUFFER_SIZE
@@ -16,9 +16,13 @@
 
 #define LOG_TAG "OpenGLRenderer"
 
+#include <utils/String8.h>
+
+#include "Caches.h"
 #include "Debug.h"
 #include "TextDropShadowCache.h"
 #include "Properties.h"
+#include "utils/Blur.h"
 
 namespace android {
 namespace uirenderer {
@@ -49,12 +53,19 @@ TextDropShadowCache::TextDropShadowCache(uint32_t maxByteSize):
 }
 
 TextDropShadowCache::~TextDropShadowCache() {
-    mCache.clear();
+    clear();
 }
 
 void TextDropShadowCache::init() {
     mCache.setOnEntryRemovedListener(this);
     mDebugEnabled = readDebugLevel() & kDebugMoreCaches;
+
+    char property[PROPERTY_VALUE_MAX];
+    mGpuBlur = property_get(PROPERTY_GPU_TEXT_BLUR, property, NULL) > 0 &&
+            !strcmp(property, "true");
+    if (mGpuBlur) {
+        INIT_LOGD("  Text shadows will be blurred on the GPU");
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -88,7 +99,7 @@ void TextDropShadowCache::operator()(ShadowText& text, ShadowTexture*& texture)
             ALOGD("Shadow texture deleted, size = %d", texture->bitmapSize);
         }
 
-        glDeleteTextures(1, &texture->id);
+        Caches::getInstance().deleteTexture(texture->id);
         delete texture;
     }
 }
@@ -99,6 +110,11 @@ void TextDropShadowCache::operator()(ShadowText& text, ShadowTexture*& texture)
 
 void TextDropShadowCache::clear() {
     mCache.clear();
+
+    for (size_t i = 0; i < mBlurPrograms.size(); i++) {
+        delete mBlurPrograms.valueAt(i);
+    }
+    mBlurPrograms.clear();
 }
 
 ShadowTexture* TextDropShadowCache::get(SkPaint* paint, const char* text, uint32_t len,
@@ -107,8 +123,9 @@ ShadowTexture* TextDropShadowCache::get(SkPaint* paint, const char* text, uint32
     ShadowTexture* texture = mCache.get(entry);
 
     if (!texture) {
+        const bool gpuBlur = mGpuBlur && radius > 0 && radius <= MAX_GPU_BLUR_RADIUS;
         FontRenderer::DropShadow shadow = mRenderer->renderDropShadow(paint, text, 0,
-                len, numGlyphs, radius);
+                len, numGlyphs, radius, !gpuBlur);
 
         texture = new ShadowTexture;
         texture->left = shadow.penX;
@@ -118,8 +135,9 @@ ShadowTexture* TextDropShadowCache::get(SkPaint* paint, const char* text, uint32
         texture->generation = 0;
         texture->blend = true;
 
-        const uint32_t size = shadow.width * shadow.height;
-        texture->bitmapSize = size;
+        // Shadows blurred on the GPU are stored in RGBA textures
+        uint32_t size = shadow.width * shadow.height;
+        if (gpuBlur) size *= 4;
 
         // Don't even try to cache a bitmap that's bigger than the cache
         if (size < mMaxSize) {
@@ -128,15 +146,23 @@ ShadowTexture* TextDropShadowCache::get(SkPaint* paint, const char* text, uint32
             }
         }
 
-        glGenTextures(1, &texture->id);
+        if (!gpuBlur || !blurOnGpu(shadow, radius, texture)) {
+            if (gpuBlur) {
+                Blur::blurImage(shadow.image, shadow.width, shadow.height, radius);
+                size = shadow.width * shadow.height;
+            }
+
+            glGenTextures(1, &texture->id);
 
-        glBindTexture(GL_TEXTURE_2D, texture->id);
-        // Textures are Alpha8
-        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            Caches::getInstance().bindTexture(texture->id);
+            // Textures are Alpha8
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, texture->width, texture->height, 0,
-                GL_ALPHA, GL_UNSIGNED_BYTE, shadow.image);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, texture->width, texture->height, 0,
+                    GL_ALPHA, GL_UNSIGNED_BYTE, shadow.image);
+        }
 
+        texture->bitmapSize = size;
         texture->setFilter(GL_LINEAR);
         texture->setWrap(GL_CLAMP_TO_EDGE);
 
@@ -160,5 +186,176 @@ ShadowTexture* TextDropShadowCache::get(SkPaint* paint, const char* text, uint32
     return texture;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// GPU blur
+///////////////////////////////////////////////////////////////////////////////
+
+Program* TextDropShadowCache::getBlurProgram(uint32_t radius) {
+    ssize_t index = mBlurPrograms.indexOfKey(radius);
+    if (index >= 0) {
+        return mBlurPrograms.valueAt(index);
+    }
+
+    float weights[2 * radius + 1];
+    Blur::generateGaussianWeights(weights, radius);
+
+    String8 vertex(
+            "attribute vec4 position;\n"
+            "attribute vec2 texCoords;\n"
+            "uniform mat4 transform;\n"
+            "varying mediump vec2 outTexCoords;\n"
+            "\nvoid main(void) {\n"
+            "    outTexCoords = texCoords;\n"
+            "    gl_Position = transform * position;\n"
+            "}\n\n");
+
+    // The taps are unrolled and the weights baked in the shader since
+    // GLSL ES does not guarantee support for non-constant loops
+    String8 fragment(
+            "precision mediump float;\n\n"
+            "varying mediump vec2 outTexCoords;\n"
+            "uniform sampler2D sampler;\n"
+            "uniform vec2 offset;\n"
+            "\nvoid main(void) {\n"
+            "    float alpha = 0.0;\n");
+    for (int32_t r = -(int32_t) radius; r <= (int32_t) radius; r++) {
+        fragment.appendFormat("    alpha += texture2D(sampler, outTexCoords + "
+                "offset * %.1f).a * %f;\n", (float) r, weights[r + radius]);
+    }
+    fragment.append(
+            "    gl_FragColor = vec4(alpha);\n"
+            "}\n\n");
+
+    ProgramDescription description;
+    description.hasTexture = true;
+
+    Program* program = new Program(description, vertex.string(), fragment.string());
+    if (!program->isInitialized()) {
+        ALOGW("Could not create the text shadow blur program for radius %d", radius);
+        delete program;
+        program = NULL;
+    }
+
+    // Failures are recorded as well to avoid compiling the shader again
+    mBlurPrograms.add(radius, program);
+    return program;
+}
+
+static void setupBlurTexture(GLuint texture, GLenum format, uint32_t width, uint32_t height,
+        const GLvoid* data) {
+    Caches::getInstance().bindTexture(texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+bool TextDropShadowCache::blurOnGpu(const FontRenderer::DropShadow& shadow, uint32_t radius,
+        ShadowTexture* texture) {
+    Caches& caches = Caches::getInstance();
+
+    const uint32_t width = shadow.width;
+    const uint32_t height = shadow.height;
+    if (width == 0 || height == 0) return false;
+    if (width > (uint32_t) caches.maxTextureSize || height > (uint32_t) caches.maxTextureSize) {
+        return false;
+    }
+
+    Program* program = getBlurProgram(radius);
+    if (!program) return false;
+
+    GLuint fbo = caches.fboCache.get();
+    if (!fbo) return false;
+
+    // The shadow is generated in the middle of a frame, save the state
+    // we are about to modify
+    GLint previousFbo;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFbo);
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    const bool scissorEnabled = glIsEnabled(GL_SCISSOR_TEST);
+
+    // 0: unblurred source, 1: horizontal pass, 2: vertical pass
+    GLuint textures[3];
+    glGenTextures(3, textures);
+
+    caches.activeTexture(0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    setupBlurTexture(textures[0], GL_ALPHA, width, height, shadow.image);
+    setupBlurTexture(textures[1], GL_RGBA, width, height, NULL);
+    setupBlurTexture(textures[2], GL_RGBA, width, height, NULL);
+
+    caches.bindFramebuffer(fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[1], 0);
+
+    bool blurred = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (blurred) {
+        if (scissorEnabled) glDisable(GL_SCISSOR_TEST);
+        caches.setBlend(false);
+        glViewport(0, 0, width, height);
+
+        if (caches.currentProgram) caches.currentProgram->remove();
+        program->use();
+        caches.currentProgram = program;
+
+        mat4 ortho;
+        ortho.loadOrtho(0.0f, width, 0.0f, height, -1.0f, 1.0f);
+        mat4 identity;
+        program->set(ortho, identity, identity);
+
+        TextureVertex mesh[4];
+        TextureVertex::set(&mesh[0], 0.0f, 0.0f, 0.0f, 0.0f);
+        TextureVertex::set(&mesh[1], width, 0.0f, 1.0f, 0.0f);
+        TextureVertex::set(&mesh[2], 0.0f, height, 0.0f, 1.0f);
+        TextureVertex::set(&mesh[3], width, height, 1.0f, 1.0f);
+
+        caches.unbindMeshBuffer();
+        caches.bindPositionVertexPointer(true, program->position, &mesh[0].position[0]);
+        caches.bindTexCoordsVertexPointer(true, program->texCoords, &mesh[0].texture[0]);
+        caches.enableTexCoordsVertexArray();
+
+        const int offset = program->getUniform("offset");
+
+        // Horizontal pass
+        caches.bindTexture(textures[0]);
+        glUniform2f(offset, 1.0f / width, 0.0f);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        // Vertical pass
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                textures[2], 0);
+        caches.bindTexture(textures[1]);
+        glUniform2f(offset, 0.0f, 1.0f / height);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        // The mesh lives on the stack, make sure nobody reuses the pointers
+        caches.resetVertexPointers();
+
+        // The blur program must not be left current: it may be deleted
+        // when the cache is cleared
+        program->remove();
+        caches.currentProgram = NULL;
+
+        if (scissorEnabled) glEnable(GL_SCISSOR_TEST);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
+    caches.bindFramebuffer(previousFbo);
+    caches.fboCache.put(fbo);
+
+    caches.deleteTexture(textures[0]);
+    caches.deleteTexture(textures[1]);
+    if (blurred) {
+        texture->id = textures[2];
+        caches.bindTexture(texture->id);
+    } else {
+        caches.deleteTexture(textures[2]);
+    }
+
+    return blurred;
+}
+
 }; // namespace uirenderer
 }; // namespace android
@@ -21,11 +21,13 @@
 
 #include <SkPaint.h>
 
+#include <utils/KeyedVector.h>
 #include <utils/String16.h>
 
 #include "utils/Compare.h"
 #include "utils/GenerationCache.h"
 #include "FontRenderer.h"
+#include "Program.h"
 #include "Texture.h"
 
 namespace android {
@@ -93,6 +95,17 @@ struct ShadowText {
     }
 }; // struct ShadowText
 
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Largest radius the GPU blur supports; larger shadows are blurred on the CPU
+#define MAX_GPU_BLUR_RADIUS 16
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
 /**
  * Alpha texture used to represent a shadow.
  */
@@ -144,12 +157,23 @@ public:
 private:
     void init();
 
+    /**
+     * Blurs the specified shadow image with two render passes into an FBO
+     * obtained from the FBO cache. On success, the texture holds the blurred
+     * shadow in its alpha channel and true is returned.
+     */
+    bool blurOnGpu(const FontRenderer::DropShadow& shadow, uint32_t radius,
+            ShadowTexture* texture);
+    Program* getBlurProgram(uint32_t radius);
+
     GenerationCache<ShadowText, ShadowTexture*> mCache;
+    KeyedVector<uint32_t, Program*> mBlurPrograms;
 
     uint32_t mSize;
     uint32_t mMaxSize;
     FontRenderer* mRenderer;
     bool mDebugEnabled;
+    bool mGpuBlur;
 }; // class TextDropShadowCache
 
 }; // namespace uirenderer
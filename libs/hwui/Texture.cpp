@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include "Caches.h"
+#include "Texture.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Texture
+///////////////////////////////////////////////////////////////////////////////
+
+void Texture::setWrapST(GLenum wrapS, GLenum wrapT, bool bindTexture, bool force,
+        GLenum renderTarget) {
+
+    if (page) {
+        page->setWrapST(wrapS, wrapT, bindTexture, force, renderTarget);
+        return;
+    }
+
+    if (firstWrap || force || wrapS != this->wrapS || wrapT != this->wrapT) {
+        firstWrap = false;
+
+        this->wrapS = wrapS;
+        this->wrapT = wrapT;
+
+        if (bindTexture) {
+            bind(renderTarget);
+        }
+
+        glTexParameteri(renderTarget, GL_TEXTURE_WRAP_S, wrapS);
+        glTexParameteri(renderTarget, GL_TEXTURE_WRAP_T, wrapT);
+    }
+}
+
+void Texture::setFilterMinMag(GLenum min, GLenum mag, bool bindTexture, bool force,
+        GLenum renderTarget) {
+
+    if (page) {
+        page->setFilterMinMag(min, mag, bindTexture, force, renderTarget);
+        return;
+    }
+
+    if (firstFilter || force || min != minFilter || mag != magFilter) {
+        firstFilter = false;
+
+        minFilter = min;
+        magFilter = mag;
+
+        if (bindTexture) {
+            bind(renderTarget);
+        }
+
+        glTexParameteri(renderTarget, GL_TEXTURE_MIN_FILTER, min);
+        glTexParameteri(renderTarget, GL_TEXTURE_MAG_FILTER, mag);
+    }
+}
+
+void Texture::bind(GLenum renderTarget) const {
+    Caches::getInstance().bindTexture(renderTarget, id);
+}
+
+void Texture::deleteTexture() const {
+    Caches::getInstance().deleteTexture(id);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// AutoTexture
+///////////////////////////////////////////////////////////////////////////////
+
+AutoTexture::~AutoTexture() {
+    if (mTexture && mTexture->cleanup) {
+        mTexture->deleteTexture();
+        delete mTexture;
+    }
+}
+
+}; // namespace uirenderer
+}; // namespace android
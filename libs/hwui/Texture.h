@@ -28,6 +28,8 @@ namespace uirenderer {
 struct Texture {
     Texture() {
         cleanup = false;
+        pending = false;
+        compressed = false;
         bitmapSize = 0;
 
         wrapS = GL_CLAMP_TO_EDGE;
@@ -38,6 +40,12 @@ struct Texture {
 
         firstFilter = true;
         firstWrap = true;
+
+        page = NULL;
+        u1 = 0.0f;
+        v1 = 0.0f;
+        u2 = 1.0f;
+        v2 = 1.0f;
     }
 
     void setWrap(GLenum wrap, bool bindTexture = false, bool force = false,
@@ -46,22 +54,7 @@ struct Texture {
     }
 
     void setWrapST(GLenum wrapS, GLenum wrapT, bool bindTexture = false, bool force = false,
-            GLenum renderTarget = GL_TEXTURE_2D) {
-
-        if (firstWrap || force || wrapS != this->wrapS || wrapT != this->wrapT) {
-            firstWrap = false;
-
-            this->wrapS = wrapS;
-            this->wrapT = wrapT;
-
-            if (bindTexture) {
-                glBindTexture(renderTarget, id);
-            }
-
-            glTexParameteri(renderTarget, GL_TEXTURE_WRAP_S, wrapS);
-            glTexParameteri(renderTarget, GL_TEXTURE_WRAP_T, wrapT);
-        }
-    }
+            GLenum renderTarget = GL_TEXTURE_2D);
 
     void setFilter(GLenum filter, bool bindTexture = false, bool force = false,
                 GLenum renderTarget = GL_TEXTURE_2D) {
@@ -69,22 +62,18 @@ struct Texture {
     }
 
     void setFilterMinMag(GLenum min, GLenum mag, bool bindTexture = false, bool force = false,
-            GLenum renderTarget = GL_TEXTURE_2D) {
+            GLenum renderTarget = GL_TEXTURE_2D);
 
-        if (firstFilter || force || min != minFilter || mag != magFilter) {
-            firstFilter = false;
-
-            minFilter = min;
-            magFilter = mag;
-
-            if (bindTexture) {
-                glBindTexture(renderTarget, id);
-            }
+    /**
+     * Binds this texture to the active texture unit.
+     */
+    void bind(GLenum renderTarget = GL_TEXTURE_2D) const;
 
-            glTexParameteri(renderTarget, GL_TEXTURE_MIN_FILTER, min);
-            glTexParameteri(renderTarget, GL_TEXTURE_MAG_FILTER, mag);
-        }
-    }
+    /**
+     * Deletes the GL texture. Must not be called on textures stored in an
+     * atlas page.
+     */
+    void deleteTexture() const;
 
     /**
      * Name of the texture.
@@ -110,6 +99,16 @@ struct Texture {
      * Indicates whether this texture should be cleaned up after use.
      */
     bool cleanup;
+    /**
+     * Indicates whether the content of the texture is still being uploaded
+     * in the background. A pending texture has no GL texture yet.
+     */
+    bool pending;
+    /**
+     * Indicates whether the texture is stored as ETC1. Compressed textures
+     * cannot be updated with glTexSubImage2D().
+     */
+    bool compressed;
     /**
      * Optional, size of the original bitmap.
      */
@@ -127,6 +126,21 @@ struct Texture {
     GLenum minFilter;
     GLenum magFilter;
 
+    /**
+     * Atlas page holding this texture, or NULL if the texture owns its
+     * own GL texture. When set, id is the name of the page and the wrap
+     * and filter modes are those of the page.
+     */
+    Texture* page;
+    /**
+     * Texture coordinates of the bitmap in the texture. Defaults to
+     * (0, 0) - (1, 1) unless the texture is stored in an atlas page.
+     */
+    float u1;
+    float v1;
+    float u2;
+    float v2;
+
 private:
     bool firstFilter;
     bool firstWrap;
@@ -135,12 +149,7 @@ private:
 class AutoTexture {
 public:
     AutoTexture(const Texture* texture): mTexture(texture) { }
-    ~AutoTexture() {
-        if (mTexture && mTexture->cleanup) {
-            glDeleteTextures(1, &mTexture->id);
-            delete mTexture;
-        }
-    }
+    ~AutoTexture();
 
 private:
     const Texture* mTexture;
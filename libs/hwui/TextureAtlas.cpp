@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <GLES2/gl2.h>
+
+#include <SkCanvas.h>
+
+#include <utils/Log.h>
+
+#include "Caches.h"
+#include "TextureAtlas.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+TextureAtlas::TextureAtlas() {
+}
+
+TextureAtlas::~TextureAtlas() {
+    clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Pages
+///////////////////////////////////////////////////////////////////////////////
+
+TextureAtlas::Page* TextureAtlas::createPage() {
+    Page* page = new Page;
+
+    glGenTextures(1, &page->texture.id);
+    Caches::getInstance().bindTexture(page->texture.id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    page->texture.width = ATLAS_PAGE_SIZE;
+    page->texture.height = ATLAS_PAGE_SIZE;
+    page->texture.generation = 0;
+    page->texture.blend = true;
+    page->texture.setFilter(GL_NEAREST);
+    page->texture.setWrap(GL_CLAMP_TO_EDGE);
+
+    page->freeCells[0].push(0);
+
+    mPages.push(page);
+    return page;
+}
+
+void TextureAtlas::deletePage(Page* page) {
+    for (size_t i = 0; i < mPages.size(); i++) {
+        if (mPages.itemAt(i) == page) {
+            mPages.removeAt(i);
+            break;
+        }
+    }
+
+    Caches::getInstance().deleteTexture(page->texture.id);
+    delete page;
+}
+
+void TextureAtlas::clear() {
+    for (size_t i = 0; i < mCells.size(); i++) {
+        mCells.keyAt(i)->page = NULL;
+    }
+    mCells.clear();
+
+    while (!mPages.isEmpty()) {
+        deletePage(mPages.itemAt(mPages.size() - 1));
+    }
+}
+
+uint32_t TextureAtlas::getSize() const {
+    return mPages.size() * ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE * 4;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Cells allocation
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t TextureAtlas::getLevel(uint32_t width, uint32_t height) {
+    const uint32_t size = (width > height ? width : height) + 2 * ATLAS_BITMAP_BORDER;
+
+    uint32_t level = ATLAS_CELL_LEVELS - 1;
+    uint32_t cellSize = ATLAS_MIN_CELL_SIZE;
+    while (cellSize < size && level > 0) {
+        cellSize <<= 1;
+        level--;
+    }
+
+    return level;
+}
+
+bool TextureAtlas::allocate(Page* page, uint32_t level, uint32_t* x, uint32_t* y) {
+    // Find the smallest free cell that can be split down to the requested level
+    int32_t available = level;
+    while (available >= 0 && page->freeCells[available].isEmpty()) {
+        available--;
+    }
+    if (available < 0) return false;
+
+    Vector<uint32_t>& cells = page->freeCells[available];
+    const uint32_t cell = cells.itemAt(cells.size() - 1);
+    cells.removeAt(cells.size() - 1);
+
+    const uint32_t cellX = cell >> 16;
+    const uint32_t cellY = cell & 0xffff;
+
+    // Keep the top-left child at each split
+    for (uint32_t l = available + 1; l <= level; l++) {
+        const uint32_t size = ATLAS_PAGE_SIZE >> l;
+        page->freeCells[l].push(((cellX + size) << 16) | cellY);
+        page->freeCells[l].push((cellX << 16) | (cellY + size));
+        page->freeCells[l].push(((cellX + size) << 16) | (cellY + size));
+    }
+
+    *x = cellX;
+    *y = cellY;
+    return true;
+}
+
+static bool removeCell(Vector<uint32_t>& cells, uint32_t cell) {
+    for (size_t i = 0; i < cells.size(); i++) {
+        if (cells.itemAt(i) == cell) {
+            cells.removeAt(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool containsCell(const Vector<uint32_t>& cells, uint32_t cell) {
+    for (size_t i = 0; i < cells.size(); i++) {
+        if (cells.itemAt(i) == cell) return true;
+    }
+    return false;
+}
+
+void TextureAtlas::release(Page* page, uint32_t level, uint32_t x, uint32_t y) {
+    // Merge the cell with its 3 siblings as long as they are all free
+    while (level > 0) {
+        const uint32_t size = ATLAS_PAGE_SIZE >> level;
+        const uint32_t parentX = x & ~(2 * size - 1);
+        const uint32_t parentY = y & ~(2 * size - 1);
+
+        uint32_t siblings[3];
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < 4; i++) {
+            const uint32_t siblingX = parentX + (i & 0x1) * size;
+            const uint32_t siblingY = parentY + (i >> 1) * size;
+            if (siblingX != x || siblingY != y) {
+                siblings[count++] = (siblingX << 16) | siblingY;
+            }
+        }
+
+        Vector<uint32_t>& cells = page->freeCells[level];
+        if (!containsCell(cells, siblings[0]) || !containsCell(cells, siblings[1]) ||
+                !containsCell(cells, siblings[2])) {
+            break;
+        }
+
+        for (uint32_t i = 0; i < 3; i++) {
+            removeCell(cells, siblings[i]);
+        }
+
+        x = parentX;
+        y = parentY;
+        level--;
+    }
+
+    page->freeCells[level].push((x << 16) | y);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Bitmaps
+///////////////////////////////////////////////////////////////////////////////
+
+bool TextureAtlas::canAtlas(SkBitmap* bitmap) {
+    switch (bitmap->getConfig()) {
+        case SkBitmap::kARGB_8888_Config:
+        case SkBitmap::kARGB_4444_Config:
+        case SkBitmap::kIndex8_Config:
+            break;
+        default:
+            return false;
+    }
+
+    const int maxSize = ATLAS_MAX_CELL_SIZE - 2 * ATLAS_BITMAP_BORDER;
+    return bitmap->width() > 0 && bitmap->height() > 0 &&
+            bitmap->width() <= maxSize && bitmap->height() <= maxSize;
+}
+
+bool TextureAtlas::add(SkBitmap* bitmap, Texture* texture) {
+    if (!canAtlas(bitmap)) return false;
+
+    const uint32_t level = getLevel(bitmap->width(), bitmap->height());
+
+    Cell cell;
+    cell.page = NULL;
+    cell.level = level;
+
+    for (size_t i = 0; i < mPages.size(); i++) {
+        if (allocate(mPages.itemAt(i), level, &cell.x, &cell.y)) {
+            cell.page = mPages.itemAt(i);
+            break;
+        }
+    }
+
+    if (!cell.page) {
+        if (mPages.size() >= ATLAS_MAX_PAGES) return false;
+        cell.page = createPage();
+        allocate(cell.page, level, &cell.x, &cell.y);
+    }
+
+    cell.page->used++;
+    mCells.add(texture, cell);
+
+    const float pageSize = ATLAS_PAGE_SIZE;
+    const uint32_t left = cell.x + ATLAS_BITMAP_BORDER;
+    const uint32_t top = cell.y + ATLAS_BITMAP_BORDER;
+
+    texture->id = cell.page->texture.id;
+    texture->page = &cell.page->texture;
+    texture->width = bitmap->width();
+    texture->height = bitmap->height();
+    texture->u1 = left / pageSize;
+    texture->v1 = top / pageSize;
+    texture->u2 = (left + bitmap->width()) / pageSize;
+    texture->v2 = (top + bitmap->height()) / pageSize;
+
+    upload(bitmap, cell);
+    texture->generation = bitmap->getGenerationID();
+    texture->blend = !bitmap->isOpaque();
+
+    return true;
+}
+
+bool TextureAtlas::update(SkBitmap* bitmap, Texture* texture) {
+    ssize_t index = mCells.indexOfKey(texture);
+    if (index < 0) return false;
+
+    if (bitmap->width() != int(texture->width) || bitmap->height() != int(texture->height)) {
+        remove(texture);
+        return false;
+    }
+
+    upload(bitmap, mCells.valueAt(index));
+    texture->generation = bitmap->getGenerationID();
+    texture->blend = !bitmap->isOpaque();
+
+    return true;
+}
+
+void TextureAtlas::remove(Texture* texture) {
+    ssize_t index = mCells.indexOfKey(texture);
+    if (index < 0) return;
+
+    const Cell cell = mCells.valueAt(index);
+    mCells.removeItemsAt(index);
+
+    release(cell.page, cell.level, cell.x, cell.y);
+    cell.page->used--;
+
+    // Keep the first page around to avoid reallocating it constantly
+    if (cell.page->used == 0 && cell.page != mPages.itemAt(0)) {
+        deletePage(cell.page);
+    }
+
+    texture->page = NULL;
+    texture->u1 = 0.0f;
+    texture->v1 = 0.0f;
+    texture->u2 = 1.0f;
+    texture->v2 = 1.0f;
+}
+
+void TextureAtlas::upload(SkBitmap* bitmap, const Cell& cell) {
+    SkAutoLockPixels alp(*bitmap);
+
+    if (!bitmap->readyToDraw()) {
+        ALOGE("Cannot generate texture from bitmap");
+        return;
+    }
+
+    const int width = bitmap->width();
+    const int height = bitmap->height();
+
+    // Lo-fi configs are converted to ARGB_8888 first
+    SkBitmap rgbaBitmap;
+    const SkBitmap* source = bitmap;
+    if (bitmap->getConfig() != SkBitmap::kARGB_8888_Config) {
+        rgbaBitmap.setConfig(SkBitmap::kARGB_8888_Config, width, height);
+        rgbaBitmap.allocPixels();
+        rgbaBitmap.eraseColor(0);
+
+        SkCanvas canvas(rgbaBitmap);
+        canvas.drawBitmap(*bitmap, 0.0f, 0.0f, NULL);
+        source = &rgbaBitmap;
+    }
+
+    // Replicate the edges of the bitmap in the border
+    const int paddedWidth = width + 2 * ATLAS_BITMAP_BORDER;
+    const int paddedHeight = height + 2 * ATLAS_BITMAP_BORDER;
+    uint32_t* padded = new uint32_t[paddedWidth * paddedHeight];
+
+    for (int y = 0; y < paddedHeight; y++) {
+        int sourceY = y - ATLAS_BITMAP_BORDER;
+        if (sourceY < 0) sourceY = 0;
+        if (sourceY >= height) sourceY = height - 1;
+
+        const uint32_t* src = (const uint32_t*) ((const uint8_t*) source->getPixels() +
+                sourceY * source->rowBytes());
+        uint32_t* dst = padded + y * paddedWidth;
+
+        for (int x = 0; x < ATLAS_BITMAP_BORDER; x++) {
+            dst[x] = src[0];
+            dst[paddedWidth - 1 - x] = src[width - 1];
+        }
+        memcpy(dst + ATLAS_BITMAP_BORDER, src, width * sizeof(uint32_t));
+    }
+
+    Caches::getInstance().bindTexture(cell.page->texture.id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, cell.x, cell.y, paddedWidth, paddedHeight,
+            GL_RGBA, GL_UNSIGNED_BYTE, padded);
+
+    delete[] padded;
+}
+
+}; // namespace uirenderer
+}; // namespace android
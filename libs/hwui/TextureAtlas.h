@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_TEXTURE_ATLAS_H
+#define ANDROID_HWUI_TEXTURE_ATLAS_H
+
+#include <SkBitmap.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/Vector.h>
+
+#include "Texture.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Dimension of the square atlas pages, in pixels
+#define ATLAS_PAGE_SIZE 512
+#define ATLAS_MAX_PAGES 4
+
+// Pages are split in square cells whose dimensions are powers of 2
+// between these two values
+#define ATLAS_MIN_CELL_SIZE 16
+#define ATLAS_MAX_CELL_SIZE 128
+#define ATLAS_CELL_LEVELS 6
+
+// Each bitmap is surrounded by a copy of its edges to prevent
+// bilinear filtering from sampling neighbouring bitmaps
+#define ATLAS_BITMAP_BORDER 1
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Packs small bitmaps into shared RGBA textures. Each page is managed as a
+ * quadtree of cells: the smallest free cell large enough to hold a bitmap
+ * is split as needed and freed cells are merged back with their siblings,
+ * so the space of removed bitmaps is fully reclaimed.
+ *
+ * Textures stored in the atlas have their page set and use the page's
+ * texture name. Their u1, v1, u2 and v2 fields locate the bitmap in the
+ * page.
+ */
+class TextureAtlas {
+public:
+    TextureAtlas();
+    ~TextureAtlas();
+
+    /**
+     * Indicates whether the specified bitmap is small enough and of a
+     * config that can be stored in the atlas.
+     */
+    static bool canAtlas(SkBitmap* bitmap);
+
+    /**
+     * Stores the specified bitmap in the atlas and initializes the texture.
+     * Returns false if there is not enough space left.
+     */
+    bool add(SkBitmap* bitmap, Texture* texture);
+    /**
+     * Uploads the content of the bitmap again. Returns false if the bitmap
+     * changed dimensions, in which case the texture was removed from the
+     * atlas.
+     */
+    bool update(SkBitmap* bitmap, Texture* texture);
+    /**
+     * Releases the space used by the specified texture.
+     */
+    void remove(Texture* texture);
+
+    /**
+     * Deletes all the pages.
+     */
+    void clear();
+
+    /**
+     * Returns the amount of memory used by the pages, in bytes.
+     */
+    uint32_t getSize() const;
+
+private:
+    struct Page {
+        Page(): used(0) { }
+
+        Texture texture;
+        // Free cells for each level, level 0 being the whole page;
+        // cells are stored as (x << 16) | y
+        Vector<uint32_t> freeCells[ATLAS_CELL_LEVELS];
+        uint32_t used;
+    };
+
+    struct Cell {
+        Page* page;
+        uint32_t x;
+        uint32_t y;
+        uint32_t level;
+    };
+
+    static uint32_t getLevel(uint32_t width, uint32_t height);
+
+    Page* createPage();
+    void deletePage(Page* page);
+
+    bool allocate(Page* page, uint32_t level, uint32_t* x, uint32_t* y);
+    void release(Page* page, uint32_t level, uint32_t x, uint32_t y);
+
+    void upload(SkBitmap* bitmap, const Cell& cell);
+
+    Vector<Page*> mPages;
+    KeyedVector<Texture*, Cell> mCells;
+}; // class TextureAtlas
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_TEXTURE_ATLAS_H
@@ -18,10 +18,13 @@
 
 #include <GLES2/gl2.h>
 
+#include <ETC1/etc1.h>
+
 #include <SkCanvas.h>
 
 #include <utils/threads.h>
 
+#include "Caches.h"
 #include "TextureCache.h"
 #include "Properties.h"
 
@@ -35,7 +38,7 @@ namespace uirenderer {
 TextureCache::TextureCache():
         mCache(GenerationCache<SkBitmap*, Texture*>::kUnlimitedCapacity),
         mSize(0), mMaxSize(MB(DEFAULT_TEXTURE_CACHE_SIZE)),
-        mFlushRate(DEFAULT_TEXTURE_CACHE_FLUSH_RATE) {
+        mFlushRate(DEFAULT_TEXTURE_CACHE_FLUSH_RATE), mAtlas(NULL), mUploader(NULL) {
     char property[PROPERTY_VALUE_MAX];
     if (property_get(PROPERTY_TEXTURE_CACHE_SIZE, property, NULL) > 0) {
         INIT_LOGD("  Setting texture cache size to %sMB", property);
@@ -58,12 +61,14 @@ TextureCache::TextureCache():
 
 TextureCache::TextureCache(uint32_t maxByteSize):
         mCache(GenerationCache<SkBitmap*, Texture*>::kUnlimitedCapacity),
-        mSize(0), mMaxSize(maxByteSize) {
+        mSize(0), mMaxSize(maxByteSize), mAtlas(NULL), mUploader(NULL) {
     init();
 }
 
 TextureCache::~TextureCache() {
     mCache.clear();
+    delete mAtlas;
+    delete mUploader;
 }
 
 void TextureCache::init() {
@@ -73,6 +78,27 @@ void TextureCache::init() {
     INIT_LOGD("    Maximum texture dimension is %d pixels", mMaxTextureSize);
 
     mDebugEnabled = readDebugLevel() & kDebugCaches;
+
+    char property[PROPERTY_VALUE_MAX];
+    if (property_get(PROPERTY_TEXTURE_ATLAS, property, NULL) > 0 && !strcmp(property, "true")) {
+        INIT_LOGD("  Small bitmaps will be packed in a texture atlas");
+        mAtlas = new TextureAtlas;
+    }
+
+    mCompressTextures = property_get(PROPERTY_TEXTURE_COMPRESSION, property, NULL) > 0 &&
+            !strcmp(property, "true");
+
+    if (mCompressTextures || (property_get(PROPERTY_ASYNC_TEXTURE_UPLOAD, property, NULL) > 0 &&
+            !strcmp(property, "true"))) {
+        INIT_LOGD("  Large bitmaps will be uploaded in the background");
+        mUploader = new TextureUploader;
+    }
+    if (mCompressTextures) {
+        INIT_LOGD("  Large opaque bitmaps will be compressed to ETC1");
+    }
+
+    mHasPlaceholder = property_get(PROPERTY_TEXTURE_PLACEHOLDER, property, NULL) > 0;
+    mPlaceholderColor = mHasPlaceholder ? strtoul(property, NULL, 16) : 0;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -111,7 +137,13 @@ void TextureCache::operator()(SkBitmap*& bitmap, Texture*& texture) {
         if (mDebugEnabled) {
             ALOGD("Texture deleted, size = %d", texture->bitmapSize);
         }
-        glDeleteTextures(1, &texture->id);
+        if (texture->pending) {
+            mUploader->cancel(texture);
+        } else if (texture->page && mAtlas) {
+            mAtlas->remove(texture);
+        } else if (texture->id) {
+            Caches::getInstance().deleteTexture(texture->id);
+        }
         delete texture;
     }
 }
@@ -120,9 +152,29 @@ void TextureCache::operator()(SkBitmap*& bitmap, Texture*& texture) {
 // Caching
 ///////////////////////////////////////////////////////////////////////////////
 
-Texture* TextureCache::get(SkBitmap* bitmap) {
+Texture* TextureCache::get(SkBitmap* bitmap, bool allowAtlas, bool allowPending) {
+    if (mUploader) {
+        mUploader->processCompleted();
+    }
+
     Texture* texture = mCache.get(bitmap);
 
+    if (texture && texture->pending && !allowPending) {
+        mUploader->cancel(texture);
+        uncompress(bitmap, texture);
+        generateTexture(bitmap, texture, false);
+    } else if (texture && !texture->pending && !texture->page && texture->id == 0) {
+        // The background upload failed
+        uncompress(bitmap, texture);
+        generateTexture(bitmap, texture, false);
+    }
+
+    if (texture && texture->page && !allowAtlas) {
+        // The caller cannot use atlas coordinates, give the bitmap its own texture
+        mCache.remove(bitmap);
+        texture = NULL;
+    }
+
     if (!texture) {
         if (bitmap->width() > mMaxTextureSize || bitmap->height() > mMaxTextureSize) {
             ALOGW("Bitmap too large to be uploaded into a texture (%dx%d, max=%dx%d)",
@@ -130,7 +182,11 @@ Texture* TextureCache::get(SkBitmap* bitmap) {
             return NULL;
         }
 
-        const uint32_t size = bitmap->rowBytes() * bitmap->height();
+        // Compressed bitmaps are charged their ETC1 size, 4 or 6 times smaller
+        const bool compress = allowPending && mCompressTextures &&
+                Caches::getInstance().extensions.hasETC1() && mUploader->canCompress(bitmap);
+        const uint32_t size = compress ? etc1_get_encoded_data_size(bitmap->width(),
+                bitmap->height()) : bitmap->rowBytes() * bitmap->height();
         // Don't even try to cache a bitmap that's bigger than the cache
         if (size < mMaxSize) {
             while (mSize + size > mMaxSize) {
@@ -140,7 +196,23 @@ Texture* TextureCache::get(SkBitmap* bitmap) {
 
         texture = new Texture;
         texture->bitmapSize = size;
-        generateTexture(bitmap, texture, false);
+
+        const bool atlased = !compress && allowAtlas && mAtlas && size < mMaxSize &&
+                mAtlas->add(bitmap, texture);
+        if (!atlased) {
+            if (allowPending && mUploader && size < mMaxSize && mUploader->canUpload(bitmap)) {
+                texture->id = 0;
+                texture->generation = bitmap->getGenerationID();
+                texture->width = bitmap->width();
+                texture->height = bitmap->height();
+                texture->blend = !bitmap->isOpaque();
+                texture->compressed = compress;
+                mUploader->upload(bitmap, texture, compress);
+            } else {
+                generateTexture(bitmap, texture, false);
+            }
+        }
+        Caches::getInstance().frameStats.countTextureUpload();
 
         if (size < mMaxSize) {
             mSize += size;
@@ -153,8 +225,21 @@ Texture* TextureCache::get(SkBitmap* bitmap) {
         } else {
             texture->cleanup = true;
         }
-    } else if (bitmap->getGenerationID() != texture->generation) {
-        generateTexture(bitmap, texture, true);
+    } else if (!texture->pending && bitmap->getGenerationID() != texture->generation) {
+        if (texture->page) {
+            // The bitmap changed dimensions and was evicted from the atlas
+            if (!mAtlas->update(bitmap, texture)) {
+                generateTexture(bitmap, texture, false);
+            }
+        } else if (texture->compressed) {
+            // Compressed textures cannot be updated in place
+            Caches::getInstance().deleteTexture(texture->id);
+            uncompress(bitmap, texture);
+            generateTexture(bitmap, texture, false);
+        } else {
+            generateTexture(bitmap, texture, true);
+        }
+        Caches::getInstance().frameStats.countTextureUpload();
     }
 
     return texture;
@@ -190,9 +275,19 @@ void TextureCache::clearGarbage() {
 
 void TextureCache::clear() {
     mCache.clear();
+    stopUploads();
+    if (mAtlas) {
+        mAtlas->clear();
+    }
     TEXTURE_LOGD("TextureCache:clear(), mSize = %d", mSize);
 }
 
+void TextureCache::stopUploads() {
+    if (mUploader) {
+        mUploader->stop();
+    }
+}
+
 void TextureCache::flush() {
     if (mFlushRate >= 1.0f || mCache.size() == 0) return;
     if (mFlushRate <= 0.0f) {
@@ -208,6 +303,17 @@ void TextureCache::flush() {
     }
 }
 
+void TextureCache::uncompress(SkBitmap* bitmap, Texture* texture) {
+    if (!texture->compressed) return;
+    texture->compressed = false;
+
+    const uint32_t size = bitmap->rowBytes() * bitmap->height();
+    if (!texture->cleanup) {
+        mSize += size - texture->bitmapSize;
+    }
+    texture->bitmapSize = size;
+}
+
 void TextureCache::generateTexture(SkBitmap* bitmap, Texture* texture, bool regenerate) {
     SkAutoLockPixels alp(*bitmap);
 
@@ -227,7 +333,7 @@ void TextureCache::generateTexture(SkBitmap* bitmap, Texture* texture, bool rege
     texture->width = bitmap->width();
     texture->height = bitmap->height();
 
-    glBindTexture(GL_TEXTURE_2D, texture->id);
+    Caches::getInstance().bindTexture(texture->id);
     if (!regenerate) {
         glPixelStorei(GL_UNPACK_ALIGNMENT, bitmap->bytesPerPixel());
     }
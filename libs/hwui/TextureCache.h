@@ -24,6 +24,8 @@
 
 #include "Debug.h"
 #include "Texture.h"
+#include "TextureAtlas.h"
+#include "TextureUploader.h"
 #include "utils/GenerationCache.h"
 
 namespace android {
@@ -64,8 +66,18 @@ public:
     /**
      * Returns the texture associated with the specified bitmap. If the texture
      * cannot be found in the cache, a new texture is generated.
+     *
+     * @param allowAtlas If true, the returned texture may be stored in an
+     *        atlas page, in which case the caller must honor the texture's
+     *        u1, v1, u2 and v2 coordinates. A texture previously stored in
+     *        the atlas is moved to its own GL texture when requested with
+     *        allowAtlas set to false.
+     * @param allowPending If true, a large bitmap may be uploaded in the
+     *        background and the returned texture may be pending, in which
+     *        case the caller must not draw it. A pending texture requested
+     *        with allowPending set to false is uploaded immediately.
      */
-    Texture* get(SkBitmap* bitmap);
+    Texture* get(SkBitmap* bitmap, bool allowAtlas = false, bool allowPending = false);
     /**
      * Returns the texture associated with the specified bitmap. The generated
      * texture is not kept in the cache. The caller must destroy the texture.
@@ -90,6 +102,25 @@ public:
      * Clears the cache. This causes all textures to be deleted.
      */
     void clear();
+    /**
+     * Stops the background uploads thread. Must be called before the
+     * current context is destroyed.
+     */
+    void stopUploads();
+
+    /**
+     * Indicates whether a placeholder should be drawn in place of pending
+     * textures, see getPlaceholderColor().
+     */
+    bool hasPlaceholder() const {
+        return mHasPlaceholder;
+    }
+    /**
+     * Returns the ARGB color of the placeholder drawn for pending textures.
+     */
+    uint32_t getPlaceholderColor() const {
+        return mPlaceholderColor;
+    }
 
     /**
      * Sets the maximum size of the cache in bytes.
@@ -124,6 +155,12 @@ private:
      */
     void generateTexture(SkBitmap* bitmap, Texture* texture, bool regenerate = false);
 
+    /**
+     * Charges the texture the size of its uncompressed bitmap. Must be
+     * called before a compressed texture is regenerated from its bitmap.
+     */
+    void uncompress(SkBitmap* bitmap, Texture* texture);
+
     void uploadLoFiTexture(bool resize, SkBitmap* bitmap, uint32_t width, uint32_t height);
     void uploadToTexture(bool resize, GLenum format, GLsizei width, GLsizei height,
             GLenum type, const GLvoid * data);
@@ -140,6 +177,13 @@ private:
 
     bool mDebugEnabled;
 
+    TextureAtlas* mAtlas;
+
+    TextureUploader* mUploader;
+    bool mCompressTextures;
+    bool mHasPlaceholder;
+    uint32_t mPlaceholderColor;
+
     Vector<SkBitmap*> mGarbage;
     mutable Mutex mLock;
 }; // class TextureCache
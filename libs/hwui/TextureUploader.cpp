@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <ETC1/etc1.h>
+
+#include <utils/Log.h>
+
+#include "Caches.h"
+#include "TextureUploader.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Constructors/destructor
+///////////////////////////////////////////////////////////////////////////////
+
+TextureUploader::TextureUploader(): mCurrent(NULL), mCurrentCancelled(false),
+        mExit(false), mFailed(false) {
+}
+
+TextureUploader::~TextureUploader() {
+    stop();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Render thread
+///////////////////////////////////////////////////////////////////////////////
+
+bool TextureUploader::canUpload(SkBitmap* bitmap) const {
+    {
+        Mutex::Autolock _l(mLock);
+        if (mFailed) return false;
+    }
+
+    switch (bitmap->getConfig()) {
+        case SkBitmap::kARGB_8888_Config:
+        case SkBitmap::kRGB_565_Config:
+            break;
+        default:
+            return false;
+    }
+    return bitmap->rowBytes() * bitmap->height() >= ASYNC_UPLOAD_MIN_SIZE;
+}
+
+bool TextureUploader::canCompress(SkBitmap* bitmap) const {
+    return bitmap->isImmutable() && bitmap->isOpaque() && canUpload(bitmap);
+}
+
+void TextureUploader::upload(SkBitmap* bitmap, Texture* texture, bool compress) {
+    texture->pending = true;
+
+    {
+        Mutex::Autolock _l(mLock);
+        mRequests.push(Request(*bitmap, texture, compress));
+        mCondition.signal();
+    }
+
+    if (mThread == NULL) {
+        startThread();
+    }
+}
+
+void TextureUploader::cancel(Texture* texture) {
+    Mutex::Autolock _l(mLock);
+
+    for (size_t i = 0; i < mRequests.size(); i++) {
+        if (mRequests.itemAt(i).texture == texture) {
+            mRequests.removeAt(i);
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < mResults.size(); i++) {
+        if (mResults.itemAt(i).texture == texture) {
+            mResults.editItemAt(i).texture = NULL;
+        }
+    }
+
+    if (mCurrent == texture) {
+        mCurrentCancelled = true;
+    }
+
+    texture->pending = false;
+}
+
+void TextureUploader::processCompleted() {
+    attachResults();
+
+    // Requests queued before stop() was called
+    bool restart;
+    {
+        Mutex::Autolock _l(mLock);
+        restart = mThread == NULL && !mRequests.isEmpty();
+    }
+    if (restart) {
+        startThread();
+    }
+}
+
+void TextureUploader::attachResults() {
+    Vector<Result> results;
+    {
+        Mutex::Autolock _l(mLock);
+        if (mResults.isEmpty()) return;
+        results = mResults;
+        mResults.clear();
+    }
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& result = results.itemAt(i);
+        Texture* texture = result.texture;
+
+        if (!texture) {
+            if (result.id) Caches::getInstance().deleteTexture(result.id);
+            continue;
+        }
+
+        texture->id = result.id;
+        texture->blend = result.blend;
+        texture->pending = false;
+
+        // Parameters are owned by the render thread
+        Caches::getInstance().bindTexture(texture->id);
+        texture->setFilter(GL_NEAREST, false, true);
+        texture->setWrap(GL_CLAMP_TO_EDGE, false, true);
+    }
+}
+
+void TextureUploader::startThread() {
+    EGLDisplay display = eglGetCurrentDisplay();
+    EGLContext context = eglGetCurrentContext();
+    if (display == EGL_NO_DISPLAY || context == EGL_NO_CONTEXT) return;
+
+    {
+        Mutex::Autolock _l(mLock);
+        mExit = false;
+    }
+
+    mThread = new UploadThread(this, display, context);
+    mThread->run("hwuiTextureUpload", PRIORITY_BACKGROUND);
+}
+
+void TextureUploader::stop() {
+    if (mThread == NULL) return;
+
+    {
+        Mutex::Autolock _l(mLock);
+        mExit = true;
+        mCondition.signal();
+    }
+
+    mThread->requestExitAndWait();
+    mThread.clear();
+
+    attachResults();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Upload thread
+///////////////////////////////////////////////////////////////////////////////
+
+TextureUploader::UploadThread::UploadThread(TextureUploader* uploader, EGLDisplay display,
+        EGLContext sharedContext): Thread(false),
+        mUploader(uploader), mDisplay(display), mSharedContext(sharedContext) {
+}
+
+bool TextureUploader::UploadThread::threadLoop() {
+    EGLint configAttribs[] = {
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_NONE
+    };
+    EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    EGLint surfaceAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+
+    EGLConfig config;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(mDisplay, configAttribs, &config, 1, &configCount) ||
+            configCount == 0) {
+        ALOGW("Could not find an EGL config to upload textures");
+        mUploader->failAll();
+        return false;
+    }
+
+    EGLContext context = eglCreateContext(mDisplay, config, mSharedContext, contextAttribs);
+    if (context == EGL_NO_CONTEXT) {
+        ALOGW("Could not create an EGL context to upload textures");
+        mUploader->failAll();
+        return false;
+    }
+
+    EGLSurface surface = eglCreatePbufferSurface(mDisplay, config, surfaceAttribs);
+    if (surface != EGL_NO_SURFACE && eglMakeCurrent(mDisplay, surface, surface, context)) {
+        while (mUploader->uploadNext()) { }
+        eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    } else {
+        ALOGW("Could not make the texture upload context current");
+        mUploader->failAll();
+    }
+
+    if (surface != EGL_NO_SURFACE) eglDestroySurface(mDisplay, surface);
+    eglDestroyContext(mDisplay, context);
+
+    // The thread loops in uploadNext()
+    return false;
+}
+
+bool TextureUploader::uploadCompressed(SkBitmap& bitmap) {
+    const uint32_t width = bitmap.width();
+    const uint32_t height = bitmap.height();
+
+    const uint8_t* pixels = (const uint8_t*) bitmap.getPixels();
+    uint32_t pixelSize = 2;
+    uint32_t stride = bitmap.rowBytes();
+
+    // The encoder only reads RGB 565 and RGB 888 pixels
+    uint8_t* rgb = NULL;
+    if (bitmap.getConfig() == SkBitmap::kARGB_8888_Config) {
+        rgb = new uint8_t[width * height * 3];
+        for (uint32_t y = 0; y < height; y++) {
+            const uint8_t* src = pixels + y * bitmap.rowBytes();
+            uint8_t* dst = rgb + y * width * 3;
+            for (uint32_t x = 0; x < width; x++, src += 4, dst += 3) {
+                dst[0] = src[0];
+                dst[1] = src[1];
+                dst[2] = src[2];
+            }
+        }
+        pixels = rgb;
+        pixelSize = 3;
+        stride = width * 3;
+    }
+
+    const uint32_t size = etc1_get_encoded_data_size(width, height);
+    uint8_t* data = new uint8_t[size];
+    const bool encoded = etc1_encode_image(pixels, width, height, pixelSize, stride, data) == 0;
+
+    if (encoded) {
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, GL_ETC1_RGB8_OES, width, height, 0,
+                size, data);
+    }
+
+    delete[] data;
+    delete[] rgb;
+
+    return encoded && glGetError() == GL_NO_ERROR;
+}
+
+void TextureUploader::failAll() {
+    Mutex::Autolock _l(mLock);
+    mFailed = true;
+
+    // Hand the requests back without a texture, the cache uploads them itself
+    for (size_t i = 0; i < mRequests.size(); i++) {
+        Result result;
+        result.bitmap = mRequests.itemAt(i).bitmap;
+        result.texture = mRequests.itemAt(i).texture;
+        mResults.push(result);
+    }
+    mRequests.clear();
+}
+
+bool TextureUploader::uploadNext() {
+    Request request;
+    {
+        Mutex::Autolock _l(mLock);
+        while (mRequests.isEmpty() && !mExit) {
+            mCondition.wait(mLock);
+        }
+        if (mExit) return false;
+
+        request = mRequests.itemAt(0);
+        mRequests.removeAt(0);
+        mCurrent = request.texture;
+        mCurrentCancelled = false;
+    }
+
+    Result result;
+    result.bitmap = request.bitmap;
+
+    SkBitmap& bitmap = request.bitmap;
+    {
+        SkAutoLockPixels alp(bitmap);
+
+        if (bitmap.readyToDraw()) {
+            glGenTextures(1, &result.id);
+            glBindTexture(GL_TEXTURE_2D, result.id);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, bitmap.bytesPerPixel());
+
+            if (request.compress) {
+                // The cache uploads the bitmap itself if it cannot be compressed
+                if (!uploadCompressed(bitmap)) {
+                    glDeleteTextures(1, &result.id);
+                    result.id = 0;
+                }
+                result.blend = false;
+            } else if (bitmap.getConfig() == SkBitmap::kRGB_565_Config) {
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, bitmap.rowBytesAsPixels(),
+                        bitmap.height(), 0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, bitmap.getPixels());
+                result.blend = false;
+            } else {
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, bitmap.rowBytesAsPixels(),
+                        bitmap.height(), 0, GL_RGBA, GL_UNSIGNED_BYTE, bitmap.getPixels());
+                // Do this after calling getPixels() to make sure Skia's deferred
+                // decoding happened
+                result.blend = !bitmap.isOpaque();
+            }
+
+            // The texture must be complete before the render context can use it
+            glFinish();
+        } else {
+            ALOGE("Cannot generate texture from bitmap");
+        }
+    }
+
+    Mutex::Autolock _l(mLock);
+    result.texture = mCurrentCancelled ? NULL : request.texture;
+    mResults.push(result);
+    mCurrent = NULL;
+
+    return true;
+}
+
+}; // namespace uirenderer
+}; // namespace android
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_TEXTURE_UPLOADER_H
+#define ANDROID_HWUI_TEXTURE_UPLOADER_H
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <SkBitmap.h>
+
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+#include "Texture.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Bitmaps smaller than this size, in bytes, are cheap enough to be
+// uploaded synchronously
+#define ASYNC_UPLOAD_MIN_SIZE (256 * 1024)
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Uploads large bitmaps on a background thread. The thread owns an EGL
+ * context that shares objects with the render thread's context; textures
+ * are created and filled from that context, then handed back to the render
+ * thread which attaches them to the pending Texture entries.
+ *
+ * All the methods must be called from the render thread.
+ */
+class TextureUploader {
+public:
+    TextureUploader();
+    ~TextureUploader();
+
+    /**
+     * Indicates whether the specified bitmap is large enough and of a
+     * config that can be uploaded in the background. Returns false once
+     * the upload thread failed to create its context.
+     */
+    bool canUpload(SkBitmap* bitmap) const;
+
+    /**
+     * Indicates whether the specified bitmap can be compressed to ETC1
+     * before being uploaded. The bitmap must be opaque and immutable.
+     */
+    bool canCompress(SkBitmap* bitmap) const;
+
+    /**
+     * Queues the specified bitmap for upload and marks the texture pending.
+     * The bitmap's pixels are kept alive until the upload completes. When
+     * compress is true, the bitmap is encoded to ETC1 by the upload thread;
+     * the texture is left with an id of 0 if the bitmap cannot be encoded.
+     */
+    void upload(SkBitmap* bitmap, Texture* texture, bool compress = false);
+    /**
+     * Cancels the upload of the specified texture. Must be called before a
+     * pending texture is deleted.
+     */
+    void cancel(Texture* texture);
+    /**
+     * Attaches the completed uploads to their textures, which stop being
+     * pending. A texture whose upload failed is left with an id of 0.
+     */
+    void processCompleted();
+
+    /**
+     * Stops the upload thread. Queued uploads are kept and resumed by the
+     * next call to upload() or processCompleted(). Must be called before
+     * the render thread's context is destroyed.
+     */
+    void stop();
+
+private:
+    struct Request {
+        Request(): texture(NULL), compress(false) { }
+        Request(const SkBitmap& bitmap, Texture* texture, bool compress):
+                bitmap(bitmap), texture(texture), compress(compress) { }
+
+        // Copy of the bitmap, holds a reference to its pixels
+        SkBitmap bitmap;
+        Texture* texture;
+        bool compress;
+    };
+
+    struct Result {
+        Result(): texture(NULL), id(0), blend(false) { }
+
+        // Dropped on the render thread
+        SkBitmap bitmap;
+        // NULL if the upload was cancelled
+        Texture* texture;
+        GLuint id;
+        bool blend;
+    };
+
+    class UploadThread: public Thread {
+    public:
+        UploadThread(TextureUploader* uploader, EGLDisplay display, EGLContext sharedContext);
+
+    private:
+        virtual bool threadLoop();
+
+        TextureUploader* mUploader;
+        EGLDisplay mDisplay;
+        EGLContext mSharedContext;
+    }; // class UploadThread
+
+    /**
+     * Starts the upload thread with a context shared with the current one.
+     */
+    void startThread();
+    /**
+     * Attaches the textures uploaded so far to their Texture entries.
+     */
+    void attachResults();
+
+    /**
+     * Invoked on the upload thread, returns false if the thread must exit.
+     */
+    bool uploadNext();
+    /**
+     * Invoked on the upload thread, encodes the bitmap to ETC1 and uploads
+     * it to the bound texture. Returns false if the bitmap could not be
+     * encoded.
+     */
+    static bool uploadCompressed(SkBitmap& bitmap);
+    /**
+     * Invoked on the upload thread when its context cannot be created.
+     */
+    void failAll();
+
+    // Shared with the upload thread
+    sp<UploadThread> mThread;
+    Vector<Request> mRequests;
+    Vector<Result> mResults;
+    Texture* mCurrent;
+    bool mCurrentCancelled;
+    bool mExit;
+    bool mFailed;
+    mutable Mutex mLock;
+    Condition mCondition;
+}; // class TextureUploader
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_TEXTURE_UPLOADER_H
@@ -52,6 +52,49 @@ struct TextureVertex {
     }
 }; // struct TextureVertex
 
+/**
+ * Simple structure to describe a vertex with a position, a texture and a
+ * premultiplied color.
+ */
+struct ColorTextureVertex : TextureVertex {
+    float color[4];
+
+    static inline void set(ColorTextureVertex* vertex, float x, float y, float u, float v,
+            float r, float g, float b, float a) {
+        TextureVertex::set(vertex, x, y, u, v);
+        vertex[0].color[0] = r;
+        vertex[0].color[1] = g;
+        vertex[0].color[2] = b;
+        vertex[0].color[3] = a;
+    }
+}; // struct ColorTextureVertex
+
+/**
+ * Vertex of a 9-patch mesh. The position of the vertex is made of a fixed
+ * part, in pixels, and of a stretchable part, in bitmap pixels, that is
+ * scaled by the stretch factors of the patch in the vertex shader. The
+ * texture coordinates are in texels and are inset by the texture inset of
+ * the patch in the direction given by inset (-1, 0 or 1.)
+ */
+struct PatchVertex {
+    float position[2];
+    float stretchable[2];
+    float texture[2];
+    float inset[2];
+
+    static inline void set(PatchVertex* vertex, float x, float y, float sx, float sy,
+            float u, float v, float iu, float iv) {
+        vertex[0].position[0] = x;
+        vertex[0].position[1] = y;
+        vertex[0].stretchable[0] = sx;
+        vertex[0].stretchable[1] = sy;
+        vertex[0].texture[0] = u;
+        vertex[0].texture[1] = v;
+        vertex[0].inset[0] = iu;
+        vertex[0].inset[1] = iv;
+    }
+}; // struct PatchVertex
+
 /**
  * Simple structure to describe a vertex with a position and an alpha value.
  */
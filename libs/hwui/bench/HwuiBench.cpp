@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "hwuibench"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include "Caches.h"
+#include "DisplayListRenderer.h"
+#include "DisplayListSerializer.h"
+#include "OpenGLRenderer.h"
+
+using namespace android;
+using namespace android::uirenderer;
+
+// Replays display lists captured with DisplayListSerializer into an
+// offscreen pbuffer and reports per-operation CPU latency, shader
+// compiles, texture uploads and frame time percentiles.
+//
+// Usage: hwuibench [-n frames] [-w warmup] [-c] capture [capture...]
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+#define DEFAULT_FRAME_COUNT 1000
+#define DEFAULT_WARMUP_COUNT 10
+
+struct Options {
+    Options(): frameCount(DEFAULT_FRAME_COUNT), warmupCount(DEFAULT_WARMUP_COUNT),
+            coldCaches(false) { }
+
+    int frameCount;
+    int warmupCount;
+    // Flush the caches before every frame
+    bool coldCaches;
+};
+
+struct Totals {
+    Totals(): textureUploads(0), shaderCompiles(0), programSwitches(0), fboSwitches(0) {
+        memset(ops, 0, sizeof(ops));
+    }
+
+    void add(const FrameInfo& info) {
+        textureUploads += info.textureUploads;
+        shaderCompiles += info.shaderCompiles;
+        programSwitches += info.programSwitches;
+        fboSwitches += info.fboSwitches;
+        for (int i = 0; i < FRAME_STATS_OP_COUNT; i++) {
+            ops[i] += info.ops[i];
+        }
+    }
+
+    uint32_t textureUploads;
+    uint32_t shaderCompiles;
+    uint32_t programSwitches;
+    uint32_t fboSwitches;
+    uint64_t ops[FRAME_STATS_OP_COUNT];
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// EGL
+///////////////////////////////////////////////////////////////////////////////
+
+class Context {
+public:
+    Context(): mDisplay(EGL_NO_DISPLAY), mContext(EGL_NO_CONTEXT), mSurface(EGL_NO_SURFACE) { }
+
+    ~Context() {
+        if (mDisplay == EGL_NO_DISPLAY) return;
+
+        eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (mSurface != EGL_NO_SURFACE) eglDestroySurface(mDisplay, mSurface);
+        if (mContext != EGL_NO_CONTEXT) eglDestroyContext(mDisplay, mContext);
+        eglTerminate(mDisplay);
+    }
+
+    bool create(int width, int height) {
+        mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (mDisplay == EGL_NO_DISPLAY || !eglInitialize(mDisplay, NULL, NULL)) {
+            fprintf(stderr, "Could not initialize EGL\n");
+            return false;
+        }
+
+        EGLint configAttribs[] = {
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RED_SIZE, 8,
+                EGL_GREEN_SIZE, 8,
+                EGL_BLUE_SIZE, 8,
+                EGL_ALPHA_SIZE, 8,
+                EGL_DEPTH_SIZE, 0,
+                EGL_STENCIL_SIZE, OpenGLRenderer::getStencilSize(),
+                EGL_NONE
+        };
+        EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+        EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(mDisplay, configAttribs, &config, 1, &configCount) ||
+                configCount == 0) {
+            fprintf(stderr, "Could not find a pbuffer EGL config\n");
+            return false;
+        }
+
+        mContext = eglCreateContext(mDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+        mSurface = eglCreatePbufferSurface(mDisplay, config, surfaceAttribs);
+        if (mContext == EGL_NO_CONTEXT || mSurface == EGL_NO_SURFACE ||
+                !eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+            fprintf(stderr, "Could not create a %dx%d pbuffer: 0x%x\n", width, height,
+                    eglGetError());
+            return false;
+        }
+
+        return true;
+    }
+
+private:
+    EGLDisplay mDisplay;
+    EGLContext mContext;
+    EGLSurface mSurface;
+}; // class Context
+
+///////////////////////////////////////////////////////////////////////////////
+// Utils
+///////////////////////////////////////////////////////////////////////////////
+
+static bool readFile(const char* path, Vector<uint8_t>& data) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    bool result = fstat(fd, &st) == 0 && st.st_size > 0;
+    if (result) {
+        data.insertAt((uint8_t) 0, 0, st.st_size);
+        size_t offset = 0;
+        while (offset < data.size()) {
+            ssize_t count = read(fd, data.editArray() + offset, data.size() - offset);
+            if (count <= 0) {
+                result = false;
+                break;
+            }
+            offset += count;
+        }
+    }
+
+    close(fd);
+    return result;
+}
+
+static int compareTimes(const nsecs_t* lhs, const nsecs_t* rhs) {
+    return *lhs < *rhs ? -1 : (*lhs > *rhs ? 1 : 0);
+}
+
+static inline float toMs(nsecs_t time) {
+    return time / 1000000.0f;
+}
+
+static void printPercentiles(const char* name, Vector<nsecs_t>& times) {
+    if (times.isEmpty()) return;
+    times.sort(compareTimes);
+
+    const size_t count = times.size();
+    printf("  %-8s p50 %7.3f  p90 %7.3f  p95 %7.3f  p99 %7.3f  max %7.3f ms\n", name,
+            toMs(times[count * 50 / 100]), toMs(times[count * 90 / 100]),
+            toMs(times[count * 95 / 100]), toMs(times[count * 99 / 100]),
+            toMs(times[count - 1]));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Benchmark
+///////////////////////////////////////////////////////////////////////////////
+
+static nsecs_t drawFrame(OpenGLRenderer& renderer, DisplayList* displayList, FrameInfo* info) {
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    renderer.prepare(false);
+    Rect dirty;
+    renderer.drawDisplayList(displayList, dirty, DisplayList::kReplayFlag_ClipChildren);
+    renderer.finish();
+    // Include the GPU work in the frame time
+    glFinish();
+
+    const nsecs_t time = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    Caches::getInstance().frameStats.getFrames(info, 1);
+    return time;
+}
+
+static bool runCapture(const char* path, const Options& options) {
+    Vector<uint8_t> data;
+    if (!readFile(path, data)) {
+        fprintf(stderr, "Could not read %s\n", path);
+        return false;
+    }
+
+    // Peek at the viewport size to create the pbuffer before decoding,
+    // decoding requires a current context
+    const int32_t* header = (const int32_t*) data.array();
+    if (data.size() < 4 * sizeof(int32_t) || header[0] != DISPLAY_LIST_SERIALIZATION_MAGIC) {
+        fprintf(stderr, "%s is not a display list capture\n", path);
+        return false;
+    }
+    const int width = header[2];
+    const int height = header[3];
+
+    Context context;
+    if (!context.create(width, height)) return false;
+
+    // Caches outlives the contexts of the previous captures
+    Caches& caches = Caches::getInstance();
+    caches.init();
+    caches.frameStats.terminate();
+    caches.frameStats.init(true, caches.extensions.hasDisjointTimerQuery());
+
+    bool result = false;
+    {
+        DisplayListCapture capture;
+        if (!capture.read(data.array(), data.size())) {
+            fprintf(stderr, "Could not decode %s\n", path);
+        } else {
+            OpenGLRenderer renderer;
+            renderer.setViewport(width, height);
+
+            printf("%s: %dx%d, %d frames\n", path, width, height, options.frameCount);
+
+            // The first frame compiles shaders and uploads textures
+            FrameInfo info;
+            const nsecs_t firstFrame = drawFrame(renderer, capture.getDisplayList(), &info);
+            printf("  First frame %.3f ms, %d shader compiles, %d texture uploads\n",
+                    toMs(firstFrame), info.shaderCompiles, info.textureUploads);
+
+            for (int i = 0; i < options.warmupCount; i++) {
+                drawFrame(renderer, capture.getDisplayList(), &info);
+            }
+
+            Vector<nsecs_t> frameTimes;
+            Vector<nsecs_t> replayTimes;
+            Totals totals;
+
+            caches.frameStats.setOpTimingEnabled(true);
+            for (int i = 0; i < options.frameCount; i++) {
+                if (options.coldCaches) {
+                    caches.flush(Caches::kFlushMode_Full);
+                }
+                frameTimes.add(drawFrame(renderer, capture.getDisplayList(), &info));
+                replayTimes.add(info.replayTime);
+                totals.add(info);
+            }
+            caches.frameStats.setOpTimingEnabled(false);
+
+            nsecs_t opTimes[FRAME_STATS_OP_COUNT];
+            caches.frameStats.getOpTimes(opTimes);
+
+            printPercentiles("Frame", frameTimes);
+            printPercentiles("Replay", replayTimes);
+
+            printf("  Per frame: %.2f shader compiles, %.2f texture uploads, "
+                    "%.2f program switches, %.2f FBO switches\n",
+                    totals.shaderCompiles / float(options.frameCount),
+                    totals.textureUploads / float(options.frameCount),
+                    totals.programSwitches / float(options.frameCount),
+                    totals.fboSwitches / float(options.frameCount));
+
+            printf("  %-20s %10s %10s %10s\n", "Operation", "Count", "Total ms", "Avg us");
+            for (int op = 0; op <= DisplayList::DrawGLFunction; op++) {
+                if (totals.ops[op] == 0) continue;
+                printf("  %-20s %10llu %10.2f %10.3f\n", DisplayList::OP_NAMES[op],
+                        (unsigned long long) totals.ops[op], toMs(opTimes[op]),
+                        opTimes[op] / 1000.0f / totals.ops[op]);
+            }
+
+            result = true;
+        }
+    }
+
+    // The capture and the renderer must be destroyed before the context
+    caches.flush(Caches::kFlushMode_Full);
+    caches.terminate();
+
+    return result;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-n frames] [-w warmup] [-c] capture [capture...]\n", name);
+    fprintf(stderr, "  -n  number of measured frames, %d by default\n", DEFAULT_FRAME_COUNT);
+    fprintf(stderr, "  -w  number of warmup frames, %d by default\n", DEFAULT_WARMUP_COUNT);
+    fprintf(stderr, "  -c  flush the caches before every frame\n");
+}
+
+int main(int argc, char** argv) {
+    Options options;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:w:c")) != -1) {
+        switch (opt) {
+            case 'n':
+                options.frameCount = atoi(optarg);
+                break;
+            case 'w':
+                options.warmupCount = atoi(optarg);
+                break;
+            case 'c':
+                options.coldCaches = true;
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (optind >= argc || options.frameCount <= 0 || options.warmupCount < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int failures = 0;
+    for (int i = optind; i < argc; i++) {
+        if (!runCapture(argv[i], options)) failures++;
+    }
+
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "OpenGLRenderer"
+
+#include <math.h>
+
+#if defined(__ARM_HAVE_NEON)
+    #include <arm_neon.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+#include "Blur.h"
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Kernels
+///////////////////////////////////////////////////////////////////////////////
+
+static inline int32_t clamp(int32_t value, int32_t max) {
+    return value < 0 ? 0 : (value > max ? max : value);
+}
+
+/**
+ * Computes one output pixel, clamping samples to the edges of the line.
+ * The line is made of count samples spaced by stride bytes.
+ */
+static inline uint8_t blurPixelClamped(const uint16_t* weights, int32_t radius,
+        const uint8_t* line, int32_t stride, int32_t position, int32_t count) {
+    uint32_t sum = 0;
+    for (int32_t r = -radius; r <= radius; r++) {
+        const int32_t index = clamp(position + r, count - 1);
+        sum += line[index * stride] * weights[r + radius];
+    }
+    return (uint8_t) (sum >> BLUR_WEIGHT_SHIFT);
+}
+
+/**
+ * Computes one output pixel away from the edges of the line. The pointer
+ * points to the first sample covered by the kernel.
+ */
+static inline uint8_t blurPixel(const uint16_t* weights, int32_t radius,
+        const uint8_t* samples, int32_t stride) {
+    uint32_t sum = 0;
+    const int32_t taps = 2 * radius + 1;
+    for (int32_t i = 0; i < taps; i++) {
+        sum += *samples * weights[i];
+        samples += stride;
+    }
+    return (uint8_t) (sum >> BLUR_WEIGHT_SHIFT);
+}
+
+#if defined(__ARM_HAVE_NEON) || defined(__SSE2__)
+
+#define BLUR_SIMD_WIDTH 8
+
+/**
+ * Computes 8 adjacent output pixels. rows[i] points to the 8 samples that
+ * must be multiplied by the weight i.
+ */
+static inline void blurPixels8(const uint16_t* weights, int32_t taps,
+        const uint8_t* const* rows, int32_t offset, uint8_t* output) {
+#if defined(__ARM_HAVE_NEON)
+    uint32x4_t low = vdupq_n_u32(0);
+    uint32x4_t high = vdupq_n_u32(0);
+    for (int32_t i = 0; i < taps; i++) {
+        const uint16x8_t pixels = vmovl_u8(vld1_u8(rows[i] + offset));
+        low = vmlal_n_u16(low, vget_low_u16(pixels), weights[i]);
+        high = vmlal_n_u16(high, vget_high_u16(pixels), weights[i]);
+    }
+    const uint16x8_t result = vcombine_u16(vshrn_n_u32(low, BLUR_WEIGHT_SHIFT),
+            vshrn_n_u32(high, BLUR_WEIGHT_SHIFT));
+    vst1_u8(output, vmovn_u16(result));
+#else
+    const __m128i zero = _mm_setzero_si128();
+    __m128i low = zero;
+    __m128i high = zero;
+    for (int32_t i = 0; i < taps; i++) {
+        const __m128i pixels = _mm_unpacklo_epi8(
+                _mm_loadl_epi64((const __m128i*) (rows[i] + offset)), zero);
+        const __m128i weight = _mm_set1_epi16(weights[i]);
+        const __m128i productLow = _mm_mullo_epi16(pixels, weight);
+        const __m128i productHigh = _mm_mulhi_epu16(pixels, weight);
+        low = _mm_add_epi32(low, _mm_unpacklo_epi16(productLow, productHigh));
+        high = _mm_add_epi32(high, _mm_unpackhi_epi16(productLow, productHigh));
+    }
+    // Results are <= 255 so the saturating packs are lossless
+    const __m128i result = _mm_packs_epi32(_mm_srli_epi32(low, BLUR_WEIGHT_SHIFT),
+            _mm_srli_epi32(high, BLUR_WEIGHT_SHIFT));
+    _mm_storel_epi64((__m128i*) output, _mm_packus_epi16(result, zero));
+#endif
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// Weights
+///////////////////////////////////////////////////////////////////////////////
+
+void Blur::generateGaussianWeights(float* weights, int32_t radius) {
+    // Compute gaussian weights for the blur
+    // e is the euler's number
+    float e = 2.718281828459045f;
+    float pi = 3.1415926535897932f;
+    // g(x) = ( 1 / sqrt( 2 * pi ) * sigma) * e ^ ( -x^2 / 2 * sigma^2 )
+    // x is of the form [-radius .. 0 .. radius]
+    // and sigma varies with radius.
+    // Based on some experimental radius values and sigma's
+    // we approximately fit sigma = f(radius) as
+    // sigma = radius * 0.3  + 0.6
+    // The larger the radius gets, the more our gaussian blur
+    // will resemble a box blur since with large sigma
+    // the gaussian curve begins to lose its shape
+    float sigma = 0.3f * (float) radius + 0.6f;
+
+    // Now compute the coefficints
+    // We will store some redundant values to save some math during
+    // the blur calculations
+    // precompute some values
+    float coeff1 = 1.0f / (sqrt( 2.0f * pi ) * sigma);
+    float coeff2 = - 1.0f / (2.0f * sigma * sigma);
+
+    float normalizeFactor = 0.0f;
+    for (int32_t r = -radius; r <= radius; r ++) {
+        float floatR = (float) r;
+        weights[r + radius] = coeff1 * pow(e, floatR * floatR * coeff2);
+        normalizeFactor += weights[r + radius];
+    }
+
+    //Now we need to normalize the weights because all our coefficients need to add up to one
+    normalizeFactor = 1.0f / normalizeFactor;
+    for (int32_t r = -radius; r <= radius; r ++) {
+        weights[r + radius] *= normalizeFactor;
+    }
+}
+
+void Blur::generateFixedWeights(const float* weights, uint16_t* fixedWeights,
+        int32_t radius) {
+    const int32_t one = 1 << BLUR_WEIGHT_SHIFT;
+    const int32_t taps = 2 * radius + 1;
+
+    int32_t sum = 0;
+    for (int32_t i = 0; i < taps; i++) {
+        fixedWeights[i] = (uint16_t) (weights[i] * one + 0.5f);
+        sum += fixedWeights[i];
+    }
+
+    // Fold the rounding error into the center weight so a fully opaque
+    // area remains fully opaque once blurred
+    fixedWeights[radius] += one - sum;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Passes
+///////////////////////////////////////////////////////////////////////////////
+
+void Blur::horizontal(const uint16_t* weights, int32_t radius,
+        const uint8_t* source, uint8_t* dest, int32_t width, int32_t height) {
+    // Pixels in [radius, fastEnd) can be computed without clamping
+    const int32_t fastStart = radius < width ? radius : width;
+    const int32_t fastEnd = width - radius;
+
+    for (int32_t y = 0; y < height; y++) {
+        const uint8_t* input = source + y * width;
+        uint8_t* output = dest + y * width;
+
+        int32_t x = 0;
+        for ( ; x < fastStart; x++) {
+            output[x] = blurPixelClamped(weights, radius, input, 1, x, width);
+        }
+
+#ifdef BLUR_SIMD_WIDTH
+        const int32_t taps = 2 * radius + 1;
+        const uint8_t* rows[taps];
+        for (int32_t i = 0; i < taps; i++) {
+            rows[i] = input + i - radius;
+        }
+        for ( ; x + BLUR_SIMD_WIDTH <= fastEnd; x += BLUR_SIMD_WIDTH) {
+            blurPixels8(weights, taps, rows, x, output + x);
+        }
+#endif
+
+        for ( ; x < fastEnd; x++) {
+            output[x] = blurPixel(weights, radius, input + x - radius, 1);
+        }
+        for ( ; x < width; x++) {
+            output[x] = blurPixelClamped(weights, radius, input, 1, x, width);
+        }
+    }
+}
+
+void Blur::vertical(const uint16_t* weights, int32_t radius,
+        const uint8_t* source, uint8_t* dest, int32_t width, int32_t height) {
+    const int32_t taps = 2 * radius + 1;
+    const uint8_t* rows[taps];
+
+    for (int32_t y = 0; y < height; y++) {
+        uint8_t* output = dest + y * width;
+
+        // Clamping is resolved once per row by picking the source rows
+        for (int32_t i = 0; i < taps; i++) {
+            rows[i] = source + clamp(y + i - radius, height - 1) * width;
+        }
+
+        int32_t x = 0;
+#ifdef BLUR_SIMD_WIDTH
+        for ( ; x + BLUR_SIMD_WIDTH <= width; x += BLUR_SIMD_WIDTH) {
+            blurPixels8(weights, taps, rows, x, output + x);
+        }
+#endif
+
+        for ( ; x < width; x++) {
+            uint32_t sum = 0;
+            for (int32_t i = 0; i < taps; i++) {
+                sum += rows[i][x] * weights[i];
+            }
+            output[x] = (uint8_t) (sum >> BLUR_WEIGHT_SHIFT);
+        }
+    }
+}
+
+void Blur::blurImage(uint8_t* image, int32_t width, int32_t height, int32_t radius) {
+    const int32_t taps = 2 * radius + 1;
+
+    float gaussian[taps];
+    generateGaussianWeights(gaussian, radius);
+
+    uint16_t weights[taps];
+    generateFixedWeights(gaussian, weights, radius);
+
+    uint8_t* scratch = new uint8_t[width * height];
+
+    horizontal(weights, radius, image, scratch, width, height);
+    vertical(weights, radius, scratch, image, width, height);
+
+    delete[] scratch;
+}
+
+}; // namespace uirenderer
+}; // namespace android
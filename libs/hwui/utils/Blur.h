@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HWUI_BLUR_H
+#define ANDROID_HWUI_BLUR_H
+
+#include <stdint.h>
+
+namespace android {
+namespace uirenderer {
+
+///////////////////////////////////////////////////////////////////////////////
+// Defines
+///////////////////////////////////////////////////////////////////////////////
+
+// Precision, in bits, of the fixed point weights used by the blur kernels
+#define BLUR_WEIGHT_SHIFT 14
+
+///////////////////////////////////////////////////////////////////////////////
+// Classes
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * Separable gaussian blur for alpha8 images. The kernels operate on fixed
+ * point weights so that the scalar, NEON and SSE2 implementations produce
+ * exactly the same output.
+ */
+class Blur {
+public:
+    /**
+     * Computes the 2 * radius + 1 normalized weights of a gaussian kernel.
+     */
+    static void generateGaussianWeights(float* weights, int32_t radius);
+
+    /**
+     * Converts normalized weights to fixed point. The resulting weights
+     * add up to exactly 1 << BLUR_WEIGHT_SHIFT.
+     */
+    static void generateFixedWeights(const float* weights, uint16_t* fixedWeights,
+            int32_t radius);
+
+    static void horizontal(const uint16_t* weights, int32_t radius,
+            const uint8_t* source, uint8_t* dest, int32_t width, int32_t height);
+    static void vertical(const uint16_t* weights, int32_t radius,
+            const uint8_t* source, uint8_t* dest, int32_t width, int32_t height);
+
+    /**
+     * Blurs the specified image in place.
+     */
+    static void blurImage(uint8_t* image, int32_t width, int32_t height, int32_t radius);
+}; // class Blur
+
+}; // namespace uirenderer
+}; // namespace android
+
+#endif // ANDROID_HWUI_BLUR_H
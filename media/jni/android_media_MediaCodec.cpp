@@ -59,6 +59,13 @@ struct fields_t {
     jfieldID cryptoInfoKeyID;
     jfieldID cryptoInfoIVID;
     jfieldID cryptoInfoModeID;
+
+    jmethodID bufferInfoSetID;
+
+    jclass byteBufferClass;
+    jmethodID byteBufferOrderID;
+    jmethodID byteBufferClearID;
+    jobject nativeByteOrder;
 };
 
 static fields_t gFields;
@@ -69,7 +76,9 @@ JMediaCodec::JMediaCodec(
         JNIEnv *env, jobject thiz,
         const char *name, bool nameIsType, bool encoder)
     : mClass(NULL),
-      mObject(NULL) {
+      mObject(NULL),
+      mInputBufferArray(NULL),
+      mOutputBufferArray(NULL) {
     jclass clazz = env->GetObjectClass(thiz);
     CHECK(clazz != NULL);
 
@@ -100,6 +109,8 @@ JMediaCodec::~JMediaCodec() {
 
     JNIEnv *env = AndroidRuntime::getJNIEnv();
 
+    clearBufferArrays(env);
+
     env->DeleteWeakGlobalRef(mObject);
     mObject = NULL;
     env->DeleteGlobalRef(mClass);
@@ -128,6 +139,8 @@ status_t JMediaCodec::start() {
 status_t JMediaCodec::stop() {
     mSurfaceTextureClient.clear();
 
+    clearBufferArrays(AndroidRuntime::getJNIEnv());
+
     return mCodec->stop();
 }
 
@@ -174,10 +187,8 @@ status_t JMediaCodec::dequeueOutputBuffer(
         return err;
     }
 
-    jclass clazz = env->FindClass("android/media/MediaCodec$BufferInfo");
-
-    jmethodID method = env->GetMethodID(clazz, "set", "(IIJI)V");
-    env->CallVoidMethod(bufferInfo, method, offset, size, timeUs, flags);
+    env->CallVoidMethod(
+            bufferInfo, gFields.bufferInfoSetID, offset, size, timeUs, flags);
 
     return OK;
 }
@@ -198,6 +209,37 @@ status_t JMediaCodec::getOutputFormat(JNIEnv *env, jobject *format) const {
     return ConvertMessageToMap(env, msg, format);
 }
 
+void JMediaCodec::clearBufferArrays(JNIEnv *env) {
+    Mutex::Autolock autoLock(mBuffersLock);
+
+    if (mInputBufferArray != NULL) {
+        env->DeleteGlobalRef(mInputBufferArray);
+        mInputBufferArray = NULL;
+    }
+    mInputBuffers.clear();
+
+    if (mOutputBufferArray != NULL) {
+        env->DeleteGlobalRef(mOutputBufferArray);
+        mOutputBufferArray = NULL;
+    }
+    mOutputBuffers.clear();
+}
+
+static bool sameBuffers(
+        const Vector<sp<ABuffer> > &a, const Vector<sp<ABuffer> > &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a.itemAt(i) != b.itemAt(i)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 status_t JMediaCodec::getBuffers(
         JNIEnv *env, bool input, jobjectArray *bufArray) const {
     Vector<sp<ABuffer> > buffers;
@@ -211,40 +253,65 @@ status_t JMediaCodec::getBuffers(
         return err;
     }
 
-    jclass byteBufferClass = env->FindClass("java/nio/ByteBuffer");
-    CHECK(byteBufferClass != NULL);
+    Mutex::Autolock autoLock(mBuffersLock);
 
-    jmethodID orderID = env->GetMethodID(
-            byteBufferClass,
-            "order",
-            "(Ljava/nio/ByteOrder;)Ljava/nio/ByteBuffer;");
+    Vector<sp<ABuffer> > &cachedBuffers =
+        input ? mInputBuffers : mOutputBuffers;
+    jobjectArray &cachedArray =
+        input ? mInputBufferArray : mOutputBufferArray;
 
-    CHECK(orderID != NULL);
+    if (cachedArray == NULL || !sameBuffers(buffers, cachedBuffers)) {
+        jobjectArray byteBuffers = env->NewObjectArray(
+                buffers.size(), gFields.byteBufferClass, NULL);
 
-    jclass byteOrderClass = env->FindClass("java/nio/ByteOrder");
-    CHECK(byteOrderClass != NULL);
+        if (byteBuffers == NULL) {
+            return NO_MEMORY;
+        }
 
-    jmethodID nativeOrderID = env->GetStaticMethodID(
-            byteOrderClass, "nativeOrder", "()Ljava/nio/ByteOrder;");
-    CHECK(nativeOrderID != NULL);
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            const sp<ABuffer> &buffer = buffers.itemAt(i);
 
-    jobject nativeByteOrderObj =
-        env->CallStaticObjectMethod(byteOrderClass, nativeOrderID);
-    CHECK(nativeByteOrderObj != NULL);
+            jobject byteBuffer =
+                env->NewDirectByteBuffer(
+                    buffer->base(),
+                    buffer->capacity());
+
+            jobject me = env->CallObjectMethod(
+                    byteBuffer, gFields.byteBufferOrderID, gFields.nativeByteOrder);
+            env->DeleteLocalRef(me);
+            me = NULL;
+
+            env->SetObjectArrayElement(
+                    byteBuffers, i, byteBuffer);
 
+            env->DeleteLocalRef(byteBuffer);
+            byteBuffer = NULL;
+        }
+
+        if (cachedArray != NULL) {
+            env->DeleteGlobalRef(cachedArray);
+        }
+        cachedArray = (jobjectArray)env->NewGlobalRef(byteBuffers);
+        cachedBuffers = buffers;
+
+        env->DeleteLocalRef(byteBuffers);
+        byteBuffers = NULL;
+    }
+
+    // The cached array never leaves this object, callers get a new array
+    // every time, holding the cached ByteBuffers reset to their whole
+    // capacity as new ones would be.
     *bufArray = (jobjectArray)env->NewObjectArray(
-            buffers.size(), byteBufferClass, NULL);
+            buffers.size(), gFields.byteBufferClass, NULL);
 
-    for (size_t i = 0; i < buffers.size(); ++i) {
-        const sp<ABuffer> &buffer = buffers.itemAt(i);
+    if (*bufArray == NULL) {
+        return NO_MEMORY;
+    }
 
-        jobject byteBuffer =
-            env->NewDirectByteBuffer(
-                buffer->base(),
-                buffer->capacity());
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        jobject byteBuffer = env->GetObjectArrayElement(cachedArray, i);
 
-        jobject me = env->CallObjectMethod(
-                byteBuffer, orderID, nativeByteOrderObj);
+        jobject me = env->CallObjectMethod(byteBuffer, gFields.byteBufferClearID);
         env->DeleteLocalRef(me);
         me = NULL;
 
@@ -255,9 +322,6 @@ status_t JMediaCodec::getBuffers(
         byteBuffer = NULL;
     }
 
-    env->DeleteLocalRef(nativeByteOrderObj);
-    nativeByteOrderObj = NULL;
-
     return OK;
 }
 
@@ -498,9 +562,16 @@ static void android_media_MediaCodec_queueSecureInputBuffer(
 
     status_t err = OK;
 
-    CryptoPlugin::SubSample *subSamples = NULL;
-    jbyte *key = NULL;
-    jbyte *iv = NULL;
+    // Most samples have a few subsamples, which are parsed on the stack so
+    // that queueing a sample does not allocate.
+    enum { kMaxStackSubSamples = 16 };
+    CryptoPlugin::SubSample stackSubSamples[kMaxStackSubSamples];
+    jint stackNumBytes[kMaxStackSubSamples];
+
+    CryptoPlugin::SubSample *subSamples = stackSubSamples;
+    jint *numBytes = stackNumBytes;
+    uint8_t key[16];
+    uint8_t iv[16];
 
     if (numSubSamples <= 0) {
         err = -EINVAL;
@@ -514,39 +585,31 @@ static void android_media_MediaCodec_queueSecureInputBuffer(
             && env->GetArrayLength(numBytesOfClearDataObj) < numSubSamples) {
         err = -ERANGE;
     } else {
-        jboolean isCopy;
-
-        jint *numBytesOfClearData =
-            (numBytesOfClearDataObj == NULL)
-                ? NULL
-                : env->GetIntArrayElements(numBytesOfClearDataObj, &isCopy);
-
-        jint *numBytesOfEncryptedData =
-            (numBytesOfEncryptedDataObj == NULL)
-                ? NULL
-                : env->GetIntArrayElements(numBytesOfEncryptedDataObj, &isCopy);
+        if (numSubSamples > kMaxStackSubSamples) {
+            subSamples = new CryptoPlugin::SubSample[numSubSamples];
+            numBytes = new jint[numSubSamples];
+        }
 
-        subSamples = new CryptoPlugin::SubSample[numSubSamples];
+        if (numBytesOfClearDataObj == NULL) {
+            memset(numBytes, 0, numSubSamples * sizeof(jint));
+        } else {
+            env->GetIntArrayRegion(
+                    numBytesOfClearDataObj, 0, numSubSamples, numBytes);
+        }
 
         for (jint i = 0; i < numSubSamples; ++i) {
-            subSamples[i].mNumBytesOfClearData =
-                (numBytesOfClearData == NULL) ? 0 : numBytesOfClearData[i];
-
-            subSamples[i].mNumBytesOfEncryptedData =
-                (numBytesOfEncryptedData == NULL)
-                    ? 0 : numBytesOfEncryptedData[i];
+            subSamples[i].mNumBytesOfClearData = numBytes[i];
         }
 
-        if (numBytesOfEncryptedData != NULL) {
-            env->ReleaseIntArrayElements(
-                    numBytesOfEncryptedDataObj, numBytesOfEncryptedData, 0);
-            numBytesOfEncryptedData = NULL;
+        if (numBytesOfEncryptedDataObj == NULL) {
+            memset(numBytes, 0, numSubSamples * sizeof(jint));
+        } else {
+            env->GetIntArrayRegion(
+                    numBytesOfEncryptedDataObj, 0, numSubSamples, numBytes);
         }
 
-        if (numBytesOfClearData != NULL) {
-            env->ReleaseIntArrayElements(
-                    numBytesOfClearDataObj, numBytesOfClearData, 0);
-            numBytesOfClearData = NULL;
+        for (jint i = 0; i < numSubSamples; ++i) {
+            subSamples[i].mNumBytesOfEncryptedData = numBytes[i];
         }
     }
 
@@ -554,8 +617,7 @@ static void android_media_MediaCodec_queueSecureInputBuffer(
         if (env->GetArrayLength(keyObj) != 16) {
             err = -EINVAL;
         } else {
-            jboolean isCopy;
-            key = env->GetByteArrayElements(keyObj, &isCopy);
+            env->GetByteArrayRegion(keyObj, 0, 16, (jbyte *)key);
         }
     }
 
@@ -563,8 +625,7 @@ static void android_media_MediaCodec_queueSecureInputBuffer(
         if (env->GetArrayLength(ivObj) != 16) {
             err = -EINVAL;
         } else {
-            jboolean isCopy;
-            iv = env->GetByteArrayElements(ivObj, &isCopy);
+            env->GetByteArrayRegion(ivObj, 0, 16, (jbyte *)iv);
         }
     }
 
@@ -574,25 +635,20 @@ static void android_media_MediaCodec_queueSecureInputBuffer(
         err = codec->queueSecureInputBuffer(
                 index, offset,
                 subSamples, numSubSamples,
-                (const uint8_t *)key, (const uint8_t *)iv,
+                keyObj != NULL ? key : NULL,
+                ivObj != NULL ? iv : NULL,
                 (CryptoPlugin::Mode)mode,
                 timestampUs,
                 flags,
                 &errorDetailMsg);
     }
 
-    if (iv != NULL) {
-        env->ReleaseByteArrayElements(ivObj, iv, 0);
-        iv = NULL;
-    }
-
-    if (key != NULL) {
-        env->ReleaseByteArrayElements(keyObj, key, 0);
-        key = NULL;
+    if (subSamples != stackSubSamples) {
+        delete[] subSamples;
+        delete[] numBytes;
     }
-
-    delete[] subSamples;
     subSamples = NULL;
+    numBytes = NULL;
 
     throwExceptionAsNecessary(
             env, err, errorDetailMsg.empty() ? NULL : errorDetailMsg.c_str());
@@ -751,6 +807,42 @@ static void android_media_MediaCodec_native_init(JNIEnv *env) {
 
     gFields.cryptoInfoModeID = env->GetFieldID(clazz, "mode", "I");
     CHECK(gFields.cryptoInfoModeID != NULL);
+
+    clazz = env->FindClass("android/media/MediaCodec$BufferInfo");
+    CHECK(clazz != NULL);
+
+    gFields.bufferInfoSetID = env->GetMethodID(clazz, "set", "(IIJI)V");
+    CHECK(gFields.bufferInfoSetID != NULL);
+
+    clazz = env->FindClass("java/nio/ByteBuffer");
+    CHECK(clazz != NULL);
+
+    gFields.byteBufferClass = (jclass)env->NewGlobalRef(clazz);
+
+    gFields.byteBufferOrderID = env->GetMethodID(
+            clazz,
+            "order",
+            "(Ljava/nio/ByteOrder;)Ljava/nio/ByteBuffer;");
+    CHECK(gFields.byteBufferOrderID != NULL);
+
+    gFields.byteBufferClearID = env->GetMethodID(
+            clazz,
+            "clear",
+            "()Ljava/nio/Buffer;");
+    CHECK(gFields.byteBufferClearID != NULL);
+
+    clazz = env->FindClass("java/nio/ByteOrder");
+    CHECK(clazz != NULL);
+
+    jmethodID nativeOrderID = env->GetStaticMethodID(
+            clazz, "nativeOrder", "()Ljava/nio/ByteOrder;");
+    CHECK(nativeOrderID != NULL);
+
+    jobject nativeByteOrderObj = env->CallStaticObjectMethod(clazz, nativeOrderID);
+    CHECK(nativeByteOrderObj != NULL);
+
+    gFields.nativeByteOrder = env->NewGlobalRef(nativeByteOrderObj);
+    env->DeleteLocalRef(nativeByteOrderObj);
 }
 
 static void android_media_MediaCodec_native_setup(
@@ -23,9 +23,12 @@
 #include <media/stagefright/foundation/ABase.h>
 #include <utils/Errors.h>
 #include <utils/RefBase.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
 
 namespace android {
 
+struct ABuffer;
 struct ALooper;
 struct AMessage;
 struct AString;
@@ -94,6 +97,16 @@ private:
     sp<ALooper> mLooper;
     sp<MediaCodec> mCodec;
 
+    // The ByteBuffers handed out by getBuffers() are reused for as long as
+    // the codec keeps the same buffers.
+    mutable Mutex mBuffersLock;
+    mutable Vector<sp<ABuffer> > mInputBuffers;
+    mutable Vector<sp<ABuffer> > mOutputBuffers;
+    mutable jobjectArray mInputBufferArray;
+    mutable jobjectArray mOutputBufferArray;
+
+    void clearBufferArrays(JNIEnv *env);
+
     DISALLOW_EVIL_CONSTRUCTORS(JMediaCodec);
 };
 
@@ -22,6 +22,9 @@
 #include <utils/Log.h>
 #include <utils/threads.h>
 #include <core/SkBitmap.h>
+#include <core/SkCanvas.h>
+#include <core/SkMatrix.h>
+#include <core/SkPaint.h>
 #include <media/mediametadataretriever.h>
 #include <private/media/VideoFrame.h>
 
@@ -38,7 +41,6 @@ struct fields_t {
     jclass bitmapClazz;  // Must be a global ref
     jfieldID nativeBitmap;
     jmethodID createBitmapMethod;
-    jmethodID createScaledBitmapMethod;
     jclass configClazz;  // Must be a global ref
     jmethodID createConfigMethod;
 };
@@ -166,12 +168,22 @@ static void rotate0(T* dst, const T* src, size_t width, size_t height)
     memcpy(dst, src, width * height * sizeof(T));
 }
 
+// The 90 and 270 degree rotations walk the destination column by column,
+// so they are done in tiles that stay in the cache.
+static const size_t kRotateTileSize = 32;
+
 template<typename T>
 static void rotate90(T* dst, const T* src, size_t width, size_t height)
 {
-    for (size_t i = 0; i < height; ++i) {
-        for (size_t j = 0; j < width; ++j) {
-            dst[j * height + height - 1 - i] = src[i * width + j];
+    for (size_t ti = 0; ti < height; ti += kRotateTileSize) {
+        const size_t iEnd = ti + kRotateTileSize < height ? ti + kRotateTileSize : height;
+        for (size_t tj = 0; tj < width; tj += kRotateTileSize) {
+            const size_t jEnd = tj + kRotateTileSize < width ? tj + kRotateTileSize : width;
+            for (size_t i = ti; i < iEnd; ++i) {
+                for (size_t j = tj; j < jEnd; ++j) {
+                    dst[j * height + height - 1 - i] = src[i * width + j];
+                }
+            }
         }
     }
 }
@@ -189,9 +201,15 @@ static void rotate180(T* dst, const T* src, size_t width, size_t height)
 template<typename T>
 static void rotate270(T* dst, const T* src, size_t width, size_t height)
 {
-    for (size_t i = 0; i < height; ++i) {
-        for (size_t j = 0; j < width; ++j) {
-            dst[(width - 1 - j) * height + i] = src[i * width + j];
+    for (size_t ti = 0; ti < height; ti += kRotateTileSize) {
+        const size_t iEnd = ti + kRotateTileSize < height ? ti + kRotateTileSize : height;
+        for (size_t tj = 0; tj < width; tj += kRotateTileSize) {
+            const size_t jEnd = tj + kRotateTileSize < width ? tj + kRotateTileSize : width;
+            for (size_t i = ti; i < iEnd; ++i) {
+                for (size_t j = tj; j < jEnd; ++j) {
+                    dst[(width - 1 - j) * height + i] = src[i * width + j];
+                }
+            }
         }
     }
 }
@@ -246,52 +264,79 @@ static jobject android_media_MediaMetadataRetriever_getFrameAtTime(JNIEnv *env,
                         SkBitmap::kRGB_565_Config);
 
     size_t width, height;
-    bool swapWidthAndHeight = false;
+    size_t displayWidth, displayHeight;
     if (videoFrame->mRotationAngle == 90 || videoFrame->mRotationAngle == 270) {
         width = videoFrame->mHeight;
         height = videoFrame->mWidth;
-        swapWidthAndHeight = true;
+        displayWidth = videoFrame->mDisplayHeight;
+        displayHeight = videoFrame->mDisplayWidth;
     } else {
         width = videoFrame->mWidth;
         height = videoFrame->mHeight;
+        displayWidth = videoFrame->mDisplayWidth;
+        displayHeight = videoFrame->mDisplayHeight;
     }
 
+    const bool scaled = displayWidth != width || displayHeight != height;
+    if (scaled) {
+        ALOGV("Bitmap dimension is scaled from %dx%d to %dx%d",
+                width, height, displayWidth, displayHeight);
+    }
+
+    // A frame that is displayed at another size is rotated and scaled into
+    // the returned bitmap in one pass
     jobject jBitmap = env->CallStaticObjectMethod(
                             fields.bitmapClazz,
                             fields.createBitmapMethod,
-                            width,
-                            height,
+                            displayWidth,
+                            displayHeight,
                             config);
+    if (jBitmap == NULL) {  // OutOfMemoryError exception has already been thrown.
+        return NULL;
+    }
 
     SkBitmap *bitmap =
             (SkBitmap *) env->GetIntField(jBitmap, fields.nativeBitmap);
 
-    bitmap->lockPixels();
-    rotate((uint16_t*)bitmap->getPixels(),
-           (uint16_t*)((char*)videoFrame + sizeof(VideoFrame)),
-           videoFrame->mWidth,
-           videoFrame->mHeight,
-           videoFrame->mRotationAngle);
-    bitmap->unlockPixels();
-
-    if (videoFrame->mDisplayWidth  != videoFrame->mWidth ||
-        videoFrame->mDisplayHeight != videoFrame->mHeight) {
-        size_t displayWidth = videoFrame->mDisplayWidth;
-        size_t displayHeight = videoFrame->mDisplayHeight;
-        if (swapWidthAndHeight) {
-            displayWidth = videoFrame->mDisplayHeight;
-            displayHeight = videoFrame->mDisplayWidth;
-        }
-        ALOGV("Bitmap dimension is scaled from %dx%d to %dx%d",
-                width, height, displayWidth, displayHeight);
-        jobject scaledBitmap = env->CallStaticObjectMethod(fields.bitmapClazz,
-                                    fields.createScaledBitmapMethod,
-                                    jBitmap,
-                                    displayWidth,
-                                    displayHeight,
-                                    true);
-        return scaledBitmap;
+    uint16_t *src = (uint16_t*)((char*)videoFrame + sizeof(VideoFrame));
+    if (!scaled) {
+        bitmap->lockPixels();
+        rotate((uint16_t*)bitmap->getPixels(),
+               src,
+               videoFrame->mWidth,
+               videoFrame->mHeight,
+               videoFrame->mRotationAngle);
+        bitmap->unlockPixels();
+        return jBitmap;
+    }
+
+    SkBitmap frame;
+    frame.setConfig(SkBitmap::kRGB_565_Config, videoFrame->mWidth, videoFrame->mHeight);
+    frame.setPixels(src);
+
+    // Same orientation as rotate()
+    SkMatrix matrix;
+    matrix.setRotate(SkIntToScalar(videoFrame->mRotationAngle));
+    switch (videoFrame->mRotationAngle) {
+        case 90:
+            matrix.postTranslate(SkIntToScalar(videoFrame->mHeight), 0);
+            break;
+        case 180:
+            matrix.postTranslate(SkIntToScalar(videoFrame->mWidth),
+                    SkIntToScalar(videoFrame->mHeight));
+            break;
+        case 270:
+            matrix.postTranslate(0, SkIntToScalar(videoFrame->mWidth));
+            break;
     }
+    matrix.postScale(SkIntToScalar(displayWidth) / width,
+            SkIntToScalar(displayHeight) / height);
+
+    SkPaint paint;
+    paint.setFilterBitmap(true);
+
+    SkCanvas canvas(*bitmap);
+    canvas.drawBitmapMatrix(frame, matrix, &paint);
 
     return jBitmap;
 }
@@ -399,13 +444,6 @@ static void android_media_MediaMetadataRetriever_native_init(JNIEnv *env)
     if (fields.createBitmapMethod == NULL) {
         return;
     }
-    fields.createScaledBitmapMethod =
-            env->GetStaticMethodID(fields.bitmapClazz, "createScaledBitmap",
-                    "(Landroid/graphics/Bitmap;IIZ)"
-                    "Landroid/graphics/Bitmap;");
-    if (fields.createScaledBitmapMethod == NULL) {
-        return;
-    }
     fields.nativeBitmap = env->GetFieldID(fields.bitmapClazz, "mNativeBitmap", "I");
     if (fields.nativeBitmap == NULL) {
         return;
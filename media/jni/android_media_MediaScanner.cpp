@@ -17,7 +17,9 @@
 
 //#define LOG_NDEBUG 0
 #define LOG_TAG "MediaScannerJNI"
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
+#include <utils/String8.h>
 #include <utils/threads.h>
 #include <utils/Unicode.h>
 #include <media/mediascanner.h>
@@ -44,9 +46,34 @@ static const char* const kIllegalArgumentException =
 
 struct fields_t {
     jfieldID    context;
+    jmethodID   scanFileMethodID;
+    jmethodID   handleStringTagMethodID;
+    jmethodID   setMimeTypeMethodID;
 };
 static fields_t fields;
 
+// The scanner reports a small, fixed set of tag names for every file, so
+// their Java strings are created once.
+static const size_t kMaxTagNames = 64;
+static Mutex sTagNamesLock;
+static KeyedVector<String8, jstring> sTagNames;
+
+static jstring getTagName(JNIEnv* env, const char* name)
+{
+    Mutex::Autolock _l(sTagNamesLock);
+    String8 key(name);
+    ssize_t index = sTagNames.indexOfKey(key);
+    if (index >= 0) {
+        return (jstring) env->NewLocalRef(sTagNames.valueAt(index));
+    }
+
+    jstring nameStr = env->NewStringUTF(name);
+    if (nameStr != NULL && sTagNames.size() < kMaxTagNames) {
+        sTagNames.add(key, (jstring) env->NewGlobalRef(nameStr));
+    }
+    return nameStr;
+}
+
 static status_t checkAndClearExceptionFromCallback(JNIEnv* env, const char* methodName) {
     if (env->ExceptionCheck()) {
         ALOGE("An exception was thrown by callback '%s'.", methodName);
@@ -62,39 +89,14 @@ class MyMediaScannerClient : public MediaScannerClient
 public:
     MyMediaScannerClient(JNIEnv *env, jobject client)
         :   mEnv(env),
-            mClient(env->NewGlobalRef(client)),
-            mScanFileMethodID(0),
-            mHandleStringTagMethodID(0),
-            mSetMimeTypeMethodID(0)
+            mClient(client)
     {
         ALOGV("MyMediaScannerClient constructor");
-        jclass mediaScannerClientInterface =
-                env->FindClass(kClassMediaScannerClient);
-
-        if (mediaScannerClientInterface == NULL) {
-            ALOGE("Class %s not found", kClassMediaScannerClient);
-        } else {
-            mScanFileMethodID = env->GetMethodID(
-                                    mediaScannerClientInterface,
-                                    "scanFile",
-                                    "(Ljava/lang/String;JJZZ)V");
-
-            mHandleStringTagMethodID = env->GetMethodID(
-                                    mediaScannerClientInterface,
-                                    "handleStringTag",
-                                    "(Ljava/lang/String;Ljava/lang/String;)V");
-
-            mSetMimeTypeMethodID = env->GetMethodID(
-                                    mediaScannerClientInterface,
-                                    "setMimeType",
-                                    "(Ljava/lang/String;)V");
-        }
     }
 
     virtual ~MyMediaScannerClient()
     {
         ALOGV("MyMediaScannerClient destructor");
-        mEnv->DeleteGlobalRef(mClient);
     }
 
     virtual status_t scanFile(const char* path, long long lastModified,
@@ -109,7 +111,7 @@ public:
             return NO_MEMORY;
         }
 
-        mEnv->CallVoidMethod(mClient, mScanFileMethodID, pathStr, lastModified,
+        mEnv->CallVoidMethod(mClient, fields.scanFileMethodID, pathStr, lastModified,
                 fileSize, isDirectory, noMedia);
 
         mEnv->DeleteLocalRef(pathStr);
@@ -120,7 +122,7 @@ public:
     {
         ALOGV("handleStringTag: name(%s) and value(%s)", name, value);
         jstring nameStr, valueStr;
-        if ((nameStr = mEnv->NewStringUTF(name)) == NULL) {
+        if ((nameStr = getTagName(mEnv, name)) == NULL) {
             mEnv->ExceptionClear();
             return NO_MEMORY;
         }
@@ -149,7 +151,7 @@ public:
         }
 
         mEnv->CallVoidMethod(
-            mClient, mHandleStringTagMethodID, nameStr, valueStr);
+            mClient, fields.handleStringTagMethodID, nameStr, valueStr);
 
         mEnv->DeleteLocalRef(nameStr);
         mEnv->DeleteLocalRef(valueStr);
@@ -165,7 +167,7 @@ public:
             return NO_MEMORY;
         }
 
-        mEnv->CallVoidMethod(mClient, mSetMimeTypeMethodID, mimeTypeStr);
+        mEnv->CallVoidMethod(mClient, fields.setMimeTypeMethodID, mimeTypeStr);
 
         mEnv->DeleteLocalRef(mimeTypeStr);
         return checkAndClearExceptionFromCallback(mEnv, "setMimeType");
@@ -173,10 +175,8 @@ public:
 
 private:
     JNIEnv *mEnv;
+    // only used for the duration of the native call that created the client
     jobject mClient;
-    jmethodID mScanFileMethodID;
-    jmethodID mHandleStringTagMethodID;
-    jmethodID mSetMimeTypeMethodID;
 };
 
 
@@ -341,6 +341,19 @@ android_media_MediaScanner_native_init(JNIEnv *env)
     if (fields.context == NULL) {
         return;
     }
+
+    clazz = env->FindClass(kClassMediaScannerClient);
+    if (clazz == NULL) {
+        ALOGE("Class %s not found", kClassMediaScannerClient);
+        return;
+    }
+
+    fields.scanFileMethodID = env->GetMethodID(
+            clazz, "scanFile", "(Ljava/lang/String;JJZZ)V");
+    fields.handleStringTagMethodID = env->GetMethodID(
+            clazz, "handleStringTag", "(Ljava/lang/String;Ljava/lang/String;)V");
+    fields.setMimeTypeMethodID = env->GetMethodID(
+            clazz, "setMimeType", "(Ljava/lang/String;)V");
 }
 
 static void
@@ -26,6 +26,10 @@
 #include <fcntl.h>
 #include <utils/threads.h>
 
+#if defined(__ARM_HAVE_NEON)
+    #include <arm_neon.h>
+#endif
+
 #include "jni.h"
 #include "JNIHelp.h"
 #include "android_runtime/AndroidRuntime.h"
@@ -72,6 +76,38 @@ static const int nFir21 = sizeof(fir21) / sizeof(fir21[0]);
 
 static const int BUF_SIZE = 2048;
 
+#if defined(__ARM_HAVE_NEON)
+
+// Four taps per multiply-accumulate, the last tap is done on its own
+static inline int fir21Sample(const short* inp) {
+    int32x4_t acc = vdupq_n_s32(0);
+    int n = 0;
+    for (; n + 4 <= nFir21; n += 4) {
+        acc = vmlal_s16(acc, vld1_s16(&fir21[n]), vld1_s16(&inp[n]));
+    }
+    int32x2_t pair = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    int sum = vget_lane_s32(vpadd_s32(pair, pair), 0);
+    for (; n < nFir21; n++) {
+        sum += fir21[n] * inp[n];
+    }
+    return sum;
+}
+
+#else
+
+// The filter is symmetric, so each coefficient multiplies the sum of the two
+// samples it applies to
+static inline int fir21Sample(const short* inp) {
+    const int half = nFir21 / 2;
+    int sum = fir21[half] * inp[half];
+    for (int n = 0; n < half; n++) {
+        sum += fir21[n] * (inp[n] + inp[nFir21 - 1 - n]);
+    }
+    return sum;
+}
+
+#endif
+
 
 static void android_media_ResampleInputStream_fir21(JNIEnv *env, jclass clazz,
          jbyteArray jIn,  jint jInOffset,
@@ -92,13 +128,7 @@ static void android_media_ResampleInputStream_fir21(JNIEnv *env, jclass clazz,
     // compute filter
     short out[BUF_SIZE];
     for (int i = 0; i < jNpoints; i++) {
-        long sum = 0;
-        const short* firp = &fir21[0];
-        const short* inp = &in[i * 2];
-        for (int n = nFir21; --n >= 0; ) {
-            sum += ((long)*firp++) * ((long)*inp++);
-        }
-        out[i] = (short)(sum >> 16);
+        out[i] = (short)(fir21Sample(&in[i * 2]) >> 16);
     }
 
     // save new values
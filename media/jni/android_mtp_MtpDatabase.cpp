@@ -35,6 +35,8 @@
 #include "MtpUtils.h"
 #include "mtp.h"
 
+#include <utils/Vector.h>
+
 extern "C" {
 #include "jhead.h"
 }
@@ -81,6 +83,13 @@ MtpDatabase* getMtpDatabase(JNIEnv *env, jobject database) {
 
 // ----------------------------------------------------------------------------
 
+struct ObjectProperty {
+    MtpObjectProperty   code;
+    int                 type;
+    int64_t             longValue;
+    MtpString           stringValue;
+};
+
 class MyMtpDatabase : public MtpDatabase {
 private:
     jobject         mDatabase;
@@ -88,6 +97,15 @@ private:
     jlongArray      mLongBuffer;
     jcharArray      mStringBuffer;
 
+    // Properties of the object last read with getObjectPropertyValue().
+    // Handles start at 1, 0 means that nothing is cached.
+    MtpObjectHandle         mCachedHandle;
+    Vector<ObjectProperty>  mCachedProperties;
+
+    const ObjectProperty*   getCachedProperty(MtpObjectHandle handle,
+                                            MtpObjectProperty property);
+    void                    invalidateCachedProperties() { mCachedHandle = 0; }
+
 public:
                                     MyMtpDatabase(JNIEnv *env, jobject client);
     virtual                         ~MyMtpDatabase();
@@ -186,7 +204,8 @@ MyMtpDatabase::MyMtpDatabase(JNIEnv *env, jobject client)
     :   mDatabase(env->NewGlobalRef(client)),
         mIntBuffer(NULL),
         mLongBuffer(NULL),
-        mStringBuffer(NULL)
+        mStringBuffer(NULL),
+        mCachedHandle(0)
 {
     // create buffers for out arguments
     // we don't need to be thread-safe so this is OK
@@ -241,6 +260,7 @@ void MyMtpDatabase::endSendObject(const char* path, MtpObjectHandle handle,
     jstring pathStr = env->NewStringUTF(path);
     env->CallVoidMethod(mDatabase, method_endSendObject, pathStr,
                         (jint)handle, (jint)format, (jboolean)succeeded);
+    invalidateCachedProperties();
 
     if (pathStr)
         env->DeleteLocalRef(pathStr);
@@ -350,116 +370,171 @@ MtpDevicePropertyList* MyMtpDatabase::getSupportedDeviceProperties() {
     return list;
 }
 
-MtpResponseCode MyMtpDatabase::getObjectPropertyValue(MtpObjectHandle handle,
-                                            MtpObjectProperty property,
-                                            MtpDataPacket& packet) {
-    JNIEnv* env = AndroidRuntime::getJNIEnv();
-    jobject list = env->CallObjectMethod(mDatabase, method_getObjectPropertyList,
-                (jlong)handle, 0, (jlong)property, 0, 0);
+// Reads the properties of an MtpPropertyList into properties
+static MtpResponseCode readPropertyList(JNIEnv* env, jobject list,
+                                        Vector<ObjectProperty>& properties) {
     MtpResponseCode result = env->GetIntField(list, field_mResult);
     int count = env->GetIntField(list, field_mCount);
-    if (result == MTP_RESPONSE_OK && count != 1)
-        result = MTP_RESPONSE_GENERAL_ERROR;
+    if (result != MTP_RESPONSE_OK || count <= 0)
+        return result;
 
-    if (result == MTP_RESPONSE_OK) {
-        jintArray objectHandlesArray = (jintArray)env->GetObjectField(list, field_mObjectHandles);
-        jintArray propertyCodesArray = (jintArray)env->GetObjectField(list, field_mPropertyCodes);
-        jintArray dataTypesArray = (jintArray)env->GetObjectField(list, field_mDataTypes);
-        jlongArray longValuesArray = (jlongArray)env->GetObjectField(list, field_mLongValues);
-        jobjectArray stringValuesArray = (jobjectArray)env->GetObjectField(list, field_mStringValues);
+    jintArray propertyCodesArray = (jintArray)env->GetObjectField(list, field_mPropertyCodes);
+    jintArray dataTypesArray = (jintArray)env->GetObjectField(list, field_mDataTypes);
+    jlongArray longValuesArray = (jlongArray)env->GetObjectField(list, field_mLongValues);
+    jobjectArray stringValuesArray = (jobjectArray)env->GetObjectField(list, field_mStringValues);
+
+    jint* propertyCodes = env->GetIntArrayElements(propertyCodesArray, 0);
+    jint* dataTypes = env->GetIntArrayElements(dataTypesArray, 0);
+    jlong* longValues = (longValuesArray ? env->GetLongArrayElements(longValuesArray, 0) : NULL);
+
+    properties.setCapacity(properties.size() + count);
+    for (int i = 0; i < count; i++) {
+        ObjectProperty property;
+        property.code = propertyCodes[i];
+        property.type = dataTypes[i];
+        property.longValue = (longValues ? longValues[i] : 0);
+        if (property.type == MTP_TYPE_STR && stringValuesArray) {
+            jstring value = (jstring)env->GetObjectArrayElement(stringValuesArray, i);
+            const char *valueStr = (value ? env->GetStringUTFChars(value, NULL) : NULL);
+            if (valueStr) {
+                property.stringValue = valueStr;
+                env->ReleaseStringUTFChars(value, valueStr);
+            }
+            env->DeleteLocalRef(value);
+        }
+        properties.add(property);
+    }
 
-        jint* objectHandles = env->GetIntArrayElements(objectHandlesArray, 0);
-        jint* propertyCodes = env->GetIntArrayElements(propertyCodesArray, 0);
-        jint* dataTypes = env->GetIntArrayElements(dataTypesArray, 0);
-        jlong* longValues = (longValuesArray ? env->GetLongArrayElements(longValuesArray, 0) : NULL);
+    // the values are only read, there is nothing to copy back
+    env->ReleaseIntArrayElements(propertyCodesArray, propertyCodes, JNI_ABORT);
+    env->ReleaseIntArrayElements(dataTypesArray, dataTypes, JNI_ABORT);
+    if (longValues)
+        env->ReleaseLongArrayElements(longValuesArray, longValues, JNI_ABORT);
+
+    env->DeleteLocalRef(propertyCodesArray);
+    env->DeleteLocalRef(dataTypesArray);
+    if (longValuesArray)
+        env->DeleteLocalRef(longValuesArray);
+    if (stringValuesArray)
+        env->DeleteLocalRef(stringValuesArray);
+    return result;
+}
 
-        int type = dataTypes[0];
-        jlong longValue = (longValues ? longValues[0] : 0);
+static MtpResponseCode putPropertyValue(const ObjectProperty& property,
+                                        MtpDataPacket& packet) {
+    int64_t longValue = property.longValue;
+
+    // special case date properties, which are strings to MTP
+    // but stored internally as a uint64
+    if (property.code == MTP_PROPERTY_DATE_MODIFIED
+            || property.code == MTP_PROPERTY_DATE_ADDED) {
+        char    date[20];
+        formatDateTime(longValue, date, sizeof(date));
+        packet.putString(date);
+        return MTP_RESPONSE_OK;
+    }
+    // release date is stored internally as just the year
+    if (property.code == MTP_PROPERTY_ORIGINAL_RELEASE_DATE) {
+        char    date[20];
+        snprintf(date, sizeof(date), "%04lld0101T000000", longValue);
+        packet.putString(date);
+        return MTP_RESPONSE_OK;
+    }
 
-        // special case date properties, which are strings to MTP
-        // but stored internally as a uint64
-        if (property == MTP_PROPERTY_DATE_MODIFIED || property == MTP_PROPERTY_DATE_ADDED) {
-            char    date[20];
-            formatDateTime(longValue, date, sizeof(date));
-            packet.putString(date);
-            goto out;
-        }
-        // release date is stored internally as just the year
-        if (property == MTP_PROPERTY_ORIGINAL_RELEASE_DATE) {
-            char    date[20];
-            snprintf(date, sizeof(date), "%04lld0101T000000", longValue);
-            packet.putString(date);
-            goto out;
-        }
+    switch (property.type) {
+        case MTP_TYPE_INT8:
+            packet.putInt8(longValue);
+            break;
+        case MTP_TYPE_UINT8:
+            packet.putUInt8(longValue);
+            break;
+        case MTP_TYPE_INT16:
+            packet.putInt16(longValue);
+            break;
+        case MTP_TYPE_UINT16:
+            packet.putUInt16(longValue);
+            break;
+        case MTP_TYPE_INT32:
+            packet.putInt32(longValue);
+            break;
+        case MTP_TYPE_UINT32:
+            packet.putUInt32(longValue);
+            break;
+        case MTP_TYPE_INT64:
+            packet.putInt64(longValue);
+            break;
+        case MTP_TYPE_UINT64:
+            packet.putUInt64(longValue);
+            break;
+        case MTP_TYPE_INT128:
+            packet.putInt128(longValue);
+            break;
+        case MTP_TYPE_UINT128:
+            packet.putInt128(longValue);
+            break;
+        case MTP_TYPE_STR:
+            if (property.stringValue.length() > 0) {
+                packet.putString((const char *)property.stringValue);
+            } else {
+                packet.putEmptyString();
+            }
+            break;
+        default:
+            ALOGE("unsupported type in getObjectPropertyValue\n");
+            return MTP_RESPONSE_INVALID_OBJECT_PROP_FORMAT;
+    }
+    return MTP_RESPONSE_OK;
+}
 
-        switch (type) {
-            case MTP_TYPE_INT8:
-                packet.putInt8(longValue);
-                break;
-            case MTP_TYPE_UINT8:
-                packet.putUInt8(longValue);
-                break;
-            case MTP_TYPE_INT16:
-                packet.putInt16(longValue);
-                break;
-            case MTP_TYPE_UINT16:
-                packet.putUInt16(longValue);
-                break;
-            case MTP_TYPE_INT32:
-                packet.putInt32(longValue);
-                break;
-            case MTP_TYPE_UINT32:
-                packet.putUInt32(longValue);
-                break;
-            case MTP_TYPE_INT64:
-                packet.putInt64(longValue);
-                break;
-            case MTP_TYPE_UINT64:
-                packet.putUInt64(longValue);
-                break;
-            case MTP_TYPE_INT128:
-                packet.putInt128(longValue);
-                break;
-            case MTP_TYPE_UINT128:
-                packet.putInt128(longValue);
-                break;
-            case MTP_TYPE_STR:
-            {
-                jstring stringValue = (jstring)env->GetObjectArrayElement(stringValuesArray, 0);
-                if (stringValue) {
-                    const char* str = env->GetStringUTFChars(stringValue, NULL);
-                    if (str == NULL) {
-                        return MTP_RESPONSE_GENERAL_ERROR;
-                    }
-                    packet.putString(str);
-                    env->ReleaseStringUTFChars(stringValue, str);
-                } else {
-                    packet.putEmptyString();
-                }
-                break;
-             }
-            default:
-                ALOGE("unsupported type in getObjectPropertyValue\n");
-                result = MTP_RESPONSE_INVALID_OBJECT_PROP_FORMAT;
+// Hosts read the properties of an object one at a time, so the first read
+// fetches the file properties of the object with a single call into Java and
+// the following reads are served from them.
+const ObjectProperty* MyMtpDatabase::getCachedProperty(MtpObjectHandle handle,
+                                            MtpObjectProperty property) {
+    if (handle != mCachedHandle) {
+        mCachedHandle = handle;
+        mCachedProperties.clear();
+
+        JNIEnv* env = AndroidRuntime::getJNIEnv();
+        jobject list = env->CallObjectMethod(mDatabase, method_getObjectPropertyList,
+                    (jlong)handle, 0, (jlong)0xFFFFFFFF, 0, 0);
+        checkAndClearExceptionFromCallback(env, __FUNCTION__);
+        if (list) {
+            readPropertyList(env, list, mCachedProperties);
+            env->DeleteLocalRef(list);
         }
-out:
-        env->ReleaseIntArrayElements(objectHandlesArray, objectHandles, 0);
-        env->ReleaseIntArrayElements(propertyCodesArray, propertyCodes, 0);
-        env->ReleaseIntArrayElements(dataTypesArray, dataTypes, 0);
-        if (longValues)
-            env->ReleaseLongArrayElements(longValuesArray, longValues, 0);
+    }
 
-        env->DeleteLocalRef(objectHandlesArray);
-        env->DeleteLocalRef(propertyCodesArray);
-        env->DeleteLocalRef(dataTypesArray);
-        if (longValuesArray)
-            env->DeleteLocalRef(longValuesArray);
-        if (stringValuesArray)
-            env->DeleteLocalRef(stringValuesArray);
+    for (size_t i = 0; i < mCachedProperties.size(); i++) {
+        if (mCachedProperties[i].code == property)
+            return &mCachedProperties[i];
     }
+    return NULL;
+}
 
-    env->DeleteLocalRef(list);
+MtpResponseCode MyMtpDatabase::getObjectPropertyValue(MtpObjectHandle handle,
+                                            MtpObjectProperty property,
+                                            MtpDataPacket& packet) {
+    const ObjectProperty* cached = getCachedProperty(handle, property);
+    if (cached)
+        return putPropertyValue(*cached, packet);
+
+    // not a file property, ask for this one alone
+    JNIEnv* env = AndroidRuntime::getJNIEnv();
+    jobject list = env->CallObjectMethod(mDatabase, method_getObjectPropertyList,
+                (jlong)handle, 0, (jlong)property, 0, 0);
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
+    if (!list)
+        return MTP_RESPONSE_GENERAL_ERROR;
+
+    Vector<ObjectProperty> properties;
+    MtpResponseCode result = readPropertyList(env, list, properties);
+    env->DeleteLocalRef(list);
+    if (result == MTP_RESPONSE_OK && properties.size() != 1)
+        result = MTP_RESPONSE_GENERAL_ERROR;
+
+    if (result == MTP_RESPONSE_OK)
+        result = putPropertyValue(properties[0], packet);
     return result;
 }
 
@@ -514,6 +589,8 @@ MtpResponseCode MyMtpDatabase::setObjectPropertyValue(MtpObjectHandle handle,
 
     jint result = env->CallIntMethod(mDatabase, method_setObjectProperty,
                 (jint)handle, (jint)property, longValue, stringValue);
+    if (handle == mCachedHandle)
+        invalidateCachedProperties();
     if (stringValue)
         env->DeleteLocalRef(stringValue);
 
@@ -759,17 +836,17 @@ MtpResponseCode MyMtpDatabase::getObjectInfo(MtpObjectHandle handle,
     if (!result)
         return MTP_RESPONSE_INVALID_OBJECT_HANDLE;
 
-    jint* intValues = env->GetIntArrayElements(mIntBuffer, 0);
+    jint intValues[3];
+    env->GetIntArrayRegion(mIntBuffer, 0, 3, intValues);
     info.mStorageID = intValues[0];
     info.mFormat = intValues[1];
     info.mParent = intValues[2];
-    env->ReleaseIntArrayElements(mIntBuffer, intValues, 0);
 
-    jlong* longValues = env->GetLongArrayElements(mLongBuffer, 0);
+    jlong longValues[2];
+    env->GetLongArrayRegion(mLongBuffer, 0, 2, longValues);
     uint64_t size = longValues[0];
     info.mCompressedSize = (size > 0xFFFFFFFFLL ? 0xFFFFFFFF : size);
     info.mDateModified = longValues[1];
-    env->ReleaseLongArrayElements(mLongBuffer, longValues, 0);
 
 //    info.mAssociationType = (format == MTP_FORMAT_ASSOCIATION ?
 //                            MTP_ASSOCIATION_TYPE_GENERIC_FOLDER :
@@ -870,6 +947,8 @@ MtpResponseCode MyMtpDatabase::getObjectFilePath(MtpObjectHandle handle,
 MtpResponseCode MyMtpDatabase::deleteFile(MtpObjectHandle handle) {
     JNIEnv* env = AndroidRuntime::getJNIEnv();
     MtpResponseCode result = env->CallIntMethod(mDatabase, method_deleteFile, (jint)handle);
+    if (handle == mCachedHandle)
+        invalidateCachedProperties();
 
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
     return result;
@@ -1054,12 +1133,14 @@ MtpProperty* MyMtpDatabase::getDevicePropertyDesc(MtpDeviceProperty property) {
 }
 
 void MyMtpDatabase::sessionStarted() {
+    invalidateCachedProperties();
     JNIEnv* env = AndroidRuntime::getJNIEnv();
     env->CallVoidMethod(mDatabase, method_sessionStarted);
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
 }
 
 void MyMtpDatabase::sessionEnded() {
+    invalidateCachedProperties();
     JNIEnv* env = AndroidRuntime::getJNIEnv();
     env->CallVoidMethod(mDatabase, method_sessionEnded);
     checkAndClearExceptionFromCallback(env, __FUNCTION__);
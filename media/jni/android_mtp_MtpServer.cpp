@@ -56,6 +56,10 @@ static inline MtpServer* getMtpServer(JNIEnv *env, jobject thiz) {
     return (MtpServer*)env->GetIntField(thiz, field_MtpServer_nativeContext);
 }
 
+// Object data does not go through this process: MtpServer hands the file
+// descriptor to the driver with the MTP_SEND_FILE and MTP_RECEIVE_FILE
+// ioctls, and the driver moves the data between the file and the USB
+// endpoints itself.
 static void
 android_mtp_MtpServer_setup(JNIEnv *env, jobject thiz, jobject javaDatabase, jboolean usePtp)
 {
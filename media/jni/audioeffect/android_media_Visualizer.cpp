@@ -183,9 +183,7 @@ static void captureCallback(void* user,
         jArray = callbackInfo->waveform_data;
 
         if (jArray != NULL) {
-            jbyte *nArray = env->GetByteArrayElements(jArray, NULL);
-            memcpy(nArray, waveform, waveformSize);
-            env->ReleaseByteArrayElements(jArray, nArray, 0);
+            env->SetByteArrayRegion(jArray, 0, waveformSize, (jbyte *)waveform);
             env->CallStaticVoidMethod(
                 callbackInfo->visualizer_class,
                 fields.midPostNativeEvent,
@@ -204,9 +202,7 @@ static void captureCallback(void* user,
         jArray = callbackInfo->fft_data;
 
         if (jArray != NULL) {
-            jbyte *nArray = env->GetByteArrayElements(jArray, NULL);
-            memcpy(nArray, fft, fftSize);
-            env->ReleaseByteArrayElements(jArray, nArray, 0);
+            env->SetByteArrayRegion(jArray, 0, fftSize, (jbyte *)fft);
             env->CallStaticVoidMethod(
                 callbackInfo->visualizer_class,
                 fields.midPostNativeEvent,
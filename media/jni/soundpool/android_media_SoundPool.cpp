@@ -15,11 +15,14 @@
  */
 
 #include <stdio.h>
+#include <sys/stat.h>
 
 //#define LOG_NDEBUG 0
 #define LOG_TAG "SoundPool-JNI"
 
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
+#include <utils/threads.h>
 #include <nativehelper/jni.h>
 #include <nativehelper/JNIHelp.h>
 #include <android_runtime/AndroidRuntime.h>
@@ -33,8 +36,104 @@ static struct fields_t {
     jclass      mSoundPoolClass;
 } fields;
 
+// Identifies the data a sample is decoded from, so that loading the same
+// data again in a pool returns the sample that is already decoded.
+struct SampleKey {
+    dev_t dev;
+    ino_t ino;
+    int64_t offset;
+    int64_t length;
+
+    bool operator<(const SampleKey& rhs) const {
+        if (dev != rhs.dev) return dev < rhs.dev;
+        if (ino != rhs.ino) return ino < rhs.ino;
+        if (offset != rhs.offset) return offset < rhs.offset;
+        return length < rhs.length;
+    }
+};
+
+struct SampleEntry {
+    int sampleID;
+    // number of load() calls the sample was returned for
+    int refs;
+    // number of load() calls still waiting for the load complete event
+    int pendingEvents;
+    bool loaded;
+    int status;
+};
+
+struct SoundPoolContext {
+    SoundPool* pool;
+    jobject weakRef;
+    Mutex lock;
+    KeyedVector<SampleKey, SampleEntry> samples;
+};
+
+static inline SoundPoolContext* getSoundPoolContext(JNIEnv *env, jobject thiz) {
+    return (SoundPoolContext*)env->GetIntField(thiz, fields.mNativeContext);
+}
+
 static inline SoundPool* MusterSoundPool(JNIEnv *env, jobject thiz) {
-    return (SoundPool*)env->GetIntField(thiz, fields.mNativeContext);
+    SoundPoolContext* context = getSoundPoolContext(env, thiz);
+    return context != NULL ? context->pool : NULL;
+}
+
+static void postLoadComplete(JNIEnv *env, SoundPoolContext* context, int sampleID, int status)
+{
+    env->CallStaticVoidMethod(fields.mSoundPoolClass, fields.mPostEvent, context->weakRef,
+            SoundPoolEvent::SAMPLE_LOADED, sampleID, status, NULL);
+}
+
+// Returns the sample already decoded from the same data, or loads it
+static int loadSample(JNIEnv *env, SoundPoolContext* context, const struct stat& st,
+        int64_t offset, int64_t length, int fd, const char* path, int priority)
+{
+    SampleKey key;
+    key.dev = st.st_dev;
+    key.ino = st.st_ino;
+    key.offset = offset;
+    key.length = length;
+
+    bool loaded = false;
+    int sampleID = 0;
+    int status = 0;
+    {
+        AutoMutex _l(context->lock);
+        ssize_t index = context->samples.indexOfKey(key);
+        if (index >= 0) {
+            SampleEntry& entry(context->samples.editValueAt(index));
+            entry.refs++;
+            if (entry.loaded) {
+                loaded = true;
+                status = entry.status;
+            } else {
+                entry.pendingEvents++;
+            }
+            sampleID = entry.sampleID;
+        } else {
+            // The lock is held so that the load complete event, which may
+            // come from the decoder thread, finds the entry
+            sampleID = path != NULL ? context->pool->load(path, priority)
+                    : context->pool->load(fd, offset, length, priority);
+            if (sampleID > 0) {
+                SampleEntry entry;
+                entry.sampleID = sampleID;
+                entry.refs = 1;
+                entry.pendingEvents = 1;
+                entry.loaded = false;
+                entry.status = 0;
+                context->samples.add(key, entry);
+            }
+            return sampleID;
+        }
+    }
+
+    // The listener expects an event for every load
+    ALOGV("sample %d already loaded", sampleID);
+    if (loaded) {
+        postLoadComplete(env, context, sampleID, status);
+    }
+    return sampleID;
 }
 
 // ----------------------------------------------------------------------------
@@ -47,8 +146,15 @@ android_media_SoundPool_load_URL(JNIEnv *env, jobject thiz, jstring path, jint p
         jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
         return 0;
     }
+    SoundPoolContext* context = getSoundPoolContext(env, thiz);
     const char* s = env->GetStringUTFChars(path, NULL);
-    int id = ap->load(s, priority);
+    struct stat st;
+    int id;
+    if (stat(s, &st) == 0 && S_ISREG(st.st_mode)) {
+        id = loadSample(env, context, st, 0, st.st_size, -1, s, priority);
+    } else {
+        id = ap->load(s, priority);
+    }
     env->ReleaseStringUTFChars(path, s);
     return id;
 }
@@ -58,18 +164,36 @@ android_media_SoundPool_load_FD(JNIEnv *env, jobject thiz, jobject fileDescripto
         jlong offset, jlong length, jint priority)
 {
     ALOGV("android_media_SoundPool_load_FD");
-    SoundPool *ap = MusterSoundPool(env, thiz);
-    if (ap == NULL) return 0;
-    return ap->load(jniGetFDFromFileDescriptor(env, fileDescriptor),
-            int64_t(offset), int64_t(length), int(priority));
+    SoundPoolContext* context = getSoundPoolContext(env, thiz);
+    if (context == NULL) return 0;
+    int fd = jniGetFDFromFileDescriptor(env, fileDescriptor);
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        return loadSample(env, context, st, int64_t(offset), int64_t(length), fd, NULL,
+                int(priority));
+    }
+    return context->pool->load(fd, int64_t(offset), int64_t(length), int(priority));
 }
 
 static bool
 android_media_SoundPool_unload(JNIEnv *env, jobject thiz, jint sampleID) {
     ALOGV("android_media_SoundPool_unload\n");
-    SoundPool *ap = MusterSoundPool(env, thiz);
-    if (ap == NULL) return 0;
-    return ap->unload(sampleID);
+    SoundPoolContext* context = getSoundPoolContext(env, thiz);
+    if (context == NULL) return 0;
+
+    AutoMutex _l(context->lock);
+    for (size_t i = 0; i < context->samples.size(); i++) {
+        SampleEntry& entry(context->samples.editValueAt(i));
+        if (entry.sampleID == sampleID) {
+            // Other loads of the same data still use the sample
+            if (--entry.refs > 0) {
+                return true;
+            }
+            context->samples.removeItemsAt(i);
+            break;
+        }
+    }
+    return context->pool->unload(sampleID);
 }
 
 static int
@@ -171,8 +295,27 @@ android_media_SoundPool_setRate(JNIEnv *env, jobject thiz, jint channelID,
 static void android_media_callback(SoundPoolEvent event, SoundPool* soundPool, void* user)
 {
     ALOGV("callback: (%d, %d, %d, %p, %p)", event.mMsg, event.mArg1, event.mArg2, soundPool, user);
+    SoundPoolContext* context = (SoundPoolContext*) user;
     JNIEnv *env = AndroidRuntime::getJNIEnv();
-    env->CallStaticVoidMethod(fields.mSoundPoolClass, fields.mPostEvent, user, event.mMsg, event.mArg1, event.mArg2, NULL);
+
+    int count = 1;
+    if (event.mMsg == SoundPoolEvent::SAMPLE_LOADED) {
+        AutoMutex _l(context->lock);
+        for (size_t i = 0; i < context->samples.size(); i++) {
+            SampleEntry& entry(context->samples.editValueAt(i));
+            if (entry.sampleID == event.mArg1) {
+                entry.loaded = true;
+                entry.status = event.mArg2;
+                count = entry.pendingEvents;
+                entry.pendingEvents = 0;
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        env->CallStaticVoidMethod(fields.mSoundPoolClass, fields.mPostEvent, context->weakRef,
+                event.mMsg, event.mArg1, event.mArg2, NULL);
+    }
 }
 
 static jint
@@ -184,12 +327,15 @@ android_media_SoundPool_native_setup(JNIEnv *env, jobject thiz, jobject weakRef,
         return -1;
     }
 
-    // save pointer to SoundPool C++ object in opaque field in Java object
-    env->SetIntField(thiz, fields.mNativeContext, (int)ap);
+    SoundPoolContext* context = new SoundPoolContext();
+    context->pool = ap;
+    context->weakRef = env->NewGlobalRef(weakRef);
+
+    // save pointer to the context in opaque field in Java object
+    env->SetIntField(thiz, fields.mNativeContext, (int)context);
 
     // set callback with weak reference
-    jobject globalWeakRef = env->NewGlobalRef(weakRef);
-    ap->setCallback(android_media_callback, globalWeakRef);
+    ap->setCallback(android_media_callback, context);
     return 0;
 }
 
@@ -197,19 +343,19 @@ static void
 android_media_SoundPool_release(JNIEnv *env, jobject thiz)
 {
     ALOGV("android_media_SoundPool_release");
-    SoundPool *ap = MusterSoundPool(env, thiz);
-    if (ap != NULL) {
-
-        // release weak reference
-        jobject weakRef = (jobject) ap->getUserData();
-        if (weakRef != NULL) {
-            env->DeleteGlobalRef(weakRef);
-        }
+    SoundPoolContext* context = getSoundPoolContext(env, thiz);
+    if (context != NULL) {
 
         // clear callback and native context
-        ap->setCallback(NULL, NULL);
+        context->pool->setCallback(NULL, NULL);
         env->SetIntField(thiz, fields.mNativeContext, 0);
-        delete ap;
+        delete context->pool;
+
+        // release weak reference
+        if (context->weakRef != NULL) {
+            env->DeleteGlobalRef(context->weakRef);
+        }
+        delete context;
     }
 }
 
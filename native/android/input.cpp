@@ -284,6 +284,10 @@ int32_t AInputQueue_getEvent(AInputQueue* queue, AInputEvent** outEvent) {
     return queue->getEvent(outEvent);
 }
 
+size_t AInputQueue_getEvents(AInputQueue* queue, AInputEvent** outEvents, size_t maxEvents) {
+    return queue->getEvents(outEvents, maxEvents);
+}
+
 int32_t AInputQueue_preDispatchEvent(AInputQueue* queue, AInputEvent* event) {
     return queue->preDispatchEvent(event) ? 1 : 0;
 }
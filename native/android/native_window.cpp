@@ -74,6 +74,12 @@ int32_t ANativeWindow_setBuffersGeometry(ANativeWindow* window, int32_t width,
     return err;
 }
 
+/*
+ * Surface::lock() copies the pixels outside of the dirty bounds from the
+ * previously posted buffer, and grows the bounds to the area of the new buffer
+ * whose content it could not restore. On return, only the pixels inside
+ * inOutDirtyBounds need to be redrawn.
+ */
 int32_t ANativeWindow_lock(ANativeWindow* window, ANativeWindow_Buffer* outBuffer,
         ARect* inOutDirtyBounds) {
     return window->perform(window, NATIVE_WINDOW_LOCK, outBuffer, inOutDirtyBounds);
@@ -120,6 +120,11 @@ int ASensorEventQueue_hasEvents(ASensorEventQueue* queue)
     return (nfd == 0) ? 0 : 1;
 }
 
+/*
+ * SensorEventQueue::read() receives as many events as fit in the array with a
+ * single recvmsg() on the BitTube, so callers should pass an array large enough
+ * to drain the queue in one call rather than reading events one at a time.
+ */
 ssize_t ASensorEventQueue_getEvents(ASensorEventQueue* queue,
                 ASensorEvent* events, size_t count)
 {
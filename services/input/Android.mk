@@ -18,6 +18,7 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= \
     EventHub.cpp \
+    EventRecording.cpp \
     InputApplication.cpp \
     InputDispatcher.cpp \
     InputListener.cpp \
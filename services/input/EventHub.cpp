@@ -19,9 +19,11 @@
 // #define LOG_NDEBUG 0
 
 #include "EventHub.h"
+#include "EventRecording.h"
 
 #include <hardware_legacy/power.h>
 
+#include <cutils/atomic.h>
 #include <cutils/properties.h>
 #include <utils/Log.h>
 #include <utils/Timers.h>
@@ -198,7 +200,8 @@ EventHub::EventHub(void) :
         mOpeningDevices(0), mClosingDevices(0),
         mNeedToSendFinishedDeviceScan(false),
         mNeedToReopenDevices(false), mNeedToScanDevices(true),
-        mPendingEventCount(0), mPendingEventIndex(0), mPendingINotify(false) {
+        mPendingEventCount(0), mPendingEventIndex(0), mPendingINotify(false),
+        mReadBuffer(NULL), mReadBufferSize(0), mRecorder(NULL) {
     acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_ID);
 
     mEpollFd = epoll_create(EPOLL_SIZE_HINT);
@@ -235,6 +238,17 @@ EventHub::EventHub(void) :
     result = epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeReadPipeFd, &eventItem);
     LOG_ALWAYS_FATAL_IF(result != 0, "Could not add wake read pipe to epoll instance.  errno=%d",
             errno);
+
+    char recordPath[PROPERTY_VALUE_MAX];
+    if (property_get("input.eventhub.record", recordPath, NULL) > 0) {
+        mRecorder = new EventRecorder();
+        if (mRecorder->open(recordPath)) {
+            delete mRecorder;
+            mRecorder = NULL;
+        } else {
+            ALOGI("Recording raw input events to '%s'.", recordPath);
+        }
+    }
 }
 
 EventHub::~EventHub(void) {
@@ -251,6 +265,9 @@ EventHub::~EventHub(void) {
     ::close(mWakeReadPipeFd);
     ::close(mWakeWritePipeFd);
 
+    free(mReadBuffer);
+    delete mRecorder;
+
     release_wake_lock(WAKE_LOCK_ID);
 }
 
@@ -286,24 +303,32 @@ status_t EventHub::getAbsoluteAxisInfo(int32_t deviceId, int axis,
         AutoMutex _l(mLock);
 
         Device* device = getDeviceLocked(deviceId);
-        if (device && !device->isVirtual() && test_bit(axis, device->absBitmask)) {
-            struct input_absinfo info;
-            if(ioctl(device->fd, EVIOCGABS(axis), &info)) {
-                ALOGW("Error reading absolute controller %d for device %s fd %d, errno=%d",
-                     axis, device->identifier.name.string(), device->fd, errno);
-                return -errno;
-            }
+        if (device) {
+            return getAbsoluteAxisInfoLocked(device, axis, outAxisInfo);
+        }
+    }
+    return -1;
+}
 
-            if (info.minimum != info.maximum) {
-                outAxisInfo->valid = true;
-                outAxisInfo->minValue = info.minimum;
-                outAxisInfo->maxValue = info.maximum;
-                outAxisInfo->flat = info.flat;
-                outAxisInfo->fuzz = info.fuzz;
-                outAxisInfo->resolution = info.resolution;
-            }
-            return OK;
+status_t EventHub::getAbsoluteAxisInfoLocked(Device* device, int axis,
+        RawAbsoluteAxisInfo* outAxisInfo) const {
+    if (!device->isVirtual() && test_bit(axis, device->absBitmask)) {
+        struct input_absinfo info;
+        if(ioctl(device->fd, EVIOCGABS(axis), &info)) {
+            ALOGW("Error reading absolute controller %d for device %s fd %d, errno=%d",
+                 axis, device->identifier.name.string(), device->fd, errno);
+            return -errno;
+        }
+
+        if (info.minimum != info.maximum) {
+            outAxisInfo->valid = true;
+            outAxisInfo->minValue = info.minimum;
+            outAxisInfo->maxValue = info.maximum;
+            outAxisInfo->flat = info.flat;
+            outAxisInfo->fuzz = info.fuzz;
+            outAxisInfo->resolution = info.resolution;
         }
+        return OK;
     }
     return -1;
 }
@@ -444,21 +469,30 @@ status_t EventHub::mapKey(int32_t deviceId, int32_t scanCode, int32_t usageCode,
     Device* device = getDeviceLocked(deviceId);
 
     if (device) {
-        // Check the key character map first.
-        sp<KeyCharacterMap> kcm = device->getKeyCharacterMap();
-        if (kcm != NULL) {
-            if (!kcm->mapKey(scanCode, usageCode, outKeycode)) {
-                *outFlags = 0;
-                return NO_ERROR;
-            }
+        return mapKeyLocked(device, scanCode, usageCode, outKeycode, outFlags);
+    }
+
+    *outKeycode = 0;
+    *outFlags = 0;
+    return NAME_NOT_FOUND;
+}
+
+status_t EventHub::mapKeyLocked(Device* device, int32_t scanCode, int32_t usageCode,
+        int32_t* outKeycode, uint32_t* outFlags) const {
+    // Check the key character map first.
+    sp<KeyCharacterMap> kcm = device->getKeyCharacterMap();
+    if (kcm != NULL) {
+        if (!kcm->mapKey(scanCode, usageCode, outKeycode)) {
+            *outFlags = 0;
+            return NO_ERROR;
         }
+    }
 
-        // Check the key layout next.
-        if (device->keyMap.haveKeyLayout()) {
-            if (!device->keyMap.keyLayoutMap->mapKey(
-                    scanCode, usageCode, outKeycode, outFlags)) {
-                return NO_ERROR;
-            }
+    // Check the key layout next.
+    if (device->keyMap.haveKeyLayout()) {
+        if (!device->keyMap.keyLayoutMap->mapKey(
+                scanCode, usageCode, outKeycode, outFlags)) {
+            return NO_ERROR;
         }
     }
 
@@ -641,7 +675,21 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
 
     AutoMutex _l(mLock);
 
-    struct input_event readBuffer[bufferSize];
+    if (mReadBufferSize < bufferSize) {
+        struct input_event* readBuffer = static_cast<struct input_event*>(
+                realloc(mReadBuffer, sizeof(struct input_event) * bufferSize));
+        if (readBuffer) {
+            mReadBuffer = readBuffer;
+            mReadBufferSize = bufferSize;
+        } else if (!mReadBuffer) {
+            ALOGE("Could not allocate input event read buffer.");
+            return 0;
+        }
+    }
+    struct input_event* readBuffer = mReadBuffer;
+    if (bufferSize > mReadBufferSize) {
+        bufferSize = mReadBufferSize;
+    }
 
     RawEvent* event = buffer;
     size_t capacity = bufferSize;
@@ -746,6 +794,8 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
 
             Device* device = mDevices.valueAt(deviceIndex);
             if (eventItem.events & EPOLLIN) {
+                // Drain as much of the device as the remaining capacity allows so that
+                // bursts are handled in a single pass over the ready descriptors.
                 int32_t readSize = read(device->fd, readBuffer,
                         sizeof(struct input_event) * capacity);
                 if (readSize == 0 || (readSize < 0 && errno == ENODEV)) {
@@ -877,10 +927,78 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
         }
     }
 
+    if (mRecorder && event != buffer) {
+        recordEventsLocked(buffer, event - buffer);
+    }
+
     // All done, return the number of events we read.
     return event - buffer;
 }
 
+void EventHub::recordEventsLocked(const RawEvent* events, size_t count) {
+    // Describe newly added devices ahead of the events that announce them, so that
+    // a replay can present the same devices to the reader.
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].type != DEVICE_ADDED) {
+            continue;
+        }
+        Device* device = getDeviceLocked(events[i].deviceId);
+        if (device) {
+            RecordedDevice recordedDevice;
+            recordedDevice.id = events[i].deviceId;
+            describeDeviceLocked(device, &recordedDevice);
+            mRecorder->writeDevice(recordedDevice);
+        }
+    }
+
+    mRecorder->writeEvents(events, count);
+
+    if (!mRecorder->isOpen()) {
+        delete mRecorder;
+        mRecorder = NULL;
+    }
+}
+
+void EventHub::describeDeviceLocked(Device* device, RecordedDevice* outDevice) const {
+    outDevice->classes = device->classes;
+    outDevice->identifier = device->identifier;
+
+    if (device->configuration) {
+        outDevice->configuration = device->configuration->getProperties();
+    }
+
+    for (int axis = 0; axis <= ABS_MAX; axis++) {
+        RawAbsoluteAxisInfo info;
+        info.clear();
+        if (!getAbsoluteAxisInfoLocked(device, axis, &info) && info.valid) {
+            outDevice->absoluteAxes.add(axis, info);
+        }
+    }
+
+    for (int axis = 0; axis <= REL_MAX; axis++) {
+        if (test_bit(axis, device->relBitmask)) {
+            outDevice->relativeAxes.push(axis);
+        }
+    }
+
+    for (int property = 0; property <= INPUT_PROP_MAX; property++) {
+        if (test_bit(property, device->propBitmask)) {
+            outDevice->inputProperties.push(property);
+        }
+    }
+
+    for (int32_t scanCode = 0; scanCode <= KEY_MAX; scanCode++) {
+        if (test_bit(scanCode, device->keyBitmask)) {
+            RecordedKey key;
+            if (mapKeyLocked(device, scanCode, 0, &key.keyCode, &key.flags)) {
+                key.keyCode = AKEYCODE_UNKNOWN;
+                key.flags = 0;
+            }
+            outDevice->keys.add(scanCode, key);
+        }
+    }
+}
+
 void EventHub::wake() {
     ALOGV("wake() called");
 
@@ -1401,6 +1519,76 @@ status_t EventHub::readNotifyLocked() {
     return 0;
 }
 
+// ----------------------------------------------------------------------------
+
+// Maximum number of threads used to prefetch device configuration during a scan.
+static const int MAX_PREFETCH_THREADS = 4;
+
+// Parses the configuration, key layout and key character map files of a device ahead of
+// time so that the key map cache is warm when the device is opened.  Opening devices
+// still happens one at a time so that device ids and the built-in keyboard are assigned
+// exactly as before.
+static void prefetchDeviceConfiguration(const char* devicePath) {
+    int fd = open(devicePath, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0) {
+        return;
+    }
+
+    InputDeviceIdentifier identifier;
+    char buffer[80];
+    if (ioctl(fd, EVIOCGNAME(sizeof(buffer) - 1), &buffer) >= 1) {
+        buffer[sizeof(buffer) - 1] = '\0';
+        identifier.name.setTo(buffer);
+    }
+
+    struct input_id inputId;
+    uint8_t evBitmask[sizeof_bit_array(EV_MAX + 1)];
+    memset(evBitmask, 0, sizeof(evBitmask));
+    bool ok = !ioctl(fd, EVIOCGID, &inputId)
+            && ioctl(fd, EVIOCGBIT(0, sizeof(evBitmask)), evBitmask) >= 0;
+    close(fd);
+    if (!ok || !test_bit(EV_KEY, evBitmask)) {
+        return;
+    }
+    identifier.bus = inputId.bustype;
+    identifier.product = inputId.product;
+    identifier.vendor = inputId.vendor;
+    identifier.version = inputId.version;
+
+    PropertyMap* configuration = NULL;
+    String8 configurationFile = getInputDeviceConfigurationFilePathByDeviceIdentifier(
+            identifier, INPUT_DEVICE_CONFIGURATION_FILE_TYPE_CONFIGURATION);
+    if (!configurationFile.isEmpty()) {
+        PropertyMap::load(configurationFile, &configuration);
+    }
+
+    KeyMap keyMap;
+    keyMap.load(identifier, configuration);
+    delete configuration;
+}
+
+class DeviceConfigurationPrefetcher : public Thread {
+public:
+    DeviceConfigurationPrefetcher(const Vector<String8>& devicePaths,
+            volatile int32_t* nextIndex) :
+            Thread(/*canCallJava*/ false),
+            mDevicePaths(devicePaths), mNextIndex(nextIndex) {
+    }
+
+private:
+    const Vector<String8>& mDevicePaths;
+    volatile int32_t* mNextIndex;
+
+    virtual bool threadLoop() {
+        size_t index = size_t(android_atomic_inc(mNextIndex));
+        if (index >= mDevicePaths.size()) {
+            return false;
+        }
+        prefetchDeviceConfiguration(mDevicePaths[index].string());
+        return true;
+    }
+};
+
 status_t EventHub::scanDirLocked(const char *dirname)
 {
     char devname[PATH_MAX];
@@ -1413,15 +1601,42 @@ status_t EventHub::scanDirLocked(const char *dirname)
     strcpy(devname, dirname);
     filename = devname + strlen(devname);
     *filename++ = '/';
+    Vector<String8> devicePaths;
     while((de = readdir(dir))) {
         if(de->d_name[0] == '.' &&
            (de->d_name[1] == '\0' ||
             (de->d_name[1] == '.' && de->d_name[2] == '\0')))
             continue;
         strcpy(filename, de->d_name);
-        openDeviceLocked(devname);
+        devicePaths.push(String8(devname));
     }
     closedir(dir);
+
+    // Optionally parse the configuration files of all devices in parallel first.
+    char value[PROPERTY_VALUE_MAX];
+    property_get("input.eventhub.prefetch", value, "0");
+    int threadCount = atoi(value);
+    if (threadCount > MAX_PREFETCH_THREADS) {
+        threadCount = MAX_PREFETCH_THREADS;
+    }
+    if (threadCount > 0 && devicePaths.size() > 1) {
+        volatile int32_t nextIndex = 0;
+        Vector<sp<Thread> > threads;
+        for (int i = 0; i < threadCount; i++) {
+            sp<Thread> thread = new DeviceConfigurationPrefetcher(devicePaths, &nextIndex);
+            if (thread->run("InputDevicePrefetch", PRIORITY_URGENT_DISPLAY)) {
+                break;
+            }
+            threads.push(thread);
+        }
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i]->join();
+        }
+    }
+
+    for (size_t i = 0; i < devicePaths.size(); i++) {
+        openDeviceLocked(devicePaths[i].string());
+    }
     return 0;
 }
 
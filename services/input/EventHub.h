@@ -240,6 +240,9 @@ public:
     virtual void monitor() = 0;
 };
 
+class EventRecorder;
+struct RecordedDevice;
+
 class EventHub : public EventHubInterface
 {
 public:
@@ -367,6 +370,14 @@ private:
 
     bool isExternalDeviceLocked(Device* device);
 
+    status_t getAbsoluteAxisInfoLocked(Device* device, int axis,
+            RawAbsoluteAxisInfo* outAxisInfo) const;
+    status_t mapKeyLocked(Device* device, int32_t scanCode, int32_t usageCode,
+            int32_t* outKeycode, uint32_t* outFlags) const;
+
+    void recordEventsLocked(const RawEvent* events, size_t count);
+    void describeDeviceLocked(Device* device, RecordedDevice* outDevice) const;
+
     // Protect all internal state.
     mutable Mutex mLock;
 
@@ -404,13 +415,22 @@ private:
     static const int EPOLL_SIZE_HINT = 8;
 
     // Maximum number of signalled FDs to handle at a time.
-    static const int EPOLL_MAX_EVENTS = 16;
+    static const int EPOLL_MAX_EVENTS = 32;
 
     // The array of pending epoll events and the index of the next event to be handled.
     struct epoll_event mPendingEventItems[EPOLL_MAX_EVENTS];
     size_t mPendingEventCount;
     size_t mPendingEventIndex;
     bool mPendingINotify;
+
+    // Buffer used to read raw input events from the devices, grown to match the size
+    // of the caller's event buffer.
+    struct input_event* mReadBuffer;
+    size_t mReadBufferSize;
+
+    // Records the events returned by getEvents() when the "input.eventhub.record"
+    // property names a file, or NULL when recording is disabled.
+    EventRecorder* mRecorder;
 };
 
 }; // namespace android
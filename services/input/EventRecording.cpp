@@ -0,0 +1,454 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "EventRecording"
+
+//#define LOG_NDEBUG 0
+
+#include "EventRecording.h"
+
+#include <utils/Log.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace android {
+
+static const uint32_t RECORDING_MAGIC = 0x56455249; // "IREV"
+static const uint32_t RECORDING_VERSION = 1;
+
+enum {
+    RECORD_TAG_DEVICE = 1,
+    RECORD_TAG_EVENTS = 2,
+};
+
+// Size of one serialized RawEvent.
+static const size_t RECORDED_EVENT_SIZE = sizeof(int64_t) + 4 * sizeof(int32_t);
+
+// Upper bound on the size of a single record, to reject corrupt files early.
+static const uint32_t MAX_RECORD_SIZE = 16 * 1024 * 1024;
+
+static status_t writeFully(int fd, const void* data, size_t size) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while (size) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        p += n;
+        size -= n;
+    }
+    return OK;
+}
+
+
+// --- EventRecorder ---
+
+EventRecorder::EventRecorder() :
+        mFd(-1) {
+}
+
+EventRecorder::~EventRecorder() {
+    close();
+}
+
+status_t EventRecorder::open(const char* path) {
+    close();
+
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        ALOGE("Could not create event recording '%s', errno=%d", path, errno);
+        return -errno;
+    }
+
+    uint32_t header[2] = { RECORDING_MAGIC, RECORDING_VERSION };
+    status_t status = writeFully(fd, header, sizeof(header));
+    if (status) {
+        ALOGE("Could not write event recording header to '%s', status=%d", path, status);
+        ::close(fd);
+        return status;
+    }
+
+    mFd = fd;
+    return OK;
+}
+
+void EventRecorder::close() {
+    if (mFd >= 0) {
+        ::close(mFd);
+        mFd = -1;
+    }
+}
+
+status_t EventRecorder::writeDevice(const RecordedDevice& device) {
+    if (mFd < 0) {
+        return INVALID_OPERATION;
+    }
+
+    writeInt32(device.id);
+    writeUint32(device.classes);
+
+    writeString(device.identifier.name);
+    writeString(device.identifier.location);
+    writeString(device.identifier.uniqueId);
+    writeString(device.identifier.descriptor);
+    writeUint32(device.identifier.bus);
+    writeUint32(device.identifier.vendor);
+    writeUint32(device.identifier.product);
+    writeUint32(device.identifier.version);
+
+    writeUint32(device.configuration.size());
+    for (size_t i = 0; i < device.configuration.size(); i++) {
+        writeString(device.configuration.keyAt(i));
+        writeString(device.configuration.valueAt(i));
+    }
+
+    writeUint32(device.absoluteAxes.size());
+    for (size_t i = 0; i < device.absoluteAxes.size(); i++) {
+        const RawAbsoluteAxisInfo& info = device.absoluteAxes.valueAt(i);
+        writeInt32(device.absoluteAxes.keyAt(i));
+        writeInt32(info.minValue);
+        writeInt32(info.maxValue);
+        writeInt32(info.flat);
+        writeInt32(info.fuzz);
+        writeInt32(info.resolution);
+    }
+
+    writeUint32(device.relativeAxes.size());
+    for (size_t i = 0; i < device.relativeAxes.size(); i++) {
+        writeInt32(device.relativeAxes.itemAt(i));
+    }
+
+    writeUint32(device.inputProperties.size());
+    for (size_t i = 0; i < device.inputProperties.size(); i++) {
+        writeInt32(device.inputProperties.itemAt(i));
+    }
+
+    writeUint32(device.keys.size());
+    for (size_t i = 0; i < device.keys.size(); i++) {
+        const RecordedKey& key = device.keys.valueAt(i);
+        writeInt32(device.keys.keyAt(i));
+        writeInt32(key.keyCode);
+        writeUint32(key.flags);
+    }
+
+    return flushRecord(RECORD_TAG_DEVICE);
+}
+
+status_t EventRecorder::writeEvents(const RawEvent* events, size_t count) {
+    if (mFd < 0) {
+        return INVALID_OPERATION;
+    }
+
+    writeUint32(count);
+    for (size_t i = 0; i < count; i++) {
+        const RawEvent& event = events[i];
+        writeInt64(event.when);
+        writeInt32(event.deviceId);
+        writeInt32(event.type);
+        writeInt32(event.code);
+        writeInt32(event.value);
+    }
+    return flushRecord(RECORD_TAG_EVENTS);
+}
+
+void EventRecorder::writeUint32(uint32_t value) {
+    mBuffer.appendArray(reinterpret_cast<const uint8_t*>(&value), sizeof(value));
+}
+
+void EventRecorder::writeInt32(int32_t value) {
+    mBuffer.appendArray(reinterpret_cast<const uint8_t*>(&value), sizeof(value));
+}
+
+void EventRecorder::writeInt64(int64_t value) {
+    mBuffer.appendArray(reinterpret_cast<const uint8_t*>(&value), sizeof(value));
+}
+
+void EventRecorder::writeString(const String8& value) {
+    writeUint32(value.length());
+    mBuffer.appendArray(reinterpret_cast<const uint8_t*>(value.string()), value.length());
+}
+
+status_t EventRecorder::flushRecord(uint32_t tag) {
+    uint32_t header[2] = { tag, uint32_t(mBuffer.size()) };
+    status_t status = writeFully(mFd, header, sizeof(header));
+    if (!status) {
+        status = writeFully(mFd, mBuffer.array(), mBuffer.size());
+    }
+    mBuffer.clear();
+
+    if (status) {
+        // A partially written record cannot be recovered, so stop recording.
+        ALOGE("Could not write event recording, status=%d", status);
+        close();
+    }
+    return status;
+}
+
+
+// --- EventRecording::Parser ---
+
+class EventRecording::Parser {
+public:
+    Parser(const uint8_t* data, size_t size) :
+            mData(data), mSize(size), mOffset(0), mError(false) {
+    }
+
+    inline bool hasError() const { return mError; }
+    inline bool atEnd() const { return mOffset == mSize; }
+
+    uint32_t readUint32() {
+        uint32_t value = 0;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    int32_t readInt32() {
+        int32_t value = 0;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    int64_t readInt64() {
+        int64_t value = 0;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    String8 readString() {
+        uint32_t length = readUint32();
+        if (!check(length)) {
+            return String8();
+        }
+        String8 value(reinterpret_cast<const char*>(mData + mOffset), length);
+        mOffset += length;
+        return value;
+    }
+
+    // Returns the number of elements of the given size that follow, or 0 if the
+    // count exceeds the remaining data.
+    uint32_t readCount(size_t elementSize) {
+        uint32_t count = readUint32();
+        if (count > (mSize - mOffset) / elementSize) {
+            mError = true;
+            return 0;
+        }
+        return count;
+    }
+
+    void skip(size_t size) {
+        if (check(size)) {
+            mOffset += size;
+        }
+    }
+
+    void readDevice(RecordedDevice* device) {
+        device->id = readInt32();
+        device->classes = readUint32();
+
+        device->identifier.name = readString();
+        device->identifier.location = readString();
+        device->identifier.uniqueId = readString();
+        device->identifier.descriptor = readString();
+        device->identifier.bus = readUint32();
+        device->identifier.vendor = readUint32();
+        device->identifier.product = readUint32();
+        device->identifier.version = readUint32();
+
+        uint32_t count = readCount(2 * sizeof(uint32_t));
+        for (uint32_t i = 0; i < count && !mError; i++) {
+            String8 key = readString();
+            String8 value = readString();
+            device->configuration.add(key, value);
+        }
+
+        count = readCount(6 * sizeof(int32_t));
+        for (uint32_t i = 0; i < count && !mError; i++) {
+            int32_t axis = readInt32();
+            RawAbsoluteAxisInfo info;
+            info.valid = true;
+            info.minValue = readInt32();
+            info.maxValue = readInt32();
+            info.flat = readInt32();
+            info.fuzz = readInt32();
+            info.resolution = readInt32();
+            device->absoluteAxes.add(axis, info);
+        }
+
+        count = readCount(sizeof(int32_t));
+        for (uint32_t i = 0; i < count && !mError; i++) {
+            device->relativeAxes.push(readInt32());
+        }
+
+        count = readCount(sizeof(int32_t));
+        for (uint32_t i = 0; i < count && !mError; i++) {
+            device->inputProperties.push(readInt32());
+        }
+
+        count = readCount(3 * sizeof(int32_t));
+        for (uint32_t i = 0; i < count && !mError; i++) {
+            int32_t scanCode = readInt32();
+            RecordedKey key;
+            key.keyCode = readInt32();
+            key.flags = readUint32();
+            device->keys.add(scanCode, key);
+        }
+    }
+
+    void readEvents(Vector<RawEvent>* events) {
+        uint32_t count = readCount(RECORDED_EVENT_SIZE);
+        events->setCapacity(count);
+        for (uint32_t i = 0; i < count && !mError; i++) {
+            RawEvent event;
+            event.when = readInt64();
+            event.deviceId = readInt32();
+            event.type = readInt32();
+            event.code = readInt32();
+            event.value = readInt32();
+            events->push(event);
+        }
+    }
+
+private:
+    const uint8_t* mData;
+    size_t mSize;
+    size_t mOffset;
+    bool mError;
+
+    bool check(size_t size) {
+        if (mError || size > mSize - mOffset) {
+            mError = true;
+            return false;
+        }
+        return true;
+    }
+
+    void read(void* value, size_t size) {
+        if (check(size)) {
+            memcpy(value, mData + mOffset, size);
+            mOffset += size;
+        }
+    }
+};
+
+
+// --- EventRecording ---
+
+EventRecording::EventRecording() {
+}
+
+EventRecording::~EventRecording() {
+}
+
+status_t EventRecording::load(const char* path, EventRecording** outRecording) {
+    *outRecording = NULL;
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        ALOGE("Could not open event recording '%s', errno=%d", path, errno);
+        return -errno;
+    }
+
+    Vector<uint8_t> data;
+    uint8_t chunk[4096];
+    for (;;) {
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            status_t status = -errno;
+            ALOGE("Could not read event recording '%s', errno=%d", path, errno);
+            ::close(fd);
+            return status;
+        }
+        if (n == 0) {
+            break;
+        }
+        data.appendArray(chunk, n);
+    }
+    ::close(fd);
+
+    Parser parser(data.array(), data.size());
+    if (parser.readUint32() != RECORDING_MAGIC
+            || parser.readUint32() != RECORDING_VERSION
+            || parser.hasError()) {
+        ALOGE("Event recording '%s' has an invalid header.", path);
+        return BAD_VALUE;
+    }
+
+    EventRecording* recording = new EventRecording();
+    RecordedBatch batch;
+    while (!parser.atEnd()) {
+        uint32_t tag = parser.readUint32();
+        uint32_t size = parser.readUint32();
+        if (parser.hasError() || size > MAX_RECORD_SIZE) {
+            break;
+        }
+
+        switch (tag) {
+        case RECORD_TAG_DEVICE: {
+            RecordedDevice device;
+            parser.readDevice(&device);
+            if (!parser.hasError()) {
+                batch.devices.push(device);
+            }
+            break;
+        }
+        case RECORD_TAG_EVENTS:
+            parser.readEvents(&batch.events);
+            if (!parser.hasError()) {
+                recording->mBatches.push(batch);
+            }
+            batch.devices.clear();
+            batch.events.clear();
+            break;
+        default:
+            // Skip records written by later versions of the recorder.
+            parser.skip(size);
+            break;
+        }
+
+        if (parser.hasError()) {
+            break;
+        }
+    }
+
+    if (parser.hasError()) {
+        // The last record is usually truncated when the recording process was killed,
+        // so keep whatever was read up to that point.
+        ALOGW("Event recording '%s' ends with a truncated record.", path);
+    }
+
+    *outRecording = recording;
+    return OK;
+}
+
+size_t EventRecording::getEventCount() const {
+    size_t count = 0;
+    for (size_t i = 0; i < mBatches.size(); i++) {
+        count += mBatches.itemAt(i).events.size();
+    }
+    return count;
+}
+
+} // namespace android
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_EVENT_RECORDING_H
+#define _UI_EVENT_RECORDING_H
+
+#include "EventHub.h"
+
+#include <androidfw/InputDevice.h>
+#include <utils/Errors.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+/*
+ * Describes how the event hub mapped one scan code of a recorded device.
+ */
+struct RecordedKey {
+    int32_t keyCode;
+    uint32_t flags;
+};
+
+/*
+ * Describes an input device as the event hub presented it at the time it was added,
+ * so that the device can be reconstructed without the original hardware.
+ */
+struct RecordedDevice {
+    int32_t id;
+    uint32_t classes;
+    InputDeviceIdentifier identifier;
+    KeyedVector<String8, String8> configuration;
+    KeyedVector<int32_t, RawAbsoluteAxisInfo> absoluteAxes;
+    Vector<int32_t> relativeAxes;
+    Vector<int32_t> inputProperties;
+    KeyedVector<int32_t, RecordedKey> keys; // indexed by scan code
+
+    RecordedDevice() : id(0), classes(0) { }
+};
+
+/*
+ * One batch of raw events exactly as it was returned by EventHub::getEvents(),
+ * preceded by the descriptions of any devices that the batch reports as added.
+ */
+struct RecordedBatch {
+    Vector<RecordedDevice> devices;
+    Vector<RawEvent> events;
+};
+
+/*
+ * Writes a recording of the raw event stream.
+ *
+ * The file starts with a header and is followed by a sequence of tagged records,
+ * each of which is either a device description or a batch of raw events.
+ * Values are written in host byte order; a recording is meant to be replayed on
+ * the same kind of device it was captured on.
+ */
+class EventRecorder {
+public:
+    EventRecorder();
+    ~EventRecorder();
+
+    /* Creates the recording file, replacing any existing one. */
+    status_t open(const char* path);
+    void close();
+
+    inline bool isOpen() const { return mFd >= 0; }
+
+    status_t writeDevice(const RecordedDevice& device);
+    status_t writeEvents(const RawEvent* events, size_t count);
+
+private:
+    int mFd;
+    Vector<uint8_t> mBuffer;
+
+    void writeUint32(uint32_t value);
+    void writeInt32(int32_t value);
+    void writeInt64(int64_t value);
+    void writeString(const String8& value);
+    status_t flushRecord(uint32_t tag);
+};
+
+/*
+ * Reads a recording written by EventRecorder.
+ */
+class EventRecording {
+public:
+    EventRecording();
+    ~EventRecording();
+
+    static status_t load(const char* path, EventRecording** outRecording);
+
+    inline const Vector<RecordedBatch>& getBatches() const { return mBatches; }
+
+    /* Gets the total number of raw events in all batches. */
+    size_t getEventCount() const;
+
+private:
+    Vector<RecordedBatch> mBatches;
+
+    class Parser;
+};
+
+} // namespace android
+
+#endif // _UI_EVENT_RECORDING_H
@@ -50,6 +50,7 @@
 #include <androidfw/PowerManager.h>
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <limits.h>
@@ -84,11 +85,22 @@ const nsecs_t STREAM_AHEAD_EVENT_TIMEOUT = 500 * 1000000LL; // 0.5sec
 // Log a warning when an event takes longer than this to process, even if an ANR does not occur.
 const nsecs_t SLOW_EVENT_PROCESSING_WARNING_TIMEOUT = 2000 * 1000000LL; // 2sec
 
+// Maximum number of freed entries of each kind to keep around for reuse.
+const size_t MAX_POOLED_ENTRIES = 64;
+
 
 static inline nsecs_t now() {
     return systemTime(SYSTEM_TIME_MONOTONIC);
 }
 
+static inline uint32_t toMillis(nsecs_t duration) {
+    nsecs_t millis = duration / 1000000LL;
+    if (millis <= 0) {
+        return 0;
+    }
+    return millis < 0xffffffffLL ? uint32_t(millis) : 0xffffffffU;
+}
+
 static inline const char* toString(bool value) {
     return value ? "true" : "false";
 }
@@ -440,9 +452,10 @@ bool InputDispatcher::enqueueInboundEventLocked(EventEntry* entry) {
 
 sp<InputWindowHandle> InputDispatcher::findTouchedWindowAtLocked(int32_t x, int32_t y) {
     // Traverse windows from front to back to find touched window.
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
+    const Vector<size_t>& candidates = mWindowGrid.getCandidates(x, y);
+    size_t numCandidates = candidates.size();
+    for (size_t i = 0; i < numCandidates; i++) {
+        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(candidates.itemAt(i));
         const InputWindowInfo* windowInfo = windowHandle->getInfo();
         int32_t flags = windowInfo->layoutParamsFlags;
 
@@ -1165,9 +1178,10 @@ int32_t InputDispatcher::findTouchedWindowTargetsLocked(nsecs_t currentTime,
         bool isTouchModal = false;
 
         // Traverse windows from front to back to find touched window and outside targets.
-        size_t numWindows = mWindowHandles.size();
-        for (size_t i = 0; i < numWindows; i++) {
-            sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
+        const Vector<size_t>& candidates = mWindowGrid.getCandidates(x, y);
+        size_t numCandidates = candidates.size();
+        for (size_t i = 0; i < numCandidates; i++) {
+            sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(candidates.itemAt(i));
             const InputWindowInfo* windowInfo = windowHandle->getInfo();
             int32_t flags = windowInfo->layoutParamsFlags;
 
@@ -1605,6 +1619,24 @@ bool InputDispatcher::checkInjectionPermission(const sp<InputWindowHandle>& wind
 
 bool InputDispatcher::isWindowObscuredAtPointLocked(
         const sp<InputWindowHandle>& windowHandle, int32_t x, int32_t y) const {
+    // The windows obscuring the point are in its cell, but their order relative
+    // to the window is only known when the window is in the cell as well.
+    const Vector<size_t>& candidates = mWindowGrid.getCandidates(x, y);
+    size_t numCandidates = candidates.size();
+    bool obscured = false;
+    for (size_t i = 0; i < numCandidates; i++) {
+        const sp<InputWindowHandle>& otherHandle = mWindowHandles.itemAt(candidates.itemAt(i));
+        if (otherHandle == windowHandle) {
+            return obscured;
+        }
+
+        const InputWindowInfo* otherInfo = otherHandle->getInfo();
+        if (otherInfo->visible && ! otherInfo->isTrustedOverlay()
+                && otherInfo->frameContainsPoint(x, y)) {
+            obscured = true;
+        }
+    }
+
     size_t numWindows = mWindowHandles.size();
     for (size_t i = 0; i < numWindows; i++) {
         sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(i);
@@ -1871,11 +1903,73 @@ void InputDispatcher::enqueueDispatchEntryLocked(
         incrementPendingForegroundDispatchesLocked(eventEntry);
     }
 
+    // Bound the backlog of moves waiting for a connection that is not keeping up.
+    if (dispatchEntry->resolvedAction == AMOTION_EVENT_ACTION_MOVE
+            && eventEntry->type == EventEntry::TYPE_MOTION
+            && mConfig.maxQueuedMotionMoves) {
+        trimQueuedMotionMovesLocked(connection, dispatchEntry);
+    }
+
     // Enqueue the dispatch entry.
     connection->outboundQueue.enqueueAtTail(dispatchEntry);
     traceOutboundQueueLengthLocked(connection);
 }
 
+void InputDispatcher::trimQueuedMotionMovesLocked(const sp<Connection>& connection,
+        const DispatchEntry* dispatchEntry) {
+    // Entries in the outbound queue have not been published yet.  Find the run of moves
+    // at its tail that belong to the same gesture as the new move.  Moves cannot be
+    // coalesced across any other event because that would reorder them.
+    uint32_t count = 0;
+    DispatchEntry* oldest = NULL;
+    for (DispatchEntry* entry = connection->outboundQueue.tail; entry; entry = entry->prev) {
+        if (!canCoalesceMotionMoves(entry, dispatchEntry)) {
+            break;
+        }
+        oldest = entry;
+        count += 1;
+    }
+
+    if (count >= mConfig.maxQueuedMotionMoves) {
+#if DEBUG_DISPATCH_CYCLE
+        ALOGD("channel '%s' ~ Dropping oldest of %d queued moves because the consumer "
+                "is not keeping up.", connection->getInputChannelName(), count);
+#endif
+        connection->outboundQueue.dequeue(oldest);
+        releaseDispatchEntryLocked(oldest);
+    }
+}
+
+bool InputDispatcher::canCoalesceMotionMoves(const DispatchEntry* a, const DispatchEntry* b) {
+    if (a->resolvedAction != AMOTION_EVENT_ACTION_MOVE
+            || a->eventEntry->type != EventEntry::TYPE_MOTION
+            || a->resolvedFlags != b->resolvedFlags
+            || a->targetFlags != b->targetFlags
+            || a->xOffset != b->xOffset
+            || a->yOffset != b->yOffset
+            || a->scaleFactor != b->scaleFactor) {
+        return false;
+    }
+
+    const MotionEntry* am = static_cast<const MotionEntry*>(a->eventEntry);
+    const MotionEntry* bm = static_cast<const MotionEntry*>(b->eventEntry);
+    if (am->deviceId != bm->deviceId
+            || am->source != bm->source
+            || am->metaState != bm->metaState
+            || am->buttonState != bm->buttonState
+            || am->downTime != bm->downTime
+            || am->pointerCount != bm->pointerCount) {
+        return false;
+    }
+    for (uint32_t i = 0; i < am->pointerCount; i++) {
+        if (am->pointerProperties[i].id != bm->pointerProperties[i].id
+                || am->pointerProperties[i].toolType != bm->pointerProperties[i].toolType) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
         const sp<Connection>& connection) {
 #if DEBUG_DISPATCH_CYCLE
@@ -1885,76 +1979,25 @@ void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
 
     while (connection->status == Connection::STATUS_NORMAL
             && !connection->outboundQueue.isEmpty()) {
-        DispatchEntry* dispatchEntry = connection->outboundQueue.head;
-        dispatchEntry->deliveryTime = currentTime;
-
-        // Publish the event.
-        status_t status;
-        EventEntry* eventEntry = dispatchEntry->eventEntry;
-        switch (eventEntry->type) {
-        case EventEntry::TYPE_KEY: {
-            KeyEntry* keyEntry = static_cast<KeyEntry*>(eventEntry);
-
-            // Publish the key event.
-            status = connection->inputPublisher.publishKeyEvent(dispatchEntry->seq,
-                    keyEntry->deviceId, keyEntry->source,
-                    dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
-                    keyEntry->keyCode, keyEntry->scanCode,
-                    keyEntry->metaState, keyEntry->repeatCount, keyEntry->downTime,
-                    keyEntry->eventTime);
-            break;
-        }
-
-        case EventEntry::TYPE_MOTION: {
-            MotionEntry* motionEntry = static_cast<MotionEntry*>(eventEntry);
-
-            PointerCoords scaledCoords[MAX_POINTERS];
-            const PointerCoords* usingCoords = motionEntry->pointerCoords;
-
-            // Set the X and Y offset depending on the input source.
-            float xOffset, yOffset, scaleFactor;
-            if ((motionEntry->source & AINPUT_SOURCE_CLASS_POINTER)
-                    && !(dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS)) {
-                scaleFactor = dispatchEntry->scaleFactor;
-                xOffset = dispatchEntry->xOffset * scaleFactor;
-                yOffset = dispatchEntry->yOffset * scaleFactor;
-                if (scaleFactor != 1.0f) {
-                    for (size_t i = 0; i < motionEntry->pointerCount; i++) {
-                        scaledCoords[i] = motionEntry->pointerCoords[i];
-                        scaledCoords[i].scale(scaleFactor);
-                    }
-                    usingCoords = scaledCoords;
-                }
-            } else {
-                xOffset = 0.0f;
-                yOffset = 0.0f;
-                scaleFactor = 1.0f;
-
-                // We don't want the dispatch target to know.
-                if (dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS) {
-                    for (size_t i = 0; i < motionEntry->pointerCount; i++) {
-                        scaledCoords[i].clear();
-                    }
-                    usingCoords = scaledCoords;
-                }
+        // Publish as many queued events as fit in a batch so that they are written
+        // to the channel together.  The entries stay in the outbound queue until the
+        // batch has been sent, since none of them are sent if the channel is full.
+        connection->inputPublisher.beginBatch();
+        status_t status = OK;
+        size_t batchCount = 0;
+        for (DispatchEntry* dispatchEntry = connection->outboundQueue.head;
+                dispatchEntry && !connection->inputPublisher.isBatchFull();
+                dispatchEntry = dispatchEntry->next) {
+            dispatchEntry->deliveryTime = currentTime;
+            status = publishDispatchEntryLocked(connection, dispatchEntry);
+            if (status) {
+                break;
             }
-
-            // Publish the motion event.
-            status = connection->inputPublisher.publishMotionEvent(dispatchEntry->seq,
-                    motionEntry->deviceId, motionEntry->source,
-                    dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
-                    motionEntry->edgeFlags, motionEntry->metaState, motionEntry->buttonState,
-                    xOffset, yOffset,
-                    motionEntry->xPrecision, motionEntry->yPrecision,
-                    motionEntry->downTime, motionEntry->eventTime,
-                    motionEntry->pointerCount, motionEntry->pointerProperties,
-                    usingCoords);
-            break;
+            batchCount += 1;
         }
-
-        default:
-            ALOG_ASSERT(false);
-            return;
+        status_t sendStatus = connection->inputPublisher.endBatch();
+        if (!status) {
+            status = sendStatus;
         }
 
         // Check the result.
@@ -1984,14 +2027,96 @@ void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
             return;
         }
 
-        // Re-enqueue the event on the wait queue.
-        connection->outboundQueue.dequeue(dispatchEntry);
+        // Re-enqueue the events on the wait queue.
+        uint32_t waitQueueLength = connection->waitQueue.count();
+        while (batchCount--) {
+            DispatchEntry* dispatchEntry = connection->outboundQueue.dequeueAtHead();
+            connection->waitQueue.enqueueAtTail(dispatchEntry);
+
+            waitQueueLength += 1;
+            connection->queueDepth.add(waitQueueLength);
+            connection->inputToDispatchLatency.add(toMillis(
+                    currentTime - dispatchEntry->eventEntry->eventTime));
+        }
         traceOutboundQueueLengthLocked(connection);
-        connection->waitQueue.enqueueAtTail(dispatchEntry);
         traceWaitQueueLengthLocked(connection);
     }
 }
 
+status_t InputDispatcher::publishDispatchEntryLocked(const sp<Connection>& connection,
+        DispatchEntry* dispatchEntry) {
+    status_t status;
+    EventEntry* eventEntry = dispatchEntry->eventEntry;
+    switch (eventEntry->type) {
+    case EventEntry::TYPE_KEY: {
+        KeyEntry* keyEntry = static_cast<KeyEntry*>(eventEntry);
+
+        // Publish the key event.
+        status = connection->inputPublisher.publishKeyEvent(dispatchEntry->seq,
+                keyEntry->deviceId, keyEntry->source,
+                dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
+                keyEntry->keyCode, keyEntry->scanCode,
+                keyEntry->metaState, keyEntry->repeatCount, keyEntry->downTime,
+                keyEntry->eventTime);
+        break;
+    }
+
+    case EventEntry::TYPE_MOTION: {
+        MotionEntry* motionEntry = static_cast<MotionEntry*>(eventEntry);
+
+        PointerCoords scaledCoords[MAX_POINTERS];
+        const PointerCoords* usingCoords = motionEntry->pointerCoords;
+
+        // Set the X and Y offset depending on the input source.
+        float xOffset, yOffset, scaleFactor;
+        if ((motionEntry->source & AINPUT_SOURCE_CLASS_POINTER)
+                && !(dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS)) {
+            scaleFactor = dispatchEntry->scaleFactor;
+            xOffset = dispatchEntry->xOffset * scaleFactor;
+            yOffset = dispatchEntry->yOffset * scaleFactor;
+            if (scaleFactor != 1.0f) {
+                for (size_t i = 0; i < motionEntry->pointerCount; i++) {
+                    scaledCoords[i] = motionEntry->pointerCoords[i];
+                    scaledCoords[i].scale(scaleFactor);
+                }
+                usingCoords = scaledCoords;
+            }
+        } else {
+            xOffset = 0.0f;
+            yOffset = 0.0f;
+            scaleFactor = 1.0f;
+
+            // We don't want the dispatch target to know.
+            if (dispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS) {
+                for (size_t i = 0; i < motionEntry->pointerCount; i++) {
+                    scaledCoords[i].clear();
+                }
+                usingCoords = scaledCoords;
+            }
+        }
+
+        // Publish the motion event.
+        status = connection->inputPublisher.publishMotionEvent(dispatchEntry->seq,
+                motionEntry->deviceId, motionEntry->source,
+                dispatchEntry->resolvedAction, dispatchEntry->resolvedFlags,
+                motionEntry->edgeFlags, motionEntry->metaState, motionEntry->buttonState,
+                xOffset, yOffset,
+                motionEntry->xPrecision, motionEntry->yPrecision,
+                motionEntry->downTime, motionEntry->eventTime,
+                motionEntry->pointerCount, motionEntry->pointerProperties,
+                usingCoords);
+        break;
+    }
+
+    default:
+        ALOG_ASSERT(false);
+        status = BAD_VALUE;
+        break;
+    }
+
+    return status;
+}
+
 void InputDispatcher::finishDispatchCycleLocked(nsecs_t currentTime,
         const sp<Connection>& connection, uint32_t seq, bool handled) {
 #if DEBUG_DISPATCH_CYCLE
@@ -2491,12 +2616,23 @@ void InputDispatcher::notifyDeviceReset(const NotifyDeviceResetArgs* args) {
 int32_t InputDispatcher::injectInputEvent(const InputEvent* event,
         int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
         uint32_t policyFlags) {
+    return injectInputEvents(&event, 1,
+            injectorPid, injectorUid, syncMode, timeoutMillis, policyFlags);
+}
+
+int32_t InputDispatcher::injectInputEvents(const InputEvent* const* events, size_t eventCount,
+        int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
+        uint32_t policyFlags) {
 #if DEBUG_INBOUND_EVENT_DETAILS
-    ALOGD("injectInputEvent - eventType=%d, injectorPid=%d, injectorUid=%d, "
+    ALOGD("injectInputEvents - eventCount=%d, injectorPid=%d, injectorUid=%d, "
             "syncMode=%d, timeoutMillis=%d, policyFlags=0x%08x",
-            event->getType(), injectorPid, injectorUid, syncMode, timeoutMillis, policyFlags);
+            eventCount, injectorPid, injectorUid, syncMode, timeoutMillis, policyFlags);
 #endif
 
+    if (eventCount == 0) {
+        return INPUT_EVENT_INJECTION_FAILED;
+    }
+
     nsecs_t endTime = now() + milliseconds_to_nanoseconds(timeoutMillis);
 
     policyFlags |= POLICY_FLAG_INJECTED;
@@ -2504,87 +2640,33 @@ int32_t InputDispatcher::injectInputEvent(const InputEvent* event,
         policyFlags |= POLICY_FLAG_TRUSTED;
     }
 
-    EventEntry* firstInjectedEntry;
-    EventEntry* lastInjectedEntry;
-    switch (event->getType()) {
-    case AINPUT_EVENT_TYPE_KEY: {
-        const KeyEvent* keyEvent = static_cast<const KeyEvent*>(event);
-        int32_t action = keyEvent->getAction();
-        if (! validateKeyEvent(action)) {
+    // Validate the whole batch before any of it reaches the policy, so that a rejected
+    // batch has no side effects.
+    for (size_t i = 0; i < eventCount; i++) {
+        if (!validateInjectedEvent(events[i])) {
             return INPUT_EVENT_INJECTION_FAILED;
         }
-
-        int32_t flags = keyEvent->getFlags();
-        if (flags & AKEY_EVENT_FLAG_VIRTUAL_HARD_KEY) {
-            policyFlags |= POLICY_FLAG_VIRTUAL;
-        }
-
-        if (!(policyFlags & POLICY_FLAG_FILTERED)) {
-            mPolicy->interceptKeyBeforeQueueing(keyEvent, /*byref*/ policyFlags);
-        }
-
-        if (policyFlags & POLICY_FLAG_WOKE_HERE) {
-            flags |= AKEY_EVENT_FLAG_WOKE_HERE;
-        }
-
-        mLock.lock();
-        firstInjectedEntry = new KeyEntry(keyEvent->getEventTime(),
-                keyEvent->getDeviceId(), keyEvent->getSource(),
-                policyFlags, action, flags,
-                keyEvent->getKeyCode(), keyEvent->getScanCode(), keyEvent->getMetaState(),
-                keyEvent->getRepeatCount(), keyEvent->getDownTime());
-        lastInjectedEntry = firstInjectedEntry;
-        break;
     }
 
-    case AINPUT_EVENT_TYPE_MOTION: {
-        const MotionEvent* motionEvent = static_cast<const MotionEvent*>(event);
-        int32_t action = motionEvent->getAction();
-        size_t pointerCount = motionEvent->getPointerCount();
-        const PointerProperties* pointerProperties = motionEvent->getPointerProperties();
-        if (! validateMotionEvent(action, pointerCount, pointerProperties)) {
-            return INPUT_EVENT_INJECTION_FAILED;
-        }
-
-        if (!(policyFlags & POLICY_FLAG_FILTERED)) {
-            nsecs_t eventTime = motionEvent->getEventTime();
-            mPolicy->interceptMotionBeforeQueueing(eventTime, /*byref*/ policyFlags);
-        }
+    // Build the entries for the whole batch before taking the lock, so that they can be
+    // enqueued together.
+    EventEntry* firstInjectedEntry = NULL;
+    EventEntry* lastInjectedEntry = NULL;
+    for (size_t i = 0; i < eventCount; i++) {
+        EventEntry* firstEventEntry;
+        EventEntry* lastEventEntry;
+        createInjectedEntries(events[i], policyFlags, &firstEventEntry, &lastEventEntry);
 
-        mLock.lock();
-        const nsecs_t* sampleEventTimes = motionEvent->getSampleEventTimes();
-        const PointerCoords* samplePointerCoords = motionEvent->getSamplePointerCoords();
-        firstInjectedEntry = new MotionEntry(*sampleEventTimes,
-                motionEvent->getDeviceId(), motionEvent->getSource(), policyFlags,
-                action, motionEvent->getFlags(),
-                motionEvent->getMetaState(), motionEvent->getButtonState(),
-                motionEvent->getEdgeFlags(),
-                motionEvent->getXPrecision(), motionEvent->getYPrecision(),
-                motionEvent->getDownTime(), uint32_t(pointerCount),
-                pointerProperties, samplePointerCoords);
-        lastInjectedEntry = firstInjectedEntry;
-        for (size_t i = motionEvent->getHistorySize(); i > 0; i--) {
-            sampleEventTimes += 1;
-            samplePointerCoords += pointerCount;
-            MotionEntry* nextInjectedEntry = new MotionEntry(*sampleEventTimes,
-                    motionEvent->getDeviceId(), motionEvent->getSource(), policyFlags,
-                    action, motionEvent->getFlags(),
-                    motionEvent->getMetaState(), motionEvent->getButtonState(),
-                    motionEvent->getEdgeFlags(),
-                    motionEvent->getXPrecision(), motionEvent->getYPrecision(),
-                    motionEvent->getDownTime(), uint32_t(pointerCount),
-                    pointerProperties, samplePointerCoords);
-            lastInjectedEntry->next = nextInjectedEntry;
-            lastInjectedEntry = nextInjectedEntry;
+        if (lastInjectedEntry) {
+            lastInjectedEntry->next = firstEventEntry;
+        } else {
+            firstInjectedEntry = firstEventEntry;
         }
-        break;
-    }
-
-    default:
-        ALOGW("Cannot inject event of type %d", event->getType());
-        return INPUT_EVENT_INJECTION_FAILED;
+        lastInjectedEntry = lastEventEntry;
     }
 
+    // Only the last entry carries the injection state.  Entries are dispatched in order,
+    // so its result is the result of the batch.
     InjectionState* injectionState = new InjectionState(injectorPid, injectorUid);
     if (syncMode == INPUT_EVENT_INJECTION_SYNC_NONE) {
         injectionState->injectionIsAsync = true;
@@ -2594,13 +2676,15 @@ int32_t InputDispatcher::injectInputEvent(const InputEvent* event,
     lastInjectedEntry->injectionState = injectionState;
 
     bool needWake = false;
-    for (EventEntry* entry = firstInjectedEntry; entry != NULL; ) {
-        EventEntry* nextEntry = entry->next;
-        needWake |= enqueueInboundEventLocked(entry);
-        entry = nextEntry;
-    }
+    { // acquire lock
+        AutoMutex _l(mLock);
 
-    mLock.unlock();
+        for (EventEntry* entry = firstInjectedEntry; entry != NULL; ) {
+            EventEntry* nextEntry = entry->next;
+            needWake |= enqueueInboundEventLocked(entry);
+            entry = nextEntry;
+        }
+    } // release lock
 
     if (needWake) {
         mLooper->wake();
@@ -2622,7 +2706,7 @@ int32_t InputDispatcher::injectInputEvent(const InputEvent* event,
                 nsecs_t remainingTimeout = endTime - now();
                 if (remainingTimeout <= 0) {
 #if DEBUG_INJECTION
-                    ALOGD("injectInputEvent - Timed out waiting for injection result "
+                    ALOGD("injectInputEvents - Timed out waiting for injection result "
                             "to become available.");
 #endif
                     injectionResult = INPUT_EVENT_INJECTION_TIMED_OUT;
@@ -2636,13 +2720,13 @@ int32_t InputDispatcher::injectInputEvent(const InputEvent* event,
                     && syncMode == INPUT_EVENT_INJECTION_SYNC_WAIT_FOR_FINISHED) {
                 while (injectionState->pendingForegroundDispatches != 0) {
 #if DEBUG_INJECTION
-                    ALOGD("injectInputEvent - Waiting for %d pending foreground dispatches.",
+                    ALOGD("injectInputEvents - Waiting for %d pending foreground dispatches.",
                             injectionState->pendingForegroundDispatches);
 #endif
                     nsecs_t remainingTimeout = endTime - now();
                     if (remainingTimeout <= 0) {
 #if DEBUG_INJECTION
-                    ALOGD("injectInputEvent - Timed out waiting for pending foreground "
+                    ALOGD("injectInputEvents - Timed out waiting for pending foreground "
                             "dispatches to finish.");
 #endif
                         injectionResult = INPUT_EVENT_INJECTION_TIMED_OUT;
@@ -2658,7 +2742,7 @@ int32_t InputDispatcher::injectInputEvent(const InputEvent* event,
     } // release lock
 
 #if DEBUG_INJECTION
-    ALOGD("injectInputEvent - Finished with result %d.  "
+    ALOGD("injectInputEvents - Finished with result %d.  "
             "injectorPid=%d, injectorUid=%d",
             injectionResult, injectorPid, injectorUid);
 #endif
@@ -2666,6 +2750,100 @@ int32_t InputDispatcher::injectInputEvent(const InputEvent* event,
     return injectionResult;
 }
 
+bool InputDispatcher::validateInjectedEvent(const InputEvent* event) {
+    switch (event->getType()) {
+    case AINPUT_EVENT_TYPE_KEY: {
+        const KeyEvent* keyEvent = static_cast<const KeyEvent*>(event);
+        return validateKeyEvent(keyEvent->getAction());
+    }
+
+    case AINPUT_EVENT_TYPE_MOTION: {
+        const MotionEvent* motionEvent = static_cast<const MotionEvent*>(event);
+        return validateMotionEvent(motionEvent->getAction(),
+                motionEvent->getPointerCount(), motionEvent->getPointerProperties());
+    }
+
+    default:
+        ALOGW("Cannot inject event of type %d", event->getType());
+        return false;
+    }
+}
+
+void InputDispatcher::createInjectedEntries(const InputEvent* event, uint32_t policyFlags,
+        EventEntry** outFirstEntry, EventEntry** outLastEntry) {
+    switch (event->getType()) {
+    case AINPUT_EVENT_TYPE_KEY: {
+        const KeyEvent* keyEvent = static_cast<const KeyEvent*>(event);
+        int32_t action = keyEvent->getAction();
+
+        int32_t flags = keyEvent->getFlags();
+        if (flags & AKEY_EVENT_FLAG_VIRTUAL_HARD_KEY) {
+            policyFlags |= POLICY_FLAG_VIRTUAL;
+        }
+
+        if (!(policyFlags & POLICY_FLAG_FILTERED)) {
+            mPolicy->interceptKeyBeforeQueueing(keyEvent, /*byref*/ policyFlags);
+        }
+
+        if (policyFlags & POLICY_FLAG_WOKE_HERE) {
+            flags |= AKEY_EVENT_FLAG_WOKE_HERE;
+        }
+
+        *outFirstEntry = new KeyEntry(keyEvent->getEventTime(),
+                keyEvent->getDeviceId(), keyEvent->getSource(),
+                policyFlags, action, flags,
+                keyEvent->getKeyCode(), keyEvent->getScanCode(), keyEvent->getMetaState(),
+                keyEvent->getRepeatCount(), keyEvent->getDownTime());
+        *outLastEntry = *outFirstEntry;
+        break;
+    }
+
+    case AINPUT_EVENT_TYPE_MOTION: {
+        const MotionEvent* motionEvent = static_cast<const MotionEvent*>(event);
+        int32_t action = motionEvent->getAction();
+        size_t pointerCount = motionEvent->getPointerCount();
+        const PointerProperties* pointerProperties = motionEvent->getPointerProperties();
+
+        if (!(policyFlags & POLICY_FLAG_FILTERED)) {
+            nsecs_t eventTime = motionEvent->getEventTime();
+            mPolicy->interceptMotionBeforeQueueing(eventTime, /*byref*/ policyFlags);
+        }
+
+        const nsecs_t* sampleEventTimes = motionEvent->getSampleEventTimes();
+        const PointerCoords* samplePointerCoords = motionEvent->getSamplePointerCoords();
+        MotionEntry* firstEntry = new MotionEntry(*sampleEventTimes,
+                motionEvent->getDeviceId(), motionEvent->getSource(), policyFlags,
+                action, motionEvent->getFlags(),
+                motionEvent->getMetaState(), motionEvent->getButtonState(),
+                motionEvent->getEdgeFlags(),
+                motionEvent->getXPrecision(), motionEvent->getYPrecision(),
+                motionEvent->getDownTime(), uint32_t(pointerCount),
+                pointerProperties, samplePointerCoords);
+        EventEntry* lastEntry = firstEntry;
+        for (size_t i = motionEvent->getHistorySize(); i > 0; i--) {
+            sampleEventTimes += 1;
+            samplePointerCoords += pointerCount;
+            MotionEntry* nextEntry = new MotionEntry(*sampleEventTimes,
+                    motionEvent->getDeviceId(), motionEvent->getSource(), policyFlags,
+                    action, motionEvent->getFlags(),
+                    motionEvent->getMetaState(), motionEvent->getButtonState(),
+                    motionEvent->getEdgeFlags(),
+                    motionEvent->getXPrecision(), motionEvent->getYPrecision(),
+                    motionEvent->getDownTime(), uint32_t(pointerCount),
+                    pointerProperties, samplePointerCoords);
+            lastEntry->next = nextEntry;
+            lastEntry = nextEntry;
+        }
+        *outFirstEntry = firstEntry;
+        *outLastEntry = lastEntry;
+        break;
+    }
+
+    default:
+        LOG_ALWAYS_FATAL("Injected event of type %d was not validated", event->getType());
+    }
+}
+
 bool InputDispatcher::hasInjectionPermission(int32_t injectorPid, int32_t injectorUid) {
     return injectorUid == 0
             || mPolicy->checkInjectEventsPermissionNonReentrant(injectorPid, injectorUid);
@@ -2749,20 +2927,59 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
 #if DEBUG_FOCUS
     ALOGD("setInputWindows");
 #endif
+    // Read the state of the windows before taking the lock, it comes from the
+    // window manager objects and is slow to get compared to the rest of the update.
+    size_t numWindows = inputWindowHandles.size();
+    Vector<InputWindowInfo> windowInfos;
+    windowInfos.insertAt(0, numWindows);
+    Vector<bool> windowInfoValid;
+    windowInfoValid.insertAt(false, 0, numWindows);
+    for (size_t i = 0; i < numWindows; i++) {
+        windowInfoValid.editItemAt(i) =
+                inputWindowHandles.itemAt(i)->readInfo(&windowInfos.editItemAt(i));
+    }
+
     { // acquire lock
         AutoMutex _l(mLock);
 
+        // Apply the state of the windows that changed, and stop there when
+        // neither the states nor the list of windows did.
+        Vector<sp<InputWindowHandle> > newWindowHandles;
+        bool changed = false;
+        for (size_t i = 0; i < numWindows; i++) {
+            const sp<InputWindowHandle>& windowHandle = inputWindowHandles.itemAt(i);
+            if (!windowInfoValid.itemAt(i)) {
+                if (windowHandle->getInfo() != NULL) {
+                    windowHandle->releaseInfo();
+                    changed = true;
+                }
+                continue;
+            }
+            const InputWindowInfo& windowInfo = windowInfos.itemAt(i);
+            if (windowHandle->getInfo() == NULL || *windowHandle->getInfo() != windowInfo) {
+                windowHandle->setInfo(windowInfo);
+                changed = true;
+            }
+            if (windowInfo.inputChannel == NULL) {
+                continue;
+            }
+            size_t index = newWindowHandles.size();
+            if (index >= mWindowHandles.size() || mWindowHandles.itemAt(index) != windowHandle) {
+                changed = true;
+            }
+            newWindowHandles.push(windowHandle);
+        }
+        if (!changed && newWindowHandles.size() == mWindowHandles.size()) {
+            return;
+        }
+
         Vector<sp<InputWindowHandle> > oldWindowHandles = mWindowHandles;
-        mWindowHandles = inputWindowHandles;
+        mWindowHandles = newWindowHandles;
 
         sp<InputWindowHandle> newFocusedWindowHandle;
         bool foundHoveredWindow = false;
         for (size_t i = 0; i < mWindowHandles.size(); i++) {
             const sp<InputWindowHandle>& windowHandle = mWindowHandles.itemAt(i);
-            if (!windowHandle->updateInfo() || windowHandle->getInputChannel() == NULL) {
-                mWindowHandles.removeAt(i--);
-                continue;
-            }
             if (windowHandle->getInfo()->hasFocus) {
                 newFocusedWindowHandle = windowHandle;
             }
@@ -2775,6 +2992,8 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
             mLastHoverWindowHandle = NULL;
         }
 
+        mWindowGrid.build(mWindowHandles);
+
         if (mFocusedWindowHandle != newFocusedWindowHandle) {
             if (mFocusedWindowHandle != NULL) {
 #if DEBUG_FOCUS
@@ -3156,6 +3375,13 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
             } else {
                 dump.append(INDENT3 "WaitQueue: <empty>\n");
             }
+
+            dump.append(INDENT3 "InputToDispatchLatency: ");
+            connection->inputToDispatchLatency.dump(dump, "ms");
+            dump.append(INDENT3 "DispatchToFinishedLatency: ");
+            connection->dispatchToFinishedLatency.dump(dump, "ms");
+            dump.append(INDENT3 "QueueDepth: ");
+            connection->queueDepth.dump(dump, "");
         }
     } else {
         dump.append(INDENT "Connections: <none>\n");
@@ -3173,6 +3399,8 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
             mConfig.keyRepeatDelay * 0.000001f);
     dump.appendFormat(INDENT2 "KeyRepeatTimeout: %0.1fms\n",
             mConfig.keyRepeatTimeout * 0.000001f);
+    dump.appendFormat(INDENT2 "MaxQueuedMotionMoves: %d\n",
+            mConfig.maxQueuedMotionMoves);
 }
 
 status_t InputDispatcher::registerInputChannel(const sp<InputChannel>& inputChannel,
@@ -3400,6 +3628,7 @@ void InputDispatcher::doDispatchCycleFinishedLockedInterruptible(
     DispatchEntry* dispatchEntry = connection->findWaitQueueEntry(seq);
     if (dispatchEntry) {
         nsecs_t eventDuration = finishTime - dispatchEntry->deliveryTime;
+        connection->dispatchToFinishedLatency.add(toMillis(eventDuration));
         if (eventDuration > SLOW_EVENT_PROCESSING_WARNING_TIMEOUT) {
             String8 msg;
             msg.appendFormat("Window '%s' spent %0.1fms processing the last input event: ",
@@ -3671,6 +3900,23 @@ void InputDispatcher::dump(String8& dump) {
     }
 }
 
+void InputDispatcher::getDispatchStatistics(Vector<InputDispatchStatistics>& outStatistics) {
+    AutoMutex _l(mLock);
+
+    outStatistics.clear();
+    outStatistics.setCapacity(mConnectionsByFd.size());
+    for (size_t i = 0; i < mConnectionsByFd.size(); i++) {
+        const sp<Connection>& connection = mConnectionsByFd.valueAt(i);
+        InputDispatchStatistics statistics;
+        statistics.inputChannelName = connection->inputChannel->getName();
+        statistics.windowName.setTo(connection->getWindowName());
+        statistics.inputToDispatchLatency = connection->inputToDispatchLatency;
+        statistics.dispatchToFinishedLatency = connection->dispatchToFinishedLatency;
+        statistics.queueDepth = connection->queueDepth;
+        outStatistics.push(statistics);
+    }
+}
+
 void InputDispatcher::monitor() {
     // Acquire and release the lock to ensure that the dispatcher has not deadlocked.
     mLock.lock();
@@ -3680,6 +3926,56 @@ void InputDispatcher::monitor() {
 }
 
 
+// --- InputDispatcher::EntryPool ---
+
+// Keeps freed blocks of a fixed size for reuse, so that the entries allocated for every
+// event and dispatch target do not each go through the heap.  Entries are created on the
+// reader, dispatcher and binder threads, so the pool has its own lock.
+class InputDispatcher::EntryPool {
+public:
+    EntryPool(size_t blockSize) :
+            mBlockSize(blockSize), mFreeList(NULL), mFreeCount(0) {
+    }
+
+    void* allocate(size_t size) {
+        if (size == mBlockSize) {
+            AutoMutex _l(mLock);
+            FreeBlock* block = mFreeList;
+            if (block) {
+                mFreeList = block->next;
+                mFreeCount -= 1;
+                return block;
+            }
+        }
+        return malloc(size);
+    }
+
+    void recycle(void* ptr, size_t size) {
+        if (ptr && size == mBlockSize) {
+            AutoMutex _l(mLock);
+            if (mFreeCount < MAX_POOLED_ENTRIES) {
+                FreeBlock* block = static_cast<FreeBlock*>(ptr);
+                block->next = mFreeList;
+                mFreeList = block;
+                mFreeCount += 1;
+                return;
+            }
+        }
+        free(ptr);
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    const size_t mBlockSize;
+    Mutex mLock;
+    FreeBlock* mFreeList;
+    size_t mFreeCount;
+};
+
+
 // --- InputDispatcher::Queue ---
 
 template <typename T>
@@ -3788,6 +4084,16 @@ InputDispatcher::KeyEntry::KeyEntry(nsecs_t eventTime,
 InputDispatcher::KeyEntry::~KeyEntry() {
 }
 
+InputDispatcher::EntryPool InputDispatcher::KeyEntry::sPool(sizeof(KeyEntry));
+
+void* InputDispatcher::KeyEntry::operator new(size_t size) {
+    return sPool.allocate(size);
+}
+
+void InputDispatcher::KeyEntry::operator delete(void* ptr, size_t size) {
+    sPool.recycle(ptr, size);
+}
+
 void InputDispatcher::KeyEntry::appendDescription(String8& msg) const {
     msg.appendFormat("KeyEvent(action=%d, deviceId=%d, source=0x%08x)",
             action, deviceId, source);
@@ -3817,6 +4123,13 @@ InputDispatcher::MotionEntry::MotionEntry(nsecs_t eventTime,
         metaState(metaState), buttonState(buttonState), edgeFlags(edgeFlags),
         xPrecision(xPrecision), yPrecision(yPrecision),
         downTime(downTime), pointerCount(pointerCount) {
+    if (pointerCount <= INLINE_POINTERS) {
+        this->pointerProperties = inlinePointerProperties;
+        this->pointerCoords = inlinePointerCoords;
+    } else {
+        this->pointerProperties = new PointerProperties[pointerCount];
+        this->pointerCoords = new PointerCoords[pointerCount];
+    }
     for (uint32_t i = 0; i < pointerCount; i++) {
         this->pointerProperties[i].copyFrom(pointerProperties[i]);
         this->pointerCoords[i].copyFrom(pointerCoords[i]);
@@ -3824,6 +4137,20 @@ InputDispatcher::MotionEntry::MotionEntry(nsecs_t eventTime,
 }
 
 InputDispatcher::MotionEntry::~MotionEntry() {
+    if (pointerProperties != inlinePointerProperties) {
+        delete[] pointerProperties;
+        delete[] pointerCoords;
+    }
+}
+
+InputDispatcher::EntryPool InputDispatcher::MotionEntry::sPool(sizeof(MotionEntry));
+
+void* InputDispatcher::MotionEntry::operator new(size_t size) {
+    return sPool.allocate(size);
+}
+
+void InputDispatcher::MotionEntry::operator delete(void* ptr, size_t size) {
+    sPool.recycle(ptr, size);
 }
 
 void InputDispatcher::MotionEntry::appendDescription(String8& msg) const {
@@ -3849,6 +4176,16 @@ InputDispatcher::DispatchEntry::~DispatchEntry() {
     eventEntry->release();
 }
 
+InputDispatcher::EntryPool InputDispatcher::DispatchEntry::sPool(sizeof(DispatchEntry));
+
+void* InputDispatcher::DispatchEntry::operator new(size_t size) {
+    return sPool.allocate(size);
+}
+
+void InputDispatcher::DispatchEntry::operator delete(void* ptr, size_t size) {
+    sPool.recycle(ptr, size);
+}
+
 uint32_t InputDispatcher::DispatchEntry::nextSeq() {
     // Sequence number 0 is reserved and will never be returned.
     uint32_t seq;
@@ -4243,6 +4580,114 @@ InputDispatcher::CommandEntry::CommandEntry(Command command) :
 InputDispatcher::CommandEntry::~CommandEntry() {
 }
 
+InputDispatcher::EntryPool InputDispatcher::CommandEntry::sPool(sizeof(CommandEntry));
+
+void* InputDispatcher::CommandEntry::operator new(size_t size) {
+    return sPool.allocate(size);
+}
+
+void InputDispatcher::CommandEntry::operator delete(void* ptr, size_t size) {
+    sPool.recycle(ptr, size);
+}
+
+
+// --- InputDispatcher::WindowGrid ---
+
+InputDispatcher::WindowGrid::WindowGrid() :
+        left(0), top(0), cellWidth(1), cellHeight(1) {
+}
+
+void InputDispatcher::WindowGrid::build(const Vector<sp<InputWindowHandle> >& windowHandles) {
+    global.clear();
+    for (size_t i = 0; i < GRID_SIZE * GRID_SIZE; i++) {
+        cells[i].clear();
+    }
+
+    // Bounds of the windows that only affect the touches inside them, as the
+    // union of their touchable region and their frame.  The frame is needed by
+    // isWindowObscuredAtPointLocked() and is inclusive of its right and bottom edges.
+    const size_t numWindows = windowHandles.size();
+    Vector<SkIRect> bounds;
+    bounds.insertAt(0, numWindows);
+    SkIRect gridBounds;
+    gridBounds.setEmpty();
+    for (size_t i = 0; i < numWindows; i++) {
+        const InputWindowInfo* windowInfo = windowHandles.itemAt(i)->getInfo();
+        int32_t flags = windowInfo->layoutParamsFlags;
+        SkIRect& windowBounds = bounds.editItemAt(i);
+        windowBounds.setEmpty();
+
+        if (!windowInfo->visible || (flags & InputWindowInfo::FLAG_SYSTEM_ERROR)) {
+            continue;
+        }
+        bool isTouchable = !(flags & InputWindowInfo::FLAG_NOT_TOUCHABLE);
+        bool isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
+                | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
+        if ((isTouchable && isTouchModal) || (flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH)) {
+            continue;
+        }
+
+        windowBounds.set(windowInfo->frameLeft, windowInfo->frameTop,
+                windowInfo->frameRight + 1, windowInfo->frameBottom + 1);
+        if (isTouchable) {
+            windowBounds.join(windowInfo->touchableRegion.getBounds());
+        }
+        gridBounds.join(windowBounds);
+    }
+
+    if (!gridBounds.isEmpty()) {
+        left = gridBounds.fLeft;
+        top = gridBounds.fTop;
+        cellWidth = (gridBounds.width() + GRID_SIZE - 1) / GRID_SIZE;
+        cellHeight = (gridBounds.height() + GRID_SIZE - 1) / GRID_SIZE;
+    } else {
+        left = 0;
+        top = 0;
+        cellWidth = 1;
+        cellHeight = 1;
+    }
+
+    for (size_t i = 0; i < numWindows; i++) {
+        const InputWindowInfo* windowInfo = windowHandles.itemAt(i)->getInfo();
+        const SkIRect& windowBounds = bounds.itemAt(i);
+        if (!windowBounds.isEmpty()) {
+            int32_t cellLeft = (windowBounds.fLeft - left) / cellWidth;
+            int32_t cellTop = (windowBounds.fTop - top) / cellHeight;
+            int32_t cellRight = (windowBounds.fRight - 1 - left) / cellWidth;
+            int32_t cellBottom = (windowBounds.fBottom - 1 - top) / cellHeight;
+            if (cellRight >= GRID_SIZE) {
+                cellRight = GRID_SIZE - 1;
+            }
+            if (cellBottom >= GRID_SIZE) {
+                cellBottom = GRID_SIZE - 1;
+            }
+            for (int32_t cy = cellTop; cy <= cellBottom; cy++) {
+                for (int32_t cx = cellLeft; cx <= cellRight; cx++) {
+                    cells[cy * GRID_SIZE + cx].push(i);
+                }
+            }
+        } else if (windowInfo->visible
+                || (windowInfo->layoutParamsFlags & InputWindowInfo::FLAG_SYSTEM_ERROR)) {
+            global.push(i);
+            for (size_t j = 0; j < GRID_SIZE * GRID_SIZE; j++) {
+                cells[j].push(i);
+            }
+        }
+    }
+}
+
+const Vector<size_t>& InputDispatcher::WindowGrid::getCandidates(int32_t x, int32_t y) const {
+    if (x < left || y < top) {
+        return global;
+    }
+    int32_t cx = (x - left) / cellWidth;
+    int32_t cy = (y - top) / cellHeight;
+    if (cx >= GRID_SIZE || cy >= GRID_SIZE) {
+        return global;
+    }
+    return cells[cy * GRID_SIZE + cx];
+}
+
 
 // --- InputDispatcher::TouchState ---
 
@@ -4346,6 +4791,47 @@ bool InputDispatcher::TouchState::isSlippery() const {
 }
 
 
+// --- InputDispatchHistogram ---
+
+void InputDispatchHistogram::clear() {
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        counts[i] = 0;
+    }
+    count = 0;
+    sum = 0;
+    max = 0;
+}
+
+void InputDispatchHistogram::add(uint32_t value) {
+    size_t bucket = value ? 32 - __builtin_clz(value) : 0;
+    if (bucket >= BUCKET_COUNT) {
+        bucket = BUCKET_COUNT - 1;
+    }
+    counts[bucket] += 1;
+    count += 1;
+    sum += value;
+    if (value > max) {
+        max = value;
+    }
+}
+
+void InputDispatchHistogram::dump(String8& dump, const char* units) const {
+    dump.appendFormat("count=%u, avg=%0.1f%s, max=%u%s, buckets=[",
+            count, count ? double(sum) / count : 0.0, units, max, units);
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        if (i) {
+            dump.append(", ");
+        }
+        if (i + 1 == BUCKET_COUNT) {
+            dump.appendFormat(">=%u: %u", 1U << (i - 1), counts[i]);
+        } else {
+            dump.appendFormat("<%u: %u", 1U << i, counts[i]);
+        }
+    }
+    dump.append("]\n");
+}
+
+
 // --- InputDispatcherThread ---
 
 InputDispatcherThread::InputDispatcherThread(const sp<InputDispatcherInterface>& dispatcher) :
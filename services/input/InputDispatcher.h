@@ -173,9 +173,55 @@ struct InputDispatcherConfiguration {
     // The key repeat inter-key delay.
     nsecs_t keyRepeatDelay;
 
+    // The maximum number of consecutive move events of the same gesture that may wait
+    // in the outbound queue of a connection that is not keeping up.  When exceeded,
+    // the oldest waiting move is dropped since newer samples supersede it.
+    // Zero means no limit.
+    uint32_t maxQueuedMotionMoves;
+
     InputDispatcherConfiguration() :
             keyRepeatTimeout(500 * 1000000LL),
-            keyRepeatDelay(50 * 1000000LL) { }
+            keyRepeatDelay(50 * 1000000LL),
+            maxQueuedMotionMoves(0) { }
+};
+
+
+/*
+ * Histogram of values recorded by the input dispatcher.
+ *
+ * Bucket 0 counts the value 0 and bucket i counts the values from 2^(i-1) up to 2^i - 1.
+ * The last bucket also counts all larger values.
+ */
+struct InputDispatchHistogram {
+    enum { BUCKET_COUNT = 12 };
+
+    uint32_t counts[BUCKET_COUNT];
+    uint32_t count;
+    uint64_t sum;
+    uint32_t max;
+
+    InputDispatchHistogram() { clear(); }
+
+    void clear();
+    void add(uint32_t value);
+    void dump(String8& dump, const char* units) const;
+};
+
+/*
+ * Dispatch statistics for one input channel, collected since it was registered.
+ */
+struct InputDispatchStatistics {
+    String8 inputChannelName;
+    String8 windowName;
+
+    // Milliseconds from the time an event occurred to when it was published to the channel.
+    InputDispatchHistogram inputToDispatchLatency;
+
+    // Milliseconds from publishing an event to receiving its finished signal.
+    InputDispatchHistogram dispatchToFinishedLatency;
+
+    // Number of events awaiting a finished signal, including the one just published.
+    InputDispatchHistogram queueDepth;
 };
 
 
@@ -280,6 +326,11 @@ public:
     /* Called by the heatbeat to ensures that the dispatcher has not deadlocked. */
     virtual void monitor() = 0;
 
+    /* Gets the dispatch statistics of all registered input channels.
+     *
+     * This method may be called on any thread (usually by the input manager). */
+    virtual void getDispatchStatistics(Vector<InputDispatchStatistics>& outStatistics) = 0;
+
     /* Runs a single iteration of the dispatch loop.
      * Nominally processes one queued event, a timeout, or a response from an input consumer.
      *
@@ -298,7 +349,23 @@ public:
             int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
             uint32_t policyFlags) = 0;
 
+    /* Injects a batch of input events as a unit and optionally waits for sync.
+     * Permissions are checked once for the whole batch.  Either all of the events are
+     * enqueued together, with no other events in between, or none are if any of them is
+     * invalid.  The synchronization mode applies to the last event of the batch, which
+     * the dispatcher handles after all of the others.
+     * Returns one of the INPUT_EVENT_INJECTION_XXX constants for the batch.
+     *
+     * This method may be called on any thread (usually by the input manager).
+     */
+    virtual int32_t injectInputEvents(const InputEvent* const* events, size_t eventCount,
+            int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
+            uint32_t policyFlags) = 0;
+
     /* Sets the list of input windows.
+     *
+     * Only the windows whose state changed are updated, and the dispatcher is left
+     * untouched when none did.  The state is read before the dispatcher is locked.
      *
      * This method may be called on any thread (usually by the input manager).
      */
@@ -369,6 +436,7 @@ public:
 
     virtual void dump(String8& dump);
     virtual void monitor();
+    virtual void getDispatchStatistics(Vector<InputDispatchStatistics>& outStatistics);
 
     virtual void dispatchOnce();
 
@@ -381,6 +449,9 @@ public:
     virtual int32_t injectInputEvent(const InputEvent* event,
             int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
             uint32_t policyFlags);
+    virtual int32_t injectInputEvents(const InputEvent* const* events, size_t eventCount,
+            int32_t injectorPid, int32_t injectorUid, int32_t syncMode, int32_t timeoutMillis,
+            uint32_t policyFlags);
 
     virtual void setInputWindows(const Vector<sp<InputWindowHandle> >& inputWindowHandles);
     virtual void setFocusedApplication(const sp<InputApplicationHandle>& inputApplicationHandle);
@@ -395,6 +466,8 @@ public:
     virtual status_t unregisterInputChannel(const sp<InputChannel>& inputChannel);
 
 private:
+    class EntryPool;
+
     template <typename T>
     struct Link {
         T* next;
@@ -495,6 +568,11 @@ private:
         virtual void appendDescription(String8& msg) const;
         void recycle();
 
+        // Allocated from a pool of recycled entries.
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr, size_t size);
+        static EntryPool sPool;
+
     protected:
         virtual ~KeyEntry();
     };
@@ -512,8 +590,14 @@ private:
         float yPrecision;
         nsecs_t downTime;
         uint32_t pointerCount;
-        PointerProperties pointerProperties[MAX_POINTERS];
-        PointerCoords pointerCoords[MAX_POINTERS];
+        PointerProperties* pointerProperties; // pointerCount elements
+        PointerCoords* pointerCoords; // pointerCount elements
+
+        // Most motions carry one or two pointers, so their data is kept inline and the
+        // pooled entries stay small.  Larger pointer sets are allocated separately.
+        enum { INLINE_POINTERS = 2 };
+        PointerProperties inlinePointerProperties[INLINE_POINTERS];
+        PointerCoords inlinePointerCoords[INLINE_POINTERS];
 
         MotionEntry(nsecs_t eventTime,
                 int32_t deviceId, uint32_t source, uint32_t policyFlags, int32_t action,
@@ -523,6 +607,11 @@ private:
                 const PointerProperties* pointerProperties, const PointerCoords* pointerCoords);
         virtual void appendDescription(String8& msg) const;
 
+        // Allocated from a pool of recycled entries.
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr, size_t size);
+        static EntryPool sPool;
+
     protected:
         virtual ~MotionEntry();
     };
@@ -546,6 +635,11 @@ private:
                 int32_t targetFlags, float xOffset, float yOffset, float scaleFactor);
         ~DispatchEntry();
 
+        // Allocated from a pool of recycled entries.
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr, size_t size);
+        static EntryPool sPool;
+
         inline bool hasForegroundTarget() const {
             return targetFlags & InputTarget::FLAG_FOREGROUND;
         }
@@ -584,6 +678,11 @@ private:
         CommandEntry(Command command);
         ~CommandEntry();
 
+        // Allocated from a pool of recycled entries.
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr, size_t size);
+        static EntryPool sPool;
+
         Command command;
 
         // parameters for the command (usage varies by command)
@@ -810,6 +909,11 @@ private:
         // yet received a "finished" response from the application.
         Queue<DispatchEntry> waitQueue;
 
+        // Latency and queue depth statistics.
+        InputDispatchHistogram inputToDispatchLatency;
+        InputDispatchHistogram dispatchToFinishedLatency;
+        InputDispatchHistogram queueDepth;
+
         explicit Connection(const sp<InputChannel>& inputChannel,
                 const sp<InputWindowHandle>& inputWindowHandle, bool monitor);
 
@@ -879,6 +983,9 @@ private:
 
     // Event injection and synchronization.
     Condition mInjectionResultAvailableCondition;
+    bool validateInjectedEvent(const InputEvent* event);
+    void createInjectedEntries(const InputEvent* event, uint32_t policyFlags,
+            EventEntry** outFirstEntry, EventEntry** outLastEntry);
     bool hasInjectionPermission(int32_t injectorPid, int32_t injectorUid);
     void setInjectionResultLocked(EventEntry* entry, int32_t injectionResult);
 
@@ -912,6 +1019,33 @@ private:
 
     Vector<sp<InputWindowHandle> > mWindowHandles;
 
+    // Spatial index of mWindowHandles for the touch lookups.
+    // Each cell of a grid laid over the windows lists, front to back, the indices
+    // of the windows that can affect a touch in that cell: the visible windows whose
+    // touchable region or frame overlaps the cell, and the windows that affect every
+    // touch (touch modal windows, windows watching outside touches and system error
+    // windows).  Other windows are left out since the lookups skip them anyway.
+    struct WindowGrid {
+        enum { GRID_SIZE = 16 };
+
+        int32_t left;
+        int32_t top;
+        int32_t cellWidth;
+        int32_t cellHeight;
+
+        // Windows that affect every touch, used for points outside the grid.
+        Vector<size_t> global;
+        Vector<size_t> cells[GRID_SIZE * GRID_SIZE];
+
+        WindowGrid();
+
+        void build(const Vector<sp<InputWindowHandle> >& windowHandles);
+
+        // Returns the windows to consider for a touch at x, y in z-order.
+        const Vector<size_t>& getCandidates(int32_t x, int32_t y) const;
+    };
+    WindowGrid mWindowGrid;
+
     sp<InputWindowHandle> getWindowHandleLocked(const sp<InputChannel>& inputChannel) const;
     bool hasWindowHandleLocked(const sp<InputWindowHandle>& windowHandle) const;
 
@@ -1026,12 +1160,17 @@ private:
     void enqueueDispatchEntryLocked(const sp<Connection>& connection,
             EventEntry* eventEntry, const InputTarget* inputTarget, int32_t dispatchMode);
     void startDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection);
+    status_t publishDispatchEntryLocked(const sp<Connection>& connection,
+            DispatchEntry* dispatchEntry);
     void finishDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection,
             uint32_t seq, bool handled);
     void abortBrokenDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection,
             bool notify);
     void drainDispatchQueueLocked(Queue<DispatchEntry>* queue);
     void releaseDispatchEntryLocked(DispatchEntry* dispatchEntry);
+    void trimQueuedMotionMovesLocked(const sp<Connection>& connection,
+            const DispatchEntry* dispatchEntry);
+    static bool canCoalesceMotionMoves(const DispatchEntry* a, const DispatchEntry* b);
     static int handleReceiveCallback(int fd, int events, void* data);
 
     void synthesizeCancelationEventsForAllConnectionsLocked(
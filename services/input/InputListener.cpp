@@ -177,5 +177,37 @@ void QueuedInputListener::flush() {
     mArgsQueue.clear();
 }
 
+void QueuedInputListener::merge(QueuedInputListener* const* listeners, size_t count) {
+    Vector<size_t> positions;
+    positions.insertAt(0, 0, count);
+    size_t remaining = 0;
+    for (size_t i = 0; i < count; i++) {
+        remaining += listeners[i]->mArgsQueue.size();
+    }
+
+    mArgsQueue.setCapacity(mArgsQueue.size() + remaining);
+    while (remaining--) {
+        // Take the earliest event at the head of any of the queues.
+        ssize_t earliest = -1;
+        nsecs_t earliestTime = 0;
+        for (size_t i = 0; i < count; i++) {
+            const Vector<NotifyArgs*>& queue = listeners[i]->mArgsQueue;
+            if (positions[i] < queue.size()) {
+                nsecs_t eventTime = queue[positions[i]]->getEventTime();
+                if (earliest < 0 || eventTime < earliestTime) {
+                    earliest = i;
+                    earliestTime = eventTime;
+                }
+            }
+        }
+        size_t& position = positions.editItemAt(earliest);
+        mArgsQueue.push(listeners[earliest]->mArgsQueue[position++]);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        listeners[i]->mArgsQueue.clear();
+    }
+}
+
 
 } // namespace android
@@ -31,6 +31,8 @@ struct NotifyArgs {
     virtual ~NotifyArgs() { }
 
     virtual void notify(const sp<InputListenerInterface>& listener) const = 0;
+
+    virtual nsecs_t getEventTime() const = 0;
 };
 
 
@@ -47,6 +49,8 @@ struct NotifyConfigurationChangedArgs : public NotifyArgs {
     virtual ~NotifyConfigurationChangedArgs() { }
 
     virtual void notify(const sp<InputListenerInterface>& listener) const;
+
+    virtual nsecs_t getEventTime() const { return eventTime; }
 };
 
 
@@ -74,6 +78,8 @@ struct NotifyKeyArgs : public NotifyArgs {
     virtual ~NotifyKeyArgs() { }
 
     virtual void notify(const sp<InputListenerInterface>& listener) const;
+
+    virtual nsecs_t getEventTime() const { return eventTime; }
 };
 
 
@@ -108,6 +114,8 @@ struct NotifyMotionArgs : public NotifyArgs {
     virtual ~NotifyMotionArgs() { }
 
     virtual void notify(const sp<InputListenerInterface>& listener) const;
+
+    virtual nsecs_t getEventTime() const { return eventTime; }
 };
 
 
@@ -128,6 +136,8 @@ struct NotifySwitchArgs : public NotifyArgs {
     virtual ~NotifySwitchArgs() { }
 
     virtual void notify(const sp<InputListenerInterface>& listener) const;
+
+    virtual nsecs_t getEventTime() const { return eventTime; }
 };
 
 
@@ -146,6 +156,8 @@ struct NotifyDeviceResetArgs : public NotifyArgs {
     virtual ~NotifyDeviceResetArgs() { }
 
     virtual void notify(const sp<InputListenerInterface>& listener) const;
+
+    virtual nsecs_t getEventTime() const { return eventTime; }
 };
 
 
@@ -185,6 +197,10 @@ public:
 
     void flush();
 
+    /* Moves the events queued by other listeners into this one, merged in order of
+     * their event times.  Events from the same listener keep their relative order. */
+    void merge(QueuedInputListener* const* listeners, size_t count);
+
 private:
     sp<InputListenerInterface> mInnerListener;
     Vector<NotifyArgs*> mArgsQueue;
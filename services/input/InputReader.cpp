@@ -42,6 +42,7 @@
 #include "InputReader.h"
 
 #include <cutils/log.h>
+#include <cutils/properties.h>
 #include <androidfw/Keyboard.h>
 #include <androidfw/VirtualKeyMap.h>
 
@@ -65,6 +66,9 @@ namespace android {
 // Maximum number of slots supported when using the slot-based Multitouch Protocol B.
 static const size_t MAX_SLOTS = 32;
 
+// Maximum number of worker threads used to process input devices in parallel.
+static const int MAX_READER_WORKERS = 4;
+
 // --- Static Functions ---
 
 template<typename T>
@@ -234,16 +238,43 @@ void InputReaderConfiguration::setDisplayInfo(int32_t displayId, bool external,
 }
 
 
+// --- AutoConditionalMutex ---
+
+// Holds a mutex for the duration of a scope, but only if a condition is true.
+class AutoConditionalMutex {
+public:
+    inline AutoConditionalMutex(Mutex& mutex, bool condition) :
+            mMutex(condition ? &mutex : NULL) {
+        if (mMutex) {
+            mMutex->lock();
+        }
+    }
+
+    inline ~AutoConditionalMutex() {
+        if (mMutex) {
+            mMutex->unlock();
+        }
+    }
+
+private:
+    Mutex* mMutex;
+};
+
+
 // --- InputReader ---
 
 InputReader::InputReader(const sp<EventHubInterface>& eventHub,
         const sp<InputReaderPolicyInterface>& policy,
         const sp<InputListenerInterface>& listener) :
-        mContext(this), mEventHub(eventHub), mPolicy(policy),
+        mContext(this), mProcessingInParallel(false), mJobCount(0),
+        mReadyJobs(0), mNextJob(0), mPendingJobs(0),
+        mEventHub(eventHub), mPolicy(policy),
+        mEventBuffer(new RawEvent[EVENT_BUFFER_SIZE]), mEventBufferSize(EVENT_BUFFER_SIZE),
         mGlobalMetaState(0), mGeneration(1),
         mDisableVirtualKeysTimeout(LLONG_MIN), mNextTimeout(LLONG_MAX),
         mConfigurationChangesToRefresh(0) {
     mQueuedListener = new QueuedInputListener(listener);
+    pthread_key_create(&mJobListenerKey, NULL);
 
     { // acquire lock
         AutoMutex _l(mLock);
@@ -251,12 +282,42 @@ InputReader::InputReader(const sp<EventHubInterface>& eventHub,
         refreshConfigurationLocked(0);
         updateGlobalMetaStateLocked();
     } // release lock
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("input.reader.workers", value, "0");
+    int workerCount = atoi(value);
+    if (workerCount > MAX_READER_WORKERS) {
+        workerCount = MAX_READER_WORKERS;
+    }
+    for (int i = 0; i < workerCount; i++) {
+        sp<WorkerThread> worker = new WorkerThread(this);
+        status_t result = worker->run("InputReaderWorker", PRIORITY_URGENT_DISPLAY);
+        if (result) {
+            ALOGE("Could not start input reader worker thread due to error %d.", result);
+            break;
+        }
+        mWorkers.push(worker);
+    }
 }
 
 InputReader::~InputReader() {
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        mWorkers[i]->requestExit();
+    }
+    { // acquire lock
+        AutoMutex _l(mWorkLock);
+        mWorkAvailableCondition.broadcast();
+    } // release lock
+    for (size_t i = 0; i < mWorkers.size(); i++) {
+        mWorkers[i]->join();
+    }
+    pthread_key_delete(mJobListenerKey);
+
     for (size_t i = 0; i < mDevices.size(); i++) {
         delete mDevices.valueAt(i);
     }
+
+    delete[] mEventBuffer;
 }
 
 void InputReader::loopOnce() {
@@ -281,7 +342,7 @@ void InputReader::loopOnce() {
         }
     } // release lock
 
-    size_t count = mEventHub->getEvents(timeoutMillis, mEventBuffer, EVENT_BUFFER_SIZE);
+    size_t count = mEventHub->getEvents(timeoutMillis, mEventBuffer, mEventBufferSize);
 
     { // acquire lock
         AutoMutex _l(mLock);
@@ -306,6 +367,14 @@ void InputReader::loopOnce() {
             inputDevicesChanged = true;
             getInputDevicesLocked(inputDevices);
         }
+
+        // A full buffer means that more events are probably waiting, so make room
+        // for them to be read in a single pass the next time around.
+        if (count == mEventBufferSize && mEventBufferSize < MAX_EVENT_BUFFER_SIZE) {
+            delete[] mEventBuffer;
+            mEventBufferSize *= 2;
+            mEventBuffer = new RawEvent[mEventBufferSize];
+        }
     } // release lock
 
     // Send out a message that the describes the changed input devices.
@@ -339,8 +408,15 @@ void InputReader::processEventsLocked(const RawEvent* rawEvents, size_t count) {
 #if DEBUG_RAW_EVENTS
             ALOGD("BatchSize: %d Count: %d", batchSize, count);
 #endif
-            processEventsForDeviceLocked(deviceId, rawEvent, batchSize);
+            if (mWorkers.isEmpty()) {
+                processEventsForDeviceLocked(deviceId, rawEvent, batchSize);
+            } else {
+                addDeviceJobLocked(deviceId, rawEvent, batchSize);
+            }
         } else {
+            // Device changes act as a barrier for the events being processed in parallel.
+            runDeviceJobsLocked();
+
             switch (rawEvent->type) {
             case EventHubInterface::DEVICE_ADDED:
                 addDeviceLocked(rawEvent->when, rawEvent->deviceId);
@@ -359,6 +435,7 @@ void InputReader::processEventsLocked(const RawEvent* rawEvents, size_t count) {
         count -= batchSize;
         rawEvent += batchSize;
     }
+    runDeviceJobsLocked();
 }
 
 void InputReader::addDeviceLocked(nsecs_t when, int32_t deviceId) {
@@ -488,6 +565,111 @@ void InputReader::processEventsForDeviceLocked(int32_t deviceId,
     device->process(rawEvents, count);
 }
 
+void InputReader::addDeviceJobLocked(int32_t deviceId,
+        const RawEvent* rawEvents, size_t count) {
+    ssize_t deviceIndex = mDevices.indexOfKey(deviceId);
+    if (deviceIndex < 0 || mDevices.valueAt(deviceIndex)->isIgnored()) {
+        processEventsForDeviceLocked(deviceId, rawEvents, count); // discards the events
+        return;
+    }
+
+    InputDevice* device = mDevices.valueAt(deviceIndex);
+    size_t jobIndex = 0;
+    while (jobIndex < mJobCount && mJobs[jobIndex].device != device) {
+        jobIndex += 1;
+    }
+    if (jobIndex == mJobCount) {
+        if (mJobCount == mJobs.size()) {
+            mJobs.push();
+            mJobs.editTop().listener = new QueuedInputListener(NULL);
+        }
+        DeviceJob& job = mJobs.editItemAt(mJobCount++);
+        job.device = device;
+        job.ranges.clear();
+    }
+
+    DeviceJob::Range range;
+    range.rawEvents = rawEvents;
+    range.count = count;
+    mJobs.editItemAt(jobIndex).ranges.push(range);
+}
+
+void InputReader::runDeviceJobsLocked() {
+    if (mJobCount == 0) {
+        return;
+    }
+
+    if (mJobCount == 1) {
+        // A single device is simply processed here, directly into the queued listener.
+        const DeviceJob& job = mJobs[0];
+        for (size_t i = 0; i < job.ranges.size(); i++) {
+            job.device->process(job.ranges[i].rawEvents, job.ranges[i].count);
+        }
+    } else {
+        mProcessingInParallel = true;
+        { // acquire lock
+            AutoMutex _l(mWorkLock);
+            mReadyJobs = mJobCount;
+            mNextJob = 0;
+            mPendingJobs = mJobCount;
+            mWorkAvailableCondition.broadcast();
+        } // release lock
+
+        // Help out instead of just waiting.
+        runDeviceJobs();
+
+        { // acquire lock
+            AutoMutex _l(mWorkLock);
+            while (mPendingJobs) {
+                mWorkDoneCondition.wait(mWorkLock);
+            }
+            mReadyJobs = 0;
+            mNextJob = 0;
+        } // release lock
+        mProcessingInParallel = false;
+
+        Vector<QueuedInputListener*> listeners;
+        listeners.setCapacity(mJobCount);
+        for (size_t i = 0; i < mJobCount; i++) {
+            listeners.push(mJobs[i].listener.get());
+        }
+        mQueuedListener->merge(listeners.array(), listeners.size());
+    }
+    mJobCount = 0;
+}
+
+void InputReader::runDeviceJobs() {
+    for (;;) {
+        DeviceJob* job;
+        { // acquire lock
+            AutoMutex _l(mWorkLock);
+            if (mNextJob >= mReadyJobs) {
+                return;
+            }
+            job = &mJobs.editItemAt(mNextJob++);
+        } // release lock
+
+        runDeviceJob(*job);
+
+        { // acquire lock
+            AutoMutex _l(mWorkLock);
+            mPendingJobs -= 1;
+            if (!mPendingJobs) {
+                mWorkDoneCondition.broadcast();
+            }
+        } // release lock
+    }
+}
+
+void InputReader::runDeviceJob(DeviceJob& job) {
+    // Events produced by the device's mappers go to the job's own listener.
+    pthread_setspecific(mJobListenerKey, job.listener.get());
+    for (size_t i = 0; i < job.ranges.size(); i++) {
+        job.device->process(job.ranges[i].rawEvents, job.ranges[i].count);
+    }
+    pthread_setspecific(mJobListenerKey, NULL);
+}
+
 void InputReader::timeoutExpiredLocked(nsecs_t when) {
     for (size_t i = 0; i < mDevices.size(); i++) {
         InputDevice* device = mDevices.valueAt(i);
@@ -792,39 +974,49 @@ InputReader::ContextImpl::ContextImpl(InputReader* reader) :
         mReader(reader) {
 }
 
+// The input loop holds the lock while the context is in use.  When devices are being
+// processed in parallel, the context lock also serializes the calls of the workers.
+
 void InputReader::ContextImpl::updateGlobalMetaState() {
     // lock is already held by the input loop
+    AutoConditionalMutex _l(mReader->mContextLock, mReader->mProcessingInParallel);
     mReader->updateGlobalMetaStateLocked();
 }
 
 int32_t InputReader::ContextImpl::getGlobalMetaState() {
     // lock is already held by the input loop
+    AutoConditionalMutex _l(mReader->mContextLock, mReader->mProcessingInParallel);
     return mReader->getGlobalMetaStateLocked();
 }
 
 void InputReader::ContextImpl::disableVirtualKeysUntil(nsecs_t time) {
     // lock is already held by the input loop
+    AutoConditionalMutex _l(mReader->mContextLock, mReader->mProcessingInParallel);
     mReader->disableVirtualKeysUntilLocked(time);
 }
 
 bool InputReader::ContextImpl::shouldDropVirtualKey(nsecs_t now,
         InputDevice* device, int32_t keyCode, int32_t scanCode) {
     // lock is already held by the input loop
+    AutoConditionalMutex _l(mReader->mContextLock, mReader->mProcessingInParallel);
     return mReader->shouldDropVirtualKeyLocked(now, device, keyCode, scanCode);
 }
 
 void InputReader::ContextImpl::fadePointer() {
     // lock is already held by the input loop
+    AutoConditionalMutex _l(mReader->mContextLock, mReader->mProcessingInParallel);
     mReader->fadePointerLocked();
 }
 
 void InputReader::ContextImpl::requestTimeoutAtTime(nsecs_t when) {
     // lock is already held by the input loop
+    AutoConditionalMutex _l(mReader->mContextLock, mReader->mProcessingInParallel);
     mReader->requestTimeoutAtTimeLocked(when);
 }
 
 int32_t InputReader::ContextImpl::bumpGeneration() {
     // lock is already held by the input loop
+    AutoConditionalMutex _l(mReader->mContextLock, mReader->mProcessingInParallel);
     return mReader->bumpGenerationLocked();
 }
 
@@ -833,6 +1025,11 @@ InputReaderPolicyInterface* InputReader::ContextImpl::getPolicy() {
 }
 
 InputListenerInterface* InputReader::ContextImpl::getListener() {
+    // Workers queue the events of each device separately so that they can be merged.
+    void* jobListener = pthread_getspecific(mReader->mJobListenerKey);
+    if (jobListener) {
+        return static_cast<QueuedInputListener*>(jobListener);
+    }
     return mReader->mQueuedListener.get();
 }
 
@@ -841,6 +1038,31 @@ EventHubInterface* InputReader::ContextImpl::getEventHub() {
 }
 
 
+// --- InputReader::WorkerThread ---
+
+InputReader::WorkerThread::WorkerThread(InputReader* reader) :
+        Thread(/*canCallJava*/ false), mReader(reader) {
+}
+
+InputReader::WorkerThread::~WorkerThread() {
+}
+
+bool InputReader::WorkerThread::threadLoop() {
+    { // acquire lock
+        AutoMutex _l(mReader->mWorkLock);
+        while (mReader->mNextJob >= mReader->mReadyJobs) {
+            if (exitPending()) {
+                return false;
+            }
+            mReader->mWorkAvailableCondition.wait(mReader->mWorkLock);
+        }
+    } // release lock
+
+    mReader->runDeviceJobs();
+    return true;
+}
+
+
 // --- InputReaderThread ---
 
 InputReaderThread::InputReaderThread(const sp<InputReaderInterface>& reader) :
@@ -3141,6 +3363,48 @@ void TouchInputMapper::configureSurface(nsecs_t when, bool* outResetNeeded) {
     }
 
     if (orientationChanged || sizeChanged || deviceModeChanged) {
+        // Compute the transform from raw coordinates onto the oriented surface
+        // that is applied to every pointer by cookPointerData().
+        SurfaceTransform& t = mSurfaceTransform;
+        switch (mSurfaceOrientation) {
+        case DISPLAY_ORIENTATION_90:
+            t.originX = mRawPointerAxes.x.maxValue;
+            t.originY = mRawPointerAxes.y.minValue;
+            t.xx = 0;
+            t.xy = mYScale;
+            t.yx = -mXScale;
+            t.yy = 0;
+            t.orientation = -M_PI_2;
+            break;
+        case DISPLAY_ORIENTATION_180:
+            t.originX = mRawPointerAxes.x.maxValue;
+            t.originY = mRawPointerAxes.y.maxValue;
+            t.xx = -mXScale;
+            t.xy = 0;
+            t.yx = 0;
+            t.yy = -mYScale;
+            t.orientation = 0;
+            break;
+        case DISPLAY_ORIENTATION_270:
+            t.originX = mRawPointerAxes.x.minValue;
+            t.originY = mRawPointerAxes.y.maxValue;
+            t.xx = 0;
+            t.xy = -mYScale;
+            t.yx = mXScale;
+            t.yy = 0;
+            t.orientation = M_PI_2;
+            break;
+        default:
+            t.originX = mRawPointerAxes.x.minValue;
+            t.originY = mRawPointerAxes.y.minValue;
+            t.xx = mXScale;
+            t.xy = 0;
+            t.yx = 0;
+            t.yy = mYScale;
+            t.orientation = 0;
+            break;
+        }
+
         // Compute oriented surface dimensions, precision, scales and ranges.
         // Note that the maximum value reported is an inclusive maximum value so it is one
         // unit less than the total width or height of surface.
@@ -4115,32 +4379,18 @@ void TouchInputMapper::cookPointerData() {
 
         // X and Y
         // Adjust coords for surface orientation.
-        float x, y;
-        switch (mSurfaceOrientation) {
-        case DISPLAY_ORIENTATION_90:
-            x = float(in.y - mRawPointerAxes.y.minValue) * mYScale;
-            y = float(mRawPointerAxes.x.maxValue - in.x) * mXScale;
-            orientation -= M_PI_2;
+        const SurfaceTransform& t = mSurfaceTransform;
+        float rawX = float(in.x - t.originX);
+        float rawY = float(in.y - t.originY);
+        float x = t.xx * rawX + t.xy * rawY;
+        float y = t.yx * rawX + t.yy * rawY;
+        if (t.orientation) {
+            orientation += t.orientation;
             if (orientation < - M_PI_2) {
                 orientation += M_PI;
-            }
-            break;
-        case DISPLAY_ORIENTATION_180:
-            x = float(mRawPointerAxes.x.maxValue - in.x) * mXScale;
-            y = float(mRawPointerAxes.y.maxValue - in.y) * mYScale;
-            break;
-        case DISPLAY_ORIENTATION_270:
-            x = float(mRawPointerAxes.y.maxValue - in.y) * mYScale;
-            y = float(in.x - mRawPointerAxes.x.minValue) * mXScale;
-            orientation += M_PI_2;
-            if (orientation > M_PI_2) {
+            } else if (orientation > M_PI_2) {
                 orientation -= M_PI;
             }
-            break;
-        default:
-            x = float(in.x - mRawPointerAxes.x.minValue) * mXScale;
-            y = float(in.y - mRawPointerAxes.y.minValue) * mYScale;
-            break;
         }
 
         // Write output coords.
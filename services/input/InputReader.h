@@ -34,6 +34,7 @@
 
 #include <stddef.h>
 #include <unistd.h>
+#include <pthread.h>
 
 // Maximum supported size of a vibration pattern.
 // Must be at least 2.
@@ -327,6 +328,11 @@ public:
  * uses a single Mutex to guard its state.  The Mutex may be held while calling into the
  * EventHub or the InputReaderPolicy but it is never held while calling into the
  * InputListener.
+ *
+ * When the "input.reader.workers" property is set, the raw events of different devices
+ * are processed concurrently by that many worker threads, while the input reader thread
+ * holds the Mutex.  Events of the same device are still processed in order, and the
+ * resulting events are merged back in order of their event times.
  */
 class InputReader : public InputReaderInterface {
 public:
@@ -385,8 +391,54 @@ protected:
     friend class ContextImpl;
 
 private:
+    class WorkerThread : public Thread {
+    public:
+        explicit WorkerThread(InputReader* reader);
+        virtual ~WorkerThread();
+
+    private:
+        InputReader* mReader;
+
+        virtual bool threadLoop();
+    };
+
+    // The raw events of one device to be processed by a worker.
+    struct DeviceJob {
+        struct Range {
+            const RawEvent* rawEvents;
+            size_t count;
+        };
+
+        InputDevice* device;
+        Vector<Range> ranges;
+        sp<QueuedInputListener> listener;
+    };
+
     Mutex mLock;
 
+    // Serializes access to the shared reader state by the workers through the context.
+    Mutex mContextLock;
+    bool mProcessingInParallel;
+
+    // The worker pool, or empty if all devices are processed on the reader thread.
+    Vector<sp<WorkerThread> > mWorkers;
+
+    // Jobs collected by the reader thread.  The first mJobCount entries are in use,
+    // and the others are kept to reuse their listeners.
+    Vector<DeviceJob> mJobs;
+    size_t mJobCount;
+
+    // Jobs handed off to the workers, guarded by mWorkLock.
+    Mutex mWorkLock;
+    Condition mWorkAvailableCondition;
+    Condition mWorkDoneCondition;
+    size_t mReadyJobs;
+    size_t mNextJob;
+    size_t mPendingJobs;
+
+    // Identifies the listener of the job that the current thread is processing.
+    pthread_key_t mJobListenerKey;
+
     Condition mReaderIsAliveCondition;
 
     sp<EventHubInterface> mEventHub;
@@ -395,9 +447,12 @@ private:
 
     InputReaderConfiguration mConfig;
 
-    // The event queue.
-    static const int EVENT_BUFFER_SIZE = 256;
-    RawEvent mEventBuffer[EVENT_BUFFER_SIZE];
+    // The event queue.  It starts out with room for EVENT_BUFFER_SIZE events and
+    // doubles, up to MAX_EVENT_BUFFER_SIZE, whenever a read fills it completely.
+    static const size_t EVENT_BUFFER_SIZE = 256;
+    static const size_t MAX_EVENT_BUFFER_SIZE = 2048;
+    RawEvent* mEventBuffer;
+    size_t mEventBufferSize;
 
     KeyedVector<int32_t, InputDevice*> mDevices;
 
@@ -407,6 +462,10 @@ private:
     void addDeviceLocked(nsecs_t when, int32_t deviceId);
     void removeDeviceLocked(nsecs_t when, int32_t deviceId);
     void processEventsForDeviceLocked(int32_t deviceId, const RawEvent* rawEvents, size_t count);
+    void addDeviceJobLocked(int32_t deviceId, const RawEvent* rawEvents, size_t count);
+    void runDeviceJobsLocked();
+    void runDeviceJobs();
+    void runDeviceJob(DeviceJob& job);
     void timeoutExpiredLocked(nsecs_t when);
 
     void handleConfigurationChangedLocked(nsecs_t when);
@@ -1305,6 +1364,17 @@ private:
     float mTiltYCenter;
     float mTiltYScale;
 
+    // Maps raw coordinates onto the oriented surface, set by configureSurface().
+    // The surface coordinates of a raw point p are M (p - origin), where origin is the
+    // raw point that ends up at the surface origin, and orientations are rotated by
+    // the orientation offset.
+    struct SurfaceTransform {
+        int32_t originX, originY;
+        float xx, xy;
+        float yx, yy;
+        float orientation;
+    } mSurfaceTransform;
+
     // Oriented motion ranges for input device info.
     struct OrientedRanges {
         InputDeviceInfo::MotionRange x;
@@ -43,6 +43,29 @@ bool InputWindowInfo::supportsSplitTouch() const {
     return layoutParamsFlags & FLAG_SPLIT_TOUCH;
 }
 
+bool InputWindowInfo::operator==(const InputWindowInfo& other) const {
+    return inputChannel == other.inputChannel
+            && name == other.name
+            && layoutParamsFlags == other.layoutParamsFlags
+            && layoutParamsType == other.layoutParamsType
+            && dispatchingTimeout == other.dispatchingTimeout
+            && frameLeft == other.frameLeft
+            && frameTop == other.frameTop
+            && frameRight == other.frameRight
+            && frameBottom == other.frameBottom
+            && scaleFactor == other.scaleFactor
+            && touchableRegion == other.touchableRegion
+            && visible == other.visible
+            && canReceiveKeys == other.canReceiveKeys
+            && hasFocus == other.hasFocus
+            && hasWallpaper == other.hasWallpaper
+            && paused == other.paused
+            && layer == other.layer
+            && ownerPid == other.ownerPid
+            && ownerUid == other.ownerUid
+            && inputFeatures == other.inputFeatures;
+}
+
 
 // --- InputWindowHandle ---
 
@@ -54,6 +77,24 @@ InputWindowHandle::~InputWindowHandle() {
     delete mInfo;
 }
 
+bool InputWindowHandle::updateInfo() {
+    InputWindowInfo info;
+    if (!readInfo(&info)) {
+        releaseInfo();
+        return false;
+    }
+    setInfo(info);
+    return true;
+}
+
+void InputWindowHandle::setInfo(const InputWindowInfo& info) {
+    if (!mInfo) {
+        mInfo = new InputWindowInfo(info);
+    } else {
+        *mInfo = info;
+    }
+}
+
 void InputWindowHandle::releaseInfo() {
     if (mInfo) {
         delete mInfo;
@@ -144,6 +144,11 @@ struct InputWindowInfo {
     bool isTrustedOverlay() const;
 
     bool supportsSplitTouch() const;
+
+    bool operator==(const InputWindowInfo& other) const;
+    inline bool operator!=(const InputWindowInfo& other) const {
+        return !(*this == other);
+    }
 };
 
 
@@ -182,7 +187,24 @@ public:
      *
      * Returns true on success, or false if the handle is no longer valid.
      */
-    virtual bool updateInfo() = 0;
+    bool updateInfo();
+
+    /**
+     * Reads the most current available information about the window into
+     * outInfo without changing the state of this object, so it may be called
+     * outside of the input dispatcher's critical section.
+     *
+     * Returns true on success, or false if the handle is no longer valid.
+     */
+    virtual bool readInfo(InputWindowInfo* outInfo) = 0;
+
+    /**
+     * Replaces the state of this object with information obtained from readInfo().
+     *
+     * This method should only be called from within the input dispatcher's
+     * critical section.
+     */
+    void setInfo(const InputWindowInfo& info);
 
     /**
      * Releases the storage used by the associated information when it is
@@ -125,6 +125,13 @@ void SpriteController::doUpdateSprites() {
         mLocked.invalidatedSprites.clear();
     } // release lock
 
+    // Moving the pointer only changes sprite positions, which does not need any of the
+    // surface bookkeeping below.
+    if (doUpdateSpritePositions(updates)) {
+        updates.clear();
+        return;
+    }
+
     // Create missing surfaces.
     bool surfaceChanged = false;
     for (size_t i = 0; i < numSprites; i++) {
@@ -344,6 +351,33 @@ void SpriteController::doUpdateSprites() {
     updates.clear();
 }
 
+bool SpriteController::doUpdateSpritePositions(const Vector<SpriteUpdate>& updates) {
+    size_t numSprites = updates.size();
+    for (size_t i = 0; i < numSprites; i++) {
+        const SpriteUpdate& update = updates.itemAt(i);
+        if (update.state.dirty != DIRTY_POSITION
+                || update.state.surfaceControl == NULL
+                || !update.state.surfaceVisible
+                || !update.state.surfaceDrawn
+                || !update.state.wantSurfaceVisible()) {
+            return false;
+        }
+    }
+
+    SurfaceComposerClient::openGlobalTransaction();
+    for (size_t i = 0; i < numSprites; i++) {
+        const SpriteUpdate& update = updates.itemAt(i);
+        status_t status = update.state.surfaceControl->setPosition(
+                update.state.positionX - update.state.icon.hotSpotX,
+                update.state.positionY - update.state.icon.hotSpotY);
+        if (status) {
+            ALOGE("Error %d setting sprite surface position.", status);
+        }
+    }
+    SurfaceComposerClient::closeGlobalTransaction();
+    return true;
+}
+
 void SpriteController::doDisposeSurfaces() {
     // Collect disposed surfaces.
     Vector<sp<SurfaceControl> > disposedSurfaces;
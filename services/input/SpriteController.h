@@ -282,6 +282,7 @@ private:
 
     void handleMessage(const Message& message);
     void doUpdateSprites();
+    bool doUpdateSpritePositions(const Vector<SpriteUpdate>& updates);
     void doDisposeSurfaces();
 
     void ensureSurfaceComposerClient();
@@ -36,13 +36,18 @@ static const int32_t INJECTOR_UID = 1001;
 
 class FakeInputDispatcherPolicy : public InputDispatcherPolicyInterface {
     InputDispatcherConfiguration mConfig;
+    size_t mInterceptCount;
 
 protected:
     virtual ~FakeInputDispatcherPolicy() {
     }
 
 public:
-    FakeInputDispatcherPolicy() {
+    FakeInputDispatcherPolicy() : mInterceptCount(0) {
+    }
+
+    size_t getInterceptCount() const {
+        return mInterceptCount;
     }
 
 private:
@@ -70,9 +75,11 @@ private:
     }
 
     virtual void interceptKeyBeforeQueueing(const KeyEvent* keyEvent, uint32_t& policyFlags) {
+        mInterceptCount += 1;
     }
 
     virtual void interceptMotionBeforeQueueing(nsecs_t when, uint32_t& policyFlags) {
+        mInterceptCount += 1;
     }
 
     virtual nsecs_t interceptKeyBeforeDispatching(const sp<InputWindowHandle>& inputWindowHandle,
@@ -243,4 +250,28 @@ TEST_F(InputDispatcherTest, InjectInputEvent_ValidatesMotionEvents) {
             << "Should reject motion events with duplicate pointer ids.";
 }
 
+TEST_F(InputDispatcherTest, InjectInputEvents_ValidatesBatch) {
+    KeyEvent validEvent;
+    validEvent.initialize(DEVICE_ID, AINPUT_SOURCE_KEYBOARD,
+            AKEY_EVENT_ACTION_DOWN, 0,
+            AKEYCODE_A, KEY_A, AMETA_NONE, 0, ARBITRARY_TIME, ARBITRARY_TIME);
+    KeyEvent invalidEvent;
+    invalidEvent.initialize(DEVICE_ID, AINPUT_SOURCE_KEYBOARD,
+            /*action*/ -1, 0,
+            AKEYCODE_A, KEY_A, AMETA_NONE, 0, ARBITRARY_TIME, ARBITRARY_TIME);
+
+    // Rejects empty batches.
+    ASSERT_EQ(INPUT_EVENT_INJECTION_FAILED, mDispatcher->injectInputEvents(NULL, 0,
+            INJECTOR_PID, INJECTOR_UID, INPUT_EVENT_INJECTION_SYNC_NONE, 0, 0))
+            << "Should reject empty batches.";
+
+    // Rejects the whole batch when any of its events is invalid.
+    const InputEvent* events[] = { &validEvent, &invalidEvent, &validEvent };
+    ASSERT_EQ(INPUT_EVENT_INJECTION_FAILED, mDispatcher->injectInputEvents(events, 3,
+            INJECTOR_PID, INJECTOR_UID, INPUT_EVENT_INJECTION_SYNC_NONE, 0, 0))
+            << "Should reject batches that contain an invalid event.";
+    ASSERT_EQ(size_t(0), mFakePolicy->getInterceptCount())
+            << "Should not intercept any event of a rejected batch.";
+}
+
 } // namespace android
@@ -0,0 +1,959 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a raw input event recording through the input reader and dispatcher
+ * and reports how long each stage of the pipeline took.
+ *
+ * Recordings are captured by the event hub when the "input.eventhub.record" property
+ * names a file at the time the system server starts, for example:
+ *
+ *     adb shell setprop input.eventhub.record /data/system/input.rec
+ *     adb shell stop && adb shell start
+ *
+ * The recording is then replayed one batch at a time, exactly as the reader originally
+ * received it from EventHub::getEvents().  Every event of a batch is stamped with the
+ * time at which the batch is handed to the reader and each cooked key or motion sample
+ * is followed through the pipeline:
+ *
+ *     cook      from the raw event time until the reader notifies the dispatcher
+ *     queue     from that notification until the sample is received from the input
+ *               channel of a synthetic full screen window, which includes publishing
+ *     total     from the raw event time until the sample is received
+ *
+ * The next batch is only replayed once all samples of the current batch have been
+ * received, so the results do not depend on thread scheduling.
+ */
+
+#define LOG_TAG "InputReplay"
+
+#include "../../EventRecording.h"
+#include "../../InputDispatcher.h"
+#include "../../InputReader.h"
+
+#include <androidfw/Input.h>
+#include <androidfw/InputTransport.h>
+#include <utils/List.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include <linux/input.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace android {
+
+// Time to wait for the dispatcher to publish the samples of a batch before they are
+// considered dropped.
+static const int SAMPLE_TIMEOUT_MILLIS = 500;
+
+// Dispatching timeout of the synthetic window.
+static const nsecs_t DISPATCHING_TIMEOUT = 5000 * 1000000LL; // 5 seconds
+
+
+static bool contains(const Vector<int32_t>& values, int32_t value) {
+    for (size_t i = 0; i < values.size(); i++) {
+        if (values.itemAt(i) == value) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// --- ReplayEventHub ---
+
+/*
+ * Presents the devices and raw events of a recording to the input reader.
+ *
+ * Only used from the thread that calls InputReader::loopOnce().
+ */
+class ReplayEventHub : public EventHubInterface {
+    struct Device {
+        RecordedDevice recorded;
+        KeyedVector<int32_t, int32_t> scanCodeStates;
+        KeyedVector<int32_t, int32_t> absoluteAxisValues;
+    };
+
+    const EventRecording* mRecording;
+    bool mPaced;
+    KeyedVector<int32_t, Device*> mDevices;
+
+    size_t mBatchIndex;
+    size_t mEventIndex;
+    nsecs_t mBatchTime;
+    nsecs_t mLastRecordedTime;
+    nsecs_t mLastReplayedTime;
+
+protected:
+    virtual ~ReplayEventHub() {
+        for (size_t i = 0; i < mDevices.size(); i++) {
+            delete mDevices.valueAt(i);
+        }
+    }
+
+public:
+    ReplayEventHub(const EventRecording* recording, bool paced) :
+            mRecording(recording), mPaced(paced),
+            mBatchIndex(0), mEventIndex(0), mBatchTime(0),
+            mLastRecordedTime(0), mLastReplayedTime(0) {
+    }
+
+    bool isFinished() const {
+        return mBatchIndex >= mRecording->getBatches().size();
+    }
+
+private:
+    const Device* getDevice(int32_t deviceId) const {
+        ssize_t index = mDevices.indexOfKey(deviceId);
+        return index >= 0 ? mDevices.valueAt(index) : NULL;
+    }
+
+    void addDevice(const RecordedDevice& recorded) {
+        Device* device = new Device();
+        device->recorded = recorded;
+        ssize_t index = mDevices.indexOfKey(recorded.id);
+        if (index >= 0) {
+            delete mDevices.valueAt(index);
+            mDevices.replaceValueAt(index, device);
+        } else {
+            mDevices.add(recorded.id, device);
+        }
+    }
+
+    void updateDeviceState(const RawEvent& event) {
+        ssize_t index = mDevices.indexOfKey(event.deviceId);
+        if (index < 0) {
+            return;
+        }
+        Device* device = mDevices.valueAt(index);
+        if (event.type == EV_KEY) {
+            device->scanCodeStates.replaceValueFor(event.code,
+                    event.value ? AKEY_STATE_DOWN : AKEY_STATE_UP);
+        } else if (event.type == EV_ABS) {
+            device->absoluteAxisValues.replaceValueFor(event.code, event.value);
+        }
+    }
+
+    void waitForBatchTime(nsecs_t recordedTime) {
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (mLastReplayedTime && recordedTime > mLastRecordedTime) {
+            nsecs_t delay = mLastReplayedTime + (recordedTime - mLastRecordedTime) - now;
+            if (delay > 0) {
+                usleep(delay / 1000);
+                now = systemTime(SYSTEM_TIME_MONOTONIC);
+            }
+        }
+        mLastRecordedTime = recordedTime;
+        mLastReplayedTime = now;
+    }
+
+    virtual uint32_t getDeviceClasses(int32_t deviceId) const {
+        const Device* device = getDevice(deviceId);
+        return device ? device->recorded.classes : 0;
+    }
+
+    virtual InputDeviceIdentifier getDeviceIdentifier(int32_t deviceId) const {
+        const Device* device = getDevice(deviceId);
+        return device ? device->recorded.identifier : InputDeviceIdentifier();
+    }
+
+    virtual void getConfiguration(int32_t deviceId, PropertyMap* outConfiguration) const {
+        outConfiguration->clear();
+        const Device* device = getDevice(deviceId);
+        if (device) {
+            const KeyedVector<String8, String8>& configuration = device->recorded.configuration;
+            for (size_t i = 0; i < configuration.size(); i++) {
+                outConfiguration->addProperty(configuration.keyAt(i), configuration.valueAt(i));
+            }
+        }
+    }
+
+    virtual status_t getAbsoluteAxisInfo(int32_t deviceId, int axis,
+            RawAbsoluteAxisInfo* outAxisInfo) const {
+        outAxisInfo->clear();
+        const Device* device = getDevice(deviceId);
+        if (device) {
+            ssize_t index = device->recorded.absoluteAxes.indexOfKey(axis);
+            if (index >= 0) {
+                *outAxisInfo = device->recorded.absoluteAxes.valueAt(index);
+                return OK;
+            }
+        }
+        return -1;
+    }
+
+    virtual bool hasRelativeAxis(int32_t deviceId, int axis) const {
+        const Device* device = getDevice(deviceId);
+        return device && contains(device->recorded.relativeAxes, axis);
+    }
+
+    virtual bool hasInputProperty(int32_t deviceId, int property) const {
+        const Device* device = getDevice(deviceId);
+        return device && contains(device->recorded.inputProperties, property);
+    }
+
+    virtual status_t mapKey(int32_t deviceId, int32_t scanCode, int32_t usageCode,
+            int32_t* outKeycode, uint32_t* outFlags) const {
+        const Device* device = getDevice(deviceId);
+        if (device) {
+            ssize_t index = device->recorded.keys.indexOfKey(scanCode);
+            if (index >= 0 && device->recorded.keys.valueAt(index).keyCode != AKEYCODE_UNKNOWN) {
+                const RecordedKey& key = device->recorded.keys.valueAt(index);
+                *outKeycode = key.keyCode;
+                *outFlags = key.flags;
+                return NO_ERROR;
+            }
+        }
+        *outKeycode = 0;
+        *outFlags = 0;
+        return NAME_NOT_FOUND;
+    }
+
+    virtual status_t mapAxis(int32_t deviceId, int32_t scanCode,
+            AxisInfo* outAxisInfo) const {
+        // Joystick axis mappings are not part of the recording.
+        return NAME_NOT_FOUND;
+    }
+
+    virtual void setExcludedDevices(const Vector<String8>& devices) {
+    }
+
+    virtual size_t getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSize) {
+        const Vector<RecordedBatch>& batches = mRecording->getBatches();
+        if (mBatchIndex >= batches.size()) {
+            return 0;
+        }
+
+        const RecordedBatch& batch = batches.itemAt(mBatchIndex);
+        if (mEventIndex == 0) {
+            if (mPaced && !batch.events.isEmpty()) {
+                waitForBatchTime(batch.events.itemAt(0).when);
+            }
+            for (size_t i = 0; i < batch.devices.size(); i++) {
+                addDevice(batch.devices.itemAt(i));
+            }
+            mBatchTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        }
+
+        // The reader may have a smaller buffer than the one the batch was recorded with,
+        // in which case the batch is returned over several calls.
+        size_t count = 0;
+        while (count < bufferSize && mEventIndex < batch.events.size()) {
+            RawEvent& event = buffer[count++];
+            event = batch.events.itemAt(mEventIndex++);
+            event.when = mBatchTime;
+            updateDeviceState(event);
+        }
+
+        if (mEventIndex >= batch.events.size()) {
+            mBatchIndex += 1;
+            mEventIndex = 0;
+        }
+        return count;
+    }
+
+    virtual int32_t getScanCodeState(int32_t deviceId, int32_t scanCode) const {
+        const Device* device = getDevice(deviceId);
+        if (!device) {
+            return AKEY_STATE_UNKNOWN;
+        }
+        return device->scanCodeStates.valueFor(scanCode); // AKEY_STATE_UP if never pressed
+    }
+
+    virtual int32_t getKeyCodeState(int32_t deviceId, int32_t keyCode) const {
+        const Device* device = getDevice(deviceId);
+        if (!device) {
+            return AKEY_STATE_UNKNOWN;
+        }
+        for (size_t i = 0; i < device->recorded.keys.size(); i++) {
+            if (device->recorded.keys.valueAt(i).keyCode == keyCode
+                    && device->scanCodeStates.valueFor(device->recorded.keys.keyAt(i))
+                            == AKEY_STATE_DOWN) {
+                return AKEY_STATE_DOWN;
+            }
+        }
+        return AKEY_STATE_UP;
+    }
+
+    virtual int32_t getSwitchState(int32_t deviceId, int32_t sw) const {
+        return getDevice(deviceId) ? AKEY_STATE_UP : AKEY_STATE_UNKNOWN;
+    }
+
+    virtual status_t getAbsoluteAxisValue(int32_t deviceId, int32_t axis,
+            int32_t* outValue) const {
+        *outValue = 0;
+        const Device* device = getDevice(deviceId);
+        if (device) {
+            ssize_t index = device->absoluteAxisValues.indexOfKey(axis);
+            if (index >= 0) {
+                *outValue = device->absoluteAxisValues.valueAt(index);
+                return OK;
+            }
+        }
+        return -1;
+    }
+
+    virtual bool markSupportedKeyCodes(int32_t deviceId, size_t numCodes, const int32_t* keyCodes,
+            uint8_t* outFlags) const {
+        const Device* device = getDevice(deviceId);
+        if (!device) {
+            return false;
+        }
+        for (size_t i = 0; i < numCodes; i++) {
+            for (size_t j = 0; j < device->recorded.keys.size(); j++) {
+                if (device->recorded.keys.valueAt(j).keyCode == keyCodes[i]) {
+                    outFlags[i] = 1;
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+    virtual bool hasScanCode(int32_t deviceId, int32_t scanCode) const {
+        const Device* device = getDevice(deviceId);
+        return device && device->recorded.keys.indexOfKey(scanCode) >= 0;
+    }
+
+    virtual bool hasLed(int32_t deviceId, int32_t led) const {
+        return false;
+    }
+
+    virtual void setLedState(int32_t deviceId, int32_t led, bool on) {
+    }
+
+    virtual void getVirtualKeyDefinitions(int32_t deviceId,
+            Vector<VirtualKeyDefinition>& outVirtualKeys) const {
+        outVirtualKeys.clear();
+    }
+
+    virtual sp<KeyCharacterMap> getKeyCharacterMap(int32_t deviceId) const {
+        return NULL;
+    }
+
+    virtual bool setKeyboardLayoutOverlay(int32_t deviceId, const sp<KeyCharacterMap>& map) {
+        return false;
+    }
+
+    virtual void vibrate(int32_t deviceId, nsecs_t duration) {
+    }
+
+    virtual void cancelVibrate(int32_t deviceId) {
+    }
+
+    virtual void requestReopenDevices() {
+    }
+
+    virtual void wake() {
+    }
+
+    virtual void dump(String8& dump) {
+        dump.appendFormat("Replay Event Hub: batch %d of %d\n",
+                mBatchIndex, mRecording->getBatches().size());
+    }
+
+    virtual void monitor() {
+    }
+};
+
+
+// --- ReplayPointerController ---
+
+class ReplayPointerController : public PointerControllerInterface {
+    float mMaxX, mMaxY;
+    float mX, mY;
+    int32_t mButtonState;
+
+protected:
+    virtual ~ReplayPointerController() { }
+
+public:
+    ReplayPointerController(int32_t width, int32_t height) :
+            mMaxX(width - 1), mMaxY(height - 1), mX(0), mY(0), mButtonState(0) {
+    }
+
+private:
+    virtual bool getBounds(float* outMinX, float* outMinY,
+            float* outMaxX, float* outMaxY) const {
+        *outMinX = 0;
+        *outMinY = 0;
+        *outMaxX = mMaxX;
+        *outMaxY = mMaxY;
+        return true;
+    }
+
+    virtual void move(float deltaX, float deltaY) {
+        setPosition(mX + deltaX, mY + deltaY);
+    }
+
+    virtual void setButtonState(int32_t buttonState) {
+        mButtonState = buttonState;
+    }
+
+    virtual int32_t getButtonState() const {
+        return mButtonState;
+    }
+
+    virtual void setPosition(float x, float y) {
+        mX = x < 0 ? 0 : x > mMaxX ? mMaxX : x;
+        mY = y < 0 ? 0 : y > mMaxY ? mMaxY : y;
+    }
+
+    virtual void getPosition(float* outX, float* outY) const {
+        *outX = mX;
+        *outY = mY;
+    }
+
+    virtual void fade(Transition transition) {
+    }
+
+    virtual void unfade(Transition transition) {
+    }
+
+    virtual void setPresentation(Presentation presentation) {
+    }
+
+    virtual void setSpots(const PointerCoords* spotCoords,
+            const uint32_t* spotIdToIndex, BitSet32 spotIdBits) {
+    }
+
+    virtual void clearSpots() {
+    }
+};
+
+
+// --- ReplayReaderPolicy ---
+
+class ReplayReaderPolicy : public InputReaderPolicyInterface {
+    int32_t mDisplayWidth;
+    int32_t mDisplayHeight;
+    KeyedVector<int32_t, sp<PointerControllerInterface> > mPointerControllers;
+
+protected:
+    virtual ~ReplayReaderPolicy() { }
+
+public:
+    ReplayReaderPolicy(int32_t displayWidth, int32_t displayHeight) :
+            mDisplayWidth(displayWidth), mDisplayHeight(displayHeight) {
+    }
+
+private:
+    virtual void getReaderConfiguration(InputReaderConfiguration* outConfig) {
+        outConfig->setDisplayInfo(0, false /*external*/,
+                mDisplayWidth, mDisplayHeight, DISPLAY_ORIENTATION_0);
+    }
+
+    virtual sp<PointerControllerInterface> obtainPointerController(int32_t deviceId) {
+        ssize_t index = mPointerControllers.indexOfKey(deviceId);
+        if (index >= 0) {
+            return mPointerControllers.valueAt(index);
+        }
+        sp<PointerControllerInterface> controller =
+                new ReplayPointerController(mDisplayWidth, mDisplayHeight);
+        mPointerControllers.add(deviceId, controller);
+        return controller;
+    }
+
+    virtual void notifyInputDevicesChanged(const Vector<InputDeviceInfo>& inputDevices) {
+    }
+
+    virtual sp<KeyCharacterMap> getKeyboardLayoutOverlay(const String8& inputDeviceDescriptor) {
+        return NULL;
+    }
+
+    virtual String8 getDeviceAlias(const InputDeviceIdentifier& identifier) {
+        return String8::empty();
+    }
+};
+
+
+// --- ReplayDispatcherPolicy ---
+
+/*
+ * Passes every event on to the focused or touched window, like the window manager
+ * policy does for an unlocked, awake device.
+ */
+class ReplayDispatcherPolicy : public InputDispatcherPolicyInterface {
+    InputDispatcherConfiguration mConfig;
+
+protected:
+    virtual ~ReplayDispatcherPolicy() { }
+
+public:
+    ReplayDispatcherPolicy() { }
+
+private:
+    virtual void notifyConfigurationChanged(nsecs_t when) {
+    }
+
+    virtual nsecs_t notifyANR(const sp<InputApplicationHandle>& inputApplicationHandle,
+            const sp<InputWindowHandle>& inputWindowHandle) {
+        return 0;
+    }
+
+    virtual void notifyInputChannelBroken(const sp<InputWindowHandle>& inputWindowHandle) {
+    }
+
+    virtual void getDispatcherConfiguration(InputDispatcherConfiguration* outConfig) {
+        *outConfig = mConfig;
+    }
+
+    virtual bool isKeyRepeatEnabled() {
+        // Synthetic repeats would depend on timing rather than on the recording.
+        return false;
+    }
+
+    virtual bool filterInputEvent(const InputEvent* inputEvent, uint32_t policyFlags) {
+        return true;
+    }
+
+    virtual void interceptKeyBeforeQueueing(const KeyEvent* keyEvent, uint32_t& policyFlags) {
+        policyFlags |= POLICY_FLAG_PASS_TO_USER;
+    }
+
+    virtual void interceptMotionBeforeQueueing(nsecs_t when, uint32_t& policyFlags) {
+        policyFlags |= POLICY_FLAG_PASS_TO_USER;
+    }
+
+    virtual nsecs_t interceptKeyBeforeDispatching(const sp<InputWindowHandle>& inputWindowHandle,
+            const KeyEvent* keyEvent, uint32_t policyFlags) {
+        return 0;
+    }
+
+    virtual bool dispatchUnhandledKey(const sp<InputWindowHandle>& inputWindowHandle,
+            const KeyEvent* keyEvent, uint32_t policyFlags, KeyEvent* outFallbackKeyEvent) {
+        return false;
+    }
+
+    virtual void notifySwitch(nsecs_t when,
+            int32_t switchCode, int32_t switchValue, uint32_t policyFlags) {
+    }
+
+    virtual void pokeUserActivity(nsecs_t eventTime, int32_t eventType) {
+    }
+
+    virtual bool checkInjectEventsPermissionNonReentrant(
+            int32_t injectorPid, int32_t injectorUid) {
+        return false;
+    }
+};
+
+
+// --- ReplayApplicationHandle ---
+
+class ReplayApplicationHandle : public InputApplicationHandle {
+public:
+    ReplayApplicationHandle() { }
+    virtual ~ReplayApplicationHandle() { }
+
+    virtual bool updateInfo() {
+        if (!mInfo) {
+            mInfo = new InputApplicationInfo();
+        }
+        mInfo->name.setTo("Replay Application");
+        mInfo->dispatchingTimeout = DISPATCHING_TIMEOUT;
+        return true;
+    }
+};
+
+
+// --- ReplayWindowHandle ---
+
+/*
+ * A focused window that covers the whole display.
+ */
+class ReplayWindowHandle : public InputWindowHandle {
+    sp<InputChannel> mInputChannel;
+    int32_t mWidth;
+    int32_t mHeight;
+
+public:
+    ReplayWindowHandle(const sp<InputApplicationHandle>& inputApplicationHandle,
+            const sp<InputChannel>& inputChannel, int32_t width, int32_t height) :
+            InputWindowHandle(inputApplicationHandle),
+            mInputChannel(inputChannel), mWidth(width), mHeight(height) {
+    }
+
+    virtual ~ReplayWindowHandle() { }
+
+    virtual bool readInfo(InputWindowInfo* outInfo) {
+        outInfo->inputChannel = mInputChannel;
+        outInfo->name.setTo("Replay Window");
+        outInfo->layoutParamsFlags = InputWindowInfo::FLAG_SPLIT_TOUCH;
+        outInfo->layoutParamsType = InputWindowInfo::TYPE_APPLICATION;
+        outInfo->dispatchingTimeout = DISPATCHING_TIMEOUT;
+        outInfo->frameLeft = 0;
+        outInfo->frameTop = 0;
+        outInfo->frameRight = mWidth;
+        outInfo->frameBottom = mHeight;
+        outInfo->scaleFactor = 1.0f;
+        outInfo->touchableRegion.setRect(0, 0, mWidth, mHeight);
+        outInfo->visible = true;
+        outInfo->canReceiveKeys = true;
+        outInfo->hasFocus = true;
+        outInfo->hasWallpaper = false;
+        outInfo->paused = false;
+        outInfo->layer = 1;
+        outInfo->ownerPid = getpid();
+        outInfo->ownerUid = getuid();
+        outInfo->inputFeatures = 0;
+        return true;
+    }
+};
+
+
+// --- LatencyStage ---
+
+/*
+ * Collects the latencies measured for one stage of the pipeline.
+ */
+class LatencyStage {
+public:
+    explicit LatencyStage(const char* name) : mName(name) { }
+
+    void add(nsecs_t latency) {
+        mLatencies.push(latency);
+    }
+
+    // Gets the latency that the given percentage of the samples do not exceed.
+    nsecs_t getPercentile(int percent) {
+        if (mLatencies.isEmpty()) {
+            return 0;
+        }
+        mLatencies.sort(compareLatencies);
+        size_t index = (mLatencies.size() - 1) * percent / 100;
+        return mLatencies.itemAt(index);
+    }
+
+    void dump() {
+        nsecs_t sum = 0;
+        for (size_t i = 0; i < mLatencies.size(); i++) {
+            sum += mLatencies.itemAt(i);
+        }
+        nsecs_t mean = mLatencies.isEmpty() ? 0 : sum / nsecs_t(mLatencies.size());
+        printf("%-8s %8d %10.1f %10.1f %10.1f %10.1f %10.1f\n", mName,
+                mLatencies.size(), mean * 0.001f,
+                getPercentile(50) * 0.001f, getPercentile(90) * 0.001f,
+                getPercentile(99) * 0.001f, getPercentile(100) * 0.001f);
+    }
+
+private:
+    const char* mName;
+    Vector<nsecs_t> mLatencies;
+
+    static int compareLatencies(const nsecs_t* a, const nsecs_t* b) {
+        return *a < *b ? -1 : *a > *b ? 1 : 0;
+    }
+};
+
+
+// --- ReplayListener ---
+
+/*
+ * Notes when the reader hands each key and motion sample to the dispatcher.
+ */
+class ReplayListener : public InputListenerInterface {
+public:
+    struct Sample {
+        nsecs_t eventTime;
+        nsecs_t notifyTime;
+    };
+
+    explicit ReplayListener(const sp<InputListenerInterface>& innerListener) :
+            mInnerListener(innerListener) {
+    }
+
+    List<Sample>& getPendingSamples() {
+        return mPendingSamples;
+    }
+
+protected:
+    virtual ~ReplayListener() { }
+
+private:
+    sp<InputListenerInterface> mInnerListener;
+    List<Sample> mPendingSamples;
+
+    void addSample(nsecs_t eventTime) {
+        Sample sample;
+        sample.eventTime = eventTime;
+        sample.notifyTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        mPendingSamples.push_back(sample);
+    }
+
+    virtual void notifyConfigurationChanged(const NotifyConfigurationChangedArgs* args) {
+        mInnerListener->notifyConfigurationChanged(args);
+    }
+
+    virtual void notifyKey(const NotifyKeyArgs* args) {
+        addSample(args->eventTime);
+        mInnerListener->notifyKey(args);
+    }
+
+    virtual void notifyMotion(const NotifyMotionArgs* args) {
+        addSample(args->eventTime);
+        mInnerListener->notifyMotion(args);
+    }
+
+    virtual void notifySwitch(const NotifySwitchArgs* args) {
+        mInnerListener->notifySwitch(args);
+    }
+
+    virtual void notifyDeviceReset(const NotifyDeviceResetArgs* args) {
+        mInnerListener->notifyDeviceReset(args);
+    }
+};
+
+
+// --- InputReplay ---
+
+struct ReplayOptions {
+    int iterations;
+    bool paced;
+    int32_t displayWidth;
+    int32_t displayHeight;
+    nsecs_t maxTotalLatency; // 99th percentile limit, or 0 for none
+
+    ReplayOptions() :
+            iterations(1), paced(false), displayWidth(1280), displayHeight(720),
+            maxTotalLatency(0) {
+    }
+};
+
+class InputReplay {
+public:
+    InputReplay(const EventRecording* recording, const ReplayOptions& options) :
+            mRecording(recording), mOptions(options),
+            mCookStage("cook"), mQueueStage("queue"), mTotalStage("total"),
+            mDroppedSampleCount(0), mUnmatchedSampleCount(0) {
+    }
+
+    status_t run() {
+        for (int i = 0; i < mOptions.iterations; i++) {
+            status_t status = runOnce();
+            if (status) {
+                return status;
+            }
+        }
+        return OK;
+    }
+
+    // Prints the results and returns false if they exceed the latency limit.
+    bool report() {
+        printf("Replayed %d raw events in %d batches, %d time(s).\n",
+                mRecording->getEventCount(), mRecording->getBatches().size(),
+                mOptions.iterations);
+        printf("%-8s %8s %10s %10s %10s %10s %10s\n",
+                "stage", "samples", "mean(us)", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+        mCookStage.dump();
+        mQueueStage.dump();
+        mTotalStage.dump();
+        if (mDroppedSampleCount || mUnmatchedSampleCount) {
+            printf("%d sample(s) were not published, %d unexpected sample(s) were received.\n",
+                    mDroppedSampleCount, mUnmatchedSampleCount);
+        }
+
+        if (mOptions.maxTotalLatency) {
+            nsecs_t latency = mTotalStage.getPercentile(99);
+            if (latency > mOptions.maxTotalLatency) {
+                printf("FAILED: p99 total latency %0.1fus exceeds the limit of %0.1fus.\n",
+                        latency * 0.001f, mOptions.maxTotalLatency * 0.001f);
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    typedef ReplayListener::Sample Sample;
+
+    const EventRecording* mRecording;
+    ReplayOptions mOptions;
+
+    LatencyStage mCookStage;
+    LatencyStage mQueueStage;
+    LatencyStage mTotalStage;
+    size_t mDroppedSampleCount;
+    size_t mUnmatchedSampleCount;
+
+    status_t runOnce() {
+        sp<InputChannel> serverChannel, clientChannel;
+        status_t status = InputChannel::openInputChannelPair(String8("replay"),
+                serverChannel, clientChannel);
+        if (status) {
+            fprintf(stderr, "Could not open input channel pair, status=%d\n", status);
+            return status;
+        }
+
+        sp<ReplayEventHub> eventHub = new ReplayEventHub(mRecording, mOptions.paced);
+        sp<InputDispatcher> dispatcher = new InputDispatcher(new ReplayDispatcherPolicy());
+        sp<ReplayListener> listener = new ReplayListener(dispatcher);
+        sp<InputReader> reader = new InputReader(eventHub,
+                new ReplayReaderPolicy(mOptions.displayWidth, mOptions.displayHeight),
+                listener);
+
+        sp<InputApplicationHandle> application = new ReplayApplicationHandle();
+        Vector<sp<InputWindowHandle> > windows;
+        windows.push(new ReplayWindowHandle(application, serverChannel,
+                mOptions.displayWidth, mOptions.displayHeight));
+
+        status = dispatcher->registerInputChannel(serverChannel, windows.itemAt(0), false);
+        if (status) {
+            fprintf(stderr, "Could not register input channel, status=%d\n", status);
+            return status;
+        }
+        dispatcher->setFocusedApplication(application);
+        dispatcher->setInputWindows(windows);
+        dispatcher->setInputDispatchMode(true /*enabled*/, false /*frozen*/);
+
+        sp<InputDispatcherThread> dispatcherThread = new InputDispatcherThread(dispatcher);
+        status = dispatcherThread->run("InputDispatcher", PRIORITY_URGENT_DISPLAY);
+        if (status) {
+            fprintf(stderr, "Could not start dispatcher thread, status=%d\n", status);
+            return status;
+        }
+
+        InputConsumer consumer(clientChannel);
+        while (!eventHub->isFinished()) {
+            reader->loopOnce();
+            receiveSamples(consumer, listener->getPendingSamples());
+        }
+
+        dispatcherThread->requestExit();
+        dispatcher->monitor(); // wakes the dispatcher so that the thread can exit
+        dispatcherThread->join();
+
+        dispatcher->unregisterInputChannel(serverChannel);
+        return OK;
+    }
+
+    void receiveSamples(InputConsumer& consumer, List<Sample>& pendingSamples) {
+        PreallocatedInputEventFactory factory;
+        while (!pendingSamples.empty()) {
+            uint32_t seq;
+            InputEvent* event;
+            status_t status = consumer.consume(&factory, true /*consumeBatches*/, -1,
+                    &seq, &event);
+            if (status == WOULD_BLOCK) {
+                struct pollfd pfd;
+                pfd.fd = consumer.getChannel()->getFd();
+                pfd.events = POLLIN;
+                if (poll(&pfd, 1, SAMPLE_TIMEOUT_MILLIS) <= 0) {
+                    mDroppedSampleCount += pendingSamples.size();
+                    pendingSamples.clear();
+                }
+                continue;
+            }
+            if (status) {
+                fprintf(stderr, "Could not consume input event, status=%d\n", status);
+                mDroppedSampleCount += pendingSamples.size();
+                pendingSamples.clear();
+                return;
+            }
+
+            nsecs_t receiveTime = systemTime(SYSTEM_TIME_MONOTONIC);
+            if (event->getType() == AINPUT_EVENT_TYPE_MOTION) {
+                const MotionEvent* motionEvent = static_cast<const MotionEvent*>(event);
+                for (size_t h = 0; h < motionEvent->getHistorySize(); h++) {
+                    addSample(pendingSamples, motionEvent->getHistoricalEventTime(h),
+                            receiveTime);
+                }
+                addSample(pendingSamples, motionEvent->getEventTime(), receiveTime);
+            } else {
+                addSample(pendingSamples, static_cast<const KeyEvent*>(event)->getEventTime(),
+                        receiveTime);
+            }
+            consumer.sendFinishedSignal(seq, true);
+        }
+    }
+
+    void addSample(List<Sample>& pendingSamples, nsecs_t eventTime, nsecs_t receiveTime) {
+        // Samples arrive in the order they were notified; anything else, such as a
+        // cancellation synthesized by the dispatcher, is not part of the replay.
+        if (pendingSamples.empty() || pendingSamples.begin()->eventTime != eventTime) {
+            mUnmatchedSampleCount += 1;
+            return;
+        }
+
+        const Sample& sample = *pendingSamples.begin();
+        mCookStage.add(sample.notifyTime - sample.eventTime);
+        mQueueStage.add(receiveTime - sample.notifyTime);
+        mTotalStage.add(receiveTime - sample.eventTime);
+        pendingSamples.erase(pendingSamples.begin());
+    }
+};
+
+} // namespace android
+
+using namespace android;
+
+static void usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-n iterations] [-p] [-d WIDTHxHEIGHT] [-l p99-limit-us] "
+            "recording\n"
+            "  -n  replay the recording this many times\n"
+            "  -p  wait between batches as long as they were apart when recorded\n"
+            "  -d  size of the display and of the synthetic window, default 1280x720\n"
+            "  -l  exit with an error if the 99th percentile total latency exceeds\n"
+            "      this many microseconds\n", name);
+}
+
+int main(int argc, char** argv) {
+    ReplayOptions options;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:pd:l:")) != -1) {
+        switch (opt) {
+        case 'n':
+            options.iterations = atoi(optarg);
+            break;
+        case 'p':
+            options.paced = true;
+            break;
+        case 'd':
+            if (sscanf(optarg, "%dx%d", &options.displayWidth, &options.displayHeight) != 2) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'l':
+            options.maxTotalLatency = atoll(optarg) * 1000LL;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (optind != argc - 1 || options.iterations < 1
+            || options.displayWidth <= 0 || options.displayHeight <= 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    EventRecording* recording;
+    status_t status = EventRecording::load(argv[optind], &recording);
+    if (status) {
+        fprintf(stderr, "Could not load recording '%s', status=%d\n", argv[optind], status);
+        return 1;
+    }
+
+    InputReplay replay(recording, options);
+    status = replay.run();
+    bool passed = !status && replay.report();
+    delete recording;
+    return passed ? 0 : 1;
+}
@@ -21,6 +21,7 @@
 #include "jni.h"
 #include <utils/Log.h>
 #include <utils/misc.h>
+#include <utils/threads.h>
 
 #include <fcntl.h>
 #include <stdio.h>
@@ -37,6 +38,13 @@
 
 namespace android {
 
+// The service reprograms the next alarm of a type whenever its alarm list
+// changes, which mostly leaves the deadline as it was. The deadlines last
+// programmed are kept so such calls do not go to the driver.
+static Mutex gProgrammedLock;
+static bool gProgrammedValid[ANDROID_ALARM_TYPE_COUNT];
+static struct timespec gProgrammed[ANDROID_ALARM_TYPE_COUNT];
+
 static jint android_server_AlarmManagerService_setKernelTimezone(JNIEnv* env, jobject obj, jint fd, jint minswest)
 {
     struct timezone tz;
@@ -57,6 +65,9 @@ static jint android_server_AlarmManagerService_setKernelTimezone(JNIEnv* env, jo
 
 static jint android_server_AlarmManagerService_init(JNIEnv* env, jobject obj)
 {
+    Mutex::Autolock _l(gProgrammedLock);
+    memset(gProgrammedValid, 0, sizeof(gProgrammedValid));
+
     return open("/dev/alarm", O_RDWR);
 }
 
@@ -71,11 +82,22 @@ static void android_server_AlarmManagerService_set(JNIEnv* env, jobject obj, jin
     ts.tv_sec = seconds;
     ts.tv_nsec = nanoseconds;
 
+    Mutex::Autolock _l(gProgrammedLock);
+    bool cacheable = type >= 0 && type < ANDROID_ALARM_TYPE_COUNT;
+    if (cacheable && gProgrammedValid[type] && gProgrammed[type].tv_sec == ts.tv_sec
+            && gProgrammed[type].tv_nsec == ts.tv_nsec) {
+        return;
+    }
+
 	int result = ioctl(fd, ANDROID_ALARM_SET(type), &ts);
 	if (result < 0)
 	{
         ALOGE("Unable to set alarm to %lld.%09lld: %s\n", seconds, nanoseconds, strerror(errno));
     }
+    if (cacheable) {
+        gProgrammedValid[type] = result >= 0;
+        gProgrammed[type] = ts;
+    }
 }
 
 static jint android_server_AlarmManagerService_waitForAlarm(JNIEnv* env, jobject obj, jint fd)
@@ -93,6 +115,17 @@ static jint android_server_AlarmManagerService_waitForAlarm(JNIEnv* env, jobject
         return 0;
     }
 
+    // The alarms that fired are no longer programmed, and a change of the
+    // wall clock moves every deadline.
+    {
+        Mutex::Autolock _l(gProgrammedLock);
+        for (int type = 0; type < ANDROID_ALARM_TYPE_COUNT; type++) {
+            if ((result & (1 << type)) || (result & ANDROID_ALARM_TIME_CHANGE_MASK)) {
+                gProgrammedValid[type] = false;
+            }
+        }
+    }
+
     return result;
 }
 
@@ -20,6 +20,7 @@
 #include "jni.h"
 #include <utils/Log.h>
 #include <utils/misc.h>
+#include <utils/threads.h>
 
 #include <fcntl.h>
 #include <stdio.h>
@@ -184,13 +185,97 @@ static int readFromFile(const char* path, char* buf, size_t size)
     return count;
 }
 
+// The power supply attributes are read on every uevent, so their files are
+// kept open and read again from the start rather than reopened each time.
+// sysfs regenerates the contents of an attribute on a read at offset 0.
+struct CachedFile {
+    const char* path;
+    int fd;
+};
+
+static const int MAX_CACHED_FILES = 16;
+static CachedFile gCachedFiles[MAX_CACHED_FILES];
+static int gCachedFileCount = 0;
+static Mutex gCachedFileLock;
+
+static int getCachedFd(const char* path)
+{
+    for (int i = 0; i < gCachedFileCount; i++) {
+        if (gCachedFiles[i].path == path)
+            return gCachedFiles[i].fd;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC, 0);
+    if (fd == -1) {
+        ALOGE("Could not open '%s'", path);
+        return -1;
+    }
+    if (gCachedFileCount == MAX_CACHED_FILES)
+        return fd;
+
+    gCachedFiles[gCachedFileCount].path = path;
+    gCachedFiles[gCachedFileCount].fd = fd;
+    gCachedFileCount++;
+    return fd;
+}
+
+static void closeCachedFd(const char* path, int fd)
+{
+    for (int i = 0; i < gCachedFileCount; i++) {
+        if (gCachedFiles[i].path == path) {
+            gCachedFiles[i] = gCachedFiles[--gCachedFileCount];
+            break;
+        }
+    }
+    close(fd);
+}
+
+static bool isCachedFd(const char* path)
+{
+    for (int i = 0; i < gCachedFileCount; i++) {
+        if (gCachedFiles[i].path == path)
+            return true;
+    }
+    return false;
+}
+
+// Same as readFromFile() for the paths in gPaths, which must stay valid.
+// Callers hold gCachedFileLock.
+static int readFromCachedFile(const char* path, char* buf, size_t size)
+{
+    if (!path)
+        return -1;
+
+    ssize_t count = -1;
+    // A read error usually means the power supply went away and came back,
+    // so reopen the file once before giving up.
+    for (int attempt = 0; attempt < 2 && count < 0; attempt++) {
+        int fd = getCachedFd(path);
+        if (fd == -1)
+            break;
+
+        count = TEMP_FAILURE_RETRY(pread(fd, buf, size - 1, 0));
+        if (count < 0 || !isCachedFd(path))
+            closeCachedFd(path, fd);
+    }
+
+    if (count > 0) {
+        while (count > 0 && buf[count-1] == '\n')
+            count--;
+        buf[count] = '\0';
+    } else {
+        buf[0] = '\0';
+    }
+    return count;
+}
+
 static void setBooleanField(JNIEnv* env, jobject obj, const char* path, jfieldID fieldID)
 {
     const int SIZE = 16;
     char buf[SIZE];
     
     jboolean value = false;
-    if (readFromFile(path, buf, SIZE) > 0) {
+    if (readFromCachedFile(path, buf, SIZE) > 0) {
         if (buf[0] != '0') {
             value = true;
         }
@@ -204,7 +289,7 @@ static void setIntField(JNIEnv* env, jobject obj, const char* path, jfieldID fie
     char buf[SIZE];
     
     jint value = 0;
-    if (readFromFile(path, buf, SIZE) > 0) {
+    if (readFromCachedFile(path, buf, SIZE) > 0) {
         value = atoi(buf);
     }
     env->SetIntField(obj, fieldID, value);
@@ -216,7 +301,7 @@ static void setVoltageField(JNIEnv* env, jobject obj, const char* path, jfieldID
     char buf[SIZE];
 
     jint value = 0;
-    if (readFromFile(path, buf, SIZE) > 0) {
+    if (readFromCachedFile(path, buf, SIZE) > 0) {
         value = atoi(buf);
         value /= gVoltageDivisor;
     }
@@ -226,6 +311,8 @@ static void setVoltageField(JNIEnv* env, jobject obj, const char* path, jfieldID
 
 static void android_server_BatteryService_update(JNIEnv* env, jobject obj)
 {
+    Mutex::Autolock _l(gCachedFileLock);
+
     setBooleanField(env, obj, gPaths.acOnlinePath, gFieldIds.mAcOnline);
     setBooleanField(env, obj, gPaths.usbOnlinePath, gFieldIds.mUsbOnline);
     setBooleanField(env, obj, gPaths.batteryPresentPath, gFieldIds.mBatteryPresent);
@@ -241,25 +328,35 @@ static void android_server_BatteryService_update(JNIEnv* env, jobject obj)
     const int SIZE = 128;
     char buf[SIZE];
     
-    if (readFromFile(gPaths.batteryStatusPath, buf, SIZE) > 0)
+    if (readFromCachedFile(gPaths.batteryStatusPath, buf, SIZE) > 0)
         env->SetIntField(obj, gFieldIds.mBatteryStatus, getBatteryStatus(buf));
     else
         env->SetIntField(obj, gFieldIds.mBatteryStatus,
                          gConstants.statusUnknown);
 
 #ifdef HAS_DOCK_BATTERY
-    if (readFromFile(gPaths.dockbatteryStatusPath, buf, SIZE) > 0)
+    if (readFromCachedFile(gPaths.dockbatteryStatusPath, buf, SIZE) > 0)
         env->SetIntField(obj, gFieldIds.mDockBatteryStatus, getDockBatteryStatus(buf));
     else
         env->SetIntField(obj, gFieldIds.mDockBatteryStatus,
                          gConstants.dockstatusUndocked);
 #endif
     
-    if (readFromFile(gPaths.batteryHealthPath, buf, SIZE) > 0)
+    if (readFromCachedFile(gPaths.batteryHealthPath, buf, SIZE) > 0)
         env->SetIntField(obj, gFieldIds.mBatteryHealth, getBatteryHealth(buf));
 
-    if (readFromFile(gPaths.batteryTechnologyPath, buf, SIZE) > 0)
-        env->SetObjectField(obj, gFieldIds.mBatteryTechnology, env->NewStringUTF(buf));
+    // The technology rarely changes, so only create a new string when it does.
+    static char lastTechnology[SIZE];
+    if (readFromCachedFile(gPaths.batteryTechnologyPath, buf, SIZE) > 0) {
+        if (strcmp(buf, lastTechnology) != 0) {
+            jstring technology = env->NewStringUTF(buf);
+            if (technology != NULL) {
+                env->SetObjectField(obj, gFieldIds.mBatteryTechnology, technology);
+                env->DeleteLocalRef(technology);
+                strcpy(lastTechnology, buf);
+            }
+        }
+    }
 }
 
 static JNINativeMethod sMethods[] = {
@@ -22,6 +22,7 @@
 
 #include <utils/misc.h>
 #include <utils/Log.h>
+#include <utils/threads.h>
 #include <hardware/hardware.h>
 #include <hardware/lights.h>
 
@@ -44,8 +45,104 @@ enum {
     LIGHT_COUNT
 };
 
+/*
+ * Applies light states on its own thread, so that callers never wait for the
+ * lights HAL. Only the latest pending state of each light is applied, and
+ * states equal to the one already applied are dropped.
+ */
+class LightsThread : public Thread {
+public:
+    LightsThread(light_device_t* const* lights) : Thread(false) {
+        for (int i = 0; i < LIGHT_COUNT; i++) {
+            mLights[i] = lights[i];
+            mPending[i] = false;
+            mApplied[i] = false;
+        }
+    }
+
+    void post(int light, const light_state_t& state) {
+        Mutex::Autolock _l(mLock);
+        mPendingStates[light] = state;
+        mPending[light] = true;
+        mCondition.signal();
+    }
+
+    // Applies a state right away on the calling thread.
+    void apply(int light, const light_state_t& state) {
+        {
+            Mutex::Autolock _l(mLock);
+            // A state posted earlier must not override this one.
+            mPending[light] = false;
+        }
+        applyState(light, state);
+    }
+
+    void stop() {
+        requestExit();
+        {
+            Mutex::Autolock _l(mLock);
+            mCondition.signal();
+        }
+        requestExitAndWait();
+    }
+
+private:
+    virtual bool threadLoop() {
+        light_state_t states[LIGHT_COUNT];
+        bool pending[LIGHT_COUNT];
+        {
+            Mutex::Autolock _l(mLock);
+            bool any = false;
+            for (int i = 0; i < LIGHT_COUNT; i++) {
+                any |= mPending[i];
+            }
+            if (!any) {
+                if (!exitPending()) {
+                    mCondition.wait(mLock);
+                }
+                return true;
+            }
+            for (int i = 0; i < LIGHT_COUNT; i++) {
+                pending[i] = mPending[i];
+                states[i] = mPendingStates[i];
+                mPending[i] = false;
+            }
+        }
+
+        for (int i = 0; i < LIGHT_COUNT; i++) {
+            if (pending[i]) {
+                applyState(i, states[i]);
+            }
+        }
+        return true;
+    }
+
+    void applyState(int light, const light_state_t& state) {
+        // The HAL is not required to be reentrant.
+        Mutex::Autolock _l(mHalLock);
+        if (mApplied[light] && !memcmp(&mAppliedStates[light], &state, sizeof(state))) {
+            return;
+        }
+        mLights[light]->set_light(mLights[light], &state);
+        mAppliedStates[light] = state;
+        mApplied[light] = true;
+    }
+
+    light_device_t* mLights[LIGHT_COUNT];
+
+    Mutex mLock;
+    Condition mCondition;
+    bool mPending[LIGHT_COUNT];
+    light_state_t mPendingStates[LIGHT_COUNT];
+
+    Mutex mHalLock;
+    bool mApplied[LIGHT_COUNT];
+    light_state_t mAppliedStates[LIGHT_COUNT];
+};
+
 struct Devices {
     light_device_t* lights[LIGHT_COUNT];
+    sp<LightsThread> thread;
 };
 
 static light_device_t* get_device(hw_module_t* module, char const* name)
@@ -66,7 +163,7 @@ static jint init_native(JNIEnv *env, jobject clazz)
     hw_module_t* module;
     Devices* devices;
     
-    devices = (Devices*)malloc(sizeof(Devices));
+    devices = new Devices();
 
     err = hw_get_module(LIGHTS_HARDWARE_MODULE_ID, (hw_module_t const**)&module);
     if (err == 0) {
@@ -87,9 +184,12 @@ static jint init_native(JNIEnv *env, jobject clazz)
         devices->lights[LIGHT_INDEX_WIFI]
                 = get_device(module, LIGHT_ID_WIFI);
     } else {
-        memset(devices, 0, sizeof(Devices));
+        memset(devices->lights, 0, sizeof(devices->lights));
     }
 
+    devices->thread = new LightsThread(devices->lights);
+    devices->thread->run("LightsService", PRIORITY_FOREGROUND);
+
     return (jint)devices;
 }
 
@@ -100,7 +200,8 @@ static void finalize_native(JNIEnv *env, jobject clazz, int ptr)
         return;
     }
 
-    free(devices);
+    devices->thread->stop();
+    delete devices;
 }
 
 static void setLight_native(JNIEnv *env, jobject clazz, int ptr,
@@ -120,7 +221,13 @@ static void setLight_native(JNIEnv *env, jobject clazz, int ptr,
     state.flashOffMS = offMS;
     state.brightnessMode = brightnessMode;
 
-    devices->lights[light]->set_light(devices->lights[light], &state);
+    // The display backlight is changed synchronously so that the display is
+    // never turned on or off before its backlight.
+    if (light == LIGHT_INDEX_BACKLIGHT) {
+        devices->thread->apply(light, state);
+    } else {
+        devices->thread->post(light, state);
+    }
 }
 
 static JNINativeMethod method_table[] = {
@@ -28,6 +28,7 @@
 #include <utils/Timers.h>
 #include <utils/misc.h>
 #include <utils/String8.h>
+#include <utils/KeyedVector.h>
 #include <hardware/power.h>
 #include <hardware_legacy/power.h>
 #include <cutils/android_reboot.h>
@@ -60,6 +61,18 @@ static nsecs_t gLastEventTime[POWER_MANAGER_LAST_EVENT + 1];
 // Throttling interval for user activity calls.
 static const nsecs_t MIN_TIME_BETWEEN_USERACTIVITIES = 500 * 1000000L; // 500ms
 
+// Kernel wake lock usage, updated next to the acquire and release calls so
+// that it costs no more than the calls themselves. The device cannot suspend
+// while a wake lock is held, so the monotonic clock measures hold times.
+struct WakeLockUsage {
+    uint32_t acquireCount;
+    nsecs_t totalTime;
+    nsecs_t acquireTime;    // 0 when not held
+};
+
+static Mutex gWakeLockUsageLock;
+static KeyedVector<String8, WakeLockUsage> gWakeLockUsage;
+
 // ----------------------------------------------------------------------------
 
 static bool checkAndClearExceptionFromCallback(JNIEnv* env, const char* methodName) {
@@ -122,6 +135,60 @@ void android_server_PowerManagerService_goToSleep(nsecs_t eventTime) {
     }
 }
 
+void android_server_PowerManagerService_getWakeLockStats(
+        Vector<PowerManagerWakeLockStats>* outStats) {
+    AutoMutex _l(gWakeLockUsageLock);
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    outStats->clear();
+    outStats->setCapacity(gWakeLockUsage.size());
+    for (size_t i = 0; i < gWakeLockUsage.size(); i++) {
+        const WakeLockUsage& usage = gWakeLockUsage.valueAt(i);
+        PowerManagerWakeLockStats stats;
+        stats.id = gWakeLockUsage.keyAt(i);
+        stats.acquireCount = usage.acquireCount;
+        stats.totalTime = usage.totalTime;
+        stats.held = usage.acquireTime != 0;
+        if (stats.held) {
+            stats.totalTime += now - usage.acquireTime;
+        }
+        outStats->add(stats);
+    }
+}
+
+static void noteWakeLockAcquired(const char* id) {
+    AutoMutex _l(gWakeLockUsageLock);
+    String8 key(id);
+    ssize_t index = gWakeLockUsage.indexOfKey(key);
+    if (index < 0) {
+        WakeLockUsage usage;
+        usage.acquireCount = 0;
+        usage.totalTime = 0;
+        usage.acquireTime = 0;
+        index = gWakeLockUsage.add(key, usage);
+    }
+
+    // Kernel wake locks are not reference counted, so acquiring a held lock
+    // neither restarts its timer nor counts as a new acquisition.
+    WakeLockUsage& usage = gWakeLockUsage.editValueAt(index);
+    if (usage.acquireTime == 0) {
+        usage.acquireCount++;
+        usage.acquireTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+}
+
+static void noteWakeLockReleased(const char* id) {
+    AutoMutex _l(gWakeLockUsageLock);
+    ssize_t index = gWakeLockUsage.indexOfKey(String8(id));
+    if (index >= 0) {
+        WakeLockUsage& usage = gWakeLockUsage.editValueAt(index);
+        if (usage.acquireTime != 0) {
+            usage.totalTime += systemTime(SYSTEM_TIME_MONOTONIC) - usage.acquireTime;
+            usage.acquireTime = 0;
+        }
+    }
+}
+
 // ----------------------------------------------------------------------------
 
 static void nativeInit(JNIEnv* env, jobject obj) {
@@ -158,6 +225,7 @@ static void nativeAcquireWakeLock(JNIEnv *env, jobject clazz, jint lock, jstring
     const char *id = env->GetStringUTFChars(idObj, NULL);
 
     acquire_wake_lock(lock, id);
+    noteWakeLockAcquired(id);
 
     env->ReleaseStringUTFChars(idObj, id);
 }
@@ -171,6 +239,7 @@ static void nativeReleaseWakeLock(JNIEnv *env, jobject clazz, jstring idObj) {
     const char *id = env->GetStringUTFChars(idObj, NULL);
 
     release_wake_lock(id);
+    noteWakeLockReleased(id);
 
     env->ReleaseStringUTFChars(idObj, id);
 
@@ -21,6 +21,8 @@
 #include "jni.h"
 
 #include <androidfw/PowerManager.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -29,6 +31,20 @@ extern bool android_server_PowerManagerService_isScreenBright();
 extern void android_server_PowerManagerService_userActivity(nsecs_t eventTime, int32_t eventType);
 extern void android_server_PowerManagerService_goToSleep(nsecs_t eventTime);
 
+/*
+ * Time spent holding one of the kernel wake locks acquired through
+ * PowerManagerService, accumulated since the service started.
+ */
+struct PowerManagerWakeLockStats {
+    String8 id;
+    uint32_t acquireCount;
+    nsecs_t totalTime;   // includes the current hold, if any
+    bool held;
+};
+
+extern void android_server_PowerManagerService_getWakeLockStats(
+        Vector<PowerManagerWakeLockStats>* outStats);
+
 } // namespace android
 
 #endif // _ANDROID_SERVER_POWER_MANAGER_SERVICE_H
@@ -28,7 +28,9 @@
 #include "JNIHelp.h"
 #include "jni.h"
 #include <limits.h>
+#include <stdlib.h>
 #include <android_runtime/AndroidRuntime.h>
+#include <cutils/properties.h>
 
 #include <utils/Log.h>
 #include <utils/Looper.h>
@@ -657,6 +659,11 @@ void NativeInputManager::getDispatcherConfiguration(InputDispatcherConfiguration
     if (!checkAndClearExceptionFromCallback(env, "getKeyRepeatDelay")) {
         outConfig->keyRepeatDelay = milliseconds_to_nanoseconds(keyRepeatDelay);
     }
+
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("input.dispatcher.maxqueuedmoves", value, NULL) > 0) {
+        outConfig->maxQueuedMotionMoves = atoi(value);
+    }
 }
 
 bool NativeInputManager::isKeyRepeatEnabled() {
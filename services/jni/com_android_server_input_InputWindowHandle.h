@@ -32,7 +32,7 @@ public:
 
     jobject getInputWindowHandleObjLocalRef(JNIEnv* env);
 
-    virtual bool updateInfo();
+    virtual bool readInfo(InputWindowInfo* outInfo);
 
 private:
     jweak mObjWeak;
@@ -345,13 +345,18 @@ static jint android_location_GpsLocationProvider_read_sv_status(JNIEnv* env, job
 {
     // this should only be called from within a call to reportSvStatus
 
-    jint* prns = env->GetIntArrayElements(prnArray, 0);
-    jfloat* snrs = env->GetFloatArrayElements(snrArray, 0);
-    jfloat* elev = env->GetFloatArrayElements(elevArray, 0);
-    jfloat* azim = env->GetFloatArrayElements(azumArray, 0);
-    jint* mask = env->GetIntArrayElements(maskArray, 0);
+    // Fill native arrays and copy them over, rather than pinning all five
+    // Java arrays several times a second.
+    jint prns[GPS_MAX_SVS];
+    jfloat snrs[GPS_MAX_SVS];
+    jfloat elev[GPS_MAX_SVS];
+    jfloat azim[GPS_MAX_SVS];
+    jint mask[3];
 
     int num_svs = sGpsSvStatus.num_svs;
+    if (num_svs > GPS_MAX_SVS) {
+        num_svs = GPS_MAX_SVS;
+    }
     for (int i = 0; i < num_svs; i++) {
         prns[i] = sGpsSvStatus.sv_list[i].prn;
         snrs[i] = sGpsSvStatus.sv_list[i].snr;
@@ -362,11 +367,11 @@ static jint android_location_GpsLocationProvider_read_sv_status(JNIEnv* env, job
     mask[1] = sGpsSvStatus.almanac_mask;
     mask[2] = sGpsSvStatus.used_in_fix_mask;
 
-    env->ReleaseIntArrayElements(prnArray, prns, 0);
-    env->ReleaseFloatArrayElements(snrArray, snrs, 0);
-    env->ReleaseFloatArrayElements(elevArray, elev, 0);
-    env->ReleaseFloatArrayElements(azumArray, azim, 0);
-    env->ReleaseIntArrayElements(maskArray, mask, 0);
+    env->SetIntArrayRegion(prnArray, 0, num_svs, prns);
+    env->SetFloatArrayRegion(snrArray, 0, num_svs, snrs);
+    env->SetFloatArrayRegion(elevArray, 0, num_svs, elev);
+    env->SetFloatArrayRegion(azumArray, 0, num_svs, azim);
+    env->SetIntArrayRegion(maskArray, 0, 3, mask);
     return num_svs;
 }
 
@@ -431,12 +436,10 @@ static jint android_location_GpsLocationProvider_read_nmea(JNIEnv* env, jobject
                                             jbyteArray nmeaArray, jint buffer_size)
 {
     // this should only be called from within a call to reportNmea
-    jbyte* nmea = (jbyte *)env->GetPrimitiveArrayCritical(nmeaArray, 0);
     int length = sNmeaStringLength;
     if (length > buffer_size)
         length = buffer_size;
-    memcpy(nmea, sNmeaString, length);
-    env->ReleasePrimitiveArrayCritical(nmeaArray, nmea, JNI_ABORT);
+    env->SetByteArrayRegion(nmeaArray, 0, length, (const jbyte*)sNmeaString);
     return length;
 }
 
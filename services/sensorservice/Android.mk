@@ -12,6 +12,7 @@ LOCAL_SRC_FILES:= \
     SensorDevice.cpp \
     SensorFusion.cpp \
     SensorInterface.cpp \
+    SensorRecording.cpp \
     SensorService.cpp \
 
 
@@ -32,3 +33,6 @@ endif
 LOCAL_MODULE:= libsensorservice
 
 include $(BUILD_SHARED_LIBRARY)
+
+# Build the manual test programs.
+include $(call all-makefiles-under, $(LOCAL_PATH))
@@ -387,7 +387,22 @@ void Fusion::predict(const vec3_t& w, float dT) {
     Phi[0][0] = I33 - wx*(k1*ilwe) + wx2*k0;
     Phi[1][0] = wx*k0 - I33dT - wx2*(ilwe*ilwe*ilwe)*(lwedT-k1);
 
-    P = Phi*P*transpose(Phi) + GQGt;
+    // Expanding Phi*P*Phit block-wise with the zero and identity blocks of
+    // Phi and P01 = P10t, only two blocks need to be computed:
+    //
+    //  P10 = Phi00*P10 + Phi10*P11
+    //  P00 = (Phi00*P00 + Phi10*P10t)*Phi00t + P10*Phi10t  (using the new P10)
+    //  P11 = P11
+    //
+    // which takes 6 3x3 products instead of the 24 of the full expression.
+    const mat33_t& Phi00(Phi[0][0]);
+    const mat33_t& Phi10(Phi[1][0]);
+    const mat33_t P10(Phi00*P[1][0] + Phi10*P[1][1]);
+    P[0][0] = (Phi00*P[0][0] + Phi10*transpose(P[1][0]))*transpose(Phi00)
+            + P10*transpose(Phi10) + GQGt[0][0];
+    P[1][0] = P10 + GQGt[1][0];
+    P[0][1] = transpose(P[1][0]);
+    P[1][1] += GQGt[1][1];
 
     checkState();
 }
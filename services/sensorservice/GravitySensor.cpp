@@ -67,7 +67,8 @@ bool GravitySensor::process(sensors_event_t* outEvent,
 }
 
 status_t GravitySensor::activate(void* ident, bool enabled) {
-    return mSensorFusion.activate(this, enabled);
+    // gravity (and linear-acceleration, through us) don't depend on the heading
+    return mSensorFusion.activate(this, enabled, false);
 }
 
 status_t GravitySensor::setDelay(void* ident, int handle, int64_t ns) {
@@ -202,9 +202,23 @@ ssize_t SensorDevice::poll(sensors_event_t* buffer, size_t count) {
     do {
         c = mSensorDevice->poll(mSensorDevice, buffer, count);
     } while (c == -EINTR);
+    if (c > 0 && mRecorder.isOpen()) {
+        mRecorder.writeEvents(buffer, c);
+    }
     return c;
 }
 
+status_t SensorDevice::startRecording(const char* path) {
+    sensor_t const* list;
+    ssize_t count = getSensorList(&list);
+    if (count < 0) return count;
+    status_t err = mRecorder.open(path, list, count);
+    if (err == NO_ERROR) {
+        ALOGI("recording sensor events to '%s'", path);
+    }
+    return err;
+}
+
 status_t SensorDevice::activate(void* ident, int handle, int enabled)
 {
     if (!mSensorDevice) return NO_INIT;
@@ -26,6 +26,8 @@
 
 #include <gui/Sensor.h>
 
+#include "SensorRecording.h"
+
 // ---------------------------------------------------------------------------
 
 namespace android {
@@ -47,12 +49,17 @@ class SensorDevice : public Singleton<SensorDevice> {
         nsecs_t selectDelay();
     };
     DefaultKeyedVector<int, Info> mActivationCount;
+    // only used by poll()
+    SensorRecorder mRecorder;
 
     SensorDevice();
 public:
     ssize_t getSensorList(sensor_t const** list);
     status_t initCheck() const;
     ssize_t poll(sensors_event_t* buffer, size_t count);
+    // records everything poll() returns to the given file, must be called
+    // before anything polls
+    status_t startRecording(const char* path);
     status_t activate(void* ident, int handle, int enabled);
     status_t setDelay(void* ident, int handle, int64_t ns);
     void dump(String8& result, char* buffer, size_t SIZE);
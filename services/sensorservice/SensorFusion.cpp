@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <hardware/sensors.h>
+
 #include "SensorDevice.h"
 #include "SensorFusion.h"
 #include "SensorService.h"
@@ -23,9 +25,23 @@ namespace android {
 
 ANDROID_SINGLETON_STATIC_INSTANCE(SensorFusion)
 
+// The gyro never runs slower than this, below it the integration error of
+// the prediction step becomes noticeable.
+static const nsecs_t MAX_GYRO_DELAY_NS = 10000000LL; // 100 Hz
+
+// The device is considered still when the bias-corrected angular rate and the
+// deviation of the acceleration from gravity are both below these.
+static const float STATIONARY_GYRO_THRESHOLD = 0.02f; // rad/s
+static const float STATIONARY_ACC_THRESHOLD = 0.2f;   // m/s^2
+
+// Measurement updates are never skipped for longer than this, so the bias
+// estimate and the covariance keep being corrected.
+static const nsecs_t MAX_SKIPPED_UPDATE_NS = 1000000000LL; // 1 s
+
 SensorFusion::SensorFusion()
     : mSensorDevice(SensorDevice::getInstance()),
-      mEnabled(false), mGyroTime(0)
+      mEnabled(false), mGyroTime(0), mStationary(false),
+      mAccUpdateTime(0), mMagUpdateTime(0)
 {
     sensor_t const* list;
     ssize_t count = mSensorDevice.getSensorList(&list);
@@ -54,31 +70,51 @@ void SensorFusion::process(const sensors_event_t& event) {
         if (mGyroTime != 0) {
             const float dT = (event.timestamp - mGyroTime) / 1000000000.0f;
             const float freq = 1 / dT;
-            if (freq >= 100 && freq<1000) { // filter values obviously wrong
+            if (freq >= 50 && freq<1000) { // filter values obviously wrong
                 const float alpha = 1 / (1 + dT); // 1s time-constant
                 mGyroRate = freq + (mGyroRate - freq)*alpha;
             }
         }
         mGyroTime = event.timestamp;
-        mFusion.handleGyro(vec3_t(event.data), 1.0f/mGyroRate);
+        const vec3_t gyro(event.data);
+        mFusion.handleGyro(gyro, 1.0f/mGyroRate);
+        mStationary = mFusion.hasEstimate() &&
+                length(gyro - mFusion.getBias()) < STATIONARY_GYRO_THRESHOLD;
     } else if (event.type == SENSOR_TYPE_MAGNETIC_FIELD) {
-        const vec3_t mag(event.data);
-        mFusion.handleMag(mag);
+        if (!canSkipUpdate(event.timestamp, mMagUpdateTime)) {
+            const vec3_t mag(event.data);
+            mFusion.handleMag(mag);
+            mMagUpdateTime = event.timestamp;
+        }
     } else if (event.type == SENSOR_TYPE_ACCELEROMETER) {
         const vec3_t acc(event.data);
-        mFusion.handleAcc(acc);
+        if (fabsf(length(acc) - GRAVITY_EARTH) >= STATIONARY_ACC_THRESHOLD) {
+            mStationary = false;
+        }
+        if (!canSkipUpdate(event.timestamp, mAccUpdateTime)) {
+            mFusion.handleAcc(acc);
+            mAccUpdateTime = event.timestamp;
+        }
         mAttitude = mFusion.getAttitude();
     }
 }
 
+bool SensorFusion::canSkipUpdate(nsecs_t timestamp, nsecs_t lastUpdateTime) const {
+    // The heading is only observable through the magnetometer and does not
+    // affect gravity, and while the device is still the prediction alone keeps
+    // the attitude, so gravity-only clients don't need the measurement updates.
+    return mStationary && mHeadingClients.size() == 0 &&
+            timestamp - lastUpdateTime < MAX_SKIPPED_UPDATE_NS;
+}
+
 template <typename T> inline T min(T a, T b) { return a<b ? a : b; }
 template <typename T> inline T max(T a, T b) { return a>b ? a : b; }
 
-status_t SensorFusion::activate(void* ident, bool enabled) {
+status_t SensorFusion::activate(void* ident, bool enabled, bool needsHeading) {
 
     ALOGD_IF(DEBUG_CONNECTIONS,
-            "SensorFusion::activate(ident=%p, enabled=%d)",
-            ident, enabled);
+            "SensorFusion::activate(ident=%p, enabled=%d, needsHeading=%d)",
+            ident, enabled, needsHeading);
 
     const ssize_t idx = mClients.indexOf(ident);
     if (enabled) {
@@ -91,6 +127,17 @@ status_t SensorFusion::activate(void* ident, bool enabled) {
         }
     }
 
+    const ssize_t headingIdx = mHeadingClients.indexOf(ident);
+    if (enabled && needsHeading) {
+        if (headingIdx < 0) {
+            mHeadingClients.add(ident);
+        }
+    } else {
+        if (headingIdx >= 0) {
+            mHeadingClients.removeItemsAt(headingIdx);
+        }
+    }
+
     mSensorDevice.activate(ident, mAcc.getHandle(), enabled);
     mSensorDevice.activate(ident, mMag.getHandle(), enabled);
     mSensorDevice.activate(ident, mGyro.getHandle(), enabled);
@@ -101,15 +148,21 @@ status_t SensorFusion::activate(void* ident, bool enabled) {
         if (newState) {
             mFusion.init();
             mGyroTime = 0;
+            mStationary = false;
+            mAccUpdateTime = 0;
+            mMagUpdateTime = 0;
         }
     }
     return NO_ERROR;
 }
 
 status_t SensorFusion::setDelay(void* ident, int64_t ns) {
+    // The gyro runs as slow as the client allows but within the range the
+    // filter needs, SensorDevice then picks the fastest rate of all clients.
+    const nsecs_t gyroDelay = min(max(nsecs_t(ns), mTargetDelayNs), MAX_GYRO_DELAY_NS);
     mSensorDevice.setDelay(ident, mAcc.getHandle(), ns);
-    mSensorDevice.setDelay(ident, mMag.getHandle(), ms2ns(20));
-    mSensorDevice.setDelay(ident, mGyro.getHandle(), mTargetDelayNs);
+    mSensorDevice.setDelay(ident, mMag.getHandle(), max(nsecs_t(ns), ms2ns(20)));
+    mSensorDevice.setDelay(ident, mGyro.getHandle(), gyroDelay);
     return NO_ERROR;
 }
 
@@ -127,12 +180,15 @@ int32_t SensorFusion::getMinDelay() const {
 
 void SensorFusion::dump(String8& result, char* buffer, size_t SIZE) {
     const Fusion& fusion(mFusion);
-    snprintf(buffer, SIZE, "9-axis fusion %s (%d clients), gyro-rate=%7.2fHz, "
+    snprintf(buffer, SIZE, "9-axis fusion %s (%d clients, %d need heading), "
+            "gyro-rate=%7.2fHz, %s, "
             "q=< %g, %g, %g, %g > (%g), "
             "b=< %g, %g, %g >\n",
             mEnabled ? "enabled" : "disabled",
             mClients.size(),
+            mHeadingClients.size(),
             mGyroRate,
+            mStationary ? "stationary" : "moving",
             fusion.getAttitude().x,
             fusion.getAttitude().y,
             fusion.getAttitude().z,
@@ -49,8 +49,13 @@ class SensorFusion : public Singleton<SensorFusion> {
     nsecs_t mGyroTime;
     vec4_t mAttitude;
     SortedVector<void*> mClients;
+    SortedVector<void*> mHeadingClients;
+    bool mStationary;
+    nsecs_t mAccUpdateTime;
+    nsecs_t mMagUpdateTime;
 
     SensorFusion();
+    bool canSkipUpdate(nsecs_t timestamp, nsecs_t lastUpdateTime) const;
 
 public:
     void process(const sensors_event_t& event);
@@ -62,7 +67,9 @@ public:
     vec3_t getGyroBias() const { return mFusion.getBias(); }
     float getEstimatedRate() const { return mGyroRate; }
 
-    status_t activate(void* ident, bool enabled);
+    // Clients which only need the direction of gravity pass needsHeading=false,
+    // which lets the filter skip measurement updates while the device is still.
+    status_t activate(void* ident, bool enabled, bool needsHeading = true);
     status_t setDelay(void* ident, int64_t ns);
 
     float getPowerUsage() const;
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <utils/Log.h>
+
+#include "SensorRecording.h"
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+static const uint32_t RECORDING_MAGIC = 0x53524553; // "SERS"
+static const uint32_t RECORDING_VERSION = 1;
+
+// a poll never returns more events than this, anything larger is corrupt
+static const uint32_t MAX_BATCH_SIZE = 4096;
+
+static status_t writeFully(int fd, void const* data, size_t size) {
+    uint8_t const* p = static_cast<uint8_t const*>(data);
+    while (size) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        p += n;
+        size -= n;
+    }
+    return NO_ERROR;
+}
+
+static status_t readFully(int fd, void* data, size_t size) {
+    uint8_t* p = static_cast<uint8_t*>(data);
+    while (size) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if (n == 0)
+            return NOT_ENOUGH_DATA;
+        p += n;
+        size -= n;
+    }
+    return NO_ERROR;
+}
+
+// ---------------------------------------------------------------------------
+
+SensorRecorder::SensorRecorder()
+    : mFd(-1)
+{
+}
+
+SensorRecorder::~SensorRecorder()
+{
+    close();
+}
+
+status_t SensorRecorder::open(const char* path, sensor_t const* list, size_t count)
+{
+    close();
+
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        ALOGE("couldn't create sensor recording '%s' (%s)", path, strerror(errno));
+        return -errno;
+    }
+
+    // header, then the sensor list
+    uint32_t header[4] = { RECORDING_MAGIC, RECORDING_VERSION,
+            sizeof(sensors_event_t), count };
+    status_t err = writeFully(fd, header, sizeof(header));
+    for (size_t i=0 ; i<count && err == NO_ERROR ; i++) {
+        RecordedSensor sensor;
+        sensor.handle = list[i].handle;
+        sensor.type = list[i].type;
+        err = writeFully(fd, &sensor, sizeof(sensor));
+    }
+    if (err != NO_ERROR) {
+        ALOGE("couldn't write sensor recording header to '%s' (%s)",
+                path, strerror(-err));
+        ::close(fd);
+        return err;
+    }
+
+    mFd = fd;
+    return NO_ERROR;
+}
+
+void SensorRecorder::close()
+{
+    if (mFd >= 0) {
+        ::close(mFd);
+        mFd = -1;
+    }
+}
+
+status_t SensorRecorder::writeEvents(sensors_event_t const* buffer, size_t count)
+{
+    if (mFd < 0)
+        return NO_INIT;
+
+    uint32_t size = count;
+    status_t err = writeFully(mFd, &size, sizeof(size));
+    if (err == NO_ERROR) {
+        err = writeFully(mFd, buffer, count * sizeof(sensors_event_t));
+    }
+    if (err != NO_ERROR) {
+        // a partially written batch can't be recovered, stop recording
+        ALOGE("sensor recording failed (%s), stopping", strerror(-err));
+        close();
+    }
+    return err;
+}
+
+// ---------------------------------------------------------------------------
+
+status_t SensorRecording::load(const char* path, SensorRecording* outRecording)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        ALOGE("couldn't open sensor recording '%s' (%s)", path, strerror(errno));
+        return -errno;
+    }
+
+    SensorRecording& recording(*outRecording);
+    recording.mSensors.clear();
+    recording.mEvents.clear();
+    recording.mBatchSizes.clear();
+
+    uint32_t header[4];
+    status_t err = readFully(fd, header, sizeof(header));
+    if (err == NO_ERROR && (header[0] != RECORDING_MAGIC ||
+            header[1] != RECORDING_VERSION ||
+            header[2] != sizeof(sensors_event_t))) {
+        ALOGE("'%s' isn't a sensor recording of this version", path);
+        err = BAD_VALUE;
+    }
+    for (size_t i=0 ; i<header[3] && err == NO_ERROR ; i++) {
+        RecordedSensor sensor;
+        err = readFully(fd, &sensor, sizeof(sensor));
+        if (err == NO_ERROR) {
+            recording.mSensors.add(sensor);
+        }
+    }
+
+    while (err == NO_ERROR) {
+        uint32_t count;
+        err = readFully(fd, &count, sizeof(count));
+        if (err == NOT_ENOUGH_DATA) {
+            // clean end of the recording
+            err = NO_ERROR;
+            break;
+        }
+        if (err == NO_ERROR && count > MAX_BATCH_SIZE) {
+            ALOGE("'%s' is corrupt (batch of %u events)", path, count);
+            err = BAD_VALUE;
+        }
+        if (err == NO_ERROR) {
+            const size_t offset = recording.mEvents.size();
+            recording.mEvents.insertAt(offset, count);
+            err = readFully(fd, recording.mEvents.editArray() + offset,
+                    count * sizeof(sensors_event_t));
+            if (err == NOT_ENOUGH_DATA) {
+                // the recorder was killed in the middle of a batch, keep what
+                // we have
+                ALOGW("'%s' ends with a partial batch", path);
+                recording.mEvents.removeItemsAt(offset, count);
+                err = NO_ERROR;
+                break;
+            }
+            recording.mBatchSizes.add(count);
+        }
+    }
+
+    ::close(fd);
+    return err;
+}
+
+int32_t SensorRecording::getSensorType(int32_t handle) const
+{
+    for (size_t i=0 ; i<mSensors.size() ; i++) {
+        if (mSensors[i].handle == handle)
+            return mSensors[i].type;
+    }
+    return -1;
+}
+
+// ---------------------------------------------------------------------------
+}; // namespace android
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_RECORDING_H
+#define ANDROID_SENSOR_RECORDING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/Errors.h>
+#include <utils/Vector.h>
+
+#include <hardware/sensors.h>
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+/*
+ * A recording starts with the handle and type of each h/w sensor, followed by
+ * every buffer returned by SensorDevice::poll(), as is. Values are in host byte
+ * order, a recording is meant to be replayed on the same kind of device.
+ */
+struct RecordedSensor {
+    int32_t handle;
+    int32_t type;
+};
+
+class SensorRecorder {
+    int mFd;
+public:
+    SensorRecorder();
+    ~SensorRecorder();
+
+    // creates the recording file, replacing any existing one
+    status_t open(const char* path, sensor_t const* list, size_t count);
+    void close();
+    bool isOpen() const { return mFd >= 0; }
+
+    status_t writeEvents(sensors_event_t const* buffer, size_t count);
+};
+
+class SensorRecording {
+    Vector<RecordedSensor> mSensors;
+    Vector<sensors_event_t> mEvents;
+    Vector<size_t> mBatchSizes;
+public:
+    static status_t load(const char* path, SensorRecording* outRecording);
+
+    const Vector<RecordedSensor>& getSensors() const { return mSensors; }
+    // all events, in the order they were polled
+    const Vector<sensors_event_t>& getEvents() const { return mEvents; }
+    // the number of events each poll returned
+    const Vector<size_t>& getBatchSizes() const { return mBatchSizes; }
+    int32_t getSensorType(int32_t handle) const;
+};
+
+// ---------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_SENSOR_RECORDING_H
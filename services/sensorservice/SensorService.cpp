@@ -18,6 +18,7 @@
 #include <math.h>
 #include <sys/types.h>
 
+#include <cutils/atomic-inline.h>
 #include <cutils/properties.h>
 
 #include <utils/SortedVector.h>
@@ -61,7 +62,9 @@ namespace android {
  */
 
 SensorService::SensorService()
-    : mInitCheck(NO_INIT)
+    : mInitCheck(NO_INIT), mMaxReportLatency(0),
+      mActiveState(new ActiveState()),
+      mRoutedEvents(NULL), mRoutedEventsCapacity(0)
 {
 }
 
@@ -145,15 +148,89 @@ void SensorService::onFirstRef()
                 }
             }
 
+            // devices that track motion in the background can trade reporting
+            // latency for fewer client wake-ups
+            char value[PROPERTY_VALUE_MAX];
+            property_get("ro.sensors.max_report_latency", value, "0");
+            mMaxReportLatency = ms2ns(atoi(value));
+            if (mMaxReportLatency > 0) {
+                mBatchFlushThread = new BatchFlushThread(this);
+                mBatchFlushThread->run("SensorBatchFlush", PRIORITY_URGENT_DISPLAY);
+            }
+
             run("SensorService", PRIORITY_URGENT_DISPLAY);
             mInitCheck = NO_ERROR;
         }
     }
 }
 
+SensorService::BatchFlushThread::BatchFlushThread(SensorService* service)
+    : Thread(false), mService(service), mWoken(false)
+{
+}
+
+void SensorService::BatchFlushThread::wake()
+{
+    Mutex::Autolock _l(mLock);
+    mWoken = true;
+    mCondition.signal();
+}
+
+bool SensorService::BatchFlushThread::threadLoop()
+{
+    const nsecs_t next = mService->flushOverdueEvents();
+
+    Mutex::Autolock _l(mLock);
+    if (!mWoken) {
+        if (next == 0) {
+            mCondition.wait(mLock);
+        } else {
+            const nsecs_t timeout = next - systemTime(SYSTEM_TIME_MONOTONIC);
+            if (timeout > 0) {
+                mCondition.waitRelative(mLock, timeout);
+            }
+        }
+    }
+    mWoken = false;
+    return true;
+}
+
+void SensorService::wakeBatchFlushThread()
+{
+    if (mBatchFlushThread != 0) {
+        mBatchFlushThread->wake();
+    }
+}
+
+nsecs_t SensorService::flushOverdueEvents()
+{
+    Vector< sp<SensorEventConnection> > connections;
+    {
+        Mutex::Autolock _l(mLock);
+        const size_t size = mActiveConnections.size();
+        for (size_t i=0 ; i<size ; i++) {
+            sp<SensorEventConnection> connection(mActiveConnections[i].promote());
+            if (connection != 0) {
+                connections.add(connection);
+            }
+        }
+    }
+
+    // the connections may be released below, which takes mLock
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t next = 0;
+    for (size_t i=0 ; i<connections.size() ; i++) {
+        const nsecs_t deadline = connections[i]->flushOverdueEvents(now, mMaxReportLatency);
+        if (deadline != 0 && (next == 0 || deadline < next)) {
+            next = deadline;
+        }
+    }
+    return next;
+}
+
 void SensorService::registerSensor(SensorInterface* s)
 {
-    sensors_event_t event;
+    LastEvent event;
     memset(&event, 0, sizeof(event));
 
     const Sensor sensor(s->getSensor());
@@ -163,6 +240,11 @@ void SensorService::registerSensor(SensorInterface* s)
     mSensorMap.add(sensor.getHandle(), s);
     // create an entry in the mLastEventSeen array
     mLastEventSeen.add(sensor.getHandle(), event);
+    // on-change sensors report nothing until their value changes, so their
+    // events are never held back
+    if (sensor.getMinDelay() > 0) {
+        mContinuousSensors.add(sensor.getHandle());
+    }
 }
 
 void SensorService::registerVirtualSensor(SensorInterface* s)
@@ -175,6 +257,7 @@ SensorService::~SensorService()
 {
     for (size_t i=0 ; i<mSensorMap.size() ; i++)
         delete mSensorMap.valueAt(i);
+    free(mRoutedEvents);
 }
 
 static const String16 sDump("android.permission.DUMP");
@@ -196,7 +279,8 @@ status_t SensorService::dump(int fd, const Vector<String16>& args)
         result.append(buffer);
         for (size_t i=0 ; i<mSensorList.size() ; i++) {
             const Sensor& s(mSensorList[i]);
-            const sensors_event_t& e(mLastEventSeen.valueFor(s.getHandle()));
+            sensors_event_t e;
+            mLastEventSeen.valueFor(s.getHandle()).read(&e);
             snprintf(buffer, SIZE,
                     "%-48s| %-32s | 0x%08x | maxRate=%7.2fHz | "
                     "last=<%5.1f,%5.1f,%5.1f>\n",
@@ -210,6 +294,9 @@ status_t SensorService::dump(int fd, const Vector<String16>& args)
         SensorFusion::getInstance().dump(result, buffer, SIZE);
         SensorDevice::getInstance().dump(result, buffer, SIZE);
 
+        snprintf(buffer, SIZE, "max report latency: %lld ms\n",
+                ns2ms(mMaxReportLatency));
+        result.append(buffer);
         snprintf(buffer, SIZE, "%d active connections\n",
                 mActiveConnections.size());
         result.append(buffer);
@@ -234,8 +321,8 @@ bool SensorService::threadLoop()
 
     const size_t numEventMax = 16;
     const size_t minBufferSize = numEventMax + numEventMax * mVirtualSensorList.size();
-    sensors_event_t buffer[minBufferSize];
-    sensors_event_t scratch[minBufferSize];
+    sensors_event_t buffer[numEventMax];
+    sensors_event_t merged[minBufferSize];
     SensorDevice& device(SensorDevice::getInstance());
     const size_t vcount = mVirtualSensorList.size();
 
@@ -249,61 +336,62 @@ bool SensorService::threadLoop()
 
         recordLastValue(buffer, count);
 
+        const sp<ActiveState> state(getActiveState());
+        sensors_event_t const* events = buffer;
+        size_t total = count;
+
         // handle virtual sensors
         if (count && vcount) {
-            sensors_event_t const * const event = buffer;
-            const DefaultKeyedVector<int, SensorInterface*> virtualSensors(
-                    getActiveVirtualSensors());
+            const DefaultKeyedVector<int, SensorInterface*>& virtualSensors(
+                    state->virtualSensors);
             const size_t activeVirtualSensorCount = virtualSensors.size();
             if (activeVirtualSensorCount) {
-                size_t k = 0;
+                // each sensor's events come in order, but the HAL may
+                // interleave sensors out of order
+                sortEventBuffer(buffer, count);
                 SensorFusion& fusion(SensorFusion::getInstance());
                 if (fusion.isEnabled()) {
                     for (size_t i=0 ; i<size_t(count) ; i++) {
-                        fusion.process(event[i]);
+                        fusion.process(buffer[i]);
                     }
                 }
                 RotationVectorSensor2& rv2(RotationVectorSensor2::getInstance());
                 if (rv2.isEnabled()) {
                     for (size_t i=0 ; i<size_t(count) ; i++) {
-                        rv2.process(event[i]);
+                        rv2.process(buffer[i]);
                     }
                 }
-                for (size_t i=0 ; i<size_t(count) && k<minBufferSize ; i++) {
+                // a virtual sensor event has the timestamp of the event it is
+                // computed from, so emitting it right after that event keeps
+                // the whole stream in order. At most activeVirtualSensorCount
+                // events follow each of the count events, so merged can't
+                // overflow.
+                size_t k = 0;
+                for (size_t i=0 ; i<size_t(count) ; i++) {
+                    merged[k++] = buffer[i];
                     for (size_t j=0 ; j<activeVirtualSensorCount ; j++) {
-                        if (count + k >= minBufferSize) {
-                            ALOGE("buffer too small to hold all events: "
-                                    "count=%ld, k=%ld, size=%ld",
-                                    count, k, minBufferSize);
-                            break;
-                        }
-                        sensors_event_t out;
+                        sensors_event_t& out(merged[k]);
                         SensorInterface* si = virtualSensors.valueAt(j);
-                        if (si->process(&out, event[i])) {
-                            buffer[count + k] = out;
+                        if (si->process(&out, buffer[i])) {
+                            // record the last synthesized value
+                            mLastEventSeen.editValueFor(out.sensor).write(out);
                             k++;
                         }
                     }
                 }
-                if (k) {
-                    // record the last synthesized values
-                    recordLastValue(&buffer[count], k);
-                    count += k;
-                    // sort the buffer by time-stamps
-                    sortEventBuffer(buffer, count);
-                }
+                events = merged;
+                total = k;
             }
         }
 
         // send our events to clients...
-        const SortedVector< wp<SensorEventConnection> > activeConnections(
-                getActiveConnections());
-        size_t numConnections = activeConnections.size();
-        for (size_t i=0 ; i<numConnections ; i++) {
-            sp<SensorEventConnection> connection(
-                    activeConnections[i].promote());
+        routeEvents(state, events, total);
+        const size_t numRoutes = mEventRoutes.size();
+        for (size_t i=0 ; i<numRoutes ; i++) {
+            const EventRoute& route(mEventRoutes[i]);
+            sp<SensorEventConnection> connection(route.connection.promote());
             if (connection != 0) {
-                connection->sendEvents(buffer, count, scratch);
+                connection->sendEvents(mRoutedEvents + route.offset, route.count);
             }
         }
     } while (count >= 0 || Thread::exitPending());
@@ -316,45 +404,156 @@ bool SensorService::threadLoop()
 void SensorService::recordLastValue(
         sensors_event_t const * buffer, size_t count)
 {
-    Mutex::Autolock _l(mLock);
-
     // record the last event for each sensor
     int32_t prev = buffer[0].sensor;
     for (size_t i=1 ; i<count ; i++) {
         // record the last event of each sensor type in this buffer
         int32_t curr = buffer[i].sensor;
         if (curr != prev) {
-            mLastEventSeen.editValueFor(prev) = buffer[i-1];
+            mLastEventSeen.editValueFor(prev).write(buffer[i-1]);
             prev = curr;
         }
     }
-    mLastEventSeen.editValueFor(prev) = buffer[count-1];
+    mLastEventSeen.editValueFor(prev).write(buffer[count-1]);
+}
+
+void SensorService::LastEvent::write(const sensors_event_t& e)
+{
+    volatile int32_t* s = const_cast<volatile int32_t*>(&seq);
+    android_atomic_release_store(seq + 1, s);   // odd: write in progress
+    android_memory_barrier();
+    event = e;
+    android_atomic_release_store(seq + 1, s);   // even: done
+}
+
+void SensorService::LastEvent::read(sensors_event_t* e) const
+{
+    volatile const int32_t* s = const_cast<volatile const int32_t*>(&seq);
+    int32_t before, after;
+    do {
+        before = android_atomic_acquire_load(s);
+        *e = event;
+        android_memory_barrier();
+        after = android_atomic_acquire_load(s);
+    } while ((before & 1) || before != after);
 }
 
 void SensorService::sortEventBuffer(sensors_event_t* buffer, size_t count)
 {
-    struct compar {
-        static int cmp(void const* lhs, void const* rhs) {
-            sensors_event_t const* l = static_cast<sensors_event_t const*>(lhs);
-            sensors_event_t const* r = static_cast<sensors_event_t const*>(rhs);
-            return l->timestamp - r->timestamp;
+    // an insertion sort merges the in-order runs of each sensor in place, it
+    // does nothing but compare neighbors when the buffer is already in order
+    for (size_t i=1 ; i<count ; i++) {
+        if (buffer[i].timestamp >= buffer[i-1].timestamp) {
+            continue;
+        }
+        const sensors_event_t e(buffer[i]);
+        size_t j = i;
+        do {
+            buffer[j] = buffer[j-1];
+            j--;
+        } while (j > 0 && buffer[j-1].timestamp > e.timestamp);
+        buffer[j] = e;
+    }
+}
+
+void SensorService::routeEvents(const sp<ActiveState>& state,
+        sensors_event_t const* buffer, size_t count)
+{
+    mEventRoutes.clear();
+    mEventRouteIndices.clear();
+
+    // first find out how many events go to each connection, looking up the
+    // subscribers once for each run of events from the same sensor
+    size_t total = 0;
+    for (size_t i=0 ; i<count ; ) {
+        const int32_t handle = buffer[i].sensor;
+        size_t run = 1;
+        while (i+run<count && buffer[i+run].sensor == handle) {
+            run++;
+        }
+        const ssize_t index = state->connections.indexOfKey(handle);
+        if (index >= 0) {
+            const SortedVector< wp<SensorEventConnection> >& connections(
+                    state->connections.valueAt(index));
+            for (size_t j=0 ; j<connections.size() ; j++) {
+                SensorEventConnection* c = connections[j].unsafe_get();
+                ssize_t index = mEventRouteIndices.indexOfKey(c);
+                if (index < 0) {
+                    EventRoute route;
+                    route.connection = connections[j];
+                    route.offset = 0;
+                    route.count = 0;
+                    index = mEventRouteIndices.add(c, mEventRoutes.add(route));
+                }
+                mEventRoutes.editItemAt(mEventRouteIndices.valueAt(index)).count += run;
+                total += run;
+            }
+        }
+        i += run;
+    }
+
+    if (total > mRoutedEventsCapacity) {
+        free(mRoutedEvents);
+        mRoutedEvents = static_cast<sensors_event_t*>(
+                malloc(total * sizeof(sensors_event_t)));
+        mRoutedEventsCapacity = total;
+    }
+
+    // then lay out each connection's events in one contiguous slice, in the
+    // order they appear in the buffer
+    size_t offset = 0;
+    for (size_t i=0 ; i<mEventRoutes.size() ; i++) {
+        EventRoute& route(mEventRoutes.editItemAt(i));
+        route.offset = offset;
+        offset += route.count;
+        route.count = 0;
+    }
+    for (size_t i=0 ; i<count ; ) {
+        const int32_t handle = buffer[i].sensor;
+        size_t run = 1;
+        while (i+run<count && buffer[i+run].sensor == handle) {
+            run++;
         }
-    };
-    qsort(buffer, count, sizeof(sensors_event_t), compar::cmp);
+        const ssize_t index = state->connections.indexOfKey(handle);
+        if (index >= 0) {
+            const SortedVector< wp<SensorEventConnection> >& connections(
+                    state->connections.valueAt(index));
+            for (size_t j=0 ; j<connections.size() ; j++) {
+                EventRoute& route(mEventRoutes.editItemAt(
+                        mEventRouteIndices.valueFor(connections[j].unsafe_get())));
+                memcpy(mRoutedEvents + route.offset + route.count, buffer + i,
+                        run * sizeof(sensors_event_t));
+                route.count += run;
+            }
+        }
+        i += run;
+    }
 }
 
-SortedVector< wp<SensorService::SensorEventConnection> >
-SensorService::getActiveConnections() const
+void SensorService::publishActiveStateLocked()
 {
-    Mutex::Autolock _l(mLock);
-    return mActiveConnections;
+    // Vector copies share their storage, so this is cheap
+    sp<ActiveState> state(new ActiveState());
+    const size_t size = mActiveSensors.size();
+    state->connections.setCapacity(size);
+    for (size_t i=0 ; i<size ; i++) {
+        state->connections.add(mActiveSensors.keyAt(i),
+                mActiveSensors.valueAt(i)->getConnections());
+    }
+    state->virtualSensors = mActiveVirtualSensors;
+
+    Mutex::Autolock _l(mActiveStateLock);
+    mActiveState = state;
 }
 
-DefaultKeyedVector<int, SensorInterface*>
-SensorService::getActiveVirtualSensors() const
+sp<SensorService::ActiveState> SensorService::getActiveState() const
 {
-    Mutex::Autolock _l(mLock);
-    return mActiveVirtualSensors;
+    Mutex::Autolock _l(mActiveStateLock);
+    return mActiveState;
+}
+
+bool SensorService::isContinuousSensor(int handle) const {
+    return mContinuousSensors.indexOf(handle) >= 0;
 }
 
 String8 SensorService::getSensorName(int handle) const {
@@ -413,6 +612,7 @@ void SensorService::cleanupConnection(SensorEventConnection* c)
         }
     }
     mActiveConnections.remove(connection);
+    publishActiveStateLocked();
 }
 
 status_t SensorService::enable(const sp<SensorEventConnection>& connection,
@@ -439,8 +639,8 @@ status_t SensorService::enable(const sp<SensorEventConnection>& connection,
                 // known value of the requested sensor if it's not a
                 // "continuous" sensor.
                 if (sensor->getSensor().getMinDelay() == 0) {
-                    sensors_event_t scratch;
-                    sensors_event_t& event(mLastEventSeen.editValueFor(handle));
+                    sensors_event_t event;
+                    mLastEventSeen.valueFor(handle).read(&event);
                     if (event.version == sizeof(sensors_event_t)) {
                         connection->sendEvents(&event, 1);
                     }
@@ -457,6 +657,7 @@ status_t SensorService::enable(const sp<SensorEventConnection>& connection,
                 }
             }
         }
+        publishActiveStateLocked();
     }
     return err;
 }
@@ -482,6 +683,7 @@ status_t SensorService::disable(const sp<SensorEventConnection>& connection,
             mActiveVirtualSensors.removeItem(handle);
             delete rec;
         }
+        publishActiveStateLocked();
         SensorInterface* sensor = mSensorMap.valueFor(handle);
         err = sensor ? sensor->activate(connection.get(), false) : status_t(BAD_VALUE);
     }
@@ -544,7 +746,7 @@ bool SensorService::SensorRecord::removeConnection(
 
 SensorService::SensorEventConnection::SensorEventConnection(
         const sp<SensorService>& service)
-    : mService(service), mChannel(new BitTube())
+    : mService(service), mChannel(new BitTube()), mPendingSince(0)
 {
 }
 
@@ -570,6 +772,10 @@ bool SensorService::SensorEventConnection::addSensor(int32_t handle) {
 bool SensorService::SensorEventConnection::removeSensor(int32_t handle) {
     Mutex::Autolock _l(mConnectionLock);
     if (mSensorInfo.remove(handle) >= 0) {
+        if (mSensorInfo.size() == 0) {
+            // nothing would come along to push out the held back events
+            flushPendingEventsLocked();
+        }
         return true;
     }
     return false;
@@ -586,32 +792,85 @@ bool SensorService::SensorEventConnection::hasAnySensor() const {
 }
 
 status_t SensorService::SensorEventConnection::sendEvents(
-        sensors_event_t const* buffer, size_t numEvents,
-        sensors_event_t* scratch)
+        sensors_event_t const* events, size_t count)
 {
-    // filter out events not for this connection
-    size_t count = 0;
-    if (scratch) {
+    const nsecs_t maxReportLatency = mService->getMaxReportLatency();
+    if (maxReportLatency > 0) {
         Mutex::Autolock _l(mConnectionLock);
-        size_t i=0;
-        while (i<numEvents) {
-            const int32_t curr = buffer[i].sensor;
-            if (mSensorInfo.indexOf(curr) >= 0) {
-                do {
-                    scratch[count++] = buffer[i++];
-                } while ((i<numEvents) && (buffer[i].sensor == curr));
-            } else {
-                i++;
-            }
+        return batchEventsLocked(events, count, maxReportLatency);
+    }
+    return writeEvents(events, count);
+}
+
+status_t SensorService::SensorEventConnection::batchEventsLocked(
+        sensors_event_t const* events, size_t count, nsecs_t maxReportLatency)
+{
+    if (count == 0) {
+        return NO_ERROR;
+    }
+
+    // make room, the batch is written to the channel in one go
+    if (mPendingEvents.size() + count > MAX_PENDING_EVENTS) {
+        flushPendingEventsLocked();
+        if (count > MAX_PENDING_EVENTS) {
+            return writeEvents(events, count);
         }
-    } else {
-        scratch = const_cast<sensors_event_t *>(buffer);
-        count = numEvents;
     }
 
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    const bool wasEmpty = mPendingEvents.isEmpty();
+    if (wasEmpty) {
+        mPendingSince = now;
+    }
+    mPendingEvents.appendArray(events, count);
+
+    // an event from an on-change sensor may be the last one for a long time,
+    // so it is reported right away together with everything before it
+    bool flush = now - mPendingSince >= maxReportLatency;
+    for (size_t i=0 ; i<count && !flush ; i++) {
+        flush = !mService->isContinuousSensor(events[i].sensor);
+    }
+    if (flush) {
+        return flushPendingEventsLocked();
+    }
+    if (wasEmpty) {
+        // the next events may not come in time to push these out
+        mService->wakeBatchFlushThread();
+    }
+    return NO_ERROR;
+}
+
+nsecs_t SensorService::SensorEventConnection::flushOverdueEvents(
+        nsecs_t now, nsecs_t maxReportLatency)
+{
+    Mutex::Autolock _l(mConnectionLock);
+    if (mPendingEvents.isEmpty()) {
+        return 0;
+    }
+    const nsecs_t deadline = mPendingSince + maxReportLatency;
+    if (now >= deadline) {
+        flushPendingEventsLocked();
+        return 0;
+    }
+    return deadline;
+}
+
+status_t SensorService::SensorEventConnection::flushPendingEventsLocked()
+{
+    if (mPendingEvents.isEmpty()) {
+        return NO_ERROR;
+    }
+    status_t err = writeEvents(mPendingEvents.array(), mPendingEvents.size());
+    mPendingEvents.clear();
+    return err;
+}
+
+status_t SensorService::SensorEventConnection::writeEvents(
+        sensors_event_t const* events, size_t count)
+{
     // NOTE: ASensorEvent and sensors_event_t are the same type
     ssize_t size = SensorEventQueue::write(mChannel,
-            reinterpret_cast<ASensorEvent const*>(scratch), count);
+            reinterpret_cast<ASensorEvent const*>(events), count);
     if (size == -EAGAIN) {
         // the destination doesn't accept events anymore, it's probably
         // full. For now, we just drop the events on the floor.
@@ -54,6 +54,10 @@ class SensorService :
 
    static const nsecs_t MINIMUM_EVENTS_PERIOD =   1000000; // 1000 Hz
 
+   // at most this many events are held back for a connection, so that a batch
+   // is never larger than what the service writes to a channel after one poll
+   static const size_t MAX_PENDING_EVENTS = 16;
+
             SensorService();
     virtual ~SensorService();
 
@@ -82,11 +86,25 @@ class SensorService :
         // protected by SensorService::mLock
         SortedVector<int> mSensorInfo;
 
+        // Events held back until the oldest of them has waited for the maximum report
+        // latency, protected by mConnectionLock.
+        Vector<sensors_event_t> mPendingEvents;
+        nsecs_t mPendingSince;
+
+        status_t writeEvents(sensors_event_t const* events, size_t count);
+        status_t batchEventsLocked(sensors_event_t const* events, size_t count,
+                nsecs_t maxReportLatency);
+        status_t flushPendingEventsLocked();
+
     public:
         SensorEventConnection(const sp<SensorService>& service);
 
-        status_t sendEvents(sensors_event_t const* buffer, size_t count,
-                sensors_event_t* scratch = NULL);
+        // flushes the held back events if the oldest has waited for maxReportLatency,
+        // returns when it will have otherwise, 0 if there are none
+        nsecs_t flushOverdueEvents(nsecs_t now, nsecs_t maxReportLatency);
+
+        // events must all be for sensors of this connection
+        status_t sendEvents(sensors_event_t const* events, size_t count);
         bool hasSensor(int32_t handle) const;
         bool hasAnySensor() const;
         bool addSensor(int32_t handle);
@@ -100,10 +118,56 @@ class SensorService :
         bool addConnection(const sp<SensorEventConnection>& connection);
         bool removeConnection(const wp<SensorEventConnection>& connection);
         size_t getNumConnections() const { return mConnections.size(); }
+        const SortedVector< wp<SensorEventConnection> >& getConnections() const {
+            return mConnections;
+        }
     };
 
-    SortedVector< wp<SensorEventConnection> > getActiveConnections() const;
-    DefaultKeyedVector<int, SensorInterface*> getActiveVirtualSensors() const;
+    // flushes the events held back by the connections once they are overdue, as
+    // the sensors of a connection may slow down or pause and then no new event
+    // would push them out
+    class BatchFlushThread : public Thread {
+        SensorService* const mService;
+        Mutex mLock;
+        Condition mCondition;
+        bool mWoken;
+        virtual bool threadLoop();
+    public:
+        BatchFlushThread(SensorService* service);
+        // called when a connection starts holding back events
+        void wake();
+    };
+
+    // the last event of a sensor, written only by the SensorService thread and
+    // read without any lock: seq is odd while the event is being written, and a
+    // reader retries until it sees the same even seq before and after its copy.
+    struct LastEvent {
+        int32_t seq;
+        sensors_event_t event;
+        void write(const sensors_event_t& e);
+        void read(sensors_event_t* e) const;
+    };
+
+    // the subscribers of each active sensor and the active virtual sensors, as
+    // used by the SensorService thread. Binder threads never modify a published
+    // ActiveState, they build a new one and swap it in, so the thread never
+    // waits for them.
+    struct ActiveState : public LightRefBase<ActiveState> {
+        KeyedVector<int, SortedVector< wp<SensorEventConnection> > > connections;
+        DefaultKeyedVector<int, SensorInterface*> virtualSensors;
+    };
+
+    // the events of one poll destined to one connection
+    struct EventRoute {
+        wp<SensorEventConnection> connection;
+        size_t offset; // into mRoutedEvents
+        size_t count;
+    };
+
+    void routeEvents(const sp<ActiveState>& state,
+            sensors_event_t const* buffer, size_t count);
+    void publishActiveStateLocked();
+    sp<ActiveState> getActiveState() const;
 
     String8 getSensorName(int handle) const;
     void recordLastValue(sensors_event_t const * buffer, size_t count);
@@ -117,6 +181,11 @@ class SensorService :
     DefaultKeyedVector<int, SensorInterface*> mSensorMap;
     Vector<SensorInterface *> mVirtualSensorList;
     status_t mInitCheck;
+    // events of continuous sensors may be held back for up to mMaxReportLatency
+    // before they are reported to clients, 0 reports them as soon as they arrive
+    nsecs_t mMaxReportLatency;
+    SortedVector<int> mContinuousSensors;
+    sp<BatchFlushThread> mBatchFlushThread;
 
     // protected by mLock
     mutable Mutex mLock;
@@ -124,13 +193,29 @@ class SensorService :
     DefaultKeyedVector<int, SensorInterface*> mActiveVirtualSensors;
     SortedVector< wp<SensorEventConnection> > mActiveConnections;
 
-    // The size of this vector is constant, only the items are mutable
-    KeyedVector<int32_t, sensors_event_t> mLastEventSeen;
+    // only held to swap the published ActiveState, never while building it
+    mutable Mutex mActiveStateLock;
+    sp<ActiveState> mActiveState;
+
+    // The size of this vector is constant, only the items are mutable, and
+    // they're only written by the SensorService thread
+    KeyedVector<int32_t, LastEvent> mLastEventSeen;
+
+    // only used by the SensorService thread, to hand each connection the
+    // events of its sensors without scanning the whole buffer for it
+    Vector<EventRoute> mEventRoutes;
+    KeyedVector<SensorEventConnection*, size_t> mEventRouteIndices;
+    sensors_event_t* mRoutedEvents;
+    size_t mRoutedEventsCapacity;
 
 public:
     static char const* getServiceName() { return "sensorservice"; }
 
     void cleanupConnection(SensorEventConnection* connection);
+    nsecs_t getMaxReportLatency() const { return mMaxReportLatency; }
+    void wakeBatchFlushThread();
+    nsecs_t flushOverdueEvents();
+    bool isContinuousSensor(int handle) const;
     status_t enable(const sp<SensorEventConnection>& connection, int handle);
     status_t disable(const sp<SensorEventConnection>& connection, int handle);
     status_t setEventRate(const sp<SensorEventConnection>& connection, int handle, nsecs_t ns);
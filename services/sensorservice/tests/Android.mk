@@ -0,0 +1,49 @@
+# Copyright (C) 2012 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Build the sensor fusion benchmark.
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    FusionBench.cpp \
+    ../Fusion.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+    libcutils \
+    libutils
+
+LOCAL_MODULE:= fusionbench
+
+LOCAL_MODULE_TAGS := eng tests
+
+include $(BUILD_EXECUTABLE)
+
+# Build the sensor recording replay tool.
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+    SensorReplay.cpp \
+    ../Fusion.cpp \
+    ../SensorRecording.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+    libcutils \
+    libutils
+
+LOCAL_MODULE:= sensorreplay
+
+LOCAL_MODULE_TAGS := eng tests
+
+include $(BUILD_EXECUTABLE)
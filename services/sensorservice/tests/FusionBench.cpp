@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Measures the cost of the sensor fusion filter steps.
+ *
+ * The filter is fed a device lying still on a table, with a small constant gyro
+ * drift, until it has an estimate.  Each step is then timed separately:
+ *
+ *     gyro      Fusion::handleGyro(), the covariance prediction
+ *     acc       Fusion::handleAcc(), a measurement update against gravity
+ *     mag       Fusion::handleMag(), a measurement update against north
+ *
+ * Usage: fusionbench [iterations]
+ */
+
+#include "../Fusion.h"
+
+#include <utils/Timers.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace android;
+
+static const float GYRO_DT = 1.0f / 200.0f; // 200 Hz
+static const int DEFAULT_ITERATIONS = 100000;
+
+static void report(const char* name, nsecs_t elapsed, int iterations) {
+    printf("%-8s %8.1f ns/step\n", name, double(elapsed) / iterations);
+}
+
+int main(int argc, char** argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    vec3_t w;
+    w.x = 0.001f; w.y = -0.002f; w.z = 0.0005f;
+    vec3_t a;
+    a.x = 0; a.y = 0; a.z = 9.81f;
+    vec3_t m;
+    m.x = 0; m.y = 22.0f; m.z = -40.0f;
+
+    Fusion fusion;
+    fusion.init();
+    while (!fusion.hasEstimate()) {
+        fusion.handleAcc(a);
+        fusion.handleMag(m);
+        fusion.handleGyro(w, GYRO_DT);
+    }
+
+    nsecs_t gyroTime = 0, accTime = 0, magTime = 0;
+    for (int i = 0; i < iterations; i++) {
+        nsecs_t t0 = systemTime(SYSTEM_TIME_MONOTONIC);
+        fusion.handleGyro(w, GYRO_DT);
+        nsecs_t t1 = systemTime(SYSTEM_TIME_MONOTONIC);
+        fusion.handleAcc(a);
+        nsecs_t t2 = systemTime(SYSTEM_TIME_MONOTONIC);
+        fusion.handleMag(m);
+        nsecs_t t3 = systemTime(SYSTEM_TIME_MONOTONIC);
+        gyroTime += t1 - t0;
+        accTime += t2 - t1;
+        magTime += t3 - t2;
+    }
+
+    report("gyro", gyroTime, iterations);
+    report("acc", accTime, iterations);
+    report("mag", magTime, iterations);
+
+    const vec4_t q(fusion.getAttitude());
+    printf("attitude %f %f %f %f\n", q.x, q.y, q.z, q.w);
+    return 0;
+}
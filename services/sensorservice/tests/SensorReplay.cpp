@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2012 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a recording of raw h/w sensor events through the sensor fusion and
+ * reports what it cost and how far the virtual sensors drifted from a golden
+ * run.
+ *
+ * Recordings are captured by starting the sensor service with
+ *
+ *     sensorservice -r /data/system/sensors.rec
+ *
+ * The events are fed to the filter the way SensorFusion::process() does, with
+ * all virtual sensors enabled, as fast as possible and without the HAL or the
+ * service. After each accelerometer event the outputs of the rotation-vector,
+ * gravity and gyro-bias sensors are sampled, as the virtual sensors do, and
+ * can be saved (-o) as the golden run for later comparisons (-g).
+ *
+ * Usage: sensorreplay [-o golden-out] [-g golden-in] recording
+ */
+
+#include "../Fusion.h"
+#include "../SensorRecording.h"
+
+#include <hardware/sensors.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace android;
+
+// the outputs of the virtual sensors after one accelerometer event
+struct Sample {
+    int64_t timestamp;
+    vec4_t attitude;
+    vec3_t gravity;
+    vec3_t bias;
+};
+
+static status_t writeSamples(const char* path, const Vector<Sample>& samples) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "couldn't create '%s'\n", path);
+        return BAD_VALUE;
+    }
+    for (size_t i=0 ; i<samples.size() ; i++) {
+        const Sample& s(samples[i]);
+        fprintf(f, "%lld %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n",
+                s.timestamp,
+                s.attitude.x, s.attitude.y, s.attitude.z, s.attitude.w,
+                s.gravity.x, s.gravity.y, s.gravity.z,
+                s.bias.x, s.bias.y, s.bias.z);
+    }
+    fclose(f);
+    return NO_ERROR;
+}
+
+static status_t readSamples(const char* path, Vector<Sample>* outSamples) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "couldn't open '%s'\n", path);
+        return BAD_VALUE;
+    }
+    Sample s;
+    while (fscanf(f, "%lld %g %g %g %g %g %g %g %g %g %g",
+            &s.timestamp,
+            &s.attitude.x, &s.attitude.y, &s.attitude.z, &s.attitude.w,
+            &s.gravity.x, &s.gravity.y, &s.gravity.z,
+            &s.bias.x, &s.bias.y, &s.bias.z) == 11) {
+        outSamples->add(s);
+    }
+    fclose(f);
+    return NO_ERROR;
+}
+
+// angle between two unit quaternions, in degrees
+static float attitudeError(const vec4_t& a, const vec4_t& b) {
+    const float d = fabsf(dot_product(a, b));
+    return 2 * acosf(d < 1 ? d : 1) * float(180 / M_PI);
+}
+
+// angle between two vectors, in degrees
+static float directionError(const vec3_t& a, const vec3_t& b) {
+    const float c = dot_product(a, b) / (length(a) * length(b));
+    return acosf(c < 1 ? (c > -1 ? c : -1) : 1) * float(180 / M_PI);
+}
+
+static void compareSamples(const Vector<Sample>& samples, const Vector<Sample>& golden) {
+    const size_t count = samples.size() < golden.size() ? samples.size() : golden.size();
+    if (samples.size() != golden.size()) {
+        printf("sample count differs: %d, golden %d\n", samples.size(), golden.size());
+    }
+    float maxAttitude = 0, sumAttitude = 0;
+    float maxGravity = 0, sumGravity = 0;
+    float maxBias = 0;
+    size_t mismatched = 0;
+    for (size_t i=0 ; i<count ; i++) {
+        const Sample& s(samples[i]);
+        const Sample& g(golden[i]);
+        if (s.timestamp != g.timestamp) {
+            mismatched++;
+            continue;
+        }
+        const float ea = attitudeError(s.attitude, g.attitude);
+        const float eg = directionError(s.gravity, g.gravity);
+        const float eb = length(s.bias - g.bias);
+        maxAttitude = ea > maxAttitude ? ea : maxAttitude;
+        maxGravity = eg > maxGravity ? eg : maxGravity;
+        maxBias = eb > maxBias ? eb : maxBias;
+        sumAttitude += ea;
+        sumGravity += eg;
+    }
+    if (mismatched) {
+        printf("%d samples have a different timestamp than the golden run\n", mismatched);
+    }
+    const size_t n = count - mismatched;
+    printf("drift from golden run over %d samples:\n", n);
+    printf("  rotation vector  mean %8.4f deg  max %8.4f deg\n",
+            n ? sumAttitude / n : 0.0f, maxAttitude);
+    printf("  gravity          mean %8.4f deg  max %8.4f deg\n",
+            n ? sumGravity / n : 0.0f, maxGravity);
+    printf("  gyro bias                          max %8.6f rad/s\n", maxBias);
+}
+
+int main(int argc, char** argv) {
+    const char* goldenOut = NULL;
+    const char* goldenIn = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "o:g:")) != -1) {
+        switch (opt) {
+            case 'o': goldenOut = optarg; break;
+            case 'g': goldenIn = optarg; break;
+            default: optind = argc + 1; break;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-o golden-out] [-g golden-in] recording\n", argv[0]);
+        return 1;
+    }
+
+    SensorRecording recording;
+    if (SensorRecording::load(argv[optind], &recording) != NO_ERROR) {
+        fprintf(stderr, "couldn't load '%s'\n", argv[optind]);
+        return 1;
+    }
+    const Vector<sensors_event_t>& events(recording.getEvents());
+
+    // same as SensorFusion::process()
+    Fusion fusion;
+    fusion.init();
+    float gyroRate = 200;
+    int64_t gyroTime = 0;
+
+    Vector<Sample> samples;
+    size_t fused = 0;
+    nsecs_t maxLatency = 0;
+    nsecs_t totalLatency = 0;
+    const nsecs_t cpuStart = systemTime(SYSTEM_TIME_THREAD);
+    for (size_t i=0 ; i<events.size() ; i++) {
+        const sensors_event_t& event(events[i]);
+        const int32_t type = recording.getSensorType(event.sensor);
+        const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (type == SENSOR_TYPE_GYROSCOPE) {
+            if (gyroTime != 0) {
+                const float dT = (event.timestamp - gyroTime) / 1000000000.0f;
+                const float freq = 1 / dT;
+                if (freq >= 50 && freq<1000) {
+                    const float alpha = 1 / (1 + dT);
+                    gyroRate = freq + (gyroRate - freq)*alpha;
+                }
+            }
+            gyroTime = event.timestamp;
+            fusion.handleGyro(vec3_t(event.data), 1.0f/gyroRate);
+        } else if (type == SENSOR_TYPE_MAGNETIC_FIELD) {
+            fusion.handleMag(vec3_t(event.data));
+        } else if (type == SENSOR_TYPE_ACCELEROMETER) {
+            fusion.handleAcc(vec3_t(event.data));
+            if (fusion.hasEstimate()) {
+                Sample s;
+                s.timestamp = event.timestamp;
+                s.attitude = fusion.getAttitude();
+                s.gravity = fusion.getRotationMatrix()[2] * GRAVITY_EARTH;
+                s.bias = fusion.getBias();
+                samples.add(s);
+            }
+        } else {
+            continue;
+        }
+        const nsecs_t latency = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+        maxLatency = latency > maxLatency ? latency : maxLatency;
+        totalLatency += latency;
+        fused++;
+    }
+    const nsecs_t cpu = systemTime(SYSTEM_TIME_THREAD) - cpuStart;
+
+    printf("%d events in %d polls, %d fused, %d samples\n",
+            events.size(), recording.getBatchSizes().size(), fused, samples.size());
+    if (fused) {
+        printf("cpu      %8.1f us/event\n", ns2us(cpu) / double(fused));
+        printf("latency  %8.1f us mean, %8.1f us max\n",
+                ns2us(totalLatency) / double(fused), double(ns2us(maxLatency)));
+    }
+
+    if (goldenOut && writeSamples(goldenOut, samples) != NO_ERROR) {
+        return 1;
+    }
+    if (goldenIn) {
+        Vector<Sample> golden;
+        if (readSamples(goldenIn, &golden) != NO_ERROR) {
+            return 1;
+        }
+        compareSamples(samples, golden);
+    }
+    return 0;
+}
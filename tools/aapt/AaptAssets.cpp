@@ -5,6 +5,7 @@
 #include "AaptAssets.h"
 #include "ResourceFilter.h"
 #include "Main.h"
+#include "ScanCache.h"
 
 #include <utils/misc.h>
 #include <utils/SortedVector.h>
@@ -1690,42 +1691,51 @@ status_t AaptDir::addLeafFile(const String8& leafName, const sp<AaptFile>& file)
     return group->addFile(file);
 }
 
+/*
+ * List the entries of a source directory, through the scan cache of the
+ * build if there is one.
+ */
+static status_t listDir(Bundle* bundle, const String8& dir,
+                        Vector<ScanCache::Entry>* outEntries)
+{
+    ScanCache* cache = bundle->getScanCache();
+    if (cache != NULL) {
+        return cache->listDir(dir, outEntries);
+    }
+    return ScanCache::scanDir(dir, outEntries);
+}
+
 ssize_t AaptDir::slurpFullTree(Bundle* bundle, const String8& srcDir,
                             const AaptGroupEntry& kind, const String8& resType,
                             sp<FilePathStore>& fullResPaths)
 {
     Vector<String8> fileNames;
+    Vector<FileType> fileTypes;
     {
-        DIR* dir = NULL;
-
-        dir = opendir(srcDir.string());
-        if (dir == NULL) {
-            fprintf(stderr, "ERROR: opendir(%s): %s\n", srcDir.string(), strerror(errno));
+        Vector<ScanCache::Entry> entries;
+        status_t err = listDir(bundle, srcDir, &entries);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "ERROR: opendir(%s): %s\n", srcDir.string(), strerror(-err));
             return UNKNOWN_ERROR;
         }
 
         /*
          * Slurp the filenames out of the directory.
          */
-        while (1) {
-            struct dirent* entry;
-
-            entry = readdir(dir);
-            if (entry == NULL)
-                break;
+        for (size_t i = 0; i < entries.size(); i++) {
+            const ScanCache::Entry& entry = entries[i];
 
-            if (isHidden(srcDir.string(), entry->d_name))
+            if (isHidden(srcDir.string(), entry.name.string()))
                 continue;
 
-            String8 name(entry->d_name);
-            fileNames.add(name);
+            fileNames.add(entry.name);
+            fileTypes.add(entry.type);
             // Add fully qualified path for dependency purposes
             // if we're collecting them
             if (fullResPaths != NULL) {
-                fullResPaths->add(srcDir.appendPathCopy(name));
+                fullResPaths->add(srcDir.appendPathCopy(entry.name));
             }
         }
-        closedir(dir);
     }
 
     ssize_t count = 0;
@@ -1740,7 +1750,7 @@ ssize_t AaptDir::slurpFullTree(Bundle* bundle, const String8& srcDir,
         FileType type;
 
         pathName.appendPath(fileNames[i].string());
-        type = getFileType(pathName.string());
+        type = fileTypes[i];
         if (type == kFileTypeDirectory) {
             sp<AaptDir> subdir;
             bool notAdded = false;
@@ -2164,9 +2174,10 @@ ssize_t AaptAssets::slurpResourceTree(Bundle* bundle, const String8& srcDir)
 {
     ssize_t err = 0;
 
-    DIR* dir = opendir(srcDir.string());
-    if (dir == NULL) {
-        fprintf(stderr, "ERROR: opendir(%s): %s\n", srcDir.string(), strerror(errno));
+    Vector<ScanCache::Entry> entries;
+    status_t listErr = listDir(bundle, srcDir, &entries);
+    if (listErr != NO_ERROR) {
+        fprintf(stderr, "ERROR: opendir(%s): %s\n", srcDir.string(), strerror(-listErr));
         return UNKNOWN_ERROR;
     }
 
@@ -2176,25 +2187,22 @@ ssize_t AaptAssets::slurpResourceTree(Bundle* bundle, const String8& srcDir)
      * Run through the directory, looking for dirs that match the
      * expected pattern.
      */
-    while (1) {
-        struct dirent* entry = readdir(dir);
-        if (entry == NULL) {
-            break;
-        }
+    for (size_t i = 0; i < entries.size(); i++) {
+        const ScanCache::Entry& entry = entries[i];
 
-        if (isHidden(srcDir.string(), entry->d_name)) {
+        if (isHidden(srcDir.string(), entry.name.string())) {
             continue;
         }
 
         String8 subdirName(srcDir);
-        subdirName.appendPath(entry->d_name);
+        subdirName.appendPath(entry.name.string());
 
         AaptGroupEntry group;
         String8 resType;
-        bool b = group.initFromDirName(entry->d_name, &resType);
+        bool b = group.initFromDirName(entry.name.string(), &resType);
         if (!b) {
             fprintf(stderr, "invalid resource directory name: %s/%s\n", srcDir.string(),
-                    entry->d_name);
+                    entry.name.string());
             err = -1;
             continue;
         }
@@ -2204,12 +2212,12 @@ ssize_t AaptAssets::slurpResourceTree(Bundle* bundle, const String8& srcDir)
             const char *verString = group.getVersionString().string();
             int dirVersionInt = atoi(verString + 1); // skip 'v' in version name
             if (dirVersionInt > maxResInt) {
-              fprintf(stderr, "max res %d, skipping %s\n", maxResInt, entry->d_name);
+              fprintf(stderr, "max res %d, skipping %s\n", maxResInt, entry.name.string());
               continue;
             }
         }
 
-        FileType type = getFileType(subdirName.string());
+        FileType type = entry.type;
 
         if (type == kFileTypeDirectory) {
             sp<AaptDir> dir = makeDir(resType);
@@ -2239,9 +2247,6 @@ ssize_t AaptAssets::slurpResourceTree(Bundle* bundle, const String8& srcDir)
     }
 
 bail:
-    closedir(dir);
-    dir = NULL;
-
     if (err != 0) {
         return err;
     }
@@ -12,8 +12,10 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
 	AaptAssets.cpp \
+	BuildState.cpp \
 	Command.cpp \
 	CrunchCache.cpp \
+	Daemon.cpp \
 	FileFinder.cpp \
 	Main.cpp \
 	Package.cpp \
@@ -22,6 +24,7 @@ LOCAL_SRC_FILES := \
 	ResourceFilter.cpp \
 	ResourceIdCache.cpp \
 	ResourceTable.cpp \
+	ScanCache.cpp \
 	Images.cpp \
 	Resource.cpp \
     SourcePos.cpp \
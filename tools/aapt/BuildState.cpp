@@ -0,0 +1,204 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Implementation file for BuildState
+//
+
+#include "BuildState.h"
+#include "Main.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+// Bump whenever the processing of a resource changes, so that the outputs of an
+// older aapt are never reused.
+static const uint32_t kBuildStateVersion = 1;
+
+static const char* kIndexName = "index";
+
+static status_t readFile(const String8& path, Vector<char>* outData)
+{
+    FILE* fp = fopen(path.string(), "rb");
+    if (fp == NULL) {
+        return -errno;
+    }
+    char buf[16 * 1024];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        outData->appendArray(buf, n);
+    }
+    status_t err = ferror(fp) ? UNKNOWN_ERROR : NO_ERROR;
+    fclose(fp);
+    return err;
+}
+
+BuildState::BuildState(const String8& dir)
+    : mDir(dir), mRestored(0), mStored(0), mTempCount(0)
+{
+}
+
+status_t BuildState::load()
+{
+    FileType type = getFileType(mDir.string());
+    if (type == kFileTypeNonexistent) {
+#ifdef HAVE_MS_C_RUNTIME
+        int err = _mkdir(mDir.string());
+#else
+        int err = mkdir(mDir.string(), S_IRUSR|S_IWUSR|S_IXUSR|S_IRGRP|S_IXGRP);
+#endif
+        if (err != 0) {
+            fprintf(stderr, "ERROR: Unable to create build state directory '%s': %s\n",
+                    mDir.string(), strerror(errno));
+            return UNKNOWN_ERROR;
+        }
+        return NO_ERROR;
+    } else if (type != kFileTypeDirectory) {
+        fprintf(stderr, "ERROR: Build state '%s' is not a directory\n", mDir.string());
+        return UNKNOWN_ERROR;
+    }
+
+    String8 indexPath(mDir);
+    indexPath.appendPath(kIndexName);
+    FILE* fp = fopen(indexPath.string(), "r");
+    if (fp == NULL) {
+        // first build
+        return NO_ERROR;
+    }
+
+    // one "key path" line per resource
+    char line[4096];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char* sep = strchr(line, ' ');
+        char* end = strchr(line, '\n');
+        if (sep == NULL || end == NULL) {
+            continue;
+        }
+        *sep = 0;
+        *end = 0;
+        mPrevious.add(String8(sep + 1), String8(line));
+    }
+    fclose(fp);
+    return NO_ERROR;
+}
+
+status_t BuildState::computeKey(const String8& sourceFile, uint32_t options, String8* outKey)
+{
+    Vector<char> data;
+    status_t err = readFile(sourceFile, &data);
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    // two independent checksums and the size make accidental collisions
+    // between versions of the same file practically impossible
+    const Bytef* bytes = reinterpret_cast<const Bytef*>(data.array());
+    uLong crc = crc32(crc32(0L, Z_NULL, 0), bytes, data.size());
+    uLong adler = adler32(adler32(0L, Z_NULL, 0), bytes, data.size());
+    outKey->appendFormat("%08x%08x%08x%08x%08x",
+            kBuildStateVersion, options, (uint32_t) data.size(),
+            (uint32_t) crc, (uint32_t) adler);
+    return NO_ERROR;
+}
+
+String8 BuildState::getOutputPath(const String8& key) const
+{
+    String8 path(mDir);
+    path.appendPath(key);
+    return path;
+}
+
+bool BuildState::restore(const String8& resPath, const String8& key,
+        const sp<AaptFile>& file)
+{
+    Vector<char> data;
+    if (readFile(getOutputPath(key), &data) != NO_ERROR) {
+        return false;
+    }
+
+    file->clearData();
+    if (file->writeData(data.array(), data.size()) != NO_ERROR) {
+        return false;
+    }
+
+    AutoMutex _l(mLock);
+    mCurrent.replaceValueFor(resPath, key);
+    mRestored++;
+    return true;
+}
+
+void BuildState::store(const String8& resPath, const String8& key,
+        const sp<AaptFile>& file)
+{
+    String8 tempPath;
+    {
+        AutoMutex _l(mLock);
+        tempPath = getOutputPath(key);
+        tempPath.appendFormat(".%u.tmp", mTempCount++);
+    }
+
+    // written under a temporary name and renamed, so that a key never names a
+    // partial output, even if the build is interrupted
+    FILE* fp = fopen(tempPath.string(), "wb");
+    if (fp == NULL) {
+        return;
+    }
+    size_t n = fwrite(file->getData(), 1, file->getSize(), fp);
+    int err = fclose(fp);
+    if (n != file->getSize() || err != 0 ||
+            rename(tempPath.string(), getOutputPath(key).string()) != 0) {
+        unlink(tempPath.string());
+        return;
+    }
+
+    AutoMutex _l(mLock);
+    mCurrent.replaceValueFor(resPath, key);
+    mStored++;
+}
+
+void BuildState::retainExisting()
+{
+    AutoMutex _l(mLock);
+    for (size_t i = 0; i < mPrevious.size(); i++) {
+        const String8& resPath = mPrevious.keyAt(i);
+        if (mCurrent.indexOfKey(resPath) < 0
+                && getFileType(resPath.string()) == kFileTypeRegular) {
+            mCurrent.add(resPath, mPrevious.valueAt(i));
+        }
+    }
+}
+
+status_t BuildState::save()
+{
+    AutoMutex _l(mLock);
+
+    String8 indexPath(mDir);
+    indexPath.appendPath(kIndexName);
+    FILE* fp = fopen(indexPath.string(), "w");
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: Unable to write build state index '%s': %s\n",
+                indexPath.string(), strerror(errno));
+        return UNKNOWN_ERROR;
+    }
+
+    // outputs can be shared by resources with the same contents, so only
+    // the keys nothing uses anymore are deleted
+    KeyedVector<String8, bool> used;
+    for (size_t i = 0; i < mCurrent.size(); i++) {
+        fprintf(fp, "%s %s\n", mCurrent.valueAt(i).string(), mCurrent.keyAt(i).string());
+        used.replaceValueFor(mCurrent.valueAt(i), true);
+    }
+    fclose(fp);
+
+    for (size_t i = 0; i < mPrevious.size(); i++) {
+        const String8& key = mPrevious.valueAt(i);
+        if (used.indexOfKey(key) < 0) {
+            unlink(getOutputPath(key).string());
+        }
+    }
+    return NO_ERROR;
+}
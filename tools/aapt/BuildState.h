@@ -0,0 +1,81 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Persistent state of the resource build, so that unchanged resources don't
+// need to be processed again by the next build.
+//
+
+#ifndef BUILD_STATE_H
+#define BUILD_STATE_H
+
+#include <utils/Errors.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+
+#include "AaptAssets.h"
+
+using namespace android;
+
+/*
+ * The build state lives in a directory of its own. Each processed resource is
+ * stored there under a key made of the contents of its source file and of the
+ * options that affect its processing, and an index records the key of every
+ * resource of the last build. A resource whose key is found in the directory
+ * doesn't need to be processed again, whatever its path or time stamp.
+ *
+ * Only PNG images are covered: compiled XML files embed the resource ids and
+ * string pool of the whole table and must be recompiled on every build.
+ *
+ * Safe to use from several threads.
+ */
+class BuildState {
+public:
+    BuildState(const String8& dir);
+
+    /* Reads the index of the previous build, creating the directory if needed. */
+    status_t load();
+
+    /* Computes the key of the given source file processed with the given options. */
+    static status_t computeKey(const String8& sourceFile, uint32_t options, String8* outKey);
+
+    /*
+     * Replaces the data of file with the output stored under key, if any.
+     * Returns true if the output was found.
+     */
+    bool restore(const String8& resPath, const String8& key, const sp<AaptFile>& file);
+
+    /* Stores the data of file as the output of key. */
+    void store(const String8& resPath, const String8& key, const sp<AaptFile>& file);
+
+    /*
+     * Keeps the outputs of the previous build for the resources that were not
+     * processed by this one and whose source file still exists, for builds
+     * that only process the sources changed since the last one.
+     */
+    void retainExisting();
+
+    /*
+     * Writes the index of this build and deletes the outputs of resources
+     * that are gone or have changed since the previous build.
+     */
+    status_t save();
+
+    /* Number of resources restored and stored during this build. */
+    size_t getRestoredCount() const { return mRestored; }
+    size_t getStoredCount() const { return mStored; }
+
+private:
+    String8 getOutputPath(const String8& key) const;
+
+    String8 mDir;
+    Mutex mLock;
+    // resource path -> key, of the previous build and of this build
+    KeyedVector<String8, String8> mPrevious;
+    KeyedVector<String8, String8> mCurrent;
+    size_t mRestored;
+    size_t mStored;
+    uint32_t mTempCount;
+};
+
+#endif // BUILD_STATE_H
@@ -41,6 +41,9 @@ typedef enum Command {
     kCommandCrunch,
 } Command;
 
+class BuildState;
+class ScanCache;
+
 /*
  * Bundle of goodies, including everything specified on the command line.
  */
@@ -63,7 +66,9 @@ public:
           mMinSdkVersion(NULL), mTargetSdkVersion(NULL), mMaxSdkVersion(NULL),
           mVersionCode(NULL), mVersionName(NULL), mCustomPackage(NULL), mExtraPackages(NULL),
           mMaxResVersion(NULL), mDebugMode(false), mNonConstantId(false), mProduct(NULL),
-          mUseCrunchCache(false), mArgc(0), mArgv(NULL)
+          mUseCrunchCache(false), mOptimizePngs(false), mBuildStateDir(NULL), mBuildState(NULL),
+          mResourceIdCacheDir(NULL), mScanCache(NULL),
+          mArgc(0), mArgv(NULL)
         {}
     ~Bundle(void) {}
 
@@ -177,6 +182,16 @@ public:
     void setProduct(const char * val) { mProduct = val; }
     void setUseCrunchCache(bool val) { mUseCrunchCache = val; }
     bool getUseCrunchCache() const { return mUseCrunchCache; }
+    bool getOptimizePngs() const { return mOptimizePngs; }
+    void setOptimizePngs(bool val) { mOptimizePngs = val; }
+    const char* getBuildStateDir() const { return mBuildStateDir; }
+    void setBuildStateDir(const char* dir) { mBuildStateDir = dir; }
+    BuildState* getBuildState() const { return mBuildState; }
+    void setBuildState(BuildState* state) { mBuildState = state; }
+    const char* getResourceIdCacheDir() const { return mResourceIdCacheDir; }
+    void setResourceIdCacheDir(const char* dir) { mResourceIdCacheDir = dir; }
+    ScanCache* getScanCache() const { return mScanCache; }
+    void setScanCache(ScanCache* cache) { mScanCache = cache; }
 
     /*
      * Set and get the file specification.
@@ -284,6 +299,11 @@ private:
     bool        mNonConstantId;
     const char* mProduct;
     bool        mUseCrunchCache;
+    bool        mOptimizePngs;
+    const char* mBuildStateDir;
+    BuildState* mBuildState;
+    const char* mResourceIdCacheDir;
+    ScanCache*  mScanCache;
 
     /* file specification */
     int         mArgc;
@@ -33,7 +33,8 @@ public:
     // Delete a file
     virtual void deleteFile(String8 path) = 0;
 
-    // Process an image from source out to dest
+    // Process an image from source out to dest. May be called from several
+    // threads at once.
     virtual void processImage(String8 source, String8 dest) = 0;
 private:
 };
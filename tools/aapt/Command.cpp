@@ -5,6 +5,9 @@
 //
 #include "Main.h"
 #include "Bundle.h"
+#include "BuildState.h"
+#include "ResourceIdCache.h"
+#include "ScanCache.h"
 #include "ResourceFilter.h"
 #include "ResourceTable.h"
 #include "XMLNode.h"
@@ -13,6 +16,7 @@
 #include <utils/threads.h>
 #include <utils/List.h>
 #include <utils/Errors.h>
+#include <utils/WorkQueue.h>
 
 #include <fcntl.h>
 #include <errno.h>
@@ -387,12 +391,12 @@ const char *getComponentName(String8 &pkgName, String8 &componentName) {
     return retStr.string();
 }
 
-static void printCompatibleScreens(ResXMLTree& tree) {
+static void printCompatibleScreens(ResXMLTree& tree, FILE* out) {
     size_t len;
     ResXMLTree::event_code_t code;
     int depth = 0;
     bool first = true;
-    printf("compatible-screens:");
+    fprintf(out, "compatible-screens:");
     while ((code=tree.next()) != ResXMLTree::END_DOCUMENT && code != ResXMLTree::BAD_DOCUMENT) {
         if (code == ResXMLTree::END_TAG) {
             depth--;
@@ -413,42 +417,35 @@ static void printCompatibleScreens(ResXMLTree& tree) {
                     SCREEN_DENSITY_ATTR, NULL, -1);
             if (screenSize > 0 && screenDensity > 0) {
                 if (!first) {
-                    printf(",");
+                    fprintf(out, ",");
                 }
                 first = false;
-                printf("'%d/%d'", screenSize, screenDensity);
+                fprintf(out, "'%d/%d'", screenSize, screenDensity);
             }
         }
     }
-    printf("\n");
+    fprintf(out, "\n");
 }
 
 /*
  * Handle the "dump" command, to extract select data from an archive.
  */
 extern char CONSOLE_DATA[2925]; // see EOF
-int doDump(Bundle* bundle)
+/*
+ * Dump one package.  The output goes to out and the errors to err, so that
+ * packages can be dumped on several threads.  Only the options that don't
+ * print through libandroidfw can be dumped anywhere else than stdout.
+ */
+static int dumpPackage(Bundle* bundle, const char* option, const char* filename,
+        FILE* out, FILE* err)
 {
     status_t result = UNKNOWN_ERROR;
     Asset* asset = NULL;
 
-    if (bundle->getFileSpecCount() < 1) {
-        fprintf(stderr, "ERROR: no dump option specified\n");
-        return 1;
-    }
-
-    if (bundle->getFileSpecCount() < 2) {
-        fprintf(stderr, "ERROR: no dump file specified\n");
-        return 1;
-    }
-
-    const char* option = bundle->getFileSpecEntry(0);
-    const char* filename = bundle->getFileSpecEntry(1);
-
     AssetManager assets;
     void* assetsCookie;
     if (!assets.addAssetPath(String8(filename), &assetsCookie)) {
-        fprintf(stderr, "ERROR: dump failed because assets could not be loaded\n");
+        fprintf(err, "ERROR: dump failed because assets could not be loaded\n");
         return 1;
     }
 
@@ -472,7 +469,7 @@ int doDump(Bundle* bundle)
 
     const ResTable& res = assets.getResources(false);
     if (&res == NULL) {
-        fprintf(stderr, "ERROR: dump failed because no resource table was found\n");
+        fprintf(err, "ERROR: dump failed because no resource table was found\n");
         goto bail;
     }
 
@@ -487,7 +484,7 @@ int doDump(Bundle* bundle)
 
     } else if (strcmp("xmltree", option) == 0) {
         if (bundle->getFileSpecCount() < 3) {
-            fprintf(stderr, "ERROR: no dump xmltree resource file specified\n");
+            fprintf(err, "ERROR: no dump xmltree resource file specified\n");
             goto bail;
         }
 
@@ -496,13 +493,13 @@ int doDump(Bundle* bundle)
             ResXMLTree tree;
             asset = assets.openNonAsset(resname, Asset::ACCESS_BUFFER);
             if (asset == NULL) {
-                fprintf(stderr, "ERROR: dump failed because resource %s found\n", resname);
+                fprintf(err, "ERROR: dump failed because resource %s found\n", resname);
                 goto bail;
             }
 
             if (tree.setTo(asset->getBuffer(true),
                            asset->getLength()) != NO_ERROR) {
-                fprintf(stderr, "ERROR: Resource %s is corrupt\n", resname);
+                fprintf(err, "ERROR: Resource %s is corrupt\n", resname);
                 goto bail;
             }
             tree.restart();
@@ -514,7 +511,7 @@ int doDump(Bundle* bundle)
 
     } else if (strcmp("xmlstrings", option) == 0) {
         if (bundle->getFileSpecCount() < 3) {
-            fprintf(stderr, "ERROR: no dump xmltree resource file specified\n");
+            fprintf(err, "ERROR: no dump xmltree resource file specified\n");
             goto bail;
         }
 
@@ -523,13 +520,13 @@ int doDump(Bundle* bundle)
             ResXMLTree tree;
             asset = assets.openNonAsset(resname, Asset::ACCESS_BUFFER);
             if (asset == NULL) {
-                fprintf(stderr, "ERROR: dump failed because resource %s found\n", resname);
+                fprintf(err, "ERROR: dump failed because resource %s found\n", resname);
                 goto bail;
             }
 
             if (tree.setTo(asset->getBuffer(true),
                            asset->getLength()) != NO_ERROR) {
-                fprintf(stderr, "ERROR: Resource %s is corrupt\n", resname);
+                fprintf(err, "ERROR: Resource %s is corrupt\n", resname);
                 goto bail;
             }
             printStringPool(&tree.getStrings());
@@ -542,13 +539,13 @@ int doDump(Bundle* bundle)
         asset = assets.openNonAsset("AndroidManifest.xml",
                                             Asset::ACCESS_BUFFER);
         if (asset == NULL) {
-            fprintf(stderr, "ERROR: dump failed because no AndroidManifest.xml found\n");
+            fprintf(err, "ERROR: dump failed because no AndroidManifest.xml found\n");
             goto bail;
         }
 
         if (tree.setTo(asset->getBuffer(true),
                        asset->getLength()) != NO_ERROR) {
-            fprintf(stderr, "ERROR: AndroidManifest.xml is corrupt\n");
+            fprintf(err, "ERROR: AndroidManifest.xml is corrupt\n");
             goto bail;
         }
         tree.restart();
@@ -570,27 +567,27 @@ int doDump(Bundle* bundle)
                 //printf("Depth %d tag %s\n", depth, tag.string());
                 if (depth == 1) {
                     if (tag != "manifest") {
-                        fprintf(stderr, "ERROR: manifest does not start with <manifest> tag\n");
+                        fprintf(err, "ERROR: manifest does not start with <manifest> tag\n");
                         goto bail;
                     }
                     String8 pkg = getAttribute(tree, NULL, "package", NULL);
-                    printf("package: %s\n", pkg.string());
+                    fprintf(out, "package: %s\n", pkg.string());
                 } else if (depth == 2 && tag == "permission") {
                     String8 error;
                     String8 name = getAttribute(tree, NAME_ATTR, &error);
                     if (error != "") {
-                        fprintf(stderr, "ERROR: %s\n", error.string());
+                        fprintf(err, "ERROR: %s\n", error.string());
                         goto bail;
                     }
-                    printf("permission: %s\n", name.string());
+                    fprintf(out, "permission: %s\n", name.string());
                 } else if (depth == 2 && tag == "uses-permission") {
                     String8 error;
                     String8 name = getAttribute(tree, NAME_ATTR, &error);
                     if (error != "") {
-                        fprintf(stderr, "ERROR: %s\n", error.string());
+                        fprintf(err, "ERROR: %s\n", error.string());
                         goto bail;
                     }
-                    printf("uses-permission: %s\n", name.string());
+                    fprintf(out, "uses-permission: %s\n", name.string());
                 }
             }
         } else if (strcmp("badging", option) == 0) {
@@ -714,11 +711,11 @@ int doDump(Bundle* bundle)
                     } else if (depth < 3) {
                         if (withinActivity && isMainActivity && isLauncherActivity) {
                             const char *aName = getComponentName(pkg, activityName);
-                            printf("launchable-activity:");
+                            fprintf(out, "launchable-activity:");
                             if (aName != NULL) {
-                                printf(" name='%s' ", aName);
+                                fprintf(out, " name='%s' ", aName);
                             }
-                            printf(" label='%s' icon='%s'\n",
+                            fprintf(out, " label='%s' icon='%s'\n",
                                     activityLabel.string(),
                                     activityIcon.string());
                         }
@@ -758,27 +755,27 @@ int doDump(Bundle* bundle)
                 //printf("Depth %d,  %s\n", depth, tag.string());
                 if (depth == 1) {
                     if (tag != "manifest") {
-                        fprintf(stderr, "ERROR: manifest does not start with <manifest> tag\n");
+                        fprintf(err, "ERROR: manifest does not start with <manifest> tag\n");
                         goto bail;
                     }
                     pkg = getAttribute(tree, NULL, "package", NULL);
-                    printf("package: name='%s' ", pkg.string());
+                    fprintf(out, "package: name='%s' ", pkg.string());
                     int32_t versionCode = getIntegerAttribute(tree, VERSION_CODE_ATTR, &error);
                     if (error != "") {
-                        fprintf(stderr, "ERROR getting 'android:versionCode' attribute: %s\n", error.string());
+                        fprintf(err, "ERROR getting 'android:versionCode' attribute: %s\n", error.string());
                         goto bail;
                     }
                     if (versionCode > 0) {
-                        printf("versionCode='%d' ", versionCode);
+                        fprintf(out, "versionCode='%d' ", versionCode);
                     } else {
-                        printf("versionCode='' ");
+                        fprintf(out, "versionCode='' ");
                     }
                     String8 versionName = getResolvedAttribute(&res, tree, VERSION_NAME_ATTR, &error);
                     if (error != "") {
-                        fprintf(stderr, "ERROR getting 'android:versionName' attribute: %s\n", error.string());
+                        fprintf(err, "ERROR getting 'android:versionName' attribute: %s\n", error.string());
                         goto bail;
                     }
-                    printf("versionName='%s'\n", versionName.string());
+                    fprintf(out, "versionName='%s'\n", versionName.string());
                 } else if (depth == 2) {
                     withinApplication = false;
                     if (tag == "application") {
@@ -793,12 +790,12 @@ int doDump(Bundle* bundle)
                             if (llabel != "") {
                                 if (localeStr == NULL || strlen(localeStr) == 0) {
                                     label = llabel;
-                                    printf("application-label:'%s'\n", llabel.string());
+                                    fprintf(out, "application-label:'%s'\n", llabel.string());
                                 } else {
                                     if (label == "") {
                                         label = llabel;
                                     }
-                                    printf("application-label-%s:'%s'\n", localeStr,
+                                    fprintf(out, "application-label-%s:'%s'\n", localeStr,
                                             llabel.string());
                                 }
                             }
@@ -811,34 +808,34 @@ int doDump(Bundle* bundle)
                             assets.setConfiguration(tmpConfig);
                             String8 icon = getResolvedAttribute(&res, tree, ICON_ATTR, &error);
                             if (icon != "") {
-                                printf("application-icon-%d:'%s'\n", densities[i], icon.string());
+                                fprintf(out, "application-icon-%d:'%s'\n", densities[i], icon.string());
                             }
                         }
                         assets.setConfiguration(config);
 
                         String8 icon = getResolvedAttribute(&res, tree, ICON_ATTR, &error);
                         if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:icon' attribute: %s\n", error.string());
+                            fprintf(err, "ERROR getting 'android:icon' attribute: %s\n", error.string());
                             goto bail;
                         }
                         int32_t testOnly = getIntegerAttribute(tree, TEST_ONLY_ATTR, &error, 0);
                         if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:testOnly' attribute: %s\n", error.string());
+                            fprintf(err, "ERROR getting 'android:testOnly' attribute: %s\n", error.string());
                             goto bail;
                         }
-                        printf("application: label='%s' ", label.string());
-                        printf("icon='%s'\n", icon.string());
+                        fprintf(out, "application: label='%s' ", label.string());
+                        fprintf(out, "icon='%s'\n", icon.string());
                         if (testOnly != 0) {
-                            printf("testOnly='%d'\n", testOnly);
+                            fprintf(out, "testOnly='%d'\n", testOnly);
                         }
 
                         int32_t debuggable = getResolvedIntegerAttribute(&res, tree, DEBUGGABLE_ATTR, &error, 0);
                         if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:debuggable' attribute: %s\n", error.string());
+                            fprintf(err, "ERROR getting 'android:debuggable' attribute: %s\n", error.string());
                             goto bail;
                         }
                         if (debuggable != 0) {
-                            printf("application-debuggable\n");
+                            fprintf(out, "application-debuggable\n");
                         }
                     } else if (tag == "uses-sdk") {
                         int32_t code = getIntegerAttribute(tree, MIN_SDK_VERSION_ATTR, &error);
@@ -846,36 +843,36 @@ int doDump(Bundle* bundle)
                             error = "";
                             String8 name = getResolvedAttribute(&res, tree, MIN_SDK_VERSION_ATTR, &error);
                             if (error != "") {
-                                fprintf(stderr, "ERROR getting 'android:minSdkVersion' attribute: %s\n",
+                                fprintf(err, "ERROR getting 'android:minSdkVersion' attribute: %s\n",
                                         error.string());
                                 goto bail;
                             }
                             if (name == "Donut") targetSdk = 4;
-                            printf("sdkVersion:'%s'\n", name.string());
+                            fprintf(out, "sdkVersion:'%s'\n", name.string());
                         } else if (code != -1) {
                             targetSdk = code;
-                            printf("sdkVersion:'%d'\n", code);
+                            fprintf(out, "sdkVersion:'%d'\n", code);
                         }
                         code = getIntegerAttribute(tree, MAX_SDK_VERSION_ATTR, NULL, -1);
                         if (code != -1) {
-                            printf("maxSdkVersion:'%d'\n", code);
+                            fprintf(out, "maxSdkVersion:'%d'\n", code);
                         }
                         code = getIntegerAttribute(tree, TARGET_SDK_VERSION_ATTR, &error);
                         if (error != "") {
                             error = "";
                             String8 name = getResolvedAttribute(&res, tree, TARGET_SDK_VERSION_ATTR, &error);
                             if (error != "") {
-                                fprintf(stderr, "ERROR getting 'android:targetSdkVersion' attribute: %s\n",
+                                fprintf(err, "ERROR getting 'android:targetSdkVersion' attribute: %s\n",
                                         error.string());
                                 goto bail;
                             }
                             if (name == "Donut" && targetSdk < 4) targetSdk = 4;
-                            printf("targetSdkVersion:'%s'\n", name.string());
+                            fprintf(out, "targetSdkVersion:'%s'\n", name.string());
                         } else if (code != -1) {
                             if (targetSdk < code) {
                                 targetSdk = code;
                             }
-                            printf("targetSdkVersion:'%d'\n", code);
+                            fprintf(out, "targetSdkVersion:'%d'\n", code);
                         }
                     } else if (tag == "uses-configuration") {
                         int32_t reqTouchScreen = getIntegerAttribute(tree,
@@ -888,23 +885,23 @@ int doDump(Bundle* bundle)
                                 REQ_NAVIGATION_ATTR, NULL, 0);
                         int32_t reqFiveWayNav = getIntegerAttribute(tree,
                                 REQ_FIVE_WAY_NAV_ATTR, NULL, 0);
-                        printf("uses-configuration:");
+                        fprintf(out, "uses-configuration:");
                         if (reqTouchScreen != 0) {
-                            printf(" reqTouchScreen='%d'", reqTouchScreen);
+                            fprintf(out, " reqTouchScreen='%d'", reqTouchScreen);
                         }
                         if (reqKeyboardType != 0) {
-                            printf(" reqKeyboardType='%d'", reqKeyboardType);
+                            fprintf(out, " reqKeyboardType='%d'", reqKeyboardType);
                         }
                         if (reqHardKeyboard != 0) {
-                            printf(" reqHardKeyboard='%d'", reqHardKeyboard);
+                            fprintf(out, " reqHardKeyboard='%d'", reqHardKeyboard);
                         }
                         if (reqNavigation != 0) {
-                            printf(" reqNavigation='%d'", reqNavigation);
+                            fprintf(out, " reqNavigation='%d'", reqNavigation);
                         }
                         if (reqFiveWayNav != 0) {
-                            printf(" reqFiveWayNav='%d'", reqFiveWayNav);
+                            fprintf(out, " reqFiveWayNav='%d'", reqFiveWayNav);
                         }
-                        printf("\n");
+                        fprintf(out, "\n");
                     } else if (tag == "supports-screens") {
                         smallScreen = getIntegerAttribute(tree,
                                 SMALL_SCREEN_ATTR, NULL, 1);
@@ -972,13 +969,13 @@ int doDump(Bundle* bundle)
                             } else if (name == "android.hardware.screen.landscape") {
                                 specScreenLandscapeFeature = true;
                             }
-                            printf("uses-feature%s:'%s'\n",
+                            fprintf(out, "uses-feature%s:'%s'\n",
                                     req ? "" : "-not-required", name.string());
                         } else {
                             int vers = getIntegerAttribute(tree,
                                     GL_ES_VERSION_ATTR, &error);
                             if (error == "") {
-                                printf("uses-gl-es:'0x%x'\n", vers);
+                                fprintf(out, "uses-gl-es:'0x%x'\n", vers);
                             }
                         }
                     } else if (tag == "uses-permission") {
@@ -1031,48 +1028,48 @@ int doDump(Bundle* bundle)
                             } else if (name == "android.permission.WRITE_CALL_LOG") {
                                 hasWriteCallLogPermission = true;
                             }
-                            printf("uses-permission:'%s'\n", name.string());
+                            fprintf(out, "uses-permission:'%s'\n", name.string());
                         } else {
-                            fprintf(stderr, "ERROR getting 'android:name' attribute: %s\n",
+                            fprintf(err, "ERROR getting 'android:name' attribute: %s\n",
                                     error.string());
                             goto bail;
                         }
                     } else if (tag == "uses-package") {
                         String8 name = getAttribute(tree, NAME_ATTR, &error);
                         if (name != "" && error == "") {
-                            printf("uses-package:'%s'\n", name.string());
+                            fprintf(out, "uses-package:'%s'\n", name.string());
                         } else {
-                            fprintf(stderr, "ERROR getting 'android:name' attribute: %s\n",
+                            fprintf(err, "ERROR getting 'android:name' attribute: %s\n",
                                     error.string());
                                 goto bail;
                         }
                     } else if (tag == "original-package") {
                         String8 name = getAttribute(tree, NAME_ATTR, &error);
                         if (name != "" && error == "") {
-                            printf("original-package:'%s'\n", name.string());
+                            fprintf(out, "original-package:'%s'\n", name.string());
                         } else {
-                            fprintf(stderr, "ERROR getting 'android:name' attribute: %s\n",
+                            fprintf(err, "ERROR getting 'android:name' attribute: %s\n",
                                     error.string());
                                 goto bail;
                         }
                     } else if (tag == "supports-gl-texture") {
                         String8 name = getAttribute(tree, NAME_ATTR, &error);
                         if (name != "" && error == "") {
-                            printf("supports-gl-texture:'%s'\n", name.string());
+                            fprintf(out, "supports-gl-texture:'%s'\n", name.string());
                         } else {
-                            fprintf(stderr, "ERROR getting 'android:name' attribute: %s\n",
+                            fprintf(err, "ERROR getting 'android:name' attribute: %s\n",
                                     error.string());
                                 goto bail;
                         }
                     } else if (tag == "compatible-screens") {
-                        printCompatibleScreens(tree);
+                        printCompatibleScreens(tree, out);
                         depth--;
                     } else if (tag == "package-verifier") {
                         String8 name = getAttribute(tree, NAME_ATTR, &error);
                         if (name != "" && error == "") {
                             String8 publicKey = getAttribute(tree, PUBLIC_KEY_ATTR, &error);
                             if (publicKey != "" && error == "") {
-                                printf("package-verifier: name='%s' publicKey='%s'\n",
+                                fprintf(out, "package-verifier: name='%s' publicKey='%s'\n",
                                         name.string(), publicKey.string());
                             }
                         }
@@ -1086,19 +1083,19 @@ int doDump(Bundle* bundle)
                         withinActivity = true;
                         activityName = getAttribute(tree, NAME_ATTR, &error);
                         if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:name' attribute: %s\n", error.string());
+                            fprintf(err, "ERROR getting 'android:name' attribute: %s\n", error.string());
                             goto bail;
                         }
 
                         activityLabel = getResolvedAttribute(&res, tree, LABEL_ATTR, &error);
                         if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:label' attribute: %s\n", error.string());
+                            fprintf(err, "ERROR getting 'android:label' attribute: %s\n", error.string());
                             goto bail;
                         }
 
                         activityIcon = getResolvedAttribute(&res, tree, ICON_ATTR, &error);
                         if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:icon' attribute: %s\n", error.string());
+                            fprintf(err, "ERROR getting 'android:icon' attribute: %s\n", error.string());
                             goto bail;
                         }
 
@@ -1116,19 +1113,19 @@ int doDump(Bundle* bundle)
                     } else if (tag == "uses-library") {
                         String8 libraryName = getAttribute(tree, NAME_ATTR, &error);
                         if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:name' attribute for uses-library: %s\n", error.string());
+                            fprintf(err, "ERROR getting 'android:name' attribute for uses-library: %s\n", error.string());
                             goto bail;
                         }
                         int req = getIntegerAttribute(tree,
                                 REQUIRED_ATTR, NULL, 1);
-                        printf("uses-library%s:'%s'\n",
+                        fprintf(out, "uses-library%s:'%s'\n",
                                 req ? "" : "-not-required", libraryName.string());
                     } else if (tag == "receiver") {
                         withinReceiver = true;
                         receiverName = getAttribute(tree, NAME_ATTR, &error);
 
                         if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:name' attribute for receiver: %s\n", error.string());
+                            fprintf(err, "ERROR getting 'android:name' attribute for receiver: %s\n", error.string());
                             goto bail;
                         }
                     } else if (tag == "service") {
@@ -1136,7 +1133,7 @@ int doDump(Bundle* bundle)
                         serviceName = getAttribute(tree, NAME_ATTR, &error);
 
                         if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:name' attribute for service: %s\n", error.string());
+                            fprintf(err, "ERROR getting 'android:name' attribute for service: %s\n", error.string());
                             goto bail;
                         }
                     }
@@ -1149,7 +1146,7 @@ int doDump(Bundle* bundle)
                     if (tag == "action") {
                         action = getAttribute(tree, NAME_ATTR, &error);
                         if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:name' attribute: %s\n", error.string());
+                            fprintf(err, "ERROR getting 'android:name' attribute: %s\n", error.string());
                             goto bail;
                         }
                         if (withinActivity) {
@@ -1176,7 +1173,7 @@ int doDump(Bundle* bundle)
                     if (tag == "category") {
                         String8 category = getAttribute(tree, NAME_ATTR, &error);
                         if (error != "") {
-                            fprintf(stderr, "ERROR getting 'name' attribute: %s\n", error.string());
+                            fprintf(err, "ERROR getting 'name' attribute: %s\n", error.string());
                             goto bail;
                         }
                         if (withinActivity) {
@@ -1191,14 +1188,14 @@ int doDump(Bundle* bundle)
             // Pre-1.6 implicitly granted permission compatibility logic
             if (targetSdk < 4) {
                 if (!hasWriteExternalStoragePermission) {
-                    printf("uses-permission:'android.permission.WRITE_EXTERNAL_STORAGE'\n");
-                    printf("uses-implied-permission:'android.permission.WRITE_EXTERNAL_STORAGE'," \
+                    fprintf(out, "uses-permission:'android.permission.WRITE_EXTERNAL_STORAGE'\n");
+                    fprintf(out, "uses-implied-permission:'android.permission.WRITE_EXTERNAL_STORAGE'," \
                             "'targetSdkVersion < 4'\n");
                     hasWriteExternalStoragePermission = true;
                 }
                 if (!hasReadPhoneStatePermission) {
-                    printf("uses-permission:'android.permission.READ_PHONE_STATE'\n");
-                    printf("uses-implied-permission:'android.permission.READ_PHONE_STATE'," \
+                    fprintf(out, "uses-permission:'android.permission.READ_PHONE_STATE'\n");
+                    fprintf(out, "uses-implied-permission:'android.permission.READ_PHONE_STATE'," \
                             "'targetSdkVersion < 4'\n");
                 }
             }
@@ -1208,21 +1205,21 @@ int doDump(Bundle* bundle)
             // do this (regardless of target API version) because we can't have
             // an app with write permission but not read permission.
             if (!hasReadExternalStoragePermission && hasWriteExternalStoragePermission) {
-                printf("uses-permission:'android.permission.READ_EXTERNAL_STORAGE'\n");
-                printf("uses-implied-permission:'android.permission.READ_EXTERNAL_STORAGE'," \
+                fprintf(out, "uses-permission:'android.permission.READ_EXTERNAL_STORAGE'\n");
+                fprintf(out, "uses-implied-permission:'android.permission.READ_EXTERNAL_STORAGE'," \
                         "'requested WRITE_EXTERNAL_STORAGE'\n");
             }
 
             // Pre-JellyBean call log permission compatibility.
             if (targetSdk < 16) {
                 if (!hasReadCallLogPermission && hasReadContactsPermission) {
-                    printf("uses-permission:'android.permission.READ_CALL_LOG'\n");
-                    printf("uses-implied-permission:'android.permission.READ_CALL_LOG'," \
+                    fprintf(out, "uses-permission:'android.permission.READ_CALL_LOG'\n");
+                    fprintf(out, "uses-implied-permission:'android.permission.READ_CALL_LOG'," \
                             "'targetSdkVersion < 16 and requested READ_CONTACTS'\n");
                 }
                 if (!hasWriteCallLogPermission && hasWriteContactsPermission) {
-                    printf("uses-permission:'android.permission.WRITE_CALL_LOG'\n");
-                    printf("uses-implied-permission:'android.permission.WRITE_CALL_LOG'," \
+                    fprintf(out, "uses-permission:'android.permission.WRITE_CALL_LOG'\n");
+                    fprintf(out, "uses-implied-permission:'android.permission.WRITE_CALL_LOG'," \
                             "'targetSdkVersion < 16 and requested WRITE_CONTACTS'\n");
                 }
             }
@@ -1238,23 +1235,23 @@ int doDump(Bundle* bundle)
                 if (reqCameraFlashFeature) {
                     // if app requested a sub-feature (autofocus or flash) and didn't
                     // request the base camera feature, we infer that it meant to
-                    printf("uses-feature:'android.hardware.camera'\n");
-                    printf("uses-implied-feature:'android.hardware.camera'," \
+                    fprintf(out, "uses-feature:'android.hardware.camera'\n");
+                    fprintf(out, "uses-implied-feature:'android.hardware.camera'," \
                             "'requested android.hardware.camera.flash feature'\n");
                 } else if (reqCameraAutofocusFeature) {
                     // if app requested a sub-feature (autofocus or flash) and didn't
                     // request the base camera feature, we infer that it meant to
-                    printf("uses-feature:'android.hardware.camera'\n");
-                    printf("uses-implied-feature:'android.hardware.camera'," \
+                    fprintf(out, "uses-feature:'android.hardware.camera'\n");
+                    fprintf(out, "uses-implied-feature:'android.hardware.camera'," \
                             "'requested android.hardware.camera.autofocus feature'\n");
                 } else if (hasCameraPermission) {
                     // if app wants to use camera but didn't request the feature, we infer 
                     // that it meant to, and further that it wants autofocus
                     // (which was the 1.0 - 1.5 behavior)
-                    printf("uses-feature:'android.hardware.camera'\n");
+                    fprintf(out, "uses-feature:'android.hardware.camera'\n");
                     if (!specCameraAutofocusFeature) {
-                        printf("uses-feature:'android.hardware.camera.autofocus'\n");
-                        printf("uses-implied-feature:'android.hardware.camera.autofocus'," \
+                        fprintf(out, "uses-feature:'android.hardware.camera.autofocus'\n");
+                        fprintf(out, "uses-implied-feature:'android.hardware.camera.autofocus'," \
                                 "'requested android.permission.CAMERA permission'\n");
                     }
                 }
@@ -1266,22 +1263,22 @@ int doDump(Bundle* bundle)
                  hasGeneralLocPermission || reqNetworkLocFeature || reqGpsFeature)) {
                 // if app either takes a location-related permission or requests one of the
                 // sub-features, we infer that it also meant to request the base location feature
-                printf("uses-feature:'android.hardware.location'\n");
-                printf("uses-implied-feature:'android.hardware.location'," \
+                fprintf(out, "uses-feature:'android.hardware.location'\n");
+                fprintf(out, "uses-implied-feature:'android.hardware.location'," \
                         "'requested a location access permission'\n");
             }
             if (!specGpsFeature && hasGpsPermission) {
                 // if app takes GPS (FINE location) perm but does not request the GPS
                 // feature, we infer that it meant to
-                printf("uses-feature:'android.hardware.location.gps'\n");
-                printf("uses-implied-feature:'android.hardware.location.gps'," \
+                fprintf(out, "uses-feature:'android.hardware.location.gps'\n");
+                fprintf(out, "uses-implied-feature:'android.hardware.location.gps'," \
                         "'requested android.permission.ACCESS_FINE_LOCATION permission'\n");
             }
             if (!specNetworkLocFeature && hasCoarseLocPermission) {
                 // if app takes Network location (COARSE location) perm but does not request the
                 // network location feature, we infer that it meant to
-                printf("uses-feature:'android.hardware.location.network'\n");
-                printf("uses-implied-feature:'android.hardware.location.network'," \
+                fprintf(out, "uses-feature:'android.hardware.location.network'\n");
+                fprintf(out, "uses-implied-feature:'android.hardware.location.network'," \
                         "'requested android.permission.ACCESS_COURSE_LOCATION permission'\n");
             }
 
@@ -1289,8 +1286,8 @@ int doDump(Bundle* bundle)
             if (!specBluetoothFeature && hasBluetoothPermission && (targetSdk > 4)) {
                 // if app takes a Bluetooth permission but does not request the Bluetooth
                 // feature, we infer that it meant to
-                printf("uses-feature:'android.hardware.bluetooth'\n");
-                printf("uses-implied-feature:'android.hardware.bluetooth'," \
+                fprintf(out, "uses-feature:'android.hardware.bluetooth'\n");
+                fprintf(out, "uses-implied-feature:'android.hardware.bluetooth'," \
                         "'requested android.permission.BLUETOOTH or android.permission.BLUETOOTH_ADMIN " \
                         "permission and targetSdkVersion > 4'\n");
             }
@@ -1299,8 +1296,8 @@ int doDump(Bundle* bundle)
             if (!specMicrophoneFeature && hasRecordAudioPermission) {
                 // if app takes the record-audio permission but does not request the microphone
                 // feature, we infer that it meant to
-                printf("uses-feature:'android.hardware.microphone'\n");
-                printf("uses-implied-feature:'android.hardware.microphone'," \
+                fprintf(out, "uses-feature:'android.hardware.microphone'\n");
+                fprintf(out, "uses-implied-feature:'android.hardware.microphone'," \
                         "'requested android.permission.RECORD_AUDIO permission'\n");
             }
 
@@ -1308,8 +1305,8 @@ int doDump(Bundle* bundle)
             if (!specWiFiFeature && hasWiFiPermission) {
                 // if app takes one of the WiFi permissions but does not request the WiFi
                 // feature, we infer that it meant to
-                printf("uses-feature:'android.hardware.wifi'\n");
-                printf("uses-implied-feature:'android.hardware.wifi'," \
+                fprintf(out, "uses-feature:'android.hardware.wifi'\n");
+                fprintf(out, "uses-implied-feature:'android.hardware.wifi'," \
                         "'requested android.permission.ACCESS_WIFI_STATE, " \
                         "android.permission.CHANGE_WIFI_STATE, or " \
                         "android.permission.CHANGE_WIFI_MULTICAST_STATE permission'\n");
@@ -1319,8 +1316,8 @@ int doDump(Bundle* bundle)
             if (!specTelephonyFeature && (hasTelephonyPermission || reqTelephonySubFeature)) {
                 // if app takes one of the telephony permissions or requests a sub-feature but
                 // does not request the base telephony feature, we infer that it meant to
-                printf("uses-feature:'android.hardware.telephony'\n");
-                printf("uses-implied-feature:'android.hardware.telephony'," \
+                fprintf(out, "uses-feature:'android.hardware.telephony'\n");
+                fprintf(out, "uses-implied-feature:'android.hardware.telephony'," \
                         "'requested a telephony-related permission or feature'\n");
             }
 
@@ -1330,15 +1327,15 @@ int doDump(Bundle* bundle)
                 // <uses-feature android:name="android.hardware.touchscreen" android:required="false"/>
                 // Note that specTouchscreenFeature is true if the tag is present, regardless
                 // of whether its value is true or false, so this is safe
-                printf("uses-feature:'android.hardware.touchscreen'\n");
-                printf("uses-implied-feature:'android.hardware.touchscreen'," \
+                fprintf(out, "uses-feature:'android.hardware.touchscreen'\n");
+                fprintf(out, "uses-implied-feature:'android.hardware.touchscreen'," \
                         "'assumed you require a touch screen unless explicitly made optional'\n");
             }
             if (!specMultitouchFeature && reqDistinctMultitouchFeature) {
                 // if app takes one of the telephony permissions or requests a sub-feature but
                 // does not request the base telephony feature, we infer that it meant to
-                printf("uses-feature:'android.hardware.touchscreen.multitouch'\n");
-                printf("uses-implied-feature:'android.hardware.touchscreen.multitouch'," \
+                fprintf(out, "uses-feature:'android.hardware.touchscreen.multitouch'\n");
+                fprintf(out, "uses-implied-feature:'android.hardware.touchscreen.multitouch'," \
                         "'requested android.hardware.touchscreen.multitouch.distinct feature'\n");
             }
 
@@ -1348,40 +1345,40 @@ int doDump(Bundle* bundle)
                 // that request a specific orientation, then assume that
                 // orientation is required.
                 if (reqScreenLandscapeFeature) {
-                    printf("uses-feature:'android.hardware.screen.landscape'\n");
-                    printf("uses-implied-feature:'android.hardware.screen.landscape'," \
+                    fprintf(out, "uses-feature:'android.hardware.screen.landscape'\n");
+                    fprintf(out, "uses-implied-feature:'android.hardware.screen.landscape'," \
                             "'one or more activities have specified a landscape orientation'\n");
                 }
                 if (reqScreenPortraitFeature) {
-                    printf("uses-feature:'android.hardware.screen.portrait'\n");
-                    printf("uses-implied-feature:'android.hardware.screen.portrait'," \
+                    fprintf(out, "uses-feature:'android.hardware.screen.portrait'\n");
+                    fprintf(out, "uses-implied-feature:'android.hardware.screen.portrait'," \
                             "'one or more activities have specified a portrait orientation'\n");
                 }
             }
 
             if (hasMainActivity) {
-                printf("main\n");
+                fprintf(out, "main\n");
             }
             if (hasWidgetReceivers) {
-                printf("app-widget\n");
+                fprintf(out, "app-widget\n");
             }
             if (hasImeService) {
-                printf("ime\n");
+                fprintf(out, "ime\n");
             }
             if (hasWallpaperService) {
-                printf("wallpaper\n");
+                fprintf(out, "wallpaper\n");
             }
             if (hasOtherActivities) {
-                printf("other-activities\n");
+                fprintf(out, "other-activities\n");
             }
             if (isSearchable) {
-                printf("search\n");
+                fprintf(out, "search\n");
             }
             if (hasOtherReceivers) {
-                printf("other-receivers\n");
+                fprintf(out, "other-receivers\n");
             }
             if (hasOtherServices) {
-                printf("other-services\n");
+                fprintf(out, "other-services\n");
             }
 
             // For modern apps, if screen size buckets haven't been specified
@@ -1433,63 +1430,63 @@ int doDump(Bundle* bundle)
                 anyDensity = (targetSdk >= 4 || requiresSmallestWidthDp > 0
                         || compatibleWidthLimitDp > 0) ? -1 : 0;
             }
-            printf("supports-screens:");
-            if (smallScreen != 0) printf(" 'small'");
-            if (normalScreen != 0) printf(" 'normal'");
-            if (largeScreen != 0) printf(" 'large'");
-            if (xlargeScreen != 0) printf(" 'xlarge'");
-            printf("\n");
-            printf("supports-any-density: '%s'\n", anyDensity ? "true" : "false");
+            fprintf(out, "supports-screens:");
+            if (smallScreen != 0) fprintf(out, " 'small'");
+            if (normalScreen != 0) fprintf(out, " 'normal'");
+            if (largeScreen != 0) fprintf(out, " 'large'");
+            if (xlargeScreen != 0) fprintf(out, " 'xlarge'");
+            fprintf(out, "\n");
+            fprintf(out, "supports-any-density: '%s'\n", anyDensity ? "true" : "false");
             if (requiresSmallestWidthDp > 0) {
-                printf("requires-smallest-width:'%d'\n", requiresSmallestWidthDp);
+                fprintf(out, "requires-smallest-width:'%d'\n", requiresSmallestWidthDp);
             }
             if (compatibleWidthLimitDp > 0) {
-                printf("compatible-width-limit:'%d'\n", compatibleWidthLimitDp);
+                fprintf(out, "compatible-width-limit:'%d'\n", compatibleWidthLimitDp);
             }
             if (largestWidthLimitDp > 0) {
-                printf("largest-width-limit:'%d'\n", largestWidthLimitDp);
+                fprintf(out, "largest-width-limit:'%d'\n", largestWidthLimitDp);
             }
 
-            printf("locales:");
+            fprintf(out, "locales:");
             const size_t NL = locales.size();
             for (size_t i=0; i<NL; i++) {
                 const char* localeStr =  locales[i].string();
                 if (localeStr == NULL || strlen(localeStr) == 0) {
                     localeStr = "--_--";
                 }
-                printf(" '%s'", localeStr);
+                fprintf(out, " '%s'", localeStr);
             }
-            printf("\n");
+            fprintf(out, "\n");
 
-            printf("densities:");
+            fprintf(out, "densities:");
             const size_t ND = densities.size();
             for (size_t i=0; i<ND; i++) {
-                printf(" '%d'", densities[i]);
+                fprintf(out, " '%d'", densities[i]);
             }
-            printf("\n");
+            fprintf(out, "\n");
 
             AssetDir* dir = assets.openNonAssetDir(assetsCookie, "lib");
             if (dir != NULL) {
                 if (dir->getFileCount() > 0) {
-                    printf("native-code:");
+                    fprintf(out, "native-code:");
                     for (size_t i=0; i<dir->getFileCount(); i++) {
-                        printf(" '%s'", dir->getFileName(i).string());
+                        fprintf(out, " '%s'", dir->getFileName(i).string());
                     }
-                    printf("\n");
+                    fprintf(out, "\n");
                 }
                 delete dir;
             }
         } else if (strcmp("badger", option) == 0) {
-            printf("%s", CONSOLE_DATA);
+            fprintf(out, "%s", CONSOLE_DATA);
         } else if (strcmp("configurations", option) == 0) {
             Vector<ResTable_config> configs;
             res.getConfigurations(&configs);
             const size_t N = configs.size();
             for (size_t i=0; i<N; i++) {
-                printf("%s\n", configs[i].toString().string());
+                fprintf(out, "%s\n", configs[i].toString().string());
             }
         } else {
-            fprintf(stderr, "ERROR: unknown dump option '%s'\n", option);
+            fprintf(err, "ERROR: unknown dump option '%s'\n", option);
             goto bail;
         }
     }
@@ -1503,6 +1500,191 @@ bail:
     return (result != NO_ERROR);
 }
 
+/*
+ * A package dumped by a worker thread, into temporary files that are
+ * copied out in order once it is done.
+ */
+struct DumpJob {
+    String8 filename;
+    FILE* out;
+    FILE* err;
+    int result;
+    bool done;
+};
+
+class DumpPackageWorkUnit : public WorkQueue::WorkUnit {
+public:
+    DumpPackageWorkUnit(Bundle* bundle, const char* option, DumpJob* job,
+            Mutex* lock, Condition* cond)
+        : mBundle(bundle), mOption(option), mJob(job), mLock(lock), mCond(cond) { }
+
+    virtual bool run() {
+        int result = dumpPackage(mBundle, mOption, mJob->filename.string(),
+                mJob->out, mJob->err);
+
+        AutoMutex _l(*mLock);
+        mJob->result = result;
+        mJob->done = true;
+        mCond->broadcast();
+        return true;
+    }
+
+private:
+    Bundle* mBundle;
+    const char* mOption;
+    DumpJob* mJob;
+    Mutex* mLock;
+    Condition* mCond;
+};
+
+static void copyTempFile(FILE* from, FILE* to)
+{
+    char buf[16 * 1024];
+    size_t n;
+    rewind(from);
+    while ((n = fread(buf, 1, sizeof(buf), from)) > 0) {
+        fwrite(buf, 1, n, to);
+    }
+}
+
+/*
+ * Dump several packages, on as many threads as there are CPUs.  The output
+ * of each package is printed in order, between an "apk:" line with its name
+ * and a "status:" line with the result of dumping it.
+ */
+static int dumpPackages(Bundle* bundle, const char* option, Vector<DumpJob>& jobs)
+{
+    const size_t threads = getWorkerThreadCount();
+    // enough to keep the workers busy while the output is copied
+    const size_t window = threads * 4;
+    const size_t N = jobs.size();
+
+    Mutex lock;
+    Condition cond;
+    WorkQueue wq(threads, false);
+    size_t scheduled = 0;
+    int result = 0;
+
+    for (size_t i=0; i<N; i++) {
+        while (scheduled < N && scheduled < i + window) {
+            DumpJob& job = jobs.editItemAt(scheduled++);
+            job.out = tmpfile();
+            job.err = tmpfile();
+            if (job.out == NULL || job.err == NULL ||
+                    wq.schedule(new DumpPackageWorkUnit(bundle, option, &job,
+                            &lock, &cond)) != NO_ERROR) {
+                fprintf(stderr, "ERROR: unable to dump '%s': %s\n",
+                        job.filename.string(), strerror(errno));
+                job.result = 1;
+                job.done = true;
+            }
+        }
+
+        DumpJob& job = jobs.editItemAt(i);
+        {
+            AutoMutex _l(lock);
+            while (!job.done) {
+                cond.wait(lock);
+            }
+        }
+
+        printf("apk: '%s'\n", job.filename.string());
+        if (job.out != NULL) {
+            copyTempFile(job.out, stdout);
+            fclose(job.out);
+        }
+        if (job.err != NULL) {
+            fflush(stdout);
+            copyTempFile(job.err, stderr);
+            fclose(job.err);
+        }
+        printf("status: '%d'\n", job.result);
+        if (job.result != 0) {
+            result = 1;
+        }
+    }
+
+    wq.finish();
+    return result;
+}
+
+/*
+ * Read the names of the packages listed in a file, one per line.
+ */
+static bool readPackageList(const char* listFile, Vector<DumpJob>* jobs)
+{
+    FILE* fp = fopen(listFile, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "ERROR: unable to open package list '%s': %s\n",
+                listFile, strerror(errno));
+        return false;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        size_t len = strlen(line);
+        while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) {
+            line[--len] = 0;
+        }
+        if (len > 0) {
+            DumpJob job;
+            job.filename = line;
+            jobs->add(job);
+        }
+    }
+    fclose(fp);
+    return true;
+}
+
+int doDump(Bundle* bundle)
+{
+    if (bundle->getFileSpecCount() < 1) {
+        fprintf(stderr, "ERROR: no dump option specified\n");
+        return 1;
+    }
+
+    if (bundle->getFileSpecCount() < 2) {
+        fprintf(stderr, "ERROR: no dump file specified\n");
+        return 1;
+    }
+
+    const char* option = bundle->getFileSpecEntry(0);
+    const char* filename = bundle->getFileSpecEntry(1);
+
+    // The options that only print what they read from the manifest and the
+    // resource table can dump several packages, named on the command line
+    // or listed in @files.
+    if (strcmp("badging", option) != 0 && strcmp("permissions", option) != 0
+            && strcmp("configurations", option) != 0) {
+        return dumpPackage(bundle, option, filename, stdout, stderr);
+    }
+    if (bundle->getFileSpecCount() == 2 && filename[0] != '@') {
+        return dumpPackage(bundle, option, filename, stdout, stderr);
+    }
+
+    Vector<DumpJob> jobs;
+    for (int i=1; i<bundle->getFileSpecCount(); i++) {
+        const char* arg = bundle->getFileSpecEntry(i);
+        if (arg[0] == '@') {
+            if (!readPackageList(arg + 1, &jobs)) {
+                return 1;
+            }
+        } else {
+            DumpJob job;
+            job.filename = arg;
+            jobs.add(job);
+        }
+    }
+    for (size_t i=0; i<jobs.size(); i++) {
+        DumpJob& job = jobs.editItemAt(i);
+        job.out = NULL;
+        job.err = NULL;
+        job.result = 0;
+        job.done = false;
+    }
+
+    return dumpPackages(bundle, option, jobs);
+}
+
 
 /*
  * Handle the "add" command, which wants to add files to a new or
@@ -1641,6 +1823,9 @@ int doPackage(Bundle* bundle)
     int N;
     FILE* fp;
     String8 dependencyFile;
+    BuildState* buildState = NULL;
+    ScanCache* scanCache = NULL;
+    String8 idCacheFile;
 
     // -c zz_ZZ means do pseudolocalization
     ResourceFilter filter;
@@ -1687,6 +1872,16 @@ int doPackage(Bundle* bundle)
         assets->setFullAssetPaths(assetPathStore);
     }
 
+    // The source trees are scanned on every build, unchanged directories
+    // don't need to be read again.
+    if (bundle->getBuildStateDir() != NULL) {
+        String8 scanCacheFile(bundle->getBuildStateDir());
+        scanCacheFile.appendPath("dirs");
+        scanCache = new ScanCache(scanCacheFile);
+        scanCache->load();
+        bundle->setScanCache(scanCache);
+    }
+
     err = assets->slurpFromArgs(bundle);
     if (err < 0) {
         goto bail;
@@ -1696,6 +1891,25 @@ int doPackage(Bundle* bundle)
         assets->print(String8());
     }
 
+    // Images are only processed when packaging, so that's the only time the
+    // build state is used.
+    if (bundle->getBuildStateDir() != NULL && outputAPKFile) {
+        buildState = new BuildState(String8(bundle->getBuildStateDir()));
+        err = buildState->load();
+        if (err != NO_ERROR) {
+            goto bail;
+        }
+        bundle->setBuildState(buildState);
+    }
+
+    // The ids of the included packages are the same for every build that
+    // includes them, a missing or stale cache only costs the lookups.
+    if (bundle->getResourceIdCacheDir() != NULL &&
+            ResourceIdCache::getCacheFile(String8(bundle->getResourceIdCacheDir()),
+                    bundle->getPackageIncludes(), &idCacheFile) == NO_ERROR) {
+        ResourceIdCache::load(idCacheFile);
+    }
+
     // If they asked for any fileAs that need to be compiled, do so.
     if (bundle->getResourceSourceDirs().size() || bundle->getAndroidManifestFile()) {
         err = buildResources(bundle, assets);
@@ -1704,6 +1918,22 @@ int doPackage(Bundle* bundle)
         }
     }
 
+    if (idCacheFile.size() > 0 && ResourceIdCache::save(idCacheFile) != NO_ERROR) {
+        fprintf(stderr, "WARNING: Unable to write resource id cache '%s'\n",
+                idCacheFile.string());
+    }
+
+    if (buildState != NULL) {
+        if (bundle->getVerbose()) {
+            printf("Build state: %d images reused, %d processed\n",
+                    (int) buildState->getRestoredCount(), (int) buildState->getStoredCount());
+        }
+        err = buildState->save();
+        if (err != NO_ERROR) {
+            goto bail;
+        }
+    }
+
     // At this point we've read everything and processed everything.  From here
     // on out it's just writing output files.
     if (SourcePos::hasErrors()) {
@@ -1814,6 +2044,14 @@ bail:
     if (SourcePos::hasErrors()) {
         SourcePos::printErrors(stderr);
     }
+    bundle->setBuildState(NULL);
+    delete buildState;
+    if (scanCache != NULL) {
+        // only written if the build state directory exists by now
+        scanCache->save();
+        bundle->setScanCache(NULL);
+        delete scanCache;
+    }
     return retVal;
 }
 
@@ -7,6 +7,7 @@
 
 #include <utils/Vector.h>
 #include <utils/String8.h>
+#include <utils/WorkQueue.h>
 
 #include "DirectoryWalker.h"
 #include "FileFinder.h"
@@ -28,9 +29,28 @@ CrunchCache::CrunchCache(String8 sourcePath, String8 destPath, FileFinder* ff)
     loadFiles();
 }
 
-size_t CrunchCache::crunch(CacheUpdater* cu, bool forceOverwrite)
+class CrunchWorkUnit : public WorkQueue::WorkUnit {
+public:
+    CrunchWorkUnit(CacheUpdater* cu, const String8& source, const String8& dest)
+        : mCacheUpdater(cu), mSource(source), mDest(dest) { }
+
+    virtual bool run() {
+        mCacheUpdater->processImage(mSource, mDest);
+        return true;
+    }
+
+private:
+    CacheUpdater* mCacheUpdater;
+    String8 mSource;
+    String8 mDest;
+};
+
+size_t CrunchCache::crunch(CacheUpdater* cu, bool forceOverwrite, size_t threads)
 {
     size_t numFilesUpdated = 0;
+    // Every file is crunched to its own destination, so they can all be
+    // processed at the same time.
+    WorkQueue wq(threads > 0 ? threads : 1, false);
 
     // Iterate through the source files and compare to cache.
     // After processing a file, remove it from the source files and
@@ -51,10 +71,15 @@ size_t CrunchCache::crunch(CacheUpdater* cu, bool forceOverwrite)
         relativePath = String8(rPathPtr + offset);
 
         if (forceOverwrite || needsUpdating(relativePath)) {
-            cu->processImage(mSourcePath.appendPathCopy(relativePath),
-                             mDestPath.appendPathCopy(relativePath));
+            CrunchWorkUnit* w = new CrunchWorkUnit(cu,
+                    mSourcePath.appendPathCopy(relativePath),
+                    mDestPath.appendPathCopy(relativePath));
+            if (wq.schedule(w) != NO_ERROR) {
+                // Fall back to crunching it right here.
+                w->run();
+                delete w;
+            }
             numFilesUpdated++;
-            // crunchFile(relativePath);
         }
         // Delete this file from the source files and (if it exists) from the
         // dest files.
@@ -62,6 +87,8 @@ size_t CrunchCache::crunch(CacheUpdater* cu, bool forceOverwrite)
         mDestFiles.removeItem(mDestPath.appendPathCopy(relativePath));
     }
 
+    wq.finish();
+
     // Iterate through what's left of destFiles and delete leftovers
     while (mDestFiles.size() > 0) {
         cu->deleteFile(mDestFiles.keyAt(0));
@@ -44,6 +44,8 @@ public:
      * source files are only crunched when they needUpdating. Afterwards,
      * we delete any leftover files in the cache that are no longer present
      * in source.
+     * With more than one thread, files are crunched concurrently, so
+     * cu->processImage must be safe to call from several threads at once.
      *
      * PRECONDITIONS:
      *      No setup besides construction is needed
@@ -52,7 +54,7 @@ public:
      *      The function then returns the number of files changed in cache
      *      (counting deletions).
      */
-    size_t crunch(CacheUpdater* cu, bool forceOverwrite=false);
+    size_t crunch(CacheUpdater* cu, bool forceOverwrite=false, size_t threads=1);
 
 private:
     /** loadFiles is a wrapper to the FileFinder that places matching
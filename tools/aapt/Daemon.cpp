@@ -0,0 +1,201 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Run the commands of a whole build in one aapt process.
+//
+
+#include "Main.h"
+#include "ResourceIdCache.h"
+#include "SourcePos.h"
+
+#include <androidfw/AssetManager.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+using namespace android;
+
+const char* const kDaemonDoneMarker = "aapt-daemon-done";
+
+/*
+ * The packages given with -I to the last command.  They are kept open, with
+ * their resource tables loaded, so that the next command that includes the
+ * same packages finds them in the shared zip cache of AssetManager instead of
+ * opening and inflating them again.
+ */
+static AssetManager* gIncludedAssets = NULL;
+static Vector<String8> gIncludedPaths;
+static Vector<time_t> gIncludedModWhen;
+
+static time_t getModWhen(const char* path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return (time_t) -1;
+    }
+    return st.st_mtime;
+}
+
+static void updateIncludedPackages(const Bundle* bundle)
+{
+    const Vector<const char*>& incl = bundle->getPackageIncludes();
+    const size_t N = incl.size();
+
+    bool same = N == gIncludedPaths.size();
+    for (size_t i=0; same && i<N; i++) {
+        same = gIncludedPaths[i] == incl[i] && gIncludedModWhen[i] == getModWhen(incl[i]);
+    }
+    if (same) {
+        return;
+    }
+
+    // The cached ids of the included packages may all have changed.
+    ResourceIdCache::clear();
+    delete gIncludedAssets;
+    gIncludedAssets = NULL;
+    gIncludedPaths.clear();
+    gIncludedModWhen.clear();
+
+    if (N == 0) {
+        return;
+    }
+
+    gIncludedAssets = new AssetManager();
+    for (size_t i=0; i<N; i++) {
+        gIncludedPaths.add(String8(incl[i]));
+        gIncludedModWhen.add(getModWhen(incl[i]));
+        // A missing package is reported by the command itself.
+        gIncludedAssets->addAssetPath(String8(incl[i]), NULL);
+    }
+    gIncludedAssets->getResources(false);
+}
+
+/*
+ * Read one line from fp, without its terminating newline.  Returns false at
+ * the end of the input.
+ */
+static bool readLine(FILE* fp, String8* outLine)
+{
+    char buf[1024];
+    bool readAny = false;
+
+    outLine->setTo("");
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+        readAny = true;
+        size_t len = strlen(buf);
+        if (len > 0 && buf[len-1] == '\n') {
+            buf[--len] = '\0';
+            if (len > 0 && buf[len-1] == '\r') {
+                buf[--len] = '\0';
+            }
+            outLine->append(buf, len);
+            return true;
+        }
+        outLine->append(buf, len);
+    }
+    return readAny;
+}
+
+/*
+ * Split a command line into arguments, separated by blanks.  Quotes group
+ * blanks into an argument and a backslash escapes the next character, as in
+ * the shell.  Returns false if a quote isn't closed.
+ */
+static bool splitArgs(const String8& line, Vector<String8>* outArgs)
+{
+    const char* p = line.string();
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+
+        String8 arg;
+        char quote = 0;
+        while (*p != '\0' && (quote != 0 || (*p != ' ' && *p != '\t'))) {
+            if (quote != 0 && *p == quote) {
+                quote = 0;
+            } else if (quote == 0 && (*p == '\'' || *p == '"')) {
+                quote = *p;
+            } else if (*p == '\\' && quote != '\'' && p[1] != '\0') {
+                p++;
+                arg.append(p, 1);
+            } else {
+                arg.append(p, 1);
+            }
+            p++;
+        }
+        if (quote != 0) {
+            return false;
+        }
+        outArgs->add(arg);
+    }
+    return true;
+}
+
+static int runCommandLine(const Vector<String8>& args)
+{
+    // The bundle keeps pointers into argv, and -I paths and the like are
+    // converted in place, so each command gets its own copy.
+    const int argc = args.size() + 1;
+    char** argv = new char*[argc + 1];
+    argv[0] = strdup("aapt");
+    for (int i=1; i<argc; i++) {
+        argv[i] = strdup(args[i-1].string());
+    }
+    argv[argc] = NULL;
+
+    // Options that are global to the process only last for one command.
+    gUserIgnoreAssets = NULL;
+
+    Bundle bundle;
+    int result = parseArgs(argc, argv, &bundle);
+    if (result == 0) {
+        updateIncludedPackages(&bundle);
+        result = handleCommand(&bundle);
+    }
+
+    SourcePos::clearErrors();
+    ResourceIdCache::clearAppIds();
+
+    for (int i=0; i<argc; i++) {
+        free(argv[i]);
+    }
+    delete[] argv;
+    return result;
+}
+
+int runDaemon(int argc, char* const argv[])
+{
+    if (argc != 0) {
+        fprintf(stderr, "ERROR: daemon takes no arguments\n");
+        return 2;
+    }
+
+    String8 line;
+    while (readLine(stdin, &line)) {
+        Vector<String8> args;
+        int result;
+        if (!splitArgs(line, &args)) {
+            fprintf(stderr, "ERROR: Unterminated quote in '%s'\n", line.string());
+            result = 2;
+        } else if (args.size() == 0) {
+            continue;
+        } else {
+            result = runCommandLine(args);
+        }
+        fflush(stderr);
+        printf("%s %d\n", kDaemonDoneMarker, result);
+        fflush(stdout);
+    }
+
+    delete gIncludedAssets;
+    gIncludedAssets = NULL;
+    return 0;
+}
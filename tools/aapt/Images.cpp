@@ -7,6 +7,7 @@
 #define PNG_INTERNAL
 
 #include "Images.h"
+#include "BuildState.h"
 
 #include <androidfw/ResourceTypes.h>
 #include <utils/ByteOrder.h>
@@ -384,15 +385,23 @@ static uint32_t get_color(
         return Res_png_9patch::TRANSPARENT_COLOR;
     }
 
+    // Compare whole pixels, or only their alpha if the patch is transparent.
+    uint32_t mask, expected;
+    if (color[3] == 0) {
+        const uint8_t alphaMask[4] = { 0, 0, 0, 0xff };
+        memcpy(&mask, alphaMask, 4);
+        expected = 0;
+    } else {
+        mask = 0xffffffff;
+        memcpy(&expected, color, 4);
+    }
+
     while (top <= bottom) {
-        for (int i = left; i <= right; i++) {
-            png_bytep p = rows[top]+i*4;
-            if (color[3] == 0) {
-                if (p[3] != 0) {
-                    return Res_png_9patch::NO_COLOR;
-                }
-            } else if (p[0] != color[0] || p[1] != color[1]
-                       || p[2] != color[2] || p[3] != color[3]) {
+        png_bytep p = rows[top] + left*4;
+        for (int i = left; i <= right; i++, p += 4) {
+            uint32_t pixel;
+            memcpy(&pixel, p, 4);
+            if ((pixel & mask) != expected) {
                 return Res_png_9patch::NO_COLOR;
             }
         }
@@ -816,10 +825,26 @@ static void analyze_image(const char *imageName, image_info &imageInfo, int gray
     bool isPalette = true;
     bool isGrayscale = true;
 
+    // Palette lookup: an open-addressed hash from color to index into colors,
+    // with twice as many slots as colors so that probe sequences stay short.
+    // Runs of the same color are common, so the last color is checked first.
+    const int kPaletteSlots = 512;
+    uint32_t slotColors[kPaletteSlots];
+    int16_t slotIndices[kPaletteSlots];
+    memset(slotIndices, -1, sizeof(slotIndices));
+    uint32_t lastColor = 0;
+    int lastIndex = -1;
+
+    // Alpha of all pixels ANDed together: 0xff iff the image is opaque.
+    int alphaAnd = 0xff;
+
     // Scan the entire image and determine if:
-    // 1. Every pixel has R == G == B (grayscale)
+    // 1. Every pixel has R == G == B (grayscale), ie. the deviation is 0
     // 2. Every pixel has A == 255 (opaque)
     // 3. There are no more than 256 distinct RGBA colors
+    //
+    // Deviation and alpha are accumulated without branches, and the scan stops
+    // once the answer can't change anymore.
 
     // NOISY(printf("Initial image data:\n"));
     // dump_image(w, h, imageInfo.rows, PNG_COLOR_TYPE_RGB_ALPHA);
@@ -827,66 +852,66 @@ static void analyze_image(const char *imageName, image_info &imageInfo, int gray
     for (j = 0; j < h; j++) {
         png_bytep row = imageInfo.rows[j];
         png_bytep out = outRows[j];
+        int rowDeviation = 0;
         for (i = 0; i < w; i++) {
-            rr = *row++;
-            gg = *row++;
-            bb = *row++;
-            aa = *row++;
-
-            int odev = maxGrayDeviation;
-            maxGrayDeviation = MAX(ABS(rr - gg), maxGrayDeviation);
-            maxGrayDeviation = MAX(ABS(gg - bb), maxGrayDeviation);
-            maxGrayDeviation = MAX(ABS(bb - rr), maxGrayDeviation);
-            if (maxGrayDeviation > odev) {
-                NOISY(printf("New max dev. = %d at pixel (%d, %d) = (%d %d %d %d)\n",
-                             maxGrayDeviation, i, j, rr, gg, bb, aa));
-            }
-
-            // Check if image is really grayscale
-            if (isGrayscale) {
-                if (rr != gg || rr != bb) {
-                     NOISY(printf("Found a non-gray pixel at %d, %d = (%d %d %d %d)\n",
-                                  i, j, rr, gg, bb, aa));
-                    isGrayscale = false;
-                }
-            }
+            rr = row[0];
+            gg = row[1];
+            bb = row[2];
+            aa = row[3];
+            row += 4;
 
-            // Check if image is really opaque
-            if (isOpaque) {
-                if (aa != 0xff) {
-                    NOISY(printf("Found a non-opaque pixel at %d, %d = (%d %d %d %d)\n",
-                                 i, j, rr, gg, bb, aa));
-                    isOpaque = false;
-                }
-            }
+            rowDeviation = MAX(ABS(rr - gg), rowDeviation);
+            rowDeviation = MAX(ABS(gg - bb), rowDeviation);
+            rowDeviation = MAX(ABS(bb - rr), rowDeviation);
+            alphaAnd &= aa;
 
             // Check if image is really <= 256 colors
             if (isPalette) {
                 col = (uint32_t) ((rr << 24) | (gg << 16) | (bb << 8) | aa);
-                bool match = false;
-                for (idx = 0; idx < num_colors; idx++) {
-                    if (colors[idx] == col) {
-                        match = true;
-                        break;
+                if (col == lastColor && lastIndex >= 0) {
+                    idx = lastIndex;
+                } else {
+                    int slot = (int) ((col * 2654435761u) >> 23);
+                    while (slotIndices[slot] >= 0 && slotColors[slot] != col) {
+                        slot = (slot + 1) & (kPaletteSlots - 1);
                     }
-                }
-
-                // Write the palette index for the pixel to outRows optimistically
-                // We might overwrite it later if we decide to encode as gray or
-                // gray + alpha
-                *out++ = idx;
-                if (!match) {
-                    if (num_colors == 256) {
+                    if (slotIndices[slot] >= 0) {
+                        idx = slotIndices[slot];
+                    } else if (num_colors == 256) {
                         NOISY(printf("Found 257th color at %d, %d\n", i, j));
                         isPalette = false;
+                        idx = num_colors;
                     } else {
+                        idx = num_colors;
                         colors[num_colors++] = col;
+                        slotColors[slot] = col;
+                        slotIndices[slot] = idx;
                     }
+                    lastColor = col;
+                    lastIndex = isPalette ? idx : -1;
                 }
+
+                // Write the palette index for the pixel to outRows optimistically
+                // We might overwrite it later if we decide to encode as gray or
+                // gray + alpha
+                *out++ = idx;
             }
         }
+        if (rowDeviation > maxGrayDeviation) {
+            NOISY(printf("New max dev. = %d in row %d\n", rowDeviation, j));
+            maxGrayDeviation = rowDeviation;
+        }
+
+        // Nothing the rest of the image holds can change the color type.
+        if (!isPalette && alphaAnd != 0xff && maxGrayDeviation > 0
+                && maxGrayDeviation > grayscaleTolerance) {
+            break;
+        }
     }
 
+    isGrayscale = maxGrayDeviation == 0;
+    isOpaque = alphaAnd == 0xff;
+
     *paletteEntries = 0;
     *hasTransparency = !isOpaque;
     int bpp = isOpaque ? 3 : 4;
@@ -970,9 +995,18 @@ static void analyze_image(const char *imageName, image_info &imageInfo, int gray
 }
 
 
+// Filter and deflate settings that write_png can be asked to use instead of
+// the ones it picks by default.
+struct png_encoding
+{
+    int filters;
+    int strategy;
+};
+
 static void write_png(const char* imageName,
                       png_structp write_ptr, png_infop write_info,
-                      image_info& imageInfo, int grayscaleTolerance)
+                      image_info& imageInfo, int grayscaleTolerance,
+                      const png_encoding* encoding)
 {
     bool optimize = true;
     png_uint_32 width, height;
@@ -998,6 +1032,10 @@ static void write_png(const char* imageName,
     }
 
     png_set_compression_level(write_ptr, Z_BEST_COMPRESSION);
+    if (encoding != NULL) {
+        png_set_compression_mem_level(write_ptr, 9);
+        png_set_compression_strategy(write_ptr, encoding->strategy);
+    }
 
     NOISY(printf("Writing image %s: w = %d, h = %d\n", imageName,
           (int) imageInfo.width, (int) imageInfo.height));
@@ -1046,6 +1084,11 @@ static void write_png(const char* imageName,
         if (hasTransparency) {
             png_set_tRNS(write_ptr, write_info, alphaPalette, paletteEntries, (png_color_16p) 0);
         }
+    }
+
+    if (encoding != NULL) {
+       png_set_filter(write_ptr, 0, encoding->filters);
+    } else if (color_type == PNG_COLOR_TYPE_PALETTE) {
        png_set_filter(write_ptr, 0, PNG_NO_FILTERS);
     } else {
        png_set_filter(write_ptr, 0, PNG_ALL_FILTERS);
@@ -1120,6 +1163,88 @@ static void write_png(const char* imageName,
                  compression_type));
 }
 
+// The settings tried for each image with --optimize-png.  Which one gives the
+// smallest file depends on the image: flat and palette images tend to do best
+// unfiltered or run-length coded, photographic ones with adaptive filtering.
+static const png_encoding kOptimizedEncodings[] = {
+    { PNG_NO_FILTERS, Z_DEFAULT_STRATEGY },
+    { PNG_NO_FILTERS, Z_RLE },
+    { PNG_ALL_FILTERS, Z_DEFAULT_STRATEGY },
+    { PNG_ALL_FILTERS, Z_FILTERED },
+    { PNG_FILTER_SUB, Z_FILTERED },
+    { PNG_FILTER_UP, Z_FILTERED },
+    { PNG_FILTER_PAETH, Z_FILTERED },
+};
+
+static status_t encode_png(const char* imageName, image_info& imageInfo,
+                           int grayscaleTolerance, const png_encoding* encoding,
+                           const sp<AaptFile>& file)
+{
+    png_structp write_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0,
+                                                    (png_error_ptr)NULL, (png_error_ptr)NULL);
+    if (!write_ptr) {
+        return UNKNOWN_ERROR;
+    }
+
+    png_infop write_info = png_create_info_struct(write_ptr);
+    if (!write_info) {
+        png_destroy_write_struct(&write_ptr, (png_infopp)NULL);
+        return UNKNOWN_ERROR;
+    }
+
+    png_set_write_fn(write_ptr, (void*)file.get(),
+                     png_write_aapt_file, png_flush_aapt_file);
+
+    if (setjmp(png_jmpbuf(write_ptr))) {
+        png_destroy_write_struct(&write_ptr, &write_info);
+        return UNKNOWN_ERROR;
+    }
+
+    write_png(imageName, write_ptr, write_info, imageInfo, grayscaleTolerance, encoding);
+
+    png_destroy_write_struct(&write_ptr, &write_info);
+    return NO_ERROR;
+}
+
+/*
+ * Write the processed image to file, either with the default settings or,
+ * with --optimize-png, with whichever of kOptimizedEncodings gives the
+ * smallest file.  That takes several times as long, so it is best combined
+ * with --build-state, which keeps the result until the source changes.
+ */
+static status_t write_processed_png(const Bundle* bundle, const char* imageName,
+                                    image_info& imageInfo, const sp<AaptFile>& file)
+{
+    if (!bundle->getOptimizePngs()) {
+        return encode_png(imageName, imageInfo, bundle->getGrayscaleTolerance(), NULL, file);
+    }
+
+    sp<AaptFile> best;
+    for (size_t i = 0; i < NELEM(kOptimizedEncodings); i++) {
+        sp<AaptFile> candidate = new AaptFile(file->getSourceFile(), AaptGroupEntry(), String8());
+        status_t err = encode_png(imageName, imageInfo, bundle->getGrayscaleTolerance(),
+                                  &kOptimizedEncodings[i], candidate);
+        if (err != NO_ERROR) {
+            return err;
+        }
+        NOISY(printf("Image %s: encoding %d is %d bytes\n", imageName, (int) i,
+                     (int) candidate->getSize()));
+        if (best == NULL || candidate->getSize() < best->getSize()) {
+            best = candidate;
+        }
+    }
+    return file->writeData(best->getData(), best->getSize());
+}
+
+// The output only depends on the contents of the source, whether it's a
+// 9-patch, the grayscale tolerance and whether it's optimized.
+static uint32_t get_build_state_options(const Bundle* bundle, bool isNinePatch)
+{
+    return (bundle->getOptimizePngs() ? 0x20000 : 0)
+            | (isNinePatch ? 0x10000 : 0)
+            | (bundle->getGrayscaleTolerance() & 0xffff);
+}
+
 status_t preProcessImage(const Bundle* bundle, const sp<AaptAssets>& assets,
                          const sp<AaptFile>& file, String8* outNewLeafName)
 {
@@ -1136,6 +1261,20 @@ status_t preProcessImage(const Bundle* bundle, const sp<AaptAssets>& assets,
 
     String8 printableName(file->getPrintableSource());
 
+    BuildState* buildState = bundle->getBuildState();
+    String8 buildStateKey;
+    if (buildState != NULL) {
+        const bool isNinePatch = file->getPath().getBasePath().getPathExtension() == ".9";
+        uint32_t options = get_build_state_options(bundle, isNinePatch);
+        if (BuildState::computeKey(file->getSourceFile(), options, &buildStateKey) == NO_ERROR
+                && buildState->restore(file->getPath(), buildStateKey, file)) {
+            if (bundle->getVerbose()) {
+                printf("Reusing processed image: %s\n", printableName.string());
+            }
+            return NO_ERROR;
+        }
+    }
+
     if (bundle->getVerbose()) {
         printf("Processing image: %s\n", printableName.string());
     }
@@ -1146,9 +1285,6 @@ status_t preProcessImage(const Bundle* bundle, const sp<AaptAssets>& assets,
 
     image_info imageInfo;
 
-    png_structp write_ptr = NULL;
-    png_infop write_info = NULL;
-
     status_t error = UNKNOWN_ERROR;
 
     const size_t nameLen = file->getPath().length();
@@ -1187,32 +1323,16 @@ status_t preProcessImage(const Bundle* bundle, const sp<AaptAssets>& assets,
         }
     }
 
-    write_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, (png_error_ptr)NULL,
-                                        (png_error_ptr)NULL);
-    if (!write_ptr)
-    {
-        goto bail;
-    }
-
-    write_info = png_create_info_struct(write_ptr);
-    if (!write_info)
-    {
+    if (write_processed_png(bundle, printableName.string(), imageInfo, file) != NO_ERROR) {
         goto bail;
     }
 
-    png_set_write_fn(write_ptr, (void*)file.get(),
-                     png_write_aapt_file, png_flush_aapt_file);
+    error = NO_ERROR;
 
-    if (setjmp(png_jmpbuf(write_ptr)))
-    {
-        goto bail;
+    if (buildState != NULL && buildStateKey.length() > 0) {
+        buildState->store(file->getPath(), buildStateKey, file);
     }
 
-    write_png(printableName.string(), write_ptr, write_info, imageInfo,
-              bundle->getGrayscaleTolerance());
-
-    error = NO_ERROR;
-
     if (bundle->getVerbose()) {
         fseek(fp, 0, SEEK_END);
         size_t oldSize = (size_t)ftell(fp);
@@ -1229,9 +1349,6 @@ bail:
     if (fp) {
         fclose(fp);
     }
-    if (write_ptr) {
-        png_destroy_write_struct(&write_ptr, &write_info);
-    }
 
     if (error != NO_ERROR) {
         fprintf(stderr, "ERROR: Failure processing PNG image %s\n",
@@ -1240,6 +1357,21 @@ bail:
     return error;
 }
 
+static status_t write_cache_file(const String8& dest, const sp<AaptFile>& file)
+{
+    FILE* fp = fopen(dest.string(), "wb");
+    if (!fp) {
+        fprintf(stderr, "%s ERROR: Unable to open PNG file\n", dest.string());
+        return UNKNOWN_ERROR;
+    }
+    size_t n = fwrite(file->getData(), 1, file->getSize(), fp);
+    if (fclose(fp) != 0 || n != file->getSize()) {
+        fprintf(stderr, "%s ERROR: Unable to write PNG file\n", dest.string());
+        return UNKNOWN_ERROR;
+    }
+    return NO_ERROR;
+}
+
 status_t preProcessImageToCache(const Bundle* bundle, const String8& source, const String8& dest)
 {
     png_structp read_ptr = NULL;
@@ -1249,11 +1381,25 @@ status_t preProcessImageToCache(const Bundle* bundle, const String8& source, con
 
     image_info imageInfo;
 
-    png_structp write_ptr = NULL;
-    png_infop write_info = NULL;
-
     status_t error = UNKNOWN_ERROR;
 
+    const bool isNinePatch = source.getBasePath().getPathExtension() == ".9";
+    sp<AaptFile> out = new AaptFile(source, AaptGroupEntry(), String8());
+
+    BuildState* buildState = bundle->getBuildState();
+    String8 buildStateKey;
+    if (buildState != NULL) {
+        uint32_t options = get_build_state_options(bundle, isNinePatch);
+        if (BuildState::computeKey(source, options, &buildStateKey) == NO_ERROR
+                && buildState->restore(source, buildStateKey, out)) {
+            if (bundle->getVerbose()) {
+                printf("Reusing processed image for cache: %s => %s\n",
+                       source.string(), dest.string());
+            }
+            return write_cache_file(dest, out);
+        }
+    }
+
     if (bundle->getVerbose()) {
         printf("Processing image to cache: %s => %s\n", source.string(), dest.string());
     }
@@ -1303,67 +1449,32 @@ status_t preProcessImageToCache(const Bundle* bundle, const String8& source, con
 
     // Check to see if we're dealing with a 9-patch
     // If we are, process appropriately
-    if (source.getBasePath().getPathExtension() == ".9")  {
+    if (isNinePatch)  {
         if (do_9patch(source.string(), &imageInfo) != NO_ERROR) {
             return error;
         }
     }
 
-    // Call libpng to create a structure to hold the processed image data
-    // that can be written to disk
-    write_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    if (!write_ptr) {
-        png_destroy_write_struct(&write_ptr, &write_info);
-        return error;
-    }
-
-    // Call libpng to create a structure to hold processed image info that can
-    // be written to disk
-    write_info = png_create_info_struct(write_ptr);
-    if (!write_info) {
-        png_destroy_write_struct(&write_ptr, &write_info);
+    // Process the image in memory, then write it out to disk
+    if (write_processed_png(bundle, dest.string(), imageInfo, out) != NO_ERROR) {
         return error;
     }
-
-    // Open up our destination file for writing
-    fp = fopen(dest.string(), "wb");
-    if (!fp) {
-        fprintf(stderr, "%s ERROR: Unable to open PNG file\n", dest.string());
-        png_destroy_write_struct(&write_ptr, &write_info);
+    error = write_cache_file(dest, out);
+    if (error != NO_ERROR) {
         return error;
     }
 
-    // Set up libpng to write to our file
-    png_init_io(write_ptr, fp);
-
-    // Set up a jump for libpng to long jump back on on errors
-    if (setjmp(png_jmpbuf(write_ptr))) {
-        fclose(fp);
-        png_destroy_write_struct(&write_ptr, &write_info);
-        return error;
+    if (buildState != NULL && buildStateKey.length() > 0) {
+        buildState->store(source, buildStateKey, out);
     }
 
-    // Actually write out to the new png
-    write_png(dest.string(), write_ptr, write_info, imageInfo,
-              bundle->getGrayscaleTolerance());
-
     if (bundle->getVerbose()) {
-        // Find the size of our new file
-        FILE* reader = fopen(dest.string(), "rb");
-        fseek(reader, 0, SEEK_END);
-        size_t newSize = (size_t)ftell(reader);
-        fclose(reader);
-
-        float factor = ((float)newSize)/oldSize;
+        float factor = ((float)out->getSize())/oldSize;
         int percent = (int)(factor*100);
         printf("  (processed image to cache entry %s: %d%% size of source)\n",
                dest.string(), percent);
     }
 
-    //Clean up
-    fclose(fp);
-    png_destroy_write_struct(&write_ptr, &write_info);
-
     return NO_ERROR;
 }
 
@@ -13,6 +13,7 @@
 #include <utils/Errors.h>
 
 #include <stdlib.h>
+#include <unistd.h>
 #include <getopt.h>
 #include <assert.h>
 #include <ctype.h>
@@ -55,7 +56,11 @@ void usage(void)
         "   resources        Print the resource table from the APK.\n"
         "   configurations   Print the configurations in the APK.\n"
         "   xmltree          Print the compiled xmls in the given assets.\n"
-        "   xmlstrings       Print the strings of the given compiled xml assets.\n\n", gProgName);
+        "   xmlstrings       Print the strings of the given compiled xml assets.\n"
+        "   badging, permissions and configurations accept several APKs, or @file to\n"
+        "   read their names from file, one per line.  They are dumped in parallel\n"
+        "   and each one's output is printed between \"apk: 'file'\" and\n"
+        "   \"status: 'result'\" lines.\n\n", gProgName);
     fprintf(stderr,
         " %s p[ackage] [-d][-f][-m][-u][-v][-x[ extending-resource-id]][-z][-M AndroidManifest.xml] \\\n"
         "        [-0 extension [-0 extension ...]] [-g tolerance] [-j jarfile] \\\n"
@@ -63,8 +68,8 @@ void usage(void)
         "        [--app-version VAL] [--app-version-name TEXT] [--custom-package VAL] \\\n"
         "        [--rename-manifest-package PACKAGE] \\\n"
         "        [--rename-instrumentation-target-package PACKAGE] \\\n"
-        "        [--utf16] [--auto-add-overlay] \\\n"
-        "        [--max-res-version VAL] \\\n"
+        "        [--utf16] [--auto-add-overlay] [--build-state DIR] [--optimize-png] \\\n"
+        "        [--max-res-version VAL] [--resource-id-cache DIR] \\\n"
         "        [-I base-package [-I base-package ...]] \\\n"
         "        [-A asset-source-dir]  [-G class-list-file] [-P public-definitions-file] \\\n"
         "        [-S resource-sources [-S resource-sources ...]] \\\n"
@@ -86,11 +91,21 @@ void usage(void)
         " %s a[dd] [-v] file.{zip,jar,apk} file1 [file2 ...]\n"
         "   Add specified files to Zip-compatible archive.\n\n", gProgName);
     fprintf(stderr,
-        " %s c[runch] [-v] -S resource-sources ... -C output-folder ...\n"
-        "   Do PNG preprocessing and store the results in output folder.\n\n", gProgName);
+        " %s c[runch] [-v] [--optimize-png] [--build-state DIR] -S resource-sources ...\n"
+        "        -C output-folder ...\n"
+        "   Do PNG preprocessing and store the results in output folder.  The build\n"
+        "   state directory must not be shared with a package command.\n\n", gProgName);
     fprintf(stderr,
         " %s v[ersion]\n"
         "   Print program version.\n\n", gProgName);
+    fprintf(stderr,
+        " %s daemon\n"
+        "   Read commands from stdin, one per line, each being the arguments of\n"
+        "   one of the commands above (e.g. \"package -f -I android.jar ...\").\n"
+        "   Arguments are separated by blanks and may be quoted with ' or \".\n"
+        "   After each command, a line \"%s\" followed by the exit status\n"
+        "   is written to stdout.  The included packages stay loaded between\n"
+        "   commands that use the same ones.\n\n", gProgName, kDaemonDoneMarker);
     fprintf(stderr,
         " Modifiers:\n"
         "   -a  print Android-specific data (resources, manifest) when listing\n"
@@ -181,6 +196,17 @@ void usage(void)
         "       Make the resources ID non constant. This is required to make an R java class\n"
         "       that does not contain the final value but is used to make reusable compiled\n"
         "       libraries that need to access resources.\n"
+        "   --build-state\n"
+        "       Directory in which processed images are kept between builds, so that\n"
+        "       only new and changed images are processed again.\n"
+        "   --optimize-png\n"
+        "       Encode each PNG several ways and keep the smallest result.  This is\n"
+        "       several times slower, use it with --build-state so that each image\n"
+        "       is only optimized once.\n"
+        "   --resource-id-cache\n"
+        "       Directory in which the ids of the resources of the included packages\n"
+        "       are kept between builds.  It can be shared by all the builds that\n"
+        "       include the same packages.\n"
         "   --ignore-assets\n"
         "       Assets to be ignored. Default pattern is:\n"
         "       %s\n",
@@ -211,19 +237,32 @@ int handleCommand(Bundle* bundle)
     }
 }
 
+size_t getWorkerThreadCount()
+{
+    // More threads than CPUs only cost memory.
+    long cpus = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (cpus < 1) {
+        cpus = 1;
+    } else if (cpus > 32) {
+        cpus = 32;
+    }
+    return size_t(cpus);
+}
+
 /*
- * Parse args.
+ * Parse args into the bundle.  Returns 0 on success, or the exit status.
  */
-int main(int argc, char* const argv[])
+int parseArgs(int argc, char* const argv[], Bundle* bundle)
 {
-    char *prog = argv[0];
-    Bundle bundle;
     bool wantUsage = false;
     int result = 1;    // pessimistically assume an error.
     int tolerance = 0;
 
     /* default to compression */
-    bundle.setCompressionMethod(ZipEntry::kCompressDeflated);
+    bundle->setCompressionMethod(ZipEntry::kCompressDeflated);
 
     if (argc < 2) {
         wantUsage = true;
@@ -231,19 +270,19 @@ int main(int argc, char* const argv[])
     }
 
     if (argv[1][0] == 'v')
-        bundle.setCommand(kCommandVersion);
+        bundle->setCommand(kCommandVersion);
     else if (argv[1][0] == 'd')
-        bundle.setCommand(kCommandDump);
+        bundle->setCommand(kCommandDump);
     else if (argv[1][0] == 'l')
-        bundle.setCommand(kCommandList);
+        bundle->setCommand(kCommandList);
     else if (argv[1][0] == 'a')
-        bundle.setCommand(kCommandAdd);
+        bundle->setCommand(kCommandAdd);
     else if (argv[1][0] == 'r')
-        bundle.setCommand(kCommandRemove);
+        bundle->setCommand(kCommandRemove);
     else if (argv[1][0] == 'p')
-        bundle.setCommand(kCommandPackage);
+        bundle->setCommand(kCommandPackage);
     else if (argv[1][0] == 'c')
-        bundle.setCommand(kCommandCrunch);
+        bundle->setCommand(kCommandCrunch);
     else {
         fprintf(stderr, "ERROR: Unknown command '%s'\n", argv[1]);
         wantUsage = true;
@@ -262,10 +301,10 @@ int main(int argc, char* const argv[])
         while (*cp != '\0') {
             switch (*cp) {
             case 'v':
-                bundle.setVerbose(true);
+                bundle->setVerbose(true);
                 break;
             case 'a':
-                bundle.setAndroidList(true);
+                bundle->setAndroidList(true);
                 break;
             case 'c':
                 argc--;
@@ -275,10 +314,10 @@ int main(int argc, char* const argv[])
                     wantUsage = true;
                     goto bail;
                 }
-                bundle.addConfigurations(argv[0]);
+                bundle->addConfigurations(argv[0]);
                 break;
             case 'f':
-                bundle.setForce(true);
+                bundle->setForce(true);
                 break;
             case 'g':
                 argc--;
@@ -289,39 +328,39 @@ int main(int argc, char* const argv[])
                     goto bail;
                 }
                 tolerance = atoi(argv[0]);
-                bundle.setGrayscaleTolerance(tolerance);
-                printf("%s: Images with deviation <= %d will be forced to grayscale.\n", prog, tolerance);
+                bundle->setGrayscaleTolerance(tolerance);
+                printf("%s: Images with deviation <= %d will be forced to grayscale.\n", gProgName, tolerance);
                 break;
             case 'k':
-                bundle.setJunkPath(true);
+                bundle->setJunkPath(true);
                 break;
             case 'm':
-                bundle.setMakePackageDirs(true);
+                bundle->setMakePackageDirs(true);
                 break;
             case 'o':
-                bundle.setIsOverlayPackage(true);
+                bundle->setIsOverlayPackage(true);
                 break;
 #if 0
             case 'p':
-                bundle.setPseudolocalize(true);
+                bundle->setPseudolocalize(true);
                 break;
 #endif
             case 'u':
-                bundle.setUpdate(true);
+                bundle->setUpdate(true);
                 break;
             case 'x':
-                bundle.setExtending(true);
+                bundle->setExtending(true);
                 argc--;
                 argv++;
                 if (!argc || !isdigit(argv[0][0])) {
                     argc++;
                     argv--;
                 } else {
-                    bundle.setExtendedPackageId(atoi(argv[0]));
+                    bundle->setExtendedPackageId(atoi(argv[0]));
                 }
                 break;
             case 'z':
-                bundle.setRequireLocalization(true);
+                bundle->setRequireLocalization(true);
                 break;
             case 'j':
                 argc--;
@@ -332,7 +371,7 @@ int main(int argc, char* const argv[])
                     goto bail;
                 }
                 convertPath(argv[0]);
-                bundle.addJarFile(argv[0]);
+                bundle->addJarFile(argv[0]);
                 break;
             case 'A':
                 argc--;
@@ -343,7 +382,7 @@ int main(int argc, char* const argv[])
                     goto bail;
                 }
                 convertPath(argv[0]);
-                bundle.setAssetSourceDir(argv[0]);
+                bundle->setAssetSourceDir(argv[0]);
                 break;
             case 'G':
                 argc--;
@@ -354,7 +393,7 @@ int main(int argc, char* const argv[])
                     goto bail;
                 }
                 convertPath(argv[0]);
-                bundle.setProguardFile(argv[0]);
+                bundle->setProguardFile(argv[0]);
                 break;
             case 'I':
                 argc--;
@@ -365,7 +404,7 @@ int main(int argc, char* const argv[])
                     goto bail;
                 }
                 convertPath(argv[0]);
-                bundle.addPackageInclude(argv[0]);
+                bundle->addPackageInclude(argv[0]);
                 break;
             case 'F':
                 argc--;
@@ -376,7 +415,7 @@ int main(int argc, char* const argv[])
                     goto bail;
                 }
                 convertPath(argv[0]);
-                bundle.setOutputAPKFile(argv[0]);
+                bundle->setOutputAPKFile(argv[0]);
                 break;
             case 'J':
                 argc--;
@@ -387,7 +426,7 @@ int main(int argc, char* const argv[])
                     goto bail;
                 }
                 convertPath(argv[0]);
-                bundle.setRClassDir(argv[0]);
+                bundle->setRClassDir(argv[0]);
                 break;
             case 'M':
                 argc--;
@@ -398,7 +437,7 @@ int main(int argc, char* const argv[])
                     goto bail;
                 }
                 convertPath(argv[0]);
-                bundle.setAndroidManifestFile(argv[0]);
+                bundle->setAndroidManifestFile(argv[0]);
                 break;
             case 'P':
                 argc--;
@@ -409,7 +448,7 @@ int main(int argc, char* const argv[])
                     goto bail;
                 }
                 convertPath(argv[0]);
-                bundle.setPublicOutputFile(argv[0]);
+                bundle->setPublicOutputFile(argv[0]);
                 break;
             case 'S':
                 argc--;
@@ -420,7 +459,7 @@ int main(int argc, char* const argv[])
                     goto bail;
                 }
                 convertPath(argv[0]);
-                bundle.addResourceSourceDir(argv[0]);
+                bundle->addResourceSourceDir(argv[0]);
                 break;
             case 'C':
                 argc--;
@@ -431,7 +470,7 @@ int main(int argc, char* const argv[])
                     goto bail;
                 }
                 convertPath(argv[0]);
-                bundle.setCrunchedOutputDir(argv[0]);
+                bundle->setCrunchedOutputDir(argv[0]);
                 break;
             case '0':
                 argc--;
@@ -442,14 +481,14 @@ int main(int argc, char* const argv[])
                     goto bail;
                 }
                 if (argv[0][0] != 0) {
-                    bundle.addNoCompressExtension(argv[0]);
+                    bundle->addNoCompressExtension(argv[0]);
                 } else {
-                    bundle.setCompressionMethod(ZipEntry::kCompressStored);
+                    bundle->setCompressionMethod(ZipEntry::kCompressStored);
                 }
                 break;
             case '-':
                 if (strcmp(cp, "-debug-mode") == 0) {
-                    bundle.setDebugMode(true);
+                    bundle->setDebugMode(true);
                 } else if (strcmp(cp, "-min-sdk-version") == 0) {
                     argc--;
                     argv++;
@@ -458,7 +497,7 @@ int main(int argc, char* const argv[])
                         wantUsage = true;
                         goto bail;
                     }
-                    bundle.setMinSdkVersion(argv[0]);
+                    bundle->setMinSdkVersion(argv[0]);
                 } else if (strcmp(cp, "-target-sdk-version") == 0) {
                     argc--;
                     argv++;
@@ -467,7 +506,7 @@ int main(int argc, char* const argv[])
                         wantUsage = true;
                         goto bail;
                     }
-                    bundle.setTargetSdkVersion(argv[0]);
+                    bundle->setTargetSdkVersion(argv[0]);
                 } else if (strcmp(cp, "-max-sdk-version") == 0) {
                     argc--;
                     argv++;
@@ -476,7 +515,7 @@ int main(int argc, char* const argv[])
                         wantUsage = true;
                         goto bail;
                     }
-                    bundle.setMaxSdkVersion(argv[0]);
+                    bundle->setMaxSdkVersion(argv[0]);
                 } else if (strcmp(cp, "-max-res-version") == 0) {
                     argc--;
                     argv++;
@@ -485,7 +524,7 @@ int main(int argc, char* const argv[])
                         wantUsage = true;
                         goto bail;
                     }
-                    bundle.setMaxResVersion(argv[0]);
+                    bundle->setMaxResVersion(argv[0]);
                 } else if (strcmp(cp, "-version-code") == 0) {
                     argc--;
                     argv++;
@@ -494,7 +533,7 @@ int main(int argc, char* const argv[])
                         wantUsage = true;
                         goto bail;
                     }
-                    bundle.setVersionCode(argv[0]);
+                    bundle->setVersionCode(argv[0]);
                 } else if (strcmp(cp, "-version-name") == 0) {
                     argc--;
                     argv++;
@@ -503,9 +542,9 @@ int main(int argc, char* const argv[])
                         wantUsage = true;
                         goto bail;
                     }
-                    bundle.setVersionName(argv[0]);
+                    bundle->setVersionName(argv[0]);
                 } else if (strcmp(cp, "-values") == 0) {
-                    bundle.setValues(true);
+                    bundle->setValues(true);
                 } else if (strcmp(cp, "-custom-package") == 0) {
                     argc--;
                     argv++;
@@ -514,7 +553,7 @@ int main(int argc, char* const argv[])
                         wantUsage = true;
                         goto bail;
                     }
-                    bundle.setCustomPackage(argv[0]);
+                    bundle->setCustomPackage(argv[0]);
                 } else if (strcmp(cp, "-extra-packages") == 0) {
                     argc--;
                     argv++;
@@ -523,11 +562,11 @@ int main(int argc, char* const argv[])
                         wantUsage = true;
                         goto bail;
                     }
-                    bundle.setExtraPackages(argv[0]);
+                    bundle->setExtraPackages(argv[0]);
                 } else if (strcmp(cp, "-generate-dependencies") == 0) {
-                    bundle.setGenDependencies(true);
+                    bundle->setGenDependencies(true);
                 } else if (strcmp(cp, "-utf16") == 0) {
-                    bundle.setWantUTF16(true);
+                    bundle->setWantUTF16(true);
                 } else if (strcmp(cp, "-preferred-configurations") == 0) {
                     argc--;
                     argv++;
@@ -536,7 +575,7 @@ int main(int argc, char* const argv[])
                         wantUsage = true;
                         goto bail;
                     }
-                    bundle.addPreferredConfigurations(argv[0]);
+                    bundle->addPreferredConfigurations(argv[0]);
                 } else if (strcmp(cp, "-rename-manifest-package") == 0) {
                     argc--;
                     argv++;
@@ -545,7 +584,7 @@ int main(int argc, char* const argv[])
                         wantUsage = true;
                         goto bail;
                     }
-                    bundle.setManifestPackageNameOverride(argv[0]);
+                    bundle->setManifestPackageNameOverride(argv[0]);
                 } else if (strcmp(cp, "-rename-instrumentation-target-package") == 0) {
                     argc--;
                     argv++;
@@ -554,9 +593,9 @@ int main(int argc, char* const argv[])
                         wantUsage = true;
                         goto bail;
                     }
-                    bundle.setInstrumentationPackageNameOverride(argv[0]);
+                    bundle->setInstrumentationPackageNameOverride(argv[0]);
                 } else if (strcmp(cp, "-auto-add-overlay") == 0) {
-                    bundle.setAutoAddOverlay(true);
+                    bundle->setAutoAddOverlay(true);
                 } else if (strcmp(cp, "-product") == 0) {
                     argc--;
                     argv++;
@@ -565,11 +604,31 @@ int main(int argc, char* const argv[])
                         wantUsage = true;
                         goto bail;
                     }
-                    bundle.setProduct(argv[0]);
+                    bundle->setProduct(argv[0]);
                 } else if (strcmp(cp, "-non-constant-id") == 0) {
-                    bundle.setNonConstantId(true);
+                    bundle->setNonConstantId(true);
                 } else if (strcmp(cp, "-no-crunch") == 0) {
-                    bundle.setUseCrunchCache(true);
+                    bundle->setUseCrunchCache(true);
+                } else if (strcmp(cp, "-optimize-png") == 0) {
+                    bundle->setOptimizePngs(true);
+                } else if (strcmp(cp, "-build-state") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--build-state' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle->setBuildStateDir(argv[0]);
+                } else if (strcmp(cp, "-resource-id-cache") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--resource-id-cache' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle->setResourceIdCacheDir(argv[0]);
                 } else if (strcmp(cp, "-ignore-assets") == 0) {
                     argc--;
                     argv++;
@@ -601,9 +660,9 @@ int main(int argc, char* const argv[])
     /*
      * We're past the flags.  The rest all goes straight in.
      */
-    bundle.setFileSpec(argv, argc);
+    bundle->setFileSpec(argv, argc);
 
-    result = handleCommand(&bundle);
+    result = 0;
 
 bail:
     if (wantUsage) {
@@ -611,6 +670,21 @@ bail:
         result = 2;
     }
 
+    return result;
+}
+
+int main(int argc, char* const argv[])
+{
+    if (argc >= 2 && strcmp(argv[1], "daemon") == 0) {
+        return runDaemon(argc - 2, argv + 2);
+    }
+
+    Bundle bundle;
+    int result = parseArgs(argc, argv, &bundle);
+    if (result == 0) {
+        result = handleCommand(&bundle);
+    }
+
     //printf("--> returning %d\n", result);
     return result;
 }
@@ -30,6 +30,13 @@ extern int doRemove(Bundle* bundle);
 extern int doPackage(Bundle* bundle);
 extern int doCrunch(Bundle* bundle);
 
+extern int parseArgs(int argc, char* const argv[], Bundle* bundle);
+extern int handleCommand(Bundle* bundle);
+
+// Runs the commands read from stdin, see Daemon.cpp.
+extern int runDaemon(int argc, char* const argv[]);
+extern const char* const kDaemonDoneMarker;
+
 extern int calcPercent(long uncompressedLen, long compressedLen);
 
 extern android::status_t writeAPK(Bundle* bundle,
@@ -38,6 +45,10 @@ extern android::status_t writeAPK(Bundle* bundle,
 
 extern android::status_t updatePreProcessedCache(Bundle* bundle);
 
+// Number of threads to use for work that can be split across resources, such
+// as processing images and compiling XML files: one per CPU.
+extern size_t getWorkerThreadCount();
+
 extern android::status_t buildResources(Bundle* bundle,
     const sp<AaptAssets>& assets);
 
@@ -12,8 +12,10 @@
 #include <utils/threads.h>
 #include <utils/List.h>
 #include <utils/Errors.h>
+#include <utils/WorkQueue.h>
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 #include <ctype.h>
 #include <errno.h>
@@ -32,12 +34,33 @@ static const char* kNoCompressExt[] = {
     ".amr", ".awb", ".wma", ".wmv"
 };
 
+/*
+ * Files larger than this are compressed while they are added, instead of
+ * being read into memory and compressed ahead of time.
+ */
+static const size_t kMaxPreparedSize = 16 * 1024 * 1024;
+
+/*
+ * A file to add to the archive.  Files are added in order, but their data
+ * may be prepared by a worker thread while the files before them are added.
+ */
+struct PackagedFile {
+    sp<AaptGroup> group;
+    sp<AaptFile> file;
+    ZipFile::PreparedEntry* prepared;   // NULL if not prepared ahead of time
+    status_t prepareResult;
+    bool prepareDone;
+};
+
 /* fwd decls, so I can write this downward */
 ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptAssets>& assets);
-ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
-                        const AaptGroupEntry& ge, const ResourceFilter* filter);
+void collectAssets(Bundle* bundle, const sp<AaptDir>& dir,
+                        const AaptGroupEntry& ge, const ResourceFilter* filter,
+                        Vector<PackagedFile>* files);
+ssize_t addPackagedFiles(Bundle* bundle, ZipFile* zip, Vector<PackagedFile>& files);
 bool processFile(Bundle* bundle, ZipFile* zip,
-                        const sp<AaptGroup>& group, const sp<AaptFile>& file);
+                        const sp<AaptGroup>& group, const sp<AaptFile>& file,
+                        const ZipFile::PreparedEntry* prepared = NULL);
 bool okayToCompress(Bundle* bundle, const String8& pathName);
 ssize_t processJarFiles(Bundle* bundle, ZipFile* zip);
 
@@ -105,6 +128,11 @@ status_t writeAPK(Bundle* bundle, const sp<AaptAssets>& assets,
         goto bail;
     }
 
+    // Only rewrite what changed when updating an existing package.
+    if (bundle->getUpdate()) {
+        zip->setAppendMode(true);
+    }
+
     if (bundle->getVerbose()) {
         printf("Writing all files...\n");
     }
@@ -224,28 +252,26 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip,
         return -1;
     }
 
-    ssize_t count = 0;
+    Vector<PackagedFile> files;
 
     const size_t N = assets->getGroupEntries().size();
     for (size_t i=0; i<N; i++) {
         const AaptGroupEntry& ge = assets->getGroupEntries()[i];
 
-        ssize_t res = processAssets(bundle, zip, assets, ge, &filter);
-        if (res < 0) {
-            return res;
-        }
-
-        count += res;
+        collectAssets(bundle, assets, ge, &filter, &files);
     }
 
-    return count;
+    return addPackagedFiles(bundle, zip, files);
 }
 
-ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
-        const AaptGroupEntry& ge, const ResourceFilter* filter)
+/*
+ * Append the files of dir to add to the archive, in the order they are
+ * added.
+ */
+void collectAssets(Bundle* bundle, const sp<AaptDir>& dir,
+        const AaptGroupEntry& ge, const ResourceFilter* filter,
+        Vector<PackagedFile>* files)
 {
-    ssize_t count = 0;
-
     const size_t ND = dir->getDirs().size();
     size_t i;
     for (i=0; i<ND; i++) {
@@ -257,15 +283,11 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
             continue;
         }
 
-        ssize_t res = processAssets(bundle, zip, subDir, ge, filterable ? filter : NULL);
-        if (res < 0) {
-            return res;
-        }
-        count += res;
+        collectAssets(bundle, subDir, ge, filterable ? filter : NULL, files);
     }
 
     if (filter != NULL && !filter->match(ge.toParams())) {
-        return count;
+        return;
     }
 
     const size_t NF = dir->getFiles().size();
@@ -273,12 +295,134 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
         sp<AaptGroup> gp = dir->getFiles().valueAt(i);
         ssize_t fi = gp->getFiles().indexOfKey(ge);
         if (fi >= 0) {
-            sp<AaptFile> fl = gp->getFiles().valueAt(fi);
-            if (!processFile(bundle, zip, gp, fl)) {
-                return UNKNOWN_ERROR;
+            PackagedFile pf;
+            pf.group = gp;
+            pf.file = gp->getFiles().valueAt(fi);
+            pf.prepared = NULL;
+            pf.prepareResult = NO_ERROR;
+            pf.prepareDone = false;
+            files->add(pf);
+        }
+    }
+}
+
+/*
+ * Whether the data of a file is worth preparing ahead of time: it must be
+ * compressed, as copying is no faster on another thread, and be added the
+ * usual way, which processFile() decides from its name.
+ */
+static bool shouldPrepare(Bundle* bundle, const PackagedFile& pf)
+{
+    String8 storageName(pf.group->getPath());
+    storageName.convertToResPath();
+    if (storageName.length() >= strlen(kExcludeExtension) &&
+            strcmp(storageName.string() + storageName.length() - strlen(kExcludeExtension),
+                   kExcludeExtension) == 0) {
+        return false;
+    }
+    if (strcasecmp(storageName.getPathExtension().string(), ".gz") == 0) {
+        return false;
+    }
+
+    if (pf.file->hasData()) {
+        return pf.file->getCompressionMethod() == ZipEntry::kCompressDeflated
+                && pf.file->getSize() <= kMaxPreparedSize;
+    }
+    if (bundle->getCompressionMethod() != ZipEntry::kCompressDeflated
+            || !okayToCompress(bundle, storageName)) {
+        return false;
+    }
+    struct stat st;
+    return stat(pf.file->getSourceFile().string(), &st) == 0
+            && (size_t) st.st_size <= kMaxPreparedSize;
+}
+
+class PrepareFileWorkUnit : public WorkQueue::WorkUnit {
+public:
+    PrepareFileWorkUnit(PackagedFile* pf, Mutex* lock, Condition* cond)
+        : mFile(pf), mLock(lock), mCond(cond) { }
+
+    virtual bool run() {
+        const sp<AaptFile>& file = mFile->file;
+        status_t err;
+        if (file->hasData()) {
+            err = ZipFile::prepareEntry(NULL, file->getData(), file->getSize(),
+                    file->getCompressionMethod(), mFile->prepared);
+        } else {
+            err = ZipFile::prepareEntry(file->getSourceFile().string(), NULL, 0,
+                    ZipEntry::kCompressDeflated, mFile->prepared);
+        }
+
+        AutoMutex _l(*mLock);
+        mFile->prepareResult = err;
+        mFile->prepareDone = true;
+        mCond->broadcast();
+        return true;
+    }
+
+private:
+    PackagedFile* mFile;
+    Mutex* mLock;
+    Condition* mCond;
+};
+
+/*
+ * Add the files to the archive in order.  Reading and compressing them is
+ * what takes time, so worker threads prepare the files a little ahead of the
+ * one being added, which keeps the archive identical to adding them one by
+ * one.
+ */
+ssize_t addPackagedFiles(Bundle* bundle, ZipFile* zip, Vector<PackagedFile>& files)
+{
+    const size_t threads = getWorkerThreadCount();
+    // enough to keep the workers busy while large files are written
+    const size_t window = threads * 4;
+    const size_t N = files.size();
+
+    Mutex lock;
+    Condition cond;
+    WorkQueue wq(threads, false);
+    size_t scheduled = 0;
+    ssize_t count = 0;
+
+    for (size_t i=0; i<N; i++) {
+        while (scheduled < N && scheduled < i + window) {
+            PackagedFile& pf = files.editItemAt(scheduled++);
+            if (threads > 1 && shouldPrepare(bundle, pf)) {
+                pf.prepared = new ZipFile::PreparedEntry;
+                if (wq.schedule(new PrepareFileWorkUnit(&pf, &lock, &cond)) != NO_ERROR) {
+                    delete pf.prepared;
+                    pf.prepared = NULL;
+                }
             }
-            count++;
         }
+
+        PackagedFile& pf = files.editItemAt(i);
+        if (pf.prepared != NULL) {
+            AutoMutex _l(lock);
+            while (!pf.prepareDone) {
+                cond.wait(lock);
+            }
+        }
+
+        // A file that couldn't be prepared is added the usual way, which
+        // reports the error.
+        const ZipFile::PreparedEntry* prepared =
+                pf.prepared != NULL && pf.prepareResult == NO_ERROR ? pf.prepared : NULL;
+        if (!processFile(bundle, zip, pf.group, pf.file, prepared)) {
+            count = UNKNOWN_ERROR;
+            break;
+        }
+        delete pf.prepared;
+        pf.prepared = NULL;
+        count++;
+    }
+
+    // the work units reference the files, wait for them before freeing
+    wq.cancel();
+    wq.finish();
+    for (size_t i=0; i<N; i++) {
+        delete files[i].prepared;
     }
 
     return count;
@@ -291,7 +435,8 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<AaptDir>& dir,
  * delete the existing entry before adding the new one.
  */
 bool processFile(Bundle* bundle, ZipFile* zip,
-                 const sp<AaptGroup>& group, const sp<AaptFile>& file)
+                 const sp<AaptGroup>& group, const sp<AaptFile>& file,
+                 const ZipFile::PreparedEntry* prepared)
 {
     const bool hasData = file->hasData();
 
@@ -372,6 +517,8 @@ bool processFile(Bundle* bundle, ZipFile* zip,
 
     if (fromGzip) {
         result = zip->addGzip(file->getSourceFile().string(), storageName.string(), &entry);
+    } else if (prepared != NULL) {
+        result = zip->add(*prepared, storageName.string(), &entry);
     } else if (!hasData) {
         /* don't compress certain files, e.g. PNGs */
         int compressionMethod = bundle->getCompressionMethod();
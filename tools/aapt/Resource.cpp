@@ -13,6 +13,7 @@
 #include "CrunchCache.h"
 #include "FileFinder.h"
 #include "CacheUpdater.h"
+#include "BuildState.h"
 
 #include <utils/WorkQueue.h>
 
@@ -26,9 +27,6 @@
 
 #define NOISY(x) // x
 
-// Number of threads to use for preprocessing images.
-static const size_t MAX_THREADS = 4;
-
 // ==========================================================================
 // ==========================================================================
 // ==========================================================================
@@ -335,7 +333,7 @@ static status_t preProcessImages(const Bundle* bundle, const sp<AaptAssets>& ass
     volatile bool hasErrors = false;
     ssize_t res = NO_ERROR;
     if (bundle->getUseCrunchCache() == false) {
-        WorkQueue wq(MAX_THREADS, false);
+        WorkQueue wq(getWorkerThreadCount(), false);
         ResourceDirIterator it(set, String8(type));
         while ((res=it.next()) == NO_ERROR) {
             PreProcessImageWorkUnit* w = new PreProcessImageWorkUnit(
@@ -563,6 +561,119 @@ static void checkForIds(const String8& path, ResXMLParser& parser)
     }
 }
 
+// One XML file of a resource type being compiled by compileXmlFiles().
+struct XmlCompileJob {
+    sp<AaptFile> file;
+    sp<XMLNode> root;
+    status_t err;
+};
+
+class ParseXmlWorkUnit : public WorkQueue::WorkUnit {
+public:
+    ParseXmlWorkUnit(XmlCompileJob* job) : mJob(job) { }
+
+    virtual bool run() {
+        mJob->root = XMLNode::parse(mJob->file);
+        mJob->err = mJob->root != NULL ? NO_ERROR : UNKNOWN_ERROR;
+        return true; // continue even if there are errors
+    }
+
+private:
+    XmlCompileJob* mJob;
+};
+
+class FlattenXmlWorkUnit : public WorkQueue::WorkUnit {
+public:
+    FlattenXmlWorkUnit(XmlCompileJob* job, int xmlFlags) : mJob(job), mXmlFlags(xmlFlags) { }
+
+    virtual bool run() {
+        mJob->err = flattenXmlTree(mJob->root, mJob->file, mXmlFlags);
+        mJob->root.clear(); // the tree isn't needed anymore
+        return true; // continue even if there are errors
+    }
+
+private:
+    XmlCompileJob* mJob;
+    int mXmlFlags;
+};
+
+/*
+ * Compiles all XML files of a resource type, like calling compileXmlFile() on
+ * each of them in turn. Parsing and flattening a file only involve the file
+ * itself, so they run on a WorkQueue. Resolving the trees against the table
+ * happens in between, serially and in the order of the files, so the table and
+ * the compiled files are exactly the same as if they were compiled one by one.
+ */
+static status_t compileXmlFiles(const sp<AaptAssets>& assets, ResourceTable* table,
+                                const sp<ResourceTypeSet>& set, const char* type,
+                                int xmlFlags, bool checkIds)
+{
+    Vector<XmlCompileJob> jobs;
+    ResourceDirIterator it(set, String8(type));
+    ssize_t res;
+    while ((res=it.next()) == NO_ERROR) {
+        XmlCompileJob job;
+        job.file = it.getFile();
+        job.err = NO_ERROR;
+        jobs.add(job);
+    }
+    bool hasErrors = res < NO_ERROR;
+
+    // The jobs vector doesn't change from here on, so the work units can
+    // point into it.
+    {
+        WorkQueue wq(getWorkerThreadCount(), false);
+        for (size_t i = 0; i < jobs.size(); i++) {
+            ParseXmlWorkUnit* w = new ParseXmlWorkUnit(&jobs.editItemAt(i));
+            if (wq.schedule(w) != NO_ERROR) {
+                w->run();
+                delete w;
+            }
+        }
+        if (wq.finish() != NO_ERROR) {
+            return UNKNOWN_ERROR;
+        }
+    }
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        XmlCompileJob& job = jobs.editItemAt(i);
+        if (job.err == NO_ERROR) {
+            job.err = compileXmlTree(assets, job.root, table, xmlFlags);
+        }
+    }
+
+    {
+        WorkQueue wq(getWorkerThreadCount(), false);
+        for (size_t i = 0; i < jobs.size(); i++) {
+            XmlCompileJob& job = jobs.editItemAt(i);
+            if (job.err != NO_ERROR) {
+                continue;
+            }
+            FlattenXmlWorkUnit* w = new FlattenXmlWorkUnit(&job, xmlFlags);
+            if (wq.schedule(w) != NO_ERROR) {
+                w->run();
+                delete w;
+            }
+        }
+        if (wq.finish() != NO_ERROR) {
+            return UNKNOWN_ERROR;
+        }
+    }
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const XmlCompileJob& job = jobs.itemAt(i);
+        if (job.err != NO_ERROR) {
+            hasErrors = true;
+        } else if (checkIds) {
+            ResXMLTree block;
+            block.setTo(job.file->getData(), job.file->getSize(), true);
+            checkForIds(job.file->getPrintableSource(), block);
+        }
+    }
+
+    return hasErrors ? UNKNOWN_ERROR : NO_ERROR;
+}
+
 static bool applyFileOverlay(Bundle *bundle,
                              const sp<AaptAssets>& assets,
                              sp<ResourceTypeSet> *baseSet,
@@ -830,15 +941,35 @@ status_t updatePreProcessedCache(Bundle* bundle)
     String8 source(bundle->getResourceSourceDirs()[0]);
     String8 dest(bundle->getCrunchedOutputDir());
 
+    // Images whose source was touched without changing are copied back from
+    // the build state rather than processed again.
+    BuildState* buildState = NULL;
+    if (bundle->getBuildStateDir() != NULL) {
+        buildState = new BuildState(String8(bundle->getBuildStateDir()));
+        if (buildState->load() != NO_ERROR) {
+            delete buildState;
+            return UNKNOWN_ERROR;
+        }
+        bundle->setBuildState(buildState);
+    }
+
     FileFinder* ff = new SystemFileFinder();
     CrunchCache cc(source,dest,ff);
 
     CacheUpdater* cu = new SystemCacheUpdater(bundle);
-    size_t numFiles = cc.crunch(cu);
+    size_t numFiles = cc.crunch(cu, false, getWorkerThreadCount());
 
     if (bundle->getVerbose())
         fprintf(stdout, "Crunched %d PNG files to update cache\n", (int)numFiles);
 
+    if (buildState != NULL) {
+        // the images that were up to date in the cache weren't looked at
+        buildState->retainExisting();
+        buildState->save();
+        bundle->setBuildState(NULL);
+        delete buildState;
+    }
+
     delete ff;
     delete cu;
 
@@ -1073,80 +1204,40 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
     // --------------------------------------------------------------
 
     if (layouts != NULL) {
-        ResourceDirIterator it(layouts, String8("layout"));
-        while ((err=it.next()) == NO_ERROR) {
-            String8 src = it.getFile()->getPrintableSource();
-            err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err == NO_ERROR) {
-                ResXMLTree block;
-                block.setTo(it.getFile()->getData(), it.getFile()->getSize(), true);
-                checkForIds(src, block);
-            } else {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
+        err = compileXmlFiles(assets, &table, layouts, "layout", xmlFlags, true);
+        if (err != NO_ERROR) {
             hasErrors = true;
         }
         err = NO_ERROR;
     }
 
     if (anims != NULL) {
-        ResourceDirIterator it(anims, String8("anim"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
+        err = compileXmlFiles(assets, &table, anims, "anim", xmlFlags, false);
+        if (err != NO_ERROR) {
             hasErrors = true;
         }
         err = NO_ERROR;
     }
 
     if (animators != NULL) {
-        ResourceDirIterator it(animators, String8("animator"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
+        err = compileXmlFiles(assets, &table, animators, "animator", xmlFlags, false);
+        if (err != NO_ERROR) {
             hasErrors = true;
         }
         err = NO_ERROR;
     }
 
     if (interpolators != NULL) {
-        ResourceDirIterator it(interpolators, String8("interpolator"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
+        err = compileXmlFiles(assets, &table, interpolators, "interpolator", xmlFlags, false);
+        if (err != NO_ERROR) {
             hasErrors = true;
         }
         err = NO_ERROR;
     }
 
     if (xmls != NULL) {
-        ResourceDirIterator it(xmls, String8("xml"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
+        err = compileXmlFiles(assets, &table, xmls, "xml", xmlFlags, false);
+        if (err != NO_ERROR) {
             hasErrors = true;
         }
         err = NO_ERROR;
@@ -1160,34 +1251,16 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets)
     }
 
     if (colors != NULL) {
-        ResourceDirIterator it(colors, String8("color"));
-        while ((err=it.next()) == NO_ERROR) {
-          err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
+        err = compileXmlFiles(assets, &table, colors, "color", xmlFlags, false);
+        if (err != NO_ERROR) {
             hasErrors = true;
         }
         err = NO_ERROR;
     }
 
     if (menus != NULL) {
-        ResourceDirIterator it(menus, String8("menu"));
-        while ((err=it.next()) == NO_ERROR) {
-            String8 src = it.getFile()->getPrintableSource();
-            err = compileXmlFile(assets, it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-            ResXMLTree block;
-            block.setTo(it.getFile()->getData(), it.getFile()->getSize(), true);
-            checkForIds(src, block);
-        }
-
-        if (err < NO_ERROR) {
+        err = compileXmlFiles(assets, &table, menus, "menu", xmlFlags, true);
+        if (err != NO_ERROR) {
             hasErrors = true;
         }
         err = NO_ERROR;
@@ -5,6 +5,20 @@
 //
 
 #include "ResourceIdCache.h"
+#include "ZipFile.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+// Bump whenever the format of the cache file or the resolution of names
+// changes, so that the files of an older aapt are never used.
+static const uint32_t kIdCacheVersion = 1;
 
 struct lutEntry {
     String16 package;
@@ -65,3 +79,129 @@ bool ResourceIdCache::store(const String16& package,
         return false;
     }
 }
+
+void ResourceIdCache::clear()
+{
+    lutUsed = 0;
+}
+
+void ResourceIdCache::clearAppIds()
+{
+    int kept = 0;
+    for (int i = 0; i < lutUsed; i++) {
+        if (lut[i].resId == 0 || (lut[i].resId >> 24) == 0x7f) {
+            continue;
+        }
+        if (kept != i) {
+            lut[kept] = lut[i];
+        }
+        kept++;
+    }
+    lutUsed = kept;
+}
+
+status_t ResourceIdCache::getCacheFile(const String8& dir,
+                                       const Vector<const char*>& includes,
+                                       String8* outFile)
+{
+    // The zip directory already records the size and checksum of each
+    // resources.arsc, so the packages don't need to be read.
+    String8 key;
+    key.appendFormat("%08x", kIdCacheVersion);
+    for (size_t i = 0; i < includes.size(); i++) {
+        ZipFile zip;
+        if (zip.open(includes[i], ZipFile::kOpenReadOnly) != NO_ERROR) {
+            return UNKNOWN_ERROR;
+        }
+        ZipEntry* entry = zip.getEntryByName("resources.arsc");
+        if (entry == NULL) {
+            return NAME_NOT_FOUND;
+        }
+        key.appendFormat(" %08x%08lx",
+                (uint32_t) entry->getUncompressedLen(), entry->getCRC32());
+    }
+
+    const Bytef* bytes = reinterpret_cast<const Bytef*>(key.string());
+    uLong crc = crc32(crc32(0L, Z_NULL, 0), bytes, key.size());
+    uLong adler = adler32(adler32(0L, Z_NULL, 0), bytes, key.size());
+    *outFile = dir;
+    outFile->appendPath(String8::format("ids-%08x%08x",
+            (uint32_t) crc, (uint32_t) adler));
+    return NO_ERROR;
+}
+
+status_t ResourceIdCache::load(const String8& file)
+{
+    if (lutUsed > 0) {
+        return NO_ERROR;
+    }
+    FILE* fp = fopen(file.string(), "r");
+    if (fp == NULL) {
+        return -errno;
+    }
+
+    // one "resId onlyPublic package type name" line per id
+    char line[4096];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char* fields[5];
+        char* p = line;
+        size_t n = 0;
+        while (n < 5) {
+            fields[n++] = p;
+            p = strpbrk(p, " \n");
+            if (p == NULL) {
+                break;
+            }
+            *p++ = 0;
+        }
+        if (n < 5) {
+            continue;
+        }
+        uint32_t resId = strtoul(fields[0], NULL, 16);
+        if (resId == 0) {
+            continue;
+        }
+        if (!store(String16(fields[2]), String16(fields[3]), String16(fields[4]),
+                fields[1][0] == '1', resId)) {
+            break;
+        }
+    }
+    fclose(fp);
+    return NO_ERROR;
+}
+
+status_t ResourceIdCache::save(const String8& file)
+{
+    String8 dir(file.getPathDir());
+    if (getFileType(dir.string()) == kFileTypeNonexistent) {
+#ifdef HAVE_MS_C_RUNTIME
+        _mkdir(dir.string());
+#else
+        mkdir(dir.string(), S_IRUSR|S_IWUSR|S_IXUSR|S_IRGRP|S_IXGRP);
+#endif
+    }
+
+    // Several builds may share the file, so it's written under a name of its
+    // own and renamed: readers only ever see a complete file.
+    String8 tempPath(file);
+    tempPath.appendFormat(".%d.tmp", (int) getpid());
+    FILE* fp = fopen(tempPath.string(), "w");
+    if (fp == NULL) {
+        return -errno;
+    }
+    for (int i = 0; i < lutUsed; i++) {
+        const lutEntry& e = lut[i];
+        // Only the ids of the included packages are the same for every build.
+        if (e.resId == 0 || (e.resId >> 24) == 0x7f) {
+            continue;
+        }
+        fprintf(fp, "%08x %d %s %s %s\n", e.resId, e.onlyPublic ? 1 : 0,
+                String8(e.package).string(), String8(e.type).string(),
+                String8(e.name).string());
+    }
+    if (fclose(fp) != 0 || rename(tempPath.string(), file.string()) != 0) {
+        unlink(tempPath.string());
+        return UNKNOWN_ERROR;
+    }
+    return NO_ERROR;
+}
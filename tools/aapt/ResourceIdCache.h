@@ -21,6 +21,27 @@ public:
                       const String16& name,
                       bool onlyPublic,
                       uint32_t resId);
+
+    // Forgets every cached id.
+    static void clear();
+
+    // Forgets the ids that may change from one build to the next: those of
+    // the application package and the names that were not found. The ids of
+    // the other packages only depend on the included packages.
+    static void clearAppIds();
+
+    // Sets outFile to the file, in dir, for the ids of the given included
+    // packages.  The name is derived from the resource tables of the packages,
+    // so that it changes whenever one of them does.
+    static status_t getCacheFile(const String8& dir,
+                                 const Vector<const char*>& includes,
+                                 String8* outFile);
+
+    // Adds the ids stored in file to the cache, if the cache is empty.
+    static status_t load(const String8& file);
+
+    // Stores the cached ids of the included packages in file.
+    static status_t save(const String8& file);
 };
 
 #endif
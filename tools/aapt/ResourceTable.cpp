@@ -49,6 +49,18 @@ status_t compileXmlFile(const sp<AaptAssets>& assets,
                         const sp<AaptFile>& target,
                         ResourceTable* table,
                         int options)
+{
+    status_t err = compileXmlTree(assets, root, table, options);
+    if (err != NO_ERROR) {
+        return err;
+    }
+    return flattenXmlTree(root, target, options);
+}
+
+status_t compileXmlTree(const sp<AaptAssets>& assets,
+                        const sp<XMLNode>& root,
+                        ResourceTable* table,
+                        int options)
 {
     if ((options&XML_COMPILE_STRIP_WHITESPACE) != 0) {
         root->removeWhitespace(true, NULL);
@@ -77,10 +89,16 @@ status_t compileXmlFile(const sp<AaptAssets>& assets,
     if (hasErrors) {
         return UNKNOWN_ERROR;
     }
-    
+    return NO_ERROR;
+}
+
+status_t flattenXmlTree(const sp<XMLNode>& root,
+                        const sp<AaptFile>& target,
+                        int options)
+{
     NOISY(printf("Input XML Resource:\n"));
     NOISY(root->print());
-    err = root->flatten(target,
+    status_t err = root->flatten(target,
             (options&XML_COMPILE_STRIP_COMMENTS) != 0,
             (options&XML_COMPILE_STRIP_RAW_VALUES) != 0);
     if (err != NO_ERROR) {
@@ -48,6 +48,18 @@ status_t compileXmlFile(const sp<AaptAssets>& assets,
                         ResourceTable* table,
                         int options = XML_COMPILE_STANDARD_RESOURCE);
 
+// The two halves of compileXmlFile(): compileXmlTree() resolves the tree against
+// the table, and flattenXmlTree() writes it out without touching anything but
+// the tree and target, so trees can be flattened on several threads at once.
+status_t compileXmlTree(const sp<AaptAssets>& assets,
+                        const sp<XMLNode>& xmlTree,
+                        ResourceTable* table,
+                        int options = XML_COMPILE_STANDARD_RESOURCE);
+
+status_t flattenXmlTree(const sp<XMLNode>& xmlTree,
+                        const sp<AaptFile>& target,
+                        int options = XML_COMPILE_STANDARD_RESOURCE);
+
 status_t compileResourceFile(Bundle* bundle,
                              const sp<AaptAssets>& assets,
                              const sp<AaptFile>& in,
@@ -0,0 +1,146 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Implementation file for ScanCache
+//
+
+#include "ScanCache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+ScanCache::ScanCache(const String8& file)
+    : mFile(file)
+{
+}
+
+status_t ScanCache::load()
+{
+    FILE* fp = fopen(mFile.string(), "r");
+    if (fp == NULL) {
+        // first build
+        return NO_ERROR;
+    }
+
+    // a "d modWhen path" line per directory, followed by a "type name" line
+    // per entry
+    char line[4096];
+    ssize_t current = -1;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char* end = strchr(line, '\n');
+        if (end == NULL) {
+            continue;
+        }
+        *end = 0;
+        char* sep = strchr(line, ' ');
+        if (sep == NULL) {
+            continue;
+        }
+        *sep = 0;
+        if (strcmp(line, "d") == 0) {
+            char* path = strchr(sep + 1, ' ');
+            if (path == NULL) {
+                current = -1;
+                continue;
+            }
+            *path++ = 0;
+            Listing listing;
+            listing.modWhen = (time_t) strtol(sep + 1, NULL, 10);
+            current = mPrevious.add(String8(path), listing);
+        } else if (current >= 0) {
+            Entry entry;
+            entry.name = sep + 1;
+            entry.type = (FileType) atoi(line);
+            mPrevious.editValueAt(current).entries.add(entry);
+        }
+    }
+    fclose(fp);
+    return NO_ERROR;
+}
+
+status_t ScanCache::scanDir(const String8& dir, Vector<Entry>* outEntries)
+{
+    DIR* d = opendir(dir.string());
+    if (d == NULL) {
+        return -errno;
+    }
+
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+            continue;
+        }
+        Entry entry;
+        entry.name = de->d_name;
+        entry.type = getFileType(dir.appendPathCopy(entry.name).string());
+        outEntries->add(entry);
+    }
+    closedir(d);
+    return NO_ERROR;
+}
+
+status_t ScanCache::listDir(const String8& dir, Vector<Entry>* outEntries)
+{
+    struct stat st;
+    if (stat(dir.string(), &st) != 0) {
+        return -errno;
+    }
+
+    ssize_t idx = mPrevious.indexOfKey(dir);
+    if (idx >= 0 && mPrevious.valueAt(idx).modWhen == st.st_mtime) {
+        *outEntries = mPrevious.valueAt(idx).entries;
+        mCurrent.replaceValueFor(dir, mPrevious.valueAt(idx));
+        return NO_ERROR;
+    }
+
+    time_t scanWhen = time(NULL);
+    status_t err = scanDir(dir, outEntries);
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    if (st.st_mtime >= scanWhen) {
+        return NO_ERROR;
+    }
+    for (size_t i = 0; i < outEntries->size(); i++) {
+        if (strchr(outEntries->itemAt(i).name.string(), '\n') != NULL) {
+            return NO_ERROR;
+        }
+    }
+    Listing listing;
+    listing.modWhen = st.st_mtime;
+    listing.entries = *outEntries;
+    mCurrent.replaceValueFor(dir, listing);
+    return NO_ERROR;
+}
+
+status_t ScanCache::save()
+{
+    // written under a temporary name and renamed, so that an interrupted
+    // build never leaves a truncated cache behind
+    String8 tempPath(mFile);
+    tempPath.append(".tmp");
+    FILE* fp = fopen(tempPath.string(), "w");
+    if (fp == NULL) {
+        return -errno;
+    }
+    for (size_t i = 0; i < mCurrent.size(); i++) {
+        const Listing& listing = mCurrent.valueAt(i);
+        fprintf(fp, "d %ld %s\n", (long) listing.modWhen, mCurrent.keyAt(i).string());
+        for (size_t j = 0; j < listing.entries.size(); j++) {
+            const Entry& entry = listing.entries[j];
+            fprintf(fp, "%d %s\n", (int) entry.type, entry.name.string());
+        }
+    }
+    if (fclose(fp) != 0 || rename(tempPath.string(), mFile.string()) != 0) {
+        unlink(tempPath.string());
+        return UNKNOWN_ERROR;
+    }
+    return NO_ERROR;
+}
@@ -0,0 +1,64 @@
+//
+// Copyright 2012 The Android Open Source Project
+//
+// Cache of the directory listings of the source trees, so that unchanged
+// directories don't need to be read and their entries stat'ed on every build.
+//
+
+#ifndef SCAN_CACHE_H
+#define SCAN_CACHE_H
+
+#include <utils/Errors.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+#include <utils/misc.h>
+
+using namespace android;
+
+/*
+ * Adding, removing or renaming an entry of a directory updates the
+ * modification time of the directory, so a listing recorded with the names
+ * and types of the entries stays valid as long as the directory's time
+ * doesn't change: listing it again only costs one stat() instead of reading
+ * it and stat'ing every entry.  The contents of files are not covered.
+ *
+ * Directories modified during the second they were read are not recorded,
+ * as a later change in the same second wouldn't change their time.
+ */
+class ScanCache {
+public:
+    struct Entry {
+        String8 name;
+        FileType type;
+    };
+
+    ScanCache(const String8& file);
+
+    /* Reads the listings recorded by the previous build, if any. */
+    status_t load();
+
+    /*
+     * Lists the entries of dir, other than "." and "..", in the order
+     * readdir() returns them.  Returns a negative errno on failure.
+     */
+    status_t listDir(const String8& dir, Vector<Entry>* outEntries);
+
+    /* Reads a directory without any cache. */
+    static status_t scanDir(const String8& dir, Vector<Entry>* outEntries);
+
+    /* Records the listings of the directories listed during this build. */
+    status_t save();
+
+private:
+    struct Listing {
+        time_t modWhen;
+        Vector<Entry> entries;
+    };
+
+    String8 mFile;
+    KeyedVector<String8, Listing> mPrevious;
+    KeyedVector<String8, Listing> mCurrent;
+};
+
+#endif // SCAN_CACHE_H
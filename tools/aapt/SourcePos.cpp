@@ -1,6 +1,7 @@
 #include "SourcePos.h"
 
 #include <stdarg.h>
+#include <utils/threads.h>
 #include <vector>
 
 using namespace std;
@@ -26,6 +27,8 @@ struct ErrorPos
     void print(FILE* to) const;
 };
 
+// Errors may be reported from the worker threads that compile resources.
+static android::Mutex g_errorsLock;
 static vector<ErrorPos> g_errors;
 
 ErrorPos::ErrorPos()
@@ -130,6 +133,7 @@ SourcePos::error(const char* fmt, ...) const
         *p = '\0';
         p--;
     }
+    android::AutoMutex _l(g_errorsLock);
     g_errors.push_back(ErrorPos(this->file, this->line, String8(buf), true));
     return retval;
 }
@@ -155,6 +159,7 @@ SourcePos::warning(const char* fmt, ...) const
 bool
 SourcePos::hasErrors()
 {
+    android::AutoMutex _l(g_errorsLock);
     return g_errors.size() > 0;
 }
 
@@ -167,5 +172,12 @@ SourcePos::printErrors(FILE* to)
     }
 }
 
+void
+SourcePos::clearErrors()
+{
+    android::AutoMutex _l(g_errorsLock);
+    g_errors.clear();
+}
+
 
 
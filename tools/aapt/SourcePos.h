@@ -22,6 +22,7 @@ public:
 
     static bool hasErrors();
     static void printErrors(FILE* to);
+    static void clearErrors();
 };
 
 
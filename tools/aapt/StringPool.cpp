@@ -102,10 +102,72 @@ int StringPool::entry::compare(const entry& o) const {
 }
 
 StringPool::StringPool(bool utf8) :
-        mUTF8(utf8), mValues(-1)
+        mUTF8(utf8), mValueCount(0)
 {
 }
 
+uint32_t StringPool::hashValue(const String16& value)
+{
+    // FNV-1a over the UTF-16 code units.
+    const char16_t* str = value.string();
+    const size_t N = value.size();
+    uint32_t hash = 2166136261u;
+    for (size_t i=0; i<N; i++) {
+        hash = (hash ^ str[i]) * 16777619u;
+    }
+    return hash;
+}
+
+ssize_t StringPool::findValue(const String16& value) const
+{
+    const size_t N = mValues.size();
+    if (N == 0) {
+        return -1;
+    }
+    const size_t mask = N - 1;
+    for (size_t i = hashValue(value) & mask; ; i = (i + 1) & mask) {
+        const ssize_t eidx = mValues[i];
+        if (eidx < 0 || mEntries[eidx].value == value) {
+            return eidx;
+        }
+    }
+}
+
+void StringPool::addValue(size_t eidx)
+{
+    if ((mValueCount + 1) * 2 > mValues.size()) {
+        growValues();
+    }
+    const String16& value = mEntries[eidx].value;
+    const size_t mask = mValues.size() - 1;
+    for (size_t i = hashValue(value) & mask; ; i = (i + 1) & mask) {
+        ssize_t& slot = mValues.editItemAt(i);
+        if (slot < 0) {
+            slot = eidx;
+            mValueCount++;
+            return;
+        }
+        if (mEntries[slot].value == value) {
+            slot = eidx;
+            return;
+        }
+    }
+}
+
+void StringPool::growValues()
+{
+    Vector<ssize_t> old(mValues);
+    const size_t N = old.size() > 0 ? old.size() * 2 : 64;
+    mValues.clear();
+    mValues.insertAt(-1, 0, N);
+    mValueCount = 0;
+    for (size_t i=0; i<old.size(); i++) {
+        if (old[i] >= 0) {
+            addValue(old[i]);
+        }
+    }
+}
+
 ssize_t StringPool::add(const String16& value, const Vector<entry_style_span>& spans,
         const String8* configTypeName, const ResTable_config* config)
 {
@@ -119,10 +181,10 @@ ssize_t StringPool::add(const String16& value, const Vector<entry_style_span>& s
 ssize_t StringPool::add(const String16& value,
         bool mergeDuplicates, const String8* configTypeName, const ResTable_config* config)
 {
-    ssize_t vidx = mValues.indexOfKey(value);
-    ssize_t pos = vidx >= 0 ? mValues.valueAt(vidx) : -1;
-    ssize_t eidx = pos >= 0 ? mEntryArray.itemAt(pos) : -1;
-    if (eidx < 0) {
+    ssize_t eidx = findValue(value);
+    const bool first = eidx < 0;
+    ssize_t pos = first ? -1 : mEntries[eidx].indices[0];
+    if (first) {
         eidx = mEntries.add(entry(value));
         if (eidx < 0) {
             fprintf(stderr, "Failure adding string %s\n", String8(value).string());
@@ -161,20 +223,19 @@ ssize_t StringPool::add(const String16& value,
         }
     }
 
-    const bool first = vidx < 0;
     const bool styled = (pos >= 0 && (size_t)pos < mEntryStyleArray.size()) ?
         mEntryStyleArray[pos].spans.size() : 0;
     if (first || styled || !mergeDuplicates) {
         pos = mEntryArray.add(eidx);
-        if (first) {
-            vidx = mValues.add(value, pos);
-        }
         entry& ent = mEntries.editItemAt(eidx);
         ent.indices.add(pos);
+        if (first) {
+            addValue(eidx);
+        }
     }
 
-    NOISY(printf("Adding string %s to pool: pos=%d eidx=%d vidx=%d\n",
-            String8(value).string(), pos, eidx, vidx));
+    NOISY(printf("Adding string %s to pool: pos=%d eidx=%d first=%d\n",
+            String8(value).string(), pos, eidx, first));
     
     return pos;
 }
@@ -327,9 +388,9 @@ void StringPool::sortByConfig()
     mEntryArray = newEntryArray;
     mEntryStyleArray = newEntryStyleArray;
     mValues.clear();
+    mValueCount = 0;
     for (size_t i=0; i<mEntries.size(); i++) {
-        const entry& ent = mEntries[i];
-        mValues.add(ent.value, ent.indices[0]);
+        addValue(i);
     }
 
 #if 0
@@ -566,9 +627,9 @@ ssize_t StringPool::offsetForString(const String16& val) const
 
 const Vector<size_t>* StringPool::offsetsForString(const String16& val) const
 {
-    ssize_t pos = mValues.valueFor(val);
-    if (pos < 0) {
+    ssize_t eidx = findValue(val);
+    if (eidx < 0) {
         return NULL;
     }
-    return &mEntries[mEntryArray[pos]].indices;
+    return &mEntries[eidx].indices;
 }
@@ -141,6 +141,12 @@ public:
 private:
     static int config_sort(void* state, const void* lhs, const void* rhs);
 
+    // Open-addressed hash of the strings in mEntries, for interning.
+    static uint32_t hashValue(const String16& value);
+    ssize_t findValue(const String16& value) const;
+    void addValue(size_t eidx);
+    void growValues();
+
     const bool                              mUTF8;
 
     // The following data structures represent the actual structures
@@ -164,9 +170,13 @@ private:
     // The following data structures are used for book-keeping as the
     // string pool is constructed.
 
-    // Unique set of all the strings added to the pool, mapped to
-    // the first index of mEntryArray where the value was added.
-    DefaultKeyedVector<String16, ssize_t>   mValues;
+    // Hash table of all the strings added to the pool: each slot holds
+    // the index in mEntries of the string, or -1 if the slot is empty.
+    // The first index of mEntryArray where a value was added is the first
+    // of its entry's indices.  The table is kept at most half full, and
+    // its size is always a power of two.
+    Vector<ssize_t>                         mValues;
+    size_t                                  mValueCount;
     // This array maps from the original position a string was placed at
     // in mEntryArray to its new position after being sorted with sortByConfig().
     Vector<size_t>                          mOriginalPosToNewPos;
@@ -529,6 +529,145 @@ bail:
     return result;
 }
 
+/*
+ * Read and compress the data of an entry, without touching the archive.
+ *
+ * The result is byte for byte what addCommon() would write for the same
+ * input, including falling back to storing data that doesn't compress well.
+ */
+status_t ZipFile::prepareEntry(const char* fileName, const void* data,
+    size_t size, int compressionMethod, PreparedEntry* pPrepared)
+{
+    Vector<unsigned char> contents;
+
+    assert(compressionMethod == ZipEntry::kCompressDeflated ||
+           compressionMethod == ZipEntry::kCompressStored);
+
+    if (!data) {
+        FILE* inputFp = fopen(fileName, FILE_OPEN_RO);
+        if (inputFp == NULL)
+            return errnoToStatus(errno);
+
+        unsigned char tmpBuf[32768];
+        size_t count;
+        while ((count = fread(tmpBuf, 1, sizeof(tmpBuf), inputFp)) > 0)
+            contents.appendArray(tmpBuf, count);
+        bool failed = ferror(inputFp);
+        pPrepared->modWhen = getModTime(fileno(inputFp));
+        fclose(inputFp);
+        if (failed) {
+            ALOGD("read failed (errno=%d)\n", errno);
+            return UNKNOWN_ERROR;
+        }
+        data = contents.array();
+        size = contents.size();
+    } else {
+        pPrepared->modWhen = (time_t) -1;
+    }
+
+    pPrepared->data.clear();
+    if (compressionMethod == ZipEntry::kCompressDeflated) {
+        status_t result = compressDataToBuffer(data, size, &pPrepared->data,
+            &pPrepared->crc32);
+        if (result != NO_ERROR) {
+            ALOGD("compression failed, storing\n");
+            compressionMethod = ZipEntry::kCompressStored;
+        } else {
+            /* same criteria as addCommon() */
+            long src = size;
+            long dst = pPrepared->data.size();
+            if (dst + (dst / 10) > src) {
+                ALOGD("insufficient compression (src=%ld dst=%ld), storing\n",
+                    src, dst);
+                compressionMethod = ZipEntry::kCompressStored;
+            }
+        }
+    }
+    if (compressionMethod == ZipEntry::kCompressStored) {
+        pPrepared->data.clear();
+        pPrepared->data.appendArray((const unsigned char*) data, size);
+        pPrepared->crc32 = crc32(crc32(0L, Z_NULL, 0),
+            (const unsigned char*) data, size);
+    }
+
+    pPrepared->uncompressedLen = size;
+    pPrepared->compressionMethod = compressionMethod;
+    return NO_ERROR;
+}
+
+/*
+ * Add an entry whose data was prepared by prepareEntry().
+ */
+status_t ZipFile::add(const PreparedEntry& prepared, const char* storageName,
+    ZipEntry** ppEntry)
+{
+    ZipEntry* pEntry = NULL;
+    status_t result = NO_ERROR;
+    long lfhPosn, startPosn, endPosn;
+    size_t size = prepared.data.size();
+    time_t modWhen;
+
+    if (mReadOnly)
+        return INVALID_OPERATION;
+
+    /* make sure we're in a reasonable state */
+    assert(mZipFp != NULL);
+    assert(mEntries.size() == mEOCD.mTotalNumEntries);
+
+    /* make sure it doesn't already exist */
+    if (getEntryByName(storageName) != NULL)
+        return ALREADY_EXISTS;
+
+    if (fseek(mZipFp, mEOCD.mCentralDirOffset, SEEK_SET) != 0)
+        return UNKNOWN_ERROR;
+
+    pEntry = new ZipEntry;
+    pEntry->initNew(storageName, NULL);
+
+    mNeedCDRewrite = true;
+
+    lfhPosn = ftell(mZipFp);
+    pEntry->mLFH.write(mZipFp);
+    startPosn = ftell(mZipFp);
+
+    if (size > 0 && fwrite(prepared.data.array(), 1, size, mZipFp) != size) {
+        // don't need to truncate; happens in CDE rewrite
+        ALOGD("fwrite %d bytes failed\n", (int) size);
+        result = UNKNOWN_ERROR;
+        goto bail;
+    }
+    endPosn = ftell(mZipFp);
+
+    pEntry->setDataInfo(prepared.uncompressedLen, endPosn - startPosn,
+        prepared.crc32, prepared.compressionMethod);
+    modWhen = prepared.modWhen != (time_t) -1 ?
+        prepared.modWhen : getModTime(fileno(mZipFp));
+    pEntry->setModWhen(modWhen);
+    pEntry->setLFHOffset(lfhPosn);
+    mEOCD.mNumEntries++;
+    mEOCD.mTotalNumEntries++;
+    mEOCD.mCentralDirSize = 0;      // mark invalid; set by flush()
+    mEOCD.mCentralDirOffset = endPosn;
+
+    /*
+     * Go back and write the LFH.
+     */
+    if (fseek(mZipFp, lfhPosn, SEEK_SET) != 0) {
+        result = UNKNOWN_ERROR;
+        goto bail;
+    }
+    pEntry->mLFH.write(mZipFp);
+
+    mEntries.add(pEntry);
+    if (ppEntry != NULL)
+        *ppEntry = pEntry;
+    pEntry = NULL;
+
+bail:
+    delete pEntry;
+    return result;
+}
+
 /*
  * Add an entry by copying it from another zip file.  If "padding" is
  * nonzero, the specified number of bytes will be added to the "extra"
@@ -868,6 +1007,83 @@ bail:
     return result;
 }
 
+/*
+ * Compress all of "data" into "pOut", using Deflate.
+ *
+ * The input is fed to zlib in the same chunks as compressFpToFp() does, so
+ * the output is identical.
+ */
+status_t ZipFile::compressDataToBuffer(const void* data, size_t size,
+    Vector<unsigned char>* pOut, unsigned long* pCRC32)
+{
+    const size_t kBufSize = 32768;
+    unsigned char outBuf[kBufSize];
+    z_stream zstream;
+    bool atEof = false;
+    int zerr;
+
+    memset(&zstream, 0, sizeof(zstream));
+    zstream.zalloc = Z_NULL;
+    zstream.zfree = Z_NULL;
+    zstream.opaque = Z_NULL;
+    zstream.next_in = NULL;
+    zstream.avail_in = 0;
+    zstream.next_out = outBuf;
+    zstream.avail_out = kBufSize;
+    zstream.data_type = Z_UNKNOWN;
+
+    zerr = deflateInit2(&zstream, Z_BEST_COMPRESSION,
+        Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+    if (zerr != Z_OK) {
+        if (zerr == Z_VERSION_ERROR) {
+            ALOGE("Installed zlib is not compatible with linked version (%s)\n",
+                ZLIB_VERSION);
+        } else {
+            ALOGD("Call to deflateInit2 failed (zerr=%d)\n", zerr);
+        }
+        return UNKNOWN_ERROR;
+    }
+
+    unsigned long crc = crc32(0L, Z_NULL, 0);
+    const unsigned char* in = (const unsigned char*) data;
+
+    do {
+        /* only take more input if the previous chunk was consumed */
+        if (zstream.avail_in == 0 && !atEof) {
+            size_t getSize = size > kBufSize ? kBufSize : size;
+            if (getSize < kBufSize)
+                atEof = true;
+
+            crc = crc32(crc, in, getSize);
+
+            zstream.next_in = (Bytef*) in;
+            zstream.avail_in = getSize;
+            in += getSize;
+            size -= getSize;
+        }
+
+        zerr = deflate(&zstream, atEof ? Z_FINISH : Z_NO_FLUSH);
+        if (zerr != Z_OK && zerr != Z_STREAM_END) {
+            ALOGD("zlib deflate call failed (zerr=%d)\n", zerr);
+            deflateEnd(&zstream);
+            return UNKNOWN_ERROR;
+        }
+
+        /* flush when we're full or when we're done */
+        if (zstream.avail_out == 0 ||
+            (zerr == Z_STREAM_END && zstream.avail_out != (uInt) kBufSize))
+        {
+            pOut->appendArray(outBuf, zstream.next_out - outBuf);
+            zstream.next_out = outBuf;
+            zstream.avail_out = kBufSize;
+        }
+    } while (zerr == Z_OK);
+
+    deflateEnd(&zstream);
+    *pCRC32 = crc;
+    return NO_ERROR;
+}
+
 /*
  * Mark an entry as deleted.
  *
@@ -907,7 +1123,10 @@ status_t ZipFile::flush(void)
 
     assert(mZipFp != NULL);
 
-    result = crunchArchive();
+    if (mAppendMode && getWastedSpace() * 2 <= mEOCD.mCentralDirOffset)
+        result = dropDeletedEntries();
+    else
+        result = crunchArchive();
     if (result != NO_ERROR)
         return result;
 
@@ -1043,6 +1262,77 @@ status_t ZipFile::crunchArchive(void)
     return result;
 }
 
+/*
+ * Get the end of the data of an entry, including its data descriptor.
+ */
+long ZipFile::getEntryEnd(const ZipEntry* pEntry)
+{
+    long end = pEntry->getFileOffset() + pEntry->getCompressedLen();
+    if (pEntry->mCDE.mGPBitFlag & ZipEntry::kUsesDataDescr)
+        end += 16;      // signature, CRC and both sizes
+    return end;
+}
+
+/*
+ * Count the bytes before the central directory that are not part of a
+ * live entry: the data of deleted entries, and the holes they left.
+ */
+long ZipFile::getWastedSpace(void) const
+{
+    long used = 0;
+    int count = mEntries.size();
+    for (int i = 0; i < count; i++) {
+        const ZipEntry* pEntry = mEntries[i];
+        if (!pEntry->getDeleted())
+            used += getEntryEnd(pEntry) - pEntry->getLFHOffset();
+    }
+    return mEOCD.mCentralDirOffset - used;
+}
+
+/*
+ * Forget about deleted files without moving anything, for append mode.
+ *
+ * The central directory is written right after the last live entry, so
+ * deleted entries at the end of the archive are reclaimed anyway.
+ */
+status_t ZipFile::dropDeletedEntries(void)
+{
+    int i, count;
+    long delCount, end;
+
+    count = mEntries.size();
+    delCount = end = 0;
+    for (i = 0; i < count; i++) {
+        ZipEntry* pEntry = mEntries[i];
+
+        if (pEntry->getDeleted()) {
+            delCount++;
+
+            delete pEntry;
+            mEntries.removeAt(i);
+
+            /* adjust loop control */
+            count--;
+            i--;
+        } else {
+            long entryEnd = getEntryEnd(pEntry);
+            if (entryEnd > end)
+                end = entryEnd;
+        }
+    }
+
+    assert(end <= mEOCD.mCentralDirOffset);
+    mEOCD.mCentralDirOffset = end;
+    mEOCD.mNumEntries -= delCount;
+    mEOCD.mTotalNumEntries -= delCount;
+    mEOCD.mCentralDirSize = 0;  // mark invalid; set by flush()
+
+    assert(mEOCD.mNumEntries == mEOCD.mTotalNumEntries);
+    assert(mEOCD.mNumEntries == count);
+
+    return NO_ERROR;
+}
+
 /*
  * Works like memmove(), but on pieces of a file.
  */
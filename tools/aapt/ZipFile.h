@@ -44,7 +44,8 @@ namespace android {
 class ZipFile {
 public:
     ZipFile(void)
-      : mZipFp(NULL), mReadOnly(false), mNeedCDRewrite(false)
+      : mZipFp(NULL), mReadOnly(false), mNeedCDRewrite(false),
+        mAppendMode(false)
       {}
     ~ZipFile(void) {
         if (!mReadOnly)
@@ -126,6 +127,40 @@ public:
     status_t add(const ZipFile* pSourceZip, const ZipEntry* pSourceEntry,
         int padding, ZipEntry** ppEntry);
 
+    /*
+     * The data of an entry, read and compressed ahead of time by
+     * prepareEntry().  Preparing doesn't touch the archive, so entries can
+     * be prepared on other threads while earlier ones are being added.
+     */
+    struct PreparedEntry {
+        PreparedEntry()
+            : uncompressedLen(0), crc32(0),
+              compressionMethod(ZipEntry::kCompressStored),
+              modWhen((time_t) -1)
+            {}
+
+        Vector<unsigned char> data;
+        long            uncompressedLen;
+        unsigned long   crc32;
+        int             compressionMethod;
+        time_t          modWhen;        // -1 for the time of the archive
+    };
+
+    /*
+     * Prepare the data of a file, or of an in-memory buffer if "data" is
+     * non-NULL, exactly as add() would store it.
+     */
+    static status_t prepareEntry(const char* fileName, const void* data,
+        size_t size, int compressionMethod, PreparedEntry* pPrepared);
+
+    /*
+     * Add an entry whose data was prepared by prepareEntry().
+     *
+     * If "ppEntry" is non-NULL, a pointer to the new entry will be returned.
+     */
+    status_t add(const PreparedEntry& prepared, const char* storageName,
+        ZipEntry** ppEntry);
+
     /*
      * Mark an entry as having been removed.  It is not actually deleted
      * from the archive or our internal data structures until flush() is
@@ -138,6 +173,15 @@ public:
      */
     status_t flush(void);
 
+    /*
+     * In append mode, flush() leaves the data of removed entries where it
+     * is, instead of shifting every later entry down over it, and only
+     * rewrites the central directory.  Updating an archive then costs about
+     * the size of what changed.  The space is reclaimed once more than half
+     * of the archive is wasted.
+     */
+    void setAppendMode(bool append) { mAppendMode = append; }
+
     /*
      * Expand the data into the buffer provided.  The buffer must hold
      * at least <uncompressed len> bytes.  Variation expands directly
@@ -233,14 +277,23 @@ private:
     /* copy some of "srcFp" into "dstFp" */
     status_t copyPartialFpToFp(FILE* dstFp, FILE* srcFp, long length,
         unsigned long* pCRC32);
+    /* drop deleted entries from mEntries, leaving their data in the file */
+    status_t dropDeletedEntries(void);
+    /* offset just past the data of an entry */
+    static long getEntryEnd(const ZipEntry* pEntry);
+    /* bytes of the archive not used by a live entry or the central dir */
+    long getWastedSpace(void) const;
     /* like memmove(), but on parts of a single file */
     status_t filemove(FILE* fp, off_t dest, off_t src, size_t n);
     /* compress all of "srcFp" into "dstFp", using Deflate */
     status_t compressFpToFp(FILE* dstFp, FILE* srcFp,
         const void* data, size_t size, unsigned long* pCRC32);
+    /* compress all of "data" into "pOut", the same way as compressFpToFp */
+    static status_t compressDataToBuffer(const void* data, size_t size,
+        Vector<unsigned char>* pOut, unsigned long* pCRC32);
 
     /* get modification date from a file descriptor */
-    time_t getModTime(int fd);
+    static time_t getModTime(int fd);
 
     /*
      * We use stdio FILE*, which gives us buffering but makes dealing
@@ -256,6 +309,7 @@ private:
 
     /* set this when we trash the central dir */
     bool            mNeedCDRewrite;
+    bool            mAppendMode;
 
     /*
      * One ZipEntry per entry in the zip file.  I'm using pointers instead
@@ -14,15 +14,19 @@
  * limitations under the License.
  */
 
+#include <androidfw/Keyboard.h>
 #include <androidfw/KeyCharacterMap.h>
 #include <androidfw/KeyLayoutMap.h>
 #include <androidfw/VirtualKeyMap.h>
 #include <utils/PropertyMap.h>
 #include <utils/String8.h>
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 using namespace android;
 
@@ -41,9 +45,11 @@ static void usage() {
     fprintf(stderr, "Keymap Validation Tool\n\n");
     fprintf(stderr, "Usage:\n");
     fprintf(stderr,
-        " %s [*.kl] [*.kcm] [*.idc] [virtualkeys.*] [...]\n"
+        " %s [-c] [*.kl] [*.kcm] [*.idc] [virtualkeys.*] [...]\n"
         "   Validates the specified key layouts, key character maps, \n"
-        "   input device configurations, or virtual key definitions.\n\n",
+        "   input device configurations, or virtual key definitions.\n"
+        "   With -c, also writes the compiled form of each key layout and\n"
+        "   key character map next to it (*.klc, *.kcmc).\n\n",
         gProgName);
 }
 
@@ -68,9 +74,23 @@ static FileType getFileType(const char* filename) {
     return FILETYPE_UNKNOWN;
 }
 
-static bool validateFile(const char* filename) {
+static int openCompiledFile(const char* filename) {
+    String8 path(getCompiledKeyMapFilePath(String8(filename)));
+    int fd = open(path.string(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error %d creating compiled file '%s'.\n\n", errno, path.string());
+    }
+    return fd;
+}
+
+static bool validateFile(const char* filename, bool compile) {
     fprintf(stdout, "Validating file '%s'...\n", filename);
 
+    // Make sure that the file itself is parsed rather than a stale compiled form.
+    if (compile) {
+        unlink(getCompiledKeyMapFilePath(String8(filename)).string());
+    }
+
     FileType fileType = getFileType(filename);
     switch (fileType) {
     case FILETYPE_UNKNOWN:
@@ -84,6 +104,18 @@ static bool validateFile(const char* filename) {
             fprintf(stderr, "Error %d parsing key layout file.\n\n", status);
             return false;
         }
+        if (compile) {
+            int fd = openCompiledFile(filename);
+            if (fd < 0) {
+                return false;
+            }
+            status = map->writeCompiled(fd);
+            close(fd);
+            if (status) {
+                fprintf(stderr, "Error %d writing compiled key layout file.\n\n", status);
+                return false;
+            }
+        }
         break;
     }
 
@@ -95,6 +127,19 @@ static bool validateFile(const char* filename) {
             fprintf(stderr, "Error %d parsing key character map file.\n\n", status);
             return false;
         }
+        if (compile) {
+            int fd = openCompiledFile(filename);
+            if (fd < 0) {
+                return false;
+            }
+            status = map->writeCompiled(fd);
+            close(fd);
+            if (status) {
+                fprintf(stderr, "Error %d writing compiled key character map file.\n\n",
+                        status);
+                return false;
+            }
+        }
         break;
     }
 
@@ -131,9 +176,16 @@ int main(int argc, const char** argv) {
         return 1;
     }
 
+    int first = 1;
+    bool compile = false;
+    if (strcmp(argv[1], "-c") == 0) {
+        compile = true;
+        first = 2;
+    }
+
     int result = 0;
-    for (int i = 1; i < argc; i++) {
-        if (!validateFile(argv[i])) {
+    for (int i = first; i < argc; i++) {
+        if (!validateFile(argv[i], compile)) {
             result = 1;
         }
     }